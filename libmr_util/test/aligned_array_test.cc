@@ -0,0 +1,260 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "ducc0/infra/aligned_array.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/math/fft.h"
+#include "ducc0/math/constants.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+bool aligned(const void *ptr)
+  { return (reinterpret_cast<uintptr_t>(ptr)&63)==0; }
+
+template<typename Func> void in_thread(Func func)
+  {
+  thread t(func);
+  t.join();
+  }
+
+// blocks are recycled within their size class, on the releasing thread
+void test_pool_reuse()
+  {
+  MR_assert(scratch_array<double>(0).data()==nullptr, "bug");
+  const void *p1;
+  {
+  scratch_array<double> a(1000);
+  MR_assert(aligned(a.data()), "misaligned");
+  p1 = a.data();
+  }
+  {
+  scratch_array<double> a(900); // same size class (8 kB)
+  MR_assert(a.data()==p1, "block not reused");
+  scratch_array<double> b(900);
+  MR_assert(b.data()!=p1, "block handed out twice");
+  }
+
+  // many blocks alive at the same time must not overlap, including blocks
+  // above the huge page threshold
+  vector<scratch_array<size_t>> arrs;
+  for (size_t i=0; i<40; ++i)
+    {
+    arrs.emplace_back(size_t(1)<<(i%22));
+    MR_assert(aligned(arrs.back().data()), "misaligned");
+    for (size_t j=0; j<arrs.back().size(); ++j)
+      arrs.back()[j] = i;
+    }
+  for (size_t i=0; i<arrs.size(); ++i)
+    for (size_t j=0; j<arrs[i].size(); ++j)
+      MR_assert(arrs[i][j]==i, "blocks overlap");
+  }
+
+// blocks released on another thread go into that thread's cache
+void test_pool_cross_thread()
+  {
+  auto a = make_unique<scratch_array<double>>(3000);
+  const void *pa = a->data();
+  const void *pb=nullptr;
+  in_thread([&]
+    {
+    a.reset(); // released by a thread which did not allocate it
+    scratch_array<double> b(3000);
+    pb = b.data();
+    });
+  MR_assert(pb==pa, "block not cached on the releasing thread");
+
+  // allocate on one thread, use and release on others
+  constexpr size_t nthr=8, n=20;
+  vector<unique_ptr<scratch_array<int>>> blocks(nthr*n);
+  for (size_t i=0; i<blocks.size(); ++i)
+    blocks[i] = make_unique<scratch_array<int>>(100+37*i);
+  vector<thread> threads;
+  atomic<size_t> nbad(0);
+  for (size_t t=0; t<nthr; ++t)
+    threads.emplace_back([&, t]
+      {
+      for (size_t i=t; i<blocks.size(); i+=nthr)
+        {
+        auto &blk(*blocks[i]);
+        for (size_t j=0; j<blk.size(); ++j) blk[j] = int(i+j);
+        }
+      // the freshly cached blocks are handed out again to this thread
+      for (size_t i=t; i<blocks.size(); i+=nthr)
+        {
+        for (size_t j=0; j<blocks[i]->size(); ++j)
+          if ((*blocks[i])[j]!=int(i+j)) ++nbad;
+        blocks[i].reset();
+        scratch_array<int> tmp(100+37*i);
+        for (size_t j=0; j<tmp.size(); ++j) tmp[j] = -1;
+        }
+      });
+  for (auto &t: threads) t.join();
+  MR_assert(nbad==0, "data corrupted");
+  }
+
+/* Releases its block when the thread exits. Since it is constructed before
+   the thread's pool, it is destroyed after it. */
+struct LateRelease
+  {
+  unique_ptr<scratch_array<double>> arr;
+  atomic<int> *done;
+  ~LateRelease()
+    {
+    arr.reset();
+    // allocations must still work, bypassing the (destroyed) pool
+    scratch_array<double> tmp(500);
+    MR_assert(aligned(tmp.data()), "misaligned");
+    tmp[499] = 1.;
+    ++(*done);
+    }
+  };
+
+// releasing blocks after the pool of a thread is gone
+void test_pool_thread_exit()
+  {
+  atomic<int> done(0);
+  for (size_t i=0; i<4; ++i)
+    in_thread([&]
+      {
+      static thread_local LateRelease late;
+      late.done = &done;
+      scratch_array<double> warm(500); // constructs the pool
+      late.arr = make_unique<scratch_array<double>>(500);
+      });
+  MR_assert(done==4, "destructor did not run");
+
+  // blocks allocated by threads which have exited can be released and
+  // cached by the main thread
+  unique_ptr<scratch_array<double>> a;
+  in_thread([&] { a = make_unique<scratch_array<double>>(12345); });
+  const void *pa = a->data();
+  a.reset();
+  scratch_array<double> b(12345);
+  MR_assert(b.data()==pa, "block not cached");
+  }
+
+// releasing cached blocks, and limiting the cache size
+void test_pool_trim()
+  {
+  auto oldmax = scratch_pool::get_max_cached();
+  scratch_pool::trim();
+  MR_assert(scratch_pool::cached_bytes()==0, "cache not empty");
+  {
+  scratch_array<char> a(1000), b(5000), c(100000);
+  }
+  MR_assert(scratch_pool::cached_bytes()==1024+8192+131072, "bad cache size");
+  scratch_pool::trim(10000); // the largest blocks are released first
+  MR_assert(scratch_pool::cached_bytes()==1024+8192, "bad cache size");
+  scratch_pool::trim();
+  MR_assert(scratch_pool::cached_bytes()==0, "cache not empty");
+
+  // a lower limit applies to the cache of every thread
+  size_t othercache=0;
+  in_thread([&]
+    {
+    { scratch_array<char> a(1<<20); }
+    MR_assert(scratch_pool::cached_bytes()==(1<<20), "block not cached");
+    scratch_pool::set_max_cached(16384);
+    MR_assert(scratch_pool::cached_bytes()==0, "cache not trimmed");
+    });
+  in_thread([&]
+    {
+    { scratch_array<char> a(8192), b(8192), c(8192); }
+    othercache = scratch_pool::cached_bytes();
+    });
+  MR_assert(othercache==16384, "limit ignored");
+  scratch_pool::set_max_cached(0);
+  {
+  scratch_array<char> a(100);
+  }
+  MR_assert(scratch_pool::cached_bytes()==0, "caching not disabled");
+  scratch_pool::set_max_cached(oldmax);
+  }
+
+/* FFTs take all their temporary buffers from the pool; their results must
+   agree with the direct sum, and repeated transforms on warm caches (and
+   on another thread) must give bitwise the same results. */
+void test_pool_fft()
+  {
+  for (size_t n: {64, 720, 1009, 4*1009})
+    {
+    constexpr size_t nlines=3;
+    mav<complex<double>,2> in({nlines,n}), out({nlines,n}), out2({nlines,n});
+    for (size_t i=0; i<nlines; ++i)
+      for (size_t j=0; j<n; ++j)
+        in.v(i,j) = complex<double>(sin(1.+i+0.37*j), cos(2.*i+0.11*j));
+    fmav<complex<double>> fin(in), fout(out), fout2(out2);
+    c2c(fin, fout, {1}, true, 1.);
+    c2c(fin, fout2, {1}, true, 1.);
+    MR_assert(fout2.size()==fout.size(), "bug");
+    for (size_t i=0; i<nlines; ++i)
+      for (size_t j=0; j<n; ++j)
+        MR_assert(out(i,j)==out2(i,j), "results differ");
+    in_thread([&] { c2c(fin, fout2, {1}, true, 1.); });
+    for (size_t i=0; i<nlines; ++i)
+      for (size_t j=0; j<n; ++j)
+        MR_assert(out(i,j)==out2(i,j), "results differ");
+
+    double err=0, nrm=0;
+    for (size_t k=0; k<n; k+=(n/16)+1)
+      {
+      complex<double> sum=0;
+      for (size_t j=0; j<n; ++j)
+        sum += in(0,j)*polar(1., -2*pi*double((j*k)%n)/double(n));
+      err = max(err, abs(sum-out(0,k)));
+      nrm = max(nrm, abs(sum));
+      }
+    MR_assert(err<=1e-12*nrm, "inaccurate FFT");
+    }
+  }
+
+void runtest(function<void()> tf, const char *tn)
+  {
+  tf();
+  printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  runtest(test_pool_reuse,"scratch pool reuse");
+  runtest(test_pool_cross_thread,"scratch pool across threads");
+  runtest(test_pool_thread_exit,"scratch pool at thread exit");
+  runtest(test_pool_trim,"scratch pool trimming");
+  runtest(test_pool_fft,"FFTs with pooled buffers");
+  }
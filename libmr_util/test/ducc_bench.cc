@@ -0,0 +1,431 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  \file ducc_bench.cc
+ *  Benchmark driver for spherical harmonic transforms, HEALPix, the
+ *  wgridder and the Interpolator.
+ *
+ *  Usage: ducc_bench [key=value ...]
+ *    suite=sht,healpix,wgridder,interpol   groups to measure
+ *    nthreads=1,4                  thread counts (default: 1 and all)
+ *    nrep=5                        timed repetitions per case; the reported
+ *                                  numbers are the minimum and the median
+ *    quick=true                    only use small problem sizes
+ *    geom=gauss,cc,healpix         SHT geometries
+ *    lmax=511,2047                 SHT band limits (default depends on quick)
+ *    spin=0,2                      SHT spins
+ *    epsilon=1e-5                  accuracy of the wgridder and Interpolator
+ *    seed=42                       seed for the random input data
+ *    json=FILE                     write all results to FILE
+ *    tag=STRING                    free-form label stored in the JSON file
+ *
+ *  Every case is run once untimed before the repetitions, so that plan
+ *  caches and the thread pool are warm.
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <complex>
+#include <vector>
+#include <string>
+#include <map>
+#include <any>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include "ducc0/sharp/sharp.h"
+#include "ducc0/sharp/sharp_geomhelpers.h"
+#include "ducc0/sharp/sharp_almhelpers.h"
+#include "ducc0/healpix/healpix_base.h"
+#include "ducc0/math/constants.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/timers.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/string_utils.h"
+#include "ducc0/infra/error_handling.h"
+#include "python/gridder_cxx.h"
+#include "python/totalconvolve.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+struct Result
+  {
+  string suite, name, params;
+  size_t nthreads, nrep;
+  double t_min, t_median;
+  };
+
+struct Config
+  {
+  size_t nrep;
+  bool quick;
+  vector<size_t> nthreads;
+  mt19937 rng;
+  };
+
+/* Runs \a func once untimed and then \a nrep times; returns the fastest
+   and the median run time. */
+pair<double,double> measure(const function<void()> &func, size_t nrep)
+  {
+  func();
+  vector<double> times;
+  for (size_t i=0; i<nrep; ++i)
+    {
+    SimpleTimer t;
+    func();
+    times.push_back(t());
+    }
+  sort(times.begin(), times.end());
+  double median = (nrep&1) ? times[nrep/2]
+                           : 0.5*(times[nrep/2-1]+times[nrep/2]);
+  return make_pair(times[0], median);
+  }
+
+void print_header()
+  {
+  cout << left << setw(10) << "suite" << setw(14) << "case" << setw(32)
+       << "parameters" << right << setw(5) << "thr" << setw(6) << "nrep"
+       << setw(12) << "min[s]" << setw(12) << "median[s]" << endl;
+  }
+
+void print_result(const Result &r)
+  {
+  cout << left << setw(10) << r.suite << setw(14) << r.name << setw(32)
+       << r.params << right << setw(5) << r.nthreads << setw(6) << r.nrep
+       << scientific << setprecision(3)
+       << setw(12) << r.t_min << setw(12) << r.t_median
+       << defaultfloat << endl;
+  }
+
+void run(vector<Result> &results, const string &suite, const string &name,
+  const string &params, size_t nthreads, size_t nrep,
+  const function<void()> &func)
+  {
+  auto tm = measure(func, nrep);
+  Result r{suite, name, params, nthreads, nrep, tm.first, tm.second};
+  print_result(r);
+  results.push_back(r);
+  }
+
+template<typename T> void fill_random(T *ptr, size_t n, mt19937 &rng)
+  {
+  uniform_real_distribution<double> dist(-0.5,0.5);
+  for (size_t i=0; i<n; ++i)
+    {
+    if constexpr (is_same<T, complex<double>>::value)
+      ptr[i] = T(dist(rng), dist(rng));
+    else
+      ptr[i] = T(dist(rng));
+    }
+  }
+
+/* Fills \a alm with random coefficients that are valid input for a
+   transform of the given spin (real a_l0, zero for l<spin). */
+template<typename T> void random_alm(Alm<complex<T>> &alm, size_t spin,
+  mt19937 &rng)
+  {
+  uniform_real_distribution<double> dist(-1.,1.);
+  for (size_t m=0; m<=alm.Mmax(); ++m)
+    for (size_t l=m; l<=alm.Lmax(); ++l)
+      alm.Alms().v(alm.index(l,m)) = (l<spin) ? complex<T>(0) :
+        complex<T>(T(dist(rng)), (m==0) ? T(0) : T(dist(rng)));
+  }
+
+/* Random (theta, phi, psi) triples. */
+mav<double,2> random_pointings(size_t n, mt19937 &rng)
+  {
+  mav<double,2> ptg({n,3});
+  uniform_real_distribution<double> dist(0.,1.);
+  for (size_t i=0; i<n; ++i)
+    {
+    ptg.v(i,0) = acos(1.-2.*dist(rng));
+    ptg.v(i,1) = twopi*dist(rng);
+    ptg.v(i,2) = twopi*dist(rng);
+    }
+  return ptg;
+  }
+
+void bench_sht(Config &cfg, const vector<string> &geoms,
+  const vector<size_t> &lmaxes, const vector<size_t> &spins, vector<Result> &results)
+  {
+  for (const auto &geom: geoms)
+    for (auto lmax: lmaxes)
+      for (auto spin: spins)
+        {
+        unique_ptr<sharp_geom_info> ginfo;
+        if (geom=="gauss")
+          ginfo = sharp_make_gauss_geom_info(lmax+1, 2*lmax+2, 0., 1, 2*lmax+2);
+        else if (geom=="cc")
+          ginfo = sharp_make_cc_geom_info(lmax+2, 2*lmax+2, 0., 1, 2*lmax+2);
+        else if (geom=="healpix")
+          ginfo = sharp_make_healpix_geom_info(max<size_t>(1,(lmax+1)/2), 1);
+        else
+          MR_fail("unknown geometry '"+geom+"'");
+        auto ainfo = sharp_make_triangular_alm_info(lmax, lmax, 1);
+        size_t npix=0;
+        for (size_t i=0; i<ginfo->nrings(); ++i)
+          npix += ginfo->nph(i);
+        size_t ncomp = (spin==0) ? 1 : 2;
+        vector<Alm<complex<double>>> alm;
+        vector<vector<double>> maps(ncomp, vector<double>(npix));
+        vector<any> av, mv;
+        for (size_t i=0; i<ncomp; ++i)
+          {
+          alm.emplace_back(lmax, lmax);
+          random_alm(alm[i], spin, cfg.rng);
+          }
+        for (size_t i=0; i<ncomp; ++i)
+          {
+          av.push_back(alm[i].Alms().vdata());
+          mv.push_back(maps[i].data());
+          }
+        string params = geom+" lmax="+dataToString(lmax)
+          +" spin="+dataToString(spin);
+        for (auto nthr: cfg.nthreads)
+          {
+          run(results, "sht", "alm2map", params, nthr, cfg.nrep, [&]
+            { sharp_execute(SHARP_ALM2MAP, spin, av, mv, *ginfo, *ainfo, 0,
+                            int(nthr)); });
+          run(results, "sht", "map2alm", params, nthr, cfg.nrep, [&]
+            { sharp_execute(SHARP_MAP2ALM, spin, av, mv, *ginfo, *ainfo, 0,
+                            int(nthr)); });
+          }
+        }
+  }
+
+/* Splits the \a n items into chunks and calls \a func(lo, hi) on up to
+   \a nthreads threads, like the Python interface does for batch
+   conversions. */
+void batch(size_t n, size_t nthreads, const function<void(size_t,size_t)> &func)
+  {
+  execStatic(n, nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext())
+      func(rng.lo, rng.hi);
+    });
+  }
+
+void bench_healpix(Config &cfg, vector<Result> &results)
+  {
+  size_t npoints = cfg.quick ? 100000 : 4000000;
+  size_t ndisc = cfg.quick ? 100 : 2000;
+  for (auto nside: cfg.quick ? vector<int64_t>{256} : vector<int64_t>{256, 8192})
+    for (auto scheme: {RING, NEST})
+      {
+      Healpix_Base2 base(nside, scheme, SET_NSIDE);
+      uniform_real_distribution<double> dist(0.,1.);
+      vector<pointing> ang(npoints);
+      for (auto &a: ang)
+        a = pointing(acos(1.-2.*dist(cfg.rng)), twopi*dist(cfg.rng));
+      vector<vec3> vec(npoints);
+      for (size_t i=0; i<npoints; ++i)
+        vec[i] = ang[i].to_vec3();
+      vector<int64_t> pix(npoints);
+      for (auto &p: pix)
+        p = int64_t(dist(cfg.rng)*base.Npix())%base.Npix();
+      vector<int64_t> pixout(npoints);
+      vector<vec3> vecout(npoints);
+      string params = string((scheme==RING) ? "ring" : "nest")
+        +" nside="+dataToString(nside)+" n="+dataToString(npoints);
+      string dparams = string((scheme==RING) ? "ring" : "nest")
+        +" nside="+dataToString(nside)+" n="+dataToString(ndisc);
+      for (auto nthr: cfg.nthreads)
+        {
+        run(results, "healpix", "ang2pix", params, nthr, cfg.nrep, [&]
+          {
+          batch(npoints, nthr, [&](size_t lo, size_t hi)
+            { base.ang2pix(&ang[lo], &pixout[lo], hi-lo); });
+          });
+        run(results, "healpix", "vec2pix", params, nthr, cfg.nrep, [&]
+          {
+          batch(npoints, nthr, [&](size_t lo, size_t hi)
+            { base.vec2pix(&vec[lo], &pixout[lo], hi-lo); });
+          });
+        run(results, "healpix", "pix2vec", params, nthr, cfg.nrep, [&]
+          {
+          batch(npoints, nthr, [&](size_t lo, size_t hi)
+            { base.pix2vec(&pix[lo], &vecout[lo], hi-lo); });
+          });
+        if (scheme==NEST)
+          run(results, "healpix", "nest2ring", params, nthr, cfg.nrep, [&]
+            {
+            batch(npoints, nthr, [&](size_t lo, size_t hi)
+              {
+              for (size_t i=lo; i<hi; ++i)
+                pixout[i] = base.nest2ring(pix[i]);
+              });
+            });
+        // disks of 1 degree radius around the first ndisc directions
+        run(results, "healpix", "query_disc", dparams, nthr, cfg.nrep, [&]
+          {
+          batch(ndisc, nthr, [&](size_t lo, size_t hi)
+            {
+            rangeset<int64_t> pixset;
+            for (size_t i=lo; i<hi; ++i)
+              base.query_disc(ang[i], pi/180., pixset);
+            });
+          });
+        }
+      }
+  }
+
+void bench_wgridder(Config &cfg, double epsilon, vector<Result> &results)
+  {
+  size_t npix = cfg.quick ? 256 : 2048;
+  size_t nrow = cfg.quick ? 10000 : 1000000;
+  size_t nchan = cfg.quick ? 10 : 16;
+  constexpr double speedoflight=299792458., f0=1e9;
+  double pixsize = pi/180./npix;  // one degree field of view
+  mav<double,1> freq({nchan});
+  for (size_t i=0; i<nchan; ++i)
+    freq.v(i) = f0 + i*(f0/nchan);
+  mav<double,2> uvw({nrow,3});
+  fill_random(uvw.vdata(), uvw.size(), cfg.rng);
+  for (size_t i=0; i<nrow; ++i)
+    for (size_t j=0; j<3; ++j)
+      uvw.v(i,j) /= pixsize*f0/speedoflight*((j==2) ? 20. : 1.);
+  mav<complex<double>,2> ms({nrow,nchan});
+  fill_random(ms.vdata(), ms.size(), cfg.rng);
+  mav<double,2> dirty({npix,npix});
+  fill_random(dirty.vdata(), dirty.size(), cfg.rng);
+  mav<double,2> wgt({0,0}), dirty_out({npix,npix});
+  mav<uint8_t,2> mask({0,0});
+  mav<complex<double>,2> ms_out({nrow,nchan});
+  for (auto do_w: {false, true})
+    {
+    string params = "npix="+dataToString(npix)+" nvis="
+      +dataToString(nrow*nchan)+(do_w ? " w" : "");
+    for (auto nthr: cfg.nthreads)
+      {
+      run(results, "wgridder", "ms2dirty", params, nthr, cfg.nrep, [&]
+        {
+        ms2dirty(uvw, freq, ms, wgt, mask, pixsize, pixsize, 0, 0, epsilon,
+          do_w, nthr, dirty_out, 0);
+        });
+      run(results, "wgridder", "dirty2ms", params, nthr, cfg.nrep, [&]
+        {
+        dirty2ms(uvw, freq, dirty, wgt, mask, pixsize, pixsize, 0, 0, epsilon,
+          do_w, nthr, ms_out, 0);
+        });
+      }
+    }
+  }
+
+void bench_interpol(Config &cfg, double epsilon, vector<Result> &results)
+  {
+  size_t lmax = cfg.quick ? 127 : 1023;
+  size_t kmax = 8;
+  size_t nptg = cfg.quick ? 100000 : 10000000;
+  double ofmin = 1.5;
+  vector<Alm<complex<double>>> slm, blm;
+  slm.emplace_back(lmax, lmax);
+  random_alm(slm[0], 0, cfg.rng);
+  blm.emplace_back(lmax, kmax);
+  random_alm(blm[0], 0, cfg.rng);
+  auto ptg = random_pointings(nptg, cfg.rng);
+  mav<double,2> res({nptg,1});
+  string params = "lmax="+dataToString(lmax)+" kmax="+dataToString(kmax)
+    +" n="+dataToString(nptg);
+  for (auto nthr: cfg.nthreads)
+    {
+    run(results, "interpol", "setup", params, nthr, cfg.nrep, [&]
+      { Interpolator<double> inter(slm, blm, false, epsilon, ofmin, int(nthr)); });
+    Interpolator<double> inter(slm, blm, false, epsilon, ofmin, int(nthr));
+    run(results, "interpol", "interpol", params, nthr, cfg.nrep, [&]
+      { inter.interpol(ptg, res); });
+    Interpolator<double> inter2(lmax, kmax, 1, epsilon, ofmin, int(nthr));
+    run(results, "interpol", "deinterpol", params, nthr, cfg.nrep, [&]
+      { inter2.deinterpol(ptg, res); });
+    }
+  }
+
+void write_json(const string &fname, const string &tag,
+  const vector<Result> &results)
+  {
+  ofstream out(fname);
+  MR_assert(out, "could not open '"+fname+"' for writing");
+  out << setprecision(8);
+  out << "{\n  \"tag\": \"" << tag << "\",\n";
+  out << "  \"default_nthreads\": " << get_default_nthreads() << ",\n";
+  out << "  \"results\": [\n";
+  for (size_t i=0; i<results.size(); ++i)
+    {
+    const auto &r(results[i]);
+    out << "    {\"suite\": \"" << r.suite << "\", \"case\": \"" << r.name
+        << "\", \"params\": \"" << r.params << "\", \"nthreads\": "
+        << r.nthreads << ", \"nrep\": " << r.nrep << ", \"t_min\": "
+        << r.t_min << ", \"t_median\": " << r.t_median
+        << "}" << ((i+1<results.size()) ? "," : "") << "\n";
+    }
+  out << "  ]\n}\n";
+  }
+
+template<typename T> vector<T> get_list(const map<string,string> &dict,
+  const string &key, const string &deflt)
+  {
+  auto it = dict.find(key);
+  vector<T> res;
+  for (const auto &s: tokenize((it==dict.end()) ? deflt : it->second, ','))
+    res.push_back(stringToData<T>(s));
+  return res;
+  }
+
+} // unnamed namespace
+
+int main(int argc, const char **argv)
+  {
+  map<string,string> dict;
+  parse_cmdline_equalsign(argc, argv, dict);
+  auto suites = get_list<string>(dict, "suite", "sht,healpix,wgridder,interpol");
+  size_t nthr_max = get_default_nthreads();
+  bool quick = dict.count("quick") ? stringToData<bool>(dict["quick"]) : false;
+  Config cfg{dict.count("nrep") ? stringToData<size_t>(dict["nrep"]) : 5,
+    quick, get_list<size_t>(dict, "nthreads",
+      (nthr_max>1) ? "1,"+dataToString(nthr_max) : "1"),
+    mt19937(dict.count("seed") ? stringToData<unsigned>(dict["seed"]) : 42)};
+  MR_assert(cfg.nrep>0, "nrep must be positive");
+  auto geoms = get_list<string>(dict, "geom", "gauss,cc,healpix");
+  auto lmaxes = get_list<size_t>(dict, "lmax", quick ? "127,511" : "511,2047");
+  auto spins = get_list<size_t>(dict, "spin", "0,2");
+  double epsilon = dict.count("epsilon") ?
+    stringToData<double>(dict["epsilon"]) : 1e-5;
+
+  vector<Result> results;
+  print_header();
+  for (const auto &suite: suites)
+    {
+    if (suite=="sht")
+      bench_sht(cfg, geoms, lmaxes, spins, results);
+    else if (suite=="healpix")
+      bench_healpix(cfg, results);
+    else if (suite=="wgridder")
+      bench_wgridder(cfg, epsilon, results);
+    else if (suite=="interpol")
+      bench_interpol(cfg, epsilon, results);
+    else
+      MR_fail("unknown suite '"+suite+"'");
+    }
+  if (dict.count("json"))
+    write_json(dict["json"], dict.count("tag") ? dict["tag"] : "", results);
+  }
@@ -0,0 +1,345 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  \file fft_bench.cc
+ *  Benchmark and regression driver for the C++ FFT interface.
+ *
+ *  Usage: fft_bench [key=value ...]
+ *    trafo=c2c,r2c,dct,dst,hartley   transforms to measure
+ *    prec=f,d                        precisions
+ *    ndim=1,2,3                      dimensionalities
+ *    cat=pow2,smooth,prime,bluestein length categories
+ *    nthreads=1,4                    thread counts (default: 1 and all)
+ *    stride=1,2                      element stride of the arrays
+ *    quick=true                      only use small lengths
+ *    mintime=0.2                     minimum measuring time per case (s)
+ *    json=FILE                       write all results to FILE
+ *    tag=STRING                      free-form label stored in the JSON file
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <complex>
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include "ducc0/math/fft.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/timers.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/string_utils.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+using shape_t = fmav_info::shape_t;
+using stride_t = fmav_info::stride_t;
+
+struct Result
+  {
+  string trafo, prec, cat;
+  shape_t shape;
+  size_t stride, nthreads;
+  double t_cold, t_warm, gflops, ns_per_point, err;
+  };
+
+/* Transform lengths of the different categories; every entry is the length
+   along all axes of a (1D, 2D, 3D) array. */
+vector<size_t> lengths(const string &cat, size_t ndim, bool quick)
+  {
+  if (cat=="pow2")
+    {
+    if (ndim==1) return quick ? vector<size_t>{64, 1024}
+                              : vector<size_t>{64, 1024, 16384, 262144, 4194304};
+    if (ndim==2) return quick ? vector<size_t>{64} : vector<size_t>{64, 512, 2048};
+    return quick ? vector<size_t>{16} : vector<size_t>{32, 128};
+    }
+  if (cat=="smooth")
+    {
+    if (ndim==1) return quick ? vector<size_t>{60, 720}
+                              : vector<size_t>{60, 720, 5040, 100800, 2520000};
+    if (ndim==2) return quick ? vector<size_t>{60} : vector<size_t>{60, 360, 2160};
+    return quick ? vector<size_t>{12} : vector<size_t>{30, 120};
+    }
+  // primes p for which p-1 is smooth: handled by Rader's algorithm
+  if (cat=="prime")
+    {
+    if (ndim==1) return quick ? vector<size_t>{101, 1009}
+                              : vector<size_t>{101, 1009, 12289, 65537};
+    if (ndim==2) return quick ? vector<size_t>{61} : vector<size_t>{61, 257};
+    return quick ? vector<size_t>{13} : vector<size_t>{17, 97};
+    }
+  // safe primes (p-1 has a large prime factor): handled by Bluestein
+  if (cat=="bluestein")
+    {
+    if (ndim==1) return quick ? vector<size_t>{1019}
+                              : vector<size_t>{1019, 10007, 100043, 1000667};
+    if (ndim==2) return quick ? vector<size_t>{347} : vector<size_t>{347, 1019};
+    return quick ? vector<size_t>{59} : vector<size_t>{59, 167};
+    }
+  MR_fail("unknown length category '"+cat+"'");
+  }
+
+/* Standard flop count estimates: 5 N log2 N for complex transforms of
+   total size N, half of that for the real-valued ones. */
+double flops(const string &trafo, size_t size)
+  {
+  double res = 5.*size*log2(double(size));
+  return (trafo=="c2c") ? res : 0.5*res;
+  }
+
+/* Allocates an array of the requested shape whose elements are \a stride
+   apart along the last axis, and fills it with random numbers. */
+template<typename T> fmav<T> make_array(const shape_t &shape, size_t stride,
+  mt19937 &rng)
+  {
+  shape_t shp2(shape);
+  shp2.back() *= stride;
+  fmav<T> arr(shp2);
+  using Tv = decltype(real(T()));
+  uniform_real_distribution<Tv> dist(Tv(-0.5),Tv(0.5));
+  T *p = arr.vdata();
+  for (size_t i=0; i<arr.size(); ++i)
+    {
+    if constexpr (is_same<T, complex<float>>::value || is_same<T, complex<double>>::value)
+      p[i] = T(dist(rng), dist(rng));
+    else
+      p[i] = T(dist(rng));
+    }
+  stride_t str(arr.stride());
+  str.back() *= ptrdiff_t(stride);
+  return fmav<T>(arr, shape, str);
+  }
+
+template<typename T> double l2error(const fmav<T> &a, const fmav<T> &b)
+  {
+  double sum1=0, sum2=0;
+  FmavIter ia(a), ib(b);
+  while (ia.remaining()>0)
+    {
+    sum1 += norm(complex<double>(a[ia.ofs()]-b[ib.ofs()]));
+    sum2 += norm(complex<double>(a[ia.ofs()]));
+    ia.advance(); ib.advance();
+    }
+  return sqrt(sum1/sum2);
+  }
+
+/* Runs \a func once with an empty plan cache (cold) and then repeatedly
+   until at least \a mintime seconds have passed; returns the cold and the
+   best warm run time. */
+template<typename Func> pair<double,double> measure(Func func, double mintime)
+  {
+  get_plan_cache().clear();
+  SimpleTimer tcold;
+  func();
+  double t_cold = tcold();
+  double t_warm = 1e38;
+  SimpleTimer ttot;
+  size_t nrun=0;
+  while ((nrun<3) || (ttot()<mintime))
+    {
+    SimpleTimer t;
+    func();
+    t_warm = min(t_warm, t());
+    ++nrun;
+    }
+  return make_pair(t_cold, t_warm);
+  }
+
+template<typename T> Result run_case(const string &trafo, const string &cat,
+  const shape_t &shape, size_t stride, size_t nthreads, double mintime,
+  mt19937 &rng)
+  {
+  shape_t axes;
+  for (size_t i=0; i<shape.size(); ++i) axes.push_back(i);
+  size_t size=1;
+  for (auto s: shape) size*=s;
+  T fct = T(1)/T(size);
+  Result res;
+  res.trafo = trafo; res.prec = is_same<T,float>::value ? "f" : "d";
+  res.cat = cat; res.shape = shape; res.stride = stride;
+  res.nthreads = nthreads;
+  pair<double,double> tm;
+  if (trafo=="c2c")
+    {
+    auto in = make_array<complex<T>>(shape, stride, rng);
+    auto out = make_array<complex<T>>(shape, stride, rng);
+    tm = measure([&]{ c2c(in, out, axes, true, T(1), nthreads); }, mintime);
+    auto back = make_array<complex<T>>(shape, stride, rng);
+    c2c(out, back, axes, false, fct, nthreads);
+    res.err = l2error(in, back);
+    }
+  else if (trafo=="r2c")
+    {
+    auto in = make_array<T>(shape, stride, rng);
+    shape_t cshape(shape);
+    cshape.back() = cshape.back()/2+1;
+    auto out = make_array<complex<T>>(cshape, stride, rng);
+    tm = measure([&]{ r2c(in, out, axes, true, T(1), nthreads); }, mintime);
+    auto back = make_array<T>(shape, stride, rng);
+    c2r(out, back, axes, false, fct, nthreads);
+    res.err = l2error(in, back);
+    }
+  else if ((trafo=="dct") || (trafo=="dst"))
+    {
+    auto in = make_array<T>(shape, stride, rng);
+    auto out = make_array<T>(shape, stride, rng);
+    auto back = make_array<T>(shape, stride, rng);
+    // type 3 is the inverse of type 2, up to a factor 2n per axis
+    T fct2 = fct/T(size_t(1)<<shape.size());
+    if (trafo=="dct")
+      {
+      tm = measure([&]{ dct(in, out, axes, 2, T(1), false, nthreads); }, mintime);
+      dct(out, back, axes, 3, fct2, false, nthreads);
+      }
+    else
+      {
+      tm = measure([&]{ dst(in, out, axes, 2, T(1), false, nthreads); }, mintime);
+      dst(out, back, axes, 3, fct2, false, nthreads);
+      }
+    res.err = l2error(in, back);
+    }
+  else if (trafo=="hartley")
+    {
+    auto in = make_array<T>(shape, stride, rng);
+    auto out = make_array<T>(shape, stride, rng);
+    tm = measure([&]{ r2r_separable_hartley(in, out, axes, T(1), nthreads); },
+      mintime);
+    auto back = make_array<T>(shape, stride, rng);
+    r2r_separable_hartley(out, back, axes, fct, nthreads);
+    res.err = l2error(in, back);
+    }
+  else
+    MR_fail("unknown transform '"+trafo+"'");
+  res.t_cold = tm.first;
+  res.t_warm = tm.second;
+  res.gflops = 1e-9*flops(trafo, size)/res.t_warm;
+  res.ns_per_point = 1e9*res.t_warm/size;
+  return res;
+  }
+
+string shape2string(const shape_t &shape, const string &sep)
+  {
+  string res;
+  for (size_t i=0; i<shape.size(); ++i)
+    res += (i==0 ? "" : sep) + dataToString(shape[i]);
+  return res;
+  }
+
+void print_header()
+  {
+  cout << left << setw(8) << "trafo" << setw(5) << "prec" << setw(10) << "cat"
+       << setw(18) << "shape" << right << setw(4) << "str" << setw(5) << "thr"
+       << setw(12) << "cold[s]" << setw(12) << "warm[s]" << setw(9) << "GFlops"
+       << setw(10) << "ns/point" << setw(11) << "err" << endl;
+  }
+
+void print_result(const Result &r)
+  {
+  cout << left << setw(8) << r.trafo << setw(5) << r.prec << setw(10) << r.cat
+       << setw(18) << shape2string(r.shape, "x") << right
+       << setw(4) << r.stride << setw(5) << r.nthreads
+       << scientific << setprecision(3)
+       << setw(12) << r.t_cold << setw(12) << r.t_warm
+       << fixed << setprecision(2)
+       << setw(9) << r.gflops << setw(10) << r.ns_per_point
+       << scientific << setprecision(2) << setw(11) << r.err
+       << defaultfloat << endl;
+  }
+
+void write_json(const string &fname, const string &tag,
+  const vector<Result> &results)
+  {
+  ofstream out(fname);
+  MR_assert(out, "could not open '"+fname+"' for writing");
+  out << setprecision(8);
+  out << "{\n  \"tag\": \"" << tag << "\",\n";
+  out << "  \"default_nthreads\": " << get_default_nthreads() << ",\n";
+  out << "  \"results\": [\n";
+  for (size_t i=0; i<results.size(); ++i)
+    {
+    const auto &r(results[i]);
+    out << "    {\"trafo\": \"" << r.trafo << "\", \"prec\": \"" << r.prec
+        << "\", \"cat\": \"" << r.cat << "\", \"shape\": ["
+        << shape2string(r.shape, ", ") << "], \"stride\": " << r.stride
+        << ", \"nthreads\": " << r.nthreads << ", \"t_cold\": " << r.t_cold
+        << ", \"t_warm\": " << r.t_warm << ", \"gflops\": " << r.gflops
+        << ", \"ns_per_point\": " << r.ns_per_point << ", \"err\": " << r.err
+        << "}" << ((i+1<results.size()) ? "," : "") << "\n";
+    }
+  out << "  ]\n}\n";
+  }
+
+template<typename T> vector<T> get_list(const map<string,string> &dict,
+  const string &key, const string &deflt)
+  {
+  auto it = dict.find(key);
+  vector<T> res;
+  for (const auto &s: tokenize((it==dict.end()) ? deflt : it->second, ','))
+    res.push_back(stringToData<T>(s));
+  return res;
+  }
+
+} // unnamed namespace
+
+int main(int argc, const char **argv)
+  {
+  map<string,string> dict;
+  parse_cmdline_equalsign(argc, argv, dict);
+  auto trafos = get_list<string>(dict, "trafo", "c2c,r2c,dct,dst,hartley");
+  auto precs = get_list<string>(dict, "prec", "f,d");
+  auto ndims = get_list<size_t>(dict, "ndim", "1,2,3");
+  auto cats = get_list<string>(dict, "cat", "pow2,smooth,prime,bluestein");
+  auto strides = get_list<size_t>(dict, "stride", "1");
+  size_t nthr_max = get_default_nthreads();
+  auto nthreads = get_list<size_t>(dict, "nthreads",
+    (nthr_max>1) ? "1,"+dataToString(nthr_max) : "1");
+  bool quick = dict.count("quick") ? stringToData<bool>(dict["quick"]) : false;
+  double mintime = dict.count("mintime") ? stringToData<double>(dict["mintime"])
+                                         : 0.2;
+
+  mt19937 rng(42);
+  vector<Result> results;
+  print_header();
+  for (const auto &trafo: trafos)
+    for (const auto &prec: precs)
+      for (auto ndim: ndims)
+        for (const auto &cat: cats)
+          for (auto len: lengths(cat, ndim, quick))
+            for (auto stride: strides)
+              for (auto nthr: nthreads)
+                {
+                MR_assert((prec=="f")||(prec=="d"), "unknown precision '"+prec+"'");
+                shape_t shape(ndim, len);
+                Result r = (prec=="f") ?
+                  run_case<float>(trafo, cat, shape, stride, nthr, mintime, rng) :
+                  run_case<double>(trafo, cat, shape, stride, nthr, mintime, rng);
+                print_result(r);
+                results.push_back(r);
+                }
+  if (dict.count("json"))
+    write_json(dict["json"], dict.count("tag") ? dict["tag"] : "", results);
+  }
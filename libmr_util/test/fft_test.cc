@@ -0,0 +1,77 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cstdio>
+#include <functional>
+#include "ducc0/math/fft.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+/* Fills the plan cache, uses its oldest plan again and inserts one more;
+   the plan evicted must be the least recently used one. */
+void test_plan_cache_lru()
+  {
+  using Tplan = pocketfft_c<double>;
+  auto &cache(get_plan_cache());
+  auto oldsize = cache.get_max_size();
+  cache.clear();
+  cache.set_max_size(4);
+  // the plans are not kept alive outside the cache, so evicted ones are
+  // really gone
+  for (size_t len: {10, 11, 12, 13})
+    get_plan<Tplan>(len);
+  MR_assert((cache.size()==4) && (cache.misses()==4), "bad cache state");
+  get_plan<Tplan>(10); // now the most recently used plan
+  MR_assert(cache.hits()==1, "plan not cached");
+  get_plan<Tplan>(14); // evicts the plan of length 11
+  MR_assert(cache.size()==4, "bad cache size");
+  for (size_t len: {10, 12, 13, 14})
+    {
+    auto nhits=cache.hits();
+    get_plan<Tplan>(len);
+    MR_assert(cache.hits()==nhits+1, "wrong plan evicted");
+    }
+  auto nmisses=cache.misses();
+  get_plan<Tplan>(11);
+  MR_assert(cache.misses()==nmisses+1, "least recently used plan kept");
+  cache.clear();
+  cache.set_max_size(oldsize);
+  }
+
+void runtest(function<void()> tf, const char *tn)
+  {
+  tf();
+  printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  runtest(test_plan_cache_lru,"plan cache eviction order");
+  }
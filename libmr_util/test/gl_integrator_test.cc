@@ -0,0 +1,122 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cmath>
+#include <cstdio>
+#include "ducc0/math/gl_integrator.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+using detail_gl_integrator::GL_rule;
+
+/* Compares the asymptotic nodes and weights with those of the Newton
+   iteration (which make_gl_rule() uses up to n=100) for orders around the
+   switch-over point. Both are accurate to a few 1e-13 in the weights, but
+   with -ffast-math their difference reaches about 1.2e-12 at n=255. */
+void test_asymptotic()
+  {
+  for (size_t n: {90, 99, 100, 101, 102, 103, 110, 127, 128, 200, 255})
+    {
+    size_t m = (n+1)>>1;
+    GL_rule r1{vector<double>(m), vector<double>(m)},
+            r2{vector<double>(m), vector<double>(m)};
+    detail_gl_integrator::gl_newton(n, 2, r1);
+    detail_gl_integrator::gl_asymptotic(n, 2, r2);
+    for (size_t i=0; i<m; ++i)
+      {
+      MR_assert(abs(r1.x[i]-r2.x[i])<=1e-15, "nodes differ");
+      MR_assert(abs(r1.w[i]-r2.w[i])<=1e-11*r1.w[i], "weights differ");
+      }
+    }
+  }
+
+/* For high orders the weights of the Newton iteration in double precision
+   lose accuracy (relative errors grow roughly like n^2*eps), so the
+   asymptotic rule is checked against a Newton iteration in long double. */
+void test_asymptotic_high()
+  {
+  for (size_t n: {513, 1000, 2049, 4096})
+    {
+    size_t m = (n+1)>>1;
+    GL_rule r{vector<double>(m), vector<double>(m)};
+    detail_gl_integrator::gl_asymptotic(n, 2, r);
+    for (size_t i=1; i<=m; ++i)
+      {
+      using Tl = long double;
+      Tl x0 = cos(Tl(3.141592653589793238462643383279502884L)
+                 *(4*i-1)/(4*n+2)), dpdx=0;
+      for (size_t it=0; it<10; ++it)
+        {
+        Tl P_1=1, P0=x0;
+        for (size_t k=2; k<=n; ++k)
+          {
+          Tl P_2=P_1;
+          P_1=P0;
+          P0 = ((2*k-1)*x0*P_1-(k-1)*P_2)/k;
+          }
+        dpdx = (P_1-x0*P0)*n/(1-x0*x0);
+        x0 -= P0/dpdx;
+        }
+      Tl w = 2/((1-x0*x0)*dpdx*dpdx);
+      MR_assert(abs(Tl(r.x[m-i])-x0)<=1e-15L, "nodes differ");
+      MR_assert(abs(Tl(r.w[m-i])-w)<=1e-12L*w, "weights differ");
+      }
+    }
+  }
+
+/* An n-point rule must integrate polynomials of degree 2n-1 exactly;
+   check this for x^k and for orders on both sides of the switch-over. */
+void test_exactness()
+  {
+  for (size_t n: {1, 2, 3, 50, 99, 100, 101, 102, 150, 1001})
+    {
+    GL_Integrator integ(n, 2);
+    auto x = integ.coords();
+    auto w = integ.weights();
+    MR_assert(x.size()==n && w.size()==n, "bad size");
+    for (size_t k=0; k<2*n; k+=(k<20) ? 1 : 7)
+      {
+      double sum=0;
+      for (size_t i=0; i<n; ++i)
+        sum += w[i]*pow(x[i], double(k));
+      double exact = (k&1) ? 0. : 2./(k+1.);
+      MR_assert(abs(sum-exact)<=1e-14, "integral is not exact");
+      }
+    }
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  test_asymptotic();
+  test_asymptotic_high();
+  printf("asymptotic GL rules OK.\n");
+  test_exactness();
+  printf("GL integration OK.\n");
+  }
@@ -49,25 +49,25 @@ Candidates for testing the validity of the Healpix routines:
 
 #include <random>
 #include <iostream>
-#include "Healpix_cxx/healpix_base.h"
-#include "Healpix_cxx/healpix_map.h"
-#include "ducc0/constants.h"
+#include "ducc0/healpix/healpix_base.h"
+#include "ducc0/healpix/healpix_map.h"
+#include "ducc0/math/constants.h"
 //#include "alm.h"
 //#include "alm_healpix_tools.h"
 //#include "alm_powspec_tools.h"
-#include "ducc0/geom_utils.h"
-#include "ducc0/timers.h"
+#include "ducc0/math/geom_utils.h"
+#include "ducc0/infra/timers.h"
 //#include "announce.h"
-#include "ducc0/compress_utils.h"
-#include "Healpix_cxx/moc.h"
+#include "ducc0/math/compress_utils.h"
+#include "ducc0/healpix/moc.h"
 //#include "moc_fitsio.h"
-#include "ducc0/crangeset.h"
+#include "ducc0/math/crangeset.h"
 //#include "weight_utils.h"
 //#include "powspec.h"
 
 using namespace std;
 using namespace ducc0;
-using namespace ducc0::healpix;
+using namespace ducc0::detail_healpix;
 
 #define UNITTESTS
 
@@ -386,6 +386,22 @@ template<typename I> void check_rangeset()
     rsOps(c,a);
     }
   }
+  {
+  uniform_int_distribution<int> irand(0,10000);
+  for (int iter=0; iter<100; ++iter)
+    {
+    rangeset<I> a = randomRangeSet<I>(100, 0, 100), b(a);
+    vector<pair<I,I>> rng;
+    for (int i=0; i<100; ++i)
+      {
+      I v1=irand(engine), v2=v1+irand(engine)%50;
+      rng.push_back(make_pair(v1,v2));
+      a.add(v1,v2);
+      }
+    b.add(rng);
+    MR_assert(a==b,"error");
+    }
+  }
   }
 template<typename I> crangeset<I> randomCRangeSet(int num, I start, int dist)
   {
@@ -576,6 +592,13 @@ template<typename I> void check_crangeset()
     crsOps(c,a);
     }
   }
+  for (int iter=0; iter<100; ++iter)
+    {
+    rangeset<I> a = randomRangeSet<I>(1000, 0, 3);
+    crangeset<I> b(a);
+    MR_assert(b.nval()==I(a.nval()),"error");
+    MR_assert(b.toRangeset()==a,"error");
+    }
   }
 // void check_Moc0()
 //   {
@@ -622,11 +645,11 @@ template<typename I> void check_Moc()
   MR_assert(moc.contains(xtmp),"error");
   MR_assert(!xtmp.contains(moc),"error");
   MR_assert(xtmp.overlaps(moc),"error");
+  MR_assert(moc==Moc<I>::fromCompressed(moc.toCompressed()),"error");
   xtmp=moc.degradedToOrder(8,true);
   MR_assert(!moc.contains(xtmp),"error");
   MR_assert(xtmp.contains(moc),"error");
   MR_assert(xtmp.overlaps(moc),"error");
-  MR_assert(moc==Moc<I>::fromCompressed(moc.toCompressed()),"error");
 #if 0
   assertEquals("inconsistency",moc,MocUtil.mocFromString(" 0/4, 6 2/ \t 4 -16 10/3000000 \t\n "));
   assertEquals("inconsistency",moc,MocUtil.mocFromString("0/6 2/ 5 2/4 2/6- 16 0/4  10/3000000"));
@@ -656,6 +679,35 @@ template<typename I> void check_Moc()
 #endif
     }
   }
+  {
+  vector<Moc<I>> mocs;
+  Moc<I> uni;
+  for (size_t iter=0; iter<100; ++iter)
+    {
+    Moc<I> a = randomMoc<I>(100, 0, 1000);
+    uni = uni.op_or(a);
+    mocs.push_back(a);
+    }
+  MR_assert(Moc<I>::unionOf(mocs)==uni,"error");
+  }
+  for (int order=0; order<=std::min(10,int(Moc<I>::maxorder)); ++order)
+    {
+    T_Healpix_Base<I> base(order,NEST);
+    for (int m=0; m<100; ++m)
+      {
+      pointing ptg;
+      random_dir (ptg);
+      double rad = pi*frand()*frand();
+      for (int fact=0; fact<=4; fact+=4)
+        {
+        Moc<I> moc = Moc<I>::queryDisc(order,ptg,rad,fact);
+        rangeset<I> rs = (fact==0) ? base.query_disc(ptg,rad)
+                                   : base.query_disc_inclusive(ptg,rad,fact);
+        MR_assert(moc==Moc<I>::fromRangeset(order,rs),"error");
+        MR_assert(int(moc.maxOrder())<=order,"error");
+        }
+      }
+    }
   }
 template<typename I> void check_compress()
   {
@@ -677,7 +729,10 @@ template<typename I> void check_compress()
     ibitstream ibs(comp);
     interpol_decode(v2,ibs);
     MR_assert(v==v2,"data mismatch");
+    MR_assert(rangeset<I>::deserialize(b.serialize())==b,"data mismatch");
     }
+  MR_assert(rangeset<I>::deserialize(rangeset<I>().serialize()).empty(),
+    "data mismatch");
   }
 
 template<typename I> void check_ringnestring()
@@ -871,6 +926,61 @@ template<typename I> void check_neighbors()
     }
   }
 
+/* The array versions of ang2pix(), vec2pix() and pix2vec() use the SIMD
+   sincos() and atan2() of simd.h, which are less accurate than libm. Pixel
+   numbers may only differ for positions right on a pixel boundary, and then
+   only by a neighbouring pixel; vector components must agree to 1e-15. */
+template<typename I> void check_array_vs_scalar()
+  {
+  cout << "testing array versions of ang2pix, vec2pix and pix2vec "
+       << bname<I>() << endl;
+  constexpr size_t n=10007; // not a multiple of the SIMD length
+  vector<pointing> ang(n);
+  vector<vec3> vec(n);
+  vector<I> pix(n);
+  auto close = [](const T_Healpix_Base<I> &base, I p1, I p2)
+    {
+    if (p1==p2) return true;
+    array<I,8> nb;
+    base.neighbors(p1,nb);
+    return find(nb.begin(), nb.end(), p2)!=nb.end();
+    };
+  int omax=T_Healpix_Base<I>::order_max;
+  for (int order=0; order<=omax; ++order)
+    for (auto scheme: {RING, NEST})
+      {
+      T_Healpix_Base<I> base (order,scheme);
+      for (auto &a: ang) random_dir(a);
+      // poles, and a direction with a negative zero y component
+      ang[0] = pointing(0., 0.);
+      ang[1] = pointing(pi, 1.);
+      for (size_t i=0; i<n; ++i)
+        vec[i] = ang[i].to_vec3();
+      vec[2] = vec3(-1., -0., 0.3);
+      base.ang2pix(ang.data(), pix.data(), n);
+      for (size_t i=0; i<n; ++i)
+        if (!close(base, base.ang2pix(ang[i]), pix[i]))
+          FAIL(cout<<"  PROBLEM: order = "<<order<<", ang2pix("<<ang[i]
+                   <<")"<<endl)
+      base.vec2pix(vec.data(), pix.data(), n);
+      for (size_t i=0; i<n; ++i)
+        if (!close(base, base.vec2pix(vec[i]), pix[i]))
+          FAIL(cout<<"  PROBLEM: order = "<<order<<", vec2pix("<<vec[i]
+                   <<")"<<endl)
+      uniform_int_distribution<I> irand(0,base.Npix()-1);
+      for (auto &p: pix) p = irand(engine);
+      base.pix2vec(pix.data(), vec.data(), n);
+      for (size_t i=0; i<n; ++i)
+        {
+        vec3 v = base.pix2vec(pix[i]);
+        if (max({abs(v.x-vec[i].x), abs(v.y-vec[i].y), abs(v.z-vec[i].z)})
+            >1e-15)
+          FAIL(cout<<"  PROBLEM: order = "<<order<<", pix2vec("<<pix[i]
+                   <<")"<<endl)
+        }
+      }
+  }
+
 void check_swap_scheme()
   {
   cout << "testing whether double swap_scheme() returns the original map"
@@ -1533,6 +1643,76 @@ template<typename I>void perf_query_polygon(const string &name,
 
   cout << name << ": " << cnt/timer()*1e-3 << "kOps/s" << endl;
   }
+template<typename I>void perf_serialize(const string &name,
+  Ordering_Scheme scheme, double &dummy)
+  {
+  T_Healpix_Base<I> base(8192,scheme,SET_NSIDE);
+  rangeset<I> rs = base.query_disc(vec3(1,0.5,0.5),0.5);
+  double rawsize = double(rs.data().size()*sizeof(I));
+  vector<uint8_t> comp;
+  size_t cnt=0;
+  SimpleTimer timer;
+  for (int m=0; m<100; ++m)
+    {
+    comp = rs.serialize();
+    ++cnt;
+    }
+  double tenc=timer()/cnt;
+  cnt=0;
+  timer.reset();
+  for (int m=0; m<100; ++m)
+    {
+    dummy += rangeset<I>::deserialize(comp).nranges();
+    ++cnt;
+    }
+  double tdec=timer()/cnt;
+  cout << name << ": " << rawsize/tenc*1e-6 << "MB/s (encode), "
+       << rawsize/tdec*1e-6 << "MB/s (decode), ratio "
+       << rawsize/comp.size() << endl;
+  }
+
+template<typename I>void perf_add(const string &name, double &dummy)
+  {
+  const size_t n=100000;
+  uniform_int_distribution<I> irand(0,I(1)<<30);
+  vector<pair<I,I>> rng(n);
+  for (auto &r: rng)
+    {
+    r.first = irand(engine);
+    r.second = r.first + 1 + (r.first&15);
+    }
+  SimpleTimer timer;
+  rangeset<I> a;
+  for (const auto &r: rng)
+    a.add(r.first, r.second);
+  double t1=timer();
+  timer.reset();
+  rangeset<I> b;
+  b.add(rng);
+  double t2=timer();
+  MR_assert(a==b,"error");
+  dummy += a.nranges()+b.nranges();
+  cout << name << ": " << n/t1*1e-6 << "MOps/s (single), "
+       << n/t2*1e-6 << "MOps/s (bulk)" << endl;
+  }
+template<typename I>void perf_crangeset(const string &name,
+  Ordering_Scheme scheme, double &dummy)
+  {
+  size_t cnt=0;
+  T_Healpix_Base<I> base(1024,scheme,SET_NSIDE);
+  crangeset<I> crs;
+  SimpleTimer timer;
+  for (int m=0; m<1000; ++m)
+    {
+    base.query_disc_inclusive(vec3(1,0,0),halfpi/9,crs,4);
+    dummy += crs.data().size();
+    ++cnt;
+    }
+  double t=timer();
+  rangeset<I> rs=base.query_disc_inclusive(vec3(1,0,0),halfpi/9,4);
+  cout << name << ": " << cnt/t*1e-3 << "kOps/s, memory: "
+       << 100.*crs.data().size()/rs.data().size() << "% of rangeset" << endl;
+  }
 
 void perftest()
   {
@@ -1582,6 +1762,14 @@ void perftest()
   perf_query_polygon<int>   ("query_polygon (NEST):int  ",NEST,dummy);
   perf_query_polygon<int64_t> ("query_polygon (RING):int64_t",RING,dummy);
   perf_query_polygon<int64_t> ("query_polygon (NEST):int64_t",NEST,dummy);
+  perf_serialize<int64_t>     ("serialize     (RING):int64_t",RING,dummy);
+  perf_serialize<int64_t>     ("serialize     (NEST):int64_t",NEST,dummy);
+  perf_add<int>               ("rangeset::add        :int  ",dummy);
+  perf_add<int64_t>           ("rangeset::add        :int64_t",dummy);
+  perf_crangeset<int>         ("crangeset (RING):int  ",RING,dummy);
+  perf_crangeset<int>         ("crangeset (NEST):int  ",NEST,dummy);
+  perf_crangeset<int64_t>     ("crangeset (RING):int64_t",RING,dummy);
+  perf_crangeset<int64_t>     ("crangeset (NEST):int64_t",NEST,dummy);
 
   if (dummy<0) cout << dummy << endl;
   }
@@ -1622,6 +1810,8 @@ int main(int argc, const char **argv)
   check_pixangpix<int64_t>();
   check_neighbors<int>();
   check_neighbors<int64_t>();
+  check_array_vs_scalar<int>();
+  check_array_vs_scalar<int64_t>();
   check_swap_scheme();
   check_query_disc_strict(RING);
   check_query_disc_strict(NEST);
@@ -0,0 +1,257 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <stdexcept>
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/mmap_file.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+const char *tmpname = "mav_test.tmp";
+
+template<typename Func> bool throws(Func func)
+  {
+  try { func(); }
+  catch (const runtime_error &) { return true; }
+  return false;
+  }
+
+// write a file through a writable mapping, reopen it read-only and compare
+void test_mmap_roundtrip()
+  {
+  constexpr size_t n0=13, n1=17, ofs=64;
+  {
+  auto file = make_shared<mmap_file>(tmpname, mmap_file::CREATE,
+    ofs+n0*n1*sizeof(double));
+  MR_assert(file->writable(), "bug");
+  mav<double,2> arr(file, {n0,n1}, ofs);
+  for (size_t i=0; i<n0; ++i)
+    for (size_t j=0; j<n1; ++j)
+      arr.v(i,j) = 1000.*i+j;
+  file->sync();
+  }
+  auto file = make_shared<mmap_file>(tmpname);
+  MR_assert(!file->writable(), "bug");
+  MR_assert(file->size()==ofs+n0*n1*sizeof(double), "bug");
+  const mav<double,2> arr(file, {n0,n1}, ofs);
+  const fmav<double> farr(file, {n1,n0}, ofs);
+  for (size_t i=0; i<n0; ++i)
+    for (size_t j=0; j<n1; ++j)
+      {
+      MR_assert(arr(i,j)==1000.*i+j, "bug");
+      MR_assert(farr[i*n1+j]==1000.*i+j, "bug");
+      }
+  // the bytes before the offset were never written
+  mav<char,1> head(file, {ofs});
+  for (size_t i=0; i<ofs; ++i)
+    MR_assert(head(i)==0, "bug");
+
+  // read-only views cannot be written to
+  mav<double,2> arr2(file, {n0,n1}, ofs);
+  MR_assert(throws([&]{ arr2.v(0,0)=1.; }), "bug");
+  // the view must fit into the file and be aligned
+  MR_assert(throws([&]{ mav<double,2> tmp(file, {n0,n1}, ofs+8); }), "bug");
+  MR_assert(throws([&]{ mav<double,1> tmp(file, {1}, 4); }), "bug");
+  }
+
+// compare mav_apply on strided views with explicit loops over the indices
+void test_apply_strided(size_t nthreads)
+  {
+  constexpr size_t n=48;
+  mav<double,3> a({n,n,n}), b({n,n,n});
+  for (size_t i=0; i<n; ++i)
+    for (size_t j=0; j<n; ++j)
+      for (size_t k=0; k<n; ++k)
+        {
+        a.v(i,j,k) = 10000.*i+100.*j+k;
+        b.v(i,j,k) = -(10000.*k+100.*j+i);
+        }
+  // a strided subarray, a view of b with reversed axis order and
+  // negative strides, and a contiguous output array
+  auto asub = a.subarray<3>({1,0,3}, {n-2,n,n-5});
+  mav<double,3> brev(b.vdata()+(n-1)*(n*n+n+1), {n-2,n,n-5},
+    {-1,-ptrdiff_t(n),-ptrdiff_t(n*n)}, true);
+  mav<double,3> out({n-2,n,n-5});
+  mav_apply([](double &o, const double &x, double &y)
+    { o = x+2*y; y = -y; }, nthreads, out, as_const(asub), brev);
+  for (size_t i=0; i<n-2; ++i)
+    for (size_t j=0; j<n; ++j)
+      for (size_t k=0; k<n-5; ++k)
+        {
+        MR_assert(out(i,j,k)==a(i+1,j,k+3)-2*b(n-1-k,n-1-j,n-1-i), "bug");
+        MR_assert(b(n-1-k,n-1-j,n-1-i)==10000.*(n-1-i)+100.*(n-1-j)+(n-1-k),
+          "bug");
+        }
+  // a 2D slice with a unit-length axis, as fmav
+  fmav<double> slice(a.subarray<2>({5,0,0}, {0,n,1}));
+  size_t cnt=0;
+  mav_apply([&cnt](double &v) { v=-1.; ++cnt; }, 1, slice);
+  MR_assert(cnt==n, "bug");
+  for (size_t j=0; j<n; ++j)
+    MR_assert(a(5,j,0)==-1. && a(5,j,1)==10000.*5+100.*j+1, "bug");
+  }
+
+void test_apply_noncontiguous()
+  {
+  test_apply_strided(1);
+  test_apply_strided(4);
+  }
+
+// arrays without elements must not lead to any calls
+void test_apply_empty()
+  {
+  size_t cnt=0;
+  auto count = [&cnt](double &) { ++cnt; };
+  mav<double,2> a({0,5}), b({7,0});
+  mav_apply(count, 1, a);
+  mav_apply(count, 4, b);
+  fmav<double> c({3,0,2});
+  mav_apply(count, 2, c);
+  mav<double,3> d({4,5,6});
+  // (extents of 0 in subarray() remove axes, so build the view directly)
+  mav<double,3> dsub(d.vdata()+1, {2,0,3}, {30,6,2}, true);
+  MR_assert(dsub.size()==0, "bug");
+  mav_apply(count, 1, dsub);
+  MR_assert(cnt==0, "bug");
+  // a single element
+  mav<double,3> e({1,1,1});
+  mav_apply(count, 1, e);
+  MR_assert(cnt==1, "bug");
+  }
+
+void test_subarray_bounds()
+  {
+  mav<double,2> a({4,5});
+  // valid corner cases
+  auto s1 = a.subarray<2>({3,4}, {1,1});
+  MR_assert(s1.shape(0)==1 && s1.shape(1)==1, "bug");
+  auto s2 = a.subarray<1>({3,0}, {0,5});
+  MR_assert(s2.shape(0)==5, "bug");
+  // start or end beyond the array
+  MR_assert(throws([&]{ a.subarray<2>({4,0}, {1,1}); }), "bug");
+  MR_assert(throws([&]{ a.subarray<2>({0,3}, {4,3}); }), "bug");
+  MR_assert(throws([&]{ a.subarray<2>({1,0}, {4,5}); }), "bug");
+  // wrong number of remaining dimensions
+  MR_assert(throws([&]{ a.subarray<2>({0,0}, {0,5}); }), "bug");
+  fmav<double> f(a);
+  MR_assert(throws([&]{ f.subarray({0,5}, {1,0}); }), "bug");
+  MR_assert(throws([&]{ f.subarray({2,2}, {3,3}); }), "bug");
+  // arrays passed to mav_apply must have identical shapes
+  mav<double,2> b({4,4});
+  MR_assert(throws([&]{ mav_apply([](double &, double &){}, 1, a, b); }),
+    "bug");
+  }
+
+template<typename T, size_t ndim> void check_zeroed(const mav<T,ndim> &arr,
+  const array<size_t,ndim> &shape, bool contiguous=true)
+  {
+  for (size_t i=0; i<ndim; ++i)
+    MR_assert(arr.shape(i)==shape[i], "bad shape");
+  MR_assert(arr.contiguous()==contiguous, "bad strides");
+  MR_assert(arr.writable(), "not writable");
+  if (arr.size()>0)
+    MR_assert((reinterpret_cast<uintptr_t>(arr.data())&63)==0, "misaligned");
+  fmav<T> farr(arr);
+  for (size_t i=0; i<farr.size(); ++i)
+    MR_assert(farr[i]==T(0), "not zeroed");
+  }
+
+/* Arrays whose memory is first touched by several threads must be
+   indistinguishable from value-initialized ones, for any policy of thread
+   pinning. */
+void test_first_touch()
+  {
+#ifdef __GLIBC__
+  // fill freshly allocated memory with nonzero bytes
+  mallopt(M_PERTURB, 0x5a);
+#endif
+  auto old_policy = get_thread_affinity();
+  for (auto policy: {AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SCATTER})
+    {
+    set_thread_affinity(policy);
+    MR_assert(get_thread_affinity()==policy, "bug");
+    for (size_t nthreads: {1, 2, 4, 7})
+      {
+      for (auto shp: {array<size_t,2>{0,5}, array<size_t,2>{1,7},
+                      array<size_t,2>{3,100}, array<size_t,2>{37,13}})
+        {
+        check_zeroed(mav<double,2>(shp, nthreads), shp);
+        check_zeroed(mav<complex<float>,2>(shp, nthreads), shp);
+        }
+      array<size_t,3> shp3{11,4,512};
+      check_zeroed(mav<double,3>(shp3, nthreads), shp3);
+      // the first-touch version must have the same memory layout
+      auto a = mav<double,3>::build_noncritical({11,4,512}, nthreads),
+           b = mav<double,3>::build_noncritical({11,4,512});
+      for (size_t i=0; i<3; ++i)
+        MR_assert(a.stride(i)==b.stride(i), "bad strides");
+      check_zeroed(a, shp3, false);
+      aligned_array<double> arr(1001, nthreads);
+      for (size_t i=0; i<arr.size(); ++i)
+        MR_assert(arr[i]==0., "not zeroed");
+
+      // results of parallel loops do not depend on the pinning
+      mav<double,2> c({40,40}, nthreads);
+      mav_apply([](double &v){ v+=1.; }, nthreads, c);
+      for (size_t i=0; i<40; ++i)
+        for (size_t j=0; j<40; ++j)
+          MR_assert(c(i,j)==1., "bug");
+      }
+    }
+  set_thread_affinity(old_policy);
+#ifdef __GLIBC__
+  mallopt(M_PERTURB, 0);
+#endif
+  }
+
+void runtest(function<void()> tf, const char *tn)
+  {
+  tf();
+  printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  runtest(test_mmap_roundtrip,"memory-mapped files");
+  runtest(test_apply_noncontiguous,"mav_apply on strided arrays");
+  runtest(test_apply_empty,"mav_apply on empty arrays");
+  runtest(test_subarray_bounds,"subarray bounds checks");
+  runtest(test_first_touch,"first-touch allocation");
+  remove(tmpname);
+  }
@@ -0,0 +1,489 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Tests for the MPI-distributed parts of the library; every test compares
+ *  the distributed result against the serial one.
+ *  Run with "mpiexec -n <ntasks> ./mpi_test".
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#include "ducc0/infra/communication.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/sharp/sharp_mpi.h"
+#include "ducc0/sharp/sharp_almhelpers.h"
+#include "ducc0/sharp/sharp_geomhelpers.h"
+#include "python/gridder_mpi.h"
+#include "python/totalconvolve_mpi.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+using dcmplx = complex<double>;
+
+double maxabs(const vector<double> &v)
+  {
+  double res=0;
+  for (auto x: v) res=max(res, abs(x));
+  return res;
+  }
+double maxabs(const vector<dcmplx> &v)
+  {
+  double res=0;
+  for (auto x: v) res=max(res, abs(x));
+  return res;
+  }
+
+/* Returns the local part of the a_lm and map arrays for task \a rank of
+   \a ntasks. Ring pairs are dealt out round-robin; the m values are dealt
+   out to all tasks but the last one, so that (for more than one task) there
+   is always a task with an empty m range. */
+struct LocalSetup
+  {
+  unique_ptr<sharp_geom_info> ginfo;
+  unique_ptr<sharp_standard_alm_info> ainfo;
+  vector<size_t> rings;       // global indices of the local rings
+  vector<ptrdiff_t> gofs;     // offsets of the local rings in the global map
+  vector<size_t> mvals;       // local m values
+  vector<ptrdiff_t> gmstart;  // mstart of the local m values in the global a_lm
+  size_t npix, nalm;
+
+  LocalSetup(const sharp_geom_info &gg, const vector<ptrdiff_t> &gofs_all,
+    size_t lmax, size_t mmax, size_t rank, size_t ntasks)
+    {
+    size_t nrings=gg.nrings();
+    for (size_t i=rank; i<(nrings+1)/2; i+=ntasks)
+      {
+      rings.push_back(i);
+      if (nrings-1-i!=i) rings.push_back(nrings-1-i);
+      }
+    vector<size_t> nph;
+    vector<ptrdiff_t> ofs;
+    vector<double> phi0, theta, wgt;
+    npix=0;
+    for (auto r: rings)
+      {
+      nph.push_back(gg.nph(r));
+      ofs.push_back(ptrdiff_t(npix));
+      phi0.push_back(gg.phi0(r));
+      theta.push_back(gg.theta(r));
+      wgt.push_back(gg.weight(r));
+      gofs.push_back(gofs_all[r]);
+      npix+=gg.nph(r);
+      }
+    ginfo.reset(new sharp_standard_geom_info(rings.size(), nph.data(),
+      ofs.data(), 1, phi0.data(), theta.data(), wgt.data()));
+
+    size_t mtasks = max<size_t>(1, ntasks-1);
+    vector<ptrdiff_t> mvstart;
+    nalm=0;
+    for (size_t m=rank; (rank<mtasks)&&(m<=mmax); m+=mtasks)
+      {
+      mvals.push_back(m);
+      mvstart.push_back(ptrdiff_t(nalm)-ptrdiff_t(m));
+      gmstart.push_back(ptrdiff_t(m*(2*lmax-m+1)/2));
+      nalm+=lmax+1-m;
+      }
+    ainfo.reset(new sharp_standard_alm_info(lmax, mvals.size(), 1,
+      mvals.data(), mvstart.data()));
+    }
+
+  template<typename T> void map2loc(const vector<T> &glob, vector<T> &loc) const
+    {
+    loc.resize(npix);
+    for (size_t i=0, ofs=0; i<rings.size(); ofs+=ginfo->nph(i), ++i)
+      for (size_t j=0; j<ginfo->nph(i); ++j)
+        loc[ofs+j] = glob[gofs[i]+j];
+    }
+  void alm2loc(size_t lmax, const vector<dcmplx> &glob, vector<dcmplx> &loc)
+    const
+    {
+    loc.resize(nalm);
+    for (size_t i=0, ofs=0; i<mvals.size(); ofs+=lmax+1-mvals[i], ++i)
+      for (size_t l=mvals[i]; l<=lmax; ++l)
+        loc[ofs+l-mvals[i]] = glob[gmstart[i]+l];
+    }
+  };
+
+void test_sharp_mpi_case(const Communicator &comm, const string &gname,
+  size_t spin)
+  {
+  constexpr size_t lmax=47, mmax=lmax;
+  auto gg = (gname=="healpix") ? sharp_make_healpix_geom_info(16, 1)
+                               : sharp_make_gauss_geom_info(lmax+1, 2*mmax+1, 0., 1, 2*mmax+1);
+  auto ga = sharp_make_triangular_alm_info(lmax, mmax, 1);
+  size_t ncomp = (spin==0) ? 1 : 2;
+  size_t nalm = ((mmax+1)*(mmax+2))/2 + (mmax+1)*(lmax-mmax);
+  vector<ptrdiff_t> gofs(gg->nrings());
+  size_t npix=0;
+  for (size_t i=0; i<gg->nrings(); ++i)
+    { gofs[i]=ptrdiff_t(npix); npix+=gg->nph(i); }
+
+  LocalSetup loc(*gg, gofs, lmax, mmax, comm.rank(), comm.num_ranks());
+  MR_assert(comm.allreduce(long(loc.rings.size()), Communicator::Sum)==long(gg->nrings()),
+    "bad ring distribution");
+  MR_assert(comm.allreduce(long(loc.mvals.size()), Communicator::Sum)==long(mmax+1),
+    "bad m distribution");
+
+  // all tasks generate the same global input data
+  mt19937 rng(42);
+  uniform_real_distribution<double> dist(-1., 1.);
+  vector<vector<dcmplx>> galm(ncomp, vector<dcmplx>(nalm));
+  vector<vector<double>> gmap(ncomp, vector<double>(npix));
+  for (auto &a: galm)
+    for (size_t m=0, i=0; m<=mmax; ++m)
+      for (size_t l=m; l<=lmax; ++l, ++i)
+        a[i] = (l<spin) ? 0. : dcmplx(dist(rng), (m==0) ? 0. : dist(rng));
+  for (auto &m: gmap)
+    for (auto &v: m) v = dist(rng);
+
+  vector<vector<dcmplx>> lalm(ncomp);
+  vector<vector<double>> lmap(ncomp);
+  for (size_t i=0; i<ncomp; ++i)
+    loc.alm2loc(lmax, galm[i], lalm[i]);
+
+  auto run_serial = [&](sharp_jobtype type, vector<vector<dcmplx>> &alm,
+    vector<vector<double>> &map)
+    {
+    vector<any> va, vm;
+    for (auto &a: alm) va.push_back(a.data());
+    for (auto &m: map) vm.push_back(m.data());
+    sharp_execute(type, spin, va, vm, *gg, *ga, 0, 1);
+    };
+  auto run_mpi = [&](sharp_jobtype type, vector<vector<dcmplx>> &alm,
+    vector<vector<double>> &map)
+    {
+    vector<any> va, vm;
+    for (auto &a: alm) va.push_back(a.data());
+    for (auto &m: map) vm.push_back(m.data());
+    sharp_execute_mpi(comm, type, spin, va, vm, *loc.ginfo, *loc.ainfo, 0, 2);
+    };
+
+  // alm2map
+  {
+  vector<vector<double>> smap(ncomp, vector<double>(npix));
+  vector<vector<dcmplx>> salm(galm);
+  run_serial(SHARP_Y, salm, smap);
+  for (size_t i=0; i<ncomp; ++i)
+    lmap[i].assign(loc.npix, 0.);
+  run_mpi(SHARP_Y, lalm, lmap);
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    vector<double> ref;
+    loc.map2loc(smap[i], ref);
+    double err=0;
+    for (size_t j=0; j<ref.size(); ++j)
+      err = max(err, abs(lmap[i][j]-ref[j]));
+    err = comm.allreduce(err, Communicator::Max);
+    MR_assert(err<=1e-12*maxabs(smap[i]), "alm2map mismatch");
+    }
+  }
+
+  // map2alm (adjoint and with quadrature weights)
+  for (auto type: {SHARP_Yt, SHARP_MAP2ALM})
+    {
+    vector<vector<dcmplx>> salm(ncomp, vector<dcmplx>(nalm));
+    vector<vector<double>> smap(gmap);
+    run_serial(type, salm, smap);
+    for (size_t i=0; i<ncomp; ++i)
+      {
+      loc.map2loc(gmap[i], lmap[i]);
+      lalm[i].assign(loc.nalm, 0.);
+      }
+    run_mpi(type, lalm, lmap);
+    for (size_t i=0; i<ncomp; ++i)
+      {
+      vector<dcmplx> ref;
+      loc.alm2loc(lmax, salm[i], ref);
+      double err=0;
+      for (size_t j=0; j<ref.size(); ++j)
+        err = max(err, abs(lalm[i][j]-ref[j]));
+      err = comm.allreduce(err, Communicator::Max);
+      MR_assert(err<=1e-12*maxabs(salm[i]), "map2alm mismatch");
+      }
+    }
+  }
+
+void test_sharp_mpi(const Communicator &comm)
+  {
+  for (auto gname: {"gauss", "healpix"})
+    for (size_t spin: {0, 2})
+      test_sharp_mpi_case(comm, gname, spin);
+  }
+
+void test_nonblocking(const Communicator &comm)
+  {
+  int ntasks=comm.num_ranks(), rank=comm.rank();
+
+  // reductions: compare against the blocking version
+  {
+  vector<double> in(7), out(7), ref;
+  for (size_t i=0; i<in.size(); ++i) in[i] = rank*10.+i;
+  ref = comm.allreduceVec(in, Communicator::Sum);
+  auto req = comm.iallreduceRaw(in.data(), out.data(), in.size(),
+    Communicator::Sum);
+  while (!req.test()) {}
+  MR_assert(out==ref, "iallreduce(Sum) mismatch");
+  ref = comm.allreduceVec(in, Communicator::Max);
+  req = comm.iallreduceRaw(in.data(), out.data(), in.size(), Communicator::Max);
+  req.wait();
+  MR_assert(out==ref, "iallreduce(Max) mismatch");
+  }
+
+  // all-to-all with varying message sizes (including empty ones):
+  // task i sends (i+j)%3 items to task j
+  {
+  vector<int> numin(ntasks), disin(ntasks), numout(ntasks), disout(ntasks);
+  for (int j=0, ofs=0; j<ntasks; ofs+=numin[j], ++j)
+    { numin[j]=(rank+j)%3; disin[j]=ofs; }
+  for (int j=0, ofs=0; j<ntasks; ofs+=numout[j], ++j)
+    { numout[j]=(j+rank)%3; disout[j]=ofs; }
+  vector<long> in(disin[ntasks-1]+numin[ntasks-1]),
+               out(disout[ntasks-1]+numout[ntasks-1], -1);
+  for (int j=0; j<ntasks; ++j)
+    for (int k=0; k<numin[j]; ++k)
+      in[disin[j]+k] = 1000*rank+10*j+k;
+  {
+  auto req = comm.iall2allvRaw(in.data(), numin.data(), disin.data(),
+    out.data(), numout.data(), disout.data());
+  // the handle waits for completion when going out of scope
+  }
+  for (int j=0; j<ntasks; ++j)
+    for (int k=0; k<numout[j]; ++k)
+      MR_assert(out[disout[j]+k]==1000*j+10*rank+k, "ialltoallv mismatch");
+  }
+
+  // point-to-point: shift data around a ring of tasks
+  {
+  vector<double> sbuf(5), rbuf(5, -1.);
+  for (size_t i=0; i<sbuf.size(); ++i) sbuf[i] = rank+0.25*i;
+  int src=(rank+ntasks-1)%ntasks, dest=(rank+1)%ntasks;
+  auto rreq = comm.irecvRaw(rbuf.data(), rbuf.size(), src);
+  auto sreq = comm.isendRaw(sbuf.data(), sbuf.size(), dest);
+  Communicator::Request moved(move(rreq));
+  moved.wait();
+  sreq.wait();
+  for (size_t i=0; i<rbuf.size(); ++i)
+    MR_assert(rbuf[i]==src+0.25*i, "isend/irecv mismatch");
+  }
+  }
+
+/* The rows of the measurement set are dealt out round-robin to all tasks
+   but the last one, which (for more than one task) has no visibilities at
+   all. The grid dimensions are fixed, since otherwise the serial and the
+   distributed version could choose different grids. */
+void test_gridder_mpi(const Communicator &comm)
+  {
+  constexpr size_t nrow=300, nchan=4, npix=64, nu=160, nv=160;
+  constexpr double speedoflight=299792458., f0=1e9, pixsize=pi/180./npix;
+  constexpr double epsilon=1e-7;
+  size_t ntasks=size_t(comm.num_ranks()), rank=size_t(comm.rank());
+
+  // all tasks generate the same global input data
+  mt19937 rng(42);
+  uniform_real_distribution<double> dist(-0.5, 0.5);
+  mav<double,1> freq({nchan});
+  for (size_t i=0; i<nchan; ++i)
+    freq.v(i) = f0 + i*(f0/(10*nchan));
+  mav<double,2> uvw({nrow,3});
+  mav<complex<double>,2> ms({nrow,nchan});
+  mav<double,2> dirty({npix,npix});
+  for (size_t i=0; i<nrow; ++i)
+    {
+    for (size_t j=0; j<3; ++j)
+      uvw.v(i,j) = dist(rng)/(pixsize*f0/speedoflight*((j==2) ? 20. : 1.));
+    for (size_t j=0; j<nchan; ++j)
+      ms.v(i,j) = complex<double>(dist(rng), dist(rng));
+    }
+  for (size_t i=0; i<npix; ++i)
+    for (size_t j=0; j<npix; ++j)
+      dirty.v(i,j) = dist(rng);
+
+  size_t rtasks = max<size_t>(1, ntasks-1);
+  vector<size_t> rows;
+  for (size_t i=rank; (rank<rtasks)&&(i<nrow); i+=rtasks)
+    rows.push_back(i);
+  mav<double,2> luvw({rows.size(),3});
+  mav<complex<double>,2> lms({rows.size(),nchan});
+  for (size_t i=0; i<rows.size(); ++i)
+    {
+    for (size_t j=0; j<3; ++j)
+      luvw.v(i,j) = uvw(rows[i],j);
+    for (size_t j=0; j<nchan; ++j)
+      lms.v(i,j) = ms(rows[i],j);
+    }
+
+  mav<double,2> wgt({0,0}), lwgt({0,0});
+  mav<uint8_t,2> mask({0,0}), lmask({0,0});
+  for (auto do_w: {false, true})
+    {
+    mav<double,2> ref({npix,npix}), res({npix,npix});
+    ms2dirty(uvw, freq, ms, wgt, mask, pixsize, pixsize, nu, nv, epsilon,
+      do_w, 1, ref, 0);
+    ms2dirty_mpi(comm, luvw, freq, lms, lwgt, lmask, pixsize, pixsize, nu, nv,
+      epsilon, do_w, 2, res, 0);
+    double err=0, nrm=0;
+    for (size_t i=0; i<npix; ++i)
+      for (size_t j=0; j<npix; ++j)
+        {
+        err = max(err, abs(res(i,j)-ref(i,j)));
+        nrm = max(nrm, abs(ref(i,j)));
+        }
+    err = comm.allreduce(err, Communicator::Max);
+    MR_assert(err<=1e-12*nrm, "ms2dirty mismatch");
+
+    mav<complex<double>,2> msref({nrow,nchan}), lmsres({rows.size(),nchan});
+    dirty2ms(uvw, freq, dirty, wgt, mask, pixsize, pixsize, nu, nv, epsilon,
+      do_w, 1, msref, 0);
+    dirty2ms_mpi(comm, luvw, freq, dirty, lwgt, lmask, pixsize, pixsize, nu,
+      nv, epsilon, do_w, 2, lmsres, 0);
+    err=0; nrm=0;
+    for (size_t i=0; i<nrow; ++i)
+      for (size_t j=0; j<nchan; ++j)
+        nrm = max(nrm, abs(msref(i,j)));
+    for (size_t i=0; i<rows.size(); ++i)
+      for (size_t j=0; j<nchan; ++j)
+        err = max(err, abs(lmsres(i,j)-msref(rows[i],j)));
+    err = comm.allreduce(err, Communicator::Max);
+    MR_assert(err<=1e-12*nrm, "dirty2ms mismatch");
+    }
+  }
+
+/* Every task passes a different subset of the pointings (the last task
+   none at all); the interpolated values must be identical to those of the
+   serial Interpolator, and the adjoint must agree to rounding errors. */
+void test_interpol_mpi(const Communicator &comm)
+  {
+  using Talm = Alm<dcmplx>;
+  constexpr size_t lmax=31, kmax=3, ncomp=3, nptg=500;
+  constexpr double epsilon=1e-8, ofmin=1.5;
+  size_t ntasks=size_t(comm.num_ranks()), rank=size_t(comm.rank());
+
+  // all tasks generate the same global input data
+  mt19937 rng(42);
+  uniform_real_distribution<double> dist(-1., 1.);
+  auto random_alm = [&](Talm &alm)
+    {
+    for (size_t m=0; m<=alm.Mmax(); ++m)
+      for (size_t l=m; l<=alm.Lmax(); ++l)
+        alm.Alms().v(alm.index(l,m)) = dcmplx(dist(rng), (m==0) ? 0. : dist(rng));
+    };
+  vector<Talm> slm, blm;
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    slm.emplace_back(lmax, lmax);
+    random_alm(slm.back());
+    blm.emplace_back(lmax, kmax);
+    random_alm(blm.back());
+    }
+  mav<double,2> ptg({nptg,3}), data({nptg,ncomp});
+  for (size_t i=0; i<nptg; ++i)
+    {
+    ptg.v(i,0) = acos(dist(rng));
+    ptg.v(i,1) = pi*(1.+dist(rng));
+    ptg.v(i,2) = pi*(1.+dist(rng));
+    for (size_t j=0; j<ncomp; ++j)
+      data.v(i,j) = dist(rng);
+    }
+
+  size_t ptasks = max<size_t>(1, ntasks-1);
+  vector<size_t> idx;
+  for (size_t i=rank; (rank<ptasks)&&(i<nptg); i+=ptasks)
+    idx.push_back(i);
+  mav<double,2> lptg({idx.size(),3}), ldata({idx.size(),ncomp});
+  for (size_t i=0; i<idx.size(); ++i)
+    {
+    for (size_t j=0; j<3; ++j)
+      lptg.v(i,j) = ptg(idx[i],j);
+    for (size_t j=0; j<ncomp; ++j)
+      ldata.v(i,j) = data(idx[i],j);
+    }
+
+  {
+  mav<double,2> ref({nptg,ncomp}), res({idx.size(),ncomp});
+  Interpolator<double> inter(slm, blm, true, epsilon, ofmin, 1);
+  inter.interpol(ptg, ref);
+  Interpolator_mpi<double> inter_mpi(slm, blm, true, epsilon, ofmin, 2, comm);
+  inter_mpi.interpol(lptg, res);
+  for (size_t i=0; i<idx.size(); ++i)
+    for (size_t j=0; j<ncomp; ++j)
+      MR_assert(res(i,j)==ref(idx[i],j), "interpol mismatch");
+  }
+
+  {
+  vector<Talm> ref, res;
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    ref.emplace_back(lmax, lmax);
+    res.emplace_back(lmax, lmax);
+    }
+  Interpolator<double> inter(lmax, kmax, ncomp, epsilon, ofmin, 1);
+  inter.deinterpol(ptg, data);
+  inter.getSlm(blm, ref);
+  Interpolator_mpi<double> inter_mpi(lmax, kmax, ncomp, epsilon, ofmin, 2,
+    comm);
+  inter_mpi.deinterpol(lptg, ldata);
+  inter_mpi.getSlm(blm, res);
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    double err=0, nrm=0;
+    for (size_t j=0; j<ref[i].Alms().shape(0); ++j)
+      {
+      err = max(err, abs(res[i].Alms()(j)-ref[i].Alms()(j)));
+      nrm = max(nrm, abs(ref[i].Alms()(j)));
+      }
+    err = comm.allreduce(err, Communicator::Max);
+    MR_assert(err<=1e-13*nrm, "deinterpol mismatch");
+    }
+  }
+  }
+
+void runtest(const Communicator &comm, function<void(const Communicator &)> tf,
+  const char *tn)
+  {
+  tf(comm);
+  comm.barrier();
+  if (comm.master())
+    printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  Communication::init();
+  {
+  Communicator comm;
+  if (comm.master())
+    printf("Running on %d task(s)\n", comm.num_ranks());
+  runtest(comm, test_nonblocking, "nonblocking communication");
+  runtest(comm, test_sharp_mpi, "distributed SHT");
+  runtest(comm, test_gridder_mpi, "distributed wgridder");
+  runtest(comm, test_interpol_mpi, "distributed Interpolator");
+  }
+  Communication::finalize();
+  }
@@ -442,6 +442,308 @@ static void check_accuracy (sharp_geom_info &ginfo, sharp_standard_alm_info &ain
     MR_assert((err_rel[i]<1e-10) && (err_abs[i]<1e-10),"error");
   }
 
+static double maxdiff (const vector<dcmplx> &a, const vector<dcmplx> &b)
+  {
+  double res=0;
+  for (size_t i=0; i<a.size(); ++i)
+    res = max(res, abs(a[i]-b[i]));
+  return res;
+  }
+static double maxabs (const vector<dcmplx> &a)
+  {
+  double res=0;
+  for (auto v: a) res = max(res, abs(v));
+  return res;
+  }
+
+/* Compares streaming analysis of ntrans transforms (which are processed in
+   batches of at most sharp_ntrans_max) with separate sharp_execute() calls
+   per transform. */
+static void check_streaming (sharp_geom_info &ginfo,
+  sharp_standard_alm_info &ainfo, int spin, size_t ntrans)
+  {
+  size_t nalms = get_nalms(ainfo);
+  size_t ncomp = (spin==0) ? 1 : 2;
+  size_t npix = get_npix(ginfo);
+
+  vector<double> bmap(ncomp*ntrans*npix);
+  unsigned state=4711u;
+  for (auto &v: bmap) v = drand(-1,1,&state);
+  vector<const double *> map(ncomp*ntrans);
+  for (size_t i=0; i<ncomp*ntrans; ++i)
+    map[i]=&bmap[i*npix];
+  auto reader = [&](size_t icomp, size_t iring, double *ring)
+    { ginfo.get_ring(false, iring, map[icomp], ring); };
+
+  for (auto type: {SHARP_MAP2ALM, SHARP_Yt})
+    {
+    vector<dcmplx> balm_ref(ncomp*ntrans*nalms), balm(ncomp*ntrans*nalms);
+    for (size_t itrans=0; itrans<ntrans; ++itrans)
+      {
+      vector<any> av, mv;
+      for (size_t i=0; i<ncomp; ++i)
+        {
+        av.push_back(&balm_ref[(itrans*ncomp+i)*nalms]);
+        mv.push_back(map[itrans*ncomp+i]);
+        }
+      sharp_execute(type,spin,av,mv,ginfo,ainfo,0,0,nullptr,nullptr);
+      }
+    vector<any> av;
+    for (size_t i=0; i<ncomp*ntrans; ++i)
+      av.push_back(&balm[i*nalms]);
+    sharp_execute_streaming(type,spin,av,reader,ginfo,ainfo,0,0,nullptr,nullptr);
+    MR_assert(maxdiff(balm,balm_ref)<=1e-12*maxabs(balm_ref),"error");
+    }
+  }
+
+/* Compares the fused weighted projection of ntrans transforms with
+   separate SHARP_Y, pixel weighting and SHARP_Yt steps per transform. */
+static void check_weighted_projection (sharp_geom_info &ginfo,
+  sharp_standard_alm_info &ainfo, int spin, size_t ntrans)
+  {
+  size_t nalms = get_nalms(ainfo);
+  size_t ncomp = (spin==0) ? 1 : 2;
+  size_t npix = get_npix(ginfo);
+
+  vector<double> weight(npix);
+  unsigned state=815u;
+  for (auto &v: weight) v = drand(0,1,&state);
+
+  vector<dcmplx> balm_in(ncomp*ntrans*nalms), balm_ref(ncomp*ntrans*nalms);
+  for (size_t i=0; i<ncomp*ntrans; ++i)
+    random_alm(&balm_in[i*nalms],ainfo,spin,i+1);
+  vector<double> bmap(ncomp*npix);
+  for (size_t itrans=0; itrans<ntrans; ++itrans)
+    {
+    vector<any> av_in, av_ref, mv;
+    for (size_t i=0; i<ncomp; ++i)
+      {
+      av_in.push_back(&balm_in[(itrans*ncomp+i)*nalms]);
+      av_ref.push_back(&balm_ref[(itrans*ncomp+i)*nalms]);
+      mv.push_back(&bmap[i*npix]);
+      }
+    sharp_execute(SHARP_Y,spin,av_in,mv,ginfo,ainfo,0,0,nullptr,nullptr);
+    for (size_t i=0; i<ncomp; ++i)
+      for (size_t j=0; j<npix; ++j)
+        bmap[i*npix+j]*=weight[j];
+    sharp_execute(SHARP_Yt,spin,av_ref,mv,ginfo,ainfo,0,0,nullptr,nullptr);
+    }
+
+  vector<dcmplx> balm_out(ncomp*ntrans*nalms);
+  vector<any> av_in, av_out;
+  for (size_t i=0; i<ncomp*ntrans; ++i)
+    {
+    av_in.push_back(&balm_in[i*nalms]);
+    av_out.push_back(&balm_out[i*nalms]);
+    }
+  sharp_weighted_projection(spin,av_in,av_out,weight.data(),ginfo,ainfo,0,0,
+    nullptr,nullptr);
+  MR_assert(maxdiff(balm_out,balm_ref)<=1e-12*maxabs(balm_ref),"error");
+  // a second call with SHARP_ADD must double the result
+  sharp_weighted_projection(spin,av_in,av_out,weight.data(),ginfo,ainfo,
+    SHARP_ADD,0,nullptr,nullptr);
+  for (auto &v: balm_ref) v*=2;
+  MR_assert(maxdiff(balm_out,balm_ref)<=1e-12*maxabs(balm_ref),"error");
+  }
+
+/* Shifting the first pixel of a ring by k pixels must be equivalent to
+   rolling the ring data by k pixels. The shifts differ between rings (and
+   between the two rings of most pairs) and include multiples of 2*pi, so
+   the phase factors exp(i*m*phi0) of the ring FFTs are checked for all m
+   against the exactly known result. */
+static void check_phase_shift (int lmax, int spin)
+  {
+  size_t nlat=lmax+1, nph=2*lmax+2, npix=nlat*nph;
+  size_t ncomp = (spin==0) ? 1 : 2;
+  auto ainfo=sharp_make_triangular_alm_info(lmax,lmax,1);
+  auto ginfo0=sharp_make_gauss_geom_info(nlat, nph, 0., 1, nph);
+  vector<size_t> nph_(nlat, nph), kshift(nlat);
+  vector<ptrdiff_t> ofs(nlat);
+  vector<double> phi0(nlat), theta(nlat), weight(nlat);
+  for (size_t i=0; i<nlat; ++i)
+    {
+    // rings 0 and nlat-1 share their shift, all other pairs do not
+    kshift[i] = (i==nlat-1) ? kshift[0] : (37*i+5)%nph + nph*(i%4);
+    ofs[i] = ptrdiff_t(i*nph);
+    phi0[i] = kshift[i]*(2*pi/nph);
+    theta[i] = ginfo0->theta(i);
+    weight[i] = ginfo0->weight(i);
+    }
+  sharp_standard_geom_info ginfo(nlat, nph_.data(), ofs.data(), 1,
+    phi0.data(), theta.data(), weight.data());
+  auto roll = [&](const vector<double> &in)
+    {
+    vector<double> res(in.size());
+    for (size_t c=0; c<ncomp; ++c)
+      for (size_t i=0; i<nlat; ++i)
+        for (size_t j=0; j<nph; ++j)
+          res[c*npix+i*nph+j] = in[c*npix+i*nph+(j+kshift[i])%nph];
+    return res;
+    };
+  auto maxdiff_map = [](const vector<double> &a, const vector<double> &b)
+    {
+    double res=0, nrm=0;
+    for (size_t i=0; i<a.size(); ++i)
+      {
+      res = max(res, abs(a[i]-b[i]));
+      nrm = max(nrm, abs(b[i]));
+      }
+    return res/nrm;
+    };
+
+  size_t nalms = get_nalms(*ainfo);
+  vector<dcmplx> alm(ncomp*nalms);
+  for (size_t i=0; i<ncomp; ++i)
+    random_alm(&alm[i*nalms],*ainfo,spin,i+1);
+  vector<double> map0(ncomp*npix), map(ncomp*npix);
+  vector<any> av, mv0, mv;
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    av.push_back(&alm[i*nalms]);
+    mv0.push_back(&map0[i*npix]);
+    mv.push_back(&map[i*npix]);
+    }
+  sharp_execute(SHARP_ALM2MAP,spin,av,mv0,*ginfo0,*ainfo,0,0,nullptr,nullptr);
+  sharp_execute(SHARP_ALM2MAP,spin,av,mv,ginfo,*ainfo,0,0,nullptr,nullptr);
+  MR_assert(maxdiff_map(map,roll(map0))<=1e-12,"error");
+
+  auto rolled = roll(map0);
+  copy(rolled.begin(), rolled.end(), map.begin());
+  for (auto type: {SHARP_MAP2ALM, SHARP_Yt})
+    {
+    vector<dcmplx> alm0(ncomp*nalms), alm1(ncomp*nalms);
+    vector<any> av0, av1;
+    for (size_t i=0; i<ncomp; ++i)
+      {
+      av0.push_back(&alm0[i*nalms]);
+      av1.push_back(&alm1[i*nalms]);
+      }
+    sharp_execute(type,spin,av0,mv0,*ginfo0,*ainfo,0,0,nullptr,nullptr);
+    sharp_execute(type,spin,av1,mv,ginfo,*ainfo,0,0,nullptr,nullptr);
+    MR_assert(maxdiff(alm1,alm0)<=1e-12*maxabs(alm0),"error");
+    }
+  }
+
+/* Checks that geometry \a ginfo describes the same rings and pairs (in the
+   same order) as the table based sharp_standard_geom_info \a ref, and that
+   transforms with both geometries give bitwise identical results. The
+   pixel offsets of the rings are compared via get_ring() on a map holding
+   the pixel indices. */
+static void check_geometry (const sharp_geom_info &ginfo,
+  const sharp_geom_info &ref, ptrdiff_t stride, int lmax)
+  {
+  MR_assert(ginfo.nrings()==ref.nrings(),"nrings differs");
+  MR_assert(ginfo.npairs()==ref.npairs(),"npairs differs");
+  MR_assert(ginfo.nphmax()==ref.nphmax(),"nphmax differs");
+  size_t npix = get_npix(ref)*size_t(stride);
+  vector<double> idx(npix), ring1(ref.nphmax()), ring2(ref.nphmax());
+  for (size_t i=0; i<npix; ++i) idx[i]=double(i);
+  const double *pidx=idx.data();
+  for (size_t i=0; i<ref.npairs(); ++i)
+    {
+    auto p=ginfo.pair(i), pref=ref.pair(i);
+    MR_assert((p.r1==size_t(~0))==(pref.r1==size_t(~0)),"pairs differ");
+    MR_assert((p.r2==size_t(~0))==(pref.r2==size_t(~0)),"pairs differ");
+    for (auto rr: {make_pair(p.r1,pref.r1), make_pair(p.r2,pref.r2)})
+      {
+      size_t r=rr.first, r0=rr.second;
+      if (r==size_t(~0)) continue;
+      MR_assert(ginfo.nph(r)==ref.nph(r0),"nph differs");
+      MR_assert(ginfo.theta(r)==ref.theta(r0),"theta differs");
+      MR_assert(ginfo.cth(r)==ref.cth(r0),"cth differs");
+      MR_assert(ginfo.sth(r)==ref.sth(r0),"sth differs");
+      MR_assert(ginfo.phi0(r)==ref.phi0(r0),"phi0 differs");
+      MR_assert(ginfo.weight(r)==ref.weight(r0),"weight differs");
+      for (bool weighted: {false, true})
+        {
+        ginfo.get_ring(weighted,r,pidx,ring1.data());
+        ref.get_ring(weighted,r0,pidx,ring2.data());
+        for (size_t j=0; j<ref.nph(r0); ++j)
+          MR_assert(ring1[j]==ring2[j],"ring pixels differ");
+        }
+      }
+    }
+
+  auto ainfo=sharp_make_triangular_alm_info(lmax,lmax,1);
+  size_t nalms = get_nalms(*ainfo);
+  vector<dcmplx> alm(nalms), alm1(nalms), alm2(nalms);
+  random_alm(alm.data(),*ainfo,0,1);
+  vector<double> map1(npix,0.), map2(npix,0.);
+  sharp_execute(SHARP_ALM2MAP,0,{alm.data()},{map1.data()},ginfo,*ainfo,0,0,
+    nullptr,nullptr);
+  sharp_execute(SHARP_ALM2MAP,0,{alm.data()},{map2.data()},ref,*ainfo,0,0,
+    nullptr,nullptr);
+  MR_assert(map1==map2,"alm2map results differ");
+  sharp_execute(SHARP_MAP2ALM,0,{alm1.data()},{map1.data()},ginfo,*ainfo,0,0,
+    nullptr,nullptr);
+  sharp_execute(SHARP_MAP2ALM,0,{alm2.data()},{map2.data()},ref,*ainfo,0,0,
+    nullptr,nullptr);
+  MR_assert(alm1==alm2,"map2alm results differ");
+  }
+
+/* Compares the HEALPix and iso-latitude geometries, which compute their
+   ring properties on demand, with tables of the same rings. */
+static void check_geometries()
+  {
+  for (size_t nside: {1, 2, 3, 8, 13})
+    for (ptrdiff_t stride: {1, 2})
+      for (bool weighted: {false, true})
+        {
+        vector<double> wgt(2*nside);
+        unsigned state=4711u;
+        for (auto &v: wgt) v = drand(0.5,1.5,&state);
+        const double *pwgt = weighted ? wgt.data() : nullptr;
+        auto ginfo=sharp_make_weighted_healpix_geom_info(nside,stride,pwgt);
+        // the rings of the full map, in a table with stride 1
+        auto tab=sharp_make_subset_healpix_geom_info(nside,1,4*nside-1,
+          nullptr,pwgt);
+        vector<size_t> nph(tab->nrings());
+        vector<ptrdiff_t> ofs(tab->nrings());
+        vector<double> phi0(tab->nrings()), theta(tab->nrings()),
+          weight(tab->nrings());
+        vector<double> idx(12*nside*nside), ring(4*nside);
+        for (size_t i=0; i<idx.size(); ++i) idx[i]=double(i);
+        for (size_t i=0; i<tab->nrings(); ++i)
+          {
+          tab->get_ring(false,i,static_cast<const double *>(idx.data()),
+            ring.data());
+          nph[i]=tab->nph(i);
+          ofs[i]=ptrdiff_t(ring[0])*stride;
+          phi0[i]=tab->phi0(i);
+          theta[i]=tab->theta(i);
+          weight[i]=tab->weight(i);
+          }
+        sharp_standard_geom_info ref(tab->nrings(), nph.data(), ofs.data(),
+          stride, phi0.data(), theta.data(), weight.data());
+        check_geometry(*ginfo, ref, stride, int(2*nside));
+        }
+
+  using maker = unique_ptr<sharp_geom_info>(*)(size_t, size_t, double,
+    ptrdiff_t, ptrdiff_t);
+  for (maker make: {sharp_make_gauss_geom_info, sharp_make_fejer1_geom_info,
+    sharp_make_fejer2_geom_info, sharp_make_cc_geom_info,
+    sharp_make_dh_geom_info, sharp_make_mw_geom_info})
+    for (size_t nrings: {4, 7, 16, 33})
+      for (ptrdiff_t stride: {1, 2})
+        {
+        size_t nphi=2*nrings+1;
+        double phi0=0.3;
+        auto ginfo=make(nrings,nphi,phi0,stride,ptrdiff_t(nphi)*stride);
+        vector<size_t> nph(nrings, nphi);
+        vector<ptrdiff_t> ofs(nrings);
+        vector<double> phi0_(nrings, phi0), theta(nrings), weight(nrings);
+        for (size_t i=0; i<nrings; ++i)
+          {
+          ofs[i]=ptrdiff_t(i*nphi)*stride;
+          theta[i]=ginfo->theta(i);
+          weight[i]=ginfo->weight(i);
+          }
+        sharp_standard_geom_info ref(nrings, nph.data(), ofs.data(),
+          stride, phi0_.data(), theta.data(), weight.data());
+        check_geometry(*ginfo, ref, stride, int(nrings-1));
+        }
+  }
+
 static void run(int lmax, int mmax, int nlat, int nlon, int spin)
   {
   unique_ptr<sharp_geom_info> ginfo;
@@ -470,6 +772,42 @@ static void sharp_acctest(void)
   run(8, 8, 9, 17, 0);
   run(8, 8, 9, 17, 2);
   if (mytask==0) cout << "Passed.\n\n";
+
+  if (mytask==0) cout << "Testing on-demand ring properties.\n";
+  check_geometries();
+  if (mytask==0) cout << "Passed.\n\n";
+
+  if (mytask==0) cout << "Testing ring phase shifts.\n";
+  for (int lmax: {31, 255})
+    for (int spin: {0, 2})
+      check_phase_shift(lmax, spin);
+  if (mytask==0) cout << "Passed.\n\n";
+
+  if (mytask==0) cout << "Testing streaming map analysis.\n";
+  for (auto gname: {"gauss", "healpix"})
+    {
+    int lmax=47, mmax=-1, gpar1=-1, gpar2=-1;
+    unique_ptr<sharp_geom_info> ginfo;
+    unique_ptr<sharp_standard_alm_info> ainfo;
+    get_infos (gname, lmax, mmax, gpar1, gpar2, ginfo, ainfo, 0);
+    for (int spin: {0, 2})
+      for (size_t ntrans: {1, 10})
+        check_streaming(*ginfo, *ainfo, spin, ntrans);
+    }
+  if (mytask==0) cout << "Passed.\n\n";
+
+  if (mytask==0) cout << "Testing weighted projection.\n";
+  for (auto gname: {"gauss", "healpix"})
+    {
+    int lmax=47, mmax=-1, gpar1=-1, gpar2=-1;
+    unique_ptr<sharp_geom_info> ginfo;
+    unique_ptr<sharp_standard_alm_info> ainfo;
+    get_infos (gname, lmax, mmax, gpar1, gpar2, ginfo, ainfo, 0);
+    for (int spin: {0, 2})
+      for (size_t ntrans: {1, 10})
+        check_weighted_projection(*ginfo, *ainfo, spin, ntrans);
+    }
+  if (mytask==0) cout << "Passed.\n\n";
   }
 
 static void sharp_test (int argc, const char **argv)
@@ -0,0 +1,191 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Checks the accuracy of the vectorized elementary functions in simd.h
+ *  against the scalar functions of the standard library.
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+/* The reference values are computed in the next wider type (long double
+   for double arguments), so that the errors of the reference itself are
+   negligible where long double is wider than double. The functions are
+   called through pointers, so that the compiler cannot replace them by
+   less accurate inline code with -ffast-math (like the x87 fsin). */
+template<typename T> struct Ref;
+template<> struct Ref<float>
+  {
+  using T = double;
+  static inline T (*volatile sin)(T) = ::sin;
+  static inline T (*volatile cos)(T) = ::cos;
+  static inline T (*volatile exp)(T) = ::exp;
+  static inline T (*volatile log)(T) = ::log;
+  static inline T (*volatile atan2)(T, T) = ::atan2;
+  };
+template<> struct Ref<double>
+  {
+  using T = long double;
+  static inline T (*volatile sin)(T) = ::sinl;
+  static inline T (*volatile cos)(T) = ::cosl;
+  static inline T (*volatile exp)(T) = ::expl;
+  static inline T (*volatile log)(T) = ::logl;
+  static inline T (*volatile atan2)(T, T) = ::atan2l;
+  };
+template<typename T> using Tref = typename Ref<T>::T;
+
+// error of res in units of the last place of the exact result ref
+template<typename T> double ulp_error(T res, Tref<T> ref)
+  {
+  if (res==ref) return 0.;
+  int e;
+  frexp(ref, &e);
+  e = max(e, numeric_limits<T>::min_exponent);
+  Tref<T> ulp = ldexp(Tref<T>(1), e-numeric_limits<T>::digits);
+  return double(abs(Tref<T>(res)-ref)/ulp);
+  }
+
+template<typename T, typename Tgen, typename Fvec, typename Fref>
+  double max_ulp(Tgen gen, Fvec fvec, Fref fref, size_t n)
+  {
+  using V = native_simd<T>;
+  mt19937_64 rng(42);
+  double res=0;
+  for (size_t i=0; i<n; i+=V::size())
+    {
+    V x;
+    for (size_t j=0; j<V::size(); ++j)
+      x[j] = gen(rng);
+    V y = fvec(x);
+    for (size_t j=0; j<V::size(); ++j)
+      res = max(res, ulp_error<T>(y[j], fref(Tref<T>(x[j]))));
+    }
+  return res;
+  }
+
+template<typename T> void check(const char *name, double err, double bound)
+  {
+  printf("  %-6s %-22s max error: %.2f ulp\n",
+    is_same<T,float>::value ? "float" : "double", name, err);
+  MR_assert(err<=bound, "error too large");
+  }
+
+template<typename T> void test_funcs()
+  {
+  using V = native_simd<T>;
+  constexpr bool dbl = is_same<T,double>::value;
+  constexpr size_t n=1000000;
+  auto uniform = [](T lo, T hi)
+    { return [lo,hi](mt19937_64 &rng)
+      { return uniform_real_distribution<T>(lo,hi)(rng); }; };
+  auto vsin = [](V x) { return sin(x); };
+  auto vcos = [](V x) { return cos(x); };
+  auto rsin = [](Tref<T> x) { return Ref<T>::sin(x); };
+  auto rcos = [](Tref<T> x) { return Ref<T>::cos(x); };
+  // the bounds are a bit looser than the errors documented in simd.h,
+  // since they must hold with every backend and compiler
+  check<T>("sin [-100;100]", max_ulp<T>(uniform(-100,100), vsin, rsin, n), 2.);
+  check<T>("cos [-100;100]", max_ulp<T>(uniform(-100,100), vcos, rcos, n), 2.);
+  T big = dbl ? T(1e5) : T(8000);
+  check<T>("sin (large)", max_ulp<T>(uniform(-big,big), vsin, rsin, n), 3.);
+  check<T>("cos (large)", max_ulp<T>(uniform(-big,big), vcos, rcos, n), 3.);
+  // beyond the reduction limits, the scalar functions are called
+  auto huge = [](mt19937_64 &rng)
+    {
+    T res = uniform_real_distribution<T>(dbl ? T(2e6) : T(1e4), T(1e8))(rng);
+    return (rng()&1) ? res : -res;
+    };
+  check<T>("sin (huge)", max_ulp<T>(huge, vsin,
+    [](Tref<T> x) { return Tref<T>(std::sin(T(x))); }, n/10), 0.);
+
+  T emax = dbl ? T(700) : T(87);
+  check<T>("exp", max_ulp<T>(uniform(-emax,emax), [](V x) { return exp(x); },
+    [](Tref<T> x) { return Ref<T>::exp(x); }, n), 2.);
+  check<T>("exp [-1;1]", max_ulp<T>(uniform(-1,1), [](V x) { return exp(x); },
+    [](Tref<T> x) { return Ref<T>::exp(x); }, n), 2.);
+
+  auto vlog = [](V x) { return log(x); };
+  auto rlog = [](Tref<T> x) { return Ref<T>::log(x); };
+  auto logarg = [emax](mt19937_64 &rng)
+    { return exp(uniform_real_distribution<T>(-emax,emax)(rng)); };
+  check<T>("log", max_ulp<T>(logarg, vlog, rlog, n), 2.);
+  check<T>("log [0.5;2]", max_ulp<T>(uniform(0.5,2), vlog, rlog, n), 2.);
+  // subnormal arguments
+  auto tiny = [](mt19937_64 &rng)
+    {
+    return uniform_real_distribution<T>(T(1),T(1000))(rng)
+      *numeric_limits<T>::denorm_min();
+    };
+  check<T>("log (subnormal)", max_ulp<T>(tiny, vlog, rlog, n/10), 2.);
+
+  // atan2 with both arguments random (in a vector of pairs)
+  {
+  mt19937_64 rng(42);
+  uniform_real_distribution<T> dist(-1,1);
+  double err=0;
+  for (size_t i=0; i<n; i+=V::size())
+    {
+    V x, y;
+    for (size_t j=0; j<V::size(); ++j)
+      { x[j]=dist(rng); y[j]=dist(rng); }
+    V r = atan2(y, x);
+    for (size_t j=0; j<V::size(); ++j)
+      err = max(err, ulp_error<T>(r[j],
+        Ref<T>::atan2(Tref<T>(y[j]), Tref<T>(x[j]))));
+    }
+  check<T>("atan2", err, dbl ? 2. : 4.);
+  }
+
+#ifndef __FAST_MATH__
+  // special values (-ffast-math assumes that there are no infinities and NaNs)
+  V x(T(0));
+  x[0] = T(2000); x[1] = -T(2000);
+  V e = exp(x);
+  MR_assert(isinf(e[0]) && (e[0]>0) && (e[1]==0), "exp: bad special values");
+  x[0] = T(0); x[1] = -T(1);
+  V l = log(x);
+  MR_assert(isinf(l[0]) && (l[0]<0) && isnan(l[1]), "log: bad special values");
+  x[0] = numeric_limits<T>::infinity();
+  MR_assert(isinf(log(x)[0]), "log: bad special values");
+#endif
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  printf("SIMD vector length: %zu (double), %zu (float)\n",
+    native_simd<double>::size(), native_simd<float>::size());
+  test_funcs<double>();
+  test_funcs<float>();
+  printf("OK.\n");
+  }
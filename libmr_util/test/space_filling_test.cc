@@ -1,4 +1,5 @@
 #include <functional>
+#include <vector>
 #include "ducc0/math/space_filling.h"
 #include "ducc0/infra/error_handling.h"
 
@@ -164,6 +165,91 @@ int64_t t34()
   return cnt;
   }
 
+
+// array versions, processing the values in chunks of 1024
+constexpr size_t chunk=1024;
+
+int64_t t40()
+  {
+  int64_t cnt=0;
+  vector<array<uint64_t,2>> xy(chunk), xy2(chunk);
+  vector<uint64_t> v(chunk);
+  for (uint64_t x=0; x<0xffff0000; x+=0xfff5)
+    {
+    size_t n=0;
+    for (uint64_t y=0; y<0xffff0000; y+=0xfff7)
+      {
+      xy[n++] = {x,y};
+      if ((n==chunk) || (y+0xfff7>=0xffff0000))
+        {
+        coord2morton2D_64(xy.data(), v.data(), n);
+        morton2coord2D_64(v.data(), xy2.data(), n);
+        for (size_t i=0; i<n; ++i)
+          {
+          MR_assert(v[i]==coord2morton2D_64(xy[i]),"bug");
+          MR_assert(xy2[i]==xy[i],"bug");
+          }
+        cnt+=n;
+        n=0;
+        }
+      }
+    }
+  return cnt;
+  }
+int64_t t41()
+  {
+  int64_t cnt=0;
+  vector<uint64_t> v(chunk), v2(chunk), v3(chunk);
+  for (uint64_t v0=0; v0<0xffffffff00000000; v0+=chunk*0xfffff563)
+    {
+    for (size_t i=0; i<chunk; ++i)
+      v[i] = v0+i*0xfffff563;
+    morton2block2D_64(v.data(), v2.data(), chunk);
+    block2morton2D_64(v2.data(), v3.data(), chunk);
+    for (size_t i=0; i<chunk; ++i)
+      {
+      MR_assert(v2[i]==morton2block2D_64(v[i]),"bug");
+      MR_assert(v3[i]==v[i],"bug");
+      }
+    cnt+=chunk;
+    }
+  return cnt;
+  }
+int64_t t42()
+  {
+  int64_t cnt=0;
+  vector<uint64_t> v(chunk), v2(chunk), v3(chunk);
+  for (uint64_t v0=0; v0<0xffffffff00000000; v0+=chunk*0xfffffff78)
+    {
+    for (size_t i=0; i<chunk; ++i)
+      v[i] = v0+i*0xfffffff78;
+    morton2peano2D_64(v.data(), v2.data(), chunk, 32);
+    peano2morton2D_64(v2.data(), v3.data(), chunk, 32);
+    for (size_t i=0; i<chunk; ++i)
+      MR_assert(v3[i]==v[i],"bug");
+    cnt+=chunk;
+    }
+  return cnt;
+  }
+int64_t t43()
+  {
+  int64_t cnt=0;
+  vector<array<uint32_t,2>> xy(chunk), xy2(chunk);
+  vector<uint32_t> v(chunk);
+  for (uint32_t x=0; x<0x10000; ++x)
+    for (uint32_t y0=0; y0<0x10000; y0+=chunk)
+      {
+      for (size_t i=0; i<chunk; ++i)
+        xy[i] = {x, uint32_t(y0+i)};
+      coord2morton2D_32(xy.data(), v.data(), chunk);
+      morton2coord2D_32(v.data(), xy2.data(), chunk);
+      for (size_t i=0; i<chunk; ++i)
+        MR_assert(xy2[i]==xy[i],"bug");
+      cnt+=chunk;
+      }
+  return cnt;
+  }
+
 } // unnamed namespace
 
 #include <cstdio>
@@ -181,6 +267,8 @@ void runtest(function<int64_t()> tf, const char *tn)
 int main(int argc, const char **argv)
   {
   MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  printf("Morton conversions use BMI2: %s\n",
+    space_filling_bmi2() ? "yes" : "no");
   runtest(t10,"coord  <-> Morton 2D 32bit");
   runtest(t11,"coord  <-> Block  2D 32bit");
   runtest(t12,"Morton <-> Block  2D 32bit");
@@ -189,6 +277,10 @@ int main(int argc, const char **argv)
   runtest(t21,"coord  <-> Block  2D 64bit");
   runtest(t22,"Morton <-> Block  2D 64bit");
   runtest(t34,"Morton <-> Peano  2D 64bit");
+  runtest(t43,"coord  <-> Morton 2D 32bit (array)");
+  runtest(t40,"coord  <-> Morton 2D 64bit (array)");
+  runtest(t41,"Morton <-> Block  2D 64bit (array)");
+  runtest(t42,"Morton <-> Peano  2D 64bit (array)");
   runtest(t00,"coord  <-> Morton 3D 32bit");
   runtest(t01,"coord  <-> Block  3D 32bit");
   runtest(t02,"Morton <-> Peano  3D 32bit");
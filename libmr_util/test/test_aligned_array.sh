@@ -0,0 +1,3 @@
+#!/bin/sh
+
+./aligned_array_test
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+./fft_test
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+./gl_integrator_test
@@ -0,0 +1,9 @@
+#!/bin/sh
+
+# the tests use more tasks than many machines have cores
+OMPI_MCA_rmaps_base_oversubscribe=1
+export OMPI_MCA_rmaps_base_oversubscribe
+
+for ntasks in 1 2 3 5; do
+  ${MPIEXEC:-mpiexec} -n $ntasks ./mpi_test || exit 1
+done
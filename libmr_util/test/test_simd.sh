@@ -0,0 +1,3 @@
+#!/bin/sh
+
+./simd_test
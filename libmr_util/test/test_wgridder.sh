@@ -0,0 +1,3 @@
+#!/bin/sh
+
+./wgridder_test
@@ -0,0 +1,132 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*  \file threading_bench.cc
+ *  Microbenchmark for the fork-join overhead of the thread pool.
+ *
+ *  Usage: threading_bench [key=value ...]
+ *    nthreads=1,4      thread counts (default: 1, 2 and all)
+ *    mintime=0.5       minimum measuring time per case (s)
+ *
+ *  Cases:
+ *    parallel   execParallel() with an empty work function
+ *    static     execStatic() over 1000 trivial items
+ *    dynamic    execDynamic() over 10000 trivial items, chunk size 1
+ *    nested     execParallel() on 2 threads, each opening an inner region
+ *               with nthreads/2 threads
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <atomic>
+#include <functional>
+#include "ducc0/infra/timers.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/string_utils.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+/* Returns the average wall time (in microseconds) of one call of \a func,
+   measured over at least \a mintime seconds. */
+double time_per_call(const function<void()> &func, double mintime,
+  size_t &ncalls)
+  {
+  for (size_t i=0; i<10; ++i) func();  // warm up the pool
+  ncalls=0;
+  SimpleTimer timer;
+  size_t nrep=1;
+  while (true)
+    {
+    for (size_t i=0; i<nrep; ++i) func();
+    ncalls+=nrep;
+    double t=timer();
+    if (t>=mintime) return 1e6*t/ncalls;
+    nrep*=2;
+    }
+  }
+
+template<typename T> vector<T> get_list(const map<string,string> &dict,
+  const string &key, const string &deflt)
+  {
+  auto it = dict.find(key);
+  vector<T> res;
+  for (const auto &s: tokenize((it==dict.end()) ? deflt : it->second, ','))
+    res.push_back(stringToData<T>(s));
+  return res;
+  }
+
+} // unnamed namespace
+
+int main(int argc, const char **argv)
+  {
+  map<string,string> dict;
+  parse_cmdline_equalsign(argc, argv, dict);
+  size_t nthr_max = max_threads();
+  auto nthreads = get_list<size_t>(dict, "nthreads",
+    (nthr_max>2) ? "1,2,"+dataToString(nthr_max) :
+    ((nthr_max>1) ? "1,2" : "1"));
+  double mintime = dict.count("mintime") ? stringToData<double>(dict["mintime"])
+                                         : 0.5;
+
+  atomic<size_t> sink(0);
+  map<string, function<void(size_t)>> cases {
+    {"parallel", [&](size_t nthr)
+      { execParallel(nthr, [&](Scheduler &) {}); }},
+    {"static", [&](size_t nthr)
+      {
+      execStatic(1000, nthr, 0, [&](Scheduler &sched)
+        {
+        size_t cnt=0;
+        while (auto rng=sched.getNext()) cnt+=rng.hi-rng.lo;
+        sink+=cnt;
+        });
+      }},
+    {"dynamic", [&](size_t nthr)
+      {
+      execDynamic(10000, nthr, 1, [&](Scheduler &sched)
+        {
+        size_t cnt=0;
+        while (auto rng=sched.getNext()) cnt+=rng.hi-rng.lo;
+        sink+=cnt;
+        });
+      }},
+    {"nested", [&](size_t nthr)
+      {
+      execParallel(2, [&](Scheduler &)
+        { execParallel(std::max<size_t>(1, nthr/2), [&](Scheduler &) {}); });
+      }}};
+
+  cout << left << setw(10) << "case" << right << setw(5) << "thr"
+       << setw(12) << "calls" << setw(12) << "us/call" << endl;
+  for (const auto &c: {"parallel", "static", "dynamic", "nested"})
+    for (auto nthr: nthreads)
+      {
+      size_t ncalls;
+      double t = time_per_call([&]{ cases[c](nthr); }, mintime, ncalls);
+      cout << left << setw(10) << c << right << setw(5) << nthr
+           << setw(12) << ncalls << setw(12) << fixed << setprecision(2)
+           << t << endl;
+      }
+  }
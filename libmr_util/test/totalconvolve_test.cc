@@ -0,0 +1,135 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cstdio>
+#include <functional>
+#include <random>
+#include "python/totalconvolve.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+using Talm = Alm<complex<double>>;
+
+void random_alm(Talm &alm, mt19937 &rng)
+  {
+  uniform_real_distribution<double> dist(-1.,1.);
+  for (size_t m=0; m<=alm.Mmax(); ++m)
+    for (size_t l=m; l<=alm.Lmax(); ++l)
+      alm.Alms().v(alm.index(l,m)) =
+        complex<double>(dist(rng), (m==0) ? 0. : dist(rng));
+  }
+
+/* Random pointings; some of them lie exactly on the poles and on the
+   boundaries of the phi range, i.e. in the last cells of the sort. */
+mav<double,2> random_pointings(size_t n, mt19937 &rng)
+  {
+  mav<double,2> ptg({n,3});
+  uniform_real_distribution<double> dist(0.,1.);
+  for (size_t i=0; i<n; ++i)
+    {
+    ptg.v(i,0) = acos(1.-2.*dist(rng));
+    ptg.v(i,1) = twopi*dist(rng);
+    ptg.v(i,2) = twopi*dist(rng);
+    }
+  for (size_t i=0; i<n; i+=97)
+    {
+    ptg.v(i,0) = (i&1) ? pi : 0.;
+    ptg.v(i+1,1) = (i&2) ? twopi*(1.-1e-16) : 0.;
+    }
+  return ptg;
+  }
+
+/* The order in which the pointings are processed is an implementation
+   detail, so the results of a single call for all pointings (which are
+   sorted along a Peano curve of cells) must agree with those of separate
+   calls for every pointing. */
+void test_interpol_order()
+  {
+  constexpr size_t lmax=31, kmax=4, nptg=1000;
+  constexpr double epsilon=1e-8, ofmin=1.5;
+  mt19937 rng(42);
+  vector<Talm> slm, blm;
+  slm.emplace_back(lmax, lmax);
+  blm.emplace_back(lmax, kmax);
+  random_alm(slm[0], rng);
+  random_alm(blm[0], rng);
+  auto ptg = random_pointings(nptg, rng);
+
+  mav<double,2> res({nptg,1}), res1({1,1});
+  for (int nthreads: {1, 4})
+    {
+    Interpolator<double> inter(slm, blm, false, epsilon, ofmin, nthreads);
+    inter.interpol(ptg, res);
+    for (size_t i=0; i<nptg; ++i)
+      {
+      inter.interpol(ptg.subarray<2>({i,0}, {1,3}), res1);
+      MR_assert(res(i,0)==res1(0,0), "interpol depends on the order");
+      }
+    }
+
+  // adjoint: accumulate all pointings at once and one by one
+  mav<double,2> data({nptg,1});
+  uniform_real_distribution<double> dist(-1.,1.);
+  for (size_t i=0; i<nptg; ++i)
+    data.v(i,0) = dist(rng);
+  vector<Talm> ref, out;
+  ref.emplace_back(lmax, lmax);
+  out.emplace_back(lmax, lmax);
+  {
+  Interpolator<double> inter(lmax, kmax, 1, epsilon, ofmin, 1);
+  for (size_t i=0; i<nptg; ++i)
+    inter.deinterpol(ptg.subarray<2>({i,0}, {1,3}),
+      data.subarray<2>({i,0}, {1,1}));
+  inter.getSlm(blm, ref);
+  }
+  double nrm=0;
+  for (size_t i=0; i<ref[0].Alms().shape(0); ++i)
+    nrm = max(nrm, abs(ref[0].Alms()(i)));
+  for (int nthreads: {1, 4})
+    {
+    Interpolator<double> inter(lmax, kmax, 1, epsilon, ofmin, nthreads);
+    inter.deinterpol(ptg, data);
+    inter.getSlm(blm, out);
+    for (size_t i=0; i<ref[0].Alms().shape(0); ++i)
+      MR_assert(abs(out[0].Alms()(i)-ref[0].Alms()(i))<=1e-13*nrm,
+        "deinterpol depends on the order");
+    }
+  }
+
+void runtest(function<void()> tf, const char *tn)
+  {
+  tf();
+  printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  runtest(test_interpol_order,"Interpolator pointing order");
+  }
@@ -0,0 +1,226 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Tests for the C++ parts of the wgridder which are not reachable from
+ *  the Python tests.
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#include <cstdio>
+#include <functional>
+#include <random>
+#include "python/gridder_cxx.h"
+#include "ducc0/infra/error_handling.h"
+
+using namespace std;
+using namespace ducc0;
+
+namespace {
+
+constexpr double speedoflight=299792458.;
+
+double l2error(const mav<double,2> &a, const mav<double,2> &b)
+  {
+  double sa=0, sb=0, sd=0;
+  for (size_t i=0; i<a.shape(0); ++i)
+    for (size_t j=0; j<a.shape(1); ++j)
+      {
+      sa += a(i,j)*a(i,j);
+      sb += b(i,j)*b(i,j);
+      sd += (a(i,j)-b(i,j))*(a(i,j)-b(i,j));
+      }
+  return sqrt(sd/max(sa,sb));
+  }
+
+/* Measurement set with half of the visibilities clustered around a single
+   uv point, so that one tile of the grid gets many runs of visibilities,
+   which are processed concurrently in the same phase. */
+struct TestMs
+  {
+  mav<double,2> uvw;
+  mav<double,1> freq;
+  mav<complex<double>,2> ms;
+  double pixsize;
+
+  TestMs(size_t nrow, size_t nchan, size_t npix)
+    : uvw({nrow,3}), freq({nchan}), ms({nrow,nchan}), pixsize(pi/180./npix)
+    {
+    constexpr double f0=1e9;
+    mt19937 rng(42);
+    uniform_real_distribution<double> dist(-0.5,0.5);
+    for (size_t i=0; i<nchan; ++i)
+      freq.v(i) = f0 + i*(f0/(10*nchan));
+    for (size_t i=0; i<nrow; ++i)
+      {
+      double scale = (i&1) ? 0.02 : 1.;
+      for (size_t j=0; j<3; ++j)
+        uvw.v(i,j) = ((i&1) ? 0.2 : 0.) + scale*dist(rng);
+      for (size_t j=0; j<3; ++j)
+        uvw.v(i,j) /= pixsize*f0/speedoflight*((j==2) ? 20. : 1.);
+      for (size_t j=0; j<nchan; ++j)
+        ms.v(i,j) = complex<double>(dist(rng), dist(rng));
+      }
+    }
+  };
+
+/* Compares the gridding of several threads, which processes the tiles of
+   the grid in conflict-free phases, with the single-threaded result (which
+   processes all visibilities in order, as before the phases were
+   introduced), and, for a subset of pixels, with the direct sum. */
+void test_gridding_phases()
+  {
+  constexpr size_t nrow=2500, nchan=8, npix=64;
+  constexpr double epsilon=1e-5;
+  TestMs tms(nrow, nchan, npix);
+  mav<double,2> wgt({0,0});
+  mav<uint8_t,2> mask({0,0});
+  for (auto do_w: {false, true})
+    {
+    mav<double,2> ref({npix,npix});
+    ms2dirty(tms.uvw, tms.freq, tms.ms, wgt, mask, tms.pixsize, tms.pixsize,
+      0, 0, epsilon, do_w, 1, ref, 0);
+    for (size_t nthreads: {2, 4, 7})
+      {
+      mav<double,2> dirty({npix,npix});
+      ms2dirty(tms.uvw, tms.freq, tms.ms, wgt, mask, tms.pixsize,
+        tms.pixsize, 0, 0, epsilon, do_w, nthreads, dirty, 0);
+      MR_assert(l2error(dirty, ref)<=1e-13, "results differ");
+      }
+
+    // direct sum for every 7th pixel
+    mav<double,2> dft({(npix+6)/7,(npix+6)/7}),
+                  sub({(npix+6)/7,(npix+6)/7});
+    for (size_t i=0; i<npix; i+=7)
+      for (size_t j=0; j<npix; j+=7)
+        {
+        double x = (i-0.5*npix)*tms.pixsize, y = (j-0.5*npix)*tms.pixsize;
+        double eps = x*x+y*y;
+        double nm1 = do_w ? -eps/(sqrt(1.-eps)+1.) : 0.;
+        double res=0;
+        for (size_t irow=0; irow<nrow; ++irow)
+          for (size_t ichan=0; ichan<nchan; ++ichan)
+            {
+            double phase = 2*pi*tms.freq(ichan)/speedoflight
+              *(x*tms.uvw(irow,0)+y*tms.uvw(irow,1)-tms.uvw(irow,2)*nm1);
+            res += (tms.ms(irow,ichan)*polar(1.,phase)).real();
+            }
+        dft.v(i/7,j/7) = res/(nm1+1.);
+        sub.v(i/7,j/7) = ref(i,j);
+        }
+    MR_assert(l2error(sub, dft)<=epsilon, "inaccurate result");
+    }
+  }
+
+/* Compares the pruned separable Hartley transform with the fused
+   symmetrization and grid correction (grid2dirty_overwrite() and
+   dirty2grid()) with the unfused computation: a genuine Hartley transform
+   of the full grid, followed (or preceded) by the grid correction. */
+void test_hartley_correction()
+  {
+  constexpr size_t nxdirty=64, nydirty=48, nu=128, nv=112, nrow=20;
+  constexpr double epsilon=1e-5, psx=1e-5, psy=1.2e-5, f0=1e9;
+  // baselines covering only part of the uv plane, so that the FFTs are
+  // pruned
+  mav<double,2> uvw({nrow,3});
+  mav<double,1> freq({1});
+  freq.v(0) = f0;
+  mt19937 rng(42);
+  uniform_real_distribution<double> dist(-0.15,0.15);
+  for (size_t i=0; i<nrow; ++i)
+    {
+    uvw.v(i,0) = dist(rng)/(psx*f0/speedoflight);
+    uvw.v(i,1) = dist(rng)/(psy*f0/speedoflight);
+    uvw.v(i,2) = 0.;
+    }
+  Baselines bl(uvw, freq);
+  uniform_real_distribution<double> dist2(-1.,1.);
+  mav<double,2> dirty({nxdirty,nydirty});
+  for (size_t i=0; i<nxdirty; ++i)
+    for (size_t j=0; j<nydirty; ++j)
+      dirty.v(i,j) = dist2(rng);
+
+  for (size_t nthreads: {1, 3})
+    {
+    TimerHierarchy timers("test");
+    detail_gridder::GridderConfig<double> gconf(nxdirty, nydirty, nu, nv,
+      KernelDB.size(), epsilon, psx, psy, bl, nthreads, timers);
+    // the uv region touched by the visibilities (see uv_extent())
+    size_t supp = gconf.Supp();
+    size_t ulim = min(nu/2, size_t(nu*bl.Umax()*psx+0.5*supp+1)),
+           vlim = min(nv/2, size_t(nv*bl.Vmax()*psy+0.5*supp+1));
+    MR_assert((ulim<nu/2) && (vlim<nv/2), "FFTs are not pruned");
+    auto in_uv = [&](size_t u, size_t v)
+      { return ((u<ulim)||(u>=nu-ulim)) && ((v<vlim)||(v>=nv-vlim)); };
+    auto giu = grid_indices(nxdirty, nu, false),
+         giv = grid_indices(nydirty, nv, false);
+    auto cfu = correction_factors(*gconf.krn, nxdirty, nu, false, nthreads),
+         cfv = correction_factors(*gconf.krn, nydirty, nv, false, nthreads);
+
+    // grid -> dirty
+    mav<double,2> grid({nu,nv}), grid2({nu,nv}), href({nu,nv});
+    for (size_t u=0; u<nu; ++u)
+      for (size_t v=0; v<nv; ++v)
+        grid.v(u,v) = in_uv(u,v) ? dist2(rng) : 0.;
+    grid2.apply(grid, [](double &a, double b) { a=b; });
+    mav<double,2> res({nxdirty,nydirty}), ref({nxdirty,nydirty});
+    gconf.grid2dirty_overwrite(grid2, res);
+    {
+    fmav<double> fin(grid), fout(href);
+    r2r_genuine_hartley(fin, fout, {0,1}, 1.);
+    }
+    for (size_t i=0; i<nxdirty; ++i)
+      for (size_t j=0; j<nydirty; ++j)
+        ref.v(i,j) = href(giu[i],giv[j])*cfu[i]*cfv[j];
+    MR_assert(l2error(res, ref)<=1e-13, "grid2dirty differs");
+
+    // dirty -> grid
+    mav<double,2> gres({nu,nv}), gref({nu,nv});
+    gconf.dirty2grid(dirty, gres);
+    mav<double,2> gtmp({nu,nv});
+    for (size_t i=0; i<nxdirty; ++i)
+      for (size_t j=0; j<nydirty; ++j)
+        gtmp.v(giu[i],giv[j]) = dirty(i,j)*cfu[i]*cfv[j];
+    {
+    fmav<double> fin(gtmp), fout(gref);
+    r2r_genuine_hartley(fin, fout, {0,1}, 1.);
+    }
+    for (size_t u=0; u<nu; ++u)
+      for (size_t v=0; v<nv; ++v)
+        if (!in_uv(u,v))
+          gres.v(u,v) = gref.v(u,v) = 0.;
+    MR_assert(l2error(gres, gref)<=1e-13, "dirty2grid differs");
+    }
+  }
+
+void runtest(function<void()> tf, const char *tn)
+  {
+  tf();
+  printf("%s OK.\n",tn);
+  }
+
+}
+
+int main(int argc, const char **argv)
+  {
+  MR_assert((argc==1)||(argv[0]==nullptr),"problem with args");
+  runtest(test_gridding_phases,"gridding in tile phases");
+  runtest(test_hartley_correction,"Hartley conversion with grid correction");
+  }
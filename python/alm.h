@@ -28,6 +28,8 @@
 #include <complex>
 #include <cmath>
 #include "ducc0/infra/threading.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/useful_macros.h"
 #endif
 
 #include "ducc0/infra/mav.h"
@@ -138,11 +140,45 @@ template<typename T> class Alm: public Alm_Base
   private:
     mav<T,1> alm;
 
-    template<typename Func> void applyLM(Func func)
+    /* Calls func(l,m,a_lm) for all coefficients; the m values are
+       distributed over the threads. */
+    template<typename Func> void applyLM(Func func, size_t nthreads=1)
       {
-      for (auto m: mval)
-        for (size_t l=m; l<=lmax; ++l)
-          func(l,m,alm.v(index(l,m)));
+      execDynamic(mval.size(), nthreads, 1, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          auto m = mval[i];
+          if (alm.stride(0)==1) // contiguous: allow vectorization
+            {
+            T * DUCC0_RESTRICT p = &alm.v(index(m,m));
+            for (size_t l=m; l<=lmax; ++l)
+              func(l,m,p[l-m]);
+            }
+          else
+            for (size_t l=m; l<=lmax; ++l)
+              func(l,m,alm.v(index(l,m)));
+          }
+        });
+      }
+    /* Calls func(i,a[i]) for all entries of the storage array, in parallel. */
+    template<typename Func> void applyFlat(Func func, size_t nthreads=1)
+      {
+      execStatic(alm.size(), nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext())
+          {
+          if (alm.stride(0)==1)
+            {
+            T * DUCC0_RESTRICT p = &alm.v(0);
+            for (auto i=rng.lo; i<rng.hi; ++i)
+              func(i, p[i]);
+            }
+          else
+            for (auto i=rng.lo; i<rng.hi; ++i)
+              func(i, alm.v(i));
+          }
+        });
       }
 
   public:
@@ -161,21 +197,25 @@ template<typename T> class Alm: public Alm_Base
       { alm.fill(0); }
 
     /*! Multiplies all coefficients by \a factor. */
-    template<typename T2> void Scale (const T2 &factor)
-      { for (size_t m=0; m<alm.size(); ++m) alm.v(m)*=factor; }
+    template<typename T2> void Scale (const T2 &factor, size_t nthreads=1)
+      { applyFlat([&factor](size_t, T &v){v*=factor;}, nthreads); }
     /*! \a a(l,m) *= \a factor[l] for all \a l,m. */
-    template<typename T2> void ScaleL (const mav<T2,1> &factor)
+    template<typename T2> void ScaleL (const mav<T2,1> &factor,
+      size_t nthreads=1)
       {
       MR_assert(factor.size()>size_t(lmax),
         "alm.ScaleL: factor array too short");
-      applyLM([&factor](size_t l, size_t /*m*/, T &v){v*=factor(l);}); 
+      applyLM([&factor](size_t l, size_t /*m*/, T &v){v*=factor(l);},
+        nthreads);
       }
     /*! \a a(l,m) *= \a factor[m] for all \a l,m. */
-    template<typename T2> void ScaleM (const mav<T2,1> &factor)
+    template<typename T2> void ScaleM (const mav<T2,1> &factor,
+      size_t nthreads=1)
       {
       MR_assert(factor.size()>size_t(Mmax()),
         "alm.ScaleM: factor array too short");
-      applyLM([&factor](size_t /*l*/, size_t m, T &v){v*=factor(m);}); 
+      applyLM([&factor](size_t /*l*/, size_t m, T &v){v*=factor(m);},
+        nthreads);
       }
     /*! Adds \a num to a_00. */
     template<typename T2> void Add (const T2 &num)
@@ -210,14 +250,136 @@ template<typename T> class Alm: public Alm_Base
       { return alm.stride(0); }
 
     /*! Adds all coefficients from \a other to the own coefficients. */
-    void Add (const Alm &other)
+    void Add (const Alm &other, size_t nthreads=1)
       {
       MR_assert (conformable(other), "A_lm are not conformable");
-      for (size_t m=0; m<alm.size(); ++m)
-        alm.v(m) += other.alm(m);
+      const auto &oalm(other.alm);
+      applyFlat([&oalm](size_t i, T &v){v+=oalm(i);}, nthreads);
       }
   };
 
+/* Calls func(l,m) for all 0<=m<=min(l,mmax), l<=lmax, in tiles of
+   64x64 (l,m) pairs, so that accesses along l (as in the m-major Alm
+   storage) and along m (as in l-major layouts) both stay in cache.
+   Every thread handles all m of a contiguous range of l. */
+template<typename Func> void lm_tiled_loop(size_t lmax, size_t mmax,
+  size_t nthreads, Func func)
+  {
+  constexpr size_t bs=64;
+  execDynamic((lmax+bs)/bs, nthreads, 1, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext()) for(auto ib=rng.lo; ib<rng.hi; ++ib)
+      {
+      size_t l0=ib*bs, l1=min(lmax+1, l0+bs);
+      for (size_t m0=0; m0<=min(l1-1, mmax); m0+=bs)
+        for (size_t m=m0, m1=min(mmax+1, m0+bs); m<m1; ++m)
+          for (size_t l=max(l0,m); l<l1; ++l)
+            func(l,m);
+      }
+    });
+  }
+
+/*! Returns the offsets of the rows l=0 .. lmax+1 in an l-major a_lm array,
+    where every row l contains the coefficients with 0<=m<=min(l,mmax).
+    With \a real, the rows hold the real-valued packing of
+    alm2real_lmajor() instead, i.e. 2*min(l,mmax)+1 entries. */
+inline vector<size_t> lmajor_offsets(size_t lmax, size_t mmax, bool real=false)
+  {
+  vector<size_t> res(lmax+2);
+  res[0]=0;
+  for (size_t l=0; l<=lmax; ++l)
+    res[l+1] = res[l] + (real ? 2*min(l,mmax)+1 : min(l,mmax)+1);
+  return res;
+  }
+
+/*! Copies the coefficients of \a in to the l-major array \a out (see
+    lmajor_offsets()). \a in must contain all m from 0 to its mmax. */
+template<typename T> void alm2lmajor(const Alm<T> &in, mav<T,1> &out,
+  size_t nthreads=1)
+  {
+  size_t lmax=in.Lmax(), mmax=in.Mmax();
+  MR_assert(in.conformable(Alm_Base(lmax, mmax)), "a_lm must be triangular");
+  auto ofs = lmajor_offsets(lmax, mmax);
+  MR_assert(out.shape(0)==ofs.back(), "bad size of output array");
+  lm_tiled_loop(lmax, mmax, nthreads,
+    [&](size_t l, size_t m) { out.v(ofs[l]+m) = in(l,m); });
+  }
+/*! Inverse of alm2lmajor(). */
+template<typename T> void lmajor2alm(const mav<T,1> &in, Alm<T> &out,
+  size_t nthreads=1)
+  {
+  size_t lmax=out.Lmax(), mmax=out.Mmax();
+  MR_assert(out.conformable(Alm_Base(lmax, mmax)), "a_lm must be triangular");
+  auto ofs = lmajor_offsets(lmax, mmax);
+  MR_assert(in.shape(0)==ofs.back(), "bad size of input array");
+  lm_tiled_loop(lmax, mmax, nthreads,
+    [&](size_t l, size_t m) { out(l,m) = in(ofs[l]+m); });
+  }
+
+/*! Stores the a_lm of a real-valued field in the real l-major array \a out:
+    row l (see lmajor_offsets() with \a real==true) contains
+    a_l0, sqrt(2)*Re(a_l1), sqrt(2)*Im(a_l1), ..., sqrt(2)*Im(a_l,mmax).
+    The factors sqrt(2) make the sum of squares of a row equal to
+    sum_{m=-l}^{l} |a_lm|^2. */
+template<typename T> void alm2real_lmajor(const Alm<complex<T>> &in,
+  mav<T,1> &out, size_t nthreads=1)
+  {
+  size_t lmax=in.Lmax(), mmax=in.Mmax();
+  MR_assert(in.conformable(Alm_Base(lmax, mmax)), "a_lm must be triangular");
+  auto ofs = lmajor_offsets(lmax, mmax, true);
+  MR_assert(out.shape(0)==ofs.back(), "bad size of output array");
+  const T sqrt2=T(1.4142135623730950488016887242096981L);
+  lm_tiled_loop(lmax, mmax, nthreads, [&](size_t l, size_t m)
+    {
+    auto v = in(l,m);
+    if (m==0)
+      out.v(ofs[l]) = v.real();
+    else
+      {
+      out.v(ofs[l]+2*m-1) = sqrt2*v.real();
+      out.v(ofs[l]+2*m  ) = sqrt2*v.imag();
+      }
+    });
+  }
+/*! Inverse of alm2real_lmajor(). */
+template<typename T> void real_lmajor2alm(const mav<T,1> &in,
+  Alm<complex<T>> &out, size_t nthreads=1)
+  {
+  size_t lmax=out.Lmax(), mmax=out.Mmax();
+  MR_assert(out.conformable(Alm_Base(lmax, mmax)), "a_lm must be triangular");
+  auto ofs = lmajor_offsets(lmax, mmax, true);
+  MR_assert(in.shape(0)==ofs.back(), "bad size of input array");
+  const T isqrt2=T(0.7071067811865475244008443621048490L);
+  lm_tiled_loop(lmax, mmax, nthreads, [&](size_t l, size_t m)
+    {
+    out(l,m) = (m==0) ? complex<T>(in(ofs[l]), T(0))
+      : complex<T>(isqrt2*in(ofs[l]+2*m-1), isqrt2*in(ofs[l]+2*m));
+    });
+  }
+
+/*! Computes the cross power spectrum
+    \a cl[l] = 1/(2l+1) * sum_{m=-l}^{l} a1_lm conj(a2_lm)
+    of the a_lm of two real-valued fields (for \a alm1==\a alm2, the power
+    spectrum). \a alm1 and \a alm2 must be conformable and contain all m
+    from 0 to mmax; missing m>mmax count as zero. The result does not
+    depend on \a nthreads. */
+template<typename T> void alm2cl(const Alm<complex<T>> &alm1,
+  const Alm<complex<T>> &alm2, mav<double,1> &cl, size_t nthreads=1)
+  {
+  size_t lmax=alm1.Lmax(), mmax=alm1.Mmax();
+  MR_assert(alm1.conformable(alm2), "a_lm are not conformable");
+  MR_assert(alm1.conformable(Alm_Base(lmax, mmax)), "a_lm must be triangular");
+  MR_assert(cl.shape(0)==lmax+1, "bad size of output array");
+  for (size_t l=0; l<=lmax; ++l) cl.v(l)=0.;
+  // every l is handled by a single thread, in ascending m
+  lm_tiled_loop(lmax, mmax, nthreads, [&](size_t l, size_t m)
+    {
+    auto v = complex<double>(alm1(l,m))*conj(complex<double>(alm2(l,m)));
+    cl.v(l) += (m==0) ? v.real() : 2*v.real();
+    });
+  for (size_t l=0; l<=lmax; ++l) cl.v(l) /= double(2*l+1);
+  }
+
 #if 1
 /*! Class for calculation of the Wigner matrix at arbitrary angles, using Risbo
     recursion in a way that can be OpenMP-parallelised. This approach uses more
@@ -229,11 +391,13 @@ class wigner_d_risbo_openmp
     vector<double> sqt;
     mav<double,2> d, dd;
     ptrdiff_t n;
+    size_t nthreads;
 
   public:
-    wigner_d_risbo_openmp(size_t lmax, double ang)
+    wigner_d_risbo_openmp(size_t lmax, double ang, size_t nthreads_=1)
       : p(sin(ang/2)), q(cos(ang/2)), sqt(2*lmax+1),
-        d({lmax+1,2*lmax+1}), dd({lmax+1,2*lmax+1}), n(-1)
+        d({lmax+1,2*lmax+1}), dd({lmax+1,2*lmax+1}), n(-1),
+        nthreads(nthreads_)
       { for (size_t m=0; m<sqt.size(); ++m) sqt[m] = std::sqrt(double(m)); }
 
     const mav<double,2> &recurse()
@@ -264,28 +428,41 @@ class wigner_d_risbo_openmp
           for (int i=1;i<j; ++i)
             xdd.v(0,i) = xj*sqt[j]*(q*sqt[j-i]*xd(0,i) - p*sqt[i]*xd(0,i-1));
           xdd.v(0,j) = -p*xd(0,j-1);
-// parallelize
-          for (int k=1; k<=n; ++k)
+          // the rows k>0 only depend on the previous step
+          execStatic(n, nthreads, 0, [&](Scheduler &sched)
             {
-            double t1 = xj*sqt[j-k]*q, t2 = xj*sqt[j-k]*p;
-            double t3 = xj*sqt[k  ]*p, t4 = xj*sqt[k  ]*q;
-            xdd.v(k,0) = xj*sqt[j]*(q*sqt[j-k]*xd(k,0) + p*sqt[k]*xd(k-1,0));
-            for (int i=1; i<j; ++i)
-              xdd.v(k,i) = t1*sqt[j-i]*xd(k,i) - t2*sqt[i]*xd(k,i-1)
-                        + t3*sqt[j-i]*xd(k-1,i) + t4*sqt[i]*xd(k-1,i-1);
-            xdd.v(k,j) = -t2*sqt[j]*xd(k,j-1) + t4*sqt[j]*xd(k-1,j-1);
-            }
+            while (auto rng=sched.getNext())
+              for (int k=int(rng.lo)+1; k<=int(rng.hi); ++k)
+                {
+                double t1 = xj*sqt[j-k]*q, t2 = xj*sqt[j-k]*p;
+                double t3 = xj*sqt[k  ]*p, t4 = xj*sqt[k  ]*q;
+                xdd.v(k,0) = xj*sqt[j]*(q*sqt[j-k]*xd(k,0) + p*sqt[k]*xd(k-1,0));
+                for (int i=1; i<j; ++i)
+                  xdd.v(k,i) = t1*sqt[j-i]*xd(k,i) - t2*sqt[i]*xd(k,i-1)
+                            + t3*sqt[j-i]*xd(k-1,i) + t4*sqt[i]*xd(k-1,i-1);
+                xdd.v(k,j) = -t2*sqt[j]*xd(k,j-1) + t4*sqt[j]*xd(k-1,j-1);
+                }
+            });
           }
         }
       return d;
       }
   };
 
-template<typename T> void rotate_alm (Alm<complex<T>> &alm,
-  double psi, double theta, double phi)
+/*! Rotates all a_lm sets in \a alms by the Euler angles \a psi, \a theta
+    and \a phi. All sets must be complete and have the same \a lmax; the
+    Wigner d matrices are computed only once for all of them. */
+template<typename T> void rotate_alm (const vector<Alm<complex<T>> *> &alms,
+  double psi, double theta, double phi, size_t nthreads=1)
   {
-  auto lmax=alm.Lmax();
-  MR_assert (alm.complete(), "rotate_alm: need complete A_lm set");
+  if (alms.empty()) return;
+  auto lmax=alms[0]->Lmax();
+  for (auto a: alms)
+    {
+    MR_assert (a->complete(), "rotate_alm: need complete A_lm set");
+    MR_assert (a->Lmax()==lmax, "rotate_alm: all A_lm sets must have the same lmax");
+    }
+  size_t nalms=alms.size();
 
   if (theta!=0)
     {
@@ -295,41 +472,70 @@ template<typename T> void rotate_alm (Alm<complex<T>> &alm,
       exppsi[m] = polar(1.,-psi*m);
       expphi[m] = polar(1.,-phi*m);
       }
-    vector<complex<double> > almtmp(lmax+1);
-size_t nthreads=1;
-    wigner_d_risbo_openmp rec(lmax,theta);
+    // real and imaginary parts of the rotated a_lm for one l, per set
+    size_t ntmp=lmax+1;
+    vector<double> tmpr(nalms*ntmp), tmpi(nalms*ntmp);
+    wigner_d_risbo_openmp rec(lmax,theta,nthreads);
     for (size_t l=0; l<=lmax; ++l)
       {
       const auto &d(rec.recurse());
 
-      for (size_t m=0; m<=l; ++m)
-        almtmp[m] = complex<double>(alm(l,0))*d(l,l+m);
-
       execStatic(l+1, nthreads, 0, [&](Scheduler &sched)
         {
-        auto rng=sched.getNext();
-        auto lo=rng.lo;
-        auto hi=rng.hi;
-
-        bool flip = true;
-        for (size_t mm=1; mm<=l; ++mm)
+        using Tv = native_simd<double>;
+        constexpr size_t vlen = Tv::size();
+        vector<double> f1, f2;
+        while (auto rng=sched.getNext())
           {
-          auto t1 = complex<double>(alm(l,mm))*exppsi[mm];
-          bool flip2 = ((mm+lo)&1);
-          for (auto m=lo; m<hi; ++m)
+          auto lo=rng.lo, len=rng.hi-rng.lo;
+          f1.resize(len); f2.resize(len);
+          for (size_t a=0; a<nalms; ++a)
+            {
+            auto t = complex<double>((*alms[a])(l,0));
+            for (size_t i=0; i<len; ++i)
+              {
+              tmpr[a*ntmp+lo+i] = t.real()*d(l,l+lo+i);
+              tmpi[a*ntmp+lo+i] = t.imag()*d(l,l+lo+i);
+              }
+            }
+          for (size_t mm=1; mm<=l; ++mm)
             {
-            double d1 = flip2 ? -d(l-mm,l-m) : d(l-mm,l-m);
-            double d2 = flip  ? -d(l-mm,l+m) : d(l-mm,l+m);
-            double f1 = d1+d2, f2 = d1-d2;
-            almtmp[m]+=complex<double>(t1.real()*f1,t1.imag()*f2);
-            flip2 = !flip2;
+            // the signs of the d matrix elements alternate with m and mm;
+            // the mm part is applied to the a_lm below
+            for (size_t i=0; i<len; ++i)
+              {
+              auto m=lo+i;
+              double d1 = (m&1) ? -d(l-mm,l-m) : d(l-mm,l-m);
+              double d2 = d(l-mm,l+m);
+              f1[i] = d1+d2; f2[i] = d1-d2;
+              }
+            for (size_t a=0; a<nalms; ++a)
+              {
+              auto t1 = complex<double>((*alms[a])(l,mm))*exppsi[mm];
+              if (mm&1) t1=-t1;
+              Tv t1r=t1.real(), t1i=t1.imag();
+              double *DUCC0_RESTRICT pr=&tmpr[a*ntmp+lo],
+                     *DUCC0_RESTRICT pi=&tmpi[a*ntmp+lo];
+              size_t i=0;
+              for (; i+vlen<=len; i+=vlen)
+                {
+                (Tv::loadu(pr+i)+t1r*Tv::loadu(&f1[i])).storeu(pr+i);
+                (Tv::loadu(pi+i)+t1i*Tv::loadu(&f2[i])).storeu(pi+i);
+                }
+              for (; i<len; ++i)
+                {
+                pr[i] += t1.real()*f1[i];
+                pi[i] += t1.imag()*f2[i];
+                }
+              }
             }
-          flip = !flip;
           }
         });
 
-      for (size_t m=0; m<=l; ++m)
-        alm(l,m) = complex<T>(almtmp[m]*expphi[m]);
+      for (size_t a=0; a<nalms; ++a)
+        for (size_t m=0; m<=l; ++m)
+          (*alms[a])(l,m) = complex<T>(complex<double>(tmpr[a*ntmp+m],
+            tmpi[a*ntmp+m])*expphi[m]);
       }
     }
   else
@@ -337,16 +543,27 @@ size_t nthreads=1;
     for (size_t m=0; m<=lmax; ++m)
       {
       auto ang = polar(1.,-(psi+phi)*m);
-      for (size_t l=m; l<=lmax; ++l)
-        alm(l,m) *= ang;
+      for (auto a: alms)
+        for (size_t l=m; l<=lmax; ++l)
+          (*a)(l,m) *= ang;
       }
     }
   }
+
+template<typename T> void rotate_alm (Alm<complex<T>> &alm,
+  double psi, double theta, double phi, size_t nthreads=1)
+  { rotate_alm(vector<Alm<complex<T>> *>{&alm}, psi, theta, phi, nthreads); }
 #endif
 }
 
 using detail_alm::Alm_Base;
 using detail_alm::Alm;
+using detail_alm::lmajor_offsets;
+using detail_alm::alm2lmajor;
+using detail_alm::lmajor2alm;
+using detail_alm::alm2real_lmajor;
+using detail_alm::real_lmajor2alm;
+using detail_alm::alm2cl;
 #if 1
 using detail_alm::rotate_alm;
 #endif
@@ -1,6 +1,8 @@
 #include "ducc0/infra/system.cc"
 #include "ducc0/infra/string_utils.cc"
 #include "ducc0/infra/threading.cc"
+#include "ducc0/infra/perf_counters.cc"
+#include "ducc0/infra/mmap_file.cc"
 #include "ducc0/math/pointing.cc"
 #include "ducc0/math/geom_utils.cc"
 #include "ducc0/math/space_filling.cc"
@@ -11,26 +13,64 @@
 #include "ducc0/sharp/sharp_geomhelpers.cc"
 #include "ducc0/healpix/healpix_tables.cc"
 #include "ducc0/healpix/healpix_base.cc"
+#include "ducc0/healpix/healpix_map.cc"
 
 #include <pybind11/pybind11.h>
 #include "python/sht.cc"
 #include "python/fft.cc"
 #include "python/totalconvolve.cc"
 #include "python/wgridder.cc"
+#include "python/nufft.cc"
 #include "python/healpix.cc"
 #include "python/misc.cc"
 #include "python/pointingprovider.cc"
 
 using namespace ducc0;
 
+#ifdef MULTIARCH
+// variants of the modules in add_simd_modules(); see ducc_arch_inc.cc
+namespace ducc0 {
+#if (!defined(__APPLE__))
+void add_simd_modules_avx512f(pybind11::module &m);
+#endif
+void add_simd_modules_avx2(pybind11::module &m);
+void add_simd_modules_fma4(pybind11::module &m);
+void add_simd_modules_fma(pybind11::module &m);
+void add_simd_modules_avx(pybind11::module &m);
+}
+#endif
+
+/* Adds the modules whose performance depends most on the instruction set;
+   in multiarch builds, the variant is chosen according to the CPU (or the
+   DUCC0_ARCH environment variable) when the module is imported. */
+static void add_simd_modules(pybind11::module &m)
+  {
+#ifdef MULTIARCH
+  auto isa = select_isa_variant({
+#if (!defined(__APPLE__))
+    "avx512f",
+#endif
+    "avx2", "fma4", "fma", "avx"});
+#if (!defined(__APPLE__))
+  if (isa=="avx512f") return add_simd_modules_avx512f(m);
+#endif
+  if (isa=="avx2") return add_simd_modules_avx2(m);
+  if (isa=="fma4") return add_simd_modules_fma4(m);
+  if (isa=="fma") return add_simd_modules_fma(m);
+  if (isa=="avx") return add_simd_modules_avx(m);
+#endif
+  add_fft(m);
+  add_totalconvolve(m);
+  add_wgridder(m);
+  add_nufft(m);
+  }
+
 PYBIND11_MODULE(PKGNAME, m)
   {
   m.attr("__version__") = PKGVERSION;
 
-  add_fft(m);
+  add_simd_modules(m);
   add_sht(m);
-  add_totalconvolve(m);
-  add_wgridder(m);
   add_healpix(m);
   add_misc(m);
   add_pointingprovider(m);
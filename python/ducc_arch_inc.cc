@@ -0,0 +1,74 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  Author: Martin Reinecke
+ */
+
+/* Variant of the fft, totalconvolve, wgridder and nufft modules for one
+   instruction set; this file is compiled once per entry of the multiarch
+   list in setup.py, with the corresponding -m flags and ARCH set to the
+   variant name. ducc.cc selects one of the resulting add_simd_modules_ARCH()
+   functions (or its own baseline code) when the module is imported.
+
+   The namespaces containing the vectorized code are renamed per variant, so
+   that their template instantiations cannot be merged with those of other
+   variants by the linker. The remaining inline code (standard library,
+   pybind11, mav, pybind_utils.h) is instantiated by the baseline code in
+   ducc.cc as well, which is linked first, so the linker keeps the baseline
+   copies. Non-inline functions (thread pool, SHT, HEALPix ...) are shared
+   with the baseline code; for this reason, headers included here must not
+   contain non-inline definitions outside the renamed namespaces. */
+
+// FIXME: same workaround for problems on OSX as in sharp_core_inc.cc
+#if (!defined(__APPLE__)) || (!defined(__AVX512F__))
+
+#define XCONCATX(a,b) a##_##b
+#define XCONCATX2(a,b) XCONCATX(a,b)
+#define XARCH(a) XCONCATX2(a,ARCH)
+
+#define detail_simd XARCH(detail_simd)
+#define detail_fft XARCH(detail_fft)
+#define detail_gridding_kernel XARCH(detail_gridding_kernel)
+#define detail_spreading XARCH(detail_spreading)
+#define detail_gridder XARCH(detail_gridder)
+#define detail_nufft XARCH(detail_nufft)
+#define detail_totalconvolve XARCH(detail_totalconvolve)
+#define detail_pymodule_fft XARCH(detail_pymodule_fft)
+#define detail_pymodule_totalconvolve XARCH(detail_pymodule_totalconvolve)
+#define detail_pymodule_wgridder XARCH(detail_pymodule_wgridder)
+#define detail_pymodule_nufft XARCH(detail_pymodule_nufft)
+
+#include <pybind11/pybind11.h>
+#include "python/fft.cc"
+#include "python/totalconvolve.cc"
+#include "python/wgridder.cc"
+#include "python/nufft.cc"
+
+namespace ducc0 {
+
+void XARCH(add_simd_modules)(pybind11::module &m)
+  {
+  add_fft(m);
+  add_totalconvolve(m);
+  add_wgridder(m);
+  add_nufft(m);
+  }
+
+}
+
+#endif
@@ -70,17 +70,17 @@ using f64 = double;
 using flong = ldbl_t;
 auto None = py::none();
 
-shape_t makeaxes(const py::array &in, const py::object &axes)
+shape_t makeaxes(size_t ndim_, const py::object &axes)
   {
   if (axes.is_none())
     {
-    shape_t res(size_t(in.ndim()));
+    shape_t res(ndim_);
     for (size_t i=0; i<res.size(); ++i)
       res[i]=i;
     return res;
     }
   auto tmp=axes.cast<std::vector<ptrdiff_t>>();
-  auto ndim = in.ndim();
+  auto ndim = ptrdiff_t(ndim_);
   if ((tmp.size()>size_t(ndim)) || (tmp.size()==0))
     throw std::runtime_error("bad axes argument");
   for (auto& sz: tmp)
@@ -93,6 +93,9 @@ shape_t makeaxes(const py::array &in, const py::object &axes)
   return shape_t(tmp.begin(), tmp.end());
   }
 
+shape_t makeaxes(const py::array &in, const py::object &axes)
+  { return makeaxes(size_t(in.ndim()), axes); }
+
 #define DISPATCH(arr, T1, T2, T3, func, args) \
   { \
   if (py::isinstance<py::array_t<T1>>(arr)) return func<double> args; \
@@ -301,6 +304,88 @@ py::array c2r(const py::array &in, const py::object &axes_, size_t lastsize,
     inorm, out_, nthreads))
   }
 
+// returns a view of the memory of 'arr' as an array of type T, with length
+// 'len' and the byte stride 'stride' along 'axis'
+template<typename T> py::array reinterpret_view(const py::array &arr,
+  size_t axis, size_t len, ptrdiff_t stride)
+  {
+  std::vector<ptrdiff_t> shp(size_t(arr.ndim())), str(size_t(arr.ndim()));
+  for (size_t i=0; i<shp.size(); ++i)
+    {
+    shp[i] = arr.shape(int(i));
+    str[i] = arr.strides(int(i));
+    }
+  shp[axis] = ptrdiff_t(len);
+  str[axis] = stride;
+  return py::array_t<T>(shp, str, reinterpret_cast<const T *>(arr.data()),
+    arr);
+  }
+
+template<typename T> py::array r2c_inplace_internal(py::array &a,
+  const py::object &axes_, size_t lastsize, bool forward, int inorm,
+  size_t nthreads)
+  {
+  auto axes = makeaxes(a, axes_);
+  size_t axis = axes.back();
+  auto aa = to_fmav<T>(a, true);
+  if (lastsize==0)
+    {
+    if (aa.shape(axis)<2) throw std::invalid_argument("bad padded axis length");
+    lastsize = aa.shape(axis)-2;
+    }
+  shape_t dims_in(aa.shape());
+  dims_in[axis] = lastsize;
+  {
+  py::gil_scoped_release release;
+  T fct = norm_fct<T>(inorm, dims_in, axes);
+  ducc0::r2c_inplace(aa, axes, lastsize, forward, fct, nthreads);
+  }
+  return reinterpret_view<std::complex<T>>(a, axis, aa.shape(axis)/2,
+    ptrdiff_t(sizeof(std::complex<T>)));
+  }
+
+py::array r2c_inplace(py::array &a, const py::object &axes_, size_t lastsize,
+  bool forward, int inorm, size_t nthreads)
+  {
+  DISPATCH(a, f64, f32, flong, r2c_inplace_internal, (a, axes_, lastsize,
+    forward, inorm, nthreads))
+  }
+
+template<typename T> py::array c2r_inplace_internal(py::array &a,
+  const py::object &axes_, size_t lastsize, bool forward, int inorm,
+  size_t nthreads)
+  {
+  auto axes = makeaxes(a, axes_);
+  size_t axis = axes.back();
+  auto ac = to_fmav<std::complex<T>>(a, true);
+  if (lastsize==0) lastsize=2*ac.shape(axis)-2;
+  if ((lastsize/2) + 1 != ac.shape(axis))
+    throw std::invalid_argument("bad lastsize");
+  if (ac.stride(axis)!=1)
+    throw std::invalid_argument("last transformed axis must be contiguous");
+  auto shp(ac.shape());
+  auto str(ac.stride());
+  for (auto &s: str) s*=2;
+  shp[axis] *= 2;
+  str[axis] = 1;
+  fmav<T> aa(reinterpret_cast<T *>(ac.vdata()), shp, str, true);
+  shape_t dims_out(ac.shape());
+  dims_out[axis] = lastsize;
+  {
+  py::gil_scoped_release release;
+  T fct = norm_fct<T>(inorm, dims_out, axes);
+  ducc0::c2r_inplace(aa, axes, lastsize, forward, fct, nthreads);
+  }
+  return reinterpret_view<T>(a, axis, lastsize, ptrdiff_t(sizeof(T)));
+  }
+
+py::array c2r_inplace(py::array &a, const py::object &axes_, size_t lastsize,
+  bool forward, int inorm, size_t nthreads)
+  {
+  DISPATCH(a, c128, c64, clong, c2r_inplace_internal, (a, axes_, lastsize,
+    forward, inorm, nthreads))
+  }
+
 template<typename T> py::array separable_hartley_internal(const py::array &in,
   const py::object &axes_, int inorm, py::object &out_, size_t nthreads)
   {
@@ -345,6 +430,224 @@ py::array genuine_hartley(const py::array &in, const py::object &axes_,
     out_, nthreads))
   }
 
+template<typename T> py::array convolve_axis_internal(const py::array &in,
+  py::array &out, size_t axis, const py::array &kernel, size_t nthreads)
+  {
+  auto ain = to_fmav<T>(in, false);
+  auto aout = to_fmav<T>(out, true);
+  auto akernel = to_fmav<T>(kernel, false);
+  MR_assert(akernel.ndim()==1, "kernel must be one-dimensional");
+  std::vector<T> kern(akernel.shape(0));
+  for (size_t i=0; i<kern.size(); ++i)
+    kern[i] = akernel[ptrdiff_t(i)*akernel.stride(0)];
+  {
+  py::gil_scoped_release release;
+  ducc0::convolve_axis(ain, aout, axis, kern, nthreads);
+  }
+  return out;
+  }
+
+py::array convolve_axis(const py::array &in, py::array &out, size_t axis,
+  const py::array &kernel, size_t nthreads)
+  {
+  if (in.dtype().kind() == 'c')
+    DISPATCH(in, c128, c64, clong, convolve_axis_internal, (in, out, axis,
+      kernel, nthreads))
+  DISPATCH(in, f64, f32, flong, convolve_axis_internal, (in, out, axis,
+    kernel, nthreads))
+  }
+
+class Py_Plan
+  {
+  private:
+    enum Kind { C2C, R2C, C2R, R2R_FFTPACK, SEP_HARTLEY, GEN_HARTLEY, DCT, DST };
+    enum Prec { SINGLE, DOUBLE, LONG };
+
+    Kind kind;
+    Prec prec;
+    shape_t shape_in, shape_out, axes;
+    bool forward, real2hermitian, ortho;
+    int type;
+    ldbl_t fct;
+    size_t nthreads;
+    // keeps the 1D plans alive for the lifetime of this object
+    std::vector<std::shared_ptr<void>> plans;
+
+    static Kind str2kind(const std::string &kind)
+      {
+      if (kind=="c2c") return C2C;
+      if (kind=="r2c") return R2C;
+      if (kind=="c2r") return C2R;
+      if (kind=="r2r_fftpack") return R2R_FFTPACK;
+      if (kind=="separable_hartley") return SEP_HARTLEY;
+      if (kind=="genuine_hartley") return GEN_HARTLEY;
+      if (kind=="dct") return DCT;
+      if (kind=="dst") return DST;
+      throw std::invalid_argument("unknown transform kind '"+kind+"'");
+      }
+
+    // the precision is determined by the dtype of the input array
+    Prec dtype2prec(const py::dtype &dt) const
+      {
+      bool cmplx_in = (kind==C2C) || (kind==C2R);
+      if (cmplx_in ? dt.equal(py::dtype::of<c128>()) : dt.equal(py::dtype::of<f64>()))
+        return DOUBLE;
+      if (cmplx_in ? dt.equal(py::dtype::of<c64>()) : dt.equal(py::dtype::of<f32>()))
+        return SINGLE;
+      if (cmplx_in ? dt.equal(py::dtype::of<clong>()) : dt.equal(py::dtype::of<flong>()))
+        return LONG;
+      throw std::runtime_error("unsupported data type");
+      }
+
+    template<typename Tplan> void add_plan(size_t len)
+      { plans.push_back(ducc0::get_plan<Tplan>(len)); }
+
+    template<typename T> void make_plans()
+      {
+      using namespace ducc0::detail_fft;
+      for (size_t i=0; i<axes.size(); ++i)
+        {
+        size_t len = shape_in[axes[i]];
+        bool last = (i+1==axes.size());
+        switch (kind)
+          {
+          case C2C: add_plan<pocketfft_c<T>>(len); break;
+          case R2C: last ? add_plan<pocketfft_r<T>>(len)
+                         : add_plan<pocketfft_c<T>>(len); break;
+          case C2R: last ? add_plan<pocketfft_r<T>>(shape_out[axes[i]])
+                         : add_plan<pocketfft_c<T>>(len); break;
+          case R2R_FFTPACK: case SEP_HARTLEY: add_plan<pocketfft_r<T>>(len); break;
+          case GEN_HARTLEY: (last || (axes.size()==1)) ? add_plan<pocketfft_r<T>>(len)
+                                                       : add_plan<pocketfft_c<T>>(len); break;
+          case DCT: case DST:
+            if (type==1)
+              (kind==DCT) ? add_plan<T_dct1<T>>(len) : add_plan<T_dst1<T>>(len);
+            else if (type==4)
+              add_plan<T_dcst4<T>>(len);
+            else
+              add_plan<T_dcst23<T>>(len);
+            break;
+          }
+        }
+      }
+
+    template<typename Tin> fmav<Tin> check_input(const py::array &in) const
+      {
+      MR_assert(isPyarr<Tin>(in), "incorrect data type");
+      auto ain = to_fmav<Tin>(in, false);
+      MR_assert(ain.shape()==shape_in, "input shape mismatch");
+      return ain;
+      }
+
+    template<typename T> py::array exec_typed(const py::array &in,
+      py::object &out_) const
+      {
+      using C = std::complex<T>;
+      T tfct = T(fct);
+      switch (kind)
+        {
+        case C2C:
+          {
+          auto ain = check_input<C>(in);
+          auto out = get_optional_Pyarr<C>(out_, shape_out);
+          auto aout = to_fmav<C>(out, true);
+          {
+          py::gil_scoped_release release;
+          ducc0::c2c(ain, aout, axes, forward, tfct, nthreads);
+          }
+          return std::move(out);
+          }
+        case R2C:
+          {
+          auto ain = check_input<T>(in);
+          auto out = get_optional_Pyarr<C>(out_, shape_out);
+          auto aout = to_fmav<C>(out, true);
+          {
+          py::gil_scoped_release release;
+          ducc0::r2c(ain, aout, axes, forward, tfct, nthreads);
+          }
+          return std::move(out);
+          }
+        case C2R:
+          {
+          auto ain = check_input<C>(in);
+          auto out = get_optional_Pyarr<T>(out_, shape_out);
+          auto aout = to_fmav<T>(out, true);
+          {
+          py::gil_scoped_release release;
+          ducc0::c2r(ain, aout, axes, forward, tfct, nthreads);
+          }
+          return std::move(out);
+          }
+        default:
+          {
+          auto ain = check_input<T>(in);
+          auto out = get_optional_Pyarr<T>(out_, shape_out);
+          auto aout = to_fmav<T>(out, true);
+          {
+          py::gil_scoped_release release;
+          if (kind==R2R_FFTPACK)
+            ducc0::r2r_fftpack(ain, aout, axes, real2hermitian, forward, tfct, nthreads);
+          else if (kind==SEP_HARTLEY)
+            ducc0::r2r_separable_hartley(ain, aout, axes, tfct, nthreads);
+          else if (kind==GEN_HARTLEY)
+            ducc0::r2r_genuine_hartley(ain, aout, axes, tfct, nthreads);
+          else if (kind==DCT)
+            ducc0::dct(ain, aout, axes, type, tfct, ortho, nthreads);
+          else
+            ducc0::dst(ain, aout, axes, type, tfct, ortho, nthreads);
+          }
+          return std::move(out);
+          }
+        }
+      }
+
+  public:
+    Py_Plan(const std::string &kind_, const std::vector<size_t> &shape,
+      const py::object &dtype, const py::object &axes_, bool forward_,
+      int inorm, int type_, size_t lastsize, bool real2hermitian_,
+      size_t nthreads_)
+      : kind(str2kind(kind_)), prec(dtype2prec(py::dtype::from_args(dtype))),
+        shape_in(shape), shape_out(shape), axes(makeaxes(shape.size(), axes_)),
+        forward(forward_), real2hermitian(real2hermitian_), ortho(inorm==1),
+        type(type_), nthreads(nthreads_)
+      {
+      MR_assert(!shape_in.empty(), "at least 1D required");
+      size_t axis = axes.back();
+      if (kind==R2C)
+        shape_out[axis] = shape_in[axis]/2+1;
+      if (kind==C2R)
+        {
+        if (lastsize==0) lastsize=2*shape_in[axis]-1;
+        if ((lastsize/2) + 1 != shape_in[axis])
+          throw std::invalid_argument("bad lastsize");
+        shape_out[axis] = lastsize;
+        }
+      if ((kind==DCT)||(kind==DST))
+        {
+        if ((type<1) || (type>4)) throw std::invalid_argument("invalid transform type");
+        int delta = (type!=1) ? 0 : ((kind==DCT) ? -1 : 1);
+        fct = norm_fct<ldbl_t>(inorm, shape_in, axes, 2, delta);
+        }
+      else
+        fct = norm_fct<ldbl_t>(inorm, (kind==C2R) ? shape_out : shape_in, axes);
+      for (auto ax: axes)
+        MR_assert(shape_in[ax]>0, "zero-length transforms are not supported");
+      if (prec==DOUBLE) make_plans<double>();
+      else if (prec==SINGLE) make_plans<float>();
+      else make_plans<ldbl_t>();
+      }
+
+    py::array exec(const py::array &in, py::object &out_) const
+      {
+      if (prec==DOUBLE) return exec_typed<double>(in, out_);
+      if (prec==SINGLE) return exec_typed<float>(in, out_);
+      return exec_typed<ldbl_t>(in, out_);
+      }
+
+    std::vector<size_t> shape_output() const { return shape_out; }
+  };
+
 // Export good_size in raw C-API to reduce overhead (~4x faster)
 PyObject * good_size(PyObject * /*self*/, PyObject * args)
   {
@@ -370,6 +673,23 @@ PyObject * good_size(PyObject * /*self*/, PyObject * args)
     real ? util1d::good_size_real(n) : util1d::good_size_cmplx(n));
   }
 
+py::dict plan_cache_info()
+  {
+  auto &cache = ducc0::get_plan_cache();
+  py::dict res;
+  res["size"] = cache.size();
+  res["max_size"] = cache.get_max_size();
+  res["hits"] = cache.hits();
+  res["misses"] = cache.misses();
+  return res;
+  }
+
+void clear_plan_cache()
+  { ducc0::get_plan_cache().clear(); }
+
+void set_plan_cache_size(size_t max_size)
+  { ducc0::get_plan_cache().set_max_size(max_size); }
+
 const char *fft_DS = R"""(Fast Fourier and Hartley transforms.
 
 This module supports
@@ -481,6 +801,81 @@ numpy.ndarray (real type with same accuracy as `a`)
     entries.
 )""";
 
+const char *r2c_inplace_DS = R"""(Performs an in-place FFT whose input is strictly real.
+
+The data layout is the one used by FFTW for in-place real transforms: if n
+real values are transformed along the last axis in `axes`, the length of this
+axis in `a` must be 2*(n//2+1), with the input in the first n entries. On
+exit, the same memory holds the n//2+1 complex output values.
+
+Parameters
+----------
+a : numpy.ndarray (any real type)
+    The padded input data; it is overwritten by the result.
+    The last axis in `axes` must have unit stride, and all other strides must
+    be multiples of twice the item size.
+axes : list of integers
+    The axes along which the FFT is carried out.
+    If not set, all axes will be transformed in ascending order.
+lastsize : int
+    The number n of real input values along the last transformed axis.
+    Must be `a.shape[axes[-1]]-2` or `a.shape[axes[-1]]-1`. If 0, the former
+    is used.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type
+      0 : no normalization
+      1 : divide by sqrt(N)
+      2 : divide by N
+    where N is the product of the lengths of the transformed input axes.
+nthreads : int
+    Number of threads to use. If 0, use the system default (typically governed
+    by the `OMP_NUM_THREADS` environment variable).
+
+Returns
+-------
+numpy.ndarray (complex type with same accuracy as `a`)
+    A complex view of the memory of `a` containing the result. The length of
+    the last transformed axis is n//2+1.
+)""";
+
+const char *c2r_inplace_DS = R"""(Performs an in-place FFT whose output is strictly real.
+
+This is the inverse operation of `r2c_inplace`, using the same data layout.
+
+Parameters
+----------
+a : numpy.ndarray (any complex type)
+    The input data; it is overwritten by the result.
+    The last axis in `axes` must be contiguous.
+axes : list of integers
+    The axes along which the FFT is carried out.
+    If not set, all axes will be transformed in ascending order.
+lastsize : int
+    The output size of the last axis to be transformed.
+    If the corresponding input axis has size n, this can be 2*n-2 or 2*n-1.
+    If 0, 2*n-2 is used.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+inorm : int
+    Normalization type
+      0 : no normalization
+      1 : divide by sqrt(N)
+      2 : divide by N
+    where N is the product of the lengths of the transformed output axes.
+nthreads : int
+    Number of threads to use. If 0, use the system default (typically governed
+    by the `OMP_NUM_THREADS` environment variable).
+
+Returns
+-------
+numpy.ndarray (real type with same accuracy as `a`)
+    A real view of the memory of `a` containing the result. The shape is
+    identical to that of the input array, except for the axis that was
+    transformed last, which has now `lastsize` entries.
+)""";
+
 const char *r2r_fftpack_DS = R"""(Performs a real-valued FFT using the FFTPACK storage scheme.
 
 Parameters
@@ -671,6 +1066,131 @@ out : int
 
 )""";
 
+const char * plan_cache_info_DS = R"""(Returns statistics about the FFT plan cache.
+
+The cache is shared by all transforms in this module and holds the most
+recently used 1D plans, keyed by transform type, precision and length.
+
+Returns
+-------
+dict
+    with the entries
+      "size" : the number of plans currently cached
+      "max_size" : the maximum number of cached plans
+      "hits" : the number of plan requests satisfied from the cache
+      "misses" : the number of plan requests that required a new plan
+)""";
+
+const char * clear_plan_cache_DS = R"""(Empties the FFT plan cache.
+
+All cached plans are discarded and the hit/miss counters are reset.
+)""";
+
+const char * set_plan_cache_size_DS = R"""(Sets the maximum number of cached FFT plans.
+
+If the cache currently holds more plans, the least recently used ones are
+discarded.
+
+Parameters
+----------
+max_size : int
+    The new maximum number of cached plans. If 0, plans are not cached.
+)""";
+
+const char *Plan_DS = R"""(A precomputed FFT plan for repeated transforms of a fixed shape.
+
+All argument checking, normalization factors and the required 1D plans are
+computed once during construction, so that each call to `execute` only has to
+check the shapes and types of its arguments.
+
+Parameters
+----------
+kind : str
+    the kind of transform; one of "c2c", "r2c", "c2r", "r2r_fftpack",
+    "separable_hartley", "genuine_hartley", "dct" and "dst".
+    The meaning of this and all following parameters is documented in the
+    function of the same name.
+shape : tuple of int
+    the shape of the input arrays
+dtype : numpy.dtype
+    the data type of the input arrays. This must be complex for "c2c" and
+    "c2r", and real for all other kinds.
+axes : list of integers
+    The axes along which the transform is carried out.
+    If not set, all axes will be transformed.
+forward : bool
+    If `True`, a negative sign is used in the exponent, else a positive one.
+    Ignored for Hartley transforms, DCTs and DSTs.
+inorm : int
+    Normalization type, see the documentation of the individual transforms.
+type : int
+    the type of DCT or DST. Must be in [1; 4] for these transforms, otherwise
+    it is ignored.
+lastsize : int
+    the output size of the last transformed axis for "c2r", otherwise ignored.
+real2hermitian : bool
+    only used for "r2r_fftpack"
+nthreads : int
+    Number of threads to use. If 0, use the system default (typically governed
+    by the `OMP_NUM_THREADS` environment variable).
+)""";
+
+const char *convolve_axis_DS = R"""(Performs a circular convolution along one axis.
+
+Every 1D line of `a` along `axis` is Fourier transformed, multiplied with
+`kernel` (the Fourier coefficients of the convolution kernel), zero-padded or
+truncated in Fourier space to the length of `out` along `axis`, and
+transformed back. This combines a convolution with a Fourier resampling in a
+single pass, without any temporary arrays.
+
+Parameters
+----------
+a : numpy.ndarray (any real or complex type)
+    The input data
+out : numpy.ndarray (same data type as `a`)
+    The output data. Must have the same shape as `a`, except along `axis`.
+    May be identical to `a`, if the shapes and strides match; otherwise it
+    must not overlap with `a`.
+axis : integer
+    The axis along which the convolution is carried out.
+kernel : one-dimensional numpy.ndarray (same data type as `a`)
+    The Fourier coefficients of the kernel. Let l_min be the smaller of the
+    lengths of `a` and `out` along `axis`.
+    For real data, both lengths must be even, and `kernel` holds the
+    l_min//2+1 coefficients of the frequencies 0 to l_min//2.
+    For complex data, `kernel` holds l_min coefficients in standard FFT order.
+    The kernel is not normalized; for a plain Fourier resampling use a
+    constant kernel of 1/(length of `a` along `axis`).
+    If l_min is even, the coefficient of frequency l_min//2 is split evenly
+    between the frequencies +l_min//2 and -l_min//2 when padding, and the
+    input values at these two frequencies are summed when truncating.
+nthreads : int
+    Number of threads to use. If 0, use the system default (typically governed
+    by the `OMP_NUM_THREADS` environment variable).
+
+Returns
+-------
+numpy.ndarray
+    identical to `out`.
+)""";
+
+const char *Plan_execute_DS = R"""(Executes the planned transform.
+
+Parameters
+----------
+a : numpy.ndarray
+    The input data. Shape and data type must match the ones given when the
+    plan was created.
+out : numpy.ndarray (shape `output_shape()`)
+    The same restrictions as for the individual transform functions apply.
+    If None, a new array is allocated to store the output.
+
+Returns
+-------
+numpy.ndarray
+    The transformed data.
+)""";
+
 } // unnamed namespace
 
 void add_fft(py::module &msup)
@@ -684,20 +1204,44 @@ void add_fft(py::module &msup)
     "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
   m.def("c2r", c2r, c2r_DS, "a"_a, "axes"_a=None, "lastsize"_a=0,
     "forward"_a=true, "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
+  m.def("r2c_inplace", r2c_inplace, r2c_inplace_DS, "a"_a, "axes"_a=None,
+    "lastsize"_a=0, "forward"_a=true, "inorm"_a=0, "nthreads"_a=1);
+  m.def("c2r_inplace", c2r_inplace, c2r_inplace_DS, "a"_a, "axes"_a=None,
+    "lastsize"_a=0, "forward"_a=true, "inorm"_a=0, "nthreads"_a=1);
   m.def("r2r_fftpack", r2r_fftpack, r2r_fftpack_DS, "a"_a, "axes"_a,
     "real2hermitian"_a, "forward"_a, "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
   m.def("separable_hartley", separable_hartley, separable_hartley_DS, "a"_a,
     "axes"_a=None, "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
   m.def("genuine_hartley", genuine_hartley, genuine_hartley_DS, "a"_a,
     "axes"_a=None, "inorm"_a=0, "out"_a=None, "nthreads"_a=1);
+  m.def("convolve_axis", convolve_axis, convolve_axis_DS, "a"_a, "out"_a,
+    "axis"_a, "kernel"_a, "nthreads"_a=1);
   m.def("dct", dct, dct_DS, "a"_a, "type"_a, "axes"_a=None, "inorm"_a=0,
     "out"_a=None, "nthreads"_a=1);
   m.def("dst", dst, dst_DS, "a"_a, "type"_a, "axes"_a=None, "inorm"_a=0,
     "out"_a=None, "nthreads"_a=1);
+  for (auto name: {"c2c", "r2c", "c2r", "r2r_fftpack", "separable_hartley",
+                   "genuine_hartley", "dct", "dst"})
+    add_async(m, name);
+
+  py::class_<Py_Plan>(m, "Plan", Plan_DS, py::module_local())
+    .def(py::init<const std::string &, const std::vector<size_t> &,
+      const py::object &, const py::object &, bool, int, int, size_t, bool,
+      size_t>(), "kind"_a, "shape"_a, "dtype"_a, "axes"_a=None,
+      "forward"_a=true, "inorm"_a=0, "type"_a=0, "lastsize"_a=0,
+      "real2hermitian"_a=false, "nthreads"_a=1)
+    .def("execute", &Py_Plan::exec, Plan_execute_DS, "a"_a, "out"_a=None)
+    .def("__call__", &Py_Plan::exec, Plan_execute_DS, "a"_a, "out"_a=None)
+    .def("output_shape", &Py_Plan::shape_output);
 
   static PyMethodDef good_size_meth[] =
     {{"good_size", good_size, METH_VARARGS, good_size_DS}, {0, 0, 0, 0}};
   PyModule_AddFunctions(m.ptr(), good_size_meth);
+
+  m.def("plan_cache_info", plan_cache_info, plan_cache_info_DS);
+  m.def("clear_plan_cache", clear_plan_cache, clear_plan_cache_DS);
+  m.def("set_plan_cache_size", set_plan_cache_size, set_plan_cache_size_DS,
+    "max_size"_a);
   }
 
 }
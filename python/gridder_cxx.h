@@ -29,6 +29,9 @@
 #include <vector>
 #include <array>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <fstream>
 
 #include "ducc0/infra/error_handling.h"
 #include "ducc0/math/fft.h"
@@ -39,6 +42,8 @@
 #include "ducc0/infra/simd.h"
 #include "ducc0/infra/timers.h"
 #include "ducc0/math/gridding_kernel.h"
+#include "ducc0/math/spreading_helpers.h"
+#include "ducc0/math/gl_integrator.h"
 
 namespace ducc0 {
 
@@ -46,6 +51,8 @@ namespace detail_gridder {
 
 using namespace std;
 
+using shape_t = fmav_info::shape_t;
+
 template<size_t ndim> void checkShape
   (const array<size_t, ndim> &shp1, const array<size_t, ndim> &shp2)
   { MR_assert(shp1==shp2, "shape mismatch"); }
@@ -57,22 +64,30 @@ template<typename T> inline T fmod1 (T v)
 // Start of real gridder functionality
 //
 
+/* Conversions between a complex uv grid of a real-valued image and the
+   equivalent real grid in Hartley representation. The values at u,v and
+   -u,-v (modulo the grid size) depend on each other, so both are handled
+   together, as well as the pair at u,-v and -u,v; every input value is
+   read only once. */
 template<typename T> void complex2hartley
   (const mav<complex<T>, 2> &grid, mav<T,2> &grid2, size_t nthreads)
   {
   MR_assert(grid.conformable(grid2), "shape mismatch");
   size_t nu=grid.shape(0), nv=grid.shape(1);
 
-  execStatic(nu, nthreads, 0, [&](Scheduler &sched)
+  execStatic(nu/2+1, nthreads, 0, [&](Scheduler &sched)
     {
     while (auto rng=sched.getNext()) for(auto u=rng.lo; u<rng.hi; ++u)
       {
       size_t xu = (u==0) ? 0 : nu-u;
-      for (size_t v=0; v<nv; ++v)
+      for (size_t v=0; v<=nv/2; ++v)
         {
         size_t xv = (v==0) ? 0 : nv-v;
-        grid2.v(u,v) = T(0.5)*(grid( u, v).real()+grid( u, v).imag()+
-                               grid(xu,xv).real()-grid(xu,xv).imag());
+        auto a = grid(u,v), b = grid(xu,xv), c = grid(u,xv), d = grid(xu,v);
+        grid2.v( u, v) = T(0.5)*(a.real()+a.imag()+b.real()-b.imag());
+        grid2.v(xu,xv) = T(0.5)*(b.real()+b.imag()+a.real()-a.imag());
+        grid2.v( u,xv) = T(0.5)*(c.real()+c.imag()+d.real()-d.imag());
+        grid2.v(xu, v) = T(0.5)*(d.real()+d.imag()+c.real()-c.imag());
         }
       }
     });
@@ -84,55 +99,35 @@ template<typename T> void hartley2complex
   MR_assert(grid.conformable(grid2), "shape mismatch");
   size_t nu=grid.shape(0), nv=grid.shape(1);
 
-  execStatic(nu, nthreads, 0, [&](Scheduler &sched)
+  execStatic(nu/2+1, nthreads, 0, [&](Scheduler &sched)
     {
     while (auto rng=sched.getNext()) for(auto u=rng.lo; u<rng.hi; ++u)
       {
       size_t xu = (u==0) ? 0 : nu-u;
-      for (size_t v=0; v<nv; ++v)
+      for (size_t v=0; v<=nv/2; ++v)
         {
         size_t xv = (v==0) ? 0 : nv-v;
-        T v1 = T(0.5)*grid( u, v);
-        T v2 = T(0.5)*grid(xu,xv);
-        grid2.v(u,v) = std::complex<T>(v1+v2, v1-v2);
+        T a = T(0.5)*grid( u, v), b = T(0.5)*grid(xu,xv),
+          c = T(0.5)*grid( u,xv), d = T(0.5)*grid(xu, v);
+        grid2.v( u, v) = std::complex<T>(a+b, a-b);
+        grid2.v(xu,xv) = std::complex<T>(b+a, b-a);
+        grid2.v( u,xv) = std::complex<T>(c+d, c-d);
+        grid2.v(xu, v) = std::complex<T>(d+c, d-c);
         }
       }
     });
   }
 
-template<typename T> void hartley2_2D(mav<T,2> &arr, size_t vlim,
-  bool first_fast, size_t nthreads)
+/* Turns the four values a=f(u,v), b=f(-u,v), c=f(u,-v), d=f(-u,-v) of the
+   separable 2D Hartley transform f into those of the genuine one, or vice
+   versa (the operation is its own inverse and commutes with the separable
+   transform). */
+template<typename T> [[gnu::always_inline]] inline void hartley_mirror
+  (T &a, T &b, T &c, T &d)
   {
-  size_t nu=arr.shape(0), nv=arr.shape(1);
-  fmav<T> farr(arr);
-  if (2*vlim<nv)
-    {
-    if (!first_fast)
-      r2r_separable_hartley(farr, farr, {1}, T(1), nthreads);
-    auto flo = farr.subarray({0,0},{farr.shape(0),vlim});
-    r2r_separable_hartley(flo, flo, {0}, T(1), nthreads);
-    auto fhi = farr.subarray({0,farr.shape(1)-vlim},{farr.shape(0),vlim});
-    r2r_separable_hartley(fhi, fhi, {0}, T(1), nthreads);
-    if (first_fast)
-      r2r_separable_hartley(farr, farr, {1}, T(1), nthreads);
-    }
-  else
-    r2r_separable_hartley(farr, farr, {0,1}, T(1), nthreads);
-  execStatic((nu+1)/2-1, nthreads, 0, [&](Scheduler &sched)
-    {
-    while (auto rng=sched.getNext()) for(auto i=rng.lo+1; i<rng.hi+1; ++i)
-      for(size_t j=1; j<(nv+1)/2; ++j)
-         {
-         T a = arr(i,j);
-         T b = arr(nu-i,j);
-         T c = arr(i,nv-j);
-         T d = arr(nu-i,nv-j);
-         arr.v(i,j) = T(0.5)*(a+b+c-d);
-         arr.v(nu-i,j) = T(0.5)*(a+b+d-c);
-         arr.v(i,nv-j) = T(0.5)*(a+c+d-b);
-         arr.v(nu-i,nv-j) = T(0.5)*(b+c+d-a);
-         }
-     });
+  T a2 = T(0.5)*(a+b+c-d), b2 = T(0.5)*(a+b+d-c),
+    c2 = T(0.5)*(a+c+d-b), d2 = T(0.5)*(b+c+d-a);
+  a=a2; b=b2; c=c2; d=d2;
   }
 
 using idx_t = uint32_t;
@@ -158,57 +153,284 @@ struct UVW
     }
   };
 
+/*! Compact description of the active (i.e. unflagged) visibilities: for
+    every row, a list of ascending, non-overlapping channel ranges
+    [lo; hi[. Fully flagged rows take no space, and flagged blocks of
+    channels are skipped in one step; for typical flagging patterns this is
+    much smaller than a dense nrow x nchan mask. */
+class ChannelRuns
+  {
+  private:
+    size_t nchan;
+    // the runs of row irow are rowofs[irow] to rowofs[irow+1]-1
+    vector<size_t> rowofs;
+    // cum[i] is the number of active channels in the row before run i
+    vector<idx_t> lo, hi, cum;
+
+    void finalize()
+      {
+      size_t nrow = rowofs.size()-1;
+      MR_assert((lo.size()==rowofs[nrow]) && (hi.size()==lo.size()),
+        "inconsistent run arrays");
+      cum.resize(lo.size());
+      for (size_t irow=0; irow<nrow; ++irow)
+        {
+        MR_assert(rowofs[irow+1]>=rowofs[irow], "row offsets must not decrease");
+        idx_t acc=0;
+        for (size_t i=rowofs[irow]; i<rowofs[irow+1]; ++i)
+          {
+          MR_assert((lo[i]<hi[i]) && (hi[i]<=nchan), "bad channel run");
+          MR_assert((i==rowofs[irow]) || (lo[i]>=hi[i-1]),
+            "channel runs must be ascending and non-overlapping");
+          cum[i] = acc;
+          acc += hi[i]-lo[i];
+          }
+        }
+      }
+
+  public:
+    /*! All visibilities of \a nrow rows with \a nchan_ channels are active. */
+    ChannelRuns(size_t nrow, size_t nchan_)
+      : nchan(nchan_), rowofs(nrow+1), lo(nchan ? nrow : 0, 0),
+        hi(nchan ? nrow : 0, idx_t(nchan)), cum(lo.size(), 0)
+      {
+      for (size_t i=0; i<=nrow; ++i)
+        rowofs[i] = nchan ? i : 0;
+      }
+    /*! Runs given explicitly: the runs of row \a irow are stored at the
+        indices rowofs_[irow] to rowofs_[irow+1]-1 of \a lo_ and \a hi_. */
+    ChannelRuns(size_t nchan_, vector<size_t> &&rowofs_, vector<idx_t> &&lo_,
+      vector<idx_t> &&hi_)
+      : nchan(nchan_), rowofs(move(rowofs_)), lo(move(lo_)), hi(move(hi_))
+      {
+      MR_assert((!rowofs.empty()) && (rowofs[0]==0), "bad row offsets");
+      finalize();
+      }
+    /*! Builds the runs of \a nrow rows with \a nchan_ channels in parallel.
+        For every row, \a func(tid, irow, add) must call \a add(lo, hi) for
+        the active channel ranges of the row in ascending order; \a tid is
+        the number of the calling thread. */
+    template<typename Func> ChannelRuns(size_t nrow, size_t nchan_,
+      size_t nthreads, Func func)
+      : nchan(nchan_), rowofs(nrow+1, 0)
+      {
+      vector<vector<idx_t>> tlo(nthreads), thi(nthreads);
+      execParallel(nthreads, [&](Scheduler &sched)
+        {
+        auto tid = sched.thread_num();
+        auto [rlo, rhi] = calcShare(nthreads, tid, nrow);
+        auto &llo(tlo[tid]), &lhi(thi[tid]);
+        for (size_t irow=rlo; irow<rhi; ++irow)
+          {
+          size_t n0 = llo.size();
+          func(tid, irow, [&](size_t l, size_t h)
+            {
+            // merge adjacent ranges
+            if ((llo.size()>n0) && (lhi.back()==l))
+              lhi.back() = idx_t(h);
+            else
+              { llo.push_back(idx_t(l)); lhi.push_back(idx_t(h)); }
+            });
+          rowofs[irow+1] = llo.size()-n0;
+          }
+        });
+      for (size_t irow=0; irow<nrow; ++irow)
+        rowofs[irow+1] += rowofs[irow];
+      lo.reserve(rowofs[nrow]); hi.reserve(rowofs[nrow]);
+      for (size_t t=0; t<nthreads; ++t)
+        {
+        lo.insert(lo.end(), tlo[t].begin(), tlo[t].end());
+        hi.insert(hi.end(), thi[t].begin(), thi[t].end());
+        }
+      finalize();
+      }
+    /*! Active visibilities are those with \a mask(irow,ichan)!=0. */
+    ChannelRuns(const mav<uint8_t,2> &mask, size_t nthreads)
+      : ChannelRuns(mask.shape(0), mask.shape(1), nthreads,
+          [&mask](size_t /*tid*/, size_t irow, auto add)
+          {
+          size_t nch=mask.shape(1);
+          for (size_t ichan=0; ichan<nch; )
+            {
+            while ((ichan<nch) && (mask(irow,ichan)==0)) ++ichan;
+            size_t start=ichan;
+            while ((ichan<nch) && (mask(irow,ichan)!=0)) ++ichan;
+            if (ichan>start) add(start, ichan);
+            }
+          }) {}
+
+    size_t Nrows() const { return rowofs.size()-1; }
+    size_t Nchannels() const { return nchan; }
+    /*! Total number of runs. */
+    size_t Nruns() const { return lo.size(); }
+    /*! Runs of row \a irow are those with indices from first(irow) to
+        first(irow+1)-1. */
+    size_t first(size_t irow) const { return rowofs[irow]; }
+    idx_t Lo(size_t irun) const { return lo[irun]; }
+    idx_t Hi(size_t irun) const { return hi[irun]; }
+    /*! Number of active channels in row \a irow. */
+    size_t nActive(size_t irow) const
+      {
+      auto i=rowofs[irow+1];
+      return (i==rowofs[irow]) ? 0 : cum[i-1]+hi[i-1]-lo[i-1];
+      }
+    /*! Returns the \a k-th active channel of row \a irow. */
+    idx_t channel(size_t irow, size_t k) const
+      {
+      auto it = upper_bound(cum.begin()+ptrdiff_t(rowofs[irow]),
+        cum.begin()+ptrdiff_t(rowofs[irow+1]), idx_t(k));
+      size_t i = size_t(it-cum.begin())-1;
+      return lo[i] + idx_t(k-cum[i]);
+      }
+  };
+
+/*! Coordinates of the visibilities. The uvw coordinates of the rows are
+    either stored explicitly (in the precision in which they were provided),
+    or computed on the fly from the positions of the two antennas forming the
+    baseline and the hour angle of the row. */
 class Baselines
   {
   protected:
+    // antennas and hour angle index of a row
+    struct AntRow
+      {
+      idx_t ant1, ant2, time;
+      };
+
     vector<UVW> coord;
+    vector<array<float,3>> coord_f;
+    vector<UVW> antpos;
+    vector<AntRow> antrow;
+    vector<double> sinha, cosha;
+    double sindec, cosdec, vfac;
     vector<double> f_over_c;
     idx_t nrows, nchan;
     idx_t shift, mask;
     double umax, vmax;
 
-  public:
-    template<typename T> Baselines(const mav<T,2> &coord_,
-      const mav<T,1> &freq, bool negate_v=false)
+    template<typename T> void initFreq(size_t nrows_, const mav<T,1> &freq)
       {
       constexpr double speedOfLight = 299792458.;
-      MR_assert(coord_.shape(1)==3, "dimension mismatch");
       auto hugeval = size_t(~(idx_t(0)));
-      MR_assert(coord_.shape(0)<hugeval, "too many entries in MS");
-      MR_assert(coord_.shape(1)<hugeval, "too many entries in MS");
-      MR_assert(coord_.size()<hugeval, "too many entries in MS");
-      nrows = coord_.shape(0);
+      MR_assert(nrows_<hugeval, "too many entries in MS");
+      nrows = nrows_;
       nchan = freq.shape(0);
       shift=0;
       while((idx_t(1)<<shift)<nchan) ++shift;
       mask=(idx_t(1)<<shift)-1;
       MR_assert(nrows*(mask+1)<hugeval, "too many entries in MS");
       f_over_c.resize(nchan);
-      double fcmax = 0;
       for (size_t i=0; i<nchan; ++i)
         {
         MR_assert(freq(i)>0, "negative channel frequency encountered");
         f_over_c[i] = freq(i)/speedOfLight;
-        fcmax = max(fcmax, abs(f_over_c[i]));
         }
-      coord.resize(nrows);
-      double vfac = negate_v ? -1 : 1;
-      vmax=0;
-      for (size_t i=0; i<coord.size(); ++i)
+      }
+    void initMax()
+      {
+      double fcmax = 0;
+      for (auto fc: f_over_c)
+        fcmax = max(fcmax, abs(fc));
+      umax=vmax=0;
+      for (idx_t i=0; i<nrows; ++i)
         {
-        coord[i] = UVW(coord_(i,0), vfac*coord_(i,1), coord_(i,2));
-        umax = max(umax, abs(coord_(i,0)));
-        vmax = max(vmax, abs(coord_(i,1)));
+        auto uvw = rowCoord(i);
+        umax = max(umax, abs(uvw.u));
+        vmax = max(vmax, abs(uvw.v));
         }
       umax *= fcmax;
       vmax *= fcmax;
       }
 
+    UVW rowCoord(idx_t row) const
+      {
+      if (!coord.empty()) return coord[row];
+      if (!coord_f.empty())
+        {
+        const auto &c(coord_f[row]);
+        return UVW(c[0], c[1], c[2]);
+        }
+      const auto &ar(antrow[row]);
+      const auto &p1(antpos[ar.ant1]), &p2(antpos[ar.ant2]);
+      double bx=p2.u-p1.u, by=p2.v-p1.v, bz=p2.w-p1.w;
+      double sh=sinha[ar.time], ch=cosha[ar.time];
+      double tmp=ch*bx-sh*by;
+      return UVW(sh*bx+ch*by, vfac*(cosdec*bz-sindec*tmp), sindec*bz+cosdec*tmp);
+      }
+
+  public:
+    /*! Single precision coordinates are also stored in single precision,
+        which halves the memory traffic for them during (de)gridding. */
+    template<typename T, typename Tf> Baselines(const mav<T,2> &coord_,
+      const mav<Tf,1> &freq, bool negate_v=false)
+      : vfac(negate_v ? -1 : 1)
+      {
+      MR_assert(coord_.shape(1)==3, "dimension mismatch");
+      auto hugeval = size_t(~(idx_t(0)));
+      MR_assert(coord_.size()<hugeval, "too many entries in MS");
+      initFreq(coord_.shape(0), freq);
+      if constexpr (is_same<T, float>::value)
+        {
+        coord_f.resize(nrows);
+        for (size_t i=0; i<nrows; ++i)
+          coord_f[i] = {coord_(i,0), T(vfac)*coord_(i,1), coord_(i,2)};
+        }
+      else
+        {
+        coord.resize(nrows);
+        for (size_t i=0; i<nrows; ++i)
+          coord[i] = UVW(coord_(i,0), vfac*coord_(i,1), coord_(i,2));
+        }
+      initMax();
+      }
+
+    /*! Computes the uvw coordinates of every row from antenna positions
+        instead of storing them (which needs 12 instead of 24 bytes per row).
+        \a pos holds the antenna positions (in meters) in a right-handed
+        equatorial frame: x points towards hour angle 0 on the celestial
+        equator, y towards hour angle -6h, z towards the celestial pole.
+        Row \a i has the baseline from antenna \a ant1(i) to \a ant2(i)
+        and the hour angle \a hour_angle(time(i)) (in radians); the phase
+        center is at declination \a dec.
+        The coordinates follow Thompson, Moran & Swenson, eq. (4.1). */
+    template<typename T, typename Ti> Baselines(const mav<T,2> &pos,
+      const mav<Ti,1> &ant1, const mav<Ti,1> &ant2, const mav<Ti,1> &time,
+      const mav<T,1> &hour_angle, double dec, const mav<T,1> &freq,
+      bool negate_v=false)
+      : sindec(sin(dec)), cosdec(cos(dec)), vfac(negate_v ? -1 : 1)
+      {
+      MR_assert(pos.shape(1)==3, "dimension mismatch");
+      size_t nant=pos.shape(0), ntime=hour_angle.shape(0);
+      checkShape(ant2.shape(), ant1.shape());
+      checkShape(time.shape(), ant1.shape());
+      initFreq(ant1.shape(0), freq);
+      antpos.resize(nant);
+      for (size_t i=0; i<nant; ++i)
+        antpos[i] = UVW(pos(i,0), pos(i,1), pos(i,2));
+      sinha.resize(ntime);
+      cosha.resize(ntime);
+      for (size_t i=0; i<ntime; ++i)
+        {
+        sinha[i] = sin(hour_angle(i));
+        cosha[i] = cos(hour_angle(i));
+        }
+      antrow.resize(nrows);
+      for (size_t i=0; i<nrows; ++i)
+        {
+        // negative indices wrap around to huge values and fail as well
+        MR_assert((size_t(ant1(i))<nant) && (size_t(ant2(i))<nant),
+          "antenna index out of range");
+        MR_assert(size_t(time(i))<ntime, "time index out of range");
+        antrow[i] = AntRow{idx_t(ant1(i)), idx_t(ant2(i)), idx_t(time(i))};
+        }
+      initMax();
+      }
+
     RowChan getRowChan(idx_t index) const
       { return RowChan{index>>shift, index&mask}; }
 
     UVW effectiveCoord(const RowChan &rc) const
-      { return coord[rc.row]*f_over_c[rc.chan]; }
+      { return rowCoord(rc.row)*f_over_c[rc.chan]; }
     UVW effectiveCoord(idx_t index) const
       { return effectiveCoord(getRowChan(index)); }
     size_t Nrows() const { return nrows; }
@@ -217,6 +439,168 @@ class Baselines
       { return ichan+(irow<<shift); }
     double Umax() const { return umax; }
     double Vmax() const { return vmax; }
+    // uvw coordinates of a row (in meters) and frequency factor of a channel
+    UVW rowUVW(idx_t row) const { return rowCoord(row); }
+    double fOverC(idx_t chan) const { return f_over_c[chan]; }
+    void extendMax(double umax_, double vmax_)
+      {
+      umax = max(umax, umax_);
+      vmax = max(vmax, vmax_);
+      }
+  };
+
+/*! Time and frequency smearing of averaged visibilities (e.g. after
+    baseline-dependent averaging). During the integration of row \a i, its
+    uvw coordinates (in meters) change by \a duvw(i), and its channels have
+    the width \a chan_width(i) (in Hz); either array may be empty if there
+    is no smearing of this kind. Every visibility is the mean of the
+    visibility function over the region of uvw space covered in this way.
+    This mean is evaluated with a tensor Gauss-Legendre rule in time and
+    frequency, i.e. every visibility is gridded as a set of weighted
+    sub-samples, whose number is chosen per row such that the quadrature
+    error on the dirty image is below \a epsilon. A channel width of 0
+    means that the row is not smeared in frequency. */
+class Smearing
+  {
+  protected:
+    vector<UVW> duvw;
+    vector<double> dfc; // channel width/speed of light
+    vector<array<uint8_t,2>> nsub; // number of nodes in time and frequency
+    vector<vector<double>> glx, glw; // Gauss-Legendre rules on [-1/2; 1/2]
+    idx_t subshift, submask;
+    double umax, vmax;
+
+    void addRule(size_t n)
+      {
+      GL_Integrator integ(n);
+      auto x = integ.coords();
+      auto w = integ.weights();
+      for (size_t i=0; i<n; ++i)
+        { x[i]*=0.5; w[i]*=0.5; }
+      glx.push_back(x);
+      glw.push_back(w);
+      }
+    // smallest number of nodes integrating exp(i*k*x) over [-1/2; 1/2]
+    // to an accuracy of epsilon for all wave numbers up to kmax
+    size_t numNodes(double kmax, double epsilon, vector<double> &klim)
+      {
+      constexpr size_t nmax=255;
+      constexpr double dk=0.02;
+      while (klim.back()<kmax)
+        {
+        size_t n=klim.size();
+        MR_assert(n<=nmax, "smearing too large");
+        addRule(n);
+        double k=klim.back();
+        while (true)
+          {
+          double knext=k+dk, res=0;
+          for (size_t i=0; i<n; ++i)
+            res += glw[n][i]*cos(knext*glx[n][i]);
+          if (abs(res-sin(0.5*knext)/(0.5*knext))>epsilon) break;
+          k = knext;
+          }
+        klim.push_back(k);
+        }
+      size_t n=1;
+      while (klim[n]<kmax) ++n;
+      return n;
+      }
+
+  public:
+    Smearing(const Baselines &baselines, const mav<double,2> &duvw_,
+      const mav<double,1> &chan_width, size_t nxdirty, size_t nydirty,
+      double pixsize_x, double pixsize_y, double epsilon, bool negate_v=false)
+      : umax(0), vmax(0)
+      {
+      constexpr double speedOfLight = 299792458.;
+      constexpr double pi=3.141592653589793238462643383279502884197;
+      size_t nrows = baselines.Nrows();
+      bool have_duvw = duvw_.size()!=0, have_cw = chan_width.size()!=0;
+      if (have_duvw) checkShape(duvw_.shape(), {nrows, 3});
+      if (have_cw) checkShape(chan_width.shape(), {nrows});
+      double vfac = negate_v ? -1 : 1;
+      duvw.resize(nrows, UVW(0,0,0));
+      dfc.resize(nrows, 0.);
+      for (size_t i=0; i<nrows; ++i)
+        {
+        if (have_duvw)
+          duvw[i] = UVW(duvw_(i,0), vfac*duvw_(i,1), duvw_(i,2));
+        if (have_cw)
+          {
+          MR_assert(chan_width(i)>=0, "negative channel width encountered");
+          dfc[i] = chan_width(i)/speedOfLight;
+          }
+        }
+      double fcmax = 0;
+      for (size_t i=0; i<baselines.Nchannels(); ++i)
+        fcmax = max(fcmax, baselines.fOverC(idx_t(i)));
+      // largest absolute values of l, m and n-1 in the image
+      double x0 = 0.5*nxdirty*pixsize_x, y0 = 0.5*nydirty*pixsize_y;
+      double nm1max = (x0*x0+y0*y0>1.) ? sqrt(abs(1.-x0*x0-y0*y0))+1.
+                                       : 1.-sqrt(max(1.-x0*x0-y0*y0,0.));
+      glx.emplace_back();  // unused entry for 0 nodes
+      glw.emplace_back();
+      addRule(1);
+      vector<double> klim{0., 2*sqrt(6*epsilon)};
+      nsub.resize(nrows);
+      size_t maxsub=1;
+      for (size_t i=0; i<nrows; ++i)
+        {
+        auto uvw = baselines.rowUVW(idx_t(i));
+        const auto &d(duvw[i]);
+        // bounds for the phase change (in radians) across the integration
+        double kt = 2*pi*fcmax*(abs(d.u)*x0+abs(d.v)*y0+abs(d.w)*nm1max);
+        double kf = 2*pi*dfc[i]*((abs(uvw.u)+0.5*abs(d.u))*x0
+          + (abs(uvw.v)+0.5*abs(d.v))*y0 + (abs(uvw.w)+0.5*abs(d.w))*nm1max);
+        size_t nt = numNodes(kt, epsilon, klim),
+               nf = numNodes(kf, epsilon, klim);
+        nsub[i] = {uint8_t(nt), uint8_t(nf)};
+        maxsub = max(maxsub, nt*nf);
+        double fmax = fcmax+0.5*dfc[i];
+        umax = max(umax, (abs(uvw.u)+0.5*abs(d.u))*fmax);
+        vmax = max(vmax, (abs(uvw.v)+0.5*abs(d.v))*fmax);
+        }
+      subshift=0;
+      while((size_t(1)<<subshift)<maxsub) ++subshift;
+      submask=(idx_t(1)<<subshift)-1;
+      MR_assert((size_t(baselines.getIdx(idx_t(nrows),0))<<subshift)
+        < size_t(~idx_t(0)), "too many entries in MS");
+      }
+
+    size_t nSub(idx_t row) const { return nsub[row][0]*nsub[row][1]; }
+    idx_t Subshift() const { return subshift; }
+    idx_t Submask() const { return submask; }
+    // largest absolute u and v (in wavelengths) of all sub-samples
+    double Umax() const { return umax; }
+    double Vmax() const { return vmax; }
+
+    UVW coord(const Baselines &baselines, const RowChan &rc, idx_t isub) const
+      {
+      size_t nf = nsub[rc.row][1];
+      double st = glx[nsub[rc.row][0]][isub/nf], sf = glx[nf][isub%nf];
+      auto uvw = baselines.rowUVW(rc.row);
+      const auto &d(duvw[rc.row]);
+      return UVW(uvw.u+st*d.u, uvw.v+st*d.v, uvw.w+st*d.w)
+        * (baselines.fOverC(rc.chan)+sf*dfc[rc.row]);
+      }
+    double weight(idx_t row, idx_t isub) const
+      {
+      size_t nf = nsub[row][1];
+      return glw[nsub[row][0]][isub/nf]*glw[nf][isub%nf];
+      }
+    // range of |w| (in wavelengths) covered by a visibility
+    void wRange(const Baselines &baselines, const RowChan &rc, double &wmin,
+      double &wmax) const
+      {
+      double w0 = baselines.rowUVW(rc.row).w, dw = 0.5*duvw[rc.row].w;
+      double fc = baselines.fOverC(rc.chan), df = 0.5*dfc[rc.row];
+      double c[4] = {(w0-dw)*(fc-df), (w0-dw)*(fc+df),
+                     (w0+dw)*(fc-df), (w0+dw)*(fc+df)};
+      double lo=*min_element(c,c+4), hi=*max_element(c,c+4);
+      wmin = min(wmin, ((lo<=0)&&(hi>=0)) ? 0. : min(abs(lo), abs(hi)));
+      wmax = max(wmax, max(abs(lo), abs(hi)));
+      }
   };
 
 template<typename T> class GridderConfig
@@ -236,8 +620,8 @@ template<typename T> class GridderConfig
     size_t nthreads;
     double ushift, vshift;
     int maxiu0, maxiv0;
-    size_t vlim;
-    bool uv_side_fast;
+    size_t ulim, vlim;
+    size_t wbatch;
 
     T phase (T x, T y, T w, bool adjoint) const
       {
@@ -264,15 +648,10 @@ template<typename T> class GridderConfig
         nthreads(nthreads_),
         ushift(supp*(-0.5)+1+nu), vshift(supp*(-0.5)+1+nv),
         maxiu0((nu+nsafe)-supp), maxiv0((nv+nsafe)-supp),
+        ulim(min(nu/2, size_t(nu*baselines.Umax()*psx+0.5*supp+1))),
         vlim(min(nv/2, size_t(nv*baselines.Vmax()*psy+0.5*supp+1))),
-        uv_side_fast(true)
+        wbatch(1)
       {
-      size_t vlim2 = (nydirty+1)/2+(supp+1)/2;
-      if (vlim2<vlim)
-        {
-        vlim = vlim2;
-        uv_side_fast = false;
-        }
       MR_assert(nu>=2*nsafe, "nu too small");
       MR_assert(nv>=2*nsafe, "nv too small");
       MR_assert((nx_dirty&1)==0, "nx_dirty must be even");
@@ -294,26 +673,73 @@ template<typename T> class GridderConfig
     size_t Nthreads() const { return nthreads; }
     double Epsilon() const { return epsilon; }
     double Ofactor() const { return ofactor; }
+    /* Allows up to \a mem bytes for the grids of w planes which are
+       processed together (see x2dirty() and dirty2x()); at most one plane
+       per thread is processed at a time. */
+    void setWPlaneMemory(double mem)
+      {
+      wbatch = max<size_t>(1, min(nthreads,
+        size_t(mem/(double(nu)*nv*sizeof(complex<T>)))));
+      }
+    size_t WPlaneBatch() const { return wbatch; }
+
+    /* Extents (in FFT order, see c2c_pruned()) of the part of the uv grid
+       touched by the visibilities, and of the part corresponding to the
+       dirty image. The Hartley post-processing combines values at mirrored
+       positions, so it needs symmetric (i.e. odd) output extents. */
+    shape_t uv_extent(bool symmetric) const
+      { return {min(nu, 2*ulim+symmetric), min(nv, 2*vlim+symmetric)}; }
+    shape_t dirty_extent(bool symmetric) const
+      { return {min(nu, nx_dirty+symmetric), min(nv, ny_dirty+symmetric)}; }
+    // returns the axis order requiring fewer 1D FFTs and reorders the
+    // extents accordingly
+    shape_t fft_axes(shape_t &in_extent, shape_t &out_extent) const
+      {
+      if (in_extent[1]*nu+out_extent[0]*nv
+        <= in_extent[0]*nv+out_extent[1]*nu)
+        return {0,1};
+      swap(in_extent[0], in_extent[1]);
+      swap(out_extent[0], out_extent[1]);
+      return {1,0};
+      }
 
-    void grid2dirty_post(mav<T,2> &tmav,
+    /* Converts the separable Hartley transform in tmav into the genuine
+       one (see hartley_mirror()) and applies the grid correction, writing
+       the result to dirty. Only the part of tmav corresponding to the
+       dirty image (including the mirror of its first row and column) is
+       read; every group of four mirrored values yields four pixels. */
+    void grid2dirty_post(const mav<T,2> &tmav,
       mav<T,2> &dirty) const
       {
       checkShape(dirty.shape(), {nx_dirty, ny_dirty});
-      auto cfu = krn->corfunc(nx_dirty/2+1, 1./nu, nthreads);
-      auto cfv = krn->corfunc(ny_dirty/2+1, 1./nv, nthreads);
-      execStatic(nx_dirty, nthreads, 0, [&](Scheduler &sched)
+      auto giu = grid_indices(nx_dirty, nu, false),
+           giv = grid_indices(ny_dirty, nv, false);
+      auto cfu = correction_factors(*krn, nx_dirty, nu, false, nthreads),
+           cfv = correction_factors(*krn, ny_dirty, nv, false, nthreads);
+      execStatic(nx_dirty/2+1, nthreads, 0, [&](Scheduler &sched)
         {
         while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
           {
-          int icfu = abs(int(nx_dirty/2)-int(i));
-          for (size_t j=0; j<ny_dirty; ++j)
+          size_t i2 = nx_dirty-i; // mirrored row; does not exist for i==0
+          size_t ix = giu[i];
+          size_t ix2 = (ix==0) ? 0 : nu-ix;
+          for (size_t j=0; j<=ny_dirty/2; ++j)
             {
-            int icfv = abs(int(ny_dirty/2)-int(j));
-            size_t i2 = nu-nx_dirty/2+i;
-            if (i2>=nu) i2-=nu;
-            size_t j2 = nv-ny_dirty/2+j;
-            if (j2>=nv) j2-=nv;
-            dirty.v(i,j) = tmav(i2,j2)*T(cfu[icfu]*cfv[icfv]);
+            size_t j2 = ny_dirty-j;
+            size_t jx = giv[j];
+            size_t jx2 = (jx==0) ? 0 : nv-jx;
+            T a = tmav(ix,jx), b = tmav(ix2,jx),
+              c = tmav(ix,jx2), d = tmav(ix2,jx2);
+            if ((ix!=ix2) && (jx!=jx2))
+              hartley_mirror(a, b, c, d);
+            T fct = T(cfu[i]*cfv[j]);
+            dirty.v(i,j) = a*fct;
+            if (i2<nx_dirty)
+              dirty.v(i2,j) = b*fct;
+            if (j2<ny_dirty)
+              dirty.v(i,j2) = c*fct;
+            if ((i2<nx_dirty) && (j2<ny_dirty))
+              dirty.v(i2,j2) = d*fct;
             }
           }
         });
@@ -373,8 +799,11 @@ template<typename T> class GridderConfig
       {
       timers.push("FFT");
       checkShape(grid.shape(), {nu,nv});
-      hartley2_2D<T>(grid, vlim, uv_side_fast, nthreads);
-      timers.poppush("grid correction");
+      auto ein=uv_extent(false), eout=dirty_extent(true);
+      auto axes=fft_axes(ein, eout);
+      fmav<T> fgrid(grid);
+      r2r_separable_hartley_pruned(fgrid, axes, ein, eout, T(1), nthreads);
+      timers.poppush("Hartley conversion+grid correction");
       grid2dirty_post(grid, dirty);
       timers.pop();
       }
@@ -385,46 +814,84 @@ template<typename T> class GridderConfig
       timers.push("FFT");
       checkShape(grid.shape(), {nu,nv});
       fmav<complex<T>> inout(grid);
-      if (2*vlim<nv)
-        {
-        if (!uv_side_fast)
-          c2c(inout, inout, {1}, BACKWARD, T(1), nthreads);
-        auto inout_lo = inout.subarray({0,0},{inout.shape(0),vlim});
-        c2c(inout_lo, inout_lo, {0}, BACKWARD, T(1), nthreads);
-        auto inout_hi = inout.subarray({0,inout.shape(1)-vlim},{inout.shape(0),vlim});
-        c2c(inout_hi, inout_hi, {0}, BACKWARD, T(1), nthreads);
-        if (uv_side_fast)
-          c2c(inout, inout, {1}, BACKWARD, T(1), nthreads);
-        }
-      else
-        c2c(inout, inout, {0,1}, BACKWARD, T(1), nthreads);
+      auto ein=uv_extent(false), eout=dirty_extent(false);
+      auto axes=fft_axes(ein, eout);
+      c2c_pruned(inout, axes, ein, eout, BACKWARD, T(1), nthreads);
       timers.poppush("wscreen+grid correction");
       grid2dirty_post2(grid, dirty, w);
       timers.pop();
       }
+    /* Same as above for several w planes at once. The FFTs of the planes are
+       done concurrently, each one by a single thread. */
+    void grid2dirty_c_overwrite_wscreen_add
+      (vector<mav<complex<T>,2>> &grids, const vector<double> &ws,
+      mav<T,2> &dirty) const
+      {
+      timers.push("FFT");
+      auto ein=uv_extent(false), eout=dirty_extent(false);
+      auto axes=fft_axes(ein, eout);
+      execDynamic(ws.size(), nthreads, 1, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          checkShape(grids[i].shape(), {nu,nv});
+          fmav<complex<T>> inout(grids[i]);
+          c2c_pruned(inout, axes, ein, eout, BACKWARD, T(1), 1);
+          }
+        });
+      timers.poppush("wscreen+grid correction");
+      for (size_t i=0; i<ws.size(); ++i)
+        grid2dirty_post2(grids[i], dirty, T(ws[i]));
+      timers.pop();
+      }
 
+    /* Adjoint of grid2dirty_post(): applies the grid correction to dirty,
+       converts the result with hartley_mirror() and stores it in the
+       corresponding part of grid, which is zeroed everywhere else. */
     void dirty2grid_pre(const mav<T,2> &dirty,
       mav<T,2> &grid) const
       {
       checkShape(dirty.shape(), {nx_dirty, ny_dirty});
       checkShape(grid.shape(), {nu, nv});
-      auto cfu = krn->corfunc(nx_dirty/2+1, 1./nu, nthreads);
-      auto cfv = krn->corfunc(ny_dirty/2+1, 1./nv, nthreads);
-      // FIXME: maybe we don't have to fill everything and can save some time
-      grid.fill(0);
-      execStatic(nx_dirty, nthreads, 0, [&](Scheduler &sched)
+      auto giu = grid_indices(nx_dirty, nu, false),
+           giv = grid_indices(ny_dirty, nv, false);
+      auto cfu = correction_factors(*krn, nx_dirty, nu, false, nthreads),
+           cfv = correction_factors(*krn, ny_dirty, nv, false, nthreads);
+      execStatic(nu, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          bool inside = (i<=nx_dirty/2) || (i>=nu-nx_dirty/2);
+          for (size_t j=inside ? ny_dirty/2+1 : 0,
+                      jend=inside ? nv-ny_dirty/2 : nv; j<jend; ++j)
+            grid.v(i,j) = T(0);
+          }
+        });
+      execStatic(nx_dirty/2+1, nthreads, 0, [&](Scheduler &sched)
         {
         while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
           {
-          int icfu = abs(int(nx_dirty/2)-int(i));
-          for (size_t j=0; j<ny_dirty; ++j)
+          size_t i2 = nx_dirty-i; // mirrored row; does not exist for i==0
+          size_t ix = giu[i];
+          size_t ix2 = (ix==0) ? 0 : nu-ix;
+          for (size_t j=0; j<=ny_dirty/2; ++j)
             {
-            int icfv = abs(int(ny_dirty/2)-int(j));
-            size_t i2 = nu-nx_dirty/2+i;
-            if (i2>=nu) i2-=nu;
-            size_t j2 = nv-ny_dirty/2+j;
-            if (j2>=nv) j2-=nv;
-            grid.v(i2,j2) = dirty(i,j)*T(cfu[icfu]*cfv[icfv]);
+            size_t j2 = ny_dirty-j;
+            size_t jx = giv[j];
+            size_t jx2 = (jx==0) ? 0 : nv-jx;
+            T fct = T(cfu[i]*cfv[j]);
+            // mirrored positions which coincide must get the same value
+            T a = dirty(i,j)*fct;
+            T b = (ix==ix2) ? a : ((i2<nx_dirty) ? dirty(i2,j)*fct : T(0));
+            T c = (jx==jx2) ? a : ((j2<ny_dirty) ? dirty(i,j2)*fct : T(0));
+            T d = (ix==ix2) ? c : ((jx==jx2) ? b :
+              (((i2<nx_dirty) && (j2<ny_dirty)) ? dirty(i2,j2)*fct : T(0)));
+            if ((ix!=ix2) && (jx!=jx2))
+              hartley_mirror(a, b, c, d);
+            grid.v(ix,jx) = a;
+            grid.v(ix2,jx) = b;
+            grid.v(ix,jx2) = c;
+            grid.v(ix2,jx2) = d;
             }
           }
         });
@@ -487,10 +954,13 @@ template<typename T> class GridderConfig
     void dirty2grid(const mav<T,2> &dirty,
       mav<T,2> &grid) const
       {
-      timers.push("grid correction");
+      timers.push("grid correction+Hartley conversion");
       dirty2grid_pre(dirty, grid);
       timers.poppush("FFT");
-      hartley2_2D<T>(grid, vlim, !uv_side_fast, nthreads);
+      auto ein=dirty_extent(true), eout=uv_extent(true);
+      auto axes=fft_axes(ein, eout);
+      fmav<T> fgrid(grid);
+      r2r_separable_hartley_pruned(fgrid, axes, ein, eout, T(1), nthreads);
       timers.pop();
       }
 
@@ -501,19 +971,30 @@ template<typename T> class GridderConfig
       dirty2grid_pre2(dirty, grid, w);
       timers.poppush("FFT");
       fmav<complex<T>> inout(grid);
-      if (2*vlim<nv)
+      auto ein=dirty_extent(false), eout=uv_extent(false);
+      auto axes=fft_axes(ein, eout);
+      c2c_pruned(inout, axes, ein, eout, FORWARD, T(1), nthreads);
+      timers.pop();
+      }
+    /* Same as above for several w planes at once. The FFTs of the planes are
+       done concurrently, each one by a single thread. */
+    void dirty2grid_c_wscreen(const mav<T,2> &dirty,
+      vector<mav<complex<T>,2>> &grids, const vector<double> &ws) const
+      {
+      timers.push("wscreen+grid correction");
+      for (size_t i=0; i<ws.size(); ++i)
+        dirty2grid_pre2(dirty, grids[i], T(ws[i]));
+      timers.poppush("FFT");
+      auto ein=dirty_extent(false), eout=uv_extent(false);
+      auto axes=fft_axes(ein, eout);
+      execDynamic(ws.size(), nthreads, 1, [&](Scheduler &sched)
         {
-        if (uv_side_fast)
-          c2c(inout, inout, {1}, FORWARD, T(1), nthreads);
-        auto inout_lo = inout.subarray({0,0},{inout.shape(0),vlim});
-        c2c(inout_lo, inout_lo, {0}, FORWARD, T(1), nthreads);
-        auto inout_hi = inout.subarray({0,inout.shape(1)-vlim},{inout.shape(0),vlim});
-        c2c(inout_hi, inout_hi, {0}, FORWARD, T(1), nthreads);
-        if (!uv_side_fast)
-          c2c(inout, inout, {1}, FORWARD, T(1), nthreads);
-        }
-      else
-        c2c(inout, inout, {0,1}, FORWARD, T(1), nthreads);
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          fmav<complex<T>> inout(grids[i]);
+          c2c_pruned(inout, axes, ein, eout, FORWARD, T(1), 1);
+          }
+        });
       timers.pop();
       }
 
@@ -528,54 +1009,24 @@ template<typename T> class GridderConfig
 
 constexpr int logsquare=4;
 
-template<size_t supp, bool wgrid, typename T> class HelperX2g2
+/* Gridding helper: the kernel is evaluated and the visibilities are spread
+   into the tile buffer in precision T, the buffer is added to the grid in
+   precision Tacc. */
+template<size_t supp, bool wgrid, typename T, typename Tacc=T> class HelperX2g2
   {
   public:
     static constexpr size_t vlen = native_simd<T>::size();
     static constexpr size_t nvec = (supp+vlen-1)/vlen;
+    /*! Number of visibilities whose kernels are evaluated together
+        by prepBatch() */
+    static constexpr size_t nbatch =
+      TemplateKernel<supp, T>::prefer_batch ? vlen : 1;
 
   private:
-    static constexpr int nsafe = (supp+1)/2;
-    static constexpr int su = 2*nsafe+(1<<logsquare);
-    static constexpr int sv = 2*nsafe+(1<<logsquare);
-    static constexpr int svvec = ((sv+vlen-1)/vlen)*vlen;
-    static constexpr double xsupp=2./supp;
-
-    const GridderConfig<T> &gconf;
+    const GridderConfig<Tacc> &gconf;
     TemplateKernel<supp, T> krn;
-    mav<complex<T>,2> &grid;
-    int nu, nv;
-    int iu0, iv0; // start index of the current visibility
-    int bu0, bv0; // start index of the current buffer
-
-    mav<T,2> bufr, bufi;
-    T *px0r, *px0i;
+    SpreadingBuffer<T, Tacc, 2, supp, logsquare> tbuf;
     double w0, xdw;
-    vector<std::mutex> &locks;
-
-    DUCC0_NOINLINE void dump()
-      {
-      int nu = int(gconf.Nu());
-      int nv = int(gconf.Nv());
-      if (bu0<-nsafe) return; // nothing written into buffer yet
-
-      int idxu = (bu0+nu)%nu;
-      int idxv0 = (bv0+nv)%nv;
-      for (int iu=0; iu<su; ++iu)
-        {
-        int idxv = idxv0;
-        {
-        std::lock_guard<std::mutex> lock(locks[idxu]);
-        for (int iv=0; iv<sv; ++iv)
-          {
-          grid.v(idxu,idxv) += complex<T>(bufr(iu,iv), bufi(iu,iv));
-          bufr.v(iu,iv) = bufi.v(iu,iv) = 0;
-          if (++idxv>=nv) idxv=0;
-          }
-        }
-        if (++idxu>=nu) idxu=0;
-        }
-      }
 
   public:
     T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
@@ -585,88 +1036,97 @@ template<size_t supp, bool wgrid, typename T> class HelperX2g2
       };
     kbuf buf;
 
-    HelperX2g2(const GridderConfig<T> &gconf_, mav<complex<T>,2> &grid_,
-      vector<std::mutex> &locks_, double w0_=-1, double dw_=-1)
-      : gconf(gconf_), krn(*gconf.krn), grid(grid_),
-        iu0(-1000000), iv0(-1000000),
-        bu0(-1000000), bv0(-1000000),
-        bufr({size_t(su),size_t(svvec)}),
-        bufi({size_t(su),size_t(svvec)}),
-        px0r(bufr.vdata()), px0i(bufi.vdata()),
+  private:
+    int biu0[nbatch], biv0[nbatch]; // start indices of the current batch
+    union {
+      T scalar[2*supp*vlen];
+      native_simd<T> simd[2*supp];
+      } kbatch; // kernel values of the current batch, transposed
+
+  public:
+
+    HelperX2g2(const GridderConfig<Tacc> &gconf_, mav<complex<Tacc>,2> &grid_,
+      double w0_=-1, double dw_=-1)
+      : gconf(gconf_), krn(*gconf.krn), tbuf(grid_),
         w0(w0_),
-        xdw(T(1)/dw_),
-        locks(locks_)
-      { checkShape(grid.shape(), {gconf.Nu(),gconf.Nv()}); }
-    ~HelperX2g2() { dump(); }
+        xdw(T(1)/dw_)
+      {
+      checkShape(grid_.shape(), {gconf.Nu(),gconf.Nv()});
+      for (auto &v: buf.simd) v=0;
+      }
 
-    constexpr int lineJump() const { return svvec; }
-    [[gnu::always_inline]] [[gnu::hot]] void prep(const UVW &in)
+    /*! Adds the buffer contents to the grid while holding \a lock and
+        resets the buffer. */
+    void flush(std::mutex &lock)
+      { tbuf.flush(lock); }
+
+    constexpr int lineJump() const { return decltype(tbuf)::lineJump(); }
+
+    /*! Evaluates the kernel for the visibilities at \a in[0..n), which are
+        then processed one by one after calling prep(0), ..., prep(n-1).
+        n must not exceed nbatch. */
+    [[gnu::always_inline]] [[gnu::hot]] void prepBatch(const UVW *in, size_t n)
       {
-      double u, v;
-      auto iu0old = iu0;
-      auto iv0old = iv0;
-      gconf.getpix(in.u, in.v, u, v, iu0, iv0);
-      T x0 = (iu0-T(u))*2+(supp-1);
-      T y0 = (iv0-T(v))*2+(supp-1);
-      if constexpr(wgrid)
-        krn.eval2s(x0, y0, T(xdw*(w0-in.w)), &buf.simd[0]);
+      if constexpr(nbatch==1)
+        {
+        double u, v;
+        gconf.getpix(in[0].u, in[0].v, u, v, biu0[0], biv0[0]);
+        T x0 = (biu0[0]-T(u))*2+(supp-1);
+        T y0 = (biv0[0]-T(v))*2+(supp-1);
+        if constexpr(wgrid)
+          krn.eval2s(x0, y0, T(xdw*(w0-in[0].w)), &buf.simd[0]);
+        else
+          krn.eval2(x0, y0, &buf.simd[0]);
+        }
       else
-        krn.eval2(x0, y0, &buf.simd[0]);
-      if ((iu0==iu0old) && (iv0==iv0old)) return;
-      if ((iu0<bu0) || (iv0<bv0) || (iu0+int(supp)>bu0+su) || (iv0+int(supp)>bv0+sv))
         {
-        dump();
-        bu0=((((iu0+nsafe)>>logsquare)<<logsquare))-nsafe;
-        bv0=((((iv0+nsafe)>>logsquare)<<logsquare))-nsafe;
+        native_simd<T> x0(0), y0(0), z0(0);
+        for (size_t b=0; b<n; ++b)
+          {
+          double u, v;
+          gconf.getpix(in[b].u, in[b].v, u, v, biu0[b], biv0[b]);
+          x0[b] = (biu0[b]-T(u))*2+(supp-1);
+          y0[b] = (biv0[b]-T(v))*2+(supp-1);
+          if constexpr(wgrid)
+            z0[b] = T(xdw*(w0-in[b].w));
+          }
+        if constexpr(wgrid)
+          krn.eval2s_batch(x0, y0, z0, &kbatch.simd[0]);
+        else
+          krn.eval2_batch(x0, y0, &kbatch.simd[0]);
         }
-      auto ofs = (iu0-bu0)*svvec + iv0-bv0;
-      p0r = px0r+ofs;
-      p0i = px0i+ofs;
+      }
+    [[gnu::always_inline]] [[gnu::hot]] void prep(size_t b)
+      {
+      if constexpr(nbatch>1)
+        for (size_t i=0; i<supp; ++i)
+          {
+          buf.scalar[i] = kbatch.scalar[i*vlen+b];
+          buf.scalar[nvec*vlen+i] = kbatch.scalar[(supp+i)*vlen+b];
+          }
+      tbuf.prep({biu0[b], biv0[b]});
+      p0r = tbuf.p0r;
+      p0i = tbuf.p0i;
       }
   };
 
-template<size_t supp, bool wgrid, typename T> class HelperG2x2
+// degridding counterpart of HelperX2g2
+template<size_t supp, bool wgrid, typename T, typename Tacc=T> class HelperG2x2
   {
   public:
     static constexpr size_t vlen = native_simd<T>::size();
     static constexpr size_t nvec = (supp+vlen-1)/vlen;
+    /*! Number of visibilities whose kernels are evaluated together
+        by prepBatch() */
+    static constexpr size_t nbatch =
+      TemplateKernel<supp, T>::prefer_batch ? vlen : 1;
 
   private:
-    static constexpr int nsafe = (supp+1)/2;
-    static constexpr int su = 2*nsafe+(1<<logsquare);
-    static constexpr int sv = 2*nsafe+(1<<logsquare);
-    static constexpr int svvec = ((sv+vlen-1)/vlen)*vlen;
-    static constexpr double xsupp=2./supp;
-
-    const GridderConfig<T> &gconf;
+    const GridderConfig<Tacc> &gconf;
     TemplateKernel<supp, T> krn;
-    const mav<complex<T>,2> &grid;
-    int iu0, iv0; // start index of the current visibility
-    int bu0, bv0; // start index of the current buffer
-
-    mav<T,2> bufr, bufi;
-    const T *px0r, *px0i;
+    InterpolationBuffer<T, Tacc, 2, supp, logsquare> tbuf;
     double w0, xdw;
 
-    DUCC0_NOINLINE void load()
-      {
-      int nu = int(gconf.Nu());
-      int nv = int(gconf.Nv());
-      int idxu = (bu0+nu)%nu;
-      int idxv0 = (bv0+nv)%nv;
-      for (int iu=0; iu<su; ++iu)
-        {
-        int idxv = idxv0;
-        for (int iv=0; iv<sv; ++iv)
-          {
-          bufr.v(iu,iv) = grid(idxu, idxv).real();
-          bufi.v(iu,iv) = grid(idxu, idxv).imag();
-          if (++idxv>=nv) idxv=0;
-          }
-        if (++idxu>=nu) idxu=0;
-        }
-      }
-
   public:
     const T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
     union kbuf {
@@ -675,41 +1135,73 @@ template<size_t supp, bool wgrid, typename T> class HelperG2x2
       };
     kbuf buf;
 
-    HelperG2x2(const GridderConfig<T> &gconf_, const mav<complex<T>,2> &grid_,
+  private:
+    int biu0[nbatch], biv0[nbatch]; // start indices of the current batch
+    union {
+      T scalar[2*supp*vlen];
+      native_simd<T> simd[2*supp];
+      } kbatch; // kernel values of the current batch, transposed
+
+  public:
+
+    HelperG2x2(const GridderConfig<Tacc> &gconf_,
+      const mav<complex<Tacc>,2> &grid_,
       double w0_=-1, double dw_=-1)
-      : gconf(gconf_), krn(*gconf.krn), grid(grid_),
-        iu0(-1000000), iv0(-1000000),
-        bu0(-1000000), bv0(-1000000),
-        bufr({size_t(su),size_t(svvec)}),
-        bufi({size_t(su),size_t(svvec)}),
-        px0r(bufr.data()), px0i(bufi.data()),
+      : gconf(gconf_), krn(*gconf.krn), tbuf(grid_),
         w0(w0_),
         xdw(T(1)/dw_)
-      { checkShape(grid.shape(), {gconf.Nu(),gconf.Nv()}); }
+      {
+      checkShape(grid_.shape(), {gconf.Nu(),gconf.Nv()});
+      for (auto &v: buf.simd) v=0;
+      }
+
+    constexpr int lineJump() const { return decltype(tbuf)::lineJump(); }
 
-    constexpr int lineJump() const { return svvec; }
-    [[gnu::always_inline]] [[gnu::hot]] void prep(const UVW &in)
+    /*! Evaluates the kernel for the visibilities at \a in[0..n), which are
+        then processed one by one after calling prep(0), ..., prep(n-1).
+        n must not exceed nbatch. */
+    [[gnu::always_inline]] [[gnu::hot]] void prepBatch(const UVW *in, size_t n)
       {
-      double u, v;
-      auto iu0old = iu0;
-      auto iv0old = iv0;
-      gconf.getpix(in.u, in.v, u, v, iu0, iv0);
-      T x0 = (iu0-T(u))*2+(supp-1);
-      T y0 = (iv0-T(v))*2+(supp-1);
-      if constexpr(wgrid)
-        krn.eval2s(x0, y0, T(xdw*(w0-in.w)), &buf.simd[0]);
+      if constexpr(nbatch==1)
+        {
+        double u, v;
+        gconf.getpix(in[0].u, in[0].v, u, v, biu0[0], biv0[0]);
+        T x0 = (biu0[0]-T(u))*2+(supp-1);
+        T y0 = (biv0[0]-T(v))*2+(supp-1);
+        if constexpr(wgrid)
+          krn.eval2s(x0, y0, T(xdw*(w0-in[0].w)), &buf.simd[0]);
+        else
+          krn.eval2(x0, y0, &buf.simd[0]);
+        }
       else
-        krn.eval2(x0, y0, &buf.simd[0]);
-      if ((iu0==iu0old) && (iv0==iv0old)) return;
-      if ((iu0<bu0) || (iv0<bv0) || (iu0+int(supp)>bu0+su) || (iv0+int(supp)>bv0+sv))
         {
-        bu0=((((iu0+nsafe)>>logsquare)<<logsquare))-nsafe;
-        bv0=((((iv0+nsafe)>>logsquare)<<logsquare))-nsafe;
-        load();
+        native_simd<T> x0(0), y0(0), z0(0);
+        for (size_t b=0; b<n; ++b)
+          {
+          double u, v;
+          gconf.getpix(in[b].u, in[b].v, u, v, biu0[b], biv0[b]);
+          x0[b] = (biu0[b]-T(u))*2+(supp-1);
+          y0[b] = (biv0[b]-T(v))*2+(supp-1);
+          if constexpr(wgrid)
+            z0[b] = T(xdw*(w0-in[b].w));
+          }
+        if constexpr(wgrid)
+          krn.eval2s_batch(x0, y0, z0, &kbatch.simd[0]);
+        else
+          krn.eval2_batch(x0, y0, &kbatch.simd[0]);
         }
-      auto ofs = (iu0-bu0)*svvec + iv0-bv0;
-      p0r = px0r+ofs;
-      p0i = px0i+ofs;
+      }
+    [[gnu::always_inline]] [[gnu::hot]] void prep(size_t b)
+      {
+      if constexpr(nbatch>1)
+        for (size_t i=0; i<supp; ++i)
+          {
+          buf.scalar[i] = kbatch.scalar[i*vlen+b];
+          buf.scalar[nvec*vlen+i] = kbatch.scalar[(supp+i)*vlen+b];
+          }
+      tbuf.prep({biu0[b], biv0[b]});
+      p0r = tbuf.p0r;
+      p0i = tbuf.p0i;
       }
   };
 
@@ -720,6 +1212,8 @@ template<typename T, typename Serv> class SubServ
     mav<idx_t,1> subidx;
 
   public:
+    using Tcalc = T;
+
     SubServ(Serv &orig, const mav<idx_t,1> &subidx_)
       : srv(orig), subidx(subidx_){}
     size_t Nvis() const { return subidx.size(); }
@@ -746,6 +1240,7 @@ template<typename T, typename T2> class MsServ
     bool have_wgt;
 
   public:
+    using Tcalc = T;
     using Tsub = SubServ<T, MsServ>;
 
     MsServ(const Baselines &baselines_,
@@ -785,62 +1280,255 @@ template<typename T, typename T2> MsServ<T, T2> makeMsServ
    const mav<idx_t,1> &idx, T2 &ms, const mav<T,2> &wgt)
   { return MsServ<T, T2>(baselines, idx, ms, wgt); }
 
-
-template<size_t SUPP, bool wgrid, typename T, typename Serv> [[gnu::hot]] void x2grid_c_helper
-  (const GridderConfig<T> &gconf, Serv &srv, mav<complex<T>,2> &grid,
-  double w0=-1, double dw=-1)
+/* Like MsServ, but serves the sub-samples of smeared visibilities (see
+   Smearing). The entries of idx hold the visibility index shifted by
+   smear.Subshift(), combined with the sub-sample number. Sub-samples of the
+   same visibility may be degridded concurrently, so their values are
+   collected in a buffer and only added to ms by finish(). */
+template<typename T, typename T2> class SmearServ
   {
-  constexpr size_t vlen=native_simd<T>::size();
-  constexpr size_t NVEC((SUPP+vlen-1)/vlen);
-  size_t nthreads = gconf.Nthreads();
+  private:
+    const Baselines &baselines;
+    const Smearing &smear;
+    mav<idx_t,1> idx;
+    T2 ms;
+    mav<T,2> wgt;
+    size_t nvis;
+    bool have_wgt;
+    idx_t subshift, submask;
+    vector<complex<T>> vbuf;
 
-  vector<std::mutex> locks(gconf.Nu());
-  size_t np = srv.Nvis();
-  execGuided(np, nthreads, 100, 0.2, [&](Scheduler &sched)
-    {
-    HelperX2g2<SUPP,wgrid,T> hlp(gconf, grid, locks, w0, dw);
-    constexpr int jump = hlp.lineJump();
-    const T * DUCC0_RESTRICT ku = hlp.buf.scalar;
-    const auto * DUCC0_RESTRICT kv = hlp.buf.simd+NVEC;
+    RowChan getRowChan(size_t i) const
+      { return baselines.getRowChan(idx(i)>>subshift); }
 
-    while (auto rng=sched.getNext()) for(auto ipart=rng.lo; ipart<rng.hi; ++ipart)
+  public:
+    using Tcalc = T;
+    using Tsub = SubServ<T, SmearServ>;
+
+    SmearServ(const Baselines &baselines_, const Smearing &smear_,
+      const mav<idx_t,1> &idx_, T2 ms_, const mav<T,2> &wgt_)
+      : baselines(baselines_), smear(smear_), idx(idx_), ms(ms_), wgt(wgt_),
+        nvis(idx.shape(0)), have_wgt(wgt.size()!=0),
+        subshift(smear.Subshift()), submask(smear.Submask())
       {
-      UVW coord = srv.getCoord(ipart);
-      auto flip = coord.FixW();
-      hlp.prep(coord);
-      auto * DUCC0_RESTRICT ptrr = hlp.p0r;
-      auto * DUCC0_RESTRICT ptri = hlp.p0i;
-      auto v(srv.getVis(ipart));
-
-      if (flip) v=conj(v);
-      native_simd<T> vr(v.real()), vi(v.imag());
-      for (size_t cu=0; cu<SUPP; ++cu)
-        {
-        native_simd<T> tmpr=vr*ku[cu], tmpi=vi*ku[cu];
-        for (size_t cv=0; cv<NVEC; ++cv)
-          {
-          auto tr = native_simd<T>::loadu(ptrr+cv*hlp.vlen);
-          tr += tmpr*kv[cv];
-          tr.storeu(ptrr+cv*hlp.vlen);
-          auto ti = native_simd<T>::loadu(ptri+cv*hlp.vlen);
-          ti += tmpi*kv[cv];
-          ti.storeu(ptri+cv*hlp.vlen);
-          }
-        ptrr+=jump;
-        ptri+=jump;
-        }
+      checkShape(ms.shape(), {baselines.Nrows(), baselines.Nchannels()});
+      if (have_wgt) checkShape(wgt.shape(), ms.shape());
+      if constexpr (!is_const<T2>::value)
+        vbuf.resize(nvis, complex<T>(0));
       }
-    });
-  }
-
-template<bool wgrid, typename T, typename Serv> void x2grid_c
-  (const GridderConfig<T> &gconf, Serv &srv, mav<complex<T>,2> &grid,
-  double w0=-1, double dw=-1)
-  {
-  gconf.timers.push("gridding proper");
+    Tsub getSubserv(const mav<idx_t,1> &subidx)
+      { return Tsub(*this, subidx); }
+    size_t Nvis() const { return nvis; }
+    const Baselines &getBaselines() const { return baselines; }
+    UVW getCoord(size_t i) const
+      { return smear.coord(baselines, getRowChan(i), idx(i)&submask); }
+    complex<T> getVis(size_t i) const
+      {
+      auto rc = getRowChan(i);
+      T fct = T(smear.weight(rc.row, idx(i)&submask));
+      if (have_wgt) fct *= wgt(rc.row, rc.chan);
+      return ms(rc.row, rc.chan)*fct;
+      }
+    idx_t getIdx(size_t i) const { return idx(i); }
+    void setVis (size_t i, const complex<T> &v)
+      { vbuf[i] = v; }
+    void addVis (size_t i, const complex<T> &v)
+      { vbuf[i] += v; }
+    // adds the weighted sub-samples to their visibilities
+    void finish()
+      {
+      for (size_t i=0; i<nvis; ++i)
+        {
+        auto rc = getRowChan(i);
+        T fct = T(smear.weight(rc.row, idx(i)&submask));
+        if (have_wgt) fct *= wgt(rc.row, rc.chan);
+        ms.v(rc.row, rc.chan) += vbuf[i]*fct;
+        }
+      }
+  };
+
+
+/* Scheduling of the gridding work
+
+   The visibilities are cut into runs of consecutive entries which fall into
+   the same tile of the grid (i.e. the same buffer position of HelperX2g2).
+   The buffer of a tile with indices (bu, bv) covers the grid rows
+   [16*bu-nsafe, 16*bu+16+nsafe) and columns [16*bv-nsafe, 16*bv+16+nsafe),
+   modulo nu and nv. The u and v stripes are colored such that overlapping
+   stripes have different colors, and all runs whose tiles share a
+   (u color, v color) combination form one phase. Within a phase, buffers of
+   different tiles never overlap, so the phases can be processed one after the
+   other without any locking on the grid itself. Only several runs of the same
+   tile in one phase can collide; their buffers are flushed under a lock per
+   u stripe, which is taken once per run. */
+struct X2gRun
+  {
+  size_t lo, hi;
+  uint32_t bu;
+  };
+
+// greedy coloring of the n stripes of length len starting at multiples of
+// (1<<logsquare) on a periodic axis of length ntot
+inline vector<size_t> color_stripes(size_t n, size_t len, size_t ntot,
+  size_t &ncolors)
+  {
+  constexpr size_t side=1<<logsquare;
+  auto conflict = [&](size_t a, size_t b)
+    {
+    size_t d = (side*b+ntot-(side*a)%ntot)%ntot;
+    return (d<len) || (ntot-d<len);
+    };
+  // stripes whose indices differ by more than this never overlap
+  size_t dmax = min(n, len/side+2);
+  vector<size_t> col(n, ~size_t(0));
+  ncolors=0;
+  vector<bool> used;
+  for (size_t i=0; i<n; ++i)
+    {
+    used.assign(ncolors+1, false);
+    for (size_t d=1; d<=dmax; ++d)
+      for (size_t j : {(i+d)%n, (i+n-d)%n})
+        if ((j!=i) && (col[j]!=~size_t(0)) && conflict(i,j))
+          used[col[j]] = true;
+    size_t c=0;
+    while (used[c]) ++c;
+    col[i] = c;
+    ncolors = max(ncolors, c+1);
+    }
+  return col;
+  }
+
+template<typename T, typename Serv> vector<vector<X2gRun>> x2grid_schedule
+  (const GridderConfig<T> &gconf, const Serv &srv, size_t &nbu)
+  {
+  constexpr int side=1<<logsquare;
+  size_t nu=gconf.Nu(), nv=gconf.Nv(), nsafe=gconf.Nsafe(),
+         nthreads=gconf.Nthreads();
+  nbu = ntiles<logsquare>(nu);
+  size_t nbv = ntiles<logsquare>(nv);
+  size_t ncu, ncv;
+  auto colu = color_stripes(nbu, side+2*nsafe, nu, ncu);
+  auto colv = color_stripes(nbv, side+2*nsafe, nv, ncv);
+
+  size_t np = srv.Nvis();
+  // a single thread can simply process everything in one go
+  if (nthreads==1) return {{X2gRun{0, np, 0}}};
+  size_t maxrun = max<size_t>(1000, np/(20*nthreads));
+  vector<vector<X2gRun>> runs(nthreads);
+  vector<vector<size_t>> color(nthreads);
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid = sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, np);
+    auto &myruns(runs[tid]);
+    auto &mycolor(color[tid]);
+    size_t tile0=~size_t(0), start=lo;
+    for (size_t ipart=lo; ipart<=hi; ++ipart)
+      {
+      size_t tile=~size_t(0);
+      if (ipart<hi)
+        {
+        UVW coord = srv.getCoord(ipart);
+        coord.FixW();
+        double u, v;
+        int iu0, iv0;
+        gconf.getpix(coord.u, coord.v, u, v, iu0, iv0);
+        tile = tile_index<logsquare>(iu0, int(nsafe))*nbv
+             + tile_index<logsquare>(iv0, int(nsafe));
+        }
+      if ((tile!=tile0) || (ipart-start>=maxrun))
+        {
+        if (ipart>start)
+          {
+          myruns.push_back({start, ipart, uint32_t(tile0/nbv)});
+          mycolor.push_back(colu[tile0/nbv]*ncv + colv[tile0%nbv]);
+          }
+        start = ipart;
+        tile0 = tile;
+        }
+      }
+    });
+
+  vector<vector<X2gRun>> res(ncu*ncv);
+  for (size_t t=0; t<nthreads; ++t)
+    for (size_t i=0; i<runs[t].size(); ++i)
+      res[color[t][i]].push_back(runs[t][i]);
+  return res;
+  }
+
+template<size_t SUPP, bool wgrid, typename T, typename Serv> [[gnu::hot]] void x2grid_c_helper
+  (const GridderConfig<T> &gconf, Serv &srv, mav<complex<T>,2> &grid,
+  double w0=-1, double dw=-1)
+  {
+  using Tcalc = typename Serv::Tcalc;
+  constexpr size_t vlen=native_simd<Tcalc>::size();
+  constexpr size_t NVEC((SUPP+vlen-1)/vlen);
+  size_t nthreads = gconf.Nthreads();
+
+  size_t nbu;
+  auto phases = x2grid_schedule(gconf, srv, nbu);
+  vector<std::mutex> locks(nbu);
+  for (const auto &phase: phases)
+    execDynamic(phase.size(), nthreads, 1, [&](Scheduler &sched)
+      {
+      HelperX2g2<SUPP,wgrid,Tcalc,T> hlp(gconf, grid, w0, dw);
+      constexpr int jump = hlp.lineJump();
+      const Tcalc * DUCC0_RESTRICT ku = hlp.buf.scalar;
+      const auto * DUCC0_RESTRICT kv = hlp.buf.simd+NVEC;
+
+      while (auto rng=sched.getNext()) for(auto irun=rng.lo; irun<rng.hi; ++irun)
+        {
+        const auto &run(phase[irun]);
+        for (auto ipart0=run.lo; ipart0<run.hi; ipart0+=hlp.nbatch)
+          {
+          size_t nb = min<size_t>(hlp.nbatch, run.hi-ipart0);
+          array<UVW, decltype(hlp)::nbatch> coord;
+          array<bool, decltype(hlp)::nbatch> flip{};
+          for (size_t b=0; b<nb; ++b)
+            {
+            coord[b] = srv.getCoord(ipart0+b);
+            flip[b] = coord[b].FixW();
+            }
+          hlp.prepBatch(coord.data(), nb);
+          for (size_t b=0; b<nb; ++b)
+            {
+            hlp.prep(b);
+            auto * DUCC0_RESTRICT ptrr = hlp.p0r;
+            auto * DUCC0_RESTRICT ptri = hlp.p0i;
+            auto v(srv.getVis(ipart0+b));
+
+            if (flip[b]) v=conj(v);
+            native_simd<Tcalc> vr(v.real()), vi(v.imag());
+            for (size_t cu=0; cu<SUPP; ++cu)
+              {
+              native_simd<Tcalc> tmpr=vr*ku[cu], tmpi=vi*ku[cu];
+              for (size_t cv=0; cv<NVEC; ++cv)
+                {
+                auto tr = native_simd<Tcalc>::loadu(ptrr+cv*hlp.vlen);
+                tr += tmpr*kv[cv];
+                tr.storeu(ptrr+cv*hlp.vlen);
+                auto ti = native_simd<Tcalc>::loadu(ptri+cv*hlp.vlen);
+                ti += tmpi*kv[cv];
+                ti.storeu(ptri+cv*hlp.vlen);
+                }
+              ptrr+=jump;
+              ptri+=jump;
+              }
+            }
+          }
+        hlp.flush(locks[run.bu]);
+        }
+      });
+  }
+
+template<bool wgrid, typename T, typename Serv> void x2grid_c
+  (const GridderConfig<T> &gconf, Serv &srv, mav<complex<T>,2> &grid,
+  double w0=-1, double dw=-1)
+  {
+  gconf.timers.push("gridding proper");
   checkShape(grid.shape(), {gconf.Nu(), gconf.Nv()});
 
-  if constexpr (is_same<T, float>::value)
+  if constexpr (is_same<typename Serv::Tcalc, float>::value)
     switch(gconf.Supp())
       {
       case  4: x2grid_c_helper< 4, wgrid>(gconf, srv, grid, w0, dw); break;
@@ -875,7 +1563,8 @@ template<size_t SUPP, bool wgrid, typename T, typename Serv> [[gnu::hot]] void g
   (const GridderConfig<T> &gconf, const mav<complex<T>,2> &grid,
   Serv &srv, double w0=-1, double dw=-1)
   {
-  constexpr size_t vlen=native_simd<T>::size();
+  using Tcalc = typename Serv::Tcalc;
+  constexpr size_t vlen=native_simd<Tcalc>::size();
   constexpr size_t NVEC((SUPP+vlen-1)/vlen);
   size_t nthreads = gconf.Nthreads();
 
@@ -883,36 +1572,47 @@ template<size_t SUPP, bool wgrid, typename T, typename Serv> [[gnu::hot]] void g
   size_t np = srv.Nvis();
   execGuided(np, nthreads, 1000, 0.5, [&](Scheduler &sched)
     {
-    HelperG2x2<SUPP,wgrid,T> hlp(gconf, grid, w0, dw);
+    HelperG2x2<SUPP,wgrid,Tcalc,T> hlp(gconf, grid, w0, dw);
     constexpr int jump = hlp.lineJump();
-    const T * DUCC0_RESTRICT ku = hlp.buf.scalar;
+    const Tcalc * DUCC0_RESTRICT ku = hlp.buf.scalar;
     const auto * DUCC0_RESTRICT kv = hlp.buf.simd+NVEC;
 
-    while (auto rng=sched.getNext()) for(auto ipart=rng.lo; ipart<rng.hi; ++ipart)
-      {
-      UVW coord = srv.getCoord(ipart);
-      auto flip = coord.FixW();
-      hlp.prep(coord);
-      native_simd<T> rr=0, ri=0;
-      const auto * DUCC0_RESTRICT ptrr = hlp.p0r;
-      const auto * DUCC0_RESTRICT ptri = hlp.p0i;
-      for (size_t cu=0; cu<SUPP; ++cu)
+    while (auto rng=sched.getNext())
+      for(auto ipart0=rng.lo; ipart0<rng.hi; ipart0+=hlp.nbatch)
         {
-        native_simd<T> tmpr(0), tmpi(0);
-        for (size_t cv=0; cv<NVEC; ++cv)
+        size_t nb = min<size_t>(hlp.nbatch, rng.hi-ipart0);
+        array<UVW, decltype(hlp)::nbatch> coord;
+        array<bool, decltype(hlp)::nbatch> flip{};
+        for (size_t b=0; b<nb; ++b)
+          {
+          coord[b] = srv.getCoord(ipart0+b);
+          flip[b] = coord[b].FixW();
+          }
+        hlp.prepBatch(coord.data(), nb);
+        for (size_t b=0; b<nb; ++b)
           {
-          tmpr += kv[cv]*native_simd<T>::loadu(ptrr+hlp.vlen*cv);
-          tmpi += kv[cv]*native_simd<T>::loadu(ptri+hlp.vlen*cv);
+          hlp.prep(b);
+          native_simd<Tcalc> rr=0, ri=0;
+          const auto * DUCC0_RESTRICT ptrr = hlp.p0r;
+          const auto * DUCC0_RESTRICT ptri = hlp.p0i;
+          for (size_t cu=0; cu<SUPP; ++cu)
+            {
+            native_simd<Tcalc> tmpr(0), tmpi(0);
+            for (size_t cv=0; cv<NVEC; ++cv)
+              {
+              tmpr += kv[cv]*native_simd<Tcalc>::loadu(ptrr+hlp.vlen*cv);
+              tmpi += kv[cv]*native_simd<Tcalc>::loadu(ptri+hlp.vlen*cv);
+              }
+            rr += ku[cu]*tmpr;
+            ri += ku[cu]*tmpi;
+            ptrr += jump;
+            ptri += jump;
+            }
+          auto r = complex<Tcalc>(reduce(rr, std::plus<>()), reduce(ri, std::plus<>()));
+          if (flip[b]) r=conj(r);
+          srv.addVis(ipart0+b, r);
           }
-        rr += ku[cu]*tmpr;
-        ri += ku[cu]*tmpi;
-        ptrr += jump;
-        ptri += jump;
         }
-      auto r = complex<T>(reduce(rr, std::plus<>()), reduce(ri, std::plus<>()));
-      if (flip) r=conj(r);
-      srv.addVis(ipart, r);
-      }
     });
   }
 
@@ -923,7 +1623,7 @@ template<bool wgrid, typename T, typename Serv> void grid2x_c
   gconf.timers.push("degridding proper");
   checkShape(grid.shape(), {gconf.Nu(), gconf.Nv()});
 
-  if constexpr (is_same<T, float>::value)
+  if constexpr (is_same<typename Serv::Tcalc, float>::value)
     switch(gconf.Supp())
       {
       case  4: grid2x_c_helper< 4, wgrid>(gconf, grid, srv, w0, dw); break;
@@ -965,8 +1665,8 @@ template<typename T> void apply_global_corrections(const GridderConfig<T> &gconf
   auto psy=gconf.Pixsize_y();
   double x0 = -0.5*nx_dirty*psx,
          y0 = -0.5*ny_dirty*psy;
-  auto cfu = gconf.krn->corfunc(nx_dirty/2+1, 1./gconf.Nu(), nthreads);
-  auto cfv = gconf.krn->corfunc(ny_dirty/2+1, 1./gconf.Nv(), nthreads);
+  auto cfu = correction_factors(*gconf.krn, nx_dirty, gconf.Nu(), false, nthreads),
+       cfv = correction_factors(*gconf.krn, ny_dirty, gconf.Nv(), false, nthreads);
   execStatic(nx_dirty/2+1, nthreads, 0, [&](Scheduler &sched)
     {
     while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
@@ -996,7 +1696,7 @@ template<typename T> void apply_global_corrections(const GridderConfig<T> &gconf
             fct = T(gconf.krn->corfunc(nm1*dw));
             }
           }
-        fct *= T(cfu[nx_dirty/2-i]*cfv[ny_dirty/2-j]);
+        fct *= T(cfu[i]*cfv[j]);
         size_t i2 = nx_dirty-i, j2 = ny_dirty-j;
         dirty.v(i,j)*=fct;
         if ((i>0)&&(i<i2))
@@ -1013,14 +1713,90 @@ template<typename T> void apply_global_corrections(const GridderConfig<T> &gconf
   gconf.timers.pop();
   }
 
+/* Assignment of the visibilities to w planes: minplane[p] contains the
+   indices of all visibilities whose first contributing plane is p. This only
+   depends on the visibility coordinates, so it can be reused for repeated
+   transforms of the same data set. */
+struct WPlanes
+  {
+  double wmin=0, dw=0;
+  size_t nplanes=0;
+  vector<vector<idx_t>> minplane;
+  };
+
+template<typename T, typename Serv> WPlanes getWPlanes(
+  const GridderConfig<T> &gconf, const Serv &srv, double wmin, double wmax)
+  {
+  WPlanes res;
+  gconf.timers.push("computing minplane");
+  size_t nvis = srv.Nvis(), supp=gconf.Supp(), nthreads=gconf.Nthreads();
+  double x0 = -0.5*gconf.Nxdirty()*gconf.Pixsize_x(),
+         y0 = -0.5*gconf.Nydirty()*gconf.Pixsize_y();
+  double nm1min = sqrt(max(1.-x0*x0-y0*y0,0.))-1.;
+  if (x0*x0+y0*y0>1.)
+    nm1min = -sqrt(abs(1.-x0*x0-y0*y0))-1.;
+  double dw = 0.5/gconf.Ofactor()/abs(nm1min);
+  size_t nplanes = size_t((wmax-wmin)/dw+supp);
+  res.wmin = (wmin+wmax)*0.5 - 0.5*(nplanes-1)*dw;
+  res.dw = dw;
+  res.nplanes = nplanes;
+
+  auto &minplane(res.minplane);
+  minplane.resize(nplanes);
+#if 0
+  // extra short, but potentially inefficient version:
+  for (size_t ipart=0; ipart<nvis; ++ipart)
+    {
+    int plane0 = max(0,int(1+(abs(srv.getCoord(ipart).w)-(0.5*supp*dw)-res.wmin)/dw));
+    minplane[plane0].push_back(idx_t(ipart));
+    }
+#else
+  // more efficient: precalculate final vector sizes and avoid reallocations
+  vector<int> p0(nvis);
+  mav<size_t,2> cnt({nthreads, nplanes+16}); // safety distance against false sharing
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid=sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, nvis);
+    for(auto i=lo; i<hi; ++i)
+      {
+      p0[i] = max(0,int(1+(abs(srv.getCoord(i).w)-(0.5*supp*dw)-res.wmin)/dw));
+      ++cnt.v(tid, p0[i]);
+      }
+    });
+
+  for (size_t p=0; p<nplanes; ++p)
+    {
+    size_t offset=0;
+    for (idx_t tid=0; tid<nthreads; ++tid)
+      {
+      auto tmp = cnt(tid, p);
+      cnt.v(tid, p) = offset;
+      offset += tmp;
+      }
+    minplane[p].resize(offset);
+    }
+
+  // fill minplane
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid=sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, nvis);
+    for(auto i=lo; i<hi; ++i)
+      minplane[p0[i]][cnt.v(tid,p0[i])++]=idx_t(i);
+    });
+#endif
+  gconf.timers.pop();
+  return res;
+  }
+
 template<typename T, typename Serv> class WgridHelper
   {
   private:
     GridderConfig<T> &gconf;
     Serv &srv;
-    double wmin, dw;
-    size_t nplanes, supp, nthreads;
-    vector<vector<idx_t>> minplane;
+    const WPlanes &planes;
+    size_t supp, nthreads;
     size_t verbosity;
 
     int curplane;
@@ -1092,81 +1868,27 @@ template<typename T, typename Serv> class WgridHelper
       }
 
   public:
-    WgridHelper(GridderConfig<T> &gconf_, Serv &srv_, double wmin_, double wmax, size_t verbosity_)
-      : gconf(gconf_), srv(srv_), wmin(wmin_), supp(gconf.Supp()), nthreads(gconf.Nthreads()),
-        verbosity(verbosity_), curplane(-1)
-      {
-      gconf.timers.push("computing minplane");
-      size_t nvis = srv.Nvis();
-      double x0 = -0.5*gconf.Nxdirty()*gconf.Pixsize_x(),
-             y0 = -0.5*gconf.Nydirty()*gconf.Pixsize_y();
-      double nm1min = sqrt(max(1.-x0*x0-y0*y0,0.))-1.;
-      if (x0*x0+y0*y0>1.)
-        nm1min = -sqrt(abs(1.-x0*x0-y0*y0))-1.;
-      dw = 0.5/gconf.Ofactor()/abs(nm1min);
-      nplanes = size_t((wmax-wmin)/dw+supp);
-      wmin = (wmin+wmax)*0.5 - 0.5*(nplanes-1)*dw;
-
-      minplane.resize(nplanes);
-#if 0
-      // extra short, but potentially inefficient version:
-      for (size_t ipart=0; ipart<nvis; ++ipart)
-        {
-        int plane0 = max(0,int(1+(abs(srv.getCoord(ipart).w)-(0.5*supp*dw)-wmin)/dw));
-        minplane[plane0].push_back(idx_t(ipart));
-        }
-#else
-      // more efficient: precalculate final vector sizes and avoid reallocations
-      vector<int> p0(nvis);
-      mav<size_t,2> cnt({nthreads, nplanes+16}); // safety distance against false sharing
-      execParallel(nthreads, [&](Scheduler &sched)
-        {
-        auto tid=sched.thread_num();
-        auto [lo, hi] = calcShare(nthreads, tid, nvis);
-        for(auto i=lo; i<hi; ++i)
-          {
-          p0[i] = max(0,int(1+(abs(srv.getCoord(i).w)-(0.5*supp*dw)-wmin)/dw));
-          ++cnt.v(tid, p0[i]);
-          }
-        });
-
-      for (size_t p=0; p<nplanes; ++p)
-        {
-        size_t offset=0;
-        for (idx_t tid=0; tid<nthreads; ++tid)
-          {
-          auto tmp = cnt(tid, p);
-          cnt.v(tid, p) = offset;
-          offset += tmp;
-          }
-        minplane[p].resize(offset);
-        }
-
-      // fill minplane
-      execParallel(nthreads, [&](Scheduler &sched)
-        {
-        auto tid=sched.thread_num();
-        auto [lo, hi] = calcShare(nthreads, tid, nvis);
-        for(auto i=lo; i<hi; ++i)
-          minplane[p0[i]][cnt.v(tid,p0[i])++]=idx_t(i);
-        });
-#endif
-      gconf.timers.pop();
-      }
+    WgridHelper(GridderConfig<T> &gconf_, Serv &srv_, const WPlanes &planes_,
+      size_t verbosity_)
+      : gconf(gconf_), srv(srv_), planes(planes_), supp(gconf.Supp()),
+        nthreads(gconf.Nthreads()), verbosity(verbosity_), curplane(-1)
+      {}
 
     typename Serv::Tsub getSubserv() const
       {
       auto subidx2 = mav<idx_t, 1>(subidx.data(), {subidx.size()});
       return srv.getSubserv(subidx2);
       }
-    double W() const { return wmin+curplane*dw; }
+    double W() const { return planes.wmin+curplane*planes.dw; }
     size_t Nvis() const { return subidx.size(); }
-    double DW() const { return dw; }
-    size_t Nplanes() const { return nplanes; }
+    const vector<idx_t> &Subidx() const { return subidx; }
+    double DW() const { return planes.dw; }
+    size_t Nplanes() const { return planes.nplanes; }
     bool advance()
       {
-      if (++curplane>=int(nplanes)) return false;
-      update_idx(subidx, minplane[curplane], curplane>=int(supp) ? minplane[curplane-supp] : vector<idx_t>(), nthreads);
+      TraceScope trace("WgridHelper::advance");
+      if (++curplane>=int(planes.nplanes)) return false;
+      update_idx(subidx, planes.minplane[curplane], curplane>=int(supp) ? planes.minplane[curplane-supp] : vector<idx_t>(), nthreads);
       if (verbosity>1)
         cout << "Working on plane " << curplane << " containing " << subidx.size()
              << " visibilities" << endl;
@@ -1200,28 +1922,50 @@ template<typename T> void report(const GridderConfig<T> &gconf, size_t nvis,
 template<typename T, typename Serv> void x2dirty(
   GridderConfig<T> &gconf, Serv &srv, mav<T,2> &dirty,
   bool do_wgridding, double wmin, double wmax, size_t verbosity,
-  bool divide_by_n)
+  bool divide_by_n, const WPlanes *planes=nullptr)
   {
   if (do_wgridding)
     {
-    WgridHelper<T, Serv> hlp(gconf, srv, wmin, wmax, verbosity);
+    WPlanes lplanes;
+    if (!planes)
+      {
+      lplanes = getWPlanes(gconf, srv, wmin, wmax);
+      planes = &lplanes;
+      }
+    WgridHelper<T, Serv> hlp(gconf, srv, *planes, verbosity);
     report(gconf, srv.Nvis(), wmin, wmax, hlp.Nplanes(), true, verbosity);
     double dw = hlp.DW();
     gconf.timers.push("zeroing dirty image");
     dirty.fill(0);
     gconf.timers.poppush("allocating grid");
-    auto grid = mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()});
+    // with more than one grid, batches of w planes are gridded one after the
+    // other, and then FFTed concurrently
+    size_t nbatch = gconf.WPlaneBatch();
+    vector<mav<complex<T>,2>> grids;
+    for (size_t i=0; i<nbatch; ++i)
+      grids.push_back(mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()}, gconf.Nthreads()));
     gconf.timers.pop();
-    while(hlp.advance())  // iterate over w planes
+    bool more=true;
+    while(more)
       {
-      if (hlp.Nvis()==0) continue;
-      gconf.timers.push("zeroing grid");
-      grid.fill(0);
-      gconf.timers.poppush("getSubserv");
-      auto serv = hlp.getSubserv();
-      gconf.timers.pop();
-      x2grid_c<true>(gconf, serv, grid, hlp.W(), dw);
-      gconf.grid2dirty_c_overwrite_wscreen_add(grid, dirty, T(hlp.W()));
+      vector<double> ws;
+      while((ws.size()<nbatch) && (more=hlp.advance()))  // iterate over w planes
+        {
+        if (hlp.Nvis()==0) continue;
+        auto &grid(grids[ws.size()]);
+        gconf.timers.push("zeroing grid");
+        grid.fill(0);
+        gconf.timers.poppush("getSubserv");
+        auto serv = hlp.getSubserv();
+        gconf.timers.pop();
+        x2grid_c<true>(gconf, serv, grid, hlp.W(), dw);
+        ws.push_back(hlp.W());
+        }
+      if (ws.empty()) continue;
+      if (nbatch==1)
+        gconf.grid2dirty_c_overwrite_wscreen_add(grids[0], dirty, T(ws[0]));
+      else
+        gconf.grid2dirty_c_overwrite_wscreen_add(grids, ws, dirty);
       }
     // correct for w gridding etc.
     apply_global_corrections(gconf, dirty, dw, divide_by_n);
@@ -1230,11 +1974,11 @@ template<typename T, typename Serv> void x2dirty(
     {
     report(gconf, srv.Nvis(), wmin, wmax, 0, true, verbosity);
     gconf.timers.push("allocating grid");
-    auto grid = mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()});
+    auto grid = mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()}, gconf.Nthreads());
     gconf.timers.pop();
     x2grid_c<false>(gconf, srv, grid);
     gconf.timers.push("allocating rgrid");
-    auto rgrid = mav<T,2>::build_noncritical(grid.shape());
+    auto rgrid = mav<T,2>::build_noncritical(grid.shape(), gconf.Nthreads());
     gconf.timers.poppush("complex2hartley");
     complex2hartley(grid, rgrid, gconf.Nthreads());
     gconf.timers.pop();
@@ -1245,42 +1989,76 @@ template<typename T, typename Serv> void x2dirty(
 template<typename T, typename Serv> void dirty2x(
   GridderConfig<T> &gconf,  const mav<T,2> &dirty,
   Serv &srv, bool do_wgridding, double wmin, double wmax, size_t verbosity,
-  bool divide_by_n)
+  bool divide_by_n, const WPlanes *planes=nullptr)
   {
   if (do_wgridding)
     {
     size_t nx_dirty=gconf.Nxdirty(), ny_dirty=gconf.Nydirty();
-    WgridHelper<T, Serv> hlp(gconf, srv, wmin, wmax, verbosity);
+    WPlanes lplanes;
+    if (!planes)
+      {
+      lplanes = getWPlanes(gconf, srv, wmin, wmax);
+      planes = &lplanes;
+      }
+    WgridHelper<T, Serv> hlp(gconf, srv, *planes, verbosity);
     report(gconf, srv.Nvis(), wmin, wmax, hlp.Nplanes(), false, verbosity);
     double dw = hlp.DW();
     gconf.timers.push("copying dirty image");
     mav<T,2> tdirty({nx_dirty,ny_dirty});
-    tdirty.apply(dirty, [](T&a, T b) {a=b;});
+    mav_apply([](T &a, const T &b) {a=b;}, gconf.Nthreads(), tdirty, dirty);
     gconf.timers.pop();
     // correct for w gridding etc.
     apply_global_corrections(gconf, tdirty, dw, divide_by_n);
     gconf.timers.push("allocating grid");
-    auto grid = mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()});
+    size_t nbatch = gconf.WPlaneBatch();
+    vector<mav<complex<T>,2>> grids;
+    for (size_t i=0; i<nbatch; ++i)
+      grids.push_back(mav<complex<T>,2>::build_noncritical({gconf.Nu(),gconf.Nv()}, gconf.Nthreads()));
     gconf.timers.pop();
-    while(hlp.advance())  // iterate over w planes
+    if (nbatch==1)
+      while(hlp.advance())  // iterate over w planes
+        {
+        if (hlp.Nvis()==0) continue;
+        gconf.dirty2grid_c_wscreen(tdirty, grids[0], T(hlp.W()));
+        gconf.timers.push("getSubserv");
+        auto serv = hlp.getSubserv();
+        gconf.timers.pop();
+        grid2x_c<true>(gconf, grids[0], serv, hlp.W(), dw);
+        }
+    else
       {
-      if (hlp.Nvis()==0) continue;
-      gconf.dirty2grid_c_wscreen(tdirty, grid, T(hlp.W()));
-      gconf.timers.push("getSubserv");
-      auto serv = hlp.getSubserv();
-      gconf.timers.pop();
-      grid2x_c<true>(gconf, grid, serv, hlp.W(), dw);
+      // the visibility lists of a whole batch of planes must be kept
+      bool more=true;
+      vector<vector<idx_t>> subidx(nbatch);
+      while(more)
+        {
+        vector<double> ws;
+        while((ws.size()<nbatch) && (more=hlp.advance()))  // iterate over w planes
+          {
+          if (hlp.Nvis()==0) continue;
+          subidx[ws.size()] = hlp.Subidx();
+          ws.push_back(hlp.W());
+          }
+        if (ws.empty()) continue;
+        gconf.dirty2grid_c_wscreen(tdirty, grids, ws);
+        for (size_t i=0; i<ws.size(); ++i)
+          {
+          auto subidx2 = mav<idx_t, 1>(subidx[i].data(), {subidx[i].size()});
+          auto serv = srv.getSubserv(subidx2);
+          grid2x_c<true>(gconf, grids[i], serv, ws[i], dw);
+          }
+        }
       }
     }
   else
     {
     report(gconf, srv.Nvis(), wmin, wmax, 0, false, verbosity);
     gconf.timers.push("allocating rgrid");
-    auto rgrid = mav<T,2>::build_noncritical({gconf.Nu(),gconf.Nv()});
+    auto rgrid = mav<T,2>::build_noncritical({gconf.Nu(),gconf.Nv()}, gconf.Nthreads());
     gconf.timers.pop();
     gconf.dirty2grid(dirty, rgrid);
     gconf.timers.push("allocating grid");
-    auto grid = mav<complex<T>,2>::build_noncritical(rgrid.shape());
+    auto grid = mav<complex<T>,2>::build_noncritical(rgrid.shape(), gconf.Nthreads());
     gconf.timers.poppush("hartley2complex");
     hartley2complex(rgrid, grid, gconf.Nthreads());
     gconf.timers.pop();
@@ -1288,6 +2066,93 @@ template<typename T, typename Serv> void dirty2x(
     }
   }
 
+/* Coefficients of the run-time model used by getNuNv(): the time for a
+   complex FFT of size 2048x2048, and the gridding time per visibility for
+   every kernel support. Non-positive entries have not been measured; the
+   built-in analytic estimates are used for them. There is only one set of
+   coefficients, which is used for transforms with any number of threads. */
+struct GridderCostModel
+  {
+  double fft;
+  array<double,17> grid;
+
+  GridderCostModel() : fft(-1) { grid.fill(-1); }
+  };
+
+inline mutex &costModelMutex()
+  { static mutex mtx; return mtx; }
+template<typename T> GridderCostModel &costModelStorage()
+  { static GridderCostModel res; return res; }
+
+inline const char *costModelTag(float) { return "f4"; }
+inline const char *costModelTag(double) { return "f8"; }
+
+/* Reads cost model entries from filename; every line has the form
+   "<f4|f8> fft <seconds>" or "<f4|f8> grid <support> <seconds>". */
+inline void loadCostModel(const string &filename)
+  {
+  ifstream inp(filename);
+  MR_assert(inp, "could not open cost model file '", filename, "'");
+  GridderCostModel mf=costModelStorage<float>(), md=costModelStorage<double>();
+  string prec, what;
+  while (inp >> prec >> what)
+    {
+    MR_assert((prec=="f4")||(prec=="f8"), "bad precision in cost model file");
+    auto &cm((prec=="f4") ? mf : md);
+    if (what=="fft")
+      inp >> cm.fft;
+    else
+      {
+      MR_assert(what=="grid", "bad entry in cost model file");
+      size_t supp;
+      inp >> supp;
+      MR_assert(supp<cm.grid.size(), "bad kernel support in cost model file");
+      inp >> cm.grid[supp];
+      }
+    }
+  MR_assert(inp.eof(), "error reading cost model file '", filename, "'");
+  lock_guard<mutex> lock(costModelMutex());
+  costModelStorage<float>() = mf;
+  costModelStorage<double>() = md;
+  }
+
+/* Writes all measured cost model entries to filename. */
+inline void saveCostModel(const string &filename)
+  {
+  ofstream out(filename);
+  MR_assert(out, "could not open cost model file '", filename, "'");
+  lock_guard<mutex> lock(costModelMutex());
+  auto write = [&out](const char *tag, const GridderCostModel &cm)
+    {
+    if (cm.fft>0) out << tag << " fft " << cm.fft << "\n";
+    for (size_t i=0; i<cm.grid.size(); ++i)
+      if (cm.grid[i]>0) out << tag << " grid " << i << " " << cm.grid[i] << "\n";
+    };
+  out.precision(8);
+  write("f4", costModelStorage<float>());
+  write("f8", costModelStorage<double>());
+  MR_assert(out, "error writing cost model file '", filename, "'");
+  }
+
+/* On first call, reads the file named by the environment variable
+   DUCC0_GRIDDER_COST_MODEL, if it is set. */
+inline void initCostModel()
+  {
+  static once_flag envflag;
+  call_once(envflag, []()
+    {
+    auto fname = getenv("DUCC0_GRIDDER_COST_MODEL");
+    if (fname) loadCostModel(fname);
+    });
+  }
+
+template<typename T> GridderCostModel getCostModel()
+  {
+  initCostModel();
+  lock_guard<mutex> lock(costModelMutex());
+  return costModelStorage<T>();
+  }
+
 template<typename T> auto getNuNv(double epsilon,
   bool do_wgridding, double wmin, double wmax, size_t nvis,
   size_t nxdirty, size_t nydirty, double pixsize_x, double pixsize_y, TimerHierarchy &timers)
@@ -1299,9 +2164,10 @@ template<typename T> auto getNuNv(double epsilon,
   if (x0*x0+y0*y0>1.)
     nm1min = -sqrt(abs(1.-x0*x0-y0*y0))-1.;
   auto idx = getAvailableKernels<T>(epsilon);
+  auto cmodel = getCostModel<T>();
   double mincost = 1e300;
   constexpr double nref_fft=2048;
-  constexpr double costref_fft=0.0693;
+  const double costref_fft = (cmodel.fft>0) ? cmodel.fft : 0.0693;
   size_t minnu=0, minnv=0, minidx=KernelDB.size();
   constexpr size_t vlen = native_simd<T>::size();
   for (size_t i=0; i<idx.size(); ++i)
@@ -1314,7 +2180,8 @@ template<typename T> auto getNuNv(double epsilon,
     size_t nv=2*good_size_complex(size_t(nydirty*ofactor*0.5)+1);
     double logterm = log(nu*nv)/log(nref_fft*nref_fft);
     double fftcost = nu/nref_fft*nv/nref_fft*logterm*costref_fft;
-    double gridcost = 2.2e-10*nvis*(supp*nvec*vlen + ((2*nvec+1)*(supp+3)*vlen));
+    double gridcost = (cmodel.grid[supp]>0) ? cmodel.grid[supp]*nvis :
+      2.2e-10*nvis*(supp*nvec*vlen + ((2*nvec+1)*(supp+3)*vlen));
     if (do_wgridding)
       {
       double dw = 0.5/ofactor/abs(nm1min);
@@ -1335,70 +2202,68 @@ template<typename T> auto getNuNv(double epsilon,
   return make_tuple(minnu, minnv, minidx);
   }
 
-template<typename T> vector<idx_t> getIndices(const Baselines &baselines,
-  const GridderConfig<T> &gconf, const mav<uint8_t,2> &mask)
+/* Sorts the items of all rows by the tiles into which they fall. Row irow
+   has nitems(irow) items; item(irow, j, uvw) returns false if item j is to
+   be skipped, otherwise it sets the effective uvw coordinates of the item.
+   entry(irow, j) is the value stored for the item in the result. */
+template<typename T, typename Fnum, typename Fitem, typename Fentry>
+  vector<idx_t> getIndices(size_t nrow, const GridderConfig<T> &gconf,
+  Fnum nitems, Fitem item, Fentry entry)
   {
   gconf.timers.push("Index generation");
-  size_t nrow=baselines.Nrows(),
-         nchan=baselines.Nchannels(),
-         nsafe=gconf.Nsafe(),
-         nthreads=gconf.Nthreads();
-  checkShape(mask.shape(), {nrow,nchan});
-  constexpr int side=1<<logsquare;
-  size_t nbu = (gconf.Nu()+1+side-1) >> logsquare,
-         nbv = (gconf.Nv()+1+side-1) >> logsquare;
-  mav<idx_t,2> acc({nthreads, (nbu*nbv+16)}); // the 16 is safety distance to avoid false sharing
-  vector<idx_t> tmp(nrow*nchan);
-
-  execParallel(nthreads, [&](Scheduler &sched)
-    {
-    idx_t tid = sched.thread_num();
-    auto [lo, hi] = calcShare(nthreads, tid, nrow);
-    for(auto irow=idx_t(lo); irow<idx_t(hi); ++irow)
-      {
-      for (idx_t ichan=0, idx=irow*nchan; ichan<nchan; ++ichan, ++idx)
-        if (mask(irow,ichan))
-          {
-          auto uvw = baselines.effectiveCoord(RowChan{irow,idx_t(ichan)});
-          if (uvw.w<0) uvw.Flip();
-          double u, v;
-          int iu0, iv0;
-          gconf.getpix(uvw.u, uvw.v, u, v, iu0, iv0);
-          iu0 = (iu0+nsafe)>>logsquare;
-          iv0 = (iv0+nsafe)>>logsquare;
-          tmp[idx] = nbv*iu0 + iv0;
-          ++acc.v(tid, tmp[idx]);
-          }
-        else
-          tmp[idx] = ~idx_t(0);
-      }
-    });
-
-  idx_t offset=0;
-  for (idx_t idx=0; idx<nbu*nbv; ++idx)
-    for (idx_t tid=0; tid<nthreads; ++tid)
+  int nsafe=int(gconf.Nsafe());
+  size_t nbu = ntiles<logsquare>(gconf.Nu()),
+         nbv = ntiles<logsquare>(gconf.Nv());
+  auto res = bucket_sort<idx_t>(nrow, nbu*nbv, gconf.Nthreads(), nitems,
+    [&](size_t irow, size_t j)
       {
-      auto tmp = acc(tid, idx);
-      acc.v(tid, idx) = offset;
-      offset += tmp;
-      }
-
-  vector<idx_t> res(offset);
-  execParallel(nthreads, [&](Scheduler &sched)
-    {
-    idx_t tid = sched.thread_num();
-    auto [lo, hi] = calcShare(nthreads, tid, nrow);
-    for(auto irow=idx_t(lo); irow<idx_t(hi); ++irow)
-      for (size_t ichan=0, idx=irow*nchan; ichan<nchan; ++ichan, ++idx)
-        if (tmp[idx]!=(~idx_t(0)))
-          res[acc.v(tid, tmp[idx])++] = baselines.getIdx(irow, ichan);
-    });
+      UVW uvw;
+      if (!item(idx_t(irow), j, uvw)) return ~idx_t(0);
+      if (uvw.w<0) uvw.Flip();
+      double u, v;
+      int iu0, iv0;
+      gconf.getpix(uvw.u, uvw.v, u, v, iu0, iv0);
+      return idx_t(nbv*tile_index<logsquare>(iu0, nsafe)
+                   + tile_index<logsquare>(iv0, nsafe));
+      },
+    [&](size_t irow, size_t j) { return entry(idx_t(irow), j); });
   gconf.timers.pop();
   return res;
   }
 
+/* Only the visibilities in \a runs are considered, so that the memory and
+   time spent on flagged data is negligible. */
+template<typename T> vector<idx_t> getIndices(const Baselines &baselines,
+  const GridderConfig<T> &gconf, const ChannelRuns &runs)
+  {
+  size_t nrow=baselines.Nrows(),
+         nchan=baselines.Nchannels();
+  MR_assert((runs.Nrows()==nrow) && (runs.Nchannels()==nchan),
+    "shape mismatch");
+  return getIndices(nrow, gconf, [&runs](size_t irow)
+      { return runs.nActive(irow); },
+    [&](idx_t irow, size_t k, UVW &uvw)
+      {
+      uvw = baselines.effectiveCoord(RowChan{irow,runs.channel(irow, k)});
+      return true;
+      },
+    [&](idx_t irow, size_t k)
+      { return baselines.getIdx(irow, runs.channel(irow, k)); });
+  }
+template<typename T> vector<idx_t> getIndices(const Baselines &baselines,
+  const GridderConfig<T> &gconf, const mav<uint8_t,2> &mask)
+  {
+  checkShape(mask.shape(), {baselines.Nrows(),baselines.Nchannels()});
+  return getIndices(baselines, gconf, ChannelRuns(mask, gconf.Nthreads()));
+  }
+
+/* Determines the active visibilities among those in \a runs (the ones with
+   nonzero ms and wgt, where given) together with their w range and number.
+   With smearing, the w range covers all sub-samples, and the returned number of visibilities counts the
+   sub-samples. */
 template<typename T> auto scanData(const Baselines &baselines, const mav<complex<T>,2> &ms,
-  const mav<T, 2> &wgt, const mav<uint8_t, 2> &mask, size_t nthreads, TimerHierarchy &timers)
+  const mav<T, 2> &wgt, const ChannelRuns &runs, size_t nthreads, TimerHierarchy &timers,
+  const Smearing *smear=nullptr)
   {
   timers.push("Initial scan");
   size_t nrow=baselines.Nrows(),
@@ -1407,50 +2272,187 @@ template<typename T> auto scanData(const Baselines &baselines, const mav<complex
   if (have_wgt) checkShape(wgt.shape(),{nrow,nchan});
   bool have_ms=ms.size()!=0;
   if (have_ms) checkShape(ms.shape(), {nrow,nchan});
-  bool have_mask=mask.size()!=0;
-  if (have_mask) checkShape(mask.shape(), {nrow,nchan});
+  MR_assert((runs.Nrows()==nrow) && (runs.Nchannels()==nchan),
+    "shape mismatch");
 
-  mav<uint8_t, 2> mask_out({nrow,nchan});
-  size_t nvis=0;
-  double wmin=1e300, wmax=-1e300;
-  mutex mut;
-  execParallel(nthreads, [&](Scheduler &sched)
+  vector<size_t> tnvis(nthreads, 0);
+  vector<double> twmin(nthreads, 1e300), twmax(nthreads, -1e300);
+  ChannelRuns runs_out(nrow, nchan, nthreads,
+    [&](size_t tid, size_t irow, auto add)
     {
     double lwmin=1e300, lwmax=-1e300;
     size_t lnvis=0;
-    idx_t tid = sched.thread_num();
-    auto [lo, hi] = calcShare(nthreads, tid, nrow);
-    for(auto irow=idx_t(lo); irow<idx_t(hi); ++irow)
-      for (idx_t ichan=0, idx=irow*nchan; ichan<nchan; ++ichan, ++idx)
+    for (size_t i=runs.first(irow); i<runs.first(irow+1); ++i)
+      for (idx_t ichan=runs.Lo(i); ichan<runs.Hi(i); ++ichan)
         if (((!have_ms ) || (norm(ms(irow,ichan))!=0)) &&
-            ((!have_wgt) || (wgt(irow,ichan)!=0)) &&
-            ((!have_mask) || (mask(irow,ichan)!=0)))
+            ((!have_wgt) || (wgt(irow,ichan)!=0)))
           {
+          add(ichan, ichan+1);
+          RowChan rc{idx_t(irow), ichan};
+          if (smear)
+            {
+            lnvis += smear->nSub(rc.row);
+            smear->wRange(baselines, rc, lwmin, lwmax);
+            continue;
+            }
           ++lnvis;
-          mask_out.v(irow,ichan) = 1;
-          auto uvw = baselines.effectiveCoord(RowChan{irow,idx_t(ichan)});
-          double w = abs(uvw.w);
+          double w = abs(baselines.effectiveCoord(rc).w);
           lwmin = min(lwmin, w);
           lwmax = max(lwmax, w);
           }
+    tnvis[tid] += lnvis;
+    twmin[tid] = min(twmin[tid], lwmin);
+    twmax[tid] = max(twmax[tid], lwmax);
+    });
+  size_t nvis=0;
+  double wmin=1e300, wmax=-1e300;
+  for (size_t i=0; i<nthreads; ++i)
     {
-    lock_guard<mutex> lock(mut);
-    wmin = min(wmin, lwmin);
-    wmax = max(wmax, lwmax);
-    nvis += lnvis;
+    nvis += tnvis[i];
+    wmin = min(wmin, twmin[i]);
+    wmax = max(wmax, twmax[i]);
     }
-    });
   timers.pop();
-  return make_tuple(wmin, wmax, nvis, mask_out);
+  return make_tuple(wmin, wmax, nvis, move(runs_out));
+  }
+/* Same as above; if \a mask is not empty, only visibilities with
+   mask(irow,ichan)!=0 are considered. */
+template<typename T> auto scanData(const Baselines &baselines, const mav<complex<T>,2> &ms,
+  const mav<T, 2> &wgt, const mav<uint8_t, 2> &mask, size_t nthreads, TimerHierarchy &timers,
+  const Smearing *smear=nullptr)
+  {
+  size_t nrow=baselines.Nrows(),
+         nchan=baselines.Nchannels();
+  if (mask.size()==0)
+    return scanData(baselines, ms, wgt, ChannelRuns(nrow, nchan), nthreads,
+      timers, smear);
+  checkShape(mask.shape(), {nrow,nchan});
+  timers.push("mask compression");
+  ChannelRuns runs(mask, nthreads);
+  timers.pop();
+  return scanData(baselines, ms, wgt, runs, nthreads, timers, smear);
+  }
+
+/* Measures the coefficients of the cost model for precision T on this
+   machine with nthreads threads, and makes later calls of getNuNv() use
+   them. The model does not take the thread count into account: the same
+   coefficients are used for all later transforms, so their choice of grid
+   size and kernel is best for transforms with nthreads threads (FFT and
+   gridding do not scale equally with the number of threads).
+   The measurements take a few seconds. */
+template<typename T> void calibrateCostModel(size_t nthreads)
+  {
+  GridderCostModel cm;
+  TimerHierarchy timers("cost model calibration");
+  constexpr size_t nref_fft=2048, nfft=1024;
+  {
+  auto grid = mav<complex<T>,2>::build_noncritical({nfft,nfft}, nthreads);
+  grid.fill(0);
+  fmav<complex<T>> fgrid(grid);
+  double t=1e300;
+  for (size_t rep=0; rep<2; ++rep)
+    {
+    SimpleTimer timer;
+    c2c(fgrid, fgrid, {0,1}, BACKWARD, T(1), nthreads);
+    t = min(t, timer());
+    }
+  double logterm = log(nfft*nfft)/log(nref_fft*nref_fft);
+  cm.fft = t/(double(nfft)/nref_fft*nfft/nref_fft*logterm);
+  }
+
+  // random visibilities covering the whole uv plane
+  constexpr size_t nx=512, nvis=200000;
+  constexpr double pix=1./nx;
+  mav<double,2> uvw({nvis,3});
+  mav<double,1> freq({1});
+  freq.v(0) = 299792458.; // f_over_c=1
+  uint64_t state=42;
+  auto rnd = [&state]()
+    {
+    state = state*6364136223846793005ULL + 1442695040888963407ULL;
+    return double(state>>11)*0x1.0p-53 - 0.5;
+    };
+  for (size_t i=0; i<nvis; ++i)
+    {
+    uvw.v(i,0) = rnd()/pix;
+    uvw.v(i,1) = rnd()/pix;
+    uvw.v(i,2) = 0;
+    }
+  Baselines baselines(uvw, freq);
+  mav<complex<T>,2> ms({nvis,1});
+  for (size_t i=0; i<nvis; ++i)
+    ms.v(i,0) = complex<T>(T(rnd()), T(rnd()));
+  mav<T,2> wgt(nullptr, {0,0}, false);
+  mav<uint8_t,2> mask({nvis,1});
+  mask.fill(1);
+
+  // for every support, the kernel with the smallest oversampling factor
+  size_t Wlim = is_same<T, float>::value ? 8 : 16;
+  for (size_t supp=1; supp<=Wlim; ++supp)
+    {
+    size_t kidx=KernelDB.size();
+    for (size_t i=0; i<KernelDB.size(); ++i)
+      if ((KernelDB[i].W==supp) && ((kidx==KernelDB.size())
+        || (KernelDB[i].ofactor<KernelDB[kidx].ofactor)))
+        kidx = i;
+    if (kidx==KernelDB.size()) continue;
+    size_t nu=2*good_size_complex(size_t(nx*KernelDB[kidx].ofactor*0.5)+1);
+    GridderConfig<T> gconf(nx, nx, nu, nu, kidx, KernelDB[kidx].epsilon,
+      pix, pix, baselines, nthreads, timers);
+    auto idx = getIndices(baselines, gconf, mask);
+    auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+    auto serv = makeMsServ(baselines,idx2,ms,wgt);
+    auto grid = mav<complex<T>,2>::build_noncritical({nu,nu}, nthreads);
+    double t=1e300;
+    for (size_t rep=0; rep<2; ++rep)
+      {
+      grid.fill(0);
+      SimpleTimer timer;
+      x2grid_c<false>(gconf, serv, grid);
+      t = min(t, timer());
+      }
+    cm.grid[supp] = t/nvis;
+    }
+  initCostModel();  // must not overwrite the new values later
+  lock_guard<mutex> lock(costModelMutex());
+  costModelStorage<T>() = cm;
+  }
+
+/* Grid size and kernel of a transform: if nu or nv is 0, both are chosen for
+   speed. Otherwise the kernel is chosen by GridderConfig, unless the
+   kernel has to be evaluated in a lower precision T than the grid
+   precision Tacc. */
+template<typename T, typename Tacc> auto getGridParams(double epsilon,
+  bool do_wgridding, double wmin, double wmax, size_t nvis, size_t nxdirty,
+  size_t nydirty, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+  TimerHierarchy &timers)
+  {
+  if (nu*nv==0)
+    return getNuNv<T>(epsilon, do_wgridding, wmin, wmax, nvis, nxdirty,
+      nydirty, pixsize_x, pixsize_y, timers);
+  size_t kidx = KernelDB.size();
+  if constexpr (!is_same<T, Tacc>::value)
+    {
+    kidx = findKernel<T>(min(double(nu)/nxdirty, double(nv)/nydirty), epsilon);
+    MR_assert(kidx<KernelDB.size(), "no appropriate kernel found");
+    }
+  return make_tuple(nu, nv, kidx);
   }
 
 // Note to self: divide_by_n should always be true when doing Bayesian imaging,
 // but wsclean needs it to be false, so this must be kept as a parameter.
-template<typename T> void ms2dirty(const mav<double,2> &uvw,
+/* T is the precision of the visibilities, weights and dirty image, of the
+   kernel evaluation and of the tile buffers used while (de)gridding. The uv
+   grid, the FFTs and the image corrections use precision Tacc, which may be
+   higher (e.g. float visibilities and kernels with double accumulation).
+   The uvw coordinates may be given in single or double precision. */
+template<typename T, typename Tacc=T, typename Tuvw=double> void ms2dirty(
+  const mav<Tuvw,2> &uvw,
   const mav<double,1> &freq, const mav<complex<T>,2> &ms,
-  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  const mav<T,2> &wgt, const ChannelRuns &runs, double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
   bool do_wgridding, size_t nthreads, mav<T,2> &dirty, size_t verbosity,
-  bool negate_v=false, bool divide_by_n=true)
+  bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
   {
   TimerHierarchy timers("gridding");
   timers.push("Baseline construction");
@@ -1458,71 +2460,589 @@ template<typename T> void ms2dirty(const mav<double,2> &uvw,
   timers.pop();
   // adjust for increased error when gridding in 2 or 3 dimensions
   epsilon /= do_wgridding ? 3 : 2;
-  auto [wmin, wmax, nvis, mask_out] = scanData(baselines, ms, wgt, mask, nthreads, timers);
+  auto [wmin, wmax, nvis, active] = scanData(baselines, ms, wgt, runs, nthreads, timers);
   if (nvis==0)
     { dirty.fill(0); return; }
-  size_t kidx = KernelDB.size();
-  if (nu*nv==0)
+  auto [nu2, nv2, kidx] = getGridParams<T, Tacc>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+  GridderConfig<Tacc> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, gconf, active);
+  timers.push("MsServ construction");
+  auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+  auto serv = makeMsServ(baselines,idx2,ms,wgt);
+  timers.pop();
+  if constexpr (is_same<T, Tacc>::value)
+    x2dirty(gconf, serv, dirty, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+  else
     {
-    auto [nu2, nv2, kidx2] = getNuNv<T>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, timers);
-    nu = nu2;
-    nv = nv2;
-    kidx = kidx2;
+    mav<Tacc,2> dirty2(dirty.shape());
+    x2dirty(gconf, serv, dirty2, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    for (size_t i=0; i<dirty.shape(0); ++i)
+      for (size_t j=0; j<dirty.shape(1); ++j)
+        dirty.v(i,j) = T(dirty2(i,j));
     }
-  GridderConfig<T> gconf(dirty.shape(0), dirty.shape(1), nu, nv, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
-  auto idx = getIndices(baselines, gconf, mask_out);
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+/* Variant of the above with the flags given as a dense array; if \a mask is
+   not empty, only visibilities with mask(irow,ichan)!=0 are processed. */
+template<typename T, typename Tacc=T, typename Tuvw=double> void ms2dirty(
+  const mav<Tuvw,2> &uvw,
+  const mav<double,1> &freq, const mav<complex<T>,2> &ms,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  bool do_wgridding, size_t nthreads, mav<T,2> &dirty, size_t verbosity,
+  bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  if (mask.size()!=0) checkShape(mask.shape(), {uvw.shape(0), freq.shape(0)});
+  auto runs = (mask.size()==0) ? ChannelRuns(uvw.shape(0), freq.shape(0))
+                               : ChannelRuns(mask, nthreads);
+  ms2dirty<T,Tacc,Tuvw>(uvw, freq, ms, wgt, runs, pixsize_x, pixsize_y, nu, nv,
+    epsilon, do_wgridding, nthreads, dirty, verbosity, negate_v, divide_by_n,
+    wplane_mem);
+  }
+
+/* see ms2dirty() for the meaning of T and Tacc */
+template<typename T, typename Tacc=T, typename Tuvw=double> void dirty2ms(
+  const mav<Tuvw,2> &uvw,
+  const mav<double,1> &freq, const mav<T,2> &dirty,
+  const mav<T,2> &wgt, const ChannelRuns &runs, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+  double epsilon, bool do_wgridding, size_t nthreads, mav<complex<T>,2> &ms,
+  size_t verbosity, bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  TimerHierarchy timers("degridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  // adjust for increased error when gridding in 2 or 3 dimensions
+  epsilon /= do_wgridding ? 3 : 2;
+  mav<complex<T>,2> null_ms(nullptr, {0,0}, false);
+  timers.push("MS zeroing");
+  ms.fill(0);
+  timers.pop();
+  auto [wmin, wmax, nvis, active] = scanData(baselines, null_ms, wgt, runs, nthreads, timers);
+  if (nvis==0)
+    return;
+  auto [nu2, nv2, kidx] = getGridParams<T, Tacc>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+  GridderConfig<Tacc> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, gconf, active);
   timers.push("MsServ construction");
   auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+  timers.pop();
   auto serv = makeMsServ(baselines,idx2,ms,wgt);
+  if constexpr (is_same<T, Tacc>::value)
+    dirty2x(gconf, dirty, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+  else
+    {
+    mav<Tacc,2> dirty2(dirty.shape());
+    for (size_t i=0; i<dirty.shape(0); ++i)
+      for (size_t j=0; j<dirty.shape(1); ++j)
+        dirty2.v(i,j) = Tacc(dirty(i,j));
+    dirty2x(gconf, dirty2, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    }
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+/* Variant of the above with the flags given as a dense array (see
+   ms2dirty()). */
+template<typename T, typename Tacc=T, typename Tuvw=double> void dirty2ms(
+  const mav<Tuvw,2> &uvw,
+  const mav<double,1> &freq, const mav<T,2> &dirty,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+  double epsilon, bool do_wgridding, size_t nthreads, mav<complex<T>,2> &ms,
+  size_t verbosity, bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  if (mask.size()!=0) checkShape(mask.shape(), {uvw.shape(0), freq.shape(0)});
+  auto runs = (mask.size()==0) ? ChannelRuns(uvw.shape(0), freq.shape(0))
+                               : ChannelRuns(mask, nthreads);
+  dirty2ms<T,Tacc,Tuvw>(uvw, freq, dirty, wgt, runs, pixsize_x, pixsize_y, nu,
+    nv, epsilon, do_wgridding, nthreads, ms, verbosity, negate_v, divide_by_n,
+    wplane_mem);
+  }
+
+/* Tile-sorted sub-sample entries of all active visibilities (see
+   SmearServ). */
+template<typename T> vector<idx_t> getIndices(const Baselines &baselines,
+  const Smearing &smear, const GridderConfig<T> &gconf,
+  const ChannelRuns &runs)
+  {
+  size_t nrow=baselines.Nrows(),
+         nchan=baselines.Nchannels();
+  MR_assert((runs.Nrows()==nrow) && (runs.Nchannels()==nchan),
+    "shape mismatch");
+  auto subshift = smear.Subshift();
+  return getIndices(nrow, gconf,
+    [&](size_t irow) { return runs.nActive(irow)*smear.nSub(idx_t(irow)); },
+    [&](idx_t irow, size_t j, UVW &uvw)
+      {
+      auto nsub = smear.nSub(irow);
+      RowChan rc{irow, runs.channel(irow, j/nsub)};
+      uvw = smear.coord(baselines, rc, idx_t(j%nsub));
+      return true;
+      },
+    [&](idx_t irow, size_t j)
+      {
+      auto nsub = smear.nSub(irow);
+      return (baselines.getIdx(irow, runs.channel(irow, j/nsub))<<subshift)
+        | idx_t(j%nsub);
+      });
+  }
+
+/*! Like ms2dirty(), but the visibilities are averages over the region of
+    uvw space described by \a duvw and \a chan_width (see Smearing). */
+template<typename T> void ms2dirty_smeared(const mav<double,2> &uvw,
+  const mav<double,2> &duvw, const mav<double,1> &chan_width,
+  const mav<double,1> &freq, const mav<complex<T>,2> &ms,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  bool do_wgridding, size_t nthreads, mav<T,2> &dirty, size_t verbosity,
+  bool negate_v=false, bool divide_by_n=true, double wplane_mem=0)
+  {
+  TimerHierarchy timers("gridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  // the smearing quadrature gets its own share of the error budget
+  epsilon /= do_wgridding ? 4 : 3;
+  timers.push("Smearing setup");
+  Smearing smear(baselines, duvw, chan_width, dirty.shape(0), dirty.shape(1),
+    pixsize_x, pixsize_y, epsilon, negate_v);
+  baselines.extendMax(smear.Umax(), smear.Vmax());
+  timers.pop();
+  auto [wmin, wmax, nvis, active] = scanData(baselines, ms, wgt, mask, nthreads, timers, &smear);
+  if (nvis==0)
+    { dirty.fill(0); return; }
+  auto [nu2, nv2, kidx] = getGridParams<T, T>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+  GridderConfig<T> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, smear, gconf, active);
+  timers.push("MsServ construction");
+  auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+  auto serv = SmearServ<T, const mav<complex<T>,2>>(baselines, smear, idx2, ms, wgt);
   timers.pop();
   x2dirty(gconf, serv, dirty, do_wgridding, wmin, wmax, verbosity, divide_by_n);
   if (verbosity>0)
     timers.report(cout);
   }
 
-template<typename T> void dirty2ms(const mav<double,2> &uvw,
+/*! Adjoint of ms2dirty_smeared(). */
+template<typename T> void dirty2ms_smeared(const mav<double,2> &uvw,
+  const mav<double,2> &duvw, const mav<double,1> &chan_width,
   const mav<double,1> &freq, const mav<T,2> &dirty,
   const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
   double epsilon, bool do_wgridding, size_t nthreads, mav<complex<T>,2> &ms,
-  size_t verbosity, bool negate_v=false, bool divide_by_n=true)
+  size_t verbosity, bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
   {
   TimerHierarchy timers("degridding");
   timers.push("Baseline construction");
   Baselines baselines(uvw, freq, negate_v);
   timers.pop();
+  // the smearing quadrature gets its own share of the error budget
+  epsilon /= do_wgridding ? 4 : 3;
+  timers.push("Smearing setup");
+  Smearing smear(baselines, duvw, chan_width, dirty.shape(0), dirty.shape(1),
+    pixsize_x, pixsize_y, epsilon, negate_v);
+  baselines.extendMax(smear.Umax(), smear.Vmax());
+  timers.pop();
+  mav<complex<T>,2> null_ms(nullptr, {0,0}, false);
+  timers.push("MS zeroing");
+  ms.fill(0);
+  timers.pop();
+  auto [wmin, wmax, nvis, active] = scanData(baselines, null_ms, wgt, mask, nthreads, timers, &smear);
+  if (nvis==0)
+    return;
+  auto [nu2, nv2, kidx] = getGridParams<T, T>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+  GridderConfig<T> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, smear, gconf, active);
+  timers.push("MsServ construction");
+  auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+  auto serv = SmearServ<T, mav<complex<T>,2>>(baselines, smear, idx2, ms, wgt);
+  timers.pop();
+  dirty2x(gconf, dirty, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+  timers.push("sub-sample accumulation");
+  serv.finish();
+  timers.pop();
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+/* Stable reordering of the (tile-sorted) visibility indices by channel group;
+   returns the start of every group's range in idx, with an extra entry at the
+   end. */
+inline vector<size_t> groupIndices(const Baselines &baselines,
+  vector<idx_t> &idx, const mav<size_t,1> &chan_group, size_t ngroups,
+  size_t nthreads, TimerHierarchy &timers)
+  {
+  timers.push("channel grouping");
+  checkShape(chan_group.shape(), {baselines.Nchannels()});
+  for (size_t i=0; i<chan_group.shape(0); ++i)
+    MR_assert(chan_group(i)<ngroups, "bad channel group");
+  auto group = [&](idx_t i) { return chan_group(baselines.getRowChan(i).chan); };
+  mav<size_t,2> cnt({nthreads, ngroups+16}); // safety distance against false sharing
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid=sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, idx.size());
+    for(auto i=lo; i<hi; ++i)
+      ++cnt.v(tid, group(idx[i]));
+    });
+  vector<size_t> ofs(ngroups+1, 0);
+  size_t offset=0;
+  for (size_t g=0; g<ngroups; ++g)
+    {
+    ofs[g] = offset;
+    for (size_t tid=0; tid<nthreads; ++tid)
+      {
+      auto tmp = cnt(tid, g);
+      cnt.v(tid, g) = offset;
+      offset += tmp;
+      }
+    }
+  ofs[ngroups] = offset;
+  vector<idx_t> res(idx.size());
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid=sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, idx.size());
+    for(auto i=lo; i<hi; ++i)
+      res[cnt.v(tid, group(idx[i]))++] = idx[i];
+    });
+  idx.swap(res);
+  timers.pop();
+  return ofs;
+  }
+
+/*! Like ms2dirty(), but channel \a ichan is gridded into the image
+    \a dirty(chan_group(ichan),:,:), so that a whole image cube (e.g. one
+    image per channel or per subband) is produced with a single data scan and
+    index sort. All planes share the grid dimensions and kernel. */
+template<typename T> void ms2dirty_cube(const mav<double,2> &uvw,
+  const mav<double,1> &freq, const mav<complex<T>,2> &ms,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask,
+  const mav<size_t,1> &chan_group, double pixsize_x, double pixsize_y,
+  size_t nu, size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  mav<T,3> &dirty, size_t verbosity, bool negate_v=false,
+  bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  TimerHierarchy timers("gridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  size_t ngroups=dirty.shape(0), nxdirty=dirty.shape(1), nydirty=dirty.shape(2);
+  // adjust for increased error when gridding in 2 or 3 dimensions
+  epsilon /= do_wgridding ? 3 : 2;
+  auto [wmin, wmax, nvis, active] = scanData(baselines, ms, wgt, mask, nthreads, timers);
+  if (nvis==0)
+    { dirty.fill(0); return; }
+  size_t kidx = KernelDB.size();
+  if (nu*nv==0)
+    {
+    auto [nu2, nv2, kidx2] = getNuNv<T>(epsilon, do_wgridding, wmin, wmax, (nvis+ngroups-1)/ngroups, nxdirty, nydirty, pixsize_x, pixsize_y, timers);
+    nu = nu2;
+    nv = nv2;
+    kidx = kidx2;
+    }
+  GridderConfig<T> gconf(nxdirty, nydirty, nu, nv, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, gconf, active);
+  auto ofs = groupIndices(baselines, idx, chan_group, ngroups, nthreads, timers);
+  for (size_t g=0; g<ngroups; ++g)
+    {
+    auto plane = dirty.template subarray<2>({g,0,0},{0,nxdirty,nydirty});
+    if (ofs[g+1]==ofs[g])
+      { plane.fill(0); continue; }
+    auto idx2 = mav<idx_t,1>(idx.data()+ofs[g],{ofs[g+1]-ofs[g]});
+    auto serv = makeMsServ(baselines,idx2,ms,wgt);
+    x2dirty(gconf, serv, plane, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    }
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+/*! Adjoint of ms2dirty_cube(): channel \a ichan of \a ms is computed from
+    the image \a dirty(chan_group(ichan),:,:). */
+template<typename T> void dirty2ms_cube(const mav<double,2> &uvw,
+  const mav<double,1> &freq, const mav<T,3> &dirty,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask,
+  const mav<size_t,1> &chan_group, double pixsize_x, double pixsize_y,
+  size_t nu, size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  mav<complex<T>,2> &ms, size_t verbosity, bool negate_v=false,
+  bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  TimerHierarchy timers("degridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  size_t ngroups=dirty.shape(0), nxdirty=dirty.shape(1), nydirty=dirty.shape(2);
   // adjust for increased error when gridding in 2 or 3 dimensions
   epsilon /= do_wgridding ? 3 : 2;
   mav<complex<T>,2> null_ms(nullptr, {0,0}, false);
   timers.push("MS zeroing");
   ms.fill(0);
   timers.pop();
-  auto [wmin, wmax, nvis, mask_out] = scanData(baselines, null_ms, wgt, mask, nthreads, timers);
+  auto [wmin, wmax, nvis, active] = scanData(baselines, null_ms, wgt, mask, nthreads, timers);
   if (nvis==0)
     return;
   size_t kidx = KernelDB.size();
   if (nu*nv==0)
     {
-    auto [nu2, nv2, kidx2] = getNuNv<T>(epsilon, do_wgridding, wmin, wmax, nvis, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, timers);
+    auto [nu2, nv2, kidx2] = getNuNv<T>(epsilon, do_wgridding, wmin, wmax, (nvis+ngroups-1)/ngroups, nxdirty, nydirty, pixsize_x, pixsize_y, timers);
     nu = nu2;
     nv = nv2;
     kidx = kidx2;
     }
-  GridderConfig<T> gconf(dirty.shape(0), dirty.shape(1), nu, nv, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
-  auto idx = getIndices(baselines, gconf, mask_out);
-  timers.push("MsServ construction");
-  auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
-  timers.pop();
-  auto serv = makeMsServ(baselines,idx2,ms,wgt);
-  dirty2x(gconf, dirty, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+  GridderConfig<T> gconf(nxdirty, nydirty, nu, nv, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, gconf, active);
+  auto ofs = groupIndices(baselines, idx, chan_group, ngroups, nthreads, timers);
+  for (size_t g=0; g<ngroups; ++g)
+    {
+    if (ofs[g+1]==ofs[g]) continue;
+    auto plane = dirty.template subarray<2>({g,0,0},{0,nxdirty,nydirty});
+    auto idx2 = mav<idx_t,1>(idx.data()+ofs[g],{ofs[g+1]-ofs[g]});
+    auto serv = makeMsServ(baselines,idx2,ms,wgt);
+    dirty2x(gconf, plane, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    }
   if (verbosity>0)
     timers.report(cout);
   }
 
+/*! Gridder plan for repeated transforms of one data set (e.g. in the major
+    cycles of CLEAN).
+    The constructor does all the work which only depends on the visibility
+    coordinates, the mask and the image parameters: it scans the data,
+    chooses the grid dimensions and kernel, sorts the visibilities and (for
+    w-gridding) assigns them to w planes. ms2dirty() and dirty2ms() only carry
+    out gridding, FFTs and corrections. The plan keeps copies of the
+    coordinates, so \a uvw and \a freq need not outlive it.
+    In contrast to the free ms2dirty() function, visibilities with zero value
+    are not skipped, since the visibility data are only known at execution
+    time. The weights may differ between executions. */
+template<typename T> class GridderPlan
+  {
+  private:
+    TimerHierarchy timers;
+    Baselines baselines;
+    size_t nxdirty, nydirty;
+    bool do_wgridding, divide_by_n;
+    size_t verbosity;
+    double wmin, wmax;
+    size_t nvis;
+    unique_ptr<GridderConfig<T>> gconf;
+    vector<idx_t> idx;
+    WPlanes planes;
+
+    void checkInputs(const array<size_t,2> &msshape, const mav<T,2> &wgt,
+      const array<size_t,2> &dirtyshape) const
+      {
+      checkShape(msshape, {baselines.Nrows(), baselines.Nchannels()});
+      if (wgt.size()!=0) checkShape(wgt.shape(), msshape);
+      checkShape(dirtyshape, {nxdirty, nydirty});
+      }
+
+  public:
+    /*! Takes the visibility coordinates from \a baselines, which may e.g.
+        compute them from antenna positions. */
+    GridderPlan(Baselines &&baselines_,
+      const mav<uint8_t,2> &mask, size_t nxdirty_, size_t nydirty_,
+      double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+      double epsilon, bool do_wgridding_, size_t nthreads, size_t verbosity_,
+      bool divide_by_n_=true, double wplane_mem=0)
+      : timers("gridder plan"), baselines(move(baselines_)),
+        nxdirty(nxdirty_), nydirty(nydirty_), do_wgridding(do_wgridding_),
+        divide_by_n(divide_by_n_), verbosity(verbosity_)
+      {
+      timers.push("plan construction");
+      // adjust for increased error when gridding in 2 or 3 dimensions
+      epsilon /= do_wgridding ? 3 : 2;
+      mav<complex<T>,2> null_ms(nullptr, {0,0}, false);
+      mav<T,2> null_wgt(nullptr, {0,0}, false);
+      auto [wmin_, wmax_, nvis_, active] = scanData(baselines, null_ms,
+        null_wgt, mask, nthreads, timers);
+      wmin = wmin_;
+      wmax = wmax_;
+      nvis = nvis_;
+      if (nvis>0)
+        {
+        size_t kidx = KernelDB.size();
+        if (nu*nv==0)
+          {
+          auto [nu2, nv2, kidx2] = getNuNv<T>(epsilon, do_wgridding, wmin,
+            wmax, nvis, nxdirty, nydirty, pixsize_x, pixsize_y, timers);
+          nu = nu2;
+          nv = nv2;
+          kidx = kidx2;
+          }
+        gconf = make_unique<GridderConfig<T>>(nxdirty, nydirty, nu, nv, kidx,
+          epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+        gconf->setWPlaneMemory(wplane_mem);
+        idx = getIndices(baselines, *gconf, active);
+        if (do_wgridding)
+          {
+          mav<complex<T>,2> dummy_ms(nullptr,
+            {baselines.Nrows(), baselines.Nchannels()}, false);
+          auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+          auto serv = makeMsServ(baselines, idx2, dummy_ms, null_wgt);
+          planes = getWPlanes(*gconf, serv, wmin, wmax);
+          }
+        }
+      timers.pop();
+      }
+    GridderPlan(const mav<double,2> &uvw, const mav<double,1> &freq,
+      const mav<uint8_t,2> &mask, size_t nxdirty_, size_t nydirty_,
+      double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+      double epsilon, bool do_wgridding_, size_t nthreads, size_t verbosity_,
+      bool negate_v=false, bool divide_by_n_=true, double wplane_mem=0)
+      : GridderPlan(Baselines(uvw, freq, negate_v), mask, nxdirty_, nydirty_,
+          pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding_, nthreads,
+          verbosity_, divide_by_n_, wplane_mem) {}
+    GridderPlan(const GridderPlan &) = delete;
+    GridderPlan &operator=(const GridderPlan &) = delete;
+
+    /*! \a ms can be any object providing \c shape() and
+        \c operator()(row, chan) like a \c mav<complex<T>,2>. */
+    template<typename Tms> void ms2dirty(const Tms &ms, const mav<T,2> &wgt,
+      mav<T,2> &dirty)
+      {
+      checkInputs(ms.shape(), wgt, dirty.shape());
+      if (nvis==0)
+        { dirty.fill(0); return; }
+      timers.push("ms2dirty");
+      auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+      auto serv = makeMsServ(baselines,idx2,ms,wgt);
+      x2dirty(*gconf, serv, dirty, do_wgridding, wmin, wmax, verbosity,
+        divide_by_n, &planes);
+      timers.pop();
+      if (verbosity>0)
+        timers.report(cout);
+      }
+
+    void dirty2ms(const mav<T,2> &dirty, const mav<T,2> &wgt,
+      mav<complex<T>,2> &ms)
+      {
+      checkInputs(ms.shape(), wgt, dirty.shape());
+      ms.fill(0);
+      if (nvis==0) return;
+      timers.push("dirty2ms");
+      auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+      auto serv = makeMsServ(baselines,idx2,ms,wgt);
+      dirty2x(*gconf, dirty, serv, do_wgridding, wmin, wmax, verbosity,
+        divide_by_n, &planes);
+      timers.pop();
+      if (verbosity>0)
+        timers.report(cout);
+      }
+
+    size_t Nvis() const { return nvis; }
+    size_t Nu() const { return gconf ? gconf->Nu() : 0; }
+    size_t Nv() const { return gconf ? gconf->Nv() : 0; }
+    size_t Nplanes() const { return do_wgridding ? planes.nplanes : 0; }
+  };
+
+/*! Normal operator ms2dirty(dirty2ms(x)) of the gridder, applied as a
+    convolution with the point spread function.
+    The PSF is computed once with the gridder on an image of twice the size
+    in each direction; every application then only needs one real-to-complex
+    and one complex-to-real FFT of such a zero-padded image. The result is
+    exact up to the gridding accuracy. */
+template<typename T> class GramOperator
+  {
+  private:
+    // visibilities of the PSF computation: the squared weights (or 1)
+    class PsfVis
+      {
+      private:
+        const mav<T,2> &wgt;
+        array<size_t,2> shp;
+        bool have_wgt;
+
+      public:
+        PsfVis(const mav<T,2> &wgt_, size_t nrow, size_t nchan)
+          : wgt(wgt_), shp{nrow, nchan}, have_wgt(wgt.size()!=0) {}
+        const array<size_t,2> &shape() const { return shp; }
+        complex<T> operator()(size_t row, size_t chan) const
+          { return have_wgt ? wgt(row,chan)*wgt(row,chan) : T(1); }
+      };
+
+    size_t nxdirty, nydirty, nthreads;
+    // FFT of the PSF, normalized and in r2c layout
+    mav<complex<T>,2> psf_fft;
+
+  public:
+    /*! The w term makes the operator position-dependent, so that it cannot
+        be written as a convolution; the operator is therefore always that of
+        the gridder without w-gridding. */
+    GramOperator(const mav<double,2> &uvw, const mav<double,1> &freq,
+      const mav<T,2> &wgt, const mav<uint8_t,2> &mask, size_t nxdirty_,
+      size_t nydirty_, double pixsize_x, double pixsize_y, double epsilon,
+      size_t nthreads_, size_t verbosity)
+      : nxdirty(nxdirty_), nydirty(nydirty_), nthreads(nthreads_),
+        psf_fft({2*nxdirty, nydirty+1})
+      {
+      size_t nrow=uvw.shape(0), nchan=freq.shape(0);
+      if (wgt.size()!=0) checkShape(wgt.shape(), {nrow, nchan});
+      size_t nx2=2*nxdirty, ny2=2*nydirty;
+
+      PsfVis vis(wgt, nrow, nchan);
+      mav<T,2> null_wgt(nullptr, {0,0}, false);
+      mav<T,2> psf({nx2, ny2}), shifted({nx2, ny2});
+      GridderPlan<T> plan(uvw, freq, mask, nx2, ny2, pixsize_x, pixsize_y,
+        0, 0, epsilon, false, nthreads, verbosity, false, false);
+      plan.ms2dirty(vis, null_wgt, psf);
+      // move the origin of the PSF to pixel (0,0)
+      for (size_t i=0; i<nx2; ++i)
+        for (size_t j=0; j<ny2; ++j)
+          shifted.v(i,j) = psf((i+nxdirty)%nx2, (j+nydirty)%ny2);
+      fmav<T> fshifted(shifted);
+      fmav<complex<T>> fpsf(psf_fft);
+      r2c(fshifted, fpsf, {0,1}, true, T(1)/T(nx2*ny2), nthreads);
+      }
+
+    /*! Computes \a out = ms2dirty(dirty2ms(\a in)) with the weights and mask
+        passed to the constructor. */
+    void apply(const mav<T,2> &in, mav<T,2> &out) const
+      {
+      checkShape(in.shape(), {nxdirty, nydirty});
+      checkShape(out.shape(), {nxdirty, nydirty});
+      size_t nx2=2*nxdirty, ny2=2*nydirty;
+      mav<T,2> buf({nx2, ny2});
+      auto buf0 = buf.template subarray<2>({0,0}, {nxdirty, nydirty});
+      mav_apply([](T &b, const T &i) { b=i; }, nthreads, buf0, in);
+      mav<complex<T>,2> spec({nx2, ny2/2+1});
+      fmav<T> fbuf(buf);
+      fmav<complex<T>> fspec(spec);
+      r2c(fbuf, fspec, {0,1}, true, T(1), nthreads);
+      mav_apply([](complex<T> &s, const complex<T> &p) { s*=p; }, nthreads,
+        spec, psf_fft);
+      c2r(fspec, fbuf, {0,1}, false, T(1), nthreads);
+      mav_apply([](T &o, const T &b) { o=b; }, nthreads, out, buf0);
+      }
+  };
+
 } // namespace detail_gridder
 
 // public names
 using detail_gridder::ms2dirty;
 using detail_gridder::dirty2ms;
+using detail_gridder::ms2dirty_cube;
+using detail_gridder::dirty2ms_cube;
+using detail_gridder::ms2dirty_smeared;
+using detail_gridder::dirty2ms_smeared;
+using detail_gridder::Baselines;
+using detail_gridder::ChannelRuns;
+using detail_gridder::GridderPlan;
+using detail_gridder::GramOperator;
+using detail_gridder::calibrateCostModel;
+using detail_gridder::loadCostModel;
+using detail_gridder::saveCostModel;
 
 } // namespace ducc0
 
@@ -0,0 +1,172 @@
+#ifndef GRIDDER_MPI_H
+#define GRIDDER_MPI_H
+
+/*
+ *  This file is part of nifty_gridder.
+ *
+ *  nifty_gridder is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nifty_gridder is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nifty_gridder; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+/* Distributed versions of ms2dirty() and dirty2ms(): every task passes only
+   the rows of the measurement set it owns, while the dirty image is
+   replicated on all tasks.
+
+   All tasks agree on the w range and the number of visibilities, so they
+   use identical uv grids, kernels and w planes. Every task grids its local
+   visibilities and transforms them to a local dirty image; w planes without
+   local visibilities are skipped, so if the rows are distributed by w, every
+   task only FFTs its own subset of the planes. Since the operation is linear,
+   the local images are then summed with a single allreduce. This is cheaper
+   than reducing the uv grids before the FFT: the dirty image is much smaller
+   than the oversampled complex grid, and it is reduced once instead of once
+   per w plane.
+   The adjoint needs no communication at all: every task degrids its local
+   visibilities from the (replicated) dirty image. */
+
+#include <vector>
+
+#include "ducc0/infra/communication.h"
+#include "python/gridder_cxx.h"
+
+namespace ducc0 {
+
+namespace detail_gridder {
+
+using namespace std;
+
+/* Reduces the results of scanData() over all tasks of comm. */
+inline void reduceScan(const Communicator &comm, double &wmin, double &wmax,
+  size_t &nvis)
+  {
+  wmin = comm.allreduce(wmin, Communicator::Min);
+  wmax = comm.allreduce(wmax, Communicator::Max);
+  nvis = size_t(comm.allreduce(long(nvis), Communicator::Sum));
+  }
+
+/* Parameters as for ms2dirty(); uvw, ms, wgt and mask only contain the rows
+   owned by this task. On exit, dirty contains the image of all visibilities
+   on every task. */
+template<typename T, typename Tacc=T, typename Tuvw=double> void ms2dirty_mpi(
+  const Communicator &comm, const mav<Tuvw,2> &uvw,
+  const mav<double,1> &freq, const mav<complex<T>,2> &ms,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  bool do_wgridding, size_t nthreads, mav<T,2> &dirty, size_t verbosity,
+  bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  TimerHierarchy timers("gridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  // adjust for increased error when gridding in 2 or 3 dimensions
+  epsilon /= do_wgridding ? 3 : 2;
+  auto [wmin, wmax, nvis_loc, active] = scanData(baselines, ms, wgt, mask, nthreads, timers);
+  size_t nvis = nvis_loc;
+  timers.push("reduction of scan results");
+  reduceScan(comm, wmin, wmax, nvis);
+  timers.pop();
+  if (nvis==0)
+    { dirty.fill(0); return; }
+  mav<Tacc,2> ldirty({dirty.shape(0), dirty.shape(1)});
+  if (nvis_loc>0)
+    {
+    // the grid parameters are chosen for the average load of a task
+    size_t ntasks = size_t(comm.num_ranks());
+    auto [nu2, nv2, kidx] = getGridParams<T, Tacc>(epsilon, do_wgridding, wmin, wmax, (nvis+ntasks-1)/ntasks, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+    GridderConfig<Tacc> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+    gconf.setWPlaneMemory(wplane_mem);
+    auto idx = getIndices(baselines, gconf, active);
+    timers.push("MsServ construction");
+    auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+    auto serv = makeMsServ(baselines,idx2,ms,wgt);
+    timers.pop();
+    x2dirty(gconf, serv, ldirty, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    }
+  timers.push("reduction of dirty image");
+  vector<Tacc> buf(dirty.size()), sum(dirty.size());
+  for (size_t i=0, k=0; i<dirty.shape(0); ++i)
+    for (size_t j=0; j<dirty.shape(1); ++j, ++k)
+      buf[k] = ldirty(i,j);
+  comm.allreduceRaw(buf.data(), sum.data(), buf.size(), Communicator::Sum);
+  for (size_t i=0, k=0; i<dirty.shape(0); ++i)
+    for (size_t j=0; j<dirty.shape(1); ++j, ++k)
+      dirty.v(i,j) = T(sum[k]);
+  timers.pop();
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+/* Parameters as for dirty2ms(); dirty must be identical on all tasks, while
+   uvw, wgt, mask and ms only contain the rows owned by this task. */
+template<typename T, typename Tacc=T, typename Tuvw=double> void dirty2ms_mpi(
+  const Communicator &comm, const mav<Tuvw,2> &uvw,
+  const mav<double,1> &freq, const mav<T,2> &dirty,
+  const mav<T,2> &wgt, const mav<uint8_t,2> &mask, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+  double epsilon, bool do_wgridding, size_t nthreads, mav<complex<T>,2> &ms,
+  size_t verbosity, bool negate_v=false, bool divide_by_n=true,
+  double wplane_mem=0)
+  {
+  TimerHierarchy timers("degridding");
+  timers.push("Baseline construction");
+  Baselines baselines(uvw, freq, negate_v);
+  timers.pop();
+  // adjust for increased error when gridding in 2 or 3 dimensions
+  epsilon /= do_wgridding ? 3 : 2;
+  mav<complex<T>,2> null_ms(nullptr, {0,0}, false);
+  timers.push("MS zeroing");
+  ms.fill(0);
+  timers.pop();
+  auto [wmin, wmax, nvis_loc, active] = scanData(baselines, null_ms, wgt, mask, nthreads, timers);
+  size_t nvis = nvis_loc;
+  timers.push("reduction of scan results");
+  reduceScan(comm, wmin, wmax, nvis);
+  timers.pop();
+  if (nvis_loc==0)
+    return;
+  size_t ntasks = size_t(comm.num_ranks());
+  auto [nu2, nv2, kidx] = getGridParams<T, Tacc>(epsilon, do_wgridding, wmin, wmax, (nvis+ntasks-1)/ntasks, dirty.shape(0), dirty.shape(1), pixsize_x, pixsize_y, nu, nv, timers);
+  GridderConfig<Tacc> gconf(dirty.shape(0), dirty.shape(1), nu2, nv2, kidx, epsilon, pixsize_x, pixsize_y, baselines, nthreads, timers);
+  gconf.setWPlaneMemory(wplane_mem);
+  auto idx = getIndices(baselines, gconf, active);
+  timers.push("MsServ construction");
+  auto idx2 = mav<idx_t,1>(idx.data(),{idx.size()});
+  timers.pop();
+  auto serv = makeMsServ(baselines,idx2,ms,wgt);
+  if constexpr (is_same<T, Tacc>::value)
+    dirty2x(gconf, dirty, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+  else
+    {
+    mav<Tacc,2> dirty2(dirty.shape());
+    for (size_t i=0; i<dirty.shape(0); ++i)
+      for (size_t j=0; j<dirty.shape(1); ++j)
+        dirty2.v(i,j) = Tacc(dirty(i,j));
+    dirty2x(gconf, dirty2, serv, do_wgridding, wmin, wmax, verbosity, divide_by_n);
+    }
+  if (verbosity>0)
+    timers.report(cout);
+  }
+
+} // namespace detail_gridder
+
+// public names
+using detail_gridder::ms2dirty_mpi;
+using detail_gridder::dirty2ms_mpi;
+
+} // namespace ducc0
+
+#endif
@@ -34,9 +34,11 @@
 #include <string>
 
 #include "ducc0/healpix/healpix_base.h"
+#include "ducc0/healpix/healpix_map.h"
 #include "ducc0/math/constants.h"
 #include "ducc0/infra/string_utils.h"
 #include "ducc0/math/geom_utils.h"
+#include "ducc0/infra/threading.h"
 #include "ducc0/bindings/pybind_utils.h"
 
 namespace ducc0 {
@@ -49,6 +51,9 @@ namespace py = pybind11;
 
 using shape_t = fmav_info::shape_t;
 
+// number of values passed at once to the array versions of ang2pix() etc.
+constexpr size_t blksize = 64;
+
 template<size_t nd1, size_t nd2> shape_t repl_dim(const shape_t &s,
   const array<size_t,nd1> &si, const array<size_t,nd2> &so)
   {
@@ -65,8 +70,11 @@ template<size_t nd1, size_t nd2> shape_t repl_dim(const shape_t &s,
   return snew;
   }
 
+/* Calls func(iin, iout, lo, hi) for ranges [lo; hi) of the first iterator
+   dimension, distributed over nthreads threads. The GIL is released while
+   func is running. */
 template<typename T1, typename T2, size_t nd1, size_t nd2, typename Func>
-  py::array doStuff(const py::array &ain, const array<size_t,nd1> &a1, const array<size_t,nd2> &a2, Func func)
+  py::array doStuff(const py::array &ain, const array<size_t,nd1> &a1, const array<size_t,nd2> &a2, size_t nthreads, Func func)
   {
   auto in = to_fmav<T1>(ain);
   auto oshp = repl_dim(in.shape(), a1, a2);
@@ -74,14 +82,33 @@ template<typename T1, typename T2, size_t nd1, size_t nd2, typename Func>
   auto out = to_fmav<T2>(aout,true);
   MavIter<T1,nd1+1> iin(in);
   MavIter<T2,nd2+1> iout(out);
+  {
+  py::gil_scoped_release release;
   while (!iin.done())
     {
-    func(iin, iout);
+    execStatic(iin.shape(0), nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext())
+        func(iin, iout, rng.lo, rng.hi);
+      });
     iin.inc();iout.inc();
     }
+  }
   return move(aout);
   }
 
+py::array rs2arr(const rangeset<int64_t> &pixset)
+  {
+  auto res = make_Pyarr<int64_t>(shape_t({pixset.nranges(),2}));
+  auto oref=res.mutable_unchecked<2>();
+  for (size_t i=0; i<pixset.nranges(); ++i)
+    {
+    oref(i,0)=pixset.ivbegin(i);
+    oref(i,1)=pixset.ivend(i);
+    }
+  return move(res);
+  }
+
 class Pyhpbase
   {
   public:
@@ -101,49 +128,81 @@ class Pyhpbase
         ", Scheme=" + ((base.Scheme()==RING) ? "RING" : "NEST") +".>";
       }
 
-    py::array pix2ang (const py::array &pix) const
+    py::array pix2ang (const py::array &pix, size_t nthreads) const
       {
-      return doStuff<int64_t, double, 0, 1>(pix, {}, {2}, [this](const MavIter<int64_t,1> &iin, MavIter<double,2> &iout)
+      return doStuff<int64_t, double, 0, 1>(pix, {}, {2}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<double,2> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           {
           pointing ptg=base.pix2ang(iin(i));
           iout.v(i,0) = ptg.theta; iout.v(i,1) = ptg.phi;
           }
         });
       }
-    py::array ang2pix (const py::array &ang) const
+    py::array ang2pix (const py::array &ang, size_t nthreads) const
       {
-      return doStuff<double, int64_t, 1, 0>(ang, {2}, {}, [this](const MavIter<double,2> &iin, MavIter<int64_t,1> &iout)
+      return doStuff<double, int64_t, 1, 0>(ang, {2}, {}, nthreads,
+        [this](const MavIter<double,2> &iin, MavIter<int64_t,1> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iout.shape(0); ++i)
-          iout.v(i)=base.ang2pix(pointing(iin(i,0),iin(i,1)));
+        array<pointing,blksize> ang;
+        array<int64_t,blksize> pix;
+        for (size_t i0=lo; i0<hi; i0+=blksize)
+          {
+          size_t n = min(blksize, hi-i0);
+          for (size_t i=0; i<n; ++i)
+            ang[i] = pointing(iin(i0+i,0),iin(i0+i,1));
+          base.ang2pix(ang.data(), pix.data(), n);
+          for (size_t i=0; i<n; ++i)
+            iout.v(i0+i)=pix[i];
+          }
         });
       }
-    py::array pix2vec (const py::array &pix) const
+    py::array pix2vec (const py::array &pix, size_t nthreads) const
       {
-      return doStuff<int64_t, double, 0, 1>(pix, {}, {3}, [this](const MavIter<int64_t,1> &iin, MavIter<double,2> &iout)
+      return doStuff<int64_t, double, 0, 1>(pix, {}, {3}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<double,2> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        array<int64_t,blksize> pix;
+        array<vec3,blksize> vec;
+        for (size_t i0=lo; i0<hi; i0+=blksize)
           {
-          vec3 v=base.pix2vec(iin(i));
-          iout.v(i,0)=v.x; iout.v(i,1)=v.y; iout.v(i,2)=v.z;
+          size_t n = min(blksize, hi-i0);
+          for (size_t i=0; i<n; ++i)
+            pix[i] = iin(i0+i);
+          base.pix2vec(pix.data(), vec.data(), n);
+          for (size_t i=0; i<n; ++i)
+            {
+            const auto &v(vec[i]);
+            iout.v(i0+i,0)=v.x; iout.v(i0+i,1)=v.y; iout.v(i0+i,2)=v.z;
+            }
           }
         });
       }
-    py::array vec2pix (const py::array &vec) const
+    py::array vec2pix (const py::array &vec, size_t nthreads) const
       {
-      return doStuff<double, int64_t, 1, 0>(vec, {3}, {}, [this](const MavIter<double,2> &iin, MavIter<int64_t,1> &iout)
+      return doStuff<double, int64_t, 1, 0>(vec, {3}, {}, nthreads,
+        [this](const MavIter<double,2> &iin, MavIter<int64_t,1> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iout.shape(0); ++i)
-          iout.v(i)=base.vec2pix(vec3(iin(i,0),iin(i,1),iin(i,2)));
+        array<vec3,blksize> vec;
+        array<int64_t,blksize> pix;
+        for (size_t i0=lo; i0<hi; i0+=blksize)
+          {
+          size_t n = min(blksize, hi-i0);
+          for (size_t i=0; i<n; ++i)
+            vec[i] = vec3(iin(i0+i,0),iin(i0+i,1),iin(i0+i,2));
+          base.vec2pix(vec.data(), pix.data(), n);
+          for (size_t i=0; i<n; ++i)
+            iout.v(i0+i)=pix[i];
+          }
         });
       }
-    py::array pix2xyf (const py::array &pix) const
+    py::array pix2xyf (const py::array &pix, size_t nthreads) const
       {
-      return doStuff<int64_t, int64_t, 0, 1>(pix, {}, {3}, [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,2> &iout)
+      return doStuff<int64_t, int64_t, 0, 1>(pix, {}, {3}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,2> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           {
           int x,y,f;
           base.pix2xyf(iin(i),x,y,f);
@@ -151,19 +210,21 @@ class Pyhpbase
           }
         });
       }
-    py::array xyf2pix (const py::array &xyf) const
+    py::array xyf2pix (const py::array &xyf, size_t nthreads) const
       {
-      return doStuff<int64_t, int64_t, 1, 0>(xyf, {3}, {}, [this](const MavIter<int64_t,2> &iin, MavIter<int64_t,1> &iout)
+      return doStuff<int64_t, int64_t, 1, 0>(xyf, {3}, {}, nthreads,
+        [this](const MavIter<int64_t,2> &iin, MavIter<int64_t,1> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iout.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           iout.v(i)=base.xyf2pix(iin(i,0),iin(i,1),iin(i,2));
         });
       }
-    py::array neighbors (const py::array &pix) const
+    py::array neighbors (const py::array &pix, size_t nthreads) const
       {
-      return doStuff<int64_t, int64_t, 0, 1>(pix, {}, {8}, [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,2> &iout)
+      return doStuff<int64_t, int64_t, 0, 1>(pix, {}, {8}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,2> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           {
           array<int64_t,8> res;
           base.neighbors(iin(i),res);
@@ -171,19 +232,21 @@ class Pyhpbase
           }
         });
       }
-    py::array ring2nest (const py::array &ring) const
+    py::array ring2nest (const py::array &ring, size_t nthreads) const
       {
-      return doStuff<int64_t, int64_t, 0, 0>(ring, {}, {}, [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,1> &iout)
+      return doStuff<int64_t, int64_t, 0, 0>(ring, {}, {}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,1> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           iout.v(i)=base.ring2nest(iin(i));
         });
       }
-    py::array nest2ring (const py::array &nest) const
+    py::array nest2ring (const py::array &nest, size_t nthreads) const
       {
-      return doStuff<int64_t, int64_t, 0, 0>(nest, {}, {}, [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,1> &iout)
+      return doStuff<int64_t, int64_t, 0, 0>(nest, {}, {}, nthreads,
+        [this](const MavIter<int64_t,1> &iin, MavIter<int64_t,1> &iout, size_t lo, size_t hi)
         {
-        for (size_t i=0; i<iin.shape(0); ++i)
+        for (size_t i=lo; i<hi; ++i)
           iout.v(i)=base.nest2ring(iin(i));
         });
       }
@@ -193,41 +256,177 @@ class Pyhpbase
         "ptg must be a 1D array with 2 values");
       rangeset<int64_t> pixset;
       auto ptg2 = to_mav<double,1>(ptg);
+      {
+      py::gil_scoped_release release;
       base.query_disc(pointing(ptg2(0),ptg2(1)), radius, pixset);
-      auto res = make_Pyarr<int64_t>(shape_t({pixset.nranges(),2}));
-      auto oref=res.mutable_unchecked<2>();
-      for (size_t i=0; i<pixset.nranges(); ++i)
+      }
+      return rs2arr(pixset);
+      }
+    py::array query_polygon(const py::array &vertex, size_t nthreads) const
+      {
+      auto vtx = to_mav<double,2>(vertex);
+      MR_assert(vtx.shape(1)==2, "vertex must be a 2D array of shape (n,2)");
+      vector<pointing> vv;
+      for (size_t i=0; i<vtx.shape(0); ++i)
+        vv.push_back(pointing(vtx(i,0),vtx(i,1)));
+      rangeset<int64_t> pixset;
+      {
+      py::gil_scoped_release release;
+      base.query_polygon(vv, pixset, nthreads);
+      }
+      return rs2arr(pixset);
+      }
+    py::tuple query_disc_batch(const py::array &ptg, const py::object &radius,
+      size_t nthreads) const
+      {
+      auto ptg2 = to_mav<double,2>(ptg);
+      MR_assert(ptg2.shape(1)==2, "ptg must be a 2D array of shape (n,2)");
+      size_t n = ptg2.shape(0);
+      auto rad = to_fmav<double>(py::array::ensure(radius));
+      MR_assert((rad.ndim()==0) || ((rad.ndim()==1)&&(rad.shape(0)==n)),
+        "radius must be a scalar or a 1D array with one entry per pointing");
+      const double *rptr = rad.data();
+      ptrdiff_t rstr = (rad.ndim()==0) ? 0 : rad.stride(0);
+      if (nthreads==0) nthreads = get_default_nthreads();
+
+      // every thread appends the ranges of its discs to its own buffer;
+      // for each disc we remember the buffer, position and number of ranges
+      vector<vector<int64_t>> buf(nthreads);
+      vector<size_t> tid(n), start(n), cnt(n);
+      {
+      py::gil_scoped_release release;
+      execDynamic(n, nthreads, 64, [&](Scheduler &sched)
+        {
+        auto mytid = sched.thread_num();
+        auto &mybuf(buf[mytid]);
+        rangeset<int64_t> pixset;
+        while (auto rng=sched.getNext())
+          for (size_t i=rng.lo; i<rng.hi; ++i)
+            {
+            base.query_disc(pointing(ptg2(i,0),ptg2(i,1)), rptr[i*rstr],
+              pixset);
+            tid[i] = mytid;
+            start[i] = mybuf.size();
+            cnt[i] = pixset.nranges();
+            const auto &r(pixset.data());
+            mybuf.insert(mybuf.end(), r.begin(), r.end());
+            }
+        });
+      }
+      auto offsets = make_Pyarr<int64_t>(shape_t({n+1}));
+      auto ofs = to_mav<int64_t,1>(offsets, true);
+      ofs.v(0) = 0;
+      for (size_t i=0; i<n; ++i)
+        ofs.v(i+1) = ofs(i) + int64_t(cnt[i]);
+      auto ranges = make_Pyarr<int64_t>(shape_t({size_t(ofs(n)),2}));
+      auto out = to_mav<int64_t,2>(ranges, true);
+      {
+      py::gil_scoped_release release;
+      execStatic(n, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext())
+          for (size_t i=rng.lo; i<rng.hi; ++i)
+            {
+            const int64_t *src = buf[tid[i]].data() + start[i];
+            for (size_t j=0; j<cnt[i]; ++j)
+              {
+              out.v(ofs(i)+j,0) = src[2*j];
+              out.v(ofs(i)+j,1) = src[2*j+1];
+              }
+            }
+        });
+      }
+      return py::make_tuple(offsets, ranges);
+      }
+    py::tuple get_interpol (const py::array &ang, size_t nthreads) const
+      {
+      auto in = to_fmav<double>(ang);
+      auto oshp = repl_dim<1,1>(in.shape(), {2}, {4});
+      auto apix = make_Pyarr<int64_t>(oshp);
+      auto awgt = make_Pyarr<double>(oshp);
+      auto pix = to_fmav<int64_t>(apix,true);
+      auto wgt = to_fmav<double>(awgt,true);
+      MavIter<double,2> iin(in);
+      MavIter<int64_t,2> ipix(pix);
+      MavIter<double,2> iwgt(wgt);
+      {
+      py::gil_scoped_release release;
+      while (!iin.done())
         {
-        oref(i,0)=pixset.ivbegin(i);
-        oref(i,1)=pixset.ivend(i);
+        execStatic(iin.shape(0), nthreads, 0, [&](Scheduler &sched)
+          {
+          array<int64_t,4> p;
+          array<double,4> w;
+          while (auto rng=sched.getNext())
+            for (size_t i=rng.lo; i<rng.hi; ++i)
+              {
+              base.get_interpol(pointing(iin(i,0),iin(i,1)), p, w);
+              for (size_t j=0; j<4; ++j)
+                { ipix.v(i,j)=p[j]; iwgt.v(i,j)=w[j]; }
+              }
+          });
+        iin.inc(); ipix.inc(); iwgt.inc();
         }
-      return move(res);
+      }
+      return py::make_tuple(apix, awgt);
+      }
+    template<typename T> py::array interpolate_map2 (const py::array &map,
+      const py::array &ang, size_t nthreads) const
+      {
+      auto m = to_mav<T,1>(map);
+      MR_assert(m.shape(0)==size_t(base.Npix()), "bad map size");
+      // pixel indices, weights and the map values are combined on the fly,
+      // so no intermediate arrays are needed
+      return doStuff<double, T, 1, 0>(ang, {2}, {}, nthreads,
+        [this,&m](const MavIter<double,2> &iin, MavIter<T,1> &iout, size_t lo, size_t hi)
+        {
+        array<int64_t,4> p;
+        array<double,4> w;
+        for (size_t i=lo; i<hi; ++i)
+          {
+          base.get_interpol(pointing(iin(i,0),iin(i,1)), p, w);
+          iout.v(i) = T(m(p[0])*w[0] + m(p[1])*w[1]
+                      + m(p[2])*w[2] + m(p[3])*w[3]);
+          }
+        });
+      }
+    py::array interpolate_map (const py::array &map, const py::array &ang,
+      size_t nthreads) const
+      {
+      if (isPyarr<double>(map))
+        return interpolate_map2<double>(map, ang, nthreads);
+      if (isPyarr<float>(map))
+        return interpolate_map2<float>(map, ang, nthreads);
+      MR_fail("type matching failed: 'map' has neither type 'f4' nor 'f8'");
       }
   };
 
-py::array ang2vec (const py::array &ang)
+py::array ang2vec (const py::array &ang, size_t nthreads)
   {
-  return doStuff<double, double, 1, 1>(ang, {2}, {3}, [](const MavIter<double,2> &iin, MavIter<double,2> &iout)
+  return doStuff<double, double, 1, 1>(ang, {2}, {3}, nthreads,
+    [](const MavIter<double,2> &iin, MavIter<double,2> &iout, size_t lo, size_t hi)
     {
-    for (size_t i=0; i<iin.shape(0); ++i)
+    for (size_t i=lo; i<hi; ++i)
       {
       vec3 v (pointing(iin(i,0),iin(i,1)));
       iout.v(i,0)=v.x; iout.v(i,1)=v.y; iout.v(i,2)=v.z;
       }
     });
   }
-py::array vec2ang (const py::array &vec)
+py::array vec2ang (const py::array &vec, size_t nthreads)
   {
-  return doStuff<double, double, 1, 1>(vec, {3}, {2}, [](const MavIter<double,2> &iin, MavIter<double,2> &iout)
+  return doStuff<double, double, 1, 1>(vec, {3}, {2}, nthreads,
+    [](const MavIter<double,2> &iin, MavIter<double,2> &iout, size_t lo, size_t hi)
     {
-    for (size_t i=0; i<iin.shape(0); ++i)
+    for (size_t i=lo; i<hi; ++i)
       {
       pointing ptg (vec3(iin(i,0),iin(i,1),iin(i,2)));
       iout.v(i,0)=ptg.theta; iout.v(i,1)=ptg.phi;
       }
     });
   }
-py::array local_v_angle (const py::array &v1, const py::array &v2)
+py::array local_v_angle (const py::array &v1, const py::array &v2,
+  size_t nthreads)
   {
   auto v12 = to_fmav<double>(v1);
   auto v22 = to_fmav<double>(v2);
@@ -236,16 +435,85 @@ py::array local_v_angle (const py::array &v1, const py::array &v2)
   auto angle2 = to_fmav<double>(angle,true);
   MavIter<double,2> ii1(v12), ii2(v22);
   MavIter<double,1> iout(angle2);
+  {
+  py::gil_scoped_release release;
   while (!iout.done())
     {
-    for (size_t i=0; i<iout.shape(0); ++i)
-      iout.v(i)=v_angle(vec3(ii1(i,0),ii1(i,1),ii1(i,2)),
-                        vec3(ii2(i,0),ii2(i,1),ii2(i,2)));
+    execStatic(iout.shape(0), nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext())
+        for (size_t i=rng.lo; i<rng.hi; ++i)
+          iout.v(i)=v_angle(vec3(ii1(i,0),ii1(i,1),ii1(i,2)),
+                            vec3(ii2(i,0),ii2(i,1),ii2(i,2)));
+      });
     ii1.inc();ii2.inc();iout.inc();
     }
+  }
   return move(angle);
   }
 
+Ordering_Scheme get_scheme(const string &scheme)
+  {
+  MR_assert((scheme=="RING")||(scheme=="NEST"), "unknown ordering scheme");
+  return (scheme=="RING") ? RING : NEST;
+  }
+
+template<typename T> py::array ud_grade2(const py::array &map,
+  const string &scheme_in, int64_t nside_out, const string &scheme_out,
+  bool pessimistic, size_t nthreads)
+  {
+  auto in = to_mav<T,1>(map);
+  Healpix_Base2 bin(Healpix_Base2::npix2nside(in.shape(0)),
+    get_scheme(scheme_in), SET_NSIDE);
+  Healpix_Base2 bout(nside_out, get_scheme(scheme_out), SET_NSIDE);
+  auto res = make_Pyarr<T>(shape_t({size_t(bout.Npix())}));
+  auto out = to_mav<T,1>(res, true);
+  {
+  py::gil_scoped_release release;
+  if (bin.Nside()<bout.Nside())
+    upgrade_map(bin, in, bout, out, nthreads);
+  else if (bin.Nside()>bout.Nside())
+    degrade_map(bin, in, bout, out, pessimistic, nthreads);
+  else if (bin.Scheme()!=bout.Scheme())
+    reorder_map(bin, in, out, nthreads);
+  else
+    out.apply(in, [](T &v1, const T &v2) { v1=v2; });
+  }
+  return move(res);
+  }
+py::array ud_grade(const py::array &map, const string &scheme_in,
+  int64_t nside_out, const string &scheme_out, bool pessimistic,
+  size_t nthreads)
+  {
+  if (isPyarr<double>(map))
+    return ud_grade2<double>(map, scheme_in, nside_out, scheme_out,
+      pessimistic, nthreads);
+  if (isPyarr<float>(map))
+    return ud_grade2<float>(map, scheme_in, nside_out, scheme_out,
+      pessimistic, nthreads);
+  MR_fail("type matching failed: 'map' has neither type 'f4' nor 'f8'");
+  }
+
+template<typename T> void swap_scheme2(py::array &map, const string &scheme,
+  size_t nthreads)
+  {
+  auto m = to_mav<T,1>(map, true);
+  Healpix_Base2 base(Healpix_Base2::npix2nside(m.shape(0)),
+    get_scheme(scheme), SET_NSIDE);
+  py::gil_scoped_release release;
+  mav<T,1> tmp({m.shape(0)});
+  tmp.apply(m, [](T &v1, const T &v2) { v1=v2; });
+  reorder_map(base, tmp, m, nthreads);
+  }
+void swap_scheme(py::array &map, const string &scheme, size_t nthreads)
+  {
+  if (isPyarr<double>(map))
+    return swap_scheme2<double>(map, scheme, nthreads);
+  if (isPyarr<float>(map))
+    return swap_scheme2<float>(map, scheme, nthreads);
+  MR_fail("type matching failed: 'map' has neither type 'f4' nor 'f8'");
+  }
+
 const char *healpix_DS = R"""(
 Python interface for some of the HEALPix C++ functionality
 
@@ -256,6 +524,10 @@ to pi (South Pole).
 All 3-vectors returned by the functions are normalized.
 However, 3-vectors provided as input to the functions need not be normalized.
 
+All functions operating on arrays of pixels, angles or vectors accept an
+optional "nthreads" argument (default 1), which is the number of threads used
+for the computation. The GIL is released during the computation.
+
 Error conditions are reported by raising exceptions.
 )""";
 
@@ -327,6 +599,56 @@ with last dimension 2; the pixels lying inside the disc are
 [res[0,0] .. res[0,1]); [res[1,0] .. res[1,1]) etc.
 )""";
 
+const char *query_polygon_DS = R"""(
+Returns a range set of all pixels whose centers fall within the convex polygon
+whose corners are given by "vertex", a 2D array of (co-latitude, longitude)
+tuples with shape (n,2), n>=3. The result has the format returned by
+query_disc.
+)""";
+
+const char *query_disc_batch_DS = R"""(
+Carries out query_disc for many discs at once.
+"ptg" must be a 2D array of shape (n,2) containing (co-latitude, longitude)
+tuples, "radius" is either a single value or a 1D array with n entries.
+Returns a tuple (offsets, ranges), where offsets has shape (n+1,) and ranges
+has shape (offsets[n],2). The pixel ranges of the i-th disc are
+ranges[offsets[i]:offsets[i+1]], in the format returned by query_disc.
+)""";
+
+const char *get_interpol_DS = R"""(
+Returns a tuple (pix, wgt) containing the four pixels and weights needed for
+bilinear interpolation at every (co-latitude, longitude) tuple in ang.
+ang must have a last dimension of size 2; both result arrays have the same
+shape as ang, except that their last dimension is 4 instead of 2.
+)""";
+
+const char *interpolate_map_DS = R"""(
+Returns the bilinearly interpolated values of "map" (a 1D float32 or float64
+array in the ordering scheme of this object) at every (co-latitude, longitude)
+tuple in ang. ang must have a last dimension of size 2; the result has the same
+shape as ang, without its last dimension, and the data type of "map".
+This is equivalent to computing sum(map[pix]*wgt, axis=-1) from the output of
+get_interpol, but needs no temporary arrays. Undefined map values are not
+treated specially.
+)""";
+
+const char *ud_grade_DS = R"""(
+Returns "map" (a 1D float32 or float64 array in the ordering scheme
+"scheme_in") converted to resolution "nside_out" and ordering scheme
+"scheme_out". One of the two Nside values must be an integer multiple of the
+other. When upgrading, every output pixel gets the value of the input pixel
+containing it; when degrading, it gets the average of all defined input pixels
+it contains. If "pessimistic" is True, output pixels are set to the HEALPix
+"undefined" value (-1.6375e30) as soon as one of their input pixels is
+undefined, otherwise only if all of them are undefined.
+)""";
+
+const char *swap_scheme_DS = R"""(
+Reorders "map" (a writable 1D float32 or float64 array in the ordering scheme
+"scheme") in place into the other ordering scheme. Nside must be a power of 2.
+A temporary copy of the map is used during the operation.
+)""";
+
 const char *ang2vec_DS = R"""(
 Returns a normalized 3-vector for every (co-latitude, longitude)
 tuple in ang. ang must have a last dimension of size 2; the result array
@@ -366,22 +688,41 @@ void add_healpix(py::module &msup)
       { return 4*pi/self.base.Npix(); }, pix_area_DS)
     .def("max_pixrad", [](Pyhpbase &self)
       { return self.base.max_pixrad(); }, max_pixrad_DS)
-    .def("pix2ang", &Pyhpbase::pix2ang, pix2ang_DS, "pix"_a)
-    .def("ang2pix", &Pyhpbase::ang2pix, ang2pix_DS, "ang"_a)
-    .def("pix2vec", &Pyhpbase::pix2vec, pix2vec_DS, "pix"_a)
-    .def("vec2pix", &Pyhpbase::vec2pix, vec2pix_DS, "vec"_a)
-    .def("pix2xyf", &Pyhpbase::pix2xyf, "pix"_a)
-    .def("xyf2pix", &Pyhpbase::xyf2pix, "xyf"_a)
-    .def("neighbors", &Pyhpbase::neighbors,"pix"_a)
-    .def("ring2nest", &Pyhpbase::ring2nest, ring2nest_DS, "ring"_a)
-    .def("nest2ring", &Pyhpbase::nest2ring, nest2ring_DS, "nest"_a)
+    .def("pix2ang", &Pyhpbase::pix2ang, pix2ang_DS, "pix"_a,
+      "nthreads"_a=1)
+    .def("ang2pix", &Pyhpbase::ang2pix, ang2pix_DS, "ang"_a,
+      "nthreads"_a=1)
+    .def("pix2vec", &Pyhpbase::pix2vec, pix2vec_DS, "pix"_a,
+      "nthreads"_a=1)
+    .def("vec2pix", &Pyhpbase::vec2pix, vec2pix_DS, "vec"_a,
+      "nthreads"_a=1)
+    .def("pix2xyf", &Pyhpbase::pix2xyf, "pix"_a, "nthreads"_a=1)
+    .def("xyf2pix", &Pyhpbase::xyf2pix, "xyf"_a, "nthreads"_a=1)
+    .def("neighbors", &Pyhpbase::neighbors,"pix"_a, "nthreads"_a=1)
+    .def("ring2nest", &Pyhpbase::ring2nest, ring2nest_DS, "ring"_a,
+      "nthreads"_a=1)
+    .def("nest2ring", &Pyhpbase::nest2ring, nest2ring_DS, "nest"_a,
+      "nthreads"_a=1)
     .def("query_disc", &Pyhpbase::query_disc, query_disc_DS, "ptg"_a,"radius"_a)
+    .def("query_polygon", &Pyhpbase::query_polygon, query_polygon_DS,
+      "vertex"_a, "nthreads"_a=1)
+    .def("query_disc_batch", &Pyhpbase::query_disc_batch, query_disc_batch_DS,
+      "ptg"_a, "radius"_a, "nthreads"_a=1)
+    .def("get_interpol", &Pyhpbase::get_interpol, get_interpol_DS, "ang"_a,
+      "nthreads"_a=1)
+    .def("interpolate_map", &Pyhpbase::interpolate_map, interpolate_map_DS,
+      "map"_a, "ang"_a, "nthreads"_a=1)
     .def("__repr__", &Pyhpbase::repr)
     ;
 
-  m.def("ang2vec",&ang2vec, ang2vec_DS, "ang"_a);
-  m.def("vec2ang",&vec2ang, vec2ang_DS, "vec"_a);
-  m.def("v_angle",&local_v_angle, v_angle_DS, "v1"_a, "v2"_a);
+  m.def("ang2vec",&ang2vec, ang2vec_DS, "ang"_a, "nthreads"_a=1);
+  m.def("vec2ang",&vec2ang, vec2ang_DS, "vec"_a, "nthreads"_a=1);
+  m.def("v_angle",&local_v_angle, v_angle_DS, "v1"_a, "v2"_a,
+    "nthreads"_a=1);
+  m.def("ud_grade",&ud_grade, ud_grade_DS, "map"_a, "scheme_in"_a,
+    "nside_out"_a, "scheme_out"_a, "pessimistic"_a=false, "nthreads"_a=1);
+  m.def("swap_scheme",&swap_scheme, swap_scheme_DS, "map"_a, "scheme"_a,
+    "nthreads"_a=1);
   }
 
 }
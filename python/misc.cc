@@ -27,10 +27,15 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <pybind11/stl.h>
 #include <vector>
+#include <memory>
 
 #include "ducc0/infra/mav.h"
+#include "ducc0/infra/aligned_array.h"
+#include "ducc0/infra/threading.h"
 #include "ducc0/infra/transpose.h"
+#include "ducc0/infra/timers.h"
 #include "ducc0/math/fft.h"
 #include "ducc0/math/constants.h"
 #include "ducc0/math/gl_integrator.h"
@@ -48,10 +53,13 @@ py::array GL_weights(size_t nlat, size_t nlon)
   {
   auto res = make_Pyarr<double>({nlat});
   auto res2 = to_mav<double,1>(res, true);
+  {
+  py::gil_scoped_release release;
   GL_Integrator integ(nlat);
   auto wgt = integ.weights();
   for (size_t i=0; i<res2.shape(0); ++i)
     res2.v(i) = wgt[i]*twopi/nlon;
+  }
   return move(res);
   }
 
@@ -59,150 +67,599 @@ py::array GL_thetas(size_t nlat)
   {
   auto res = make_Pyarr<double>({nlat});
   auto res2 = to_mav<double,1>(res, true);
+  {
+  py::gil_scoped_release release;
   GL_Integrator integ(nlat);
   auto x = integ.coords();
   for (size_t i=0; i<res2.shape(0); ++i)
     res2.v(i) = acos(-x[i]);
+  }
   return move(res);
   }
 
 template<typename T> py::array pyrotate_alm(const py::array &alm_, int64_t lmax,
-  double psi, double theta, double phi)
-  {
-  auto a1 = to_mav<complex<T>,1>(alm_);
-  auto alm = make_Pyarr<complex<T>>({a1.shape(0)});
-  auto a2 = to_mav<complex<T>,1>(alm,true);
-  for (size_t i=0; i<a1.shape(0); ++i) a2.v(i)=a1(i);
-  auto tmp = Alm<complex<T>>(a2,lmax,lmax);
-  rotate_alm(tmp, psi, theta, phi);
+  double psi, double theta, double phi, size_t nthreads)
+  {
+  // a 2D array holds several a_lm sets, which are rotated together
+  MR_assert((alm_.ndim()==1)||(alm_.ndim()==2), "alm must be 1D or 2D");
+  if (alm_.ndim()==1)
+    {
+    auto a1 = to_mav<complex<T>,1>(alm_);
+    auto alm = make_Pyarr<complex<T>>({a1.shape(0)});
+    auto a2 = to_mav<complex<T>,1>(alm,true);
+    {
+    py::gil_scoped_release release;
+    for (size_t i=0; i<a1.shape(0); ++i) a2.v(i)=a1(i);
+    auto tmp = Alm<complex<T>>(a2,lmax,lmax);
+    rotate_alm(tmp, psi, theta, phi, nthreads);
+    }
+    return move(alm);
+    }
+  auto a1 = to_mav<complex<T>,2>(alm_);
+  auto alm = make_Pyarr<complex<T>>({a1.shape(0), a1.shape(1)});
+  auto a2 = to_mav<complex<T>,2>(alm,true);
+  {
+  py::gil_scoped_release release;
+  vector<mav<complex<T>,1>> rows;
+  for (size_t j=0; j<a1.shape(0); ++j)
+    {
+    rows.push_back(a2.template subarray<1>({j,0},{0,a1.shape(1)}));
+    for (size_t i=0; i<a1.shape(1); ++i) rows[j].v(i)=a1(j,i);
+    }
+  vector<Alm<complex<T>>> tmp;
+  tmp.reserve(rows.size());
+  vector<Alm<complex<T>> *> ptr;
+  for (auto &r: rows)
+    {
+    tmp.emplace_back(r,lmax,lmax);
+    ptr.push_back(&tmp.back());
+    }
+  rotate_alm(ptr, psi, theta, phi, nthreads);
+  }
   return move(alm);
   }
 
-void upsample_to_cc(const mav<double,2> &in, bool has_np, bool has_sp,
-  mav<double,2> &out)
+py::array Py_alm2cl(const py::array &alm1_, const py::array &alm2_,
+  size_t lmax, size_t mmax, size_t nthreads)
   {
-  size_t ntheta_in = in.shape(0),
-         ntheta_out = out.shape(0),
-         nphi = in.shape(1);
-  MR_assert(out.shape(1)==nphi, "phi dimensions must be equal");
+  auto a1 = to_mav<complex<double>,1>(alm1_);
+  auto a2 = to_mav<complex<double>,1>(alm2_);
+  auto res = make_Pyarr<double>({lmax+1});
+  auto cl = to_mav<double,1>(res, true);
+  {
+  py::gil_scoped_release release;
+  Alm<complex<double>> alm1(a1, lmax, mmax), alm2(a2, lmax, mmax);
+  alm2cl(alm1, alm2, cl, nthreads);
+  }
+  return move(res);
+  }
+
+py::array Py_alm2lmajor(const py::array &alm_, size_t lmax, size_t mmax,
+  bool real, size_t nthreads)
+  {
+  auto a1 = to_mav<complex<double>,1>(alm_);
+  auto nout = lmajor_offsets(lmax, mmax, real).back();
+  if (real)
+    {
+    auto res = make_Pyarr<double>({nout});
+    auto out = to_mav<double,1>(res, true);
+    {
+    py::gil_scoped_release release;
+    alm2real_lmajor(Alm<complex<double>>(a1, lmax, mmax), out, nthreads);
+    }
+    return move(res);
+    }
+  auto res = make_Pyarr<complex<double>>({nout});
+  auto out = to_mav<complex<double>,1>(res, true);
+  {
+  py::gil_scoped_release release;
+  alm2lmajor(Alm<complex<double>>(a1, lmax, mmax), out, nthreads);
+  }
+  return move(res);
+  }
+
+py::array Py_lmajor2alm(const py::array &lmajor_, size_t lmax, size_t mmax,
+  size_t nthreads)
+  {
+  auto res = make_Pyarr<complex<double>>({Alm_Base::Num_Alms(lmax, mmax)});
+  auto out = to_mav<complex<double>,1>(res, true);
+  Alm<complex<double>> alm(out, lmax, mmax);
+  if (isPyarr<double>(lmajor_))
+    {
+    auto in = to_mav<double,1>(lmajor_);
+    py::gil_scoped_release release;
+    real_lmajor2alm(in, alm, nthreads);
+    }
+  else
+    {
+    auto in = to_mav<complex<double>,1>(lmajor_);
+    py::gil_scoped_release release;
+    lmajor2alm(in, alm, nthreads);
+    }
+  return move(res);
+  }
+
+/* Upsamples every component of in (shape (ncomp, ntheta_in, nphi)) to a
+   Clenshaw-Curtis grid with out.shape(1) rings. The work is distributed over
+   the components and blocks of phi columns; the FFT plans come from the
+   plan cache, so that repeated calls only pay for the transforms. */
+void upsample_to_cc(const mav<double,3> &in, bool has_np, bool has_sp,
+  mav<double,3> &out, size_t nthreads)
+  {
+  size_t ncomp = in.shape(0),
+         ntheta_in = in.shape(1),
+         ntheta_out = out.shape(1),
+         nphi = in.shape(2);
+  MR_assert(out.shape(0)==ncomp, "number of components must be equal");
+  MR_assert(out.shape(2)==nphi, "phi dimensions must be equal");
   MR_assert((nphi&1)==0, "nphi must be even");
   size_t nrings_in = 2*ntheta_in-has_np-has_sp;
   size_t nrings_out = 2*ntheta_out-2;
   MR_assert(nrings_out>=nrings_in, "number of rings must increase");
+  // keep the plans alive for the whole call
+  auto plan_in = get_plan<pocketfft_r<double>>(nrings_in);
+  auto plan_out = get_plan<pocketfft_r<double>>(nrings_out);
+  // phase factors for shifting the first ring to the pole
+  vector<complex<double>> rot;
+  if (!has_np)
+    {
+    rot.resize(ntheta_in);
+    double ang = -pi/nrings_in;
+    for (size_t i=1; i<ntheta_in; ++i)
+      rot[i] = complex<double>(cos(i*ang),sin(i*ang));
+    }
   constexpr size_t delta=128;
-  for (size_t js=0; js<nphi; js+=delta)
+  size_t nblocks = (nphi+delta-1)/delta;
+  execDynamic(ncomp*nblocks, nthreads, 1, [&](Scheduler &sched)
     {
-    size_t je = min(js+delta, nphi);
-    mav<double,2> tmp({nrings_out,je-js});
-    fmav<double> ftmp(tmp);
-    mav<double,2> tmp2(tmp.vdata(),{nrings_in, je-js}, true);
-    fmav<double> ftmp2(tmp2);
-    // enhance to "double sphere"
-    if (has_np)
-      for (size_t j=js; j<je; ++j)
-        tmp2.v(0,j-js) = in(0,j);
-    if (has_sp)
-      for (size_t j=js; j<je; ++j)
-        tmp2.v(ntheta_in-1,j-js) = in(ntheta_in-1,j);
-    for (size_t i=has_np, i2=nrings_in-1; i+has_sp<ntheta_in; ++i,--i2)
-      for (size_t j=js,j2=js+nphi/2; j<je; ++j,++j2)
-        {
-        if (j2>=nphi) j2-=nphi;
-        tmp2.v(i,j-js) = in(i,j);
-        tmp2.v(i2,j-js) = in(i,j2);
-        }
-    // FFT in theta direction
-    r2r_fftpack(ftmp2,ftmp2,{0},true,true,1./nrings_in,0);
-    if (!has_np)  // shift
+    scratch_array<double> buf(nrings_out*min(delta, nphi));
+    while (auto rng=sched.getNext()) for(auto idx=rng.lo; idx<rng.hi; ++idx)
       {
-      double ang = -pi/nrings_in;
-      for (size_t i=1; i<ntheta_in; ++i)
-        {
-        complex<double> rot(cos(i*ang),sin(i*ang));
+      size_t c = idx/nblocks;
+      size_t js = (idx%nblocks)*delta;
+      size_t je = min(js+delta, nphi);
+      mav<double,2> tmp(buf.data(),{nrings_out,je-js}, true);
+      fmav<double> ftmp(tmp);
+      mav<double,2> tmp2(buf.data(),{nrings_in, je-js}, true);
+      fmav<double> ftmp2(tmp2);
+      // enhance to "double sphere"
+      if (has_np)
         for (size_t j=js; j<je; ++j)
+          tmp2.v(0,j-js) = in(c,0,j);
+      if (has_sp)
+        for (size_t j=js; j<je; ++j)
+          tmp2.v(ntheta_in-1,j-js) = in(c,ntheta_in-1,j);
+      for (size_t i=has_np, i2=nrings_in-1; i+has_sp<ntheta_in; ++i,--i2)
+        for (size_t j=js,j2=js+nphi/2; j<je; ++j,++j2)
           {
-          complex<double> ctmp(tmp2(2*i-1,j-js),tmp2(2*i,j-js));
-          ctmp *= rot;
-          tmp2.v(2*i-1,j-js) = ctmp.real();
-          tmp2.v(2*i  ,j-js) = ctmp.imag();
+          if (j2>=nphi) j2-=nphi;
+          tmp2.v(i,j-js) = in(c,i,j);
+          tmp2.v(i2,j-js) = in(c,i,j2);
           }
-        }
+      // FFT in theta direction
+      r2r_fftpack(ftmp2,ftmp2,{0},true,true,1./nrings_in,1);
+      if (!has_np)  // shift
+        for (size_t i=1; i<ntheta_in; ++i)
+          for (size_t j=js; j<je; ++j)
+            {
+            complex<double> ctmp(tmp2(2*i-1,j-js),tmp2(2*i,j-js));
+            ctmp *= rot[i];
+            tmp2.v(2*i-1,j-js) = ctmp.real();
+            tmp2.v(2*i  ,j-js) = ctmp.imag();
+            }
+      // zero-padding
+      for (size_t i=nrings_in; i<nrings_out; ++i)
+        for (size_t j=js; j<je; ++j)
+          tmp.v(i,j-js) = 0;
+      // FFT back
+      r2r_fftpack(ftmp,ftmp,{0},false,false,1.,1);
+      // copy to output map
+      for (size_t i=0; i<ntheta_out; ++i)
+        for (size_t j=js; j<je; ++j)
+          out.v(c,i,j) = tmp(i,j-js);
       }
-    // zero-padding
-    for (size_t i=nrings_in; i<nrings_out; ++i)
-      for (size_t j=js; j<je; ++j)
-        tmp.v(i,j-js) = 0;
-    // FFT back
-    r2r_fftpack(ftmp,ftmp,{0},false,false,1.,0);
-    // copy to output map
-    for (size_t i=0; i<ntheta_out; ++i)
-      for (size_t j=js; j<je; ++j)
-        out.v(i,j) = tmp(i,j-js);
-    }
+    });
+  }
+
+void upsample_to_cc(const mav<double,2> &in, bool has_np, bool has_sp,
+  mav<double,2> &out, size_t nthreads=1)
+  {
+  mav<double,3> in3(in.data(), {1, in.shape(0), in.shape(1)},
+    {0, in.stride(0), in.stride(1)});
+  mav<double,3> out3(out.vdata(), {1, out.shape(0), out.shape(1)},
+    {0, out.stride(0), out.stride(1)}, true);
+  upsample_to_cc(in3, has_np, has_sp, out3, nthreads);
   }
 
 py::array py_upsample_to_cc(const py::array &in, size_t nrings_out, bool has_np,
-  bool has_sp, py::object &out_)
+  bool has_sp, py::object &out_, size_t nthreads)
+  {
+  MR_assert((in.ndim()==2)||(in.ndim()==3), "in must be 2D or 3D");
+  if (in.ndim()==2)
+    {
+    auto in2 = to_mav<double,2>(in);
+    auto out = get_optional_Pyarr<double>(out_, {nrings_out,size_t(in.shape(1))});
+    auto out2 = to_mav<double,2>(out,true);
+    {
+    py::gil_scoped_release release;
+    upsample_to_cc(in2, has_np, has_sp, out2, nthreads);
+    }
+    return move(out);
+    }
+  auto in2 = to_mav<double,3>(in);
+  auto out = get_optional_Pyarr<double>(out_,
+    {size_t(in.shape(0)),nrings_out,size_t(in.shape(2))});
+  auto out2 = to_mav<double,3>(out,true);
   {
-  auto in2 = to_mav<double,2>(in);
-  auto out = get_optional_Pyarr<double>(out_, {nrings_out,size_t(in.shape(1))});
-  auto out2 = to_mav<double,2>(out,true);
-    MR_assert(out2.writable(),"x1");
-  upsample_to_cc(in2, has_np, has_sp, out2);
+  py::gil_scoped_release release;
+  upsample_to_cc(in2, has_np, has_sp, out2, nthreads);
+  }
   return move(out);
   }
 
-template<typename T> py::array tphelp(const py::array &in)
+template<typename T> py::array tphelp(const py::array &in, size_t nthreads)
   {
   auto in2 = to_fmav<T>(in, false);
   auto out = make_Pyarr<T>(in2.shape());
   auto out2 = to_fmav<T>(out, true);
-  transpose(in2, out2, [](const T &in, T &out){out=in;});
+  {
+  py::gil_scoped_release release;
+  transpose(in2, out2, nthreads);
+  }
   return move(out);
   }
 
-py::array py_ascontiguousarray(const py::array &in)
+py::array py_ascontiguousarray(const py::array &in, size_t nthreads)
   {
   if (isPyarr<float>(in))
-    return tphelp<float>(in);
+    return tphelp<float>(in, nthreads);
   if (isPyarr<double>(in))
-    return tphelp<double>(in);
+    return tphelp<double>(in, nthreads);
   if (isPyarr<complex<float>>(in))
-    return tphelp<complex<float>>(in);
+    return tphelp<complex<float>>(in, nthreads);
   if (isPyarr<complex<double>>(in))
-    return tphelp<complex<double>>(in);
+    return tphelp<complex<double>>(in, nthreads);
   if (isPyarr<int>(in))
-    return tphelp<int>(in);
+    return tphelp<int>(in, nthreads);
   if (isPyarr<long>(in))
-    return tphelp<long>(in);
+    return tphelp<long>(in, nthreads);
   MR_fail("unsupported datatype");
   }
 
-template<typename T> py::array tphelp2(const py::array &in, py::array &out)
+template<typename T> py::array tphelp2(const py::array &in, py::array &out,
+  size_t nthreads)
   {
   auto in2 = to_fmav<T>(in, false);
   auto out2 = to_fmav<T>(out, true);
-  transpose(in2, out2, [](const T &in, T &out){out=in;});
+  {
+  py::gil_scoped_release release;
+  transpose(in2, out2, nthreads);
+  }
   return out;
   }
 
-py::array py_transpose(const py::array &in, py::array &out)
+py::array py_transpose(const py::array &in, py::array &out, size_t nthreads)
   {
   if (isPyarr<float>(in))
-    return tphelp2<float>(in, out);
+    return tphelp2<float>(in, out, nthreads);
   if (isPyarr<double>(in))
-    return tphelp2<double>(in, out);
+    return tphelp2<double>(in, out, nthreads);
   if (isPyarr<complex<float>>(in))
-    return tphelp2<complex<float>>(in, out);
+    return tphelp2<complex<float>>(in, out, nthreads);
   if (isPyarr<complex<double>>(in))
-    return tphelp2<complex<double>>(in, out);
+    return tphelp2<complex<double>>(in, out, nthreads);
   if (isPyarr<int>(in))
-    return tphelp2<int>(in, out);
+    return tphelp2<int>(in, out, nthreads);
   if (isPyarr<long>(in))
-    return tphelp2<long>(in, out);
+    return tphelp2<long>(in, out, nthreads);
   MR_fail("unsupported datatype");
   }
 
+const char *ascontiguousarray_DS = R"""(
+Returns a C-contiguous copy of the input array
+
+Parameters
+----------
+in : numpy.ndarray
+    the input array (float32, float64, complex64, complex128, int32 or int64)
+nthreads : int
+    the number of threads to use
+
+Returns
+-------
+numpy.ndarray(same shape and dtype as in)
+    the C-contiguous copy of `in`
+)""";
+
+const char *transpose_DS = R"""(
+Copies the contents of one array into another one with different memory layout
+
+Parameters
+----------
+in : numpy.ndarray
+    the input array (float32, float64, complex64, complex128, int32 or int64)
+out : numpy.ndarray(same shape and dtype as in)
+    the output array; it may have arbitrary strides
+nthreads : int
+    the number of threads to use
+
+Returns
+-------
+numpy.ndarray
+    identical to `out`
+)""";
+
+
+void py_set_tracing(bool enabled)
+  { trace_recorder().set_enabled(enabled); }
+
+void py_clear_trace()
+  { trace_recorder().clear(); }
+
+string py_get_trace()
+  { return trace_recorder().json(); }
+
+void py_set_perf_counters(bool enabled)
+  { set_perf_counters(enabled); }
+
+vector<string> py_perf_events_available()
+  {
+  vector<string> res;
+  for (size_t i=0; i<PERF_NEVENTS; ++i)
+    if (perf_event_available(i)) res.push_back(perf_event_name(i));
+  return res;
+  }
+
+void py_set_thread_budget(size_t nthreads)
+  { set_thread_budget(nthreads); }
+
+size_t py_get_thread_budget()
+  { return get_thread_budget(); }
+
+class Py_ThreadGroup
+  {
+  private:
+    ThreadGroup group;
+    // the scopes entered by the current thread, innermost last
+    static thread_local vector<unique_ptr<ThreadGroupScope>> scopes;
+
+  public:
+    Py_ThreadGroup(size_t nthreads) : group(nthreads) {}
+    size_t nthreads() const { return group.nthreads(); }
+    void enter()
+      { scopes.push_back(make_unique<ThreadGroupScope>(group)); }
+    void exit()
+      {
+      MR_assert(!scopes.empty(), "ThreadGroup was not entered by this thread");
+      scopes.pop_back();
+      }
+  };
+
+thread_local vector<unique_ptr<ThreadGroupScope>> Py_ThreadGroup::scopes;
+
+py::object py_run_async(const py::object &func, const py::args &args,
+  const py::kwargs &kwargs)
+  { return call_async(func, args, kwargs); }
+
+const char *run_async_DS = R"""(
+Calls `func(*args, **kwargs)` on the ducc0 thread pool
+
+This is useful for overlapping ducc0 computations without an `_async`
+variant (e.g. `Interpolator.interpol`) with other work, since all ducc0
+functions and methods release the GIL while computing. Calling other Python
+functions this way is possible, but they hold the GIL while running.
+
+Parameters
+----------
+func : callable
+    the function to call
+*args, **kwargs :
+    its arguments
+
+Returns
+-------
+concurrent.futures.Future
+    the future receiving the return value or exception of the call
+)""";
+
+const char *set_thread_budget_DS = R"""(
+Sets the maximum number of threads working concurrently in all ducc0
+computations of the process
+
+If several computations run at the same time (e.g. called from different
+Python threads), or if a parallel computation calls another one, their
+threads are taken from this common budget. Computations which get fewer
+threads than requested share their work among the available ones; the
+results do not depend on the budget.
+
+Parameters
+----------
+nthreads : int
+    the number of threads (default: the number of CPUs)
+)""";
+
+const char *get_thread_budget_DS = R"""(
+Returns the maximum number of threads working concurrently in all ducc0
+computations of the process (see `set_thread_budget()`)
+)""";
+
+const char *ThreadGroup_DS = R"""(
+Bound on the number of threads used by a group of concurrent computations
+
+Computations started inside a ``with group:`` block draw their threads from
+the group, in addition to the process-wide budget. A group object can be
+entered by several Python threads at the same time, e.g. by workers
+processing different detectors, which then share `nthreads` threads instead
+of each using `nthreads` threads of its own.
+
+Parameters
+----------
+nthreads : int
+    the maximum number of threads working concurrently for the group
+)""";
+
+const char *set_tracing_DS = R"""(
+Switches the recording of timed regions on or off
+
+While recording is on, ducc0 stores the start and end times of its major
+computational steps (SHTs, FFTs, gridding stages, interpolation) per thread.
+
+Parameters
+----------
+enabled : bool
+    whether regions should be recorded
+)""";
+
+const char *clear_trace_DS = R"""(
+Discards all recorded regions
+)""";
+
+const char *get_trace_DS = R"""(
+Returns all recorded regions in the Chrome trace-event format
+
+Returns
+-------
+str
+    a JSON document, which can be stored to a file and loaded into
+    chrome://tracing or Perfetto
+)""";
+
+const char *set_perf_counters_DS = R"""(
+Switches the collection of hardware performance counters on or off
+
+While collection is on, the counter values (summed over all threads) are
+reported together with the wall clock times of internal timers, and stored
+with the regions recorded by `set_tracing()`.
+This requires Linux and a kernel permitting access to the counters.
+
+Parameters
+----------
+enabled : bool
+    whether counters should be collected
+)""";
+
+const char *perf_events_available_DS = R"""(
+Returns the names of the hardware performance counters which can be
+collected on this system
+
+Returns
+-------
+list of str
+    the names of the available counters; empty if counters are not supported
+)""";
+
+const char *rotate_alm_DS = R"""(
+Rotates a_lm by the Euler angles psi, theta and phi
+
+Parameters
+----------
+alm : numpy.ndarray((nalm,) or (nsets, nalm), dtype=numpy.complex128)
+    the a_lm of one or several sets with the same lmax==mmax,
+    in the standard triangular order. Several sets are rotated together,
+    sharing the Wigner d matrix computation.
+lmax : int
+    the maximum l (and m) of the a_lm
+psi, theta, phi : float
+    the Euler angles in radians
+nthreads : int
+    the number of threads to use
+
+Returns
+-------
+numpy.ndarray(same shape as alm, dtype=numpy.complex128)
+    the rotated a_lm
+)""";
+
+const char *alm2cl_DS = R"""(
+Computes the (cross) angular power spectrum of two sets of a_lm of
+real-valued fields
+
+Parameters
+----------
+alm1, alm2 : numpy.ndarray((nalm,), dtype=numpy.complex128)
+    the a_lm in the standard triangular order
+lmax, mmax : int
+    the maximum l and m of the a_lm
+nthreads : int
+    the number of threads to use; the result does not depend on it
+
+Returns
+-------
+numpy.ndarray((lmax+1,), dtype=numpy.float64)
+    C_l = 1/(2l+1) * sum_{m=-l}^{l} alm1_lm conj(alm2_lm)
+)""";
+
+const char *alm_to_lmajor_DS = R"""(
+Reorders a_lm from the standard (m-major) triangular order into l-major
+order, i.e. all m for l=0, followed by all m for l=1 etc.
+
+Parameters
+----------
+alm : numpy.ndarray((nalm,), dtype=numpy.complex128)
+    the a_lm in the standard triangular order
+lmax, mmax : int
+    the maximum l and m of the a_lm
+real : bool
+    if False, row l contains the complex a_lm with 0<=m<=min(l, mmax).
+    If True, the a_lm are assumed to belong to a real-valued field, and row l
+    contains the real numbers
+    a_l0, sqrt(2)*Re(a_l1), sqrt(2)*Im(a_l1), ..., sqrt(2)*Im(a_l,min(l,mmax)),
+    whose sum of squares equals sum_{m=-l}^{l} |a_lm|^2.
+nthreads : int
+    the number of threads to use
+
+Returns
+-------
+numpy.ndarray(dtype=numpy.complex128 or numpy.float64)
+    the reordered coefficients
+)""";
+
+const char *alm_from_lmajor_DS = R"""(
+Inverse of `alm_to_lmajor`
+
+Parameters
+----------
+lmajor : numpy.ndarray(dtype=numpy.complex128 or numpy.float64)
+    the coefficients in l-major order; a float64 array is interpreted as
+    the real-valued packing produced by `alm_to_lmajor` with `real=True`
+lmax, mmax : int
+    the maximum l and m of the a_lm
+nthreads : int
+    the number of threads to use
+
+Returns
+-------
+numpy.ndarray((nalm,), dtype=numpy.complex128)
+    the a_lm in the standard triangular order
+)""";
+
+const char *upsample_to_cc_DS = R"""(
+Upsamples maps on an equidistant grid in theta to a Clenshaw-Curtis grid
+(with rings at both poles) by zero-padding in the Fourier domain along theta
+
+Parameters
+----------
+in : numpy.ndarray((ntheta_in, nphi) or (ncomp, ntheta_in, nphi), dtype=numpy.float64)
+    the input map(s); the rings are equidistant in theta, and the first and
+    last ring are at the poles if has_np and has_sp are set, respectively.
+    Otherwise they are half a ring distance away from the pole.
+    nphi must be even.
+nrings_out : int
+    the number of rings of the output map(s); must be large enough to hold
+    all information of the input
+has_np, has_sp : bool
+    whether the input has a ring at the north/south pole
+out : numpy.ndarray((nrings_out, nphi) or (ncomp, nrings_out, nphi), dtype=numpy.float64) or None
+    if provided, the result will be stored in this array
+nthreads : int
+    the number of threads to use; the work is distributed over the
+    components and blocks of phi columns
+
+Returns
+-------
+numpy.ndarray((nrings_out, nphi) or (ncomp, nrings_out, nphi), dtype=numpy.float64)
+    the upsampled map(s). If out was provided, this is identical to out.
+)""";
 
 const char *misc_DS = R"""(
 Various unsorted utilities
@@ -217,14 +674,45 @@ void add_misc(py::module &msup)
   m.def("GL_weights",&GL_weights, "nlat"_a, "nlon"_a);
   m.def("GL_thetas",&GL_thetas, "nlat"_a);
 
-  m.def("rotate_alm", &pyrotate_alm<double>, "alm"_a, "lmax"_a, "psi"_a, "theta"_a,
-    "phi"_a);
+  m.def("rotate_alm", &pyrotate_alm<double>, rotate_alm_DS, "alm"_a, "lmax"_a,
+    "psi"_a, "theta"_a, "phi"_a, "nthreads"_a=1);
+
+  m.def("alm2cl", &Py_alm2cl, alm2cl_DS, "alm1"_a, "alm2"_a, "lmax"_a,
+    "mmax"_a, "nthreads"_a=1);
+  m.def("alm_to_lmajor", &Py_alm2lmajor, alm_to_lmajor_DS, "alm"_a, "lmax"_a,
+    "mmax"_a, "real"_a=false, "nthreads"_a=1);
+  m.def("alm_from_lmajor", &Py_lmajor2alm, alm_from_lmajor_DS, "lmajor"_a,
+    "lmax"_a, "mmax"_a, "nthreads"_a=1);
+
+  m.def("upsample_to_cc",&py_upsample_to_cc, upsample_to_cc_DS, "in"_a,
+    "nrings_out"_a, "has_np"_a, "has_sp"_a, "out"_a=py::none(),
+    "nthreads"_a=1);
+
+  m.def("set_tracing", &py_set_tracing, set_tracing_DS, "enabled"_a);
+  m.def("clear_trace", &py_clear_trace, clear_trace_DS);
+  m.def("get_trace", &py_get_trace, get_trace_DS);
+  m.def("set_perf_counters", &py_set_perf_counters, set_perf_counters_DS,
+    "enabled"_a);
+  m.def("perf_events_available", &py_perf_events_available,
+    perf_events_available_DS);
 
-  m.def("upsample_to_cc",&py_upsample_to_cc, "in"_a, "nrings_out"_a,
-    "has_np"_a, "has_sp"_a, "out"_a=py::none());
+  m.def("run_async", &py_run_async, run_async_DS, "func"_a);
+  m.def("set_thread_budget", &py_set_thread_budget, set_thread_budget_DS,
+    "nthreads"_a);
+  m.def("get_thread_budget", &py_get_thread_budget, get_thread_budget_DS);
+  py::class_<Py_ThreadGroup>(m, "ThreadGroup", ThreadGroup_DS,
+    py::module_local())
+    .def(py::init<size_t>(), "nthreads"_a)
+    .def_property_readonly("nthreads", &Py_ThreadGroup::nthreads)
+    .def("__enter__", [](py::object self)
+      { self.cast<Py_ThreadGroup &>().enter(); return self; })
+    .def("__exit__", [](Py_ThreadGroup &self, py::args)
+      { self.exit(); });
 
-  m.def("ascontiguousarray",&py_ascontiguousarray, "in"_a);
-  m.def("transpose",&py_transpose, "in"_a, "out"_a);
+  m.def("ascontiguousarray",&py_ascontiguousarray, ascontiguousarray_DS,
+    "in"_a, "nthreads"_a=1);
+  m.def("transpose",&py_transpose, transpose_DS, "in"_a, "out"_a,
+    "nthreads"_a=1);
   }
 
 }
@@ -0,0 +1,314 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include "ducc0/bindings/pybind_utils.h"
+#include "ducc0/nufft/nufft.h"
+
+namespace ducc0 {
+
+namespace detail_pymodule_nufft {
+
+using namespace std;
+
+namespace py = pybind11;
+
+auto None = py::none();
+
+template<typename T, size_t ndim> void nu2u3(const py::array &points_,
+  const py::array &coord_, bool forward, double epsilon, size_t nthreads,
+  py::array &out_, size_t verbosity, bool fft_order)
+  {
+  auto coord = to_mav<double,2>(coord_, false);
+  auto points = to_mav<complex<T>,1>(points_, false);
+  auto out = to_mav<complex<T>,ndim>(out_, true);
+  {
+  py::gil_scoped_release release;
+  nu2u<T,ndim>(coord, points, forward, epsilon, nthreads, out, verbosity,
+    fft_order);
+  }
+  }
+template<typename T> void nu2u2(const py::array &points,
+  const py::array &coord, bool forward, double epsilon, size_t nthreads,
+  py::array &out, size_t verbosity, bool fft_order)
+  {
+  MR_assert(isPyarr<complex<T>>(out), "data types of 'points' and 'out' must match");
+  if (out.ndim()==1)
+    return nu2u3<T,1>(points, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  if (out.ndim()==2)
+    return nu2u3<T,2>(points, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  if (out.ndim()==3)
+    return nu2u3<T,3>(points, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  MR_fail("'out' must have 1, 2 or 3 dimensions");
+  }
+py::array Pynu2u(const py::array &points, const py::array &coord,
+  bool forward, double epsilon, size_t nthreads, py::array &out,
+  size_t verbosity, bool fft_order)
+  {
+  if (isPyarr<complex<float>>(points))
+    nu2u2<float>(points, coord, forward, epsilon, nthreads, out, verbosity,
+      fft_order);
+  else if (isPyarr<complex<double>>(points))
+    nu2u2<double>(points, coord, forward, epsilon, nthreads, out, verbosity,
+      fft_order);
+  else
+    MR_fail("type matching failed: 'points' has neither type 'c8' nor 'c16'");
+  return out;
+  }
+constexpr auto nu2u_DS = R"""(
+Type 1 non-uniform FFT (non-uniform points to uniform grid).
+
+Computes  out[k] = sum_j points[j] * exp(-+1j * dot(k, coord[j]))
+where the minus sign is used for forward transforms.
+
+Parameters
+==========
+points: np.array((npoints,), dtype=np.complex64 or np.complex128)
+    the input values at the non-uniform points
+    Its data type determines the precision in which the calculation is carried
+    out.
+coord: np.array((npoints, ndim), dtype=np.float64)
+    the coordinates of the non-uniform points (in radians, periodic with
+    period 2*pi).
+    ndim must be 1, 2, or 3.
+forward: bool
+    if True, a minus sign is used in the exponent, otherwise a plus sign
+epsilon: float
+    desired relative L2 accuracy of the result. Must be larger than 2e-13.
+    If `points` has type np.complex64, it must be larger than 1e-5.
+nthreads: int
+    number of threads to use for the calculation
+out: np.array(shape, same dtype as `points`)
+    the output array; its shape determines the number of modes along every
+    dimension. Along a dimension of length N the mode indices run from
+    -N//2 to N-1-N//2.
+verbosity: int
+    0: no output
+    1: some output
+fft_order: bool
+    if False, the zero mode along every dimension is stored at index N//2,
+    otherwise the modes are stored in the order returned by standard FFTs.
+
+Returns
+=======
+np.array(shape, same dtype as `points`)
+    identical to `out`
+)""";
+
+template<typename T, size_t ndim> py::array u2nu3(const py::array &grid_,
+  const py::array &coord_, bool forward, double epsilon, size_t nthreads,
+  py::object &out__, size_t verbosity, bool fft_order)
+  {
+  auto coord = to_mav<double,2>(coord_, false);
+  auto grid = to_mav<complex<T>,ndim>(grid_, false);
+  auto out_ = get_optional_Pyarr<complex<T>>(out__, {coord.shape(0)});
+  auto out = to_mav<complex<T>,1>(out_, true);
+  {
+  py::gil_scoped_release release;
+  u2nu<T,ndim>(coord, grid, forward, epsilon, nthreads, out, verbosity,
+    fft_order);
+  }
+  return move(out_);
+  }
+template<typename T> py::array u2nu2(const py::array &grid,
+  const py::array &coord, bool forward, double epsilon, size_t nthreads,
+  py::object &out, size_t verbosity, bool fft_order)
+  {
+  if (grid.ndim()==1)
+    return u2nu3<T,1>(grid, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  if (grid.ndim()==2)
+    return u2nu3<T,2>(grid, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  if (grid.ndim()==3)
+    return u2nu3<T,3>(grid, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  MR_fail("'grid' must have 1, 2 or 3 dimensions");
+  }
+py::array Pyu2nu(const py::array &grid, const py::array &coord,
+  bool forward, double epsilon, size_t nthreads, py::object &out,
+  size_t verbosity, bool fft_order)
+  {
+  if (isPyarr<complex<float>>(grid))
+    return u2nu2<float>(grid, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  if (isPyarr<complex<double>>(grid))
+    return u2nu2<double>(grid, coord, forward, epsilon, nthreads, out,
+      verbosity, fft_order);
+  MR_fail("type matching failed: 'grid' has neither type 'c8' nor 'c16'");
+  }
+constexpr auto u2nu_DS = R"""(
+Type 2 non-uniform FFT (uniform grid to non-uniform points).
+
+Computes  out[j] = sum_k grid[k] * exp(-+1j * dot(k, coord[j]))
+where the minus sign is used for forward transforms.
+
+Parameters
+==========
+grid: np.array(shape, dtype=np.complex64 or np.complex128)
+    the input values on the uniform grid. Along a dimension of length N the
+    mode indices run from -N//2 to N-1-N//2.
+    Its data type determines the precision in which the calculation is carried
+    out.
+coord: np.array((npoints, ndim), dtype=np.float64)
+    the coordinates of the non-uniform points (in radians, periodic with
+    period 2*pi).
+    ndim must be 1, 2, or 3 and agree with the dimensionality of `grid`.
+forward: bool
+    if True, a minus sign is used in the exponent, otherwise a plus sign
+epsilon: float
+    desired relative L2 accuracy of the result. Must be larger than 2e-13.
+    If `grid` has type np.complex64, it must be larger than 1e-5.
+nthreads: int
+    number of threads to use for the calculation
+out: np.array((npoints,), same dtype as `grid`), optional
+    if provided, the result is stored here
+verbosity: int
+    0: no output
+    1: some output
+fft_order: bool
+    if False, the zero mode along every dimension is stored at index N//2,
+    otherwise the modes are stored in the order returned by standard FFTs.
+
+Returns
+=======
+np.array((npoints,), same dtype as `grid`)
+    the values at the non-uniform points
+)""";
+
+template<typename T, size_t ndim> py::array nu2nu3(const py::array &points_,
+  const py::array &coord_, const py::array &freq_, bool forward,
+  double epsilon, size_t nthreads, py::object &out__, size_t verbosity)
+  {
+  auto coord = to_mav<double,2>(coord_, false);
+  auto freq = to_mav<double,2>(freq_, false);
+  auto points = to_mav<complex<T>,1>(points_, false);
+  auto out_ = get_optional_Pyarr<complex<T>>(out__, {freq.shape(0)});
+  auto out = to_mav<complex<T>,1>(out_, true);
+  {
+  py::gil_scoped_release release;
+  nu2nu<T,ndim>(coord, points, freq, forward, epsilon, nthreads, out,
+    verbosity);
+  }
+  return move(out_);
+  }
+template<typename T> py::array nu2nu2(const py::array &points,
+  const py::array &coord, const py::array &freq, bool forward,
+  double epsilon, size_t nthreads, py::object &out, size_t verbosity)
+  {
+  MR_assert(coord.ndim()==2, "'coord' must be a 2D array");
+  if (coord.shape(1)==1)
+    return nu2nu3<T,1>(points, coord, freq, forward, epsilon, nthreads, out,
+      verbosity);
+  if (coord.shape(1)==2)
+    return nu2nu3<T,2>(points, coord, freq, forward, epsilon, nthreads, out,
+      verbosity);
+  if (coord.shape(1)==3)
+    return nu2nu3<T,3>(points, coord, freq, forward, epsilon, nthreads, out,
+      verbosity);
+  MR_fail("'coord' must have 1, 2 or 3 columns");
+  }
+py::array Pynu2nu(const py::array &points, const py::array &coord,
+  const py::array &freq, bool forward, double epsilon, size_t nthreads,
+  py::object &out, size_t verbosity)
+  {
+  if (isPyarr<complex<float>>(points))
+    return nu2nu2<float>(points, coord, freq, forward, epsilon, nthreads,
+      out, verbosity);
+  if (isPyarr<complex<double>>(points))
+    return nu2nu2<double>(points, coord, freq, forward, epsilon, nthreads,
+      out, verbosity);
+  MR_fail("type matching failed: 'points' has neither type 'c8' nor 'c16'");
+  }
+constexpr auto nu2nu_DS = R"""(
+Type 3 non-uniform FFT (non-uniform points to non-uniform frequencies).
+
+Computes  out[k] = sum_j points[j] * exp(-+1j * dot(freq[k], coord[j]))
+where the minus sign is used for forward transforms.
+
+Parameters
+==========
+points: np.array((npoints,), dtype=np.complex64 or np.complex128)
+    the input values at the non-uniform points
+    Its data type determines the precision in which the calculation is carried
+    out.
+coord: np.array((npoints, ndim), dtype=np.float64)
+    the coordinates of the non-uniform points (arbitrary real numbers, no
+    periodicity is assumed).
+    ndim must be 1, 2, or 3.
+freq: np.array((nfreq, ndim), dtype=np.float64)
+    the frequencies at which the sums are evaluated (arbitrary real numbers)
+forward: bool
+    if True, a minus sign is used in the exponent, otherwise a plus sign
+epsilon: float
+    desired relative L2 accuracy of the result. Must be larger than 2e-13.
+    If `points` has type np.complex64, it must be larger than 1e-5.
+nthreads: int
+    number of threads to use for the calculation
+out: np.array((nfreq,), same dtype as `points`), optional
+    if provided, the result is stored here
+verbosity: int
+    0: no output
+    1: some output
+
+Returns
+=======
+np.array((nfreq,), same dtype as `points`)
+    the values at the frequencies
+
+Notes
+=====
+The cost grows with the product of the extents of `coord` and `freq` along
+every dimension, since this determines the size of the intermediate grid.
+)""";
+
+constexpr auto nufft_DS = R"""(
+Non-uniform FFTs (types 1, 2 and 3) in 1 to 3 dimensions.
+)""";
+
+void add_nufft(py::module &msup)
+  {
+  using namespace pybind11::literals;
+  auto m = msup.def_submodule("nufft");
+  m.doc() = nufft_DS;
+
+  m.def("nu2u", &Pynu2u, nu2u_DS, "points"_a, "coord"_a, "forward"_a,
+    "epsilon"_a, "nthreads"_a=1, "out"_a, "verbosity"_a=0,
+    "fft_order"_a=false);
+  m.def("u2nu", &Pyu2nu, u2nu_DS, "grid"_a, "coord"_a, "forward"_a,
+    "epsilon"_a, "nthreads"_a=1, "out"_a=None, "verbosity"_a=0,
+    "fft_order"_a=false);
+  m.def("nu2nu", &Pynu2nu, nu2nu_DS, "points"_a, "coord"_a, "freq"_a,
+    "forward"_a, "epsilon"_a, "nthreads"_a=1, "out"_a=None, "verbosity"_a=0);
+  add_async(m, "nu2u");
+  add_async(m, "u2nu");
+  add_async(m, "nu2nu");
+  }
+
+}
+
+using detail_pymodule_nufft::add_nufft;
+
+}
@@ -21,7 +21,8 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
-#include "ducc0/math/quaternion.h"
+#include "python/pointingprovider.h"
+#include "ducc0/math/quaternion_batch.h"
 
 namespace ducc0 {
 
@@ -31,92 +32,158 @@ using namespace std;
 
 namespace py = pybind11;
 
-template<typename T> class PointingProvider
-  {
-  private:
-    double t0_, freq_;
-    vector<quaternion_t<T>> quat_;
-    vector<T> rangle, rxsin;
-    vector<bool> rotflip;
-
-  public:
-    PointingProvider(double t0, double freq, const mav<T,2> &quat)
-      : t0_(t0), freq_(freq), quat_(quat.shape(0)), rangle(quat.shape(0)),
-        rxsin(quat.shape(0)), rotflip(quat.shape(0))
-      {
-      MR_assert(quat.shape(0)>=2, "need at least 2 quaternions");
-      MR_assert(quat.shape(1)==4, "need 4 entries in quaternion");
-      quat_[0] = quaternion_t<T>(quat(0,0), quat(0,1), quat(0,2), quat(0,3)).normalized();
-      for (size_t m=0; m<quat_.size()-1; ++m)
-        {
-        quat_[m+1] = quaternion_t<T>(quat(m+1,0), quat(m+1,1), quat(m+1,2), quat(m+1,3)).normalized();
-        quaternion_t<T> delta(quat_[m+1]*quat_[m].conj());
-        rotflip[m]=false;
-        if (delta.w < 0.)
-          { rotflip[m]=true; delta.flip(); }
-        auto [v, omega] = delta.toAxisAngle();
-        rangle[m]=omega*.5;
-        rxsin[m]=1./sin(rangle[m]);
-        }
-      }
-
-    void get_rotated_quaternions(double t0, double freq, const mav<T,1> &rot,
-      mav<T,2> &out, bool rot_left)
-      {
-      MR_assert(rot.shape(0)==4, "need 4 entries in quaternion");
-      auto rot_ = quaternion_t<T>(rot(0), rot(1), rot(2), rot(3)).normalized();
-      MR_assert(out.shape(1)==4, "need 4 entries in quaternion");
-      double ofs = (t0-t0_)*freq_;
-      for (size_t i=0; i<out.shape(0); ++i)
-        {
-        double fi = ofs + (i/freq)*freq_;
-        MR_assert((fi>=0) && fi<=(quat_.size()-1+1e-7), "time outside available range");
-        size_t idx = size_t(fi);
-        idx = min(idx, quat_.size()-2);
-        double frac = fi-idx;
-        double omega = rangle[idx];
-        double xsin = rxsin[idx];
-        double w1 = sin((1.-frac)*omega)*xsin,
-               w2 = sin(frac*omega)*xsin;
-        if (rotflip[idx]) w1=-w1;
-        const quaternion_t<T> &q1(quat_[idx]), &q2(quat_[idx+1]);
-        quaternion_t<T> q(w1*q1.x + w2*q2.x,
-                          w1*q1.y + w2*q2.y,
-                          w1*q1.z + w2*q2.z,
-                          w1*q1.w + w2*q2.w);
-        q = rot_left ? rot_*q : q*rot_;
-        out.v(i,0) = q.x;
-        out.v(i,1) = q.y;
-        out.v(i,2) = q.z;
-        out.v(i,3) = q.w;
-        }
-      }
-  };
-
-template<typename T> class PyPointingProvider: public PointingProvider<T>
-  {
-  protected:
-    using PointingProvider<T>::get_rotated_quaternions;
-
-  public:
-    PyPointingProvider(double t0, double freq, const py::array &quat)
-      : PointingProvider<T>(t0, freq, to_mav<T,2>(quat)) {}
-
-    py::array pyget_rotated_quaternions_out(double t0, double freq,
-      const py::array &quat, bool rot_left, py::array &out)
-      {
-      auto res2 = to_mav<T,2>(out,true);
-      auto quat2 = to_mav<T,1>(quat);
-      get_rotated_quaternions(t0, freq, quat2, res2, rot_left);
-      return move(out);
-      }
-    py::array pyget_rotated_quaternions(double t0, double freq,
-      const py::array &quat, size_t nval, bool rot_left)
-      {
-      auto res = make_Pyarr<T>({nval,4});
-      return pyget_rotated_quaternions_out(t0, freq, quat, rot_left, res);
-      }
-  };
+template<typename T> py::array pyget_rotated_quaternions_out
+  (const PointingProvider<T> &prov, double t0, double freq,
+  const py::array &quat, bool rot_left, py::array &out, size_t nthreads)
+  {
+  if (quat.ndim()==2)
+    {
+    auto res2 = to_mav<T,3>(out,true);
+    auto quat2 = to_mav<T,2>(quat);
+    py::gil_scoped_release release;
+    prov.get_rotated_quaternions(t0, freq, quat2, res2, rot_left, 0, nthreads);
+    }
+  else
+    {
+    auto res2 = to_mav<T,2>(out,true);
+    auto quat2 = to_mav<T,1>(quat);
+    py::gil_scoped_release release;
+    prov.get_rotated_quaternions(t0, freq, quat2, res2, rot_left, 0, nthreads);
+    }
+  return move(out);
+  }
+template<typename T> py::array pyget_rotated_quaternions
+  (const PointingProvider<T> &prov, double t0, double freq,
+  const py::array &quat, size_t nval, bool rot_left, size_t nthreads)
+  {
+  auto res = (quat.ndim()==2) ?
+    make_Pyarr<T>({size_t(quat.shape(0)),nval,4}) : make_Pyarr<T>({nval,4});
+  return pyget_rotated_quaternions_out(prov, t0, freq, quat, rot_left, res,
+    nthreads);
+  }
+template<typename T> py::array pyget_rotated_angles_out
+  (const PointingProvider<T> &prov, double t0, double freq,
+  const py::array &quat, bool rot_left, py::array &out, size_t nthreads)
+  {
+  if (quat.ndim()==2)
+    {
+    auto res2 = to_mav<T,3>(out,true);
+    auto quat2 = to_mav<T,2>(quat);
+    py::gil_scoped_release release;
+    prov.get_rotated_angles(t0, freq, quat2, res2, rot_left, 0, nthreads);
+    }
+  else
+    {
+    auto res2 = to_mav<T,2>(out,true);
+    auto quat2 = to_mav<T,1>(quat);
+    py::gil_scoped_release release;
+    prov.get_rotated_angles(t0, freq, quat2, res2, rot_left, 0, nthreads);
+    }
+  return move(out);
+  }
+template<typename T> py::array pyget_rotated_angles
+  (const PointingProvider<T> &prov, double t0, double freq,
+  const py::array &quat, size_t nval, bool rot_left, size_t nthreads)
+  {
+  auto res = (quat.ndim()==2) ?
+    make_Pyarr<T>({size_t(quat.shape(0)),nval,3}) : make_Pyarr<T>({nval,3});
+  return pyget_rotated_angles_out(prov, t0, freq, quat, rot_left, res,
+    nthreads);
+  }
+template<typename T> PointingProvider<T> *makePointingProvider(double t0,
+  double freq, const py::array &quat)
+  {
+  auto quat2 = to_mav<T,2>(quat);
+  py::gil_scoped_release release;
+  return new PointingProvider<T>(t0, freq, quat2);
+  }
+
+/* Returns a 2D view of arr; a 1D array becomes a single row. */
+template<typename T> mav<T,2> to_rows(const py::array &arr, bool rw=false)
+  {
+  MR_assert((arr.ndim()==1)||(arr.ndim()==2), "array must be 1D or 2D");
+  if (arr.ndim()==2) return to_mav<T,2>(arr, rw);
+  auto tmp = to_mav<T,1>(arr, rw);
+  if (rw)
+    return mav<T,2>(tmp.vdata(), {1, tmp.shape(0)}, {0, tmp.stride(0)}, true);
+  return mav<T,2>(tmp.data(), {1, tmp.shape(0)}, {0, tmp.stride(0)});
+  }
+
+/* Returns out (or a new array if out is None) with the shape of a stack of
+   n entries of length len, or a single entry if ndim==1. */
+template<typename T> py::array get_rows_out(py::object &out, size_t ndim,
+  size_t n, size_t len)
+  {
+  return (ndim==1) ? get_optional_Pyarr<T>(out, {len})
+                   : get_optional_Pyarr<T>(out, {n, len});
+  }
+
+template<typename T> py::array pyquat_multiply(const py::array &a,
+  const py::array &b, bool conj_a, bool conj_b, py::object &out_,
+  size_t nthreads)
+  {
+  auto a2 = to_rows<T>(a), b2 = to_rows<T>(b);
+  size_t n = max(a2.shape(0), b2.shape(0));
+  auto out = get_rows_out<T>(out_, size_t(max(a.ndim(), b.ndim())), n, 4);
+  auto out2 = to_rows<T>(out, true);
+  {
+  py::gil_scoped_release release;
+  quat_multiply(a2, b2, out2, conj_a, conj_b, nthreads);
+  }
+  return move(out);
+  }
+template<typename T> py::array pyquat_rotate_vectors(const py::array &q,
+  const py::array &v, py::object &out_, size_t nthreads)
+  {
+  auto q2 = to_rows<T>(q), v2 = to_rows<T>(v);
+  size_t n = max(q2.shape(0), v2.shape(0));
+  auto out = get_rows_out<T>(out_, size_t(max(q.ndim(), v.ndim())), n, 3);
+  auto out2 = to_rows<T>(out, true);
+  {
+  py::gil_scoped_release release;
+  quat_rotate_vectors(q2, v2, out2, nthreads);
+  }
+  return move(out);
+  }
+template<typename T> py::tuple pyquat_to_axis_angle(const py::array &q,
+  size_t nthreads)
+  {
+  auto q2 = to_mav<T,2>(q);
+  auto axis = make_Pyarr<T>({q2.shape(0), 3});
+  auto angle = make_Pyarr<T>({q2.shape(0)});
+  auto axis2 = to_mav<T,2>(axis, true);
+  auto angle2 = to_mav<T,1>(angle, true);
+  {
+  py::gil_scoped_release release;
+  quat_to_axis_angle(q2, axis2, angle2, nthreads);
+  }
+  return py::make_tuple(axis, angle);
+  }
+template<typename T> py::array pyquat_from_axis_angle(const py::array &axis,
+  const py::array &angle, py::object &out_, size_t nthreads)
+  {
+  auto axis2 = to_mav<T,2>(axis);
+  auto angle2 = to_mav<T,1>(angle);
+  auto out = get_optional_Pyarr<T>(out_, {axis2.shape(0), 4});
+  auto out2 = to_mav<T,2>(out, true);
+  {
+  py::gil_scoped_release release;
+  quat_from_axis_angle(axis2, angle2, out2, nthreads);
+  }
+  return move(out);
+  }
+template<typename T> py::array pyquat_to_euler_zyz(const py::array &q,
+  py::object &out_, size_t nthreads)
+  {
+  auto q2 = to_mav<T,2>(q);
+  auto out = get_optional_Pyarr<T>(out_, {q2.shape(0), 3});
+  auto out2 = to_mav<T,2>(out, true);
+  {
+  py::gil_scoped_release release;
+  quat_to_euler_zyz(q2, out2, nthreads);
+  }
+  return move(out);
+  }
 
 const char *pointingprovider_DS = R"""(
 Functionality for converting satellite orientations to detector orientations
@@ -157,20 +224,25 @@ t0 : float
     constructor.
 freq : float
     the frequency at which the output orientations should be sampled
-rot : numpy.ndarray((4,), dtype=numpy.float64)
+rot : numpy.ndarray((4,) or (ndet, 4), dtype=numpy.float64)
     A single rotation quaternion describing the rotation from the satellite to
-    the detector reference system. Components are expecetd in the order
-    (x, y, z, w). The quaternion need not be normalized.
+    the detector reference system, or one such quaternion for each of ndet
+    detectors. Components are expecetd in the order (x, y, z, w).
+    The quaternions need not be normalized.
 nval : int
     the number of requested quaternions
 rot_left : bool (optional, default=True)
     if True, the rotation quaternion is multiplied from the left side,
     otherwise from the right.
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
 
 Returns
 -------
-numpy.ndarray((nval, 4), dtype=numpy.float64) : the output quaternions
+numpy.ndarray(([ndet,] nval, 4), dtype=numpy.float64) : the output quaternions
     The quaternions are normalized and in the order (x, y, z, w)
+    If several detector rotations were given, the satellite orientations are
+    interpolated only once per sample and shared between all detectors.
 )""";
 
 const char *get_rotated_quaternions2_DS = R"""(
@@ -186,39 +258,230 @@ t0 : float
     constructor.
 freq : float
     the frequency at which the output orientations should be sampled
-rot : numpy.ndarray((4,), dtype=numpy.float64)
+rot : numpy.ndarray((4,) or (ndet, 4), dtype=numpy.float64)
     A single rotation quaternion describing the rotation from the satellite to
-    the detector reference system. Components are expecetd in the order
-    (x, y, z, w). The quaternion need not be normalized.
+    the detector reference system, or one such quaternion for each of ndet
+    detectors. Components are expecetd in the order (x, y, z, w).
+    The quaternions need not be normalized.
 rot_left : bool (optional, default=True)
     if True, the rotation quaternion is multiplied from the left side,
     otherwise from the right.
-out : numpy.ndarray((nval, 4), dtype=numpy.float64)
+out : numpy.ndarray(([ndet,] nval, 4), dtype=numpy.float64)
     the array to put the computed quaternions into
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
 
 Returns
 -------
-numpy.ndarray((nval, 4), dtype=numpy.float64) : the output quaternions
+numpy.ndarray(([ndet,] nval, 4), dtype=numpy.float64) : the output quaternions
     The quaternions are normalized and in the order (x, y, z, w)
     This is identical to the provided "out" array.
 )""";
 
+const char *get_rotated_angles_DS = R"""(
+Produces pointings started at the requested time, sampled at the requested
+frequency, which are rotated relative to the satellite orientation according to
+a provided quaternion.
+This is equivalent to converting the output of `get_rotated_quaternions` to
+Euler angles, but requires no temporary quaternion array.
+
+Parameters
+----------
+t0 : float
+    the time of the first output sample
+    This must use the same reference system as the time passed to the
+    constructor.
+freq : float
+    the frequency at which the output pointings should be sampled
+rot : numpy.ndarray((4,) or (ndet, 4), dtype=numpy.float64)
+    A single rotation quaternion describing the rotation from the satellite to
+    the detector reference system, or one such quaternion for each of ndet
+    detectors. Components are expecetd in the order (x, y, z, w).
+    The quaternions need not be normalized.
+nval : int
+    the number of requested pointings
+rot_left : bool (optional, default=True)
+    if True, the rotation quaternion is multiplied from the left side,
+    otherwise from the right.
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray(([ndet,] nval, 3), dtype=numpy.float64) : the output pointings
+    The entries are (theta, phi, psi), in the form expected by
+    `totalconvolve.Interpolator.interpol`.
+)""";
+
+const char *get_rotated_angles2_DS = R"""(
+Produces pointings started at the requested time, sampled at the requested
+frequency, which are rotated relative to the satellite orientation according to
+a provided quaternion.
+This is equivalent to converting the output of `get_rotated_quaternions` to
+Euler angles, but requires no temporary quaternion array.
+
+Parameters
+----------
+t0 : float
+    the time of the first output sample
+    This must use the same reference system as the time passed to the
+    constructor.
+freq : float
+    the frequency at which the output pointings should be sampled
+rot : numpy.ndarray((4,) or (ndet, 4), dtype=numpy.float64)
+    A single rotation quaternion describing the rotation from the satellite to
+    the detector reference system, or one such quaternion for each of ndet
+    detectors. Components are expecetd in the order (x, y, z, w).
+    The quaternions need not be normalized.
+rot_left : bool (optional, default=True)
+    if True, the rotation quaternion is multiplied from the left side,
+    otherwise from the right.
+out : numpy.ndarray(([ndet,] nval, 3), dtype=numpy.float64)
+    the array to put the computed pointings into
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray(([ndet,] nval, 3), dtype=numpy.float64) : the output pointings
+    The entries are (theta, phi, psi), in the form expected by
+    `totalconvolve.Interpolator.interpol`.
+    This is identical to the provided "out" array.
+)""";
+
+const char *quat_multiply_DS = R"""(
+Multiplies two arrays of quaternions element by element
+
+Parameters
+----------
+a, b : numpy.ndarray((n, 4) or (4,), dtype=numpy.float64)
+    the factors, with components in the order (x, y, z, w).
+    A single quaternion is used for all entries of the other array.
+conj_a, conj_b : bool (optional, default=False)
+    if True, the conjugate of the respective factor is used
+out : numpy.ndarray((n, 4) or (4,), dtype=numpy.float64) or None
+    if provided, the result will be stored in this array.
+    It may be identical to a or b.
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray((n, 4) or (4,), dtype=numpy.float64) : the products a*b
+)""";
+
+const char *quat_rotate_vectors_DS = R"""(
+Rotates 3D vectors by the rotations described by quaternions
+
+Parameters
+----------
+q : numpy.ndarray((n, 4) or (4,), dtype=numpy.float64)
+    the rotation quaternions in the order (x, y, z, w); they need not be
+    normalized. A single quaternion is applied to all vectors.
+v : numpy.ndarray((n, 3) or (3,), dtype=numpy.float64)
+    the vectors. A single vector is rotated by all quaternions.
+out : numpy.ndarray((n, 3) or (3,), dtype=numpy.float64) or None
+    if provided, the result will be stored in this array
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray((n, 3) or (3,), dtype=numpy.float64) : the rotated vectors
+)""";
+
+const char *quat_to_axis_angle_DS = R"""(
+Converts quaternions to rotation axes and angles
+
+Parameters
+----------
+q : numpy.ndarray((n, 4), dtype=numpy.float64)
+    the quaternions in the order (x, y, z, w); they need not be normalized
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+tuple(numpy.ndarray((n, 3), dtype=numpy.float64), numpy.ndarray((n,), dtype=numpy.float64))
+    the rotation axes (unit vectors) and angles (in [0; 2pi]).
+    For quaternions without a vector part, the axis is (0, 0, 1) and the
+    angle is 0.
+)""";
+
+const char *quat_from_axis_angle_DS = R"""(
+Converts rotation axes and angles to normalized quaternions
+
+Parameters
+----------
+axis : numpy.ndarray((n, 3), dtype=numpy.float64)
+    the rotation axes; they must be unit vectors
+angle : numpy.ndarray((n,), dtype=numpy.float64)
+    the rotation angles in radians
+out : numpy.ndarray((n, 4), dtype=numpy.float64) or None
+    if provided, the result will be stored in this array
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray((n, 4), dtype=numpy.float64) : the quaternions (x, y, z, w)
+)""";
+
+const char *quat_to_euler_zyz_DS = R"""(
+Converts quaternions to pointing angles
+
+Parameters
+----------
+q : numpy.ndarray((n, 4), dtype=numpy.float64)
+    the quaternions in the order (x, y, z, w); they need not be normalized
+out : numpy.ndarray((n, 3), dtype=numpy.float64) or None
+    if provided, the result will be stored in this array
+nthreads : int (optional, default=1)
+    the number of threads to use for the computation
+
+Returns
+-------
+numpy.ndarray((n, 3), dtype=numpy.float64) : the angles (theta, phi, psi)
+    of the rotations R_z(phi)*R_y(theta)*R_z(psi), as produced by
+    `PointingProvider.get_rotated_angles`
+)""";
+
 void add_pointingprovider(py::module &msup)
   {
   using namespace pybind11::literals;
   auto m = msup.def_submodule("pointingprovider");
   m.doc() = pointingprovider_DS;
 
-  using pp_d = PyPointingProvider<double>;
+  using pp_d = PointingProvider<double>;
   py::class_<pp_d>(m, "PointingProvider")
-    .def(py::init<double, double, const py::array &>(),
+    .def(py::init(&makePointingProvider<double>),
          PointingProvider_init_DS, "t0"_a, "freq"_a, "quat"_a)
-    .def ("get_rotated_quaternions", &pp_d::pyget_rotated_quaternions,
+    .def ("get_rotated_quaternions", &pyget_rotated_quaternions<double>,
        get_rotated_quaternions_DS,"t0"_a, "freq"_a, "rot"_a, "nval"_a,
-       "rot_left"_a=true)
-    .def ("get_rotated_quaternions", &pp_d::pyget_rotated_quaternions_out,
+       "rot_left"_a=true, "nthreads"_a=1)
+    .def ("get_rotated_quaternions", &pyget_rotated_quaternions_out<double>,
        get_rotated_quaternions2_DS,"t0"_a, "freq"_a, "rot"_a,
-       "rot_left"_a=true, "out"_a);
+       "rot_left"_a=true, "out"_a, "nthreads"_a=1)
+    .def ("get_rotated_angles", &pyget_rotated_angles<double>,
+       get_rotated_angles_DS,"t0"_a, "freq"_a, "rot"_a, "nval"_a,
+       "rot_left"_a=true, "nthreads"_a=1)
+    .def ("get_rotated_angles", &pyget_rotated_angles_out<double>,
+       get_rotated_angles2_DS,"t0"_a, "freq"_a, "rot"_a,
+       "rot_left"_a=true, "out"_a, "nthreads"_a=1);
+
+  m.def("quat_multiply", &pyquat_multiply<double>, quat_multiply_DS, "a"_a,
+    "b"_a, "conj_a"_a=false, "conj_b"_a=false, "out"_a=py::none(),
+    "nthreads"_a=1);
+  m.def("quat_rotate_vectors", &pyquat_rotate_vectors<double>,
+    quat_rotate_vectors_DS, "q"_a, "v"_a, "out"_a=py::none(),
+    "nthreads"_a=1);
+  m.def("quat_to_axis_angle", &pyquat_to_axis_angle<double>,
+    quat_to_axis_angle_DS, "q"_a, "nthreads"_a=1);
+  m.def("quat_from_axis_angle", &pyquat_from_axis_angle<double>,
+    quat_from_axis_angle_DS, "axis"_a, "angle"_a, "out"_a=py::none(),
+    "nthreads"_a=1);
+  m.def("quat_to_euler_zyz", &pyquat_to_euler_zyz<double>,
+    quat_to_euler_zyz_DS, "q"_a, "out"_a=py::none(), "nthreads"_a=1);
   }
 
 }
@@ -0,0 +1,224 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  Author: Martin Reinecke
+ */
+
+#ifndef DUCC0_POINTINGPROVIDER_H
+#define DUCC0_POINTINGPROVIDER_H
+
+#include <vector>
+#include <cmath>
+#include "ducc0/math/quaternion.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/threading.h"
+
+namespace ducc0 {
+
+namespace detail_pointingprovider {
+
+using namespace std;
+
+template<typename T> class PointingProvider
+  {
+  private:
+    double t0_, freq_;
+    vector<quaternion_t<T>> quat_;
+    vector<T> rangle, rxsin;
+    vector<bool> rotflip;
+
+  public:
+    PointingProvider(double t0, double freq, const mav<T,2> &quat)
+      : t0_(t0), freq_(freq), quat_(quat.shape(0)), rangle(quat.shape(0)),
+        rxsin(quat.shape(0)), rotflip(quat.shape(0))
+      {
+      MR_assert(quat.shape(0)>=2, "need at least 2 quaternions");
+      MR_assert(quat.shape(1)==4, "need 4 entries in quaternion");
+      quat_[0] = quaternion_t<T>(quat(0,0), quat(0,1), quat(0,2), quat(0,3)).normalized();
+      for (size_t m=0; m<quat_.size()-1; ++m)
+        {
+        quat_[m+1] = quaternion_t<T>(quat(m+1,0), quat(m+1,1), quat(m+1,2), quat(m+1,3)).normalized();
+        quaternion_t<T> delta(quat_[m+1]*quat_[m].conj());
+        rotflip[m]=false;
+        if (delta.w < 0.)
+          { rotflip[m]=true; delta.flip(); }
+        auto [v, omega] = delta.toAxisAngle();
+        rangle[m]=omega*.5;
+        rxsin[m]=1./sin(rangle[m]);
+        }
+      }
+
+  private:
+    /* Returns the index of the input quaternion interval containing the
+       fractional sample index fi, and the position frac within it. */
+    size_t locate(double fi, double &frac) const
+      {
+      MR_assert((fi>=0) && fi<=(quat_.size()-1+1e-7), "time outside available range");
+      size_t idx = size_t(fi);
+      idx = min(idx, quat_.size()-2);
+      frac = fi-idx;
+      return idx;
+      }
+
+    /* Returns the satellite orientation w1*q[idx] + w2*q[idx+1], where w1
+       and w2 are the slerp weights of interval idx. */
+    quaternion_t<T> combine(size_t idx, double w1, double w2) const
+      {
+      if (rotflip[idx]) w1=-w1;
+      const quaternion_t<T> &q1(quat_[idx]), &q2(quat_[idx+1]);
+      return quaternion_t<T>(w1*q1.x + w2*q2.x,
+                             w1*q1.y + w2*q2.y,
+                             w1*q1.z + w2*q2.z,
+                             w1*q1.w + w2*q2.w);
+      }
+
+    /* Calls store(idet, i, q) with the orientation q of detector idet for
+       every sample i in [0; nsamp), where rot[idet] is the rotation of the
+       detector. The satellite orientation is interpolated only once per
+       sample for all detectors; the slerp weights are computed for a SIMD
+       vector of samples at once. */
+    template<typename Func> void rotated(double t0, double freq,
+      const vector<quaternion_t<T>> &rot, bool rot_left, size_t first,
+      size_t nsamp, size_t nthreads, Func &&store) const
+      {
+      using Tsimd = native_simd<double>;
+      constexpr size_t vl = Tsimd::size();
+      double ofs = (t0-t0_)*freq_;
+      execStatic(nsamp, nthreads, 0, [&](Scheduler &sched)
+        {
+        size_t idx[vl];
+        while (auto rng=sched.getNext()) for(auto i0=rng.lo; i0<rng.hi; i0+=vl)
+          {
+          size_t nv = min(vl, rng.hi-i0);
+          Tsimd a1(0.), a2(0.), xsin(0.);
+          for (size_t j=0; j<nv; ++j)
+            {
+            double frac;
+            idx[j] = locate(ofs + ((first+i0+j)/freq)*freq_, frac);
+            a1[j] = (1.-frac)*rangle[idx[j]];
+            a2[j] = frac*rangle[idx[j]];
+            xsin[j] = rxsin[idx[j]];
+            }
+          Tsimd w1 = sin(a1)*xsin, w2 = sin(a2)*xsin;
+          for (size_t j=0; j<nv; ++j)
+            {
+            auto q = combine(idx[j], w1[j], w2[j]);
+            for (size_t idet=0; idet<rot.size(); ++idet)
+              store(idet, i0+j, rot_left ? rot[idet]*q : q*rot[idet]);
+            }
+          }
+        });
+      }
+
+    static vector<quaternion_t<T>> getRotations(const mav<T,2> &rot)
+      {
+      MR_assert(rot.shape(1)==4, "need 4 entries in quaternion");
+      vector<quaternion_t<T>> res(rot.shape(0));
+      for (size_t i=0; i<res.size(); ++i)
+        res[i] = quaternion_t<T>(rot(i,0), rot(i,1), rot(i,2), rot(i,3)).normalized();
+      return res;
+      }
+
+  public:
+    /* Writes the satellite orientations, rotated by rot, for the samples
+       first, first+1, ... of a time stream starting at t0 with frequency freq
+       into out. */
+    void get_rotated_quaternions(double t0, double freq, const mav<T,1> &rot,
+      mav<T,2> &out, bool rot_left, size_t first=0, size_t nthreads=1) const
+      {
+      MR_assert(rot.shape(0)==4, "need 4 entries in quaternion");
+      vector<quaternion_t<T>> rot_
+        {quaternion_t<T>(rot(0), rot(1), rot(2), rot(3)).normalized()};
+      MR_assert(out.shape(1)==4, "need 4 entries in quaternion");
+      rotated(t0, freq, rot_, rot_left, first, out.shape(0), nthreads,
+        [&](size_t /*idet*/, size_t i, const quaternion_t<T> &q)
+          {
+          out.v(i,0) = q.x;
+          out.v(i,1) = q.y;
+          out.v(i,2) = q.z;
+          out.v(i,3) = q.w;
+          });
+      }
+
+    /* As above, but for several detectors at once: rot has the shape
+       (ndet, 4) and out the shape (ndet, nsamp, 4). */
+    void get_rotated_quaternions(double t0, double freq, const mav<T,2> &rot,
+      mav<T,3> &out, bool rot_left, size_t first=0, size_t nthreads=1) const
+      {
+      auto rot_ = getRotations(rot);
+      MR_assert(out.shape(0)==rot_.size(), "number of detectors mismatch");
+      MR_assert(out.shape(2)==4, "need 4 entries in quaternion");
+      rotated(t0, freq, rot_, rot_left, first, out.shape(1), nthreads,
+        [&](size_t idet, size_t i, const quaternion_t<T> &q)
+          {
+          out.v(idet,i,0) = q.x;
+          out.v(idet,i,1) = q.y;
+          out.v(idet,i,2) = q.z;
+          out.v(idet,i,3) = q.w;
+          });
+      }
+
+    /* Writes the pointings (theta, phi, psi) corresponding to the output of
+       get_rotated_quaternions() into out, which has the shape (nsamp, 3). */
+    template<typename Tout> void get_rotated_angles(double t0, double freq,
+      const mav<T,1> &rot, mav<Tout,2> &out, bool rot_left, size_t first=0,
+      size_t nthreads=1) const
+      {
+      MR_assert(rot.shape(0)==4, "need 4 entries in quaternion");
+      vector<quaternion_t<T>> rot_
+        {quaternion_t<T>(rot(0), rot(1), rot(2), rot(3)).normalized()};
+      MR_assert(out.shape(1)==3, "need 3 entries in pointing");
+      rotated(t0, freq, rot_, rot_left, first, out.shape(0), nthreads,
+        [&](size_t /*idet*/, size_t i, const quaternion_t<T> &q)
+          {
+          auto [theta, phi, psi] = q.toEulerZYZ();
+          out.v(i,0) = Tout(theta);
+          out.v(i,1) = Tout(phi);
+          out.v(i,2) = Tout(psi);
+          });
+      }
+
+    /* As above, but for several detectors at once: rot has the shape
+       (ndet, 4) and out the shape (ndet, nsamp, 3). */
+    template<typename Tout> void get_rotated_angles(double t0, double freq,
+      const mav<T,2> &rot, mav<Tout,3> &out, bool rot_left, size_t first=0,
+      size_t nthreads=1) const
+      {
+      auto rot_ = getRotations(rot);
+      MR_assert(out.shape(0)==rot_.size(), "number of detectors mismatch");
+      MR_assert(out.shape(2)==3, "need 3 entries in pointing");
+      rotated(t0, freq, rot_, rot_left, first, out.shape(1), nthreads,
+        [&](size_t idet, size_t i, const quaternion_t<T> &q)
+          {
+          auto [theta, phi, psi] = q.toEulerZYZ();
+          out.v(idet,i,0) = Tout(theta);
+          out.v(idet,i,1) = Tout(phi);
+          out.v(idet,i,2) = Tout(psi);
+          });
+      }
+  };
+
+}
+
+using detail_pointingprovider::PointingProvider;
+
+}
+
+#endif
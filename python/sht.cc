@@ -29,6 +29,11 @@
 #include <pybind11/numpy.h>
 #include <vector>
 #include <complex>
+#include <map>
+#include <memory>
+#include <any>
+#include <mutex>
+#include <shared_mutex>
 
 #include "ducc0/sharp/sharp.h"
 #include "ducc0/sharp/sharp_geomhelpers.h"
@@ -46,181 +51,446 @@ using namespace std;
 
 namespace py = pybind11;
 
-using a_d = py::array_t<double>;
-using a_d_c = py::array_t<double, py::array::c_style | py::array::forcecast>;
-using a_c_c = py::array_t<complex<double>,
-  py::array::c_style | py::array::forcecast>;
-
 template<typename T> class py_sharpjob
   {
   private:
+    using a_d_c = py::array_t<T, py::array::c_style | py::array::forcecast>;
+    using a_c_c = py::array_t<complex<T>,
+      py::array::c_style | py::array::forcecast>;
+
     unique_ptr<sharp_geom_info> ginfo;
+    // restriction of ginfo to the observed rings, if set_cutsky() was called
+    unique_ptr<sharp_geom_info> ginfo_cut;
     unique_ptr<sharp_alm_info> ainfo;
     int64_t lmax_, mmax_, npix_;
     int nthreads;
+    // plans are built on first use and dropped when geometry or a_lm
+    // layout change, so that repeated transforms skip all setup work
+    mutable map<size_t, unique_ptr<sharp_plan>> plans;
+    // transforms run without the GIL, holding a shared lock; everything
+    // changing the geometry, a_lm layout, thread count or plans needs an
+    // exclusive lock
+    mutable shared_mutex mut;
+    mutable mutex plan_mut;
+    using excl_lock = unique_lock<shared_mutex>;
+    using shared_lock_t = shared_lock<shared_mutex>;
+
+    // the caller must hold a lock on mut
+    const sharp_geom_info &geom() const
+      { return ginfo_cut ? *ginfo_cut : *ginfo; }
+
+    // the caller must hold a lock on mut
+    const sharp_plan &plan(size_t spin) const
+      {
+      MR_assert(ginfo && ainfo, "geometry and a_lm info must be specified");
+      lock_guard<mutex> lock(plan_mut);
+      auto &res(plans[spin]);
+      if (!res) res = make_unique<sharp_plan>(geom(), *ainfo, spin, nthreads);
+      return *res;
+      }
 
   public:
     py_sharpjob () : lmax_(0), mmax_(0), npix_(0), nthreads(1) {}
 
     string repr() const
       {
-      return "<sharpjob_d: lmax=" + dataToString(lmax_) +
-        ", mmax=" + dataToString(mmax_) + ", npix=", dataToString(npix_) +".>";
+      return string(is_same<T,float>::value ? "<sharpjob_f" : "<sharpjob_d")
+        + ": lmax=" + dataToString(lmax_) + ", mmax=" + dataToString(mmax_)
+        + ", npix=" + dataToString(npix_) +".>";
       }
 
     void set_nthreads(int64_t nthreads_)
-      { nthreads = int(nthreads_); }
+      {
+      excl_lock lock(mut);
+      nthreads = int(nthreads_);
+      plans.clear(); // chunking may be tuned for another thread count
+      }
     void set_gauss_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert((nrings>0)&&(nphi>0),"bad grid dimensions");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_gauss_geom_info (nrings, nphi, 0., 1, nphi);
       }
     void set_healpix_geometry(int64_t nside)
       {
+      excl_lock lock(mut);
       MR_assert(nside>0,"bad Nside value");
       npix_=12*nside*nside;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_healpix_geom_info (nside, 1);
       }
     void set_fejer1_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert(nrings>0,"bad nrings value");
       MR_assert(nphi>0,"bad nphi value");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_fejer1_geom_info (nrings, nphi, 0., 1, nphi);
       }
     void set_fejer2_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert(nrings>0,"bad nrings value");
       MR_assert(nphi>0,"bad nphi value");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_fejer2_geom_info (nrings, nphi, 0., 1, nphi);
       }
     void set_cc_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert(nrings>0,"bad nrings value");
       MR_assert(nphi>0,"bad nphi value");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_cc_geom_info (nrings, nphi, 0., 1, nphi);
       }
     void set_dh_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert(nrings>1,"bad nrings value");
       MR_assert(nphi>0,"bad nphi value");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_dh_geom_info (nrings, nphi, 0., 1, nphi);
       }
     void set_mw_geometry(int64_t nrings, int64_t nphi)
       {
+      excl_lock lock(mut);
       MR_assert(nrings>0,"bad nrings value");
       MR_assert(nphi>0,"bad nphi value");
       npix_=nrings*nphi;
+      plans.clear();
+      ginfo_cut.reset();
       ginfo = sharp_make_mw_geom_info (nrings, nphi, 0., 1, nphi);
       }
+    /* Restricts all transforms to the rings containing at least one nonzero
+       pixel of mask; maps produced by alm2map are zero on all other rings.
+       If epsilon>0, the m range on every ring is additionally cut where the
+       Y_lm have fallen below epsilon relative to the largest ones. */
+    void set_cutsky(const a_d_c &mask, double epsilon)
+      {
+      MR_assert(npix_>0,"no map geometry specified");
+      MR_assert((mask.ndim()==1)&&(mask.shape(0)==npix_),
+        "incorrect size of mask array");
+      MR_assert(epsilon>=0, "epsilon must not be negative");
+      excl_lock lock(mut);
+      auto rmask = sharp_ring_mask(*ginfo, mask.data());
+      plans.clear();
+      ginfo_cut = sharp_make_cutsky_geom_info(*ginfo, rmask, epsilon);
+      }
     void set_triangular_alm_info (int64_t lmax, int64_t mmax)
       {
+      excl_lock lock(mut);
       MR_assert(mmax>=0,"negative mmax");
       MR_assert(mmax<=lmax,"mmax must not be larger than lmax");
       lmax_=lmax; mmax_=mmax;
+      plans.clear();
       ainfo = sharp_make_triangular_alm_info(lmax,mmax,1);
       }
 
     int64_t n_alm() const
       { return ((mmax_+1)*(mmax_+2))/2 + (mmax_+1)*(lmax_-mmax_); }
 
+    /* Inputs may carry one extra leading dimension, over which independent
+       transforms are batched; returns the number of transforms. */
+    static size_t get_ntrans(const py::array &arr, size_t ndim)
+      {
+      MR_assert((size_t(arr.ndim())==ndim)||(size_t(arr.ndim())==ndim+1),
+        "bad number of array dimensions");
+      return (size_t(arr.ndim())==ndim) ? 1 : size_t(arr.shape(0));
+      }
+    static vector<size_t> out_shape(const py::array &arr, size_t ndim,
+      vector<size_t> shp)
+      {
+      if (size_t(arr.ndim())>ndim) shp.insert(shp.begin(), arr.shape(0));
+      return shp;
+      }
+    template<typename Ta, typename Tm> void exec(sharp_jobtype type,
+      size_t spin, Ta *alm, Tm *map, size_t ntrans, size_t flags) const
+      {
+      size_t ncm = 1+(spin>0),
+             nca = ((type==SHARP_ALM2MAP_DERIV1)
+                  ||(type==SHARP_ALM2MAP_DERIV1_ADJOINT)) ? 1 : ncm;
+      vector<any> va, vm;
+      for (size_t i=0; i<ntrans*nca; ++i)
+        va.push_back(alm+i*n_alm());
+      for (size_t i=0; i<ntrans*ncm; ++i)
+        vm.push_back(map+i*npix_);
+      py::gil_scoped_release release;
+      shared_lock_t lock(mut);
+      plan(spin).execute(type, va, vm, flags, nthreads);
+      }
+
+    py::tuple autotune(int64_t spin)
+      {
+      MR_assert(ginfo && ainfo, "geometry and a_lm info must be specified");
+      MR_assert(spin>=0, "spin must not be negative");
+      sharp_chunking res;
+      {
+      py::gil_scoped_release release;
+      excl_lock lock(mut);
+      res = sharp_autotune_chunking(geom(), *ainfo, spin, nthreads);
+      plans.erase(spin);
+      }
+      return py::make_tuple(res.chunksize_min, res.nchunks_max);
+      }
+
     a_d_c alm2map (const a_c_c &alm) const
       {
       MR_assert(npix_>0,"no map geometry specified");
-      MR_assert (alm.size()==n_alm(),
+      auto ntrans = get_ntrans(alm, 1);
+      MR_assert (alm.shape(alm.ndim()-1)==n_alm(),
         "incorrect size of a_lm array");
-      a_d_c map(npix_);
-      auto mr=map.mutable_unchecked<1>();
-      auto ar=alm.unchecked<1>();
-      sharp_alm2map(&ar[0], &mr[0], *ginfo, *ainfo, 0, nthreads);
+      a_d_c map(out_shape(alm, 1, {size_t(npix_)}));
+      exec(SHARP_Y, 0, alm.data(), map.mutable_data(), ntrans, 0);
       return map;
       }
     a_c_c alm2map_adjoint (const a_d_c &map) const
       {
       MR_assert(npix_>0,"no map geometry specified");
-      MR_assert (map.size()==npix_,"incorrect size of map array");
-      a_c_c alm(n_alm());
-      auto mr=map.unchecked<1>();
-      auto ar=alm.mutable_unchecked<1>();
-      sharp_map2alm(&ar[0], &mr[0], *ginfo, *ainfo, 0, nthreads);
+      auto ntrans = get_ntrans(map, 1);
+      MR_assert (map.shape(map.ndim()-1)==npix_,"incorrect size of map array");
+      a_c_c alm(out_shape(map, 1, {size_t(n_alm())}));
+      exec(SHARP_Yt, 0, alm.mutable_data(), map.data(), ntrans, 0);
       return alm;
       }
     a_c_c map2alm (const a_d_c &map) const
       {
       MR_assert(npix_>0,"no map geometry specified");
-      MR_assert (map.size()==npix_,"incorrect size of map array");
-      a_c_c alm(n_alm());
-      auto mr=map.unchecked<1>();
-      auto ar=alm.mutable_unchecked<1>();
-      sharp_map2alm(&ar[0], &mr[0], *ginfo, *ainfo, SHARP_USE_WEIGHTS, nthreads);
+      auto ntrans = get_ntrans(map, 1);
+      MR_assert (map.shape(map.ndim()-1)==npix_,"incorrect size of map array");
+      a_c_c alm(out_shape(map, 1, {size_t(n_alm())}));
+      exec(SHARP_Yt, 0, alm.mutable_data(), map.data(), ntrans,
+        SHARP_USE_WEIGHTS);
       return alm;
       }
     a_d_c alm2map_spin (const a_c_c &alm, int64_t spin) const
       {
       MR_assert(npix_>0,"no map geometry specified");
-      auto ar=alm.unchecked<2>();
-      MR_assert((ar.shape(0)==2)&&(ar.shape(1)==n_alm()),
+      MR_assert(spin>0,"spin must be positive");
+      auto ntrans = get_ntrans(alm, 2);
+      MR_assert((alm.shape(alm.ndim()-2)==2)
+        &&(alm.shape(alm.ndim()-1)==n_alm()),
         "incorrect size of a_lm array");
-      a_d_c map(vector<size_t>{2,size_t(npix_)});
-      auto mr=map.mutable_unchecked<2>();
-      sharp_alm2map_spin(spin, &ar(0,0), &ar(1,0), &mr(0,0), &mr(1,0), *ginfo, *ainfo, 0, nthreads);
+      a_d_c map(out_shape(alm, 2, {2,size_t(npix_)}));
+      exec(SHARP_Y, spin, alm.data(), map.mutable_data(), ntrans, 0);
       return map;
       }
     a_c_c map2alm_spin (const a_d_c &map, int64_t spin) const
       {
       MR_assert(npix_>0,"no map geometry specified");
-      auto mr=map.unchecked<2>();
-      MR_assert ((mr.shape(0)==2)&&(mr.shape(1)==npix_),
+      MR_assert(spin>0,"spin must be positive");
+      auto ntrans = get_ntrans(map, 2);
+      MR_assert ((map.shape(map.ndim()-2)==2)
+        &&(map.shape(map.ndim()-1)==npix_),
         "incorrect size of map array");
-      a_c_c alm(vector<size_t>{2,size_t(n_alm())});
-      auto ar=alm.mutable_unchecked<2>();
-      sharp_map2alm_spin(spin, &ar(0,0), &ar(1,0), &mr(0,0), &mr(1,0), *ginfo, *ainfo, SHARP_USE_WEIGHTS, nthreads);
+      a_c_c alm(out_shape(map, 2, {2,size_t(n_alm())}));
+      exec(SHARP_Yt, spin, alm.mutable_data(), map.data(), ntrans,
+        SHARP_USE_WEIGHTS);
+      return alm;
+      }
+    py::tuple iter(const a_d_c &map, int64_t spin, int64_t niter,
+      double epsilon) const
+      {
+      MR_assert(npix_>0,"no map geometry specified");
+      MR_assert(ainfo,"a_lm info must be specified");
+      MR_assert(niter>=0,"niter must not be negative");
+      size_t ncomp = 1+(spin>0), nd = (spin>0) ? 2 : 1;
+      auto ntrans = get_ntrans(map, nd);
+      MR_assert((map.shape(map.ndim()-1)==npix_)
+        &&((spin==0)||(map.shape(map.ndim()-2)==2)),
+        "incorrect size of map array");
+      vector<size_t> shp{size_t(n_alm())};
+      if (spin>0) shp.insert(shp.begin(), 2);
+      a_c_c alm(out_shape(map, nd, shp));
+      vector<any> va, vm;
+      for (size_t i=0; i<ntrans*ncomp; ++i)
+        {
+        va.push_back(alm.mutable_data()+i*n_alm());
+        vm.push_back(map.data()+i*npix_);
+        }
+      vector<double> res;
+      {
+      py::gil_scoped_release release;
+      shared_lock_t lock(mut);
+      res = sharp_map2alm_iter(spin, va, vm, geom(), *ainfo, niter, epsilon,
+        nthreads);
+      }
+      a_d_c resid(res.size());
+      copy(res.begin(), res.end(), resid.mutable_data());
+      return py::make_tuple(alm, resid);
+      }
+    py::tuple map2alm_iter (const a_d_c &map, int64_t niter,
+      double epsilon) const
+      { return iter(map, 0, niter, epsilon); }
+    py::tuple map2alm_spin_iter (const a_d_c &map, int64_t spin,
+      int64_t niter, double epsilon) const
+      {
+      MR_assert(spin>0,"spin must be positive");
+      return iter(map, spin, niter, epsilon);
+      }
+    a_c_c weighted_projection (const a_c_c &alm, const a_d_c &weight,
+      int64_t spin) const
+      {
+      MR_assert(npix_>0,"no map geometry specified");
+      MR_assert(spin>=0, "spin must not be negative");
+      size_t nd = (spin==0) ? 1 : 2, ncomp = nd;
+      auto ntrans = get_ntrans(alm, nd);
+      MR_assert((alm.shape(alm.ndim()-1)==n_alm())
+        &&((spin==0)||(alm.shape(alm.ndim()-2)==2)),
+        "incorrect size of a_lm array");
+      MR_assert((weight.ndim()==1)&&(weight.shape(0)==npix_),
+        "incorrect size of weight array");
+      vector<size_t> shp{size_t(n_alm())};
+      if (spin>0) shp.insert(shp.begin(), 2);
+      a_c_c res(out_shape(alm, nd, shp));
+      vector<any> vin, vout;
+      for (size_t i=0; i<ntrans*ncomp; ++i)
+        {
+        vin.push_back(alm.data()+i*n_alm());
+        vout.push_back(res.mutable_data()+i*n_alm());
+        }
+      py::gil_scoped_release release;
+      shared_lock_t lock(mut);
+      plan(spin).weighted_projection(vin, vout, weight.data(), 0, nthreads);
+      return res;
+      }
+    a_d_c alm2map_deriv1 (const a_c_c &alm) const
+      {
+      MR_assert(npix_>0,"no map geometry specified");
+      auto ntrans = get_ntrans(alm, 1);
+      MR_assert (alm.shape(alm.ndim()-1)==n_alm(),
+        "incorrect size of a_lm array");
+      a_d_c map(out_shape(alm, 1, {2,size_t(npix_)}));
+      exec(SHARP_ALM2MAP_DERIV1, 1, alm.data(), map.mutable_data(), ntrans,
+        0);
+      return map;
+      }
+    a_c_c alm2map_deriv1_adjoint (const a_d_c &map) const
+      {
+      MR_assert(npix_>0,"no map geometry specified");
+      auto ntrans = get_ntrans(map, 2);
+      MR_assert ((map.shape(map.ndim()-2)==2)
+        &&(map.shape(map.ndim()-1)==npix_),
+        "incorrect size of map array");
+      a_c_c alm(out_shape(map, 2, {size_t(n_alm())}));
+      exec(SHARP_ALM2MAP_DERIV1_ADJOINT, 1, alm.mutable_data(), map.data(),
+        ntrans, 0);
       return alm;
       }
   };
 
+template<typename T> void add_sharpjob(py::module &m, const char *name)
+  {
+  using namespace pybind11::literals;
+  py::class_<py_sharpjob<T>> (m, name, py::module_local())
+    .def(py::init<>())
+    .def("set_nthreads", &py_sharpjob<T>::set_nthreads, "nthreads"_a)
+    .def("set_gauss_geometry", &py_sharpjob<T>::set_gauss_geometry,
+      "nrings"_a,"nphi"_a)
+    .def("set_healpix_geometry", &py_sharpjob<T>::set_healpix_geometry,
+      "nside"_a)
+    .def("set_fejer1_geometry", &py_sharpjob<T>::set_fejer1_geometry,
+      "nrings"_a, "nphi"_a)
+    .def("set_fejer2_geometry", &py_sharpjob<T>::set_fejer2_geometry,
+      "nrings"_a, "nphi"_a)
+    .def("set_cc_geometry", &py_sharpjob<T>::set_cc_geometry,
+      "nrings"_a, "nphi"_a)
+    .def("set_dh_geometry", &py_sharpjob<T>::set_dh_geometry,
+      "nrings"_a, "nphi"_a)
+    .def("set_mw_geometry", &py_sharpjob<T>::set_mw_geometry,
+      "nrings"_a, "nphi"_a)
+    .def("set_cutsky", &py_sharpjob<T>::set_cutsky, "mask"_a,
+      "epsilon"_a=0.)
+    .def("set_triangular_alm_info",
+      &py_sharpjob<T>::set_triangular_alm_info, "lmax"_a, "mmax"_a)
+    .def("n_alm", &py_sharpjob<T>::n_alm)
+    .def("autotune", &py_sharpjob<T>::autotune, "spin"_a=0)
+    .def("alm2map", &py_sharpjob<T>::alm2map,"alm"_a)
+    .def("alm2map_adjoint", &py_sharpjob<T>::alm2map_adjoint,"map"_a)
+    .def("map2alm", &py_sharpjob<T>::map2alm,"map"_a)
+    .def("alm2map_spin", &py_sharpjob<T>::alm2map_spin,"alm"_a,"spin"_a)
+    .def("map2alm_spin", &py_sharpjob<T>::map2alm_spin,"map"_a,"spin"_a)
+    .def("map2alm_iter", &py_sharpjob<T>::map2alm_iter, "map"_a, "niter"_a,
+      "epsilon"_a=0.)
+    .def("map2alm_spin_iter", &py_sharpjob<T>::map2alm_spin_iter, "map"_a,
+      "spin"_a, "niter"_a, "epsilon"_a=0.)
+    .def("weighted_projection", &py_sharpjob<T>::weighted_projection,
+      "alm"_a, "weight"_a, "spin"_a=0)
+    .def("alm2map_deriv1", &py_sharpjob<T>::alm2map_deriv1,"alm"_a)
+    .def("alm2map_deriv1_adjoint", &py_sharpjob<T>::alm2map_deriv1_adjoint,
+      "map"_a)
+    .def("__repr__", &py_sharpjob<T>::repr);
+  }
+
 const char *sht_DS = R"""(
 Python interface for some of the libsharp functionality
 
 Error conditions are reported by raising exceptions.
+
+`sharpjob_d` works on double precision maps and a_lm, `sharpjob_f` on single
+precision ones; the internal computations are carried out in double precision
+in both cases.
+
+All transform methods accept an optional extra leading array dimension; the
+transforms along it are carried out in a single pass, sharing the Legendre
+recursion between them.
+
+`alm2map_deriv1` computes the gradient maps dT/dtheta and dT/dphi/sin(theta)
+(shape (2, npix)) of a scalar field directly from its a_lm;
+`alm2map_deriv1_adjoint` is its adjoint.
+
+`map2alm_iter(map, niter, epsilon=0.)` and
+`map2alm_spin_iter(map, spin, niter, epsilon=0.)` improve the result of
+`map2alm` by up to `niter` Jacobi iterations (stopping once the relative
+residual of the map drops to `epsilon`), which helps for geometries without
+exact quadrature like HEALPix. They return the a_lm and an array with the
+relative residual after every step.
+
+`weighted_projection(alm, weight, spin=0)` returns
+`alm2map_adjoint(weight*alm2map(alm))` (or its spin counterpart, with `alm` of
+shape (2, n_alm)) in a single pass; the maps are only formed ring by ring in
+small buffers, which saves the map-sized temporary arrays and their memory
+traffic.
+
+`autotune(spin)` times several ways of splitting the rings into chunks for the
+current geometry, a_lm set, spin and number of threads, and makes all later
+transforms with these properties use the fastest one. The results can be kept
+across sessions with `save_wisdom()` and `load_wisdom()`.
+
+`set_cutsky(mask, epsilon=0.)` restricts the transforms of the current
+geometry to the rings containing a nonzero pixel of `mask`; all other rings
+are skipped by the FFTs and the Legendre transforms, and maps produced by
+`alm2map` are zero there. With `epsilon>0`, the m range on each ring is also
+cut where the Y_lm have decayed below `epsilon`. Setting a new geometry
+removes the mask.
 )""";
 
+void load_wisdom(const string &filename)
+  { sharp_load_wisdom(filename); }
+void save_wisdom(const string &filename)
+  { sharp_save_wisdom(filename); }
+
 void add_sht(py::module &msup)
   {
   using namespace pybind11::literals;
   auto m = msup.def_submodule("sht");
   m.doc() = sht_DS;
 
-  py::class_<py_sharpjob<double>> (m, "sharpjob_d", py::module_local())
-    .def(py::init<>())
-    .def("set_nthreads", &py_sharpjob<double>::set_nthreads, "nthreads"_a)
-    .def("set_gauss_geometry", &py_sharpjob<double>::set_gauss_geometry,
-      "nrings"_a,"nphi"_a)
-    .def("set_healpix_geometry", &py_sharpjob<double>::set_healpix_geometry,
-      "nside"_a)
-    .def("set_fejer1_geometry", &py_sharpjob<double>::set_fejer1_geometry,
-      "nrings"_a, "nphi"_a)
-    .def("set_fejer2_geometry", &py_sharpjob<double>::set_fejer2_geometry,
-      "nrings"_a, "nphi"_a)
-    .def("set_cc_geometry", &py_sharpjob<double>::set_cc_geometry,
-      "nrings"_a, "nphi"_a)
-    .def("set_dh_geometry", &py_sharpjob<double>::set_dh_geometry,
-      "nrings"_a, "nphi"_a)
-    .def("set_mw_geometry", &py_sharpjob<double>::set_mw_geometry,
-      "nrings"_a, "nphi"_a)
-    .def("set_triangular_alm_info",
-      &py_sharpjob<double>::set_triangular_alm_info, "lmax"_a, "mmax"_a)
-    .def("n_alm", &py_sharpjob<double>::n_alm)
-    .def("alm2map", &py_sharpjob<double>::alm2map,"alm"_a)
-    .def("alm2map_adjoint", &py_sharpjob<double>::alm2map_adjoint,"map"_a)
-    .def("map2alm", &py_sharpjob<double>::map2alm,"map"_a)
-    .def("alm2map_spin", &py_sharpjob<double>::alm2map_spin,"alm"_a,"spin"_a)
-    .def("map2alm_spin", &py_sharpjob<double>::map2alm_spin,"map"_a,"spin"_a)
-    .def("__repr__", &py_sharpjob<double>::repr);
+  add_sharpjob<double>(m, "sharpjob_d");
+  add_sharpjob<float>(m, "sharpjob_f");
+  m.def("load_wisdom", &load_wisdom, "filename"_a);
+  m.def("save_wisdom", &save_wisdom, "filename"_a);
   }
 
 }
@@ -109,6 +109,30 @@ def test1D(len, inorm, dtype):
     assert_(_l2error(tmp, a) < eps)
 
 
+@pmp("len", (61, 97, 127, 2*1009, 64*97, 3*257, 8191, 65537))
+def test_large_primes(len):
+    # lengths with large prime factors; these use Rader's algorithm
+    rng = np.random.default_rng(42)
+    a = rng.random(len)-0.5 + 1j*rng.random(len)-0.5j
+    _assert_close(fftn(a), np.fft.fftn(a), 1e-15)
+    _assert_close(ifftn(a), np.fft.ifftn(a)*len, 1e-15)
+    _assert_close(rfftn(a.real), np.fft.rfftn(a.real), 1e-15)
+    _assert_close(irfft_scipy(rfft_scipy(a.real, 0), 0, inorm=2), a.real,
+                  1e-15)
+
+
+@pmp("len", (256, 768, 2048, 8192, 65536))
+@pmp("nlines", (1, 13))
+def test_radix16(len, nlines):
+    # single lines and SIMD-vectorized multiple lines use different plans
+    rng = np.random.default_rng(42)
+    a = rng.random((len, nlines))-0.5 + 1j*rng.random((len, nlines))-0.5j
+    _assert_close(fftn(a, axes=(0,)), np.fft.fftn(a, axes=(0,)), 1e-15)
+    _assert_close(ifftn(a, axes=(0,)), np.fft.ifftn(a, axes=(0,))*len, 1e-15)
+    b = a.astype(np.complex64)
+    _assert_close(fftn(b, axes=(0,)), np.fft.fftn(a, axes=(0,)), 3e-7)
+
+
 @pmp("shp", shapes)
 @pmp("nthreads", (0, 1, 2))
 @pmp("inorm", [0, 1, 2])
@@ -265,3 +289,174 @@ def testdcst1D(len, inorm, type, dtype):
                       inorm=2-inorm, type=itype), eps)
     _assert_close(a, fft.dst(fft.dst(a, inorm=inorm, type=type), inorm=2-inorm,
                   type=itype), eps)
+
+
+@pmp("len", (65536, 131072+2, 240240, 3*65536))
+@pmp("shp", ((), (2,)))
+@pmp("forward", (True, False))
+def test_fourstep(len, shp, forward):
+    # long 1D transforms with few lines take the multithreaded code path
+    rng = np.random.default_rng(42)
+    a = rng.random(shp+(len,))-0.5+1j*(rng.random(shp+(len,))-0.5)
+    ref = fft.c2c(a, axes=(-1,), forward=forward, inorm=2, nthreads=1)
+    res = fft.c2c(a, axes=(-1,), forward=forward, inorm=2, nthreads=4)
+    _assert_close(res, ref, 1e-14)
+    b = a.real.copy()
+    ref = fft.r2c(b, axes=(-1,), forward=forward, inorm=2, nthreads=1)
+    res = fft.r2c(b, axes=(-1,), forward=forward, inorm=2, nthreads=4)
+    _assert_close(res, ref, 1e-14)
+    ref = fft.c2r(ref, axes=(-1,), lastsize=len, forward=not forward,
+                  nthreads=1)
+    res = fft.c2r(res, axes=(-1,), lastsize=len, forward=not forward,
+                  nthreads=4)
+    _assert_close(res, ref, 1e-14)
+    _assert_close(res, b, 1e-14)
+
+
+def test_plan_cache():
+    rng = np.random.default_rng(42)
+    a = rng.random(1009)-0.5 + 1j*rng.random(1009)-0.5j
+    fft.set_plan_cache_size(16)
+    fft.clear_plan_cache()
+    ref = fftn(a)
+    info = fft.plan_cache_info()
+    assert_(info["size"] == 1 and info["misses"] == 1 and info["hits"] == 0)
+    _assert_close(fftn(a), ref, 1e-15)
+    assert_(fft.plan_cache_info()["hits"] == 1)
+    fft.set_plan_cache_size(0)
+    assert_(fft.plan_cache_info()["size"] == 0)
+    _assert_close(fftn(a), ref, 1e-15)
+    assert_(fft.plan_cache_info()["size"] == 0)
+    fft.set_plan_cache_size(16)
+    assert_(fft.plan_cache_info()["max_size"] == 16)
+
+
+@pmp("shp", shapes2D+shapes3D)
+@pmp("inorm", [0, 1, 2])
+@pmp("nthreads", (1, 2))
+def test_plan(shp, inorm, nthreads):
+    rng = np.random.default_rng(42)
+    a = rng.random(shp)-0.5
+    c = a + 1j*(rng.random(shp)-0.5)
+    axes = (0, a.ndim-1)
+    plan = fft.Plan("c2c", c.shape, c.dtype, axes=axes, forward=False,
+                    inorm=inorm, nthreads=nthreads)
+    for _ in range(2):
+        _assert_close(plan(c), ifftn(c, axes=axes, inorm=inorm), 1e-15)
+    out = np.empty_like(c)
+    assert_(plan.execute(c, out=out) is out)
+    plan = fft.Plan("r2c", a.shape, a.dtype, axes=axes, inorm=inorm)
+    res = plan(a)
+    assert_(res.shape == tuple(plan.output_shape()))
+    _assert_close(res, fft.r2c(a, axes=axes, inorm=inorm), 1e-15)
+    plan = fft.Plan("c2r", res.shape, res.dtype, axes=axes,
+                    lastsize=a.shape[axes[-1]], forward=False, inorm=2)
+    _assert_close(plan(res), a, 1e-15)
+    for tp in range(1, 5):
+        if tp != 1 or min(a.shape[ax] for ax in axes) > 1:
+            plan = fft.Plan("dct", a.shape, a.dtype, axes=axes, type=tp,
+                            inorm=inorm)
+            _assert_close(plan(a), fft.dct(a, axes=axes, type=tp,
+                          inorm=inorm), 1e-15)
+    plan = fft.Plan("genuine_hartley", a.shape, a.dtype, axes=axes)
+    _assert_close(plan(a), fft.genuine_hartley(a, axes=axes), 1e-15)
+    b = a.astype(np.float32)
+    plan = fft.Plan("separable_hartley", b.shape, b.dtype)
+    _assert_close(plan(b), fft.separable_hartley(b), 5e-7)
+    with pytest.raises(RuntimeError):
+        plan(a)
+
+
+@pmp("shp", shapes1D+shapes2D+shapes3D)
+@pmp("inorm", [0, 2])
+@pmp("dtype", (np.float32, np.float64))
+@pmp("nthreads", (1, 2))
+def test_inplace_real(shp, inorm, dtype, nthreads):
+    rng = np.random.default_rng(42)
+    a = (rng.random(shp)-0.5).astype(dtype)
+    n = shp[-1]
+    buf = np.zeros(shp[:-1]+(2*(n//2+1),), dtype=dtype)
+    buf[..., :n] = a
+    tol = 1e-5 if dtype == np.float32 else 1e-14
+    ref = fft.r2c(a, inorm=inorm)
+    res = fft.r2c_inplace(buf, lastsize=n, inorm=inorm, nthreads=nthreads)
+    assert_(np.shares_memory(res, buf))
+    _assert_close(res, ref, tol)
+    res2 = fft.c2r_inplace(res, lastsize=n, forward=False, inorm=2-inorm,
+                           nthreads=nthreads)
+    assert_(np.shares_memory(res2, buf))
+    _assert_close(res2, a, tol)
+    axes = (a.ndim-1,)
+    ref = fft.r2c(a, axes=axes, forward=False)
+    buf[..., :n] = a
+    res = fft.r2c_inplace(buf, axes=axes, lastsize=n, forward=False)
+    _assert_close(res, ref, tol)
+
+
+@pmp("shp", shapes2D)
+@pmp("nthreads", (1, 2))
+def test_async(shp, nthreads):
+    rng = np.random.default_rng(42)
+    a = rng.random(shp)-0.5 + 1j*(rng.random(shp)-0.5)
+    futures = [fft.c2c_async(a, forward=fwd, nthreads=nthreads)
+               for fwd in (True, False)]
+    futures.append(fft.r2c_async(a.real, nthreads=nthreads))
+    assert_((futures[0].result() == fft.c2c(a)).all())
+    assert_((futures[1].result() == fft.c2c(a, forward=False)).all())
+    assert_((futures[2].result() == fft.r2c(a.real)).all())
+    with pytest.raises(Exception):
+        fft.c2c_async(a, axes=(5,)).result()
+
+
+def convolve_axis_ref(a, lout, axis, kernel):
+    a = np.moveaxis(a, axis, -1)
+    lin = a.shape[-1]
+    lmin = min(lin, lout)
+    if np.isrealobj(a):
+        k = np.empty(lmin, dtype=np.complex128)
+        k[:lmin//2+1] = kernel
+        k[lmin//2+1:] = kernel[1:(lmin+1)//2][::-1]
+        kernel = k
+    fa = np.fft.fft(a, axis=-1)
+    res = np.zeros(a.shape[:-1]+(lout,), dtype=np.complex128)
+    for f in range(-((lmin-1)//2), (lmin-1)//2+1):
+        res[..., f % lout] = fa[..., f % lin]*kernel[f % lmin]
+    if lmin % 2 == 0:
+        f = lmin//2
+        if lmin < lout:
+            res[..., f] = res[..., lout-f] = 0.5*fa[..., f]*kernel[f]
+        elif lmin < lin:
+            res[..., f] = (fa[..., f]+fa[..., lin-f])*kernel[f]
+        else:
+            res[..., f] = fa[..., f]*kernel[f]
+    res = np.fft.ifft(res, axis=-1)*lout
+    if np.isrealobj(a):
+        res = res.real
+    return np.moveaxis(res, -1, axis)
+
+
+@pmp("shp", [(10, 7), (4, 6, 5)])
+@pmp("lout", [4, 10, 13, 24])
+@pmp("dtype", [np.float64, np.complex128])
+@pmp("nthreads", [1, 2])
+def test_convolve_axis(shp, lout, dtype, nthreads):
+    rng = np.random.default_rng(42)
+    for axis in range(len(shp)):
+        lin = shp[axis]
+        if dtype == np.float64 and (lin % 2 or lout % 2):
+            continue
+        a = rng.random(shp)-0.5
+        if dtype == np.complex128:
+            a = a + 1j*(rng.random(shp)-0.5)
+        lmin = min(lin, lout)
+        nk = lmin//2+1 if dtype == np.float64 else lmin
+        kernel = (rng.random(nk)-0.5).astype(dtype)
+        if dtype == np.complex128:
+            kernel += 1j*(rng.random(nk)-0.5)
+        oshp = list(shp)
+        oshp[axis] = lout
+        out = np.empty(oshp, dtype=dtype)
+        res = fft.convolve_axis(a, out, axis, kernel, nthreads)
+        assert res is out
+        assert_(_l2error(convolve_axis_ref(a, lout, axis, kernel), out)
+                < 1e-14)
@@ -92,3 +92,132 @@ def test_vecangvec(vlen):
     inp = random_ptg(rng, vlen)
     out = ph.vec2ang(ph.ang2vec(inp))
     assert_equal(np.all(np.abs(out-inp) < 1e-14), True)
+
+
+def test_nthreads(nside_ring):
+    base = ph.Healpix_Base(nside_ring, "RING")
+    rng = np.random.default_rng(42)
+    ptg = random_ptg(rng, 10000)
+    pix = base.ang2pix(ptg)
+    assert_equal(base.ang2pix(ptg, nthreads=4), pix)
+    assert_equal(base.pix2ang(pix, nthreads=4), base.pix2ang(pix))
+    assert_equal(base.neighbors(pix, nthreads=4), base.neighbors(pix))
+    vec = ph.ang2vec(ptg, nthreads=4)
+    assert_equal(vec, ph.ang2vec(ptg))
+    assert_equal(base.vec2pix(vec, nthreads=4), base.vec2pix(vec))
+    assert_equal(ph.v_angle(vec, vec[::-1], nthreads=4),
+                 ph.v_angle(vec, vec[::-1]))
+
+
+def test_multidim(nside_nest):
+    base = ph.Healpix_Base(nside_nest, "NEST")
+    rng = np.random.default_rng(42)
+    ptg = random_ptg(rng, 1001)
+    pix = base.ang2pix(ptg)
+    assert_equal(base.ang2pix(ptg.reshape((7, 143, 2))), pix.reshape((7, 143)))
+    vec = base.pix2vec(pix)
+    assert_equal(base.pix2vec(pix.reshape((11, 91))), vec.reshape((11, 91, 3)))
+    assert_equal(base.vec2pix(vec[::-1]), pix[::-1])
+
+
+@pmp("nside", [1, 4, 7, 64, 1000])
+@pmp("scheme", ["RING", "NEST"])
+def test_query_disc_batch(nside, scheme):
+    if scheme == "NEST" and nside & (nside-1) != 0:
+        pytest.skip()
+    base = ph.Healpix_Base(nside, scheme)
+    rng = np.random.default_rng(42)
+    ptg = random_ptg(rng, 100)
+    radius = rng.random(100)*0.2
+    ofs, ranges = base.query_disc_batch(ptg, radius, nthreads=4)
+    assert_equal(ofs.shape, (101,))
+    assert_equal(ranges.shape, (ofs[-1], 2))
+    for i in range(100):
+        ref = base.query_disc(ptg[i], radius[i])
+        assert_equal(ranges[ofs[i]:ofs[i+1]], ref)
+    ofs2, ranges2 = base.query_disc_batch(ptg, 0.1)
+    ofs3, ranges3 = base.query_disc_batch(ptg, np.full(100, 0.1))
+    assert_equal(ofs2, ofs3)
+    assert_equal(ranges2, ranges3)
+
+
+@pmp("nside", [1, 2, 16, 128])
+@pmp("dtype", [np.float32, np.float64])
+def test_swap_scheme(nside, dtype):
+    rng = np.random.default_rng(42)
+    npix = 12*nside**2
+    inp = rng.random(npix).astype(dtype)
+    base = ph.Healpix_Base(nside, "RING")
+    map = inp.copy()
+    ph.swap_scheme(map, "RING", nthreads=2)
+    assert_equal(map[base.ring2nest(np.arange(npix))], inp)
+    ph.swap_scheme(map, "NEST")
+    assert_equal(map, inp)
+
+
+@pmp("nside", [1, 4, 5, 32])
+@pmp("fact", [2, 3, 4])
+@pmp("scheme_in", ["RING", "NEST"])
+@pmp("scheme_out", ["RING", "NEST"])
+def test_ud_grade(nside, fact, scheme_in, scheme_out):
+    pow2 = (nside & (nside-1)) == 0 and (fact & (fact-1)) == 0
+    if not pow2 and "NEST" in (scheme_in, scheme_out):
+        pytest.skip()
+    rng = np.random.default_rng(42)
+    inp = rng.random(12*nside**2)
+    hi = ph.ud_grade(inp, scheme_in, nside*fact, scheme_out, nthreads=2)
+    base_in = ph.Healpix_Base(nside, scheme_in)
+    base_hi = ph.Healpix_Base(nside*fact, scheme_out)
+    ipix = base_in.ang2pix(base_hi.pix2ang(np.arange(base_hi.npix())))
+    assert_equal(hi, inp[ipix])
+    lo = ph.ud_grade(hi, scheme_out, nside, scheme_in)
+    np.testing.assert_allclose(lo, inp, rtol=1e-14)
+    hi[0] = -1.6375e30
+    lo = ph.ud_grade(hi, scheme_out, nside, scheme_in, pessimistic=True)
+    assert_equal(np.sum(lo == -1.6375e30), 1)
+
+
+@pmp("nside", [1, 2, 16, 128])
+@pmp("dtype", [np.float32, np.float64])
+def test_interpolate_map(nside, dtype):
+    rng = np.random.default_rng(42)
+    npix = 12*nside**2
+    bring = ph.Healpix_Base(nside, "RING")
+    bnest = ph.Healpix_Base(nside, "NEST")
+    mring = rng.random(npix).astype(dtype)
+    mnest = mring[bring.nest2ring(np.arange(npix))]
+    ptg = random_ptg(rng, 1000).reshape((10, 100, 2))
+    pix, wgt = bring.get_interpol(ptg, nthreads=2)
+    assert_equal(pix.shape, (10, 100, 4))
+    np.testing.assert_allclose(np.sum(wgt, axis=-1), 1., rtol=1e-13)
+    ref = np.sum(mring[pix]*wgt, axis=-1)
+    rtol = 1e-6 if dtype == np.float32 else 1e-13
+    res = bring.interpolate_map(mring, ptg, nthreads=2)
+    assert_equal(res.dtype, dtype)
+    np.testing.assert_allclose(res, ref, rtol=rtol)
+    np.testing.assert_allclose(bnest.interpolate_map(mnest, ptg), ref,
+                               rtol=rtol)
+    # at the pixel centers, the map values are reproduced
+    cptg = bring.pix2ang(np.arange(npix))
+    atol = 1e-6 if dtype == np.float32 else 1e-11
+    np.testing.assert_allclose(bring.interpolate_map(mring, cptg), mring,
+                               atol=atol)
+
+
+@pmp("nside", [1, 4, 16, 256])
+@pmp("scheme", ["RING", "NEST"])
+def test_query_polygon(nside, scheme):
+    base = ph.Healpix_Base(nside, scheme)
+    vertex = np.array([[0.3, 0.1], [1.2, 0.2], [1.0, 1.3], [0.4, 1.1]])
+    ranges = base.query_polygon(vertex)
+    assert_equal(base.query_polygon(vertex, nthreads=4), ranges)
+    # compare with a brute-force test of all pixel centers
+    vv = ph.ang2vec(vertex)
+    normal = np.cross(vv, np.roll(vv, -1, axis=0))
+    normal *= np.sign(np.dot(normal[0], vv[2]))
+    inside = np.all(np.dot(base.pix2vec(np.arange(base.npix())), normal.T) > 0,
+                    axis=-1)
+    ref = np.zeros(base.npix(), dtype=bool)
+    for lo, hi in ranges:
+        ref[lo:hi] = True
+    assert_equal(ref, inside)
@@ -0,0 +1,190 @@
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Copyright(C) 2020 Max-Planck-Society
+
+
+import ducc0.fft as fft
+import ducc0.misc as misc
+import json
+import threading
+import numpy as np
+import pytest
+from numpy.testing import assert_, assert_equal
+
+pmp = pytest.mark.parametrize
+
+
+def _make_array(shape, dtype, rng):
+    res = rng.uniform(-1, 1, shape)
+    if np.issubdtype(dtype, np.complexfloating):
+        res = res + 1j*rng.uniform(-1, 1, shape)
+    elif np.issubdtype(dtype, np.integer):
+        res = 1000*res
+    return res.astype(dtype)
+
+
+@pmp("shape", ((17,), (3, 5), (130, 257), (256, 256), (7, 1, 65, 33),
+               (4, 5, 6, 7)))
+@pmp("dtype", (np.float32, np.float64, np.complex64, np.complex128,
+               np.int32, np.int64))
+@pmp("nthreads", (1, 2))
+def test_transpose(shape, dtype, nthreads):
+    rng = np.random.default_rng(42)
+    a = _make_array(shape, dtype, rng)
+    perm = rng.permutation(len(shape))
+    # non-contiguous input with permuted axes
+    b = a.transpose(perm)
+    res = misc.ascontiguousarray(b, nthreads=nthreads)
+    assert_(res.flags["C_CONTIGUOUS"])
+    assert_equal(res, b)
+    # output with reversed axis order and a negative stride
+    out = np.zeros(b.shape[::-1], dtype=dtype).T[::-1]
+    misc.transpose(b[::-1], out, nthreads=nthreads)
+    assert_equal(out, b[::-1])
+
+
+def test_tracing():
+    a = np.ones((64, 64), dtype=np.complex128)
+    misc.clear_trace()
+    fft.c2c(a, nthreads=2)
+    assert_(json.loads(misc.get_trace())["traceEvents"] == [])
+    misc.set_tracing(True)
+    try:
+        fft.c2c(a, nthreads=2)
+    finally:
+        misc.set_tracing(False)
+    events = json.loads(misc.get_trace())["traceEvents"]
+    names = [ev["name"] for ev in events]
+    assert_("general_nd" in names)
+    for ev in events:
+        assert_(ev["ph"] == "X" and ev["dur"] >= 0)
+    misc.clear_trace()
+    assert_(json.loads(misc.get_trace())["traceEvents"] == [])
+
+
+def test_perf_counters():
+    avail = misc.perf_events_available()
+    assert_(all(isinstance(name, str) for name in avail))
+    a = np.ones((64, 64), dtype=np.complex128)
+    misc.clear_trace()
+    misc.set_tracing(True)
+    misc.set_perf_counters(True)
+    try:
+        fft.c2c(a, nthreads=2)
+    finally:
+        misc.set_perf_counters(False)
+        misc.set_tracing(False)
+    events = json.loads(misc.get_trace())["traceEvents"]
+    misc.clear_trace()
+    for ev in events:
+        if ev["name"] == "general_nd":
+            assert_(sorted(ev["args"].keys()) == sorted(avail))
+
+
+@pmp("budget", (1, 3))
+def test_thread_budget(budget):
+    rng = np.random.default_rng(42)
+    a = _make_array((8, 200, 30), np.complex128, rng)
+    ref = fft.c2c(a, axes=(1, 2))
+    old = misc.get_thread_budget()
+    misc.set_thread_budget(budget)
+    try:
+        assert_equal(misc.get_thread_budget(), budget)
+        group = misc.ThreadGroup(2)
+        assert_equal(group.nthreads, 2)
+        res = [None]*4
+
+        def work(i):
+            with group:
+                res[i] = fft.c2c(a, axes=(1, 2), nthreads=4)
+        threads = [threading.Thread(target=work, args=(i,)) for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+    finally:
+        misc.set_thread_budget(old)
+    for r in res:
+        assert_equal(r, ref)
+
+
+def test_run_async():
+    def add(a, b=0):
+        return a+b
+    assert_equal(misc.run_async(add, 1, b=2).result(), 3)
+    with pytest.raises(ZeroDivisionError):
+        misc.run_async(lambda: 1/0).result()
+    a = np.arange(12.).reshape(3, 4)
+    fut = misc.run_async(misc.ascontiguousarray, a.T, nthreads=2)
+    assert_equal(fut.result(), np.ascontiguousarray(a.T))
+
+
+@pmp("has_np", (False, True))
+@pmp("has_sp", (False, True))
+@pmp("nthreads", (1, 2))
+def test_upsample_to_cc(has_np, has_sp, nthreads):
+    ntheta, nphi, nout = 10, 300, 23
+    # equidistant rings, the first/last one at the pole if requested
+    nrings = 2*ntheta - has_np - has_sp
+    theta = (np.arange(ntheta) + 0.5*(not has_np))*2*np.pi/nrings
+    phi = np.arange(nphi)*2*np.pi/nphi
+
+    def func(th, ph, k):
+        # a few low-order functions on the sphere
+        st, ct = np.sin(th)[:, None], np.cos(th)[:, None]
+        return k*ct + st*np.cos(ph)[None, :] + (k+1)*ct*st*np.sin(ph)[None, :]
+    m = np.array([func(theta, phi, k) for k in range(3)])
+    res = misc.upsample_to_cc(m, nout, has_np, has_sp, nthreads=nthreads)
+    theta_out = np.arange(nout)*np.pi/(nout-1)
+    ref = np.array([func(theta_out, phi, k) for k in range(3)])
+    np.testing.assert_allclose(res, ref, atol=1e-13)
+    assert_equal(misc.upsample_to_cc(m[1], nout, has_np, has_sp), res[1])
+
+
+def random_alm(lmax, mmax, rng):
+    nalm = ((mmax+1)*(mmax+2))//2 + (mmax+1)*(lmax-mmax)
+    res = rng.uniform(-1., 1., nalm) + 1j*rng.uniform(-1., 1., nalm)
+    res[0:lmax+1].imag = 0.
+    return res
+
+
+@pmp("lmax,mmax", ((0, 0), (10, 10), (200, 100), (130, 129)))
+@pmp("nthreads", (1, 2))
+def test_alm_layouts(lmax, mmax, nthreads):
+    rng = np.random.default_rng(42)
+    alm = random_alm(lmax, mmax, rng)
+    alm2 = random_alm(lmax, mmax, rng)
+    # reference: explicit loops over the triangular layout
+    ref = []
+    cl_ref = np.zeros(lmax+1)
+    for l in range(lmax+1):
+        idx = [m*(2*lmax+1-m)//2 + l for m in range(min(l, mmax)+1)]
+        ref.append(alm[idx])
+        cl_ref[l] = (np.sum(2*(alm[idx]*np.conj(alm2[idx])).real)
+                     - (alm[l]*alm2[l]).real)/(2*l+1)
+    ref = np.concatenate(ref)
+    lmaj = misc.alm_to_lmajor(alm, lmax, mmax, nthreads=nthreads)
+    assert_equal(lmaj, ref)
+    assert_equal(misc.alm_from_lmajor(lmaj, lmax, mmax, nthreads), alm)
+    rlmaj = misc.alm_to_lmajor(alm, lmax, mmax, real=True, nthreads=nthreads)
+    assert_(rlmaj.dtype == np.float64)
+    np.testing.assert_allclose(
+        misc.alm_from_lmajor(rlmaj, lmax, mmax, nthreads), alm, atol=1e-15)
+    np.testing.assert_allclose(
+        np.sum(rlmaj**2),
+        np.sum(misc.alm2cl(alm, alm, lmax, mmax)*(2*np.arange(lmax+1)+1)),
+        rtol=1e-13)
+    cl = misc.alm2cl(alm, alm2, lmax, mmax, nthreads)
+    np.testing.assert_allclose(cl, cl_ref, rtol=1e-12, atol=1e-15)
+    assert_equal(misc.alm2cl(alm, alm2, lmax, mmax, 3), cl)
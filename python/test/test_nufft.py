@@ -0,0 +1,124 @@
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Copyright(C) 2020 Max-Planck-Society
+
+
+import ducc0.nufft as nufft
+import numpy as np
+import pytest
+from numpy.testing import assert_allclose
+
+pmp = pytest.mark.parametrize
+
+
+def _l2error(a, b):
+    return np.sqrt(np.sum(np.abs(a-b)**2)/np.sum(np.abs(a)**2))
+
+
+def _modes(shape, fft_order):
+    res = []
+    for n in shape:
+        k = np.arange(n) - n//2
+        res.append(np.fft.ifftshift(k) if fft_order else k)
+    k = np.meshgrid(*res, indexing='ij')
+    return np.stack([kk.reshape((-1,)) for kk in k], axis=1)
+
+
+def explicit_nu2u(points, coord, shape, forward, fft_order):
+    k = _modes(shape, fft_order)
+    isign = -1 if forward else 1
+    ph = np.exp(isign*1j*(k.dot(coord.T)))
+    return ph.dot(points).reshape(shape)
+
+
+def explicit_u2nu(grid, coord, forward, fft_order):
+    k = _modes(grid.shape, fft_order)
+    isign = -1 if forward else 1
+    ph = np.exp(isign*1j*(coord.dot(k.T)))
+    return ph.dot(grid.reshape((-1,)))
+
+
+@pmp("shape", ((10,), (127,), (16, 33), (1, 9), (5, 8, 7)))
+@pmp("npoints", (1, 37, 300))
+@pmp("epsilon", (1e-2, 1e-5, 1e-12))
+@pmp("forward", (True, False))
+@pmp("fft_order", (True, False))
+@pmp("singleprec", (True, False))
+@pmp("nthreads", (1, 2))
+def test_nufft(shape, npoints, epsilon, forward, fft_order, singleprec,
+               nthreads):
+    if singleprec and epsilon < 1e-5:
+        pytest.skip()
+    rng = np.random.default_rng(42)
+    ctype = np.complex64 if singleprec else np.complex128
+    coord = rng.uniform(-np.pi, 3*np.pi, (npoints, len(shape)))
+    points = (rng.random(npoints)-0.5 + 1j*(rng.random(npoints)-0.5))
+    points = points.astype(ctype)
+    out = np.zeros(shape, dtype=ctype)
+    res = nufft.nu2u(points=points, coord=coord, forward=forward,
+                     epsilon=epsilon, nthreads=nthreads, out=out,
+                     fft_order=fft_order)
+    ref = explicit_nu2u(points.astype(np.complex128), coord, shape, forward,
+                        fft_order)
+    assert_allclose(_l2error(ref, res), 0, atol=epsilon)
+
+    grid = (rng.random(shape)-0.5 + 1j*(rng.random(shape)-0.5)).astype(ctype)
+    res = nufft.u2nu(grid=grid, coord=coord, forward=forward,
+                     epsilon=epsilon, nthreads=nthreads, fft_order=fft_order)
+    ref = explicit_u2nu(grid.astype(np.complex128), coord, forward, fft_order)
+    assert_allclose(_l2error(ref, res), 0, atol=epsilon)
+
+
+@pmp("shape", ((20,), (12, 17), (6, 5, 9)))
+@pmp("forward", (True, False))
+def test_adjointness(shape, forward):
+    rng = np.random.default_rng(42)
+    npoints = 100
+    coord = rng.uniform(-np.pi, np.pi, (npoints, len(shape)))
+    points = rng.random(npoints)-0.5 + 1j*(rng.random(npoints)-0.5)
+    grid = rng.random(shape)-0.5 + 1j*(rng.random(shape)-0.5)
+    out = np.zeros(shape, dtype=np.complex128)
+    res1 = nufft.nu2u(points=points, coord=coord, forward=forward,
+                      epsilon=1e-12, out=out)
+    res2 = nufft.u2nu(grid=grid, coord=coord, forward=not forward,
+                      epsilon=1e-12)
+    assert_allclose(np.vdot(grid, res1), np.vdot(res2, points), rtol=1e-10)
+
+
+def explicit_nu2nu(points, coord, freq, forward):
+    isign = -1 if forward else 1
+    ph = np.exp(isign*1j*(freq.dot(coord.T)))
+    return ph.dot(points)
+
+
+@pmp("ndim", (1, 2, 3))
+@pmp("npoints", (1, 37, 300))
+@pmp("nfreq", (1, 50))
+@pmp("epsilon", (1e-2, 1e-5, 1e-12))
+@pmp("forward", (True, False))
+@pmp("singleprec", (True, False))
+@pmp("nthreads", (1, 2))
+def test_nufft3(ndim, npoints, nfreq, epsilon, forward, singleprec, nthreads):
+    if singleprec and epsilon < 1e-5:
+        pytest.skip()
+    rng = np.random.default_rng(42)
+    ctype = np.complex64 if singleprec else np.complex128
+    coord = rng.uniform(-3, 17, (npoints, ndim))
+    freq = rng.uniform(-20, 5, (nfreq, ndim))
+    points = (rng.random(npoints)-0.5 + 1j*(rng.random(npoints)-0.5))
+    points = points.astype(ctype)
+    res = nufft.nu2nu(points=points, coord=coord, freq=freq, forward=forward,
+                      epsilon=epsilon, nthreads=nthreads)
+    ref = explicit_nu2nu(points.astype(np.complex128), coord, freq, forward)
+    assert_allclose(_l2error(ref, res), 0, atol=epsilon)
@@ -90,3 +90,98 @@ def testp2():
     squat3 *= np.sign(squat3[:,0]).reshape((-1,1))
     _assert_close(quat4, squat3, 1e-13)
 
+
+
+@pmp("rot_left", (True, False))
+@pmp("nthreads", (1, 2))
+def test_multidet(rot_left, nthreads):
+    rng = np.random.default_rng(42)
+    t01, f1, size1 = 0., 1., 200
+    quat1 = rng.uniform(-.5, .5, (size1, 4))
+    prov = pp.PointingProvider(t01, f1, quat1)
+    rquat = rng.uniform(-.5, .5, (3, 4))
+    t02, f2, size2 = 3.7, 10.2, 300
+    res = prov.get_rotated_quaternions(t02, f2, rquat, size2,
+                                       rot_left=rot_left, nthreads=nthreads)
+    assert_(res.shape == (3, size2, 4))
+    out = np.empty((3, size2, 4), dtype=np.float64)
+    out = prov.get_rotated_quaternions(t02, f2, rquat, rot_left=rot_left,
+                                       out=out, nthreads=nthreads)
+    assert_((res == out).all(), "problem")
+    for i in range(rquat.shape[0]):
+        ref = prov.get_rotated_quaternions(t02, f2, rquat[i], size2,
+                                           rot_left=rot_left)
+        assert_((res[i] == ref).all(), "problem")
+
+
+@pmp("rot_left", (True, False))
+@pmp("ndim", (1, 2))
+def test_angles(rot_left, ndim):
+    rng = np.random.default_rng(42)
+    t01, f1, size1 = 0., 1., 200
+    quat1 = rng.uniform(-.5, .5, (size1, 4))
+    prov = pp.PointingProvider(t01, f1, quat1)
+    rquat = rng.uniform(-.5, .5, (3, 4) if ndim == 2 else (4,))
+    t02, f2, size2 = 3.7, 10.2, 300
+    q = prov.get_rotated_quaternions(t02, f2, rquat, size2, rot_left=rot_left)
+    ptg = prov.get_rotated_angles(t02, f2, rquat, size2, rot_left=rot_left,
+                                  nthreads=2)
+    out = np.empty(q.shape[:-1]+(3,), dtype=np.float64)
+    out = prov.get_rotated_angles(t02, f2, rquat, rot_left=rot_left, out=out)
+    assert_((ptg == out).all(), "problem")
+    x, y, z, w = q[..., 0], q[..., 1], q[..., 2], q[..., 3]
+    ssum, dif = np.arctan2(z, w), np.arctan2(-x, y)
+    theta = 2*np.arctan2(np.sqrt(x**2+y**2), np.sqrt(z**2+w**2))
+    phi, psi = ssum+dif, ssum-dif
+    _assert_close(ptg[..., 0], theta, 1e-14)
+    _assert_close(np.exp(1j*ptg[..., 1]), np.exp(1j*phi), 1e-14)
+    _assert_close(np.exp(1j*ptg[..., 2]), np.exp(1j*psi), 1e-14)
+
+
+def _np_quat_mul(a, b):
+    ax, ay, az, aw = np.moveaxis(a, -1, 0)
+    bx, by, bz, bw = np.moveaxis(b, -1, 0)
+    return np.stack([aw*bx + ax*bw + ay*bz - az*by,
+                     aw*by - ax*bz + ay*bw + az*bx,
+                     aw*bz + ax*by - ay*bx + az*bw,
+                     aw*bw - ax*bx - ay*by - az*bz], axis=-1)
+
+
+@pmp("n", (1, 7, 1000))
+@pmp("nthreads", (1, 2))
+def test_quat_batch(n, nthreads):
+    rng = np.random.default_rng(42)
+    a = rng.uniform(-.5, .5, (n, 4))
+    b = rng.uniform(-.5, .5, (n, 4))
+    conj = np.array([-1., -1., -1., 1.])
+    for ca in (False, True):
+        for cb in (False, True):
+            ref = _np_quat_mul(a*conj if ca else a, b*conj if cb else b)
+            res = pp.quat_multiply(a, b, conj_a=ca, conj_b=cb,
+                                   nthreads=nthreads)
+            _assert_close(res, ref, 1e-15)
+    # broadcasting a single quaternion
+    _assert_close(pp.quat_multiply(a, b[0]), _np_quat_mul(a, b[0]), 1e-15)
+
+    # rotation of vectors: q*v*q^-1
+    v = rng.uniform(-1, 1, (n, 3))
+    vq = np.concatenate([v, np.zeros((n, 1))], axis=1)
+    ref = _np_quat_mul(_np_quat_mul(a, vq), a*conj)
+    ref = ref[:, :3]/np.sum(a**2, axis=1, keepdims=True)
+    _assert_close(pp.quat_rotate_vectors(a, v, nthreads=nthreads), ref, 1e-15)
+
+    # axis/angle round trip
+    axis, angle = pp.quat_to_axis_angle(a, nthreads=nthreads)
+    _assert_close(np.linalg.norm(axis, axis=1), np.ones(n), 1e-15)
+    q = pp.quat_from_axis_angle(axis, angle, nthreads=nthreads)
+    na = a/np.linalg.norm(a, axis=1, keepdims=True)
+    _assert_close(q, na, 1e-14)
+
+    # pointing angles
+    ptg = pp.quat_to_euler_zyz(a, nthreads=nthreads)
+    x, y, z, w = a[:, 0], a[:, 1], a[:, 2], a[:, 3]
+    ssum, dif = np.arctan2(z, w), np.arctan2(-x, y)
+    theta = 2*np.arctan2(np.sqrt(x**2+y**2), np.sqrt(z**2+w**2))
+    _assert_close(ptg[:, 0], theta, 1e-14)
+    _assert_close(np.exp(1j*ptg[:, 1]), np.exp(1j*(ssum+dif)), 1e-14)
+    _assert_close(np.exp(1j*ptg[:, 2]), np.exp(1j*(ssum-dif)), 1e-14)
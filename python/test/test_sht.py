@@ -80,3 +80,222 @@ def test_dh(params):
     job.set_dh_geometry(nlat, nlon)
     alm2 = job.map2alm(job.alm2map(alm))
     assert_allclose(alm, alm2)
+
+
+@pmp('params', [(127, 127, 128, 256),
+                (127, 2, 128, 5)])
+def test_float(params):
+    lmax, mmax, nlat, nlon = params
+    job_d = sht.sharpjob_d()
+    job_f = sht.sharpjob_f()
+    nalm = ((mmax+1)*(mmax+2))//2 + (mmax+1)*(lmax-mmax)
+    nalm_r = nalm*2-lmax-1
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    alm_r = rng.uniform(-1., 1., nalm_r)
+    alm = np.empty(nalm, dtype=np.complex128)
+    alm[0:lmax+1] = alm_r[0:lmax+1]
+    alm[lmax+1:] = np.sqrt(0.5)*(alm_r[lmax+1::2] + 1j*alm_r[lmax+2::2])
+
+    for job in (job_d, job_f):
+        job.set_triangular_alm_info(lmax, mmax)
+        job.set_gauss_geometry(nlat, nlon)
+    map_d = job_d.alm2map(alm)
+    map_f = job_f.alm2map(alm.astype(np.complex64))
+    assert map_f.dtype == np.float32
+    assert_allclose(map_f, map_d, atol=1e-5*np.max(np.abs(map_d)))
+    alm_f = job_f.map2alm(map_f)
+    assert alm_f.dtype == np.complex64
+    assert_allclose(alm_f, alm, atol=1e-5)
+
+
+def test_plan_reuse():
+    lmax, mmax = 63, 63
+    job = sht.sharpjob_d()
+    nalm = ((mmax+1)*(mmax+2))//2 + (mmax+1)*(lmax-mmax)
+    nalm_r = nalm*2-lmax-1
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    alm_r = rng.uniform(-1., 1., nalm_r)
+    alm = np.empty(nalm, dtype=np.complex128)
+    alm[0:lmax+1] = alm_r[0:lmax+1]
+    alm[lmax+1:] = np.sqrt(0.5)*(alm_r[lmax+1::2] + 1j*alm_r[lmax+2::2])
+
+    job.set_triangular_alm_info(lmax, mmax)
+    job.set_gauss_geometry(lmax+1, 2*lmax+2)
+    map1 = job.alm2map(alm)
+    assert_allclose(job.alm2map(alm), map1, rtol=0, atol=0)
+    assert_allclose(job.map2alm(map1), alm)
+    # changing the geometry must invalidate the cached plan
+    job.set_gauss_geometry(lmax+2, 2*lmax+3)
+    map2 = job.alm2map(alm)
+    assert map2.shape == ((lmax+2)*(2*lmax+3),)
+    assert_allclose(job.map2alm(map2), alm)
+
+
+@pmp('spin', [0, 2])
+@pmp('ntrans', [1, 3, 10])
+def test_batch(spin, ntrans):
+    lmax, mmax = 47, 40
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, mmax)
+    job.set_gauss_geometry(lmax+1, 2*mmax+2)
+    nalm = job.n_alm()
+    ncomp = 1 if spin == 0 else 2
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    shp = (ntrans, nalm) if spin == 0 else (ntrans, 2, nalm)
+    alm = rng.uniform(-1., 1., shp) + 1j*rng.uniform(-1., 1., shp)
+    alm[..., 0:lmax+1].imag = 0.
+    if spin > 0:  # a_lm with l < spin must vanish
+        alm[..., 0:spin] = 0.
+        alm[..., lmax+1] = 0.
+    if spin == 0:
+        a2m, m2a = job.alm2map, job.map2alm
+    else:
+        def a2m(a):
+            return job.alm2map_spin(a, spin)
+
+        def m2a(m):
+            return job.map2alm_spin(m, spin)
+    maps = a2m(alm)
+    assert maps.shape[:-1] == shp[:-1]
+    for i in range(ntrans):
+        assert_allclose(maps[i], a2m(alm[i]), rtol=1e-12, atol=1e-12)
+    assert_allclose(m2a(maps), alm, atol=1e-11*ncomp)
+
+
+def test_deriv1():
+    lmax, mmax = 47, 40
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, mmax)
+    job.set_gauss_geometry(lmax+1, 2*mmax+2)
+    nalm = job.n_alm()
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    alm = rng.uniform(-1., 1., nalm) + 1j*rng.uniform(-1., 1., nalm)
+    alm[0:lmax+1].imag = 0.
+    ell = np.concatenate([np.arange(m, lmax+1) for m in range(mmax+1)])
+    fct = np.sqrt(ell*(ell+1.))
+    spinalm = np.zeros((2, nalm), dtype=np.complex128)
+    spinalm[0] = alm*fct
+    maps = job.alm2map_deriv1(alm)
+    assert_allclose(maps, job.alm2map_spin(spinalm, 1), rtol=1e-12,
+                    atol=1e-12)
+    # adjointness, with the m=0 coefficients counted once
+    map2 = rng.uniform(-1., 1., maps.shape)
+    alm2 = job.alm2map_deriv1_adjoint(map2)
+    alm2[0:lmax+1] *= 0.5
+    assert_allclose(np.vdot(maps, map2), 2*np.vdot(alm, alm2).real,
+                    rtol=1e-12)
+
+
+def test_autotune(tmp_path):
+    lmax = 63
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, lmax)
+    job.set_gauss_geometry(lmax+1, 2*lmax+2)
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    alm = rng.uniform(-1., 1., job.n_alm()).astype(np.complex128)
+    alm[0:lmax+1].imag = 0.
+    map1 = job.alm2map(alm)
+    chunksize_min, nchunks_max = job.autotune(0)
+    assert chunksize_min > 0 and nchunks_max > 0
+    # the chunking does not change the result beyond rounding
+    assert_allclose(job.alm2map(alm), map1, rtol=1e-12)
+    fname = str(tmp_path / "wisdom.txt")
+    sht.save_wisdom(fname)
+    sht.load_wisdom(fname)
+    assert_allclose(job.alm2map(alm), map1, rtol=1e-12)
+
+
+@pmp('spin', [0, 2])
+def test_map2alm_iter(spin):
+    nside, lmax = 32, 64
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, lmax)
+    job.set_healpix_geometry(nside)
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    ncomp = 1 if spin == 0 else 2
+    alm = (rng.uniform(-1., 1., (ncomp, job.n_alm()))
+           + 1j*rng.uniform(-1., 1., (ncomp, job.n_alm())))
+    alm[:, 0:lmax+1].imag = 0.
+    lvals = np.concatenate([np.arange(m, lmax+1) for m in range(lmax+1)])
+    alm[:, lvals < spin] = 0.
+    if spin == 0:
+        alm = alm[0]
+        map = job.alm2map(alm)
+        alm1, resid = job.map2alm_iter(map, 3)
+        alm0 = job.map2alm(map)
+    else:
+        map = job.alm2map_spin(alm, spin)
+        alm1, resid = job.map2alm_spin_iter(map, spin, 3)
+        alm0 = job.map2alm_spin(map, spin)
+    assert resid.shape == (4,)
+    assert np.all(np.diff(resid) < 0)
+    assert np.max(np.abs(alm1-alm)) < 0.01*np.max(np.abs(alm0-alm))
+    # early termination
+    _, resid = job.map2alm_iter(map, 10, resid[1]) if spin == 0 else \
+        job.map2alm_spin_iter(map, spin, 10, resid[1])
+    assert resid.shape == (2,)
+
+
+@pmp('spin', [0, 2])
+def test_cutsky(spin):
+    lmax, nlat, nlon = 63, 64, 128
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, lmax)
+    job.set_gauss_geometry(nlat, nlon)
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    ncomp = 1 if spin == 0 else 2
+    alm = (rng.uniform(-1., 1., (ncomp, job.n_alm()))
+           + 1j*rng.uniform(-1., 1., (ncomp, job.n_alm())))
+    alm[:, 0:lmax+1].imag = 0.
+    lvals = np.concatenate([np.arange(m, lmax+1) for m in range(lmax+1)])
+    alm[:, lvals < spin] = 0.
+    if spin == 0:
+        a2m = lambda a: job.alm2map(a[0])[None]
+        m2a = lambda m: job.map2alm(m[0])[None]
+    else:
+        a2m = lambda a: job.alm2map_spin(a, spin)
+        m2a = lambda m: job.map2alm_spin(m, spin)
+    map_full = a2m(alm).reshape((ncomp, nlat, nlon))
+    # observe one ring pair and a few single rings
+    rmask = np.zeros(nlat, dtype=bool)
+    rmask[[3, nlat-4, 10, 11, 12, 40]] = True
+    mask = np.zeros((nlat, nlon))
+    mask[rmask, 5] = 1.
+    masked = map_full*rmask[None, :, None]
+    job.set_cutsky(mask.reshape(-1))
+    map_cut = a2m(alm).reshape((ncomp, nlat, nlon))
+    assert_allclose(map_cut, masked, rtol=0, atol=1e-12)
+    alm_ref = m2a(masked.reshape((ncomp, -1)))
+    assert_allclose(m2a(map_full.reshape((ncomp, -1))), alm_ref, rtol=0,
+                    atol=1e-12)
+    job.set_cutsky(mask.reshape(-1), 1e-10)
+    assert_allclose(a2m(alm).reshape((ncomp, nlat, nlon)), masked, rtol=0,
+                    atol=1e-8)
+    # a new geometry drops the mask
+    job.set_gauss_geometry(nlat, nlon)
+    assert_allclose(a2m(alm).reshape((ncomp, nlat, nlon)), map_full)
+
+
+@pmp('spin', [0, 1, 2])
+@pmp('ntrans', [1, 3, 10])
+def test_weighted_projection(spin, ntrans):
+    nside, lmax = 16, 40
+    job = sht.sharpjob_d()
+    job.set_triangular_alm_info(lmax, lmax)
+    job.set_healpix_geometry(nside)
+    rng = np.random.default_rng(np.random.SeedSequence(42))
+    shp = (ntrans, job.n_alm()) if spin == 0 else (ntrans, 2, job.n_alm())
+    alm = rng.uniform(-1., 1., shp) + 1j*rng.uniform(-1., 1., shp)
+    alm[..., 0:lmax+1].imag = 0.
+    weight = rng.uniform(0., 1., 12*nside**2)
+    weight[weight < 0.3] = 0.
+    res = job.weighted_projection(alm, weight, spin)
+    # map2alm on HEALPix is the adjoint synthesis times 4pi/npix
+    fct = 12*nside**2/(4*np.pi)
+    if spin == 0:
+        ref = fct*job.map2alm(weight*job.alm2map(alm))
+    else:
+        ref = fct*job.map2alm_spin(weight*job.alm2map_spin(alm, spin), spin)
+    assert_allclose(res, ref, rtol=1e-13, atol=1e-13)
+    assert_allclose(job.weighted_projection(alm[0], weight, spin), ref[0],
+                    rtol=1e-13, atol=1e-13)
@@ -20,6 +20,7 @@ from numpy.testing import assert_
 import ducc0.totalconvolve as totalconvolve
 import ducc0.sht as sht
 import ducc0.misc as misc
+import ducc0.pointingprovider as pp
 
 pmp = pytest.mark.parametrize
 
@@ -124,3 +125,149 @@ def test_adjointness(lkmax, ncomp, separate):
     v1 = np.sum([myalmdot(slm[:, c], bla[:, c], lmax, lmax, 0) for c in range(ncomp)])
     v2 = np.sum([np.vdot(fake[:, c], inter1[:, c]) for c in range(ncomp2)])
     _assert_close(v1, v2, 1e-12)
+
+
+@pmp("ncomp", [1, 3])
+@pmp("nthreads", [2, 5])
+def test_deinterpol_deterministic(ncomp, nthreads):
+    lmax, kmax = 40, 6
+    rng = np.random.default_rng(42)
+    blm = random_alm(rng, lmax, kmax, ncomp)
+    nptg = 50000
+    ptg = rng.uniform(0., 1., nptg*3).reshape(nptg, 3)
+    ptg[:, 0] *= np.pi
+    ptg[:, 1] *= 2*np.pi
+    ptg[:, 2] *= 2*np.pi
+    data = rng.uniform(-1., 1., (nptg, ncomp))
+    res = []
+    for nth in (1, nthreads, nthreads):
+        inter = totalconvolve.Interpolator(lmax, kmax, ncomp, epsilon=1e-6,
+                                           nthreads=nth)
+        inter.deinterpol(ptg, data)
+        res.append(inter.getSlm(blm))
+    assert_((res[1] == res[2]).all())
+    _assert_close(res[1], res[0], 1e-13)
+
+
+@pmp("ncomp", [1, 3])
+@pmp("separate", [True, False])
+def test_multi_detector(ncomp, separate):
+    lmax, kmax = 20, 4
+    rng = np.random.default_rng(42)
+    slm = random_alm(rng, lmax, lmax, ncomp)
+    blm = random_alm(rng, lmax, kmax, ncomp)
+    inter = totalconvolve.Interpolator(slm, blm, separate, lmax, kmax,
+                                       epsilon=1e-6, nthreads=2)
+    ndet, nptg = 7, 1000
+    ptg = rng.uniform(0., 1., (ndet, nptg, 3))
+    ptg[:, :, 0] *= np.pi
+    ptg[:, :, 1] *= 2*np.pi
+    ptg[:, :, 2] *= 2*np.pi
+    res = inter.interpol(ptg)
+    assert_(res.shape[:2] == (ndet, nptg))
+    for i in range(ndet):
+        assert_((res[i] == inter.interpol(ptg[i])).all())
+
+
+@pmp("ncomp", [1, 3])
+@pmp("separate", [True, False])
+def test_update_slm(ncomp, separate):
+    lmax, kmax = 20, 4
+    rng = np.random.default_rng(42)
+    slm = random_alm(rng, lmax, lmax, ncomp)
+    slm2 = random_alm(rng, lmax, lmax, ncomp)
+    blm = random_alm(rng, lmax, kmax, ncomp)
+    nptg = 1000
+    ptg = rng.uniform(0., 1., (nptg, 3))
+    ptg[:, 0] *= np.pi
+    ptg[:, 1] *= 2*np.pi
+    ptg[:, 2] *= 2*np.pi
+    inter = totalconvolve.Interpolator(slm, blm, separate, lmax, kmax,
+                                       epsilon=1e-6, nthreads=2)
+    inter.update_slm(slm2, blm, separate)
+    inter2 = totalconvolve.Interpolator(slm2, blm, separate, lmax, kmax,
+                                        epsilon=1e-6, nthreads=2)
+    assert_((inter.interpol(ptg) == inter2.interpol(ptg)).all())
+
+
+@pmp("ncomp", [1, 3])
+@pmp("separate", [True, False])
+def test_float_cube(ncomp, separate):
+    lmax, kmax = 30, 5
+    rng = np.random.default_rng(42)
+    slm = random_alm(rng, lmax, lmax, ncomp)
+    blm = random_alm(rng, lmax, kmax, ncomp)
+    nptg = 1000
+    ptg = rng.uniform(0., 1., (nptg, 3))
+    ptg[:, 0] *= np.pi
+    ptg[:, 1] *= 2*np.pi
+    ptg[:, 2] *= 2*np.pi
+    res = []
+    for cls in (totalconvolve.Interpolator, totalconvolve.Interpolator_fcube):
+        inter = cls(slm, blm, separate, lmax, kmax, epsilon=1e-5, nthreads=2)
+        res.append(inter.interpol(ptg))
+    _assert_close(res[1], res[0], 1e-6)
+    ncomp2 = res[0].shape[1]
+    data = rng.uniform(-1., 1., (nptg, ncomp2))
+    res = []
+    for cls in (totalconvolve.Interpolator, totalconvolve.Interpolator_fcube):
+        inter = cls(lmax, kmax, ncomp2, epsilon=1e-5, nthreads=2)
+        inter.deinterpol(ptg, data)
+        res.append(inter.getSlm(blm))
+    _assert_close(res[1], res[0], 1e-6)
+
+
+def quat2ptg(quat):
+    x, y, z, w = quat.T
+    # elements of the rotation matrix R_z(phi)*R_y(theta)*R_z(psi)
+    r02 = 2*(x*z + y*w)
+    r12 = 2*(y*z - x*w)
+    r22 = 1 - 2*(x*x + y*y)
+    r20 = 2*(x*z - y*w)
+    r21 = 2*(y*z + x*w)
+    res = np.empty((quat.shape[0], 3))
+    res[:, 0] = np.arccos(np.clip(r22, -1., 1.))
+    res[:, 1] = np.arctan2(r12, r02) % (2*np.pi)
+    res[:, 2] = np.arctan2(r21, -r20)
+    return res
+
+
+@pmp("ncomp", [1, 3])
+@pmp("singleprec", [True, False])
+def test_interpol_from_provider(ncomp, singleprec):
+    lmax, kmax = 30, 5
+    rng = np.random.default_rng(42)
+    slm = random_alm(rng, lmax, lmax, ncomp)
+    blm = random_alm(rng, lmax, kmax, ncomp)
+    cls = totalconvolve.Interpolator_f if singleprec else \
+        totalconvolve.Interpolator
+    if singleprec:
+        slm, blm = slm.astype(np.complex64), blm.astype(np.complex64)
+    inter = cls(slm, blm, True, lmax, kmax, epsilon=1e-4, nthreads=2)
+    prov = pp.PointingProvider(1., 0.1, rng.uniform(-.5, .5, (50, 4)))
+    rot = rng.uniform(-.5, .5, (4,))
+    t0, freq, nval = 3., 70., 30000
+    res = inter.interpol_from_provider(prov, t0, freq, rot, nval)
+    quat = prov.get_rotated_quaternions(t0, freq, rot, nval)
+    quat /= np.sqrt(np.sum(quat**2, axis=1, keepdims=True))
+    ptg = quat2ptg(quat)
+    if singleprec:
+        ptg = ptg.astype(np.float32)
+    ref = inter.interpol(ptg)
+    _assert_close(res, ref, 1e-5 if singleprec else 1e-12)
+
+
+@pmp("lmax", [0, 1, 17, 64])
+@pmp("nthreads", [1, 2])
+def test_rotate_alm_batch(lmax, nthreads):
+    rng = np.random.default_rng(42)
+    alm = random_alm(rng, lmax, lmax, 3)
+    ang = (0.3, 1.1, -0.7)
+    ref = np.array([misc.rotate_alm(alm[:, c], lmax, *ang)
+                    for c in range(3)])
+    res = misc.rotate_alm(alm.T, lmax, *ang, nthreads=nthreads)
+    _assert_close(res, ref, 1e-14)
+    # rotating back restores the input
+    back = misc.rotate_alm(res, lmax, -ang[2], -ang[1], -ang[0],
+                           nthreads=nthreads)
+    _assert_close(back, alm.T, 1e-13)
@@ -156,3 +156,371 @@ def test_ms2dirty_against_wdft2(nxdirty, nydirty, ofactor, nrow, nchan, epsilon,
     ref = explicit_gridder(uvw, freq, ms, wgt, nxdirty, nydirty, pixsizex,
                            pixsizey, wstacking, mask)
     assert_allclose(_l2error(dirty, ref), 0, atol=epsilon)
+
+
+@pmp("nrow", (1, 27))
+@pmp("nchan", (1, 5))
+@pmp("singleprec", (True, False))
+@pmp("wstacking", (True, False))
+@pmp("use_wgt", (True, False))
+@pmp("use_mask", (False, True))
+@pmp("nthreads", (1, 3))
+def test_plan(nrow, nchan, singleprec, wstacking, use_wgt, use_mask, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 64, 48
+    epsilon = 1e-4 if singleprec else 1e-7
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty*1.1
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    wgt = rng.uniform(0.9, 1.1, (nrow, nchan)) if use_wgt else None
+    mask = (rng.uniform(0, 1, (nrow, nchan)) > 0.5).astype(np.uint8) if use_mask else None
+    if use_mask:
+        mask[0, 0] = 1  # make sure there is at least one visibility
+    if singleprec:
+        ms = ms.astype("c8")
+        dirty = dirty.astype("f4")
+        if wgt is not None:
+            wgt = wgt.astype("f4")
+    plancls = ng.Plan_f if singleprec else ng.Plan
+    plan = plancls(uvw, freq, nxdirty, nydirty, pixsizex, pixsizey, 0, 0,
+                   epsilon, wstacking, nthreads, 0, mask)
+    # repeated execution must give identical results
+    for _ in range(2):
+        dirty2 = plan.ms2dirty(ms, wgt)
+        ms2 = plan.dirty2ms(dirty, wgt)
+        ref = explicit_gridder(uvw, freq, ms, wgt, nxdirty, nydirty, pixsizex,
+                               pixsizey, wstacking, mask)
+        assert_allclose(_l2error(dirty2, ref), 0, atol=epsilon)
+        ref = ng.dirty2ms(uvw, freq, dirty, wgt, pixsizex, pixsizey, 0, 0, epsilon,
+                          wstacking, nthreads, 0, mask)
+        assert_allclose(_l2error(ms2, ref), 0, atol=epsilon)
+
+
+@pmp("nrow", (1, 27))
+@pmp("nchan", (1, 5))
+@pmp("singleprec", (True, False))
+@pmp("nthreads", (1, 3))
+def test_wplane_batch(nrow, nchan, singleprec, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 48
+    epsilon = 1e-4 if singleprec else 1e-7
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    uvw[:, 2] *= 50  # many w planes
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    if singleprec:
+        ms = ms.astype("c8")
+        dirty = dirty.astype("f4")
+    args = (pixsizex, pixsizey, 0, 0, epsilon, True, nthreads, 0)
+    mem = 1e9
+    ref = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args)
+    res = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args,
+                      wplane_mem=mem)
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+    ref = ng.dirty2ms(uvw, freq, dirty, None, *args)
+    res = ng.dirty2ms(uvw, freq, dirty, None, *args, wplane_mem=mem)
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+
+
+@pmp("nrow", (1, 27))
+@pmp("nchan", (1, 5))
+@pmp("wstacking", (True, False))
+@pmp("nunv", ((0, 0), (56, 80)))
+def test_double_accumulation(nrow, nchan, wstacking, nunv):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 48
+    nu, nv = nunv
+    epsilon = 1e-4
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = ((rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)).astype("f4")
+    ms = (rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5))
+    ms = ms.astype("c8")
+    dirty = (rng.random((nxdirty, nydirty))-0.5).astype("f4")
+    args = (pixsizex, pixsizey, nu, nv, epsilon, wstacking, 1, 0)
+    uvw64, ms128, dirty64 = uvw.astype("f8"), ms.astype("c16"), dirty.astype("f8")
+    ref = ng.ms2dirty(uvw64, freq, ms128, None, nxdirty, nydirty, *args)
+    res = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args,
+                      double_precision_accumulation=True)
+    assert res.dtype == np.float32
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+    ref = ng.dirty2ms(uvw64, freq, dirty64, None, *args)
+    res = ng.dirty2ms(uvw, freq, dirty, None, *args,
+                      double_precision_accumulation=True)
+    assert res.dtype == np.complex64
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+
+
+def _mask2runs(mask):
+    # one run per active visibility, i.e. adjacent runs are not merged
+    row, chan = np.nonzero(mask)
+    row_start = np.zeros(mask.shape[0]+1, dtype=np.int64)
+    np.cumsum(np.bincount(row, minlength=mask.shape[0]), out=row_start[1:])
+    return row_start, chan.astype(np.int64), chan.astype(np.int64)+1
+
+
+@pmp("nrow", (1, 27))
+@pmp("nchan", (1, 5))
+@pmp("density", (0., 0.2, 0.8))
+@pmp("wstacking", (True, False))
+@pmp("nthreads", (1, 3))
+def test_channel_runs(nrow, nchan, density, wstacking, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 48
+    epsilon = 1e-7
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    mask = (rng.uniform(0, 1, (nrow, nchan)) < density).astype(np.uint8)
+    runs = _mask2runs(mask)
+    args = (pixsizex, pixsizey, 0, 0, epsilon, wstacking, nthreads, 0)
+    ref = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args, mask)
+    res = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args, runs)
+    assert_allclose(res, ref, rtol=1e-13, atol=1e-13)
+    ref = ng.dirty2ms(uvw, freq, dirty, None, *args, mask)
+    res = ng.dirty2ms(uvw, freq, dirty, None, *args, runs)
+    assert_allclose(res, ref, rtol=1e-13, atol=1e-13)
+    assert_allclose(res[mask == 0], 0)
+
+
+@pmp("nrow", (2, 27))
+@pmp("wstacking", (True, False))
+@pmp("nthreads", (1, 3))
+def test_smearing(nrow, wstacking, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 48
+    epsilon = 1e-5
+    pixsizex = pixsizey = np.pi/180/nxdirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = np.array([f0])
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    duvw = 0.05*(rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    chan_width = rng.uniform(0, 0.05, nrow)*f0
+    chan_width[1] = 0.  # no frequency smearing for this row
+    mask = np.ones((nrow, 1), dtype=np.uint8)
+    mask[0] = 0  # marks a redundant row
+    ms = rng.random((nrow, 1))-0.5 + 1j*(rng.random((nrow, 1))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    args = (pixsizex, pixsizey, 0, 0, epsilon, wstacking, nthreads, 0)
+
+    # reference: every row explicitly expanded into Gauss-Legendre samples
+    x, w = np.polynomial.legendre.leggauss(20)
+    x, w = 0.5*x, 0.5*w
+    st, sf = np.meshgrid(x, x, indexing="ij")
+    wsub = np.outer(w, w).ravel()
+    fac = 1 + sf.ravel()[None, :]*chan_width[1:, None]/f0
+    uvw_x = (uvw[1:, None, :] + st.ravel()[None, :, None]*duvw[1:, None, :]) \
+        * fac[:, :, None]
+    uvw_x = uvw_x.reshape((-1, 3))
+    wgt_x = np.tile(wsub, nrow-1).reshape((-1, 1))
+    ms_x = np.repeat(ms[1:], wsub.size, axis=0)
+
+    dirty_ref = ng.ms2dirty(uvw_x, freq, ms_x, wgt_x, nxdirty, nydirty,
+                            *args)
+    dirty_smear = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args,
+                              mask, duvw=duvw, chan_width=chan_width)
+    assert_allclose(_l2error(dirty_smear, dirty_ref), 0, atol=epsilon)
+    ms_ref = ng.dirty2ms(uvw_x, freq, dirty, wgt_x, *args)
+    ms_ref = ms_ref.reshape((nrow-1, -1)).sum(axis=1)
+    ms_smear = ng.dirty2ms(uvw, freq, dirty, None, *args, mask, duvw=duvw,
+                           chan_width=chan_width)
+    assert_allclose(ms_smear[0], 0)
+    assert_allclose(_l2error(ms_smear[1:, 0], ms_ref), 0, atol=epsilon)
+    adj1 = np.vdot(ms, ms_smear).real
+    adj2 = np.vdot(dirty_smear, dirty)
+    assert_allclose(adj1, adj2, rtol=1e-8)
+
+
+@pmp("wstacking", (True, False))
+def test_smearing_zero_width(wstacking):
+    rng = np.random.default_rng(42)
+    nrow, nchan, nxdirty, nydirty = 27, 3, 32, 48
+    epsilon = 1e-6
+    pixsizex = pixsizey = np.pi/180/nxdirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    args = (pixsizex, pixsizey, 0, 0, epsilon, wstacking, 1, 0)
+    chan_width = np.zeros(nrow)
+    ref = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args)
+    res = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, *args,
+                      chan_width=chan_width)
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+    ref = ng.dirty2ms(uvw, freq, dirty, None, *args)
+    res = ng.dirty2ms(uvw, freq, dirty, None, *args, chan_width=chan_width)
+    assert_allclose(_l2error(res, ref), 0, atol=epsilon)
+
+
+@pmp("nchan", (1, 5))
+@pmp("singleprec", (True, False))
+@pmp("wstacking", (True, False))
+def test_plan_antennas(nchan, singleprec, wstacking):
+    rng = np.random.default_rng(42)
+    nant, ntime = 7, 5
+    nxdirty, nydirty = 32, 48
+    epsilon = 1e-4 if singleprec else 1e-7
+    pixsizex = pixsizey = np.pi/180/nxdirty
+    f0 = 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    pos = (rng.random((nant, 3))-0.5)*100
+    hour_angle = rng.uniform(-1, 1, ntime)
+    dec = 0.6
+    a1, a2 = np.triu_indices(nant, 1)
+    ant1 = np.tile(a1, ntime).astype(np.int64)
+    ant2 = np.tile(a2, ntime).astype(np.int64)
+    time_idx = np.repeat(np.arange(ntime), a1.size).astype(np.int64)
+    b = pos[ant2]-pos[ant1]
+    sh, ch = np.sin(hour_angle[time_idx]), np.cos(hour_angle[time_idx])
+    sd, cd = np.sin(dec), np.cos(dec)
+    uvw = np.stack([sh*b[:, 0] + ch*b[:, 1],
+                    -sd*ch*b[:, 0] + sd*sh*b[:, 1] + cd*b[:, 2],
+                    cd*ch*b[:, 0] - cd*sh*b[:, 1] + sd*b[:, 2]], axis=1)
+    nrow = uvw.shape[0]
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    if singleprec:
+        ms = ms.astype("c8")
+        dirty = dirty.astype("f4")
+    plancls = ng.Plan_f if singleprec else ng.Plan
+    args = (nxdirty, nydirty, pixsizex, pixsizey, 0, 0, epsilon, wstacking)
+    ref = plancls(uvw, freq, *args)
+    plan = plancls(pos, ant1, ant2, time_idx, hour_angle, dec, freq, *args)
+    assert plan.nvis() == ref.nvis()
+    assert_allclose(_l2error(plan.ms2dirty(ms), ref.ms2dirty(ms)), 0,
+                    atol=epsilon)
+    assert_allclose(_l2error(plan.dirty2ms(dirty), ref.dirty2ms(dirty)), 0,
+                    atol=epsilon)
+
+
+@pmp("nrow", (2, 27))
+@pmp("nchan", (1, 5))
+@pmp("singleprec", (True, False))
+@pmp("use_wgt", (True, False))
+@pmp("nthreads", (1, 3))
+def test_gram_operator(nrow, nchan, singleprec, use_wgt, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 40
+    epsilon = 1e-4 if singleprec else 1e-9
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    wgt = rng.uniform(0.9, 1.1, (nrow, nchan)) if use_wgt else None
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    if singleprec:
+        dirty = dirty.astype("f4")
+        if wgt is not None:
+            wgt = wgt.astype("f4")
+    opcls = ng.GramOperator_f if singleprec else ng.GramOperator
+    op = opcls(uvw, freq, nxdirty, nydirty, pixsizex, pixsizey, epsilon, wgt,
+               nthreads=nthreads)
+    res = op.apply(dirty)
+    ms = ng.dirty2ms(uvw, freq, dirty, wgt, pixsizex, pixsizey, 0, 0, epsilon,
+                     False, nthreads)
+    ref = ng.ms2dirty(uvw, freq, ms, wgt, nxdirty, nydirty, pixsizex, pixsizey,
+                      0, 0, epsilon, False, nthreads)
+    assert_allclose(_l2error(res, ref), 0, atol=10*epsilon)
+
+
+@pmp("fov", (1., 20.))
+@pmp("use_mask", (True, False))
+def test_gram_operator_accuracy(fov, use_mask):
+    rng = np.random.default_rng(42)
+    nrow, nchan, nxdirty, nydirty = 100, 3, 32, 40
+    epsilon = 1e-9
+    pixsizex = fov*np.pi/180/nxdirty
+    pixsizey = fov*np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)*0.4/(pixsizex*f0/speedoflight)
+    wgt = rng.uniform(0.5, 2., (nrow, nchan))
+    mask = (rng.uniform(0, 1, (nrow, nchan)) > 0.3).astype(np.uint8) \
+        if use_mask else None
+    dirty = rng.random((nxdirty, nydirty))-0.5
+    args = (pixsizex, pixsizey, 0, 0, epsilon, False, 1, 0, mask)
+    ms = ng.dirty2ms(uvw, freq, dirty, wgt, *args)
+    ref = ng.ms2dirty(uvw, freq, ms, wgt, nxdirty, nydirty, *args)
+    op = ng.GramOperator(uvw, freq, nxdirty, nydirty, pixsizex, pixsizey,
+                         epsilon, wgt, mask)
+    assert_allclose(_l2error(op.apply(dirty), ref), 0, atol=epsilon)
+
+
+@pmp("nrow", (2, 27))
+@pmp("nchan", (1, 5))
+@pmp("singleprec", (True, False))
+@pmp("wstacking", (True, False))
+@pmp("use_wgt", (True, False))
+@pmp("nthreads", (1, 3))
+def test_cube(nrow, nchan, singleprec, wstacking, use_wgt, nthreads):
+    rng = np.random.default_rng(42)
+    nxdirty, nydirty = 32, 40
+    epsilon = 1e-4 if singleprec else 1e-9
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    chan_group = np.arange(nchan) % 3
+    ngroups = np.max(chan_group)+1
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    wgt = rng.uniform(0.9, 1.1, (nrow, nchan)) if use_wgt else None
+    dirty = rng.random((ngroups, nxdirty, nydirty))-0.5
+    if singleprec:
+        ms = ms.astype("c8")
+        dirty = dirty.astype("f4")
+        if wgt is not None:
+            wgt = wgt.astype("f4")
+    cube = ng.ms2dirty_cube(uvw, freq, ms, chan_group, wgt, nxdirty, nydirty,
+                            pixsizex, pixsizey, 0, 0, epsilon, wstacking,
+                            nthreads)
+    ms2 = ng.dirty2ms_cube(uvw, freq, dirty, chan_group, wgt, pixsizex,
+                           pixsizey, 0, 0, epsilon, wstacking, nthreads)
+    assert cube.shape == (ngroups, nxdirty, nydirty)
+    for g in range(ngroups):
+        mask = np.broadcast_to(chan_group == g, (nrow, nchan)).astype(np.uint8)
+        ref = explicit_gridder(uvw, freq, ms, wgt, nxdirty, nydirty, pixsizex,
+                               pixsizey, wstacking, mask)
+        assert_allclose(_l2error(cube[g], ref), 0, atol=epsilon)
+    ref = max(my_vdot(ms, ms).real, my_vdot(ms2, ms2).real,
+              my_vdot(dirty, dirty).real, my_vdot(cube, cube).real)
+    tol = 1e-5*ref if singleprec else 1e-11*ref
+    assert_allclose(my_vdot(ms, ms2).real, my_vdot(cube, dirty), rtol=tol)
+
+
+def test_cost_model(tmp_path):
+    rng = np.random.default_rng(42)
+    nrow, nchan, nxdirty, nydirty, epsilon = 27, 3, 32, 48, 1e-5
+    pixsizex = np.pi/180/nxdirty
+    pixsizey = np.pi/180/nydirty
+    speedoflight, f0 = 299792458., 1e9
+    freq = f0 + np.arange(nchan)*(f0/nchan)
+    uvw = (rng.random((nrow, 3))-0.5)/(pixsizex*f0/speedoflight)
+    ms = rng.random((nrow, nchan))-0.5 + 1j*(rng.random((nrow, nchan))-0.5)
+    ng.calibrate_cost_model()
+    fname = str(tmp_path / "costmodel.txt")
+    ng.save_cost_model(fname)
+    ng.load_cost_model(fname)
+    with open(fname) as f:
+        assert len(f.readlines()) > 2
+    dirty = ng.ms2dirty(uvw, freq, ms, None, nxdirty, nydirty, pixsizex,
+                        pixsizey, 0, 0, epsilon, True)
+    ref = explicit_gridder(uvw, freq, ms, None, nxdirty, nydirty, pixsizex,
+                           pixsizey, True, None)
+    assert_allclose(_l2error(dirty, ref), 0, atol=epsilon)
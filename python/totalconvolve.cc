@@ -21,6 +21,8 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <mutex>
+#include <shared_mutex>
 #include "python/totalconvolve.h"
 
 namespace ducc0 {
@@ -31,17 +33,24 @@ using namespace std;
 
 namespace py = pybind11;
 
-template<typename T> class PyInterpolator: public Interpolator<T>
+template<typename T, typename Tcube=T> class PyInterpolator: public Interpolator<T,Tcube>
   {
   protected:
-    using Interpolator<T>::lmax;
-    using Interpolator<T>::kmax;
-    using Interpolator<T>::ncomp;
-    using Interpolator<T>::interpol;
-    using Interpolator<T>::deinterpol;
-    using Interpolator<T>::getSlm;
-
-vector<Alm<complex<T>>> makevec(const py::array &inp, int64_t lmax, int64_t kmax)
+    using Interpolator<T,Tcube>::lmax;
+    using Interpolator<T,Tcube>::kmax;
+    using Interpolator<T,Tcube>::ncomp;
+    using Interpolator<T,Tcube>::interpol;
+    using Interpolator<T,Tcube>::deinterpol;
+    using Interpolator<T,Tcube>::getSlm;
+    using Interpolator<T,Tcube>::update_slm;
+
+    // interpolation runs without the GIL, holding a shared lock; operations
+    // modifying the data cube need an exclusive lock
+    mutable shared_mutex mut;
+    using excl_lock = unique_lock<shared_mutex>;
+    using shared_lock_t = shared_lock<shared_mutex>;
+
+static vector<Alm<complex<T>>> makevec(const py::array &inp, int64_t lmax, int64_t kmax)
   {
   auto inp2 = to_mav<complex<T>,2>(inp);
   vector<Alm<complex<T>>> res;
@@ -49,7 +58,7 @@ vector<Alm<complex<T>>> makevec(const py::array &inp, int64_t lmax, int64_t kmax
     res.push_back(Alm<complex<T>>(inp2.template subarray<1>({0,i},{inp2.shape(0),0}),lmax, kmax));
   return res;
   }
-void makevec_v(py::array &inp, int64_t lmax, int64_t kmax, vector<Alm<complex<T>>> &res)
+static void makevec_v(py::array &inp, int64_t lmax, int64_t kmax, vector<Alm<complex<T>>> &res)
   {
   auto inp2 = to_mav<complex<T>,2>(inp, true);
   for (size_t i=0; i<inp2.shape(1); ++i)
@@ -59,29 +68,81 @@ void makevec_v(py::array &inp, int64_t lmax, int64_t kmax, vector<Alm<complex<T>
     }
   }
   public:
-    PyInterpolator(const py::array &slm, const py::array &blm,
-      bool separate, int64_t lmax, int64_t kmax, T epsilon, T ofactor, int nthreads)
-      : Interpolator<T>(makevec(slm, lmax, lmax),
-                        makevec(blm, lmax, kmax),
-                        separate, epsilon, ofactor, nthreads) {}
+    PyInterpolator(const vector<Alm<complex<T>>> &slm,
+      const vector<Alm<complex<T>>> &blm, bool separate, T epsilon, T ofactor,
+      int nthreads)
+      : Interpolator<T,Tcube>(slm, blm, separate, epsilon, ofactor, nthreads) {}
     PyInterpolator(int64_t lmax, int64_t kmax, int64_t ncomp_, T epsilon, T ofactor, int nthreads)
-      : Interpolator<T>(lmax, kmax, ncomp_, epsilon, ofactor, nthreads) {}
+      : Interpolator<T,Tcube>(lmax, kmax, ncomp_, epsilon, ofactor, nthreads) {}
 
-    using Interpolator<T>::support;
+    static unique_ptr<PyInterpolator> make(const py::array &slm,
+      const py::array &blm, bool separate, int64_t lmax, int64_t kmax,
+      T epsilon, T ofactor, int nthreads)
+      {
+      auto slm2 = makevec(slm, lmax, lmax);
+      auto blm2 = makevec(blm, lmax, kmax);
+      py::gil_scoped_release release;
+      return make_unique<PyInterpolator>(slm2, blm2, separate, epsilon,
+        ofactor, nthreads);
+      }
+
+    using Interpolator<T,Tcube>::support;
 
     py::array pyinterpol(const py::array &ptg) const
       {
+      if (ptg.ndim()==3)
+        {
+        auto ptg2 = to_mav<T,3>(ptg);
+        auto res = make_Pyarr<T>({ptg2.shape(0),ptg2.shape(1),ncomp});
+        auto res2 = to_mav<T,3>(res,true);
+        {
+        py::gil_scoped_release release;
+        shared_lock_t lock(mut);
+        interpol(ptg2, res2);
+        }
+        return move(res);
+        }
       auto ptg2 = to_mav<T,2>(ptg);
       auto res = make_Pyarr<T>({ptg2.shape(0),ncomp});
       auto res2 = to_mav<T,2>(res,true);
+      {
+      py::gil_scoped_release release;
+      shared_lock_t lock(mut);
       interpol(ptg2, res2);
+      }
+      return move(res);
+      }
+
+    py::array pyinterpol_provider(const PointingProvider<double> &prov,
+      double t0, double freq, const py::array &rot, size_t nval,
+      bool rot_left) const
+      {
+      auto rot2 = to_mav<double,1>(rot);
+      auto res = make_Pyarr<T>({nval,ncomp});
+      auto res2 = to_mav<T,2>(res,true);
+      {
+      py::gil_scoped_release release;
+      shared_lock_t lock(mut);
+      interpol(prov, t0, freq, rot2, rot_left, res2);
+      }
       return move(res);
       }
 
+    void pyupdate_slm(const py::array &slm, const py::array &blm, bool separate)
+      {
+      auto slm2 = makevec(slm, lmax, lmax);
+      auto blm2 = makevec(blm, lmax, kmax);
+      py::gil_scoped_release release;
+      excl_lock lock(mut);
+      update_slm(slm2, blm2, separate);
+      }
+
     void pydeinterpol(const py::array &ptg, const py::array &data)
       {
       auto ptg2 = to_mav<T,2>(ptg);
       auto data2 = to_mav<T,2>(data);
+      py::gil_scoped_release release;
+      excl_lock lock(mut);
       deinterpol(ptg2, data2);
       }
     py::array pygetSlm(const py::array &blm_)
@@ -90,7 +151,11 @@ void makevec_v(py::array &inp, int64_t lmax, int64_t kmax, vector<Alm<complex<T>
       auto res = make_Pyarr<complex<T>>({Alm_Base::Num_Alms(lmax, lmax),blm.size()});
       vector<Alm<complex<T>>> slm;
       makevec_v(res, lmax, lmax, slm);
+      {
+      py::gil_scoped_release release;
+      excl_lock lock(mut);
       getSlm(blm, slm);
+      }
       return move(res);
       }
   };
@@ -118,6 +183,19 @@ The class can be configured for interpolation or for adjoint interpolation, by
 means of two different constructors.
 )""";
 
+constexpr const char *pyinterpolator_fcube_DS = R"""(
+Class encapsulating the convolution/interpolation functionality
+
+This variant has the same interface as `Interpolator`, but stores its data cube
+in single precision, which halves its memory consumption and the memory
+bandwidth needed by (de)interpolation. The relative accuracy of the results is
+therefore limited to about 1e-6, and choosing `epsilon` much smaller than that
+has no benefit.
+
+The class can be configured for interpolation or for adjoint interpolation, by
+means of two different constructors.
+)""";
+
 constexpr const char *initnormal_DS = R"""(
 Constructor for interpolation mode
 
@@ -175,6 +253,8 @@ ptg : numpy.ndarray((N, 3), dtype=numpy.float64)
     theta must be in the range [0; pi]
     phi must be in the range [0; 2pi]
     psi should be in the range [-2pi; 2pi]
+    Alternatively, an array of shape (ndet, N, 3) with the pointings of ndet
+    detectors can be passed.
 
 Returns
 -------
@@ -182,12 +262,79 @@ numpy.array((N, n2), dtype=numpy.float64)
     the interpolated values
     n2 is either 1 (if separate=True was used in the constructor) or the
     second dimension of the input slm and blm arrays (otherwise)
+    If `ptg` has three dimensions, the result has the shape (ndet, N, n2).
 
 Notes
 -----
     - Can only be called in "normal" (i.e. not adjoint) mode
     - repeated calls to this method are fine, but for good performance the
       number of pointings passed per call should be as large as possible.
+    - processing many detectors in one call is faster than separate calls,
+      since all pointings are sorted into a single work list and each part of
+      the data cube only has to be loaded once.
+)""";
+
+constexpr const char *interpol_provider_DS = R"""(
+Computes the interpolated values for the time stream of a single detector,
+whose pointings are obtained from a PointingProvider.
+
+The detector orientations are computed exactly as by
+`PointingProvider.get_rotated_quaternions(t0, freq, rot, nval, rot_left)` and
+converted to (theta, phi, psi) angles of the rotation
+R_z(phi)*R_y(theta)*R_z(psi). This is done in chunks of moderate size, so no
+arrays of quaternions or pointings are ever stored for the whole time stream.
+
+Parameters
+----------
+provider : ducc0.pointingprovider.PointingProvider
+    the object providing the satellite orientations
+t0 : float
+    the time of the first output sample
+    This must use the same reference system as the time passed to the
+    constructor of `provider`.
+freq : float
+    the sampling frequency of the detector
+rot : numpy.ndarray((4,), dtype=numpy.float64)
+    the rotation quaternion from the satellite to the detector reference
+    system. Components are expected in the order (x, y, z, w).
+nval : int
+    the number of samples
+rot_left : bool (optional, default=True)
+    if True, the rotation quaternion is multiplied from the left side,
+    otherwise from the right.
+
+Returns
+-------
+numpy.array((nval, n2), dtype=numpy.float64)
+    the interpolated values; see `interpol`
+
+Notes
+-----
+    - Can only be called in "normal" (i.e. not adjoint) mode
+)""";
+
+constexpr const char *update_slm_DS = R"""(
+Replaces the sky (and beam) spherical harmonic coefficients
+
+This recomputes the data cube exactly as the constructor would, but reuses the
+already allocated cube, the interpolation kernel and the kernel correction
+factors. This is cheaper than creating a new object when the sky changes
+repeatedly, e.g. in iterative map-making.
+
+Parameters
+----------
+sky : numpy.ndarray((nalm_sky, ncomp), dtype=numpy.complex)
+    spherical harmonic coefficients of the sky, with the lmax defined in the
+    constructor call
+beam : numpy.ndarray((nalm_beam, ncomp), dtype=numpy.complex)
+    spherical harmonic coefficients of the beam, with the lmax and kmax
+    defined in the constructor call
+separate : bool
+    must have the same value as in the constructor call
+
+Notes
+-----
+    - Can only be called in "normal" (i.e. not adjoint) mode
 )""";
 
 constexpr const char *deinterpol_DS = R"""(
@@ -244,23 +391,52 @@ void add_totalconvolve(py::module &msup)
 
   using inter_d = PyInterpolator<double>;
   py::class_<inter_d> (m, "Interpolator", py::module_local(), pyinterpolator_DS)
-    .def(py::init<const py::array &, const py::array &, bool, int64_t, int64_t, double, double, int>(),
+    .def(py::init(&inter_d::make),
       initnormal_DS, "sky"_a, "beam"_a, "separate"_a, "lmax"_a, "kmax"_a, "epsilon"_a, "ofactor"_a=1.5,
       "nthreads"_a=0)
     .def(py::init<int64_t, int64_t, int64_t, double, double, int>(), initadjoint_DS,
+      py::call_guard<py::gil_scoped_release>(),
       "lmax"_a, "kmax"_a, "ncomp"_a, "epsilon"_a, "ofactor"_a=1.5, "nthreads"_a=0)
     .def ("interpol", &inter_d::pyinterpol, interpol_DS, "ptg"_a)
+    .def ("interpol_from_provider", &inter_d::pyinterpol_provider,
+      interpol_provider_DS, "provider"_a, "t0"_a, "freq"_a, "rot"_a, "nval"_a,
+      "rot_left"_a=true)
+    .def ("update_slm", &inter_d::pyupdate_slm, update_slm_DS, "sky"_a, "beam"_a,
+      "separate"_a)
     .def ("deinterpol", &inter_d::pydeinterpol, deinterpol_DS, "ptg"_a, "data"_a)
     .def ("getSlm", &inter_d::pygetSlm, getSlm_DS, "beam"_a)
     .def ("support", &inter_d::support);
+  using inter_dfc = PyInterpolator<double,float>;
+  py::class_<inter_dfc> (m, "Interpolator_fcube", py::module_local(), pyinterpolator_fcube_DS)
+    .def(py::init(&inter_dfc::make),
+      initnormal_DS, "sky"_a, "beam"_a, "separate"_a, "lmax"_a, "kmax"_a, "epsilon"_a, "ofactor"_a=1.5,
+      "nthreads"_a=0)
+    .def(py::init<int64_t, int64_t, int64_t, double, double, int>(), initadjoint_DS,
+      py::call_guard<py::gil_scoped_release>(),
+      "lmax"_a, "kmax"_a, "ncomp"_a, "epsilon"_a, "ofactor"_a=1.5, "nthreads"_a=0)
+    .def ("interpol", &inter_dfc::pyinterpol, interpol_DS, "ptg"_a)
+    .def ("interpol_from_provider", &inter_dfc::pyinterpol_provider,
+      interpol_provider_DS, "provider"_a, "t0"_a, "freq"_a, "rot"_a, "nval"_a,
+      "rot_left"_a=true)
+    .def ("update_slm", &inter_dfc::pyupdate_slm, update_slm_DS, "sky"_a, "beam"_a,
+      "separate"_a)
+    .def ("deinterpol", &inter_dfc::pydeinterpol, deinterpol_DS, "ptg"_a, "data"_a)
+    .def ("getSlm", &inter_dfc::pygetSlm, getSlm_DS, "beam"_a)
+    .def ("support", &inter_dfc::support);
   using inter_f = PyInterpolator<float>;
   py::class_<inter_f> (m, "Interpolator_f", py::module_local(), pyinterpolator_DS)
-    .def(py::init<const py::array &, const py::array &, bool, int64_t, int64_t, float, float, int>(),
+    .def(py::init(&inter_f::make),
       initnormal_DS, "sky"_a, "beam"_a, "separate"_a, "lmax"_a, "kmax"_a, "epsilon"_a, "ofactor"_a=1.5f,
       "nthreads"_a=0)
     .def(py::init<int64_t, int64_t, int64_t, float, float, int>(), initadjoint_DS,
+      py::call_guard<py::gil_scoped_release>(),
       "lmax"_a, "kmax"_a, "ncomp"_a, "epsilon"_a, "ofactor"_a=1.5f, "nthreads"_a=0)
     .def ("interpol", &inter_f::pyinterpol, interpol_DS, "ptg"_a)
+    .def ("interpol_from_provider", &inter_f::pyinterpol_provider,
+      interpol_provider_DS, "provider"_a, "t0"_a, "freq"_a, "rot"_a, "nval"_a,
+      "rot_left"_a=true)
+    .def ("update_slm", &inter_f::pyupdate_slm, update_slm_DS, "sky"_a, "beam"_a,
+      "separate"_a)
     .def ("deinterpol", &inter_f::pydeinterpol, deinterpol_DS, "ptg"_a, "data"_a)
     .def ("getSlm", &inter_f::pygetSlm, getSlm_DS, "beam"_a)
     .def ("support", &inter_f::support);
@@ -26,118 +26,99 @@
 #define SPECIAL_CASING
 
 #include <vector>
+#include <array>
+#include <cstdint>
 #include <complex>
 #include <cmath>
 #include "ducc0/math/constants.h"
 #include "ducc0/math/gl_integrator.h"
 #include "ducc0/math/gridding_kernel.h"
+#include "ducc0/math/space_filling.h"
 #include "ducc0/infra/mav.h"
 #include "ducc0/infra/simd.h"
+#include "ducc0/infra/timers.h"
 #include "ducc0/sharp/sharp.h"
 #include "ducc0/sharp/sharp_almhelpers.h"
 #include "ducc0/sharp/sharp_geomhelpers.h"
 #include "python/alm.h"
+#include "python/pointingprovider.h"
 #include "ducc0/math/fft.h"
 
 namespace ducc0 {
 
-namespace detail_fft {
+namespace detail_totalconvolve {
 
-using std::vector;
+using namespace std;
 
-template<typename T, typename T0> aligned_array<T> alloc_tmp_conv
-  (const fmav_info &info, size_t axis, size_t len)
-  {
-  auto othersize = info.size()/info.shape(axis);
-  constexpr auto vlen = native_simd<T0>::size();
-  auto tmpsize = len*((othersize>=vlen) ? vlen : 1);
-  return aligned_array<T>(tmpsize);
-  }
-
-template<typename Tplan, typename T, typename T0, typename Exec>
-DUCC0_NOINLINE void general_convolve(const fmav<T> &in, fmav<T> &out,
-  const size_t axis, const vector<T0> &kernel, size_t nthreads,
-  const Exec &exec)
+/* Tcube is the type used for storing the data cube. Choosing float for
+   T=double halves the memory consumption and bandwidth of the cube, at the
+   price of a relative accuracy of the interpolated values which is limited
+   to a few times 1e-7. */
+template<typename T, typename Tcube=T> class Interpolator
   {
-  std::unique_ptr<Tplan> plan1, plan2;
-
-  size_t l_in=in.shape(axis), l_out=out.shape(axis);
-  size_t l_min=std::min(l_in, l_out), l_max=std::max(l_in, l_out);
-  MR_assert(kernel.size()==l_min/2+1, "bad kernel size");
-  plan1 = std::make_unique<Tplan>(l_in);
-  plan2 = std::make_unique<Tplan>(l_out);
-
-  execParallel(
-    util::thread_count(nthreads, in, axis, native_simd<T0>::size()),
-    [&](Scheduler &sched) {
-      constexpr auto vlen = native_simd<T0>::size();
-      auto storage = alloc_tmp_conv<T,T0>(in, axis, l_max);
-      multi_iter<vlen> it(in, out, axis, sched.num_threads(), sched.thread_num());
-#ifndef DUCC0_NO_SIMD
-      if (vlen>1)
-        while (it.remaining()>=vlen)
-          {
-          it.advance(vlen);
-          auto tdatav = reinterpret_cast<add_vec_t<T> *>(storage.data());
-          exec(it, in, out, tdatav, *plan1, *plan2, kernel);
-          }
-#endif
-      while (it.remaining()>0)
+  protected:
+#ifdef SIMD_INTERPOL
+    /* native_simd<T>::size() cube entries stored in reduced precision; they
+       are widened to native_simd<T> when read and rounded when updated. */
+    struct NarrowSimd
+      {
+      static constexpr size_t vl = native_simd<T>::size();
+      typedef Tcube Tv __attribute__ ((vector_size (vl*sizeof(Tcube))));
+      Tv v;
+
+      native_simd<T> widen() const
         {
-        it.advance(1);
-        auto buf = reinterpret_cast<T *>(storage.data());
-        exec(it, in, out, buf, *plan1, *plan2, kernel);
+        if constexpr (vl==1)
+          return T(v[0]);
+        else
+          return __builtin_convertvector(v, typename native_simd<T>::Tv);
         }
-    });  // end of parallel region
-  }
-
-struct ExecConvR1
-  {
-  template <typename T0, typename T, size_t vlen> void operator() (
-    const multi_iter<vlen> &it, const fmav<T0> &in, fmav<T0> &out,
-    T * buf, const pocketfft_r<T0> &plan1, const pocketfft_r<T0> &plan2,
-    const vector<T0> &kernel) const
-    {
-    size_t l_in = plan1.length(),
-           l_out = plan2.length(),
-           l_min = std::min(l_in, l_out);
-    copy_input(it, in, buf);
-    plan1.exec(buf, T0(1), true);
-    for (size_t i=0; i<l_min; ++i) buf[i]*=kernel[(i+1)/2];
-    for (size_t i=l_in; i<l_out; ++i) buf[i] = T(0);
-    plan2.exec(buf, T0(1), false);
-    copy_output(it, buf, out);
-    }
-  };
-
-template<typename T> void convolve_1d(const fmav<T> &in,
-  fmav<T> &out, size_t axis, const vector<T> &kernel, size_t nthreads=1)
-  {
-  MR_assert(axis<in.ndim(), "bad axis number");
-  MR_assert(in.ndim()==out.ndim(), "dimensionality mismatch");
-  if (in.data()==out.data())
-    MR_assert(in.stride()==out.stride(), "strides mismatch");
-  for (size_t i=0; i<in.ndim(); ++i)
-    if (i!=axis)
-      MR_assert(in.shape(i)==out.shape(i), "shape mismatch");
-  MR_assert(!((in.shape(axis)&1) || (out.shape(axis)&1)),
-    "input and output axis lengths must be even");
-  if (in.size()==0) return;
-  general_convolve<pocketfft_r<T>>(in, out, axis, kernel, nthreads,
-    ExecConvR1());
-  }
-
-}
-
-using detail_fft::convolve_1d;
+      operator native_simd<T>() const { return widen(); }
+      NarrowSimd &operator+=(const native_simd<T> &other)
+        {
+        if constexpr (vl==1)
+          v[0] += Tcube(other[0]);
+        else
+          v = __builtin_convertvector(typename native_simd<T>::Tv(widen()+other), Tv);
+        return *this;
+        }
+      };
+    using csimd = conditional_t<is_same<T,Tcube>::value, native_simd<T>, NarrowSimd>;
+#endif
 
-namespace detail_totalconvolve {
+    /* Supplies cos(psi) and sin(psi) of the pointings idx[ind] for
+       consecutive ind in [lo; hi). They are computed for a whole SIMD vector
+       of pointings at once. */
+    template<typename Tptg> class PsiTrig
+      {
+      private:
+        using Tsimd = native_simd<double>;
+        static constexpr size_t vl = Tsimd::size();
+        const Tptg &ptg;
+        const size_t *idx;
+        double cpsi[vl], spsi[vl];
 
-using namespace std;
+      public:
+        PsiTrig(const Tptg &ptg_, const size_t *idx_)
+          : ptg(ptg_), idx(idx_) {}
+        void get(size_t ind, size_t lo, size_t hi, double &c, double &s)
+          {
+          size_t b = (ind-lo)%vl;
+          if (b==0)
+            {
+            Tsimd psi(0.);
+            for (size_t bb=0; bb<min(vl, hi-ind); ++bb)
+              psi[bb] = ptg(idx[ind+bb],2);
+            Tsimd vc, vs;
+            sincos(psi, vs, vc);
+            vc.storeu(cpsi);
+            vs.storeu(spsi);
+            }
+          c = cpsi[b];
+          s = spsi[b];
+          }
+      };
 
-template<typename T> class Interpolator
-  {
-  protected:
     bool adjoint;
     size_t lmax, kmax, nphi0, ntheta0, nphi, ntheta;
     int nthreads;
@@ -145,10 +126,196 @@ template<typename T> class Interpolator
     shared_ptr<GriddingKernel<T>> kernel;
     size_t supp;
     size_t ncomp;
+    // first row of the full cube held by this object (nonzero only for
+    // the theta bands of a distributed cube)
+    size_t itheta0;
 #ifdef SIMD_INTERPOL
-    mav<native_simd<T>,4> scube;
+    mav<csimd,4> scube;
 #endif
-    mav<T,4> cube; // the data cube (theta, phi, 2*mbeam+1, TGC)
+    mav<Tcube,4> cube; // the data cube (theta, phi, 2*mbeam+1, TGC)
+    vector<T> corfac; // kernel correction factors for correct()/decorrect()
+
+    /* Returns the (theta, phi) plane of the cube for component icomp and beam
+       index k. If Tcube differs from T, this is a temporary array, which
+       contains a copy of the cube data if requested. */
+    mav<T,2> getPlane(size_t icomp, size_t k, bool copy)
+      {
+      if constexpr (is_same<T,Tcube>::value)
+        return cube.template subarray<2>({supp,supp,icomp,k},{ntheta,nphi,0,0});
+      else
+        {
+        mav<T,2> res({ntheta,nphi});
+        if (copy)
+          for (size_t i=0; i<ntheta; ++i)
+            for (size_t j=0; j<nphi; ++j)
+              res.v(i,j) = T(cube(supp+i,supp+j,icomp,k));
+        return res;
+        }
+      }
+    /* Stores a plane obtained from getPlane() back into the cube. */
+    void putPlane(const mav<T,2> &plane, size_t icomp, size_t k)
+      {
+      if constexpr (!is_same<T,Tcube>::value)
+        for (size_t i=0; i<ntheta; ++i)
+          for (size_t j=0; j<nphi; ++j)
+            cube.v(supp+i,supp+j,icomp,k) = Tcube(plane(i,j));
+      }
+    /* geometry of a (theta, phi) plane as returned by getPlane() */
+    auto planeGeometry(const mav<T,2> &plane) const
+      { return sharp_make_cc_geom_info(ntheta0,nphi0,0.,plane.stride(1),plane.stride(0)); }
+
+    vector<T> getLnorm() const
+      {
+      vector<T>lnorm(lmax+1);
+      for (size_t i=0; i<=lmax; ++i)
+        lnorm[i]=T(std::sqrt(4*pi/(2*i+1.)));
+      return lnorm;
+      }
+
+    /* Computes the planes of component icomp and beam index k from the sky
+       and beam a_lm: plane 0 (in m1) for k==0, otherwise planes 2*k-1 (in m1)
+       and 2*k (in m2). m2 is not accessed for k==0. */
+    void makePlanes(const vector<Alm<complex<T>>> &slm,
+      const vector<Alm<complex<T>>> &blm, bool separate, size_t icomp,
+      size_t k, mav<T,2> &m1, mav<T,2> &m2)
+      {
+      Alm<complex<T>> a1(lmax, lmax), a2(lmax,lmax);
+      auto ginfo = planeGeometry(m1);
+      auto ainfo = sharp_make_triangular_alm_info(lmax,lmax,1);
+      auto lnorm = getLnorm();
+
+      if (k==0)
+        {
+        for (size_t m=0; m<=lmax; ++m)
+          for (size_t l=m; l<=lmax; ++l)
+            {
+            if (separate)
+              a1(l,m) = slm[icomp](l,m)*blm[icomp](l,0).real()*lnorm[l];
+            else
+              {
+              a1(l,m) = 0;
+              for (size_t j=0; j<slm.size(); ++j)
+                a1(l,m) += slm[j](l,m)*blm[j](l,0).real()*lnorm[l];
+              }
+            }
+        sharp_alm2map(a1.Alms().data(), m1.vdata(), *ginfo, *ainfo, 0, nthreads);
+        correct(m1,0);
+        return;
+        }
+
+      for (size_t m=0; m<=lmax; ++m)
+        for (size_t l=m; l<=lmax; ++l)
+          {
+          if (l<k)
+            a1(l,m)=a2(l,m)=0.;
+          else
+            {
+            if (separate)
+              {
+              auto tmp = blm[icomp](l,k)*(-2*lnorm[l]);
+              a1(l,m) = slm[icomp](l,m)*tmp.real();
+              a2(l,m) = slm[icomp](l,m)*tmp.imag();
+              }
+            else
+              {
+              a1(l,m) = a2(l,m) = 0;
+              for (size_t j=0; j<slm.size(); ++j)
+                {
+                auto tmp = blm[j](l,k)*(-2*lnorm[l]);
+                a1(l,m) += slm[j](l,m)*tmp.real();
+                a2(l,m) += slm[j](l,m)*tmp.imag();
+                }
+              }
+            }
+          }
+      sharp_alm2map_spin(k, a1.Alms().data(), a2.Alms().data(), m1.vdata(),
+        m2.vdata(), *ginfo, *ainfo, 0, nthreads);
+      correct(m1,k);
+      correct(m2,k);
+      }
+
+    /* Adjoint of makePlanes(): adds the contributions of the planes of
+       component icomp and beam index k to slm. The planes are overwritten. */
+    void addPlanesToSlm(const vector<Alm<complex<T>>> &blm,
+      vector<Alm<complex<T>>> &slm, size_t icomp, size_t k, mav<T,2> &m1,
+      mav<T,2> &m2)
+      {
+      Alm<complex<T>> a1(lmax, lmax), a2(lmax,lmax);
+      auto ginfo = planeGeometry(m1);
+      auto ainfo = sharp_make_triangular_alm_info(lmax,lmax,1);
+      auto lnorm = getLnorm();
+      bool separate = ncomp>1;
+
+      if (k==0)
+        {
+        symmetrizePoles(m1, 0);
+        decorrect(m1,0);
+        sharp_alm2map_adjoint(a1.Alms().vdata(), m1.data(), *ginfo, *ainfo, 0, nthreads);
+        for (size_t m=0; m<=lmax; ++m)
+          for (size_t l=m; l<=lmax; ++l)
+            if (separate)
+              slm[icomp](l,m) += conj(a1(l,m))*blm[icomp](l,0).real()*lnorm[l];
+            else
+              for (size_t j=0; j<blm.size(); ++j)
+                slm[j](l,m) += conj(a1(l,m))*blm[j](l,0).real()*lnorm[l];
+        return;
+        }
+
+      symmetrizePoles(m1, 2*k-1);
+      symmetrizePoles(m2, 2*k);
+      decorrect(m1,k);
+      decorrect(m2,k);
+      sharp_alm2map_spin_adjoint(k, a1.Alms().vdata(), a2.Alms().vdata(), m1.data(),
+        m2.data(), *ginfo, *ainfo, 0, nthreads);
+      for (size_t m=0; m<=lmax; ++m)
+        for (size_t l=m; l<=lmax; ++l)
+          if (l>=k)
+            {
+            if (separate)
+              {
+              auto tmp = conj(blm[icomp](l,k))*(-2*lnorm[l]);
+              slm[icomp](l,m) += conj(a1(l,m))*tmp.real();
+              slm[icomp](l,m) -= conj(a2(l,m))*tmp.imag();
+              }
+            else
+              for (size_t j=0; j<blm.size(); ++j)
+                {
+                auto tmp = conj(blm[j](l,k))*(-2*lnorm[l]);
+                slm[j](l,m) += conj(a1(l,m))*tmp.real();
+                slm[j](l,m) -= conj(a2(l,m))*tmp.imag();
+                }
+            }
+      }
+
+    /* The pixels at phi and phi+pi of the two pole rows describe the same
+       point of the sphere; adds their contributions for plane index kk. */
+    void symmetrizePoles(mav<T,2> &plane, size_t kk) const
+      {
+      T fct = (((kk+1)/2)&1) ? -1 : 1;
+      for (size_t j=0,j2=nphi/2; j<nphi/2; ++j,++j2)
+        for (size_t i: {size_t(0), ntheta-1})
+          {
+          T tval = (plane(i,j) + fct*plane(i,j2));
+          plane.v(i,j) = tval;
+          plane.v(i,j2) = fct*tval;
+          }
+      }
+
+    /* The theta band of the cube held by task rank out of ntasks: the
+       pointings whose kernel starts in cube rows [lo; hi) are handled by
+       this task, which stores rows [lo; hi+supp-1). For ntasks==1 this is
+       the full cube. */
+    tuple<size_t, size_t> thetaBand(size_t ntasks, size_t rank) const
+      { return calcShare(ntasks, rank, ntheta+supp+1); }
+
+    /* Returns the first cube row touched by the kernel of a pointing with
+       colatitude theta. */
+    size_t thetaRow(T theta) const
+      {
+      T xdtheta = T((ntheta-1)/pi);
+      T f0=T(0.5*supp+theta*xdtheta);
+      return size_t(f0+T(1));
+      }
 
     void correct(mav<T,2> &arr, int spin)
       {
@@ -166,26 +333,20 @@ template<typename T> class Interpolator
           }
       for (size_t j=0; j<nphi0; ++j)
         tmp.v(ntheta0-1,j) = arr(ntheta0-1,j);
-      auto fct = kernel->corfunc(nphi0/2+1, 1./nphi, nthreads);
-      vector<T> k2(fct.size());
-      for (size_t i=0; i<fct.size(); ++i) k2[i] = T(fct[i]/nphi0);
       fmav<T> ftmp(tmp);
       fmav<T> ftmp0(tmp.template subarray<2>({0,0},{nphi0, nphi0}));
-      convolve_1d(ftmp0, ftmp, 0, k2, nthreads);
+      convolve_axis(ftmp0, ftmp, 0, corfac, nthreads);
       fmav<T> ftmp2(tmp.template subarray<2>({0,0},{ntheta, nphi0}));
       fmav<T> farr(arr);
-      convolve_1d(ftmp2, farr, 1, k2, nthreads);
+      convolve_axis(ftmp2, farr, 1, corfac, nthreads);
       }
     void decorrect(mav<T,2> &arr, int spin)
       {
       T sfct = (spin&1) ? -1 : 1;
       mav<T,2> tmp({nphi,nphi0});
-      auto fct = kernel->corfunc(nphi0/2+1, 1./nphi, nthreads);
-      vector<T> k2(fct.size());
-      for (size_t i=0; i<fct.size(); ++i) k2[i] = T(fct[i]/nphi0);
       fmav<T> farr(arr);
       fmav<T> ftmp2(tmp.template subarray<2>({0,0},{ntheta, nphi0}));
-      convolve_1d(farr, ftmp2, 1, k2, nthreads);
+      convolve_axis(farr, ftmp2, 1, corfac, nthreads);
       // extend to second half
       for (size_t i=1, i2=nphi-1; i+1<ntheta; ++i,--i2)
         for (size_t j=0,j2=nphi0/2; j<nphi0; ++j,++j2)
@@ -195,7 +356,7 @@ template<typename T> class Interpolator
           }
       fmav<T> ftmp(tmp);
       fmav<T> ftmp0(tmp.template subarray<2>({0,0},{nphi0, nphi0}));
-      convolve_1d(ftmp, ftmp0, 0, k2, nthreads);
+      convolve_axis(ftmp, ftmp0, 0, corfac, nthreads);
       for (size_t j=0; j<nphi0; ++j)
         arr.v(0,j) = T(0.5)*tmp(0,j);
       for (size_t i=1; i+1<ntheta0; ++i)
@@ -205,38 +366,130 @@ template<typename T> class Interpolator
         arr.v(ntheta0-1,j) = T(0.5)*tmp(ntheta0-1,j);
       }
 
-    vector<size_t> getIdx(const mav<T,2> &ptg) const
+    /* Returns, for every cell (i,j) of an nct x ncp grid (at index
+       i*ncp+j), its rank when all cells are sorted by their index along the
+       2D space-filling curve of space_filling.h (morton2peano2D_32(), a
+       Hilbert-type curve) on the enclosing 2^bits x 2^bits square.
+       Cells with nearby ranks are also close on the grid: successive cells
+       are mostly adjacent, with jumps only where the curve leaves and
+       re-enters the rectangle. Visiting the cells in this order, rather than
+       row by row, means that the cube pixels touched by a cell mostly
+       overlap those of the cells handled just before, which are still in
+       cache. */
+    static vector<uint32_t> getCellOrder(size_t nct, size_t ncp)
+      {
+      unsigned bits=1;
+      while ((size_t(1)<<bits)<max(nct,ncp)) ++bits;
+      MR_assert(bits<=16, "too many cells");
+      vector<pair<uint32_t,uint32_t>> key(nct*ncp);
+      for (size_t i=0; i<nct; ++i)
+        for (size_t j=0; j<ncp; ++j)
+          key[i*ncp+j] = {morton2peano2D_32(coord2morton2D_32(
+            {uint32_t(i),uint32_t(j)}),bits), uint32_t(i*ncp+j)};
+      sort(key.begin(), key.end());
+      vector<uint32_t> res(nct*ncp);
+      for (size_t i=0; i<key.size(); ++i)
+        res[key[i].second] = uint32_t(i);
+      return res;
+      }
+
+    /* Returns the pointing indices sorted by the cell of the sphere (of
+       roughly cellsize x cellsize cube pixels) they fall into, with the
+       cells along a Peano curve. This is a stable two-pass counting sort,
+       so the result does not depend on the number of threads. */
+    template<typename Tptg> vector<size_t> getIdx(const Tptg &ptg) const
       {
       constexpr size_t cellsize=16;
       size_t nct = ntheta/cellsize+1,
              ncp = nphi/cellsize+1;
-      vector<vector<size_t>> mapper(nct*ncp);
-      for (size_t i=0; i<ptg.shape(0); ++i)
+      auto order = getCellOrder(nct, ncp);
+      size_t nptg = ptg.shape(0),
+             nthr = size_t(max(1,nthreads));
+      vector<uint32_t> key(nptg);
+      mav<size_t,2> acc({nthr, nct*ncp+16}); // the 16 is safety distance to avoid false sharing
+      execParallel(nthr, [&](Scheduler &sched)
         {
-        size_t itheta=min(nct-1,size_t(ptg(i,0)/pi*nct)),
-               iphi=min(ncp-1,size_t(ptg(i,1)/(2*pi)*ncp));
-//        MR_assert((itheta<nct)&&(iphi<ncp), "oops");
-        mapper[itheta*ncp+iphi].push_back(i);
-        }
-      vector<size_t> idx(ptg.shape(0));
-      size_t cnt=0;
-      for (auto &vec: mapper)
+        size_t tid = sched.thread_num();
+        auto [lo, hi] = calcShare(nthr, tid, nptg);
+        for (size_t i=lo; i<hi; ++i)
+          {
+          size_t itheta=min(nct-1,size_t(ptg(i,0)/pi*nct)),
+                 iphi=min(ncp-1,size_t(ptg(i,1)/(2*pi)*ncp));
+          key[i] = order[itheta*ncp+iphi];
+          ++acc.v(tid, key[i]);
+          }
+        });
+      size_t offset=0;
+      for (size_t c=0; c<nct*ncp; ++c)
+        for (size_t tid=0; tid<nthr; ++tid)
+          {
+          auto tmp = acc(tid, c);
+          acc.v(tid, c) = offset;
+          offset += tmp;
+          }
+      vector<size_t> idx(nptg);
+      execParallel(nthr, [&](Scheduler &sched)
         {
-        for (auto i:vec)
-          idx[cnt++] = i;
-        vec.clear();
-        vec.shrink_to_fit();
-        }
+        size_t tid = sched.thread_num();
+        auto [lo, hi] = calcShare(nthr, tid, nptg);
+        for (size_t i=lo; i<hi; ++i)
+          idx[acc.v(tid, key[i])++] = i;
+        });
       return idx;
       }
 
-  public:
-    Interpolator(const vector<Alm<complex<T>>> &slm,
-                 const vector<Alm<complex<T>>> &blm,
-                 bool separate, T epsilon, T ofmin, int nthreads_)
-      : adjoint(false),
-        lmax(slm.at(0).Lmax()),
-        kmax(blm.at(0).Mmax()),
+    /* Sorts the pointings by the cell of the cube (of cellsize x cellsize
+       pixels) containing the lower corner of their kernel footprint.
+       On exit, idx[ofs[c]:ofs[c+1]] are the pointings of cell c (in input
+       order), and cells[color] lists the nonempty cells of every color.
+       Since supp<=cellsize, a pointing only touches its own cell and the
+       neighbouring ones with higher indices, so cells of the same color
+       ((itheta&1)+2*(iphi&1)) never update the same cube pixels. */
+    void getCells(const mav<T,2> &ptg, size_t cellsize, vector<size_t> &idx,
+      vector<size_t> &ofs, array<vector<size_t>,4> &cells) const
+      {
+      MR_assert(supp<=cellsize, "support too large for cell size");
+      T xdtheta = T((ntheta-1)/pi),
+        xdphi = T(nphi/(2*pi));
+      size_t nct = cube.shape(0)/cellsize+1,
+             ncp = cube.shape(1)/cellsize+1;
+      vector<uint32_t> key(ptg.shape(0));
+      ofs.assign(nct*ncp+1, 0);
+      for (size_t i=0; i<ptg.shape(0); ++i)
+        {
+        T f0=T(0.5*supp+ptg(i,0)*xdtheta);
+        size_t i0 = size_t(f0+T(1));
+        T f1=T(0.5)*supp+ptg(i,1)*xdphi;
+        size_t i1 = size_t(f1+1.);
+        MR_assert((i0>=itheta0) && (i0+supp<=itheta0+cube.shape(0))
+          && (i1+supp<=cube.shape(1)), "pointing out of range");
+        i0 -= itheta0;
+        key[i] = uint32_t((i0/cellsize)*ncp + i1/cellsize);
+        ++ofs[key[i]+1];
+        }
+      // within a color, the cells are listed along a Peano curve
+      auto order = getCellOrder(nct, ncp);
+      vector<uint32_t> bycell(nct*ncp);
+      for (size_t c=0; c<nct*ncp; ++c)
+        bycell[order[c]] = uint32_t(c);
+      for (auto c: bycell)
+        if (ofs[c+1]>0)
+          cells[((c/ncp)&1) + 2*((c%ncp)&1)].push_back(c);
+      for (size_t c=0; c<nct*ncp; ++c)
+        ofs[c+1] += ofs[c];
+      idx.resize(ptg.shape(0));
+      vector<size_t> pos(ofs.begin(), ofs.end()-1);
+      for (size_t i=0; i<ptg.shape(0); ++i)
+        idx[pos[key[i]]++] = i;
+      }
+
+    /* Sets up the cube geometry for the given parameters and allocates the
+       theta band of the cube belonging to task rank out of ntasks. */
+    Interpolator(bool adjoint_, size_t lmax_, size_t kmax_, size_t ncomp_,
+      T epsilon, T ofmin, int nthreads_, size_t ntasks, size_t rank)
+      : adjoint(adjoint_),
+        lmax(lmax_),
+        kmax(kmax_),
         nphi0(2*good_size_real(lmax+1)),
         ntheta0(nphi0/2+1),
         nphi(std::max<size_t>(20,2*good_size_real(size_t((2*lmax+1)*ofmin/2.)))),
@@ -245,15 +498,28 @@ template<typename T> class Interpolator
         ofactor(T(nphi)/(2*lmax+1)),
         kernel(selectKernel<T>(ofactor, 0.5*epsilon)),
         supp(kernel->support()),
-        ncomp(separate ? slm.size() : 1),
+        ncomp(ncomp_),
+        itheta0(get<0>(thetaBand(ntasks, rank))),
 #ifdef SIMD_INTERPOL
-        scube({ntheta+2*supp, nphi+2*supp, ncomp, (2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size()}),
-        cube(reinterpret_cast<T *>(scube.vdata()),{ntheta+2*supp, nphi+2*supp, ncomp, ((2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size())*native_simd<T>::size()},true)
+        scube({get<1>(thetaBand(ntasks, rank))+supp-1-itheta0, nphi+2*supp, ncomp, (2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size()}, size_t(nthreads_)),
+        cube(reinterpret_cast<Tcube *>(scube.vdata()),{scube.shape(0), nphi+2*supp, ncomp, ((2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size())*native_simd<T>::size()},true)
 #else
-        cube({ntheta+2*supp, nphi+2*supp, ncomp, 2*kmax+1})
+        cube({get<1>(thetaBand(ntasks, rank))+supp-1-itheta0, nphi+2*supp, ncomp, 2*kmax+1}, size_t(nthreads_))
 #endif
       {
       MR_assert((ncomp==1)||(ncomp==3), "currently only 1 or 3 components allowed");
+      MR_assert((supp<=ntheta) && (supp<=nphi), "support too large!");
+      if (adjoint) cube.apply([](Tcube &v){v=0.;});
+      auto fct = kernel->corfunc(nphi0/2+1, 1./nphi, nthreads);
+      corfac.resize(fct.size());
+      for (size_t i=0; i<fct.size(); ++i) corfac[i] = T(fct[i]/nphi0);
+      }
+
+    /* Computes the contents of the data cube from the sky and beam a_lm. */
+    void fillCube(const vector<Alm<complex<T>>> &slm,
+                  const vector<Alm<complex<T>>> &blm, bool separate)
+      {
+      TraceScope trace("Interpolator::fillCube");
       MR_assert(slm.size()==blm.size(), "inconsistent slm and blm vectors");
       for (size_t i=0; i<slm.size(); ++i)
         {
@@ -263,66 +529,19 @@ template<typename T> class Interpolator
         MR_assert(blm[i].Mmax()==kmax, "Inconcistent beam mmax");
         }
 
-      MR_assert((supp<=ntheta) && (supp<=nphi), "support too large!");
-      Alm<complex<T>> a1(lmax, lmax), a2(lmax,lmax);
-      auto ginfo = sharp_make_cc_geom_info(ntheta0,nphi0,0.,cube.stride(1),cube.stride(0));
-      auto ainfo = sharp_make_triangular_alm_info(lmax,lmax,1);
-
-      vector<T>lnorm(lmax+1);
-      for (size_t i=0; i<=lmax; ++i)
-        lnorm[i]=T(std::sqrt(4*pi/(2*i+1.)));
-
       for (size_t icomp=0; icomp<ncomp; ++icomp)
         {
-        for (size_t m=0; m<=lmax; ++m)
-          for (size_t l=m; l<=lmax; ++l)
-            {
-            if (separate)
-              a1(l,m) = slm[icomp](l,m)*blm[icomp](l,0).real()*lnorm[l];
-            else
-              {
-              a1(l,m) = 0;
-              for (size_t j=0; j<slm.size(); ++j)
-                a1(l,m) += slm[j](l,m)*blm[j](l,0).real()*lnorm[l];
-              }
-            }
-        auto m1 = cube.template subarray<2>({supp,supp,icomp,0},{ntheta,nphi,0,0});
-        sharp_alm2map(a1.Alms().data(), m1.vdata(), *ginfo, *ainfo, 0, nthreads);
-        correct(m1,0);
+        auto m1 = getPlane(icomp, 0, false);
+        makePlanes(slm, blm, separate, icomp, 0, m1, m1);
+        putPlane(m1, icomp, 0);
 
         for (size_t k=1; k<=kmax; ++k)
           {
-          for (size_t m=0; m<=lmax; ++m)
-            for (size_t l=m; l<=lmax; ++l)
-              {
-              if (l<k)
-                a1(l,m)=a2(l,m)=0.;
-              else
-                {
-                if (separate)
-                  {
-                  auto tmp = blm[icomp](l,k)*(-2*lnorm[l]);
-                  a1(l,m) = slm[icomp](l,m)*tmp.real();
-                  a2(l,m) = slm[icomp](l,m)*tmp.imag();
-                  }
-                else
-                  {
-                  a1(l,m) = a2(l,m) = 0;
-                  for (size_t j=0; j<slm.size(); ++j)
-                    {
-                    auto tmp = blm[j](l,k)*(-2*lnorm[l]);
-                    a1(l,m) += slm[j](l,m)*tmp.real();
-                    a2(l,m) += slm[j](l,m)*tmp.imag();
-                    }
-                  }
-                }
-              }
-          auto m1 = cube.template subarray<2>({supp,supp,icomp,2*k-1},{ntheta,nphi,0,0});
-          auto m2 = cube.template subarray<2>({supp,supp,icomp,2*k  },{ntheta,nphi,0,0});
-          sharp_alm2map_spin(k, a1.Alms().data(), a2.Alms().data(), m1.vdata(),
-            m2.vdata(), *ginfo, *ainfo, 0, nthreads);
-          correct(m1,k);
-          correct(m2,k);
+          auto m1 = getPlane(icomp, 2*k-1, false);
+          auto m2 = getPlane(icomp, 2*k, false);
+          makePlanes(slm, blm, separate, icomp, k, m1, m2);
+          putPlane(m1, icomp, 2*k-1);
+          putPlane(m2, icomp, 2*k);
           }
         }
 
@@ -331,7 +550,7 @@ template<typename T> class Interpolator
         for (size_t j=0, j2=nphi/2; j<nphi; ++j,++j2)
           for (size_t k=0; k<cube.shape(3); ++k)
             {
-            T fct = (((k+1)/2)&1) ? -1 : 1;
+            Tcube fct = (((k+1)/2)&1) ? -1 : 1;
             if (j2>=nphi) j2-=nphi;
             for (size_t l=0; l<cube.shape(2); ++l)
               {
@@ -349,34 +568,37 @@ template<typename T> class Interpolator
             }
       }
 
+  public:
+    Interpolator(const vector<Alm<complex<T>>> &slm,
+                 const vector<Alm<complex<T>>> &blm,
+                 bool separate, T epsilon, T ofmin, int nthreads_)
+      : Interpolator(false, slm.at(0).Lmax(), blm.at(0).Mmax(),
+          separate ? slm.size() : 1, epsilon, ofmin, nthreads_, 1, 0)
+      {
+      fillCube(slm, blm, separate);
+      }
+
     Interpolator(size_t lmax_, size_t kmax_, size_t ncomp_, T epsilon, T ofmin, int nthreads_)
-      : adjoint(true),
-        lmax(lmax_),
-        kmax(kmax_),
-        nphi0(2*good_size_real(lmax+1)),
-        ntheta0(nphi0/2+1),
-        nphi(std::max<size_t>(20,2*good_size_real(size_t((2*lmax+1)*ofmin/2.)))),
-        ntheta(nphi/2+1),
-        nthreads(nthreads_),
-        ofactor(T(nphi)/(2*lmax+1)),
-        kernel(selectKernel<T>(ofactor, 0.5*epsilon)),
-        supp(kernel->support()),
-        ncomp(ncomp_),
-#ifdef SIMD_INTERPOL
-        scube({ntheta+2*supp, nphi+2*supp, ncomp, (2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size()}),
-        cube(reinterpret_cast<T *>(scube.vdata()),{ntheta+2*supp, nphi+2*supp, ncomp, ((2*kmax+1+native_simd<T>::size()-1)/native_simd<T>::size())*native_simd<T>::size()},true)
-#else
-        cube({ntheta+2*supp, nphi+2*supp, ncomp, 2*kmax+1})
-#endif
+      : Interpolator(true, lmax_, kmax_, ncomp_, epsilon, ofmin, nthreads_, 1, 0)
+      {}
+
+    /* Recomputes the data cube for new sky (and optionally beam) a_lm.
+       lmax, kmax and the number of components must not change; the cube
+       storage, the kernel and the correction factors are reused. */
+    void update_slm(const vector<Alm<complex<T>>> &slm,
+                    const vector<Alm<complex<T>>> &blm, bool separate)
       {
-      MR_assert((ncomp==1)||(ncomp==3), "currently only 1 or 3 components allowed");
-      MR_assert((supp<=ntheta) && (supp<=nphi), "support too large!");
-      cube.apply([](T &v){v=0.;});
+      MR_assert(!adjoint, "cannot be called in adjoint mode");
+      MR_assert((separate ? slm.size() : 1)==ncomp,
+        "number of components must not change");
+      MR_assert((slm.at(0).Lmax()==lmax) && (blm.at(0).Mmax()==kmax),
+        "lmax and kmax must not change");
+      fillCube(slm, blm, separate);
       }
 
 #ifdef SIMD_INTERPOL
-    template<size_t nv, size_t nc> void interpol_help0(const T * DUCC0_RESTRICT wt,
-      const T * DUCC0_RESTRICT wp, const native_simd<T> * DUCC0_RESTRICT p, size_t d0, size_t d1, const native_simd<T> * DUCC0_RESTRICT psiarr2, mav<T,2> &res, size_t idx) const
+    template<size_t nv, size_t nc, typename Tres> void interpol_help0(const T * DUCC0_RESTRICT wt,
+      const T * DUCC0_RESTRICT wp, const csimd * DUCC0_RESTRICT p, size_t d0, size_t d1, const native_simd<T> * DUCC0_RESTRICT psiarr2, Tres &res, size_t idx) const
       {
       array<native_simd<T>,nc> vv;
       for (auto &vvv:vv) vvv=0;
@@ -390,7 +612,7 @@ template<typename T> class Interpolator
           for (auto &vvv:tvv) vvv=0;
           for (size_t l=0; l<nv; ++l)
             for (size_t c=0; c<nc; ++c)
-              tvv[c] += p1[l+nv*c]*psiarr2[l];
+              tvv[c] += psiarr2[l]*native_simd<T>(p1[l+nv*c]);
           for (size_t c=0; c<nc; ++c)
           vv[c] += (wtj*wp[k])*tvv[c];
           }
@@ -399,7 +621,7 @@ template<typename T> class Interpolator
         res.v(idx,c) = reduce(vv[c], std::plus<>());
       }
     template<size_t nv, size_t nc> void deinterpol_help0(const T * DUCC0_RESTRICT wt,
-      const T * DUCC0_RESTRICT wp, native_simd<T> * DUCC0_RESTRICT p, size_t d0, size_t d1, const native_simd<T> * DUCC0_RESTRICT psiarr2, const mav<T,2> &data, size_t idx) const
+      const T * DUCC0_RESTRICT wp, csimd * DUCC0_RESTRICT p, size_t d0, size_t d1, const native_simd<T> * DUCC0_RESTRICT psiarr2, const mav<T,2> &data, size_t idx) const
       {
       array<native_simd<T>,nc> vv;
       for (size_t i=0; i<nc; ++i) vv[i] = data(idx,i);
@@ -421,8 +643,29 @@ template<typename T> class Interpolator
       }
 #endif
 
-    void interpol (const mav<T,2> &ptg, mav<T,2> &res) const
+  protected:
+    /* Presents an array of shape (n0, n1, m) as one of shape (n0*n1, m). */
+    template<typename Tarr> class Flattened
+      {
+      private:
+        Tarr &arr;
+        size_t n1;
+
+      public:
+        Flattened(Tarr &arr_) : arr(arr_), n1(arr.shape(1)) {}
+        size_t shape(size_t i) const
+          { return (i==0) ? arr.shape(0)*n1 : arr.shape(2); }
+        decltype(auto) operator()(size_t i, size_t j) const
+          { return arr(i/n1, i%n1, j); }
+        decltype(auto) v(size_t i, size_t j)
+          { return arr.v(i/n1, i%n1, j); }
+      };
+
+    /* Tptg and Tres are 2D array-like types indexed by (pointing, j). */
+    template<typename Tptg, typename Tres> void interpol_impl(const Tptg &ptg,
+      Tres &res) const
       {
+      TraceScope trace("Interpolator::interpol");
 #ifdef SIMD_INTERPOL
       constexpr size_t vl=native_simd<T>::size();
       MR_assert(scube.stride(3)==1, "bad stride");
@@ -451,18 +694,58 @@ template<typename T> class Interpolator
         vector<native_simd<T>> psiarr2((2*kmax+1+vl-1)/vl);
         for (auto &v:psiarr2) v=0;
 #endif
+        // For small supports, the kernel is evaluated for kvl pointings at
+        // once, which uses all SIMD lanes.
+        constexpr size_t kvl=native_simd<T>::size();
+        const bool batch = ((supp+kvl-1)/kvl)*kvl >= 2*supp;
+        vector<native_simd<T>> tbatch(batch ? supp : 0), pbatch(batch ? supp : 0);
+        size_t bi0[kvl], bi1[kvl];
+        PsiTrig psitrig(ptg, idx.data());
         while (auto rng=sched.getNext()) for(auto ind=rng.lo; ind<rng.hi; ++ind)
           {
           size_t i=idx[ind];
-          T f0=T(0.5*supp+ptg(i,0)*xdtheta);
-          size_t i0 = size_t(f0+T(1));
-          kernel->eval((i0-f0)*delta-1, tbuf.simd);
-          T f1=T(0.5)*supp+ptg(i,1)*xdphi;
-          size_t i1 = size_t(f1+1.);
-          kernel->eval((i1-f1)*delta-1, pbuf.simd);
+          size_t i0, i1;
+          if (batch)
+            {
+            size_t b = (ind-rng.lo)%kvl;
+            if (b==0)
+              {
+              native_simd<T> xt(-1), xp(-1);
+              for (size_t bb=0; bb<min(kvl, rng.hi-ind); ++bb)
+                {
+                size_t ii=idx[ind+bb];
+                T f0=T(0.5*supp+ptg(ii,0)*xdtheta);
+                bi0[bb] = size_t(f0+T(1));
+                xt[bb] = (bi0[bb]-f0)*delta-1;
+                T f1=T(0.5)*supp+ptg(ii,1)*xdphi;
+                bi1[bb] = size_t(f1+1.);
+                xp[bb] = (bi1[bb]-f1)*delta-1;
+                }
+              kernel->eval_batch(xt, tbatch.data());
+              kernel->eval_batch(xp, pbatch.data());
+              }
+            i0 = bi0[b];
+            i1 = bi1[b];
+            auto stbatch = reinterpret_cast<const T *>(tbatch.data()),
+                 spbatch = reinterpret_cast<const T *>(pbatch.data());
+            for (size_t j=0; j<supp; ++j)
+              {
+              wt[j] = stbatch[j*kvl+b];
+              wp[j] = spbatch[j*kvl+b];
+              }
+            }
+          else
+            {
+            T f0=T(0.5*supp+ptg(i,0)*xdtheta);
+            i0 = size_t(f0+T(1));
+            kernel->eval((i0-f0)*delta-1, tbuf.simd);
+            T f1=T(0.5)*supp+ptg(i,1)*xdphi;
+            i1 = size_t(f1+1.);
+            kernel->eval((i1-f1)*delta-1, pbuf.simd);
+            }
           psiarr[0]=1.;
-          double psi=ptg(i,2);
-          double cpsi=cos(psi), spsi=sin(psi);
+          double cpsi, spsi;
+          psitrig.get(ind, rng.lo, rng.hi, cpsi, spsi);
           double cnpsi=cpsi, snpsi=spsi;
           for (size_t l=1; l<=kmax; ++l)
             {
@@ -483,10 +766,10 @@ template<typename T> class Interpolator
             for (size_t j=0; j<supp; ++j)
               for (size_t k=0; k<supp; ++k)
                 for (size_t l=0; l<2*kmax+1; ++l)
-                  vv += cube(i0+j,i1+k,0,l)*wt[j]*wp[k]*psiarr[l];
+                  vv += cube(i0-itheta0+j,i1+k,0,l)*wt[j]*wp[k]*psiarr[l];
             res.v(i,0) = vv;
 #else
-            const native_simd<T> *p=&scube(i0,i1,0,0);
+            const csimd *p=&scube(i0-itheta0,i1,0,0);
             ptrdiff_t d0 = scube.stride(0);
             ptrdiff_t d1 = scube.stride(1);
             switch (nv)
@@ -525,7 +808,7 @@ template<typename T> class Interpolator
                     {
                     native_simd<T> tvv=0;
                     for (size_t l=0; l<nv; ++l)
-                      tvv += p1[l]*psiarr2[l];
+                      tvv += psiarr2[l]*native_simd<T>(p1[l]);
                     vv += wtj*wp[k]*tvv;
                     }
                   }
@@ -543,15 +826,15 @@ template<typename T> class Interpolator
                 for (size_t l=0; l<2*kmax+1; ++l)
                   {
                   auto tmp = wt[j]*wp[k]*psiarr[l];
-                  v0 += cube(i0+j,i1+k,0,l)*tmp;
-                  v1 += cube(i0+j,i1+k,1,l)*tmp;
-                  v2 += cube(i0+j,i1+k,2,l)*tmp;
+                  v0 += cube(i0-itheta0+j,i1+k,0,l)*tmp;
+                  v1 += cube(i0-itheta0+j,i1+k,1,l)*tmp;
+                  v2 += cube(i0-itheta0+j,i1+k,2,l)*tmp;
                   }
             res.v(i,0) = v0;
             res.v(i,1) = v1;
             res.v(i,2) = v2;
 #else
-            const native_simd<T> *p=&scube(i0,i1,0,0);
+            const csimd *p=&scube(i0-itheta0,i1,0,0);
             ptrdiff_t d0 = scube.stride(0);
             ptrdiff_t d1 = scube.stride(1);
             switch (nv)
@@ -593,9 +876,9 @@ template<typename T> class Interpolator
                     for (size_t l=0; l<nv; ++l)
                       {
                       auto tmp = wtjwpk*psiarr2[l];
-                      v0 += p1[l]*tmp;
-                      v1 += p1[l+d2]*tmp;
-                      v2 += p1[l+2*d2]*tmp;
+                      v0 += tmp*native_simd<T>(p1[l]);
+                      v1 += tmp*native_simd<T>(p1[l+d2]);
+                      v2 += tmp*native_simd<T>(p1[l+2*d2]);
                       }
                     }
                   }
@@ -610,11 +893,56 @@ template<typename T> class Interpolator
         });
       }
 
+  public:
+    void interpol (const mav<T,2> &ptg, mav<T,2> &res) const
+      { interpol_impl(ptg, res); }
+
+    /* Interpolation for several detectors at once: ptg has the shape
+       (ndet, nsamp, 3), res the shape (ndet, nsamp, ncomp). All pointings
+       are sorted into a common work list, so every region of the data cube
+       is only brought into cache once for all detectors. */
+    void interpol (const mav<T,3> &ptg, mav<T,3> &res) const
+      {
+      MR_assert((ptg.shape(0)==res.shape(0)) && (ptg.shape(1)==res.shape(1)),
+        "dimension mismatch");
+      Flattened<const mav<T,3>> ptg2(ptg);
+      Flattened<mav<T,3>> res2(res);
+      interpol_impl(ptg2, res2);
+      }
+
+    /* Computes the interpolated values for the samples of a detector whose
+       orientation is obtained by rotating the satellite orientations of prov
+       by rot (see PointingProvider::get_rotated_quaternions()). The time
+       stream starts at t0 and is sampled with frequency freq; its length is
+       given by res.shape(0).
+       The pointings are produced and consumed in chunks of chunksize
+       samples, so the required temporary memory does not depend on the
+       length of the time stream. */
+    template<typename Tp> void interpol(const PointingProvider<Tp> &prov,
+      double t0, double freq, const mav<Tp,1> &rot, bool rot_left,
+      mav<T,2> &res, size_t chunksize=(size_t(1)<<16)) const
+      {
+      MR_assert(res.shape(1)==ncomp, "# of components mismatch");
+      MR_assert(chunksize>0, "chunksize must be positive");
+      size_t nsamp = res.shape(0);
+      size_t nchunk = min(chunksize, nsamp);
+      mav<T,2> ptg({nchunk,3});
+      for (size_t lo=0; lo<nsamp; lo+=chunksize)
+        {
+        size_t hi = min(nsamp, lo+chunksize);
+        auto ptg2 = ptg.template subarray<2>({0,0},{hi-lo,3});
+        prov.get_rotated_angles(t0, freq, rot, ptg2, rot_left, lo, nthreads);
+        auto res2 = res.template subarray<2>({lo,0},{hi-lo,ncomp});
+        interpol(ptg2, res2);
+        }
+      }
+
     size_t support() const
       { return supp; }
 
     void deinterpol (const mav<T,2> &ptg, const mav<T,2> &data)
       {
+      TraceScope trace("Interpolator::deinterpol");
 #ifdef SIMD_INTERPOL
       constexpr size_t vl=native_simd<T>::size();
       MR_assert(scube.stride(3)==1, "bad stride");
@@ -628,215 +956,189 @@ template<typename T> class Interpolator
       T delta = T(2)/supp;
       T xdtheta = T((ntheta-1)/pi),
         xdphi = T(nphi/(2*pi));
-      auto idx = getIdx(ptg);
+      vector<size_t> idx, ofs;
+      array<vector<size_t>,4> cells;
+      getCells(ptg, 16, idx, ofs, cells);
 
-      constexpr size_t cellsize=16;
-      size_t nct = ntheta/cellsize+5,
-             ncp = nphi/cellsize+5;
-      mav<std::mutex,2> locks({nct,ncp});
-
-      execStatic(idx.size(), nthreads, 0, [&](Scheduler &sched)
-        {
-        size_t b_theta=99999999999999, b_phi=9999999999999999;
-        union {
-          native_simd<T> simd[64/vl];
-          T scalar[64];
-          } tbuf, pbuf;
-        T *wt(tbuf.scalar), *wp(pbuf.scalar);
-        for (auto &v: tbuf.simd) v=0;
-        for (auto &v: pbuf.simd) v=0;
-        MR_assert(supp<=64, "support too large");
-        vector<T> psiarr(2*kmax+1);
+      // Cells of one color are processed concurrently without any locking;
+      // every cube pixel receives its contributions in a fixed order, so
+      // the result does not depend on the number of threads.
+      for (const auto &ccells: cells)
+        execDynamic(ccells.size(), nthreads, 1, [&](Scheduler &sched)
+          {
+          union {
+            native_simd<T> simd[64/vl];
+            T scalar[64];
+            } tbuf, pbuf;
+          T *wt(tbuf.scalar), *wp(pbuf.scalar);
+          for (auto &v: tbuf.simd) v=0;
+          for (auto &v: pbuf.simd) v=0;
+          MR_assert(supp<=64, "support too large");
+          vector<T> psiarr(2*kmax+1);
 #ifdef SIMD_INTERPOL
-        vector<native_simd<T>> psiarr2((2*kmax+1+vl-1)/vl);
-        for (auto &v:psiarr2) v=0;
+          vector<native_simd<T>> psiarr2((2*kmax+1+vl-1)/vl);
+          for (auto &v:psiarr2) v=0;
 #endif
-        while (auto rng=sched.getNext()) for(auto ind=rng.lo; ind<rng.hi; ++ind)
-          {
-          size_t i=idx[ind];
-          T f0=T(0.5*supp+ptg(i,0)*xdtheta);
-          size_t i0 = size_t(f0+T(1));
-          kernel->eval((i0-f0)*delta-1, tbuf.simd);
-          T f1=T(0.5)*supp+ptg(i,1)*xdphi;
-          size_t i1 = size_t(f1+1.);
-          kernel->eval((i1-f1)*delta-1, pbuf.simd);
-          psiarr[0]=1.;
-          double psi=ptg(i,2);
-          double cpsi=cos(psi), spsi=sin(psi);
-          double cnpsi=cpsi, snpsi=spsi;
-          for (size_t l=1; l<=kmax; ++l)
+          PsiTrig psitrig(ptg, idx.data());
+          while (auto rng=sched.getNext()) for(auto icell=rng.lo; icell<rng.hi; ++icell)
+          for(auto ind=ofs[ccells[icell]]; ind<ofs[ccells[icell]+1]; ++ind)
             {
-            psiarr[2*l-1]=T(cnpsi);
-            psiarr[2*l]=T(snpsi);
-            const double tmp = snpsi*cpsi + cnpsi*spsi;
-            cnpsi=cnpsi*cpsi - snpsi*spsi;
-            snpsi=tmp;
-            }
-          size_t b_theta_new = i0/cellsize,
-                 b_phi_new = i1/cellsize;
-          if ((b_theta_new!=b_theta) || (b_phi_new!=b_phi))
-            {
-            if (b_theta<locks.shape(0))  // unlock
+            size_t i=idx[ind];
+            T f0=T(0.5*supp+ptg(i,0)*xdtheta);
+            size_t i0 = size_t(f0+T(1));
+            kernel->eval((i0-f0)*delta-1, tbuf.simd);
+            T f1=T(0.5)*supp+ptg(i,1)*xdphi;
+            size_t i1 = size_t(f1+1.);
+            kernel->eval((i1-f1)*delta-1, pbuf.simd);
+            psiarr[0]=1.;
+            double cpsi, spsi;
+            psitrig.get(ind, ofs[ccells[icell]], ofs[ccells[icell]+1], cpsi, spsi);
+            double cnpsi=cpsi, snpsi=spsi;
+            for (size_t l=1; l<=kmax; ++l)
               {
-              locks.v(b_theta,b_phi).unlock();
-              locks.v(b_theta,b_phi+1).unlock();
-              locks.v(b_theta+1,b_phi).unlock();
-              locks.v(b_theta+1,b_phi+1).unlock();
+              psiarr[2*l-1]=T(cnpsi);
+              psiarr[2*l]=T(snpsi);
+              const double tmp = snpsi*cpsi + cnpsi*spsi;
+              cnpsi=cnpsi*cpsi - snpsi*spsi;
+              snpsi=tmp;
               }
-            b_theta = b_theta_new;
-            b_phi = b_phi_new;
-            locks.v(b_theta,b_phi).lock();
-            locks.v(b_theta,b_phi+1).lock();
-            locks.v(b_theta+1,b_phi).lock();
-            locks.v(b_theta+1,b_phi+1).lock();
-            }
 #ifdef SIMD_INTERPOL
-          memcpy(reinterpret_cast<T *>(psiarr2.data()), psiarr.data(),
-            (2*kmax+1)*sizeof(T));
+            memcpy(reinterpret_cast<T *>(psiarr2.data()), psiarr.data(),
+              (2*kmax+1)*sizeof(T));
 #endif
-          if (ncomp==1)
-            {
+            if (ncomp==1)
+              {
 #ifndef SIMD_INTERPOL
-            T val = data(i,0);
-            for (size_t j=0; j<supp; ++j)
-              for (size_t k=0; k<supp; ++k)
-                for (size_t l=0; l<2*kmax+1; ++l)
-                  cube.v(i0+j,i1+k,0,l) += val*wt[j]*wp[k]*psiarr[l];
+              T val = data(i,0);
+              for (size_t j=0; j<supp; ++j)
+                for (size_t k=0; k<supp; ++k)
+                  for (size_t l=0; l<2*kmax+1; ++l)
+                    cube.v(i0-itheta0+j,i1+k,0,l) += val*wt[j]*wp[k]*psiarr[l];
 #else
-            native_simd<T> *p=&scube.v(i0,i1,0,0);
-            ptrdiff_t d0 = scube.stride(0);
-            ptrdiff_t d1 = scube.stride(1);
-            switch (nv)
-              {
+              csimd *p=&scube.v(i0-itheta0,i1,0,0);
+              ptrdiff_t d0 = scube.stride(0);
+              ptrdiff_t d1 = scube.stride(1);
+              switch (nv)
+                {
 #ifdef SPECIAL_CASING
-              case 1:
-                deinterpol_help0<1,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 2:
-                deinterpol_help0<2,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 3:
-                deinterpol_help0<3,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 4:
-                deinterpol_help0<4,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 5:
-                deinterpol_help0<5,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 6:
-                deinterpol_help0<6,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 7:
-                deinterpol_help0<7,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
+                case 1:
+                  deinterpol_help0<1,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 2:
+                  deinterpol_help0<2,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 3:
+                  deinterpol_help0<3,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 4:
+                  deinterpol_help0<4,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 5:
+                  deinterpol_help0<5,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 6:
+                  deinterpol_help0<6,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 7:
+                  deinterpol_help0<7,1>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
 #endif
-              default:
-                {
-                native_simd<T> val = data(i,0);
-                for (size_t j=0; j<supp; ++j, p+=d0)
+                default:
                   {
-                  auto p1=p;
-                  T wtj = wt[j];
-                  for (size_t k=0; k<supp; ++k, p1+=d1)
+                  native_simd<T> val = data(i,0);
+                  for (size_t j=0; j<supp; ++j, p+=d0)
                     {
-                    native_simd<T> tv = wtj*wp[k]*val;
-                    for (size_t l=0; l<nv; ++l)
-                      p1[l] += tv*psiarr2[l];
-                    } 
+                    auto p1=p;
+                    T wtj = wt[j];
+                    for (size_t k=0; k<supp; ++k, p1+=d1)
+                      {
+                      native_simd<T> tv = wtj*wp[k]*val;
+                      for (size_t l=0; l<nv; ++l)
+                        p1[l] += tv*psiarr2[l];
+                      } 
+                    }
                   }
                 }
-              }
 #endif
-            }
-          else // ncomp==3
-            {
+              }
+            else // ncomp==3
+              {
 #ifndef SIMD_INTERPOL
-            T v0=data(i,0), v1=data(i,1), v2=data(i,2);
-            for (size_t j=0; j<supp; ++j)
-              for (size_t k=0; k<supp; ++k)
-                {
-                T t0 = wt[j]*wp[k];
-                for (size_t l=0; l<2*kmax+1; ++l)
+              T v0=data(i,0), v1=data(i,1), v2=data(i,2);
+              for (size_t j=0; j<supp; ++j)
+                for (size_t k=0; k<supp; ++k)
                   {
-                  T tmp = t0*psiarr[l];
-                  cube.v(i0+j,i1+k,0,l) += v0*tmp;
-                  cube.v(i0+j,i1+k,1,l) += v1*tmp;
-                  cube.v(i0+j,i1+k,2,l) += v2*tmp;
+                  T t0 = wt[j]*wp[k];
+                  for (size_t l=0; l<2*kmax+1; ++l)
+                    {
+                    T tmp = t0*psiarr[l];
+                    cube.v(i0-itheta0+j,i1+k,0,l) += v0*tmp;
+                    cube.v(i0-itheta0+j,i1+k,1,l) += v1*tmp;
+                    cube.v(i0-itheta0+j,i1+k,2,l) += v2*tmp;
+                    }
                   }
-                }
 #else
-            native_simd<T> *p=&scube.v(i0,i1,0,0);
-            ptrdiff_t d0 = scube.stride(0);
-            ptrdiff_t d1 = scube.stride(1);
-            switch (nv)
-              {
+              csimd *p=&scube.v(i0-itheta0,i1,0,0);
+              ptrdiff_t d0 = scube.stride(0);
+              ptrdiff_t d1 = scube.stride(1);
+              switch (nv)
+                {
 #ifdef SPECIAL_CASING
-              case 1:
-                deinterpol_help0<1,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 2:
-                deinterpol_help0<2,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 3:
-                deinterpol_help0<3,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 4:
-                deinterpol_help0<4,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 5:
-                deinterpol_help0<5,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 6:
-                deinterpol_help0<6,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
-              case 7:
-                deinterpol_help0<7,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
-                break;
+                case 1:
+                  deinterpol_help0<1,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 2:
+                  deinterpol_help0<2,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 3:
+                  deinterpol_help0<3,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 4:
+                  deinterpol_help0<4,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 5:
+                  deinterpol_help0<5,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 6:
+                  deinterpol_help0<6,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
+                case 7:
+                  deinterpol_help0<7,3>(wt, wp, p, d0, d1, psiarr2.data(), data, i);
+                  break;
 #endif
-              default:
-                {
-                native_simd<T> v0=data(i,0), v1=data(i,1), v2=data(i,2);
-                ptrdiff_t d2 = scube.stride(2);
-                for (size_t j=0; j<supp; ++j, p+=d0)
+                default:
                   {
-                  auto p1=p;
-                  T wtj = wt[j];
-                  for (size_t k=0; k<supp; ++k, p1+=d1)
+                  native_simd<T> v0=data(i,0), v1=data(i,1), v2=data(i,2);
+                  ptrdiff_t d2 = scube.stride(2);
+                  for (size_t j=0; j<supp; ++j, p+=d0)
                     {
-                    native_simd<T> wtjwpk = wtj*wp[k];
-                    for (size_t l=0; l<nv; ++l)
+                    auto p1=p;
+                    T wtj = wt[j];
+                    for (size_t k=0; k<supp; ++k, p1+=d1)
                       {
-                      auto tmp = wtjwpk*psiarr2[l];
-                      p1[l] += v0*tmp;
-                      p1[l+d2] += v1*tmp;
-                      p1[l+2*d2] += v2*tmp;
+                      native_simd<T> wtjwpk = wtj*wp[k];
+                      for (size_t l=0; l<nv; ++l)
+                        {
+                        auto tmp = wtjwpk*psiarr2[l];
+                        p1[l] += v0*tmp;
+                        p1[l+d2] += v1*tmp;
+                        p1[l+2*d2] += v2*tmp;
+                        }
                       }
                     }
                   }
                 }
-              }
 #endif
+              }
             }
-          }
-        if (b_theta<locks.shape(0))  // unlock
-          {
-          locks.v(b_theta,b_phi).unlock();
-          locks.v(b_theta,b_phi+1).unlock();
-          locks.v(b_theta+1,b_phi).unlock();
-          locks.v(b_theta+1,b_phi+1).unlock();
-          }
-        });
+          });
       }
     void getSlm (const vector<Alm<complex<T>>> &blm, vector<Alm<complex<T>>> &slm)
       {
+      TraceScope trace("Interpolator::getSlm");
       MR_assert(adjoint, "can only be called in adjoint mode");
       MR_assert((blm.size()==ncomp) || (ncomp==1), "incorrect number of beam a_lm sets");
       MR_assert((slm.size()==ncomp) || (ncomp==1), "incorrect number of sky a_lm sets");
-      Alm<complex<T>> a1(lmax, lmax), a2(lmax,lmax);
-      auto ginfo = sharp_make_cc_geom_info(ntheta0,nphi0,0.,cube.stride(1),cube.stride(0));
-      auto ainfo = sharp_make_triangular_alm_info(lmax,lmax,1);
-
       // move stuff from border regions onto the main grid
       for (size_t i=0; i<cube.shape(0); ++i)
         for (size_t j=0; j<supp; ++j)
@@ -850,7 +1152,7 @@ template<typename T> class Interpolator
         for (size_t j=0, j2=nphi/2; j<nphi; ++j,++j2)
           for (size_t k=0; k<cube.shape(3); ++k)
             {
-            T fct = (((k+1)/2)&1) ? -1 : 1;
+            Tcube fct = (((k+1)/2)&1) ? -1 : 1;
             if (j2>=nphi) j2-=nphi;
             for (size_t l=0; l<cube.shape(2); ++l)
               {
@@ -859,70 +1161,18 @@ template<typename T> class Interpolator
               }
             }
 
-      // special treatment for poles
-      for (size_t j=0,j2=nphi/2; j<nphi/2; ++j,++j2)
-        for (size_t k=0; k<cube.shape(3); ++k)
-          for (size_t l=0; l<cube.shape(2); ++l)
-            {
-            T fct = (((k+1)/2)&1) ? -1 : 1;
-            if (j2>=nphi) j2-=nphi;
-            T tval = (cube(supp,j+supp,l,k) + fct*cube(supp,j2+supp,l,k));
-            cube.v(supp,j+supp,l,k) = tval;
-            cube.v(supp,j2+supp,l,k) = fct*tval;
-            tval = (cube(supp+ntheta-1,j+supp,l,k) + fct*cube(supp+ntheta-1,j2+supp,l,k));
-            cube.v(supp+ntheta-1,j+supp,l,k) = tval;
-            cube.v(supp+ntheta-1,j2+supp,l,k) = fct*tval;
-            }
-
-      vector<T>lnorm(lmax+1);
-      for (size_t i=0; i<=lmax; ++i)
-        lnorm[i]=T(std::sqrt(4*pi/(2*i+1.)));
-
       for (size_t j=0; j<blm.size(); ++j)
         slm[j].SetToZero();
 
       for (size_t icomp=0; icomp<ncomp; ++icomp)
         {
-        bool separate = ncomp>1;
-        {
-        auto m1 = cube.template subarray<2>({supp,supp,icomp,0},{ntheta,nphi,0,0});
-        decorrect(m1,0);
-        sharp_alm2map_adjoint(a1.Alms().vdata(), m1.data(), *ginfo, *ainfo, 0, nthreads);
-        for (size_t m=0; m<=lmax; ++m)
-          for (size_t l=m; l<=lmax; ++l)
-            if (separate)
-              slm[icomp](l,m) += conj(a1(l,m))*blm[icomp](l,0).real()*lnorm[l];
-            else
-              for (size_t j=0; j<blm.size(); ++j)
-                slm[j](l,m) += conj(a1(l,m))*blm[j](l,0).real()*lnorm[l];
-        }
+        auto m1 = getPlane(icomp, 0, true);
+        addPlanesToSlm(blm, slm, icomp, 0, m1, m1);
         for (size_t k=1; k<=kmax; ++k)
           {
-          auto m1 = cube.template subarray<2>({supp,supp,icomp,2*k-1},{ntheta,nphi,0,0});
-          auto m2 = cube.template subarray<2>({supp,supp,icomp,2*k  },{ntheta,nphi,0,0});
-          decorrect(m1,k);
-          decorrect(m2,k);
-
-          sharp_alm2map_spin_adjoint(k, a1.Alms().vdata(), a2.Alms().vdata(), m1.data(),
-            m2.data(), *ginfo, *ainfo, 0, nthreads);
-          for (size_t m=0; m<=lmax; ++m)
-            for (size_t l=m; l<=lmax; ++l)
-              if (l>=k)
-                {
-                if (separate)
-                  {
-                  auto tmp = conj(blm[icomp](l,k))*(-2*lnorm[l]);
-                  slm[icomp](l,m) += conj(a1(l,m))*tmp.real();
-                  slm[icomp](l,m) -= conj(a2(l,m))*tmp.imag();
-                  }
-                else
-                  for (size_t j=0; j<blm.size(); ++j)
-                    {
-                    auto tmp = conj(blm[j](l,k))*(-2*lnorm[l]);
-                    slm[j](l,m) += conj(a1(l,m))*tmp.real();
-                    slm[j](l,m) -= conj(a2(l,m))*tmp.imag();
-                    }
-                }
+          auto m1 = getPlane(icomp, 2*k-1, true);
+          auto m2 = getPlane(icomp, 2*k, true);
+          addPlanesToSlm(blm, slm, icomp, k, m1, m2);
           }
         }
       }
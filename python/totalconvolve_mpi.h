@@ -0,0 +1,458 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  Author: Martin Reinecke
+ */
+
+#ifndef DUCC0_INTERPOL_NG_MPI_H
+#define DUCC0_INTERPOL_NG_MPI_H
+
+/* Distributed version of Interpolator: every task stores only a band of
+   theta rows of the data cube (plus a halo of supp-1 rows), so the memory
+   for the cube is shared by all tasks.
+
+   Building the cube requires a global FFT along theta for every (theta, phi)
+   plane (see correct()), so the planes are not split among the tasks for the
+   SHT. Instead, the (component, beam index) pairs are distributed round-robin
+   over the tasks; every task computes full planes for its pairs, and the rows
+   of these planes are sent to the tasks owning them with one all-to-all
+   exchange per round. Only the planes of a single round are held in memory
+   at any time.
+
+   Pointings and values are routed to the task owning the theta row of their
+   kernel footprint, and the results are sent back to the caller. After
+   adjoint interpolation, the halo rows are added to the neighbouring task,
+   and the cube rows are collected plane by plane for the adjoint SHTs in
+   the same round-robin fashion. The resulting sky a_lm are summed over all
+   tasks, so they are available on every task. */
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "ducc0/infra/communication.h"
+#include "python/totalconvolve.h"
+
+namespace ducc0 {
+
+namespace detail_totalconvolve {
+
+using namespace std;
+
+template<typename T, typename Tcube=T> class Interpolator_mpi: public Interpolator<T,Tcube>
+  {
+  private:
+    using base = Interpolator<T,Tcube>;
+    using base::adjoint;
+    using base::lmax;
+    using base::kmax;
+    using base::nphi;
+    using base::ntheta;
+    using base::supp;
+    using base::ncomp;
+    using base::itheta0;
+    using base::cube;
+    using base::thetaBand;
+    using base::thetaRow;
+    using base::makePlanes;
+    using base::addPlanesToSlm;
+
+    Communicator comm;
+    size_t ntasks, rank;
+    vector<size_t> bandlo; // first cube row handled by every task, and the end
+
+    void setupBands()
+      {
+      bandlo.resize(ntasks+1);
+      for (size_t i=0; i<ntasks; ++i)
+        bandlo[i] = get<0>(thetaBand(ntasks, i));
+      bandlo[ntasks] = get<1>(thetaBand(ntasks, ntasks-1));
+      for (size_t i=0; i+1<ntasks; ++i)
+        MR_assert(bandlo[i+1]-bandlo[i]>=supp-1,
+          "theta bands too narrow; please use fewer tasks");
+      }
+
+    // number of cube rows stored by task i
+    size_t nrows(size_t i) const
+      { return bandlo[i+1]+supp-1-bandlo[i]; }
+    // number of cube rows owned by task i (i.e. not part of its halo)
+    size_t nowned(size_t i) const
+      { return (i+1==ntasks) ? nrows(i) : bandlo[i+1]-bandlo[i]; }
+
+    // the work units are the pairs (icomp, k), with k in [0; kmax]
+    size_t nunits() const { return ncomp*(kmax+1); }
+    static size_t nplanes(size_t k) { return (k==0) ? 1 : 2; }
+    static size_t planeIndex(size_t k, size_t j) { return (k==0) ? 0 : 2*k-1+j; }
+    static Tcube planeSign(size_t kk) { return (((kk+1)/2)&1) ? -1 : 1; }
+
+    /* Returns the row of a (theta, phi) plane providing the data for cube
+       row irow, and whether it has to be reflected across the pole (which
+       shifts it by pi in phi and applies the sign of the plane). */
+    tuple<size_t, bool> sourceRow(size_t irow) const
+      {
+      if (irow<supp) return make_tuple(supp-irow, true);
+      if (irow<supp+ntheta) return make_tuple(irow-supp, false);
+      return make_tuple(2*ntheta+supp-2-irow, true);
+      }
+
+    static vector<int> displacements(const vector<int> &cnt)
+      {
+      vector<int> res(cnt.size(), 0);
+      for (size_t i=1; i<cnt.size(); ++i)
+        res[i] = res[i-1]+cnt[i-1];
+      return res;
+      }
+    template<typename Tv> void exchange(const vector<Tv> &sendbuf,
+      const vector<int> &nsend, vector<Tv> &recvbuf,
+      const vector<int> &nrecv) const
+      {
+      auto dsend = displacements(nsend), drecv = displacements(nrecv);
+      recvbuf.resize(size_t(drecv[ntasks-1])+size_t(nrecv[ntasks-1]));
+      comm.all2allvRaw(sendbuf.data(), nsend.data(), dsend.data(),
+        recvbuf.data(), nrecv.data(), drecv.data());
+      }
+    static int checkedCount(size_t n)
+      {
+      MR_assert(n<=size_t(numeric_limits<int>::max()),
+        "message too large for MPI");
+      return int(n);
+      }
+
+    /* Determines the task owning every pointing. On exit, perm lists the
+       pointings ordered by task, nsend/nrecv contain the number of pointings
+       sent to/received from every task, and lptg holds the pointings
+       received by this task. */
+    void routePointings(const mav<T,2> &ptg, vector<size_t> &perm,
+      vector<int> &nsend, vector<int> &nrecv, vector<T> &lptg) const
+      {
+      MR_assert(ptg.shape(1)==3, "second dimension must have length 3");
+      size_t nptg = ptg.shape(0);
+      vector<size_t> dest(nptg);
+      vector<size_t> cnt(ntasks+1, 0);
+      for (size_t i=0; i<nptg; ++i)
+        {
+        auto pos = upper_bound(bandlo.begin(), bandlo.end()-1, thetaRow(ptg(i,0)));
+        MR_assert(pos!=bandlo.begin(), "pointing out of range");
+        dest[i] = size_t(pos-bandlo.begin())-1;
+        ++cnt[dest[i]+1];
+        }
+      for (size_t i=1; i<=ntasks; ++i)
+        cnt[i] += cnt[i-1];
+      perm.resize(nptg);
+      nsend.resize(ntasks);
+      for (size_t i=0; i<ntasks; ++i)
+        nsend[i] = checkedCount(cnt[i+1]-cnt[i]);
+      for (size_t i=0; i<nptg; ++i)
+        perm[cnt[dest[i]]++] = i;
+      nrecv.resize(ntasks);
+      comm.all2allRaw(nsend.data(), nrecv.data(), ntasks);
+
+      vector<T> sendbuf(3*nptg);
+      for (size_t i=0; i<nptg; ++i)
+        for (size_t j=0; j<3; ++j)
+          sendbuf[3*i+j] = ptg(perm[i],j);
+      exchange(sendbuf, scaled(nsend,3), lptg, scaled(nrecv,3));
+      }
+    static vector<int> scaled(const vector<int> &cnt, size_t fct)
+      {
+      vector<int> res(cnt.size());
+      for (size_t i=0; i<cnt.size(); ++i)
+        res[i] = checkedCount(cnt[i]*fct);
+      return res;
+      }
+
+    /* Adds the halo rows of every task to the corresponding rows of the
+       next task, which owns them. */
+    void reduceHalo()
+      {
+      size_t nhalo = supp-1;
+      size_t rowsize = size_t(cube.stride(0));
+      MR_assert(cube.stride(0)==ptrdiff_t(cube.shape(1)*cube.stride(1))
+        && cube.stride(1)==ptrdiff_t(cube.shape(2)*cube.stride(2))
+        && cube.stride(2)==ptrdiff_t(cube.shape(3)), "cube is not contiguous");
+      size_t nsend = (rank+1<ntasks) ? nhalo*rowsize : 0,
+             nrecv = (rank>0) ? nhalo*rowsize : 0;
+      vector<Tcube> buf(nrecv);
+      comm.sendrecvRaw(cube.data()+nowned(rank)*rowsize, nsend,
+        (rank+1)%ntasks, buf.data(), nrecv, (rank+ntasks-1)%ntasks);
+      auto *ptr = cube.vdata();
+      for (size_t i=0; i<nrecv; ++i)
+        ptr[i] += buf[i];
+      }
+
+    /* Computes the local band of the data cube from the sky and beam a_lm. */
+    void fillBands(const vector<Alm<complex<T>>> &slm,
+                   const vector<Alm<complex<T>>> &blm, bool separate)
+      {
+      MR_assert(slm.size()==blm.size(), "inconsistent slm and blm vectors");
+      for (size_t i=0; i<slm.size(); ++i)
+        {
+        MR_assert(slm[i].Lmax()==lmax, "inconsistent Sky lmax");
+        MR_assert(slm[i].Mmax()==lmax, "Sky lmax must be equal to Sky mmax");
+        MR_assert(blm[i].Lmax()==lmax, "Sky and beam lmax must be equal");
+        MR_assert(blm[i].Mmax()==kmax, "Inconcistent beam mmax");
+        }
+
+      mav<T,2> m1({ntheta,nphi}), m2({ntheta,nphi});
+      for (size_t u0=0; u0<nunits(); u0+=ntasks)
+        {
+        // compute the planes of this task's work unit
+        size_t myunit = u0+rank;
+        size_t mynpl = 0;
+        if (myunit<nunits())
+          {
+          size_t icomp=myunit/(kmax+1), k=myunit%(kmax+1);
+          makePlanes(slm, blm, separate, icomp, k, m1, m2);
+          mynpl = nplanes(k);
+          }
+
+        // send every task the plane rows for all rows of its band
+        vector<int> nsend(ntasks), nrecv(ntasks);
+        for (size_t i=0; i<ntasks; ++i)
+          {
+          nsend[i] = checkedCount(mynpl*nrows(i)*nphi);
+          nrecv[i] = (u0+i<nunits()) ?
+            checkedCount(nplanes((u0+i)%(kmax+1))*nrows(rank)*nphi) : 0;
+          }
+        vector<T> sendbuf(size_t(displacements(nsend)[ntasks-1])+size_t(nsend[ntasks-1])),
+                  recvbuf;
+        for (size_t i=0, ofs=0; i<ntasks; ++i)
+          for (size_t j=0; j<mynpl; ++j)
+            {
+            const auto &plane = (j==0) ? m1 : m2;
+            for (size_t irow=bandlo[i]; irow<bandlo[i]+nrows(i); ++irow)
+              {
+              size_t src = get<0>(sourceRow(irow));
+              for (size_t iphi=0; iphi<nphi; ++iphi)
+                sendbuf[ofs++] = plane(src,iphi);
+              }
+            }
+        exchange(sendbuf, nsend, recvbuf, nrecv);
+
+        // store the received rows in the local part of the cube
+        for (size_t i=0, ofs=0; i<ntasks; ++i)
+          {
+          if (u0+i>=nunits()) continue;
+          size_t icomp=(u0+i)/(kmax+1), k=(u0+i)%(kmax+1);
+          for (size_t j=0; j<nplanes(k); ++j)
+            {
+            size_t kk = planeIndex(k,j);
+            Tcube fct = planeSign(kk);
+            for (size_t irow=0; irow<nrows(rank); ++irow, ofs+=nphi)
+              {
+              bool flip = get<1>(sourceRow(itheta0+irow));
+              for (size_t iphi=0, iphi2=nphi-nphi/2; iphi<nphi; ++iphi, ++iphi2)
+                {
+                if (iphi2>=nphi) iphi2-=nphi;
+                cube.v(irow,iphi+supp,icomp,kk) = flip ?
+                  fct*Tcube(recvbuf[ofs+iphi2]) : Tcube(recvbuf[ofs+iphi]);
+                }
+              }
+            }
+          }
+        }
+
+      // fill border regions in phi
+      for (size_t i=0; i<cube.shape(0); ++i)
+        for (size_t j=0; j<supp; ++j)
+          for (size_t k=0; k<cube.shape(3); ++k)
+            for (size_t l=0; l<cube.shape(2); ++l)
+            {
+            cube.v(i,j,l,k) = cube(i,j+nphi,l,k);
+            cube.v(i,j+nphi+supp,l,k) = cube(i,j+supp,l,k);
+            }
+      }
+
+  public:
+    /* Parameters as for the corresponding Interpolator constructor; all
+       tasks of comm must pass identical arguments. */
+    Interpolator_mpi(const vector<Alm<complex<T>>> &slm,
+                     const vector<Alm<complex<T>>> &blm,
+                     bool separate, T epsilon, T ofmin, int nthreads_,
+                     const Communicator &comm_)
+      : base(false, slm.at(0).Lmax(), blm.at(0).Mmax(),
+          separate ? slm.size() : 1, epsilon, ofmin, nthreads_,
+          size_t(comm_.num_ranks()), size_t(comm_.rank())),
+        comm(comm_), ntasks(size_t(comm.num_ranks())), rank(size_t(comm.rank()))
+      {
+      setupBands();
+      fillBands(slm, blm, separate);
+      }
+
+    /* Parameters as for the corresponding Interpolator constructor; all
+       tasks of comm must pass identical arguments. */
+    Interpolator_mpi(size_t lmax_, size_t kmax_, size_t ncomp_, T epsilon,
+      T ofmin, int nthreads_, const Communicator &comm_)
+      : base(true, lmax_, kmax_, ncomp_, epsilon, ofmin, nthreads_,
+          size_t(comm_.num_ranks()), size_t(comm_.rank())),
+        comm(comm_), ntasks(size_t(comm.num_ranks())), rank(size_t(comm.rank()))
+      { setupBands(); }
+
+    /* Parameters as for Interpolator::update_slm(); all tasks of comm must
+       pass identical arguments. */
+    void update_slm(const vector<Alm<complex<T>>> &slm,
+                    const vector<Alm<complex<T>>> &blm, bool separate)
+      {
+      MR_assert(!adjoint, "cannot be called in adjoint mode");
+      MR_assert((separate ? slm.size() : 1)==ncomp,
+        "number of components must not change");
+      MR_assert((slm.at(0).Lmax()==lmax) && (blm.at(0).Mmax()==kmax),
+        "lmax and kmax must not change");
+      fillBands(slm, blm, separate);
+      }
+
+    /* Every task passes an arbitrary subset of the pointings and obtains
+       the interpolated values for exactly these pointings. */
+    void interpol (const mav<T,2> &ptg, mav<T,2> &res) const
+      {
+      MR_assert(!adjoint, "cannot be called in adjoint mode");
+      MR_assert(ptg.shape(0)==res.shape(0), "dimension mismatch");
+      MR_assert(res.shape(1)==ncomp, "# of components mismatch");
+      vector<size_t> perm;
+      vector<int> nsend, nrecv;
+      vector<T> lptg;
+      routePointings(ptg, perm, nsend, nrecv, lptg);
+      size_t nloc = lptg.size()/3;
+      mav<T,2> lptg2(lptg.data(), {nloc,3});
+      mav<T,2> lres({nloc,ncomp});
+      base::interpol(lptg2, lres);
+
+      vector<T> sendbuf(lres.data(), lres.data()+nloc*ncomp), recvbuf;
+      exchange(sendbuf, scaled(nrecv,ncomp), recvbuf, scaled(nsend,ncomp));
+      for (size_t i=0; i<perm.size(); ++i)
+        for (size_t j=0; j<ncomp; ++j)
+          res.v(perm[i],j) = recvbuf[i*ncomp+j];
+      }
+
+    /* Every task passes an arbitrary subset of the pointings and values. */
+    void deinterpol (const mav<T,2> &ptg, const mav<T,2> &data)
+      {
+      MR_assert(adjoint, "can only be called in adjoint mode");
+      MR_assert(ptg.shape(0)==data.shape(0), "dimension mismatch");
+      MR_assert(data.shape(1)==ncomp, "# of components mismatch");
+      vector<size_t> perm;
+      vector<int> nsend, nrecv;
+      vector<T> lptg;
+      routePointings(ptg, perm, nsend, nrecv, lptg);
+      size_t nloc = lptg.size()/3;
+
+      vector<T> sendbuf(perm.size()*ncomp), recvbuf;
+      for (size_t i=0; i<perm.size(); ++i)
+        for (size_t j=0; j<ncomp; ++j)
+          sendbuf[i*ncomp+j] = data(perm[i],j);
+      exchange(sendbuf, scaled(nsend,ncomp), recvbuf, scaled(nrecv,ncomp));
+      mav<T,2> lptg2(lptg.data(), {nloc,3});
+      mav<T,2> ldata(recvbuf.data(), {nloc,ncomp});
+      base::deinterpol(lptg2, ldata);
+      }
+
+    /* Parameters as for Interpolator::getSlm(); blm must be identical on
+       all tasks, and on exit slm contains the full result on every task. */
+    void getSlm (const vector<Alm<complex<T>>> &blm, vector<Alm<complex<T>>> &slm)
+      {
+      MR_assert(adjoint, "can only be called in adjoint mode");
+      MR_assert((blm.size()==ncomp) || (ncomp==1), "incorrect number of beam a_lm sets");
+      MR_assert((slm.size()==ncomp) || (ncomp==1), "incorrect number of sky a_lm sets");
+      reduceHalo();
+
+      // move stuff from border regions in phi onto the main grid
+      for (size_t i=0; i<nowned(rank); ++i)
+        for (size_t j=0; j<supp; ++j)
+          for (size_t k=0; k<cube.shape(3); ++k)
+            for (size_t l=0; l<cube.shape(2); ++l)
+              {
+              cube.v(i,j+nphi,l,k) += cube(i,j,l,k);
+              cube.v(i,j+supp,l,k) += cube(i,j+nphi+supp,l,k);
+              }
+
+      for (size_t j=0; j<slm.size(); ++j)
+        slm[j].SetToZero();
+
+      mav<T,2> m1({ntheta,nphi}), m2({ntheta,nphi});
+      for (size_t u0=0; u0<nunits(); u0+=ntasks)
+        {
+        // send the owned rows of every plane to the task processing it
+        vector<int> nsend(ntasks), nrecv(ntasks);
+        for (size_t i=0; i<ntasks; ++i)
+          {
+          nsend[i] = (u0+i<nunits()) ?
+            checkedCount(nplanes((u0+i)%(kmax+1))*nowned(rank)*nphi) : 0;
+          nrecv[i] = (u0+rank<nunits()) ?
+            checkedCount(nplanes((u0+rank)%(kmax+1))*nowned(i)*nphi) : 0;
+          }
+        vector<T> sendbuf(size_t(displacements(nsend)[ntasks-1])+size_t(nsend[ntasks-1])),
+                  recvbuf;
+        for (size_t i=0, ofs=0; i<ntasks; ++i)
+          {
+          if (u0+i>=nunits()) continue;
+          size_t icomp=(u0+i)/(kmax+1), k=(u0+i)%(kmax+1);
+          for (size_t j=0; j<nplanes(k); ++j)
+            for (size_t irow=0; irow<nowned(rank); ++irow)
+              for (size_t iphi=0; iphi<nphi; ++iphi)
+                sendbuf[ofs++] = T(cube(irow,iphi+supp,icomp,planeIndex(k,j)));
+          }
+        exchange(sendbuf, nsend, recvbuf, nrecv);
+
+        size_t myunit = u0+rank;
+        if (myunit>=nunits()) continue;
+        size_t icomp=myunit/(kmax+1), k=myunit%(kmax+1);
+        m1.fill(0);
+        m2.fill(0);
+        for (size_t i=0, ofs=0; i<ntasks; ++i)
+          for (size_t j=0; j<nplanes(k); ++j)
+            {
+            auto &plane = (j==0) ? m1 : m2;
+            T fct = T(planeSign(planeIndex(k,j)));
+            for (size_t irow=bandlo[i]; irow<bandlo[i]+nowned(i); ++irow, ofs+=nphi)
+              {
+              auto [dst, flip] = sourceRow(irow);
+              for (size_t iphi=0, iphi2=nphi-nphi/2; iphi<nphi; ++iphi, ++iphi2)
+                {
+                if (iphi2>=nphi) iphi2-=nphi;
+                if (flip)
+                  plane.v(dst,iphi2) += fct*recvbuf[ofs+iphi];
+                else
+                  plane.v(dst,iphi) += recvbuf[ofs+iphi];
+                }
+              }
+            }
+        addPlanesToSlm(blm, slm, icomp, k, m1, m2);
+        }
+
+      // sum the contributions of all tasks
+      for (size_t j=0; j<slm.size(); ++j)
+        {
+        auto &alms = slm[j].Alms();
+        vector<complex<T>> tmp(alms.size()), sum(alms.size());
+        for (size_t i=0; i<alms.size(); ++i)
+          tmp[i] = alms(i);
+        comm.allreduceRaw(reinterpret_cast<const T *>(tmp.data()),
+          reinterpret_cast<T *>(sum.data()), 2*tmp.size(), Communicator::Sum);
+        for (size_t i=0; i<alms.size(); ++i)
+          alms.v(i) = sum[i];
+        }
+      }
+  };
+
+}
+
+using detail_totalconvolve::Interpolator_mpi;
+
+}
+
+#endif
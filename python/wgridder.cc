@@ -34,13 +34,81 @@ namespace py = pybind11;
 
 auto None = py::none();
 
-template<typename T> py::array ms2dirty2(const py::array &uvw_,
+/* Converts the "mask" argument of ms2dirty() and dirty2ms() into channel runs.
+   Besides None and a dense array of shape (nrow, nchan), a tuple
+   (row_start, chan_begin, chan_end) of int64 arrays is accepted, which lists
+   the active channel ranges [chan_begin[i]; chan_end[i]) of row irow at the
+   indices row_start[irow] to row_start[irow+1]-1. */
+ChannelRuns get_runs(const py::object &mask_, size_t nrow, size_t nchan,
+  size_t nthreads)
+  {
+  if (mask_.is_none())
+    return ChannelRuns(nrow, nchan);
+  if (py::isinstance<py::tuple>(mask_))
+    {
+    auto tup = mask_.cast<py::tuple>();
+    MR_assert(tup.size()==3, "mask tuple must have 3 entries");
+    auto rs = to_mav<int64_t,1>(tup[0].cast<py::array>(), false);
+    auto cb = to_mav<int64_t,1>(tup[1].cast<py::array>(), false);
+    auto ce = to_mav<int64_t,1>(tup[2].cast<py::array>(), false);
+    MR_assert(rs.shape(0)==nrow+1, "row_start must have nrow+1 entries");
+    MR_assert((cb.shape(0)==ce.shape(0)) && (int64_t(cb.shape(0))==rs(nrow)),
+      "inconsistent channel run arrays");
+    vector<size_t> rowofs(nrow+1);
+    for (size_t i=0; i<=nrow; ++i)
+      {
+      MR_assert(rs(i)>=0, "negative row offset");
+      rowofs[i] = size_t(rs(i));
+      }
+    // out-of-range values are clipped to nchan+1, which ChannelRuns rejects
+    vector<detail_gridder::idx_t> lo(cb.shape(0)), hi(ce.shape(0));
+    for (size_t i=0; i<lo.size(); ++i)
+      {
+      MR_assert((cb(i)>=0) && (ce(i)>=0), "negative channel index");
+      lo[i] = detail_gridder::idx_t(min<int64_t>(cb(i), nchan+1));
+      hi[i] = detail_gridder::idx_t(min<int64_t>(ce(i), nchan+1));
+      }
+    return ChannelRuns(nchan, move(rowofs), move(lo), move(hi));
+    }
+  auto mask = to_mav<uint8_t,2>(mask_.cast<py::array>(), false);
+  MR_assert((mask.shape(0)==nrow) && (mask.shape(1)==nchan),
+    "mask has wrong shape");
+  return ChannelRuns(mask, nthreads);
+  }
+
+template<typename T, typename Tacc, typename Tuvw> py::array ms2dirty2(const py::array &uvw_,
   const py::array &freq_, const py::array &ms_, const py::object &wgt_, const py::object &mask_,
   size_t npix_x, size_t npix_y, double pixsize_x, double pixsize_y, size_t nu,
   size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
-  size_t verbosity)
+  size_t verbosity, double wplane_mem)
+  {
+  auto uvw = to_mav<Tuvw,2>(uvw_, false);
+  auto freq = to_mav<double,1>(freq_, false);
+  auto ms = to_mav<complex<T>,2>(ms_, false);
+  auto wgt = get_optional_const_Pyarr<T>(wgt_, {ms.shape(0),ms.shape(1)});
+  auto wgt2 = to_mav<T,2>(wgt, false);
+  auto runs = get_runs(mask_, uvw.shape(0), freq.shape(0), nthreads);
+  auto dirty = make_Pyarr<T>({npix_x,npix_y});
+  auto dirty2 = to_mav<T,2>(dirty, true);
+  {
+  py::gil_scoped_release release;
+  ms2dirty<T,Tacc>(uvw,freq,ms,wgt2,runs,pixsize_x,pixsize_y,nu,nv,epsilon,
+    do_wgridding,nthreads,dirty2,verbosity,false,true,wplane_mem);
+  }
+  return move(dirty);
+  }
+template<typename T> py::array ms2dirty_smeared2(const py::array &uvw_,
+  const py::object &duvw_, const py::object &chan_width_,
+  const py::array &freq_, const py::array &ms_, const py::object &wgt_, const py::object &mask_,
+  size_t npix_x, size_t npix_y, double pixsize_x, double pixsize_y, size_t nu,
+  size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  size_t verbosity, double wplane_mem)
   {
   auto uvw = to_mav<double,2>(uvw_, false);
+  auto duvw = get_optional_const_Pyarr<double>(duvw_, {uvw.shape(0),3});
+  auto duvw2 = to_mav<double,2>(duvw, false);
+  auto chan_width = get_optional_const_Pyarr<double>(chan_width_, {uvw.shape(0)});
+  auto chan_width2 = to_mav<double,1>(chan_width, false);
   auto freq = to_mav<double,1>(freq_, false);
   auto ms = to_mav<complex<T>,2>(ms_, false);
   auto wgt = get_optional_const_Pyarr<T>(wgt_, {ms.shape(0),ms.shape(1)});
@@ -51,23 +119,62 @@ template<typename T> py::array ms2dirty2(const py::array &uvw_,
   auto dirty2 = to_mav<T,2>(dirty, true);
   {
   py::gil_scoped_release release;
-  ms2dirty(uvw,freq,ms,wgt2,mask2,pixsize_x,pixsize_y,nu,nv,epsilon,
-    do_wgridding,nthreads,dirty2,verbosity);
+  ms2dirty_smeared(uvw,duvw2,chan_width2,freq,ms,wgt2,mask2,pixsize_x,
+    pixsize_y,nu,nv,epsilon,do_wgridding,nthreads,dirty2,verbosity,false,true,
+    wplane_mem);
   }
   return move(dirty);
   }
+template<typename T, typename Tacc> py::array ms2dirty_uvw(const py::array &uvw,
+  const py::array &freq, const py::array &ms, const py::object &wgt, const py::object &mask,
+  size_t npix_x, size_t npix_y, double pixsize_x, double pixsize_y, size_t nu,
+  size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  size_t verbosity, double wplane_mem)
+  {
+  if (isPyarr<float>(uvw))
+    return ms2dirty2<T,Tacc,float>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
+  return ms2dirty2<T,Tacc,double>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
+    pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+    wplane_mem);
+  }
 py::array Pyms2dirty(const py::array &uvw,
   const py::array &freq, const py::array &ms, const py::object &wgt,
   size_t npix_x, size_t npix_y, double pixsize_x, double pixsize_y, size_t nu,
   size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
-  size_t verbosity, const py::object &mask)
+  size_t verbosity, const py::object &mask,
+  double wplane_mem, bool double_precision_accumulation,
+  const py::object &duvw, const py::object &chan_width)
   {
+  if (!(duvw.is_none() && chan_width.is_none()))
+    {
+    MR_assert(!double_precision_accumulation,
+      "smearing is not supported with double_precision_accumulation");
+    MR_assert(!py::isinstance<py::tuple>(mask),
+      "smearing requires the mask as an array");
+    if (isPyarr<complex<float>>(ms))
+      return ms2dirty_smeared2<float>(uvw, duvw, chan_width, freq, ms, wgt,
+        mask, npix_x, npix_y, pixsize_x, pixsize_y, nu, nv, epsilon,
+        do_wgridding, nthreads, verbosity, wplane_mem);
+    if (isPyarr<complex<double>>(ms))
+      return ms2dirty_smeared2<double>(uvw, duvw, chan_width, freq, ms, wgt,
+        mask, npix_x, npix_y, pixsize_x, pixsize_y, nu, nv, epsilon,
+        do_wgridding, nthreads, verbosity, wplane_mem);
+    MR_fail("type matching failed: 'ms' has neither type 'c8' nor 'c16'");
+    }
   if (isPyarr<complex<float>>(ms))
-    return ms2dirty2<float>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
-      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity);
+    return double_precision_accumulation ?
+      ms2dirty_uvw<float,double>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
+        pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem) :
+      ms2dirty_uvw<float,float>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
+        pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem);
   if (isPyarr<complex<double>>(ms))
-    return ms2dirty2<double>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
-      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity);
+    return ms2dirty_uvw<double,double>(uvw, freq, ms, wgt, mask, npix_x, npix_y,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
   MR_fail("type matching failed: 'ms' has neither type 'c8' nor 'c16'");
   }
 constexpr auto ms2dirty_DS = R"""(
@@ -75,14 +182,14 @@ Converts an MS object to dirty image.
 
 Parameters
 ==========
-uvw: np.array((nrows, 3), dtype=np.float64)
+uvw: np.array((nrows, 3), dtype=np.float32 or np.float64)
     UVW coordinates from the measurement set
 freq: np.array((nchan,), dtype=np.float64)
     channel frequencies
 ms: np.array((nrows, nchan,), dtype=np.complex64 or np.complex128)
     the input measurement set data.
     Its data type determines the precision in which the calculation is carried
-    out.
+    out (but see `double_precision_accumulation`).
 wgt: np.array((nrows, nchan), float with same precision as `ms`), optional
     If present, its values are multiplied to the output
 npix_x, npix_y: int
@@ -110,8 +217,38 @@ verbosity: int
     0: no output
     1: some output
     2: detailed output
-mask: np.array((nrows, nchan), dtype=np.uint8), optional
-    If present, only visibilities are processed for which mask!=0
+mask: np.array((nrows, nchan), dtype=np.uint8) or tuple of 3 np.arrays, optional
+    If present, only visibilities are processed for which mask!=0.
+    For sparse selections the mask can also be given as a tuple
+    (row_start, chan_begin, chan_end) of np.int64 arrays: the visibilities of
+    row i with chan_begin[j] <= channel < chan_end[j] are processed for
+    row_start[i] <= j < row_start[i+1]; row_start has nrows+1 entries, the
+    ranges of a row must be ascending and must not overlap. The tuple form
+    cannot be combined with smearing.
+wplane_mem: float
+    memory (in bytes) which may be used for the uv grids of w planes when
+    `do_wstacking` is True. If it allows more than one grid, batches of up to
+    `nthreads` w planes are processed together, and their FFTs are run
+    concurrently; this improves scaling for small images with many w planes.
+double_precision_accumulation: bool
+    only relevant if `ms` has type np.complex64. If True, the kernel is
+    still evaluated in single precision, but the uv grid, the FFTs and the
+    image corrections are done in double precision. This reduces the
+    rounding errors of large grids at the cost of twice the grid memory.
+duvw: np.array((nrows, 3), dtype=np.float64), optional
+    change of the UVW coordinates of every row during its integration time
+    (time smearing of averaged visibilities)
+chan_width: np.array((nrows,), dtype=np.float64), optional
+    width (in Hz) of the channels of every row (frequency smearing).
+    A width of 0 means that the row is not smeared in frequency; redundant
+    rows can be excluded via `mask` or `wgt`.
+    If `duvw` or `chan_width` is given, every visibility is treated as the
+    mean of the visibility function over the region of the uv plane covered
+    during its integration. Internally, it is gridded as a set of weighted
+    sub-samples (as many as needed for the requested accuracy), so that
+    averaged data can be imaged without expanding them. uvw must have type
+    np.float64 in this case, and `double_precision_accumulation` is not
+    supported.
 
 Returns
 =======
@@ -119,12 +256,37 @@ np.array((nxdirty, nydirty), dtype=float of same precision as `ms`)
     the dirty image
 )""";
 
-template<typename T> py::array dirty2ms2(const py::array &uvw_,
+template<typename T, typename Tacc, typename Tuvw> py::array dirty2ms2(const py::array &uvw_,
+  const py::array &freq_, const py::array &dirty_, const py::object &wgt_, const py::object &mask_,
+  double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  bool do_wgridding, size_t nthreads, size_t verbosity, double wplane_mem)
+  {
+  auto uvw = to_mav<Tuvw,2>(uvw_, false);
+  auto freq = to_mav<double,1>(freq_, false);
+  auto dirty = to_mav<T,2>(dirty_, false);
+  auto wgt = get_optional_const_Pyarr<T>(wgt_, {uvw.shape(0),freq.shape(0)});
+  auto wgt2 = to_mav<T,2>(wgt, false);
+  auto runs = get_runs(mask_, uvw.shape(0), freq.shape(0), nthreads);
+  auto ms = make_Pyarr<complex<T>>({uvw.shape(0),freq.shape(0)});
+  auto ms2 = to_mav<complex<T>,2>(ms, true);
+  {
+  py::gil_scoped_release release;
+  dirty2ms<T,Tacc>(uvw,freq,dirty,wgt2,runs,pixsize_x,pixsize_y,nu,nv,epsilon,
+    do_wgridding,nthreads,ms2,verbosity,false,true,wplane_mem);
+  }
+  return move(ms);
+  }
+template<typename T> py::array dirty2ms_smeared2(const py::array &uvw_,
+  const py::object &duvw_, const py::object &chan_width_,
   const py::array &freq_, const py::array &dirty_, const py::object &wgt_, const py::object &mask_,
   double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
-  bool do_wgridding, size_t nthreads, size_t verbosity)
+  bool do_wgridding, size_t nthreads, size_t verbosity, double wplane_mem)
   {
   auto uvw = to_mav<double,2>(uvw_, false);
+  auto duvw = get_optional_const_Pyarr<double>(duvw_, {uvw.shape(0),3});
+  auto duvw2 = to_mav<double,2>(duvw, false);
+  auto chan_width = get_optional_const_Pyarr<double>(chan_width_, {uvw.shape(0)});
+  auto chan_width2 = to_mav<double,1>(chan_width, false);
   auto freq = to_mav<double,1>(freq_, false);
   auto dirty = to_mav<T,2>(dirty_, false);
   auto wgt = get_optional_const_Pyarr<T>(wgt_, {uvw.shape(0),freq.shape(0)});
@@ -135,22 +297,60 @@ template<typename T> py::array dirty2ms2(const py::array &uvw_,
   auto ms2 = to_mav<complex<T>,2>(ms, true);
   {
   py::gil_scoped_release release;
-  dirty2ms(uvw,freq,dirty,wgt2,mask2,pixsize_x,pixsize_y,nu,nv,epsilon,
-    do_wgridding,nthreads,ms2,verbosity);
+  dirty2ms_smeared(uvw,duvw2,chan_width2,freq,dirty,wgt2,mask2,pixsize_x,
+    pixsize_y,nu,nv,epsilon,do_wgridding,nthreads,ms2,verbosity,false,true,
+    wplane_mem);
   }
   return move(ms);
   }
+template<typename T, typename Tacc> py::array dirty2ms_uvw(const py::array &uvw,
+  const py::array &freq, const py::array &dirty, const py::object &wgt, const py::object &mask,
+  double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
+  bool do_wgridding, size_t nthreads, size_t verbosity, double wplane_mem)
+  {
+  if (isPyarr<float>(uvw))
+    return dirty2ms2<T,Tacc,float>(uvw, freq, dirty, wgt, mask,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
+  return dirty2ms2<T,Tacc,double>(uvw, freq, dirty, wgt, mask,
+    pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+    wplane_mem);
+  }
 py::array Pydirty2ms(const py::array &uvw,
   const py::array &freq, const py::array &dirty, const py::object &wgt,
   double pixsize_x, double pixsize_y, size_t nu, size_t nv, double epsilon,
-  bool do_wgridding, size_t nthreads, size_t verbosity, const py::object &mask)
+  bool do_wgridding, size_t nthreads, size_t verbosity, const py::object &mask,
+  double wplane_mem, bool double_precision_accumulation,
+  const py::object &duvw, const py::object &chan_width)
   {
+  if (!(duvw.is_none() && chan_width.is_none()))
+    {
+    MR_assert(!double_precision_accumulation,
+      "smearing is not supported with double_precision_accumulation");
+    MR_assert(!py::isinstance<py::tuple>(mask),
+      "smearing requires the mask as an array");
+    if (isPyarr<float>(dirty))
+      return dirty2ms_smeared2<float>(uvw, duvw, chan_width, freq, dirty, wgt,
+        mask, pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem);
+    if (isPyarr<double>(dirty))
+      return dirty2ms_smeared2<double>(uvw, duvw, chan_width, freq, dirty, wgt,
+        mask, pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem);
+    MR_fail("type matching failed: 'dirty' has neither type 'f4' nor 'f8'");
+    }
   if (isPyarr<float>(dirty))
-    return dirty2ms2<float>(uvw, freq, dirty, wgt, mask,
-      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity);
+    return double_precision_accumulation ?
+      dirty2ms_uvw<float,double>(uvw, freq, dirty, wgt, mask,
+        pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem) :
+      dirty2ms_uvw<float,float>(uvw, freq, dirty, wgt, mask,
+        pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, wplane_mem);
   if (isPyarr<double>(dirty))
-    return dirty2ms2<double>(uvw, freq, dirty, wgt, mask,
-      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity);
+    return dirty2ms_uvw<double,double>(uvw, freq, dirty, wgt, mask,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
   MR_fail("type matching failed: 'dirty' has neither type 'f4' nor 'f8'");
   }
 constexpr auto dirty2ms_DS = R"""(
@@ -158,14 +358,14 @@ Converts a dirty image to an MS object.
 
 Parameters
 ==========
-uvw: np.array((nrows, 3), dtype=np.float64)
+uvw: np.array((nrows, 3), dtype=np.float32 or np.float64)
     UVW coordinates from the measurement set
 freq: np.array((nchan,), dtype=np.float64)
     channel frequencies
 dirty: np.array((nxdirty, nydirty), dtype=np.float32 or np.float64)
     dirty image
     Its data type determines the precision in which the calculation is carried
-    out.
+    out (but see `double_precision_accumulation`).
 wgt: np.array((nrows, nchan), same dtype as `dirty`), optional
     If present, its values are multiplied to the output
 pixsize_x, pixsize_y: float
@@ -191,8 +391,359 @@ verbosity: int
     0: no output
     1: some output
     2: detailed output
+mask: np.array((nrows, nchan), dtype=np.uint8) or tuple of 3 np.arrays, optional
+    If present, only visibilities are processed for which mask!=0.
+    For sparse selections the mask can also be given as a tuple
+    (row_start, chan_begin, chan_end) of np.int64 arrays: the visibilities of
+    row i with chan_begin[j] <= channel < chan_end[j] are processed for
+    row_start[i] <= j < row_start[i+1]; row_start has nrows+1 entries, the
+    ranges of a row must be ascending and must not overlap. The tuple form
+    cannot be combined with smearing.
+wplane_mem: float
+    memory (in bytes) which may be used for the uv grids of w planes when
+    `do_wstacking` is True. If it allows more than one grid, batches of up to
+    `nthreads` w planes are processed together, and their FFTs are run
+    concurrently; this improves scaling for small images with many w planes.
+double_precision_accumulation: bool
+    only relevant if `dirty` has type np.float32; see `ms2dirty`.
+duvw, chan_width: np.array, optional
+    smearing of averaged visibilities; see `ms2dirty`
+
+Returns
+=======
+np.array((nrows, nchan,), dtype=complex of same precision as `dirty`)
+    the measurement set data.
+)""";
+
+mav<size_t,1> get_chan_group(const py::array &chan_group_, size_t nchan,
+  size_t &ngroups)
+  {
+  auto cg = to_mav<int64_t,1>(chan_group_, false);
+  MR_assert(cg.shape(0)==nchan, "chan_group must have nchan entries");
+  mav<size_t,1> res({nchan});
+  ngroups = 0;
+  for (size_t i=0; i<nchan; ++i)
+    {
+    MR_assert(cg(i)>=0, "channel groups must be non-negative");
+    res.v(i) = size_t(cg(i));
+    ngroups = max(ngroups, res(i)+1);
+    }
+  return res;
+  }
+
+template<typename T> py::array ms2dirty_cube2(const py::array &uvw_,
+  const py::array &freq_, const py::array &ms_, const py::array &chan_group_,
+  const py::object &wgt_, const py::object &mask_, size_t npix_x,
+  size_t npix_y, double pixsize_x, double pixsize_y, size_t nu, size_t nv,
+  double epsilon, bool do_wgridding, size_t nthreads, size_t verbosity,
+  double wplane_mem)
+  {
+  auto uvw = to_mav<double,2>(uvw_, false);
+  auto freq = to_mav<double,1>(freq_, false);
+  auto ms = to_mav<complex<T>,2>(ms_, false);
+  size_t ngroups;
+  auto chan_group = get_chan_group(chan_group_, freq.shape(0), ngroups);
+  auto wgt = get_optional_const_Pyarr<T>(wgt_, {ms.shape(0),ms.shape(1)});
+  auto wgt2 = to_mav<T,2>(wgt, false);
+  auto mask = get_optional_const_Pyarr<uint8_t>(mask_, {uvw.shape(0),freq.shape(0)});
+  auto mask2 = to_mav<uint8_t,2>(mask, false);
+  auto dirty = make_Pyarr<T>({ngroups,npix_x,npix_y});
+  auto dirty2 = to_mav<T,3>(dirty, true);
+  {
+  py::gil_scoped_release release;
+  ms2dirty_cube(uvw,freq,ms,wgt2,mask2,chan_group,pixsize_x,pixsize_y,nu,nv,
+    epsilon,do_wgridding,nthreads,dirty2,verbosity,false,true,wplane_mem);
+  }
+  return move(dirty);
+  }
+py::array Pyms2dirty_cube(const py::array &uvw,
+  const py::array &freq, const py::array &ms, const py::array &chan_group,
+  const py::object &wgt, size_t npix_x, size_t npix_y, double pixsize_x,
+  double pixsize_y, size_t nu, size_t nv, double epsilon, bool do_wgridding,
+  size_t nthreads, size_t verbosity, const py::object &mask,
+  double wplane_mem)
+  {
+  if (isPyarr<complex<float>>(ms))
+    return ms2dirty_cube2<float>(uvw, freq, ms, chan_group, wgt, mask, npix_x,
+      npix_y, pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+      verbosity, wplane_mem);
+  if (isPyarr<complex<double>>(ms))
+    return ms2dirty_cube2<double>(uvw, freq, ms, chan_group, wgt, mask, npix_x,
+      npix_y, pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+      verbosity, wplane_mem);
+  MR_fail("type matching failed: 'ms' has neither type 'c8' nor 'c16'");
+  }
+constexpr auto ms2dirty_cube_DS = R"""(
+Converts an MS object to an image cube, with the channels of each channel
+group going into a separate image.
+
+This is equivalent to calling `ms2dirty` once per channel group with an
+appropriate mask, but the data are scanned and sorted only once.
+
+Parameters
+==========
+uvw, freq, ms, wgt, npix_x, npix_y, pixsize_x, pixsize_y, nu, nv, epsilon,
+do_wstacking, nthreads, verbosity, mask, wplane_mem:
+    see `ms2dirty`
+chan_group: np.array((nchan,), dtype=np.int64)
+    the index of the output image for every channel. The number of images
+    is `max(chan_group)+1`.
+
+Returns
+=======
+np.array((ngroups, nxdirty, nydirty), dtype=float of same precision as `ms`)
+    the dirty images
+)""";
+
+template<typename T> py::array dirty2ms_cube2(const py::array &uvw_,
+  const py::array &freq_, const py::array &dirty_,
+  const py::array &chan_group_, const py::object &wgt_,
+  const py::object &mask_, double pixsize_x, double pixsize_y, size_t nu,
+  size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  size_t verbosity, double wplane_mem)
+  {
+  auto uvw = to_mav<double,2>(uvw_, false);
+  auto freq = to_mav<double,1>(freq_, false);
+  auto dirty = to_mav<T,3>(dirty_, false);
+  size_t ngroups;
+  auto chan_group = get_chan_group(chan_group_, freq.shape(0), ngroups);
+  MR_assert(ngroups<=dirty.shape(0), "not enough images in the cube");
+  auto wgt = get_optional_const_Pyarr<T>(wgt_, {uvw.shape(0),freq.shape(0)});
+  auto wgt2 = to_mav<T,2>(wgt, false);
+  auto mask = get_optional_const_Pyarr<uint8_t>(mask_, {uvw.shape(0),freq.shape(0)});
+  auto mask2 = to_mav<uint8_t,2>(mask, false);
+  auto ms = make_Pyarr<complex<T>>({uvw.shape(0),freq.shape(0)});
+  auto ms2 = to_mav<complex<T>,2>(ms, true);
+  {
+  py::gil_scoped_release release;
+  dirty2ms_cube(uvw,freq,dirty,wgt2,mask2,chan_group,pixsize_x,pixsize_y,nu,
+    nv,epsilon,do_wgridding,nthreads,ms2,verbosity,false,true,wplane_mem);
+  }
+  return move(ms);
+  }
+py::array Pydirty2ms_cube(const py::array &uvw,
+  const py::array &freq, const py::array &dirty, const py::array &chan_group,
+  const py::object &wgt, double pixsize_x, double pixsize_y, size_t nu,
+  size_t nv, double epsilon, bool do_wgridding, size_t nthreads,
+  size_t verbosity, const py::object &mask,
+  double wplane_mem)
+  {
+  if (isPyarr<float>(dirty))
+    return dirty2ms_cube2<float>(uvw, freq, dirty, chan_group, wgt, mask,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
+  if (isPyarr<double>(dirty))
+    return dirty2ms_cube2<double>(uvw, freq, dirty, chan_group, wgt, mask,
+      pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity,
+      wplane_mem);
+  MR_fail("type matching failed: 'dirty' has neither type 'f4' nor 'f8'");
+  }
+constexpr auto dirty2ms_cube_DS = R"""(
+Converts an image cube to an MS object; adjoint of `ms2dirty_cube`.
+
+Parameters
+==========
+uvw, freq, wgt, pixsize_x, pixsize_y, nu, nv, epsilon, do_wstacking,
+nthreads, verbosity, mask, wplane_mem:
+    see `dirty2ms`
+dirty: np.array((ngroups, nxdirty, nydirty), dtype=np.float32 or np.float64)
+    the images
+    Its data type determines the precision in which the calculation is carried
+    out.
+chan_group: np.array((nchan,), dtype=np.int64)
+    the index of the image from which every channel is computed
+
+Returns
+=======
+np.array((nrows, nchan,), dtype=complex of same precision as `dirty`)
+    the measurement set data.
+)""";
+
+template<typename T> class PyGridderPlan
+  {
+  private:
+    size_t nrow, nchan, npix_x, npix_y;
+    unique_ptr<GridderPlan<T>> plan;
+
+  public:
+    PyGridderPlan(const py::array &uvw_, const py::array &freq_,
+      size_t npix_x_, size_t npix_y_, double pixsize_x, double pixsize_y,
+      size_t nu, size_t nv, double epsilon, bool do_wgridding,
+      size_t nthreads, size_t verbosity, const py::object &mask_,
+      double wplane_mem)
+      : npix_x(npix_x_), npix_y(npix_y_)
+      {
+      auto uvw = to_mav<double,2>(uvw_, false);
+      auto freq = to_mav<double,1>(freq_, false);
+      nrow = uvw.shape(0);
+      nchan = freq.shape(0);
+      auto mask = get_optional_const_Pyarr<uint8_t>(mask_, {nrow,nchan});
+      auto mask2 = to_mav<uint8_t,2>(mask, false);
+      py::gil_scoped_release release;
+      plan = make_unique<GridderPlan<T>>(uvw, freq, mask2, npix_x, npix_y,
+        pixsize_x, pixsize_y, nu, nv, epsilon, do_wgridding, nthreads,
+        verbosity, false, true, wplane_mem);
+      }
+    PyGridderPlan(const py::array &antenna_pos_, const py::array &ant1_,
+      const py::array &ant2_, const py::array &time_idx_,
+      const py::array &hour_angle_, double dec, const py::array &freq_,
+      size_t npix_x_, size_t npix_y_, double pixsize_x, double pixsize_y,
+      size_t nu, size_t nv, double epsilon, bool do_wgridding,
+      size_t nthreads, size_t verbosity, const py::object &mask_,
+      double wplane_mem)
+      : npix_x(npix_x_), npix_y(npix_y_)
+      {
+      auto antenna_pos = to_mav<double,2>(antenna_pos_, false);
+      auto ant1 = to_mav<int64_t,1>(ant1_, false);
+      auto ant2 = to_mav<int64_t,1>(ant2_, false);
+      auto time_idx = to_mav<int64_t,1>(time_idx_, false);
+      auto hour_angle = to_mav<double,1>(hour_angle_, false);
+      auto freq = to_mav<double,1>(freq_, false);
+      nrow = ant1.shape(0);
+      nchan = freq.shape(0);
+      auto mask = get_optional_const_Pyarr<uint8_t>(mask_, {nrow,nchan});
+      auto mask2 = to_mav<uint8_t,2>(mask, false);
+      py::gil_scoped_release release;
+      plan = make_unique<GridderPlan<T>>(Baselines(antenna_pos, ant1, ant2,
+        time_idx, hour_angle, dec, freq), mask2, npix_x, npix_y, pixsize_x,
+        pixsize_y, nu, nv, epsilon, do_wgridding, nthreads, verbosity, true,
+        wplane_mem);
+      }
+
+    py::array ms2dirty(const py::array &ms_, const py::object &wgt_)
+      {
+      auto ms = to_mav<complex<T>,2>(ms_, false);
+      auto wgt = get_optional_const_Pyarr<T>(wgt_, {nrow,nchan});
+      auto wgt2 = to_mav<T,2>(wgt, false);
+      auto dirty = make_Pyarr<T>({npix_x,npix_y});
+      auto dirty2 = to_mav<T,2>(dirty, true);
+      {
+      py::gil_scoped_release release;
+      plan->ms2dirty(ms, wgt2, dirty2);
+      }
+      return move(dirty);
+      }
+    py::array dirty2ms(const py::array &dirty_, const py::object &wgt_)
+      {
+      auto dirty = to_mav<T,2>(dirty_, false);
+      auto wgt = get_optional_const_Pyarr<T>(wgt_, {nrow,nchan});
+      auto wgt2 = to_mav<T,2>(wgt, false);
+      auto ms = make_Pyarr<complex<T>>({nrow,nchan});
+      auto ms2 = to_mav<complex<T>,2>(ms, true);
+      {
+      py::gil_scoped_release release;
+      plan->dirty2ms(dirty, wgt2, ms2);
+      }
+      return move(ms);
+      }
+    py::tuple grid_shape() const
+      { return py::make_tuple(plan->Nu(), plan->Nv()); }
+    size_t nplanes() const { return plan->Nplanes(); }
+    size_t nvis() const { return plan->Nvis(); }
+  };
+
+constexpr auto Plan_DS = R"""(
+Gridder plan for repeated transforms of the same visibility coordinates
+(e.g. the major cycles of CLEAN).
+
+All bookkeeping which only depends on `uvw`, `freq`, `mask` and the image
+parameters (data scan, choice of grid size and kernel, sorting of the
+visibilities and their assignment to w planes) is done once when the plan is
+constructed; `ms2dirty` and `dirty2ms` then only carry out gridding, FFTs and
+corrections.
+
+`Plan` works in double precision, `Plan_f` in single precision.
+
+Notes
+=====
+In contrast to the function `ms2dirty`, visibilities with value zero are not
+skipped, since the visibility data are not known at construction time.
+)""";
+
+constexpr auto Plan_init_DS = R"""(
+Parameters
+==========
+uvw: np.array((nrows, 3), dtype=np.float64)
+    UVW coordinates from the measurement set
+freq: np.array((nchan,), dtype=np.float64)
+    channel frequencies
+npix_x, npix_y: int
+    dimensions of the dirty image
+pixsize_x, pixsize_y: float
+    angular pixel size (in radians) of the dirty image
+nu, nv: int
+    dimensions of the (oversampled) intermediate uv grid; see `ms2dirty`
+    If at least one of these two values is 0, the library will automatically
+    pick values that result in a fast computation.
+epsilon: float
+    accuracy at which the computation should be done. Must be larger than 2e-13.
+    For `Plan_f`, it must be larger than 1e-5.
+do_wstacking: bool
+    if True, the full w-gridding algorithm is carried out, otherwise
+    the w values are assumed to be zero.
+nthreads: int
+    number of threads to use for the calculation
+verbosity: int
+    0: no output
+    1: some output
+    2: detailed output
 mask: np.array((nrows, nchan), dtype=np.uint8), optional
     If present, only visibilities are processed for which mask!=0
+wplane_mem: float
+    memory (in bytes) which may be used for the uv grids of w planes when
+    `do_wstacking` is True. If it allows more than one grid, batches of up to
+    `nthreads` w planes are processed together, and their FFTs are run
+    concurrently; this improves scaling for small images with many w planes.
+)""";
+
+constexpr auto Plan_init_ant_DS = R"""(
+Alternative constructor which computes the UVW coordinates on the fly from
+antenna positions and hour angles, so that no UVW array has to be stored.
+
+Parameters
+==========
+antenna_pos: np.array((nant, 3), dtype=np.float64)
+    antenna positions (in meters) in an equatorial frame: x points towards
+    hour angle 0 on the celestial equator, y towards hour angle -6h and z
+    towards the north celestial pole
+ant1, ant2: np.array((nrows,), dtype=np.int64)
+    indices of the two antennas of every row; the baseline points from
+    `ant1` to `ant2`
+time_idx: np.array((nrows,), dtype=np.int64)
+    index into `hour_angle` for every row
+hour_angle: np.array((ntimes,), dtype=np.float64)
+    hour angles (in radians) of the phase center
+dec: float
+    declination (in radians) of the phase center
+
+All other parameters are the same as above.
+)""";
+
+constexpr auto Plan_ms2dirty_DS = R"""(
+Converts an MS object to dirty image.
+
+Parameters
+==========
+ms: np.array((nrows, nchan,), dtype=np.complex128 (`Plan`) or np.complex64 (`Plan_f`))
+    the input measurement set data.
+wgt: np.array((nrows, nchan), float with same precision as `ms`), optional
+    If present, its values are multiplied to the output
+
+Returns
+=======
+np.array((npix_x, npix_y), dtype=float of same precision as `ms`)
+    the dirty image
+)""";
+
+constexpr auto Plan_dirty2ms_DS = R"""(
+Converts a dirty image to an MS object.
+
+Parameters
+==========
+dirty: np.array((npix_x, npix_y), dtype=np.float64 (`Plan`) or np.float32 (`Plan_f`))
+    dirty image
+wgt: np.array((nrows, nchan), same dtype as `dirty`), optional
+    If present, its values are multiplied to the output
 
 Returns
 =======
@@ -200,17 +751,206 @@ np.array((nrows, nchan,), dtype=complex of same precision as `dirty`)
     the measurement set data.
 )""";
 
+template<typename T> void add_plan(py::module &m, const char *name)
+  {
+  using namespace pybind11::literals;
+  using plan_t = PyGridderPlan<T>;
+  py::class_<plan_t>(m, name, Plan_DS, py::module_local())
+    .def(py::init<const py::array &, const py::array &, size_t, size_t,
+      double, double, size_t, size_t, double, bool, size_t, size_t,
+      const py::object &, double>(), Plan_init_DS, "uvw"_a, "freq"_a,
+      "npix_x"_a, "npix_y"_a, "pixsize_x"_a, "pixsize_y"_a, "nu"_a, "nv"_a, "epsilon"_a,
+      "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None,
+      "wplane_mem"_a=0.)
+    .def(py::init<const py::array &, const py::array &, const py::array &,
+      const py::array &, const py::array &, double, const py::array &, size_t,
+      size_t, double, double, size_t, size_t, double, bool, size_t, size_t,
+      const py::object &, double>(), Plan_init_ant_DS, "antenna_pos"_a,
+      "ant1"_a, "ant2"_a, "time_idx"_a, "hour_angle"_a, "dec"_a, "freq"_a,
+      "npix_x"_a, "npix_y"_a, "pixsize_x"_a, "pixsize_y"_a, "nu"_a, "nv"_a,
+      "epsilon"_a, "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0,
+      "mask"_a=None, "wplane_mem"_a=0.)
+    .def("ms2dirty", &plan_t::ms2dirty, Plan_ms2dirty_DS, "ms"_a, "wgt"_a=None)
+    .def("dirty2ms", &plan_t::dirty2ms, Plan_dirty2ms_DS, "dirty"_a,
+      "wgt"_a=None)
+    .def("grid_shape", &plan_t::grid_shape)
+    .def("nplanes", &plan_t::nplanes)
+    .def("nvis", &plan_t::nvis);
+  }
+
+template<typename T> class PyGramOperator
+  {
+  private:
+    size_t npix_x, npix_y;
+    unique_ptr<GramOperator<T>> op;
+
+  public:
+    PyGramOperator(const py::array &uvw_, const py::array &freq_,
+      size_t npix_x_, size_t npix_y_, double pixsize_x, double pixsize_y,
+      double epsilon, const py::object &wgt_, const py::object &mask_,
+      size_t nthreads, size_t verbosity)
+      : npix_x(npix_x_), npix_y(npix_y_)
+      {
+      auto uvw = to_mav<double,2>(uvw_, false);
+      auto freq = to_mav<double,1>(freq_, false);
+      auto wgt = get_optional_const_Pyarr<T>(wgt_, {uvw.shape(0),freq.shape(0)});
+      auto wgt2 = to_mav<T,2>(wgt, false);
+      auto mask = get_optional_const_Pyarr<uint8_t>(mask_, {uvw.shape(0),freq.shape(0)});
+      auto mask2 = to_mav<uint8_t,2>(mask, false);
+      py::gil_scoped_release release;
+      op = make_unique<GramOperator<T>>(uvw, freq, wgt2, mask2, npix_x,
+        npix_y, pixsize_x, pixsize_y, epsilon, nthreads, verbosity);
+      }
+
+    py::array apply(const py::array &dirty_) const
+      {
+      auto dirty = to_mav<T,2>(dirty_, false);
+      auto res = make_Pyarr<T>({npix_x,npix_y});
+      auto res2 = to_mav<T,2>(res, true);
+      {
+      py::gil_scoped_release release;
+      op->apply(dirty, res2);
+      }
+      return move(res);
+      }
+  };
+
+constexpr auto GramOperator_DS = R"""(
+Normal operator `ms2dirty(dirty2ms(x, wgt), wgt)` of the gridder, evaluated as
+a convolution with the point spread function.
+
+The PSF is computed once by the gridder on an image of twice the size in every
+direction; each application then costs a few FFTs of that size, independent of
+the number of visibilities. The result is exact up to the requested accuracy.
+
+The w term makes the normal operator position-dependent, so that it is no
+longer a convolution; the operator is therefore always that of the gridder
+without w-stacking.
+
+`GramOperator` works in double precision, `GramOperator_f` in single precision.
+)""";
+
+constexpr auto GramOperator_init_DS = R"""(
+Parameters
+==========
+uvw: np.array((nrows, 3), dtype=np.float64)
+    UVW coordinates from the measurement set
+freq: np.array((nchan,), dtype=np.float64)
+    channel frequencies
+npix_x, npix_y: int
+    dimensions of the dirty image
+pixsize_x, pixsize_y: float
+    angular pixel size (in radians) of the dirty image
+epsilon: float
+    accuracy at which the PSF is computed
+wgt: np.array((nrows, nchan), float of the operator's precision), optional
+    If present, the weights used by both `dirty2ms` and `ms2dirty`
+mask: np.array((nrows, nchan), dtype=np.uint8), optional
+    If present, only visibilities are used for which mask!=0
+nthreads: int
+    number of threads to use for the calculation
+verbosity: int
+    0: no output
+    1: some output
+    2: detailed output
+)""";
+
+constexpr auto GramOperator_apply_DS = R"""(
+Applies the operator.
+
+Parameters
+==========
+dirty: np.array((npix_x, npix_y), float of the operator's precision)
+    input image
+
+Returns
+=======
+np.array((npix_x, npix_y), float of the operator's precision)
+    the approximation of `ms2dirty(dirty2ms(dirty, wgt), wgt)`
+)""";
+
+template<typename T> void add_gram(py::module &m, const char *name)
+  {
+  using namespace pybind11::literals;
+  using op_t = PyGramOperator<T>;
+  py::class_<op_t>(m, name, GramOperator_DS, py::module_local())
+    .def(py::init<const py::array &, const py::array &, size_t, size_t,
+      double, double, double, const py::object &, const py::object &,
+      size_t, size_t>(), GramOperator_init_DS, "uvw"_a,
+      "freq"_a, "npix_x"_a, "npix_y"_a, "pixsize_x"_a, "pixsize_y"_a,
+      "epsilon"_a, "wgt"_a=None, "mask"_a=None, "nthreads"_a=1,
+      "verbosity"_a=0)
+    .def("apply", &op_t::apply, GramOperator_apply_DS, "dirty"_a);
+  }
+
+constexpr auto calibrate_cost_model_DS = R"""(
+Measures the run time of FFTs and of gridding with every kernel support on
+this machine, for single and double precision.
+
+When `nu` and `nv` are not specified, the gridding functions and plans choose
+grid size and kernel by minimizing a model of the expected run time. By
+default, this model uses built-in coefficients, which may not fit the host;
+after calibration, the measured coefficients are used instead.
+The measurements take a few seconds. The results can be kept across sessions
+with `save_cost_model()`; if the environment variable
+DUCC0_GRIDDER_COST_MODEL names such a file, it is loaded on first use.
+
+Parameters
+==========
+nthreads: int
+    number of threads to use for the measurements.
+    The cost model does not depend on the number of threads: the measured
+    coefficients are used for all later gridding calls, whatever their
+    `nthreads`. Since FFTs and gridding do not scale equally with the number
+    of threads, this should be the thread count of the typical later call.
+)""";
+
+void calibrate_cost_model(size_t nthreads)
+  {
+  py::gil_scoped_release release;
+  calibrateCostModel<float>(nthreads);
+  calibrateCostModel<double>(nthreads);
+  }
+void load_cost_model(const string &filename)
+  { loadCostModel(filename); }
+void save_cost_model(const string &filename)
+  { saveCostModel(filename); }
+
 void add_wgridder(py::module &msup)
   {
   using namespace pybind11::literals;
   auto m = msup.def_submodule("wgridder");
 
+  m.def("calibrate_cost_model", &calibrate_cost_model,
+    calibrate_cost_model_DS, "nthreads"_a=1);
+  m.def("load_cost_model", &load_cost_model, "filename"_a);
+  m.def("save_cost_model", &save_cost_model, "filename"_a);
   m.def("ms2dirty", &Pyms2dirty, ms2dirty_DS, "uvw"_a, "freq"_a, "ms"_a,
     "wgt"_a=None, "npix_x"_a, "npix_y"_a, "pixsize_x"_a, "pixsize_y"_a, "nu"_a, "nv"_a,
-    "epsilon"_a, "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None);
+    "epsilon"_a, "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None,
+    "wplane_mem"_a=0., "double_precision_accumulation"_a=false,
+    "duvw"_a=None, "chan_width"_a=None);
   m.def("dirty2ms", &Pydirty2ms, dirty2ms_DS, "uvw"_a, "freq"_a, "dirty"_a,
     "wgt"_a=None, "pixsize_x"_a, "pixsize_y"_a, "nu"_a, "nv"_a, "epsilon"_a,
-    "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None);
+    "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None,
+    "wplane_mem"_a=0., "double_precision_accumulation"_a=false,
+    "duvw"_a=None, "chan_width"_a=None);
+  m.def("ms2dirty_cube", &Pyms2dirty_cube, ms2dirty_cube_DS, "uvw"_a,
+    "freq"_a, "ms"_a, "chan_group"_a, "wgt"_a=None, "npix_x"_a, "npix_y"_a,
+    "pixsize_x"_a, "pixsize_y"_a, "nu"_a, "nv"_a, "epsilon"_a,
+    "do_wstacking"_a=false, "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None,
+    "wplane_mem"_a=0.);
+  m.def("dirty2ms_cube", &Pydirty2ms_cube, dirty2ms_cube_DS, "uvw"_a,
+    "freq"_a, "dirty"_a, "chan_group"_a, "wgt"_a=None, "pixsize_x"_a,
+    "pixsize_y"_a, "nu"_a, "nv"_a, "epsilon"_a, "do_wstacking"_a=false,
+    "nthreads"_a=1, "verbosity"_a=0, "mask"_a=None,
+    "wplane_mem"_a=0.);
+  for (auto name: {"ms2dirty", "dirty2ms", "ms2dirty_cube", "dirty2ms_cube"})
+    add_async(m, name);
+  add_plan<double>(m, "Plan");
+  add_plan<float>(m, "Plan_f");
+  add_gram<double>(m, "GramOperator");
+  add_gram<float>(m, "GramOperator_f");
   }
 
 }
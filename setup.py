@@ -1,9 +1,11 @@
 import sys
 import os.path
 import itertools
+import platform
 from glob import iglob
 
 from setuptools import setup, Extension
+from setuptools.command.build_clib import build_clib
 import pybind11
 
 pkgname = 'ducc0'
@@ -21,12 +23,25 @@ include_dirs = ['.', './src/',
                 pybind11.get_include(True),
                 pybind11.get_include(False)]
 
-extra_compile_args = ['-std=c++17', '-march=native', '-ffast-math', '-O3']
+# With DUCC0_MULTIARCH=1 the extension is built for the baseline instruction
+# set of the platform instead of the build machine, which is needed for
+# portable wheels. The SHT core and the fft, totalconvolve, wgridder and nufft
+# modules are then additionally compiled for several x86 instruction sets,
+# and the best one is selected at runtime (or the one given in the
+# environment variable DUCC0_ARCH).
+multiarch = (os.environ.get('DUCC0_MULTIARCH', '0') == '1' and
+             sys.platform != 'win32' and
+             platform.machine().lower() in ('x86_64', 'amd64'))
+march = [] if multiarch else ['-march=native']
+
+extra_compile_args = ['-std=c++17'] + march + ['-ffast-math', '-O3']
 
 python_module_link_args = []
 
 define_macros = [("PKGNAME", pkgname),
                  ("PKGVERSION", '"%s"' % version)]
+if multiarch:
+    define_macros += [("MULTIARCH", None)]
 
 if sys.platform == 'darwin':
     import distutils.sysconfig
@@ -49,15 +64,44 @@ else:
                            '-Wcast-align',
                            '-Wpointer-arith']
 
-    python_module_link_args += ['-march=native',
-                                '-Wl,-rpath,$ORIGIN',
-                                '-s']
+    python_module_link_args += march + ['-Wl,-rpath,$ORIGIN', '-s']
 
 # if you want debugging info, remove the "-s" from python_module_link_args
 depfiles = (_get_files_by_suffix('.', 'h') +
             _get_files_by_suffix('.', 'cc') +
             ['setup.py'])
 
+# variants of the SHT core and of the modules in python/ducc_arch_inc.cc for
+# runtime dispatch; see sharp_core.cc and ducc.cc.
+# These libraries are linked after the baseline code, so that the linker
+# keeps the baseline copies of inline functions shared by all variants.
+multiarch_archs = [('avx512f', ['-mavx512f']),
+                   ('avx2', ['-mavx2', '-mfma']),
+                   ('fma4', ['-mfma4']),
+                   ('fma', ['-mfma']),
+                   ('avx', ['-mavx'])]
+multiarch_sources = [('sharp_core', 'src/ducc0/sharp/sharp_core_inc.cc'),
+                     ('ducc_arch', 'python/ducc_arch_inc.cc')]
+libraries = [(name+'_'+arch,
+              {'sources': [source],
+               'include_dirs': include_dirs,
+               'macros': define_macros + [("ARCH", arch)],
+               'cflags': extra_compile_args + flags})
+             for name, source in multiarch_sources
+             for arch, flags in multiarch_archs] if multiarch else []
+
+
+class build_clib_multiarch(build_clib):
+    # all variants are built from the same source file, so every library
+    # needs its own directory for object files
+    def build_libraries(self, libraries):
+        build_temp = self.build_temp
+        for lib in libraries:
+            self.build_temp = os.path.join(build_temp, lib[0])
+            super().build_libraries([lib])
+        self.build_temp = build_temp
+
+
 extensions = [Extension(pkgname,
                         language='c++',
                         sources=['python/ducc.cc'],
@@ -85,6 +129,8 @@ setup(name=pkgname,
       packages=[],
       python_requires=">=3.6",
       ext_modules=extensions,
+      libraries=libraries,
+      cmdclass={'build_clib': build_clib_multiarch},
       install_requires=['numpy>=1.17.0'],
       license="GPLv2",
       )
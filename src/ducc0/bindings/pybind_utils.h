@@ -23,8 +23,12 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <mutex>
+#include <condition_variable>
+#include <string>
 
 #include "ducc0/infra/mav.h"
+#include "ducc0/infra/threading.h"
 
 namespace ducc0 {
 
@@ -45,7 +49,7 @@ template<typename T> py::array_t<T> toPyarr(const py::object &obj)
   return tmp;
   }
 
-shape_t copy_shape(const py::array &arr)
+inline shape_t copy_shape(const py::array &arr)
   {
   shape_t res(size_t(arr.ndim()));
   for (size_t i=0; i<res.size(); ++i)
@@ -136,6 +140,100 @@ template<typename T, size_t ndim> mav<T,ndim> to_mav(const py::array &obj, bool
     copy_fixshape<ndim>(arr), copy_fixstrides<T,ndim>(arr));
   }
 
+/* Counts the calls of call_async() which have not finished yet. */
+class async_tracker
+  {
+  private:
+    std::mutex mut;
+    std::condition_variable finished;
+    size_t npending=0;
+
+  public:
+    void add()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      ++npending;
+      }
+    void done()
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      if (--npending==0) finished.notify_all();
+      }
+    void wait_all()
+      {
+      std::unique_lock<std::mutex> lock(mut);
+      finished.wait(lock, [this]{ return npending==0; });
+      }
+  };
+
+inline async_tracker &get_async_tracker()
+  {
+  static async_tracker tracker;
+  // pending calls must finish before the interpreter shuts down
+  static bool registered = []
+    {
+    py::module::import("atexit").attr("register")(py::cpp_function([]
+      {
+      py::gil_scoped_release release;
+      get_async_tracker().wait_all();
+      }));
+    return true;
+    }();
+  (void)registered;
+  return tracker;
+  }
+
+/* Calls func(*args, **kwargs) on a worker thread of the thread pool and
+   returns a concurrent.futures.Future receiving its result or exception.
+   This only allows overlapping the call with other Python code if func
+   releases the GIL while computing. */
+inline py::object call_async(const py::object &func, const py::args &args,
+  const py::kwargs &kwargs)
+  {
+  struct call
+    {
+    py::object func, future;
+    py::args args;
+    py::kwargs kwargs;
+    };
+  auto future = py::module::import("concurrent.futures").attr("Future")();
+  auto &tracker(get_async_tracker());
+  // the Python objects are only touched (and destroyed) with the GIL held
+  auto c = new call{func, future, args, kwargs};
+  tracker.add();
+  {
+  py::gil_scoped_release release;
+  execAsync([c, &tracker]
+    {
+    {
+    py::gil_scoped_acquire acquire;
+    if (c->future.attr("set_running_or_notify_cancel")().cast<bool>())
+      {
+      try
+        { c->future.attr("set_result")(c->func(*c->args, **c->kwargs)); }
+      catch (py::error_already_set &e)
+        { c->future.attr("set_exception")(e.value()); }
+      }
+    delete c;
+    }
+    tracker.done();
+    });
+  }
+  return future;
+  }
+
+/* Adds the function "<name>_async" to \a m, which runs the function
+   \a name of \a m via call_async(). */
+inline void add_async(py::module &m, const std::string &name)
+  {
+  auto doc = "Asynchronous variant of `"+name+"`\n\n"
+    "Takes the same arguments, but runs the computation on the ducc0 thread "
+    "pool and\nreturns a `concurrent.futures.Future` for its result.\n";
+  py::object func = m.attr(name.c_str());
+  m.def((name+"_async").c_str(), [func](py::args args, py::kwargs kwargs)
+    { return call_async(func, args, kwargs); }, doc.c_str());
+  }
+
 }
 
 using detail_pybind::isPyarr;
@@ -144,6 +242,8 @@ using detail_pybind::get_optional_Pyarr;
 using detail_pybind::get_optional_const_Pyarr;
 using detail_pybind::to_fmav;
 using detail_pybind::to_mav;
+using detail_pybind::call_async;
+using detail_pybind::add_async;
 
 }
 
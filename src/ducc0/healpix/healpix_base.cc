@@ -34,6 +34,8 @@
 #include "ducc0/math/constants.h"
 #include "ducc0/infra/mav.h"
 #include "ducc0/math/space_filling.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/threading.h"
 
 namespace ducc0 {
 
@@ -377,7 +379,8 @@ template<typename I> void T_Healpix_Base<I>::query_disc_inclusive
 
 template<typename I> template<typename I2>
   void T_Healpix_Base<I>::query_multidisc (const vector<vec3> &norm,
-  const vector<double> &rad, int fact, rangeset<I2> &pixset) const
+  const vector<double> &rad, int fact, rangeset<I2> &pixset,
+  size_t nthreads) const
   {
   bool inclusive = (fact!=0);
   size_t nv=norm.size();
@@ -440,7 +443,7 @@ template<typename I> template<typename I2>
         }
       }
 
-    for (I iz=irmin; iz<=irmax; ++iz)
+    auto do_ring = [&](I iz, rangeset<I2> &out)
       {
       double z=ring2z(iz);
       I ipix1,nr;
@@ -472,8 +475,36 @@ template<typename I> template<typename I2>
         else
           tr.intersect(ipix1+ip_lo,ipix1+ip_hi+1);
         }
-      pixset.append(tr);
+      out.append(tr);
+      };
+
+    if (irmax<irmin) return;
+    size_t nrings = size_t(irmax-irmin+1);
+    if (nthreads==0) nthreads = get_default_nthreads();
+    if ((nthreads==1) || (nrings<2*nthreads))
+      {
+      for (I iz=irmin; iz<=irmax; ++iz)
+        do_ring(iz, pixset);
+      return;
       }
+    // Blocks of consecutive rings are processed in parallel. Since RING
+    // indices increase from ring to ring, the partial results only need to
+    // be concatenated in block order.
+    size_t nblocks = min(nrings, 8*nthreads);
+    vector<rangeset<I2>> partial(nblocks);
+    execDynamic(nblocks, nthreads, 1, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext())
+        for (auto b=rng.lo; b<rng.hi; ++b)
+          {
+          I lo = irmin + I((b*nrings)/nblocks),
+            hi = irmin + I(((b+1)*nrings)/nblocks);
+          for (I iz=lo; iz<hi; ++iz)
+            do_ring(iz, partial[b]);
+          }
+      });
+    for (const auto &part: partial)
+      pixset.append(part);
     }
   else // scheme_ == NEST
     {
@@ -504,35 +535,89 @@ template<typename I> template<typename I2>
         }
       }
 
-    vector<pair<I,size_t> > stk; // stack for pixel numbers and their orders
-    stk.reserve(12+3*omax); // reserve maximum size to avoid reallocation
-    for (int i=0; i<12; ++i) // insert the 12 base pixels in reverse order
-      stk.push_back(make_pair(I(11-i),0));
-
-    size_t stacktop=0; // a place to save a stack position
-
-    while (!stk.empty()) // as long as there are pixels on the stack
+    auto get_zone = [&](I pix, size_t o)
       {
-      // pop current pixel number and order from the stack
-      I pix=stk.back().first;
-      size_t o=stk.back().second;
-      stk.pop_back();
-
       vec3 pv(base[o].pix2vec(pix));
-
       size_t zone=3;
       for (size_t i=0; i<nv; ++i)
         {
         double crad=dotprod(pv,norm[i]);
         for (size_t iz=0; iz<zone; ++iz)
           if (crad<crlimit(o,i,iz))
-            if ((zone=iz)==0) goto bailout;
+            if ((zone=iz)==0) return zone;
+        }
+      return zone;
+      };
+    // processes the pixels on the stack and all their descendants
+    auto traverse = [&](vector<pair<I,size_t> > &stk, rangeset<I2> &out)
+      {
+      size_t stacktop=0; // a place to save a stack position
+      while (!stk.empty()) // as long as there are pixels on the stack
+        {
+        // pop current pixel number and order from the stack
+        I pix=stk.back().first;
+        size_t o=stk.back().second;
+        stk.pop_back();
+        check_pixel (o, order_, omax, get_zone(pix,o), out, pix, stk,
+          inclusive, stacktop);
         }
+      };
 
-      check_pixel (o, order_, omax, zone, pixset, pix, stk, inclusive,
-        stacktop);
-      bailout:;
+    vector<pair<I,size_t> > stk; // stack for pixel numbers and their orders
+    stk.reserve(12+3*omax); // reserve maximum size to avoid reallocation
+    for (int i=0; i<12; ++i) // insert the 12 base pixels in reverse order
+      stk.push_back(make_pair(I(11-i),0));
+
+    if (nthreads==0) nthreads = get_default_nthreads();
+    if (nthreads==1)
+      { traverse(stk, pixset); return; }
+
+    // Descend serially to order osplit, where there are enough pixels to
+    // keep all threads busy. The subtrees of the pixels found there occupy
+    // disjoint, ascending ranges of NESTED indices, so they are traversed in
+    // parallel and their results are concatenated.
+    size_t osplit=0;
+    while ((osplit<size_t(order_)) && ((I(12)<<(2*osplit))<I(64*nthreads)))
+      ++osplit;
+    // pixels at order osplit whose subtree must be traversed, and pixels at
+    // lower orders lying completely inside the shape
+    vector<pair<I,size_t> > items;
+    while (!stk.empty())
+      {
+      I pix=stk.back().first;
+      size_t o=stk.back().second;
+      stk.pop_back();
+      if (o==osplit)
+        { items.push_back(make_pair(pix,o)); continue; }
+      size_t zone = get_zone(pix,o);
+      if (zone==0) continue;
+      if (zone>=3) // this is what check_pixel() does for o<order_
+        items.push_back(make_pair(pix,o));
+      else
+        for (size_t i=0; i<4; ++i)
+          stk.push_back(make_pair(4*pix+3-i,o+1));
       }
+    vector<rangeset<I2>> partial(items.size());
+    execDynamic(items.size(), nthreads, 1, [&](Scheduler &sched)
+      {
+      vector<pair<I,size_t> > lstk;
+      lstk.reserve(12+3*omax);
+      while (auto rng=sched.getNext())
+        for (auto i=rng.lo; i<rng.hi; ++i)
+          if (items[i].second==osplit)
+            {
+            lstk.push_back(items[i]);
+            traverse(lstk, partial[i]);
+            }
+      });
+    for (size_t i=0; i<items.size(); ++i)
+      if (items[i].second==osplit)
+        pixset.append(partial[i]);
+      else // output all subpixels
+        {
+        int sdist=2*(order_-int(items[i].second));
+        pixset.append(items[i].first<<sdist,(items[i].first+1)<<sdist);
+        }
     }
   }
 
@@ -977,9 +1062,170 @@ template<typename I> void T_Healpix_Base<I>::pix2loc (I pix, double &z,
     }
   }
 
+template<typename I> void T_Healpix_Base<I>::loc2pix_simd (const double *z_,
+  const double *phi_, const double *sth_, I *pix, size_t n) const
+  {
+  using Tsimd = native_simd<double>;
+  Tsimd z(0.), phi(0.), sth(-1.);
+  for (size_t i=0; i<n; ++i)
+    { z[i]=z_[i]; phi[i]=phi_[i]; sth[i]=sth_[i]; }
+  double dnside = double(nside_);
+
+  Tsimd za = abs(z);
+  Tsimd tt = phi*inv_halfpi;
+  if (any_of(tt<0.) || any_of(tt>=4.))
+    tt = tt.apply([](double v) { return fmodulo(v,4.0); }); // in [0,4)
+
+  // polar caps: tp = tt-int(tt), computed exactly by masked subtractions
+  Tsimd tp = tt;
+  where(tt>=1.,tp) -= 1.;
+  where(tt>=2.,tp) -= 1.;
+  where(tt>=3.,tp) -= 1.;
+  Tsimd tmp = dnside*sqrt(3.*(1.-za));
+  where((za>=0.99)&(sth>=0.),tmp) = dnside*sth/sqrt((1.+za)/3.);
+
+  // equatorial region
+  Tsimd temp1 = dnside*(0.5+tt);
+  Tsimd temp2 = (scheme_==RING) ? dnside*z*0.75 : dnside*(z*0.75);
+
+  // jp and jm before truncation: indices of the ascending and descending
+  // edge lines
+  auto polar = za>twothird;
+  Tsimd fjp = temp1-temp2, fjm = temp1+temp2;
+  where(polar,fjp) = tp*tmp;
+  where(polar,fjm) = (1.0-tp)*tmp;
+
+  for (size_t i=0; i<n; ++i)
+    {
+    I jp = I(fjp[i]), jm = I(fjm[i]);
+    if (scheme_==RING)
+      {
+      if (za[i]<=twothird) // Equatorial region
+        {
+        I nl4 = 4*nside_;
+        I ir = nside_ + 1 + jp - jm; // in {1,2n+1}
+        I kshift = 1-(ir&1); // kshift=1 if ir even, 0 otherwise
+        I t1 = jp+jm-nside_+kshift+1+nl4+nl4;
+        I ip = (order_>0) ?
+          (t1>>1)&(nl4-1) : ((t1>>1)%nl4); // in {0,4n-1}
+        pix[i] = ncap_ + (ir-1)*nl4 + ip;
+        }
+      else  // North & South polar caps
+        {
+        I ir = jp+jm+1; // ring number counted from the closest pole
+        I ip = I(tt[i]*ir); // in {0,4*ir-1}
+        MR_assert((ip>=0)&&(ip<4*ir),"must not happen");
+        pix[i] = (z[i]>0) ? 2*ir*(ir-1) + ip : npix_ - 2*ir*(ir+1) + ip;
+        }
+      }
+    else // scheme_ == NEST
+      {
+      if (za[i]<=twothird) // Equatorial region
+        {
+        I ifp = jp >> order_;  // in {0,4}
+        I ifm = jm >> order_;
+        int face_num = (ifp==ifm) ? (ifp|4) : ((ifp<ifm) ? ifp : (ifm+8));
+        int ix = jm & (nside_-1),
+            iy = nside_ - (jp & (nside_-1)) - 1;
+        pix[i] = xyf2nest(ix,iy,face_num);
+        }
+      else // polar region, za > 2/3
+        {
+        int ntt = min(3,int(tt[i]));
+        jp=min(jp,nside_-1); // for points too close to the boundary
+        jm=min(jm,nside_-1);
+        pix[i] = (z[i]>=0) ?
+          xyf2nest(nside_-jm -1,nside_-jp-1,ntt) : xyf2nest(jp,jm,ntt+8);
+        }
+      }
+    }
+  }
+
+template<typename I> void T_Healpix_Base<I>::ang2pix (const pointing *ang,
+  I *pix, size_t n) const
+  {
+  using Tsimd = native_simd<double>;
+  constexpr size_t vlen = Tsimd::size();
+  double z[vlen], phi[vlen], sth[vlen];
+  for (size_t i0=0; i0<n; i0+=vlen)
+    {
+    size_t nv = min(vlen, n-i0);
+    Tsimd theta(0.);
+    for (size_t i=0; i<nv; ++i)
+      {
+      const auto &a(ang[i0+i]);
+      MR_assert((a.theta>=0)&&(a.theta<=pi),"invalid theta value");
+      theta[i] = a.theta;
+      phi[i] = a.phi;
+      }
+    Tsimd vz, vsth;
+    sincos(theta, vsth, vz);
+    for (size_t i=0; i<nv; ++i)
+      {
+      z[i] = vz[i];
+      sth[i] = ((theta[i]<0.01) || (theta[i] > 3.14159-0.01)) ? vsth[i] : -1.;
+      }
+    loc2pix_simd(z, phi, sth, pix+i0, nv);
+    }
+  }
+
+template<typename I> void T_Healpix_Base<I>::vec2pix (const vec3 *vec,
+  I *pix, size_t n) const
+  {
+  using Tsimd = native_simd<double>;
+  constexpr size_t vlen = Tsimd::size();
+  double z[vlen], phi[vlen], sth[vlen];
+  for (size_t i0=0; i0<n; i0+=vlen)
+    {
+    size_t nv = min(vlen, n-i0);
+    Tsimd x(0.), y(0.), vz(1.);
+    for (size_t i=0; i<nv; ++i)
+      {
+      const auto &v(vec[i0+i]);
+      x[i] = v.x; y[i] = v.y; vz[i] = v.z;
+      }
+    Tsimd vphi = atan2(y, x);
+    Tsimd xl = Tsimd(1.)/sqrt(x*x + y*y + vz*vz);
+    Tsimd nz = vz*xl;
+    Tsimd vsth(-1.);
+    where(abs(nz)>0.99,vsth) = sqrt(x*x+y*y)*xl;
+    for (size_t i=0; i<nv; ++i)
+      { z[i] = nz[i]; phi[i] = vphi[i]; sth[i] = vsth[i]; }
+    loc2pix_simd(z, phi, sth, pix+i0, nv);
+    }
+  }
+
+template<typename I> void T_Healpix_Base<I>::pix2vec (const I *pix,
+  vec3 *vec, size_t n) const
+  {
+  using Tsimd = native_simd<double>;
+  constexpr size_t vlen = Tsimd::size();
+  for (size_t i0=0; i0<n; i0+=vlen)
+    {
+    size_t nv = min(vlen, n-i0);
+    Tsimd z(0.), phi(0.), sth(-1.);
+    for (size_t i=0; i<nv; ++i)
+      {
+      double tz, tphi, tsth;
+      bool have_sth;
+      pix2loc(pix[i0+i], tz, tphi, tsth, have_sth);
+      z[i] = tz; phi[i] = tphi;
+      if (have_sth) sth[i] = tsth;
+      }
+    Tsimd st = sqrt((1.-z)*(1.+z));
+    where(sth>=0.,st) = sth;
+    Tsimd sphi, cphi;
+    sincos(phi, sphi, cphi);
+    Tsimd vx = st*cphi, vy = st*sphi;
+    for (size_t i=0; i<nv; ++i)
+      vec[i0+i] = vec3(vx[i], vy[i], z[i]);
+    }
+  }
+
 template<typename I> template<typename I2>
   void T_Healpix_Base<I>::query_polygon_internal
-  (const vector<pointing> &vertex, int fact, rangeset<I2> &pixset) const
+  (const vector<pointing> &vertex, int fact, rangeset<I2> &pixset,
+  size_t nthreads) const
   {
   bool inclusive = (fact!=0);
   size_t nv=vertex.size();
@@ -1008,26 +1254,27 @@ template<typename I> template<typename I2>
     find_enclosing_circle (vv, normal[nv], cosrad);
     rad[nv]=acos(cosrad);
     }
-  query_multidisc(normal,rad,fact,pixset);
+  query_multidisc(normal,rad,fact,pixset,nthreads);
   }
 
 template<typename I> void T_Healpix_Base<I>::query_polygon
-  (const vector<pointing> &vertex, rangeset<I> &pixset) const
+  (const vector<pointing> &vertex, rangeset<I> &pixset, size_t nthreads) const
   {
-  query_polygon_internal(vertex, 0, pixset);
+  query_polygon_internal(vertex, 0, pixset, nthreads);
   }
 
 template<typename I> void T_Healpix_Base<I>::query_polygon_inclusive
-  (const vector<pointing> &vertex, rangeset<I> &pixset, int fact) const
+  (const vector<pointing> &vertex, rangeset<I> &pixset, int fact,
+  size_t nthreads) const
   {
   MR_assert(fact>0,"fact must be a positive integer");
   if ((sizeof(I)<8) && (((I(1)<<order_max)/nside_)<fact))
     {
     T_Healpix_Base<int64_t> base2(nside_,scheme_,SET_NSIDE);
-    base2.query_polygon_internal(vertex,fact,pixset);
+    base2.query_polygon_internal(vertex,fact,pixset,nthreads);
     return;
     }
-  query_polygon_internal(vertex, fact, pixset);
+  query_polygon_internal(vertex, fact, pixset, nthreads);
   }
 
 template<typename I> void T_Healpix_Base<I>::query_strip_internal
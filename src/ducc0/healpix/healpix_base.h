@@ -33,9 +33,11 @@
 #define HEALPIX_BASE_H
 
 #include <vector>
+#include <array>
 #include "ducc0/healpix/healpix_tables.h"
 #include "ducc0/math/pointing.h"
 #include "ducc0/math/rangeset.h"
+#include "ducc0/math/crangeset.h"
 
 namespace ducc0 {
 
@@ -64,7 +66,8 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
     void in_ring (I iz, double phi0, double dphi, rangeset<I> &pixset) const;
 
     template<typename I2> void query_multidisc (const std::vector<vec3> &norm,
-      const std::vector<double> &rad, int fact, rangeset<I2> &pixset) const;
+      const std::vector<double> &rad, int fact, rangeset<I2> &pixset,
+      size_t nthreads=1) const;
 
     void query_multidisc_general (const std::vector<vec3> &norm, const std::vector<double> &rad,
       bool inclusive, const std::vector<int> &cmds, rangeset<I> &pixset) const;
@@ -78,6 +81,11 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
     void ring2xyf(I pix, int &ix, int &iy, int &face_num) const;
 
     I loc2pix (double z, double phi, double sth, bool have_sth) const;
+    /* Does the same as loc2pix() for the \a n locations (\a z[i], \a phi[i]),
+       with n<=native_simd<double>::size(). A negative \a sth[i] means that
+       the sine of theta is not provided. */
+    void loc2pix_simd (const double *z, const double *phi, const double *sth,
+      I *pix, size_t n) const;
     void pix2loc (I pix, double &z, double &phi, double &sth, bool &have_sth)
       const;
 
@@ -171,6 +179,21 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
         return loc2pix (nz,phi,0,false);
       }
 
+    /*! Computes the numbers of the pixels containing the \a n angular
+        coordinates in \a ang and stores them in \a pix.
+        \note The trigonometric functions are evaluated with the SIMD
+          versions from simd.h (maximum error about 2 ulp instead of libm's
+          0.5), so for positions within a few ulp of a pixel boundary the
+          result can be the neighbouring pixel of the one returned by the
+          single-value ang2pix(). */
+    void ang2pix (const pointing *ang, I *pix, size_t n) const;
+    /*! Computes the numbers of the pixels containing the \a n vectors in
+        \a vec and stores them in \a pix.
+        \note As for the array version of ang2pix(), vectors within a few ulp
+          of a pixel boundary can end up in the neighbouring pixel of the one
+          returned by the single-value vec2pix(). */
+    void vec2pix (const vec3 *vec, I *pix, size_t n) const;
+
     /*! Returns the angular coordinates (\a z:=cos(theta), \a phi) of the center
         of the pixel with number \a pix.
         \note This method is inaccurate near the poles at high resolutions. */
@@ -205,6 +228,11 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
         return res;
         }
       }
+    /*! Computes the vectors to the centers of the \a n pixels in \a pix
+        and stores them in \a vec.
+        \note The SIMD sincos() is used, so the components can differ from
+          those of the single-value pix2vec() by a few ulp (at most 1e-15). */
+    void pix2vec (const I *pix, vec3 *vec, size_t n) const;
     /*! Returns the pixel number for this T_Healpix_Base corresponding to the
         pixel number \a pix in \a b.
         \note \a b.Nside()\%Nside() must be 0. */
@@ -290,27 +318,39 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
       query_disc_inclusive(dir,radius,pixset,fact);
       pixset.toVector(listpix);
       }
+    /*! Variant of query_disc() returning a memory-compact \a crangeset. */
+    void query_disc (const pointing &dir, double radius,
+      crangeset<I> &pixset) const
+      { pixset = crangeset<I>(query_disc(dir,radius)); }
+    /*! Variant of query_disc_inclusive() returning a memory-compact
+        \a crangeset. */
+    void query_disc_inclusive (const pointing &dir, double radius,
+      crangeset<I> &pixset, int fact=1) const
+      { pixset = crangeset<I>(query_disc_inclusive(dir,radius,fact)); }
 
     template<typename I2> void query_polygon_internal
       (const std::vector<pointing> &vertex, int fact,
-      rangeset<I2> &pixset) const;
+      rangeset<I2> &pixset, size_t nthreads=1) const;
 
     /*! Returns a range set of pixels whose centers lie within the convex
         polygon defined by the \a vertex array.
         \param vertex array containing the vertices of the polygon.
         \param pixset a \a rangeset object containing the indices of all pixels
            whose centers lie inside the polygon
+        \param nthreads the number of threads to use (0: default)
         \note This method is more efficient in the RING scheme. */
     void query_polygon (const std::vector<pointing> &vertex,
-      rangeset<I> &pixset) const;
+      rangeset<I> &pixset, size_t nthreads=1) const;
     /*! Returns a range set of pixels whose centers lie within the convex
         polygon defined by the \a vertex array.
         \param vertex array containing the vertices of the polygon.
+        \param nthreads the number of threads to use (0: default)
         \note This method is more efficient in the RING scheme. */
-    rangeset<I> query_polygon (const std::vector<pointing> &vertex) const
+    rangeset<I> query_polygon (const std::vector<pointing> &vertex,
+      size_t nthreads=1) const
       {
       rangeset<I> res;
-      query_polygon(vertex, res);
+      query_polygon(vertex, res, nthreads);
       return res;
       }
 
@@ -325,9 +365,10 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
         \note This method may return some pixels which don't overlap with
            the polygon at all. The higher \a fact is chosen, the fewer false
            positives are returned, at the cost of increased run time.
+        \param nthreads the number of threads to use (0: default)
         \note This method is more efficient in the RING scheme. */
     void query_polygon_inclusive (const std::vector<pointing> &vertex,
-      rangeset<I> &pixset, int fact=1) const;
+      rangeset<I> &pixset, int fact=1, size_t nthreads=1) const;
     /*! Returns a range set of pixels which overlap with the convex
         polygon defined by the \a vertex array.
         \param vertex array containing the vertices of the polygon.
@@ -337,14 +378,24 @@ template<typename I> class T_Healpix_Base: public Healpix_Tables
         \note This method may return some pixels which don't overlap with
            the polygon at all. The higher \a fact is chosen, the fewer false
            positives are returned, at the cost of increased run time.
+        \param nthreads the number of threads to use (0: default)
         \note This method is more efficient in the RING scheme. */
     rangeset<I> query_polygon_inclusive (const std::vector<pointing> &vertex,
-      int fact=1) const
+      int fact=1, size_t nthreads=1) const
       {
       rangeset<I> res;
-      query_polygon_inclusive(vertex, res, fact);
+      query_polygon_inclusive(vertex, res, fact, nthreads);
       return res;
       }
+    /*! Variant of query_polygon() returning a memory-compact \a crangeset. */
+    void query_polygon (const std::vector<pointing> &vertex,
+      crangeset<I> &pixset) const
+      { pixset = crangeset<I>(query_polygon(vertex)); }
+    /*! Variant of query_polygon_inclusive() returning a memory-compact
+        \a crangeset. */
+    void query_polygon_inclusive (const std::vector<pointing> &vertex,
+      crangeset<I> &pixset, int fact=1) const
+      { pixset = crangeset<I>(query_polygon_inclusive(vertex,fact)); }
 
     /*! Returns a range set of pixels whose centers lie within the colatitude
         range defined by \a theta1 and \a theta2 (if \a inclusive==false), or
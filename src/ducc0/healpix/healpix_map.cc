@@ -29,57 +29,59 @@
  *  Author: Martin Reinecke
  */
 
-#include "healpix_map.h"
-
-using namespace std;
+#include "ducc0/healpix/healpix_map.h"
+#include "ducc0/infra/threading.h"
 
 namespace ducc0 {
 
-namespace healpix {
+namespace detail_healpix {
 
-template<typename T> void Healpix_Map<T>::Import_degrade
-  (const Healpix_Map<T> &orig, bool pessimistic)
+using namespace std;
+
+template<typename T> void degrade_map (const Healpix_Base2 &base_in,
+  const mav<T,1> &in, const Healpix_Base2 &base_out, mav<T,1> &out,
+  bool pessimistic, size_t nthreads)
   {
-  MR_assert(nside_<orig.nside_,"Import_degrade: this is no degrade");
-  int fact = orig.nside_/nside_;
-  MR_assert (orig.nside_==nside_*fact,
+  MR_assert(base_out.Nside()<base_in.Nside(), "this is no degrade");
+  int fact = base_in.Nside()/base_out.Nside();
+  MR_assert (base_in.Nside()==base_out.Nside()*fact,
     "the larger Nside must be a multiple of the smaller one");
+  MR_assert((in.shape(0)==size_t(base_in.Npix()))
+          &&(out.shape(0)==size_t(base_out.Npix())), "bad map size");
 
   int minhits = pessimistic ? fact*fact : 1;
-#pragma omp parallel
-{
-  int m;
-#pragma omp for schedule (static)
-  for (m=0; m<npix_; ++m)
+  execStatic(base_out.Npix(), nthreads, 0, [&](Scheduler &sched)
     {
-    int x,y,f;
-    pix2xyf(m,x,y,f);
-    int hits = 0;
-    tree_adder<double> adder;
-    for (int j=fact*y; j<fact*(y+1); ++j)
-      for (int i=fact*x; i<fact*(x+1); ++i)
+    while (auto rng=sched.getNext())
+      for (auto m=rng.lo; m<rng.hi; ++m)
         {
-        int opix = orig.xyf2pix(i,j,f);
-        if (!approx<double>(orig.map[opix],Healpix_undef))
-          {
-          ++hits;
-          adder.add(orig.map[opix]);
-          }
+        int x,y,f;
+        base_out.pix2xyf(m,x,y,f);
+        int hits = 0;
+        double sum = 0;
+        for (int j=fact*y; j<fact*(y+1); ++j)
+          for (int i=fact*x; i<fact*(x+1); ++i)
+            {
+            T val = in(base_in.xyf2pix(i,j,f));
+            if (!approx<double>(val,Healpix_undef))
+              { ++hits; sum+=val; }
+            }
+        out.v(m) = T((hits<minhits) ? Healpix_undef : sum/hits);
         }
-    map[m] = T((hits<minhits) ? Healpix_undef : adder.result()/hits);
-    }
-}
+    });
   }
 
-template void Healpix_Map<float>::Import_degrade
-  (const Healpix_Map<float> &orig, bool pessimistic);
-template void Healpix_Map<double>::Import_degrade
-  (const Healpix_Map<double> &orig, bool pessimistic);
+template void degrade_map (const Healpix_Base2 &base_in,
+  const mav<float,1> &in, const Healpix_Base2 &base_out, mav<float,1> &out,
+  bool pessimistic, size_t nthreads);
+template void degrade_map (const Healpix_Base2 &base_in,
+  const mav<double,1> &in, const Healpix_Base2 &base_out, mav<double,1> &out,
+  bool pessimistic, size_t nthreads);
 
 template<typename T> void Healpix_Map<T>::minmax (T &Min, T &Max) const
   {
   Min = T(1e30); Max = T(-1e30);
-  for (int m=0; m<npix_; ++m)
+  for (int64_t m=0; m<npix_; ++m)
     {
     T val = map[m];
     if (!approx<double>(val,Healpix_undef))
@@ -111,16 +113,16 @@ template<typename T> Healpix_Map<T> Healpix_Map<T>::median (double rad) const
   {
   Healpix_Map<T> out(Nside(), Scheme(), SET_NSIDE);
 
-  rangeset<int> pixset;
+  rangeset<int64_t> pixset;
   vector<T> list;
-  for (int m=0; m<Npix(); ++m)
+  for (int64_t m=0; m<Npix(); ++m)
     {
     query_disc(pix2ang(m),rad,pixset);
     list.resize(pixset.nval());
     size_t cnt=0;
     for (size_t j=0; j<pixset.nranges(); ++j)
-      for (int i=pixset.ivbegin(j); i<pixset.ivend(j); ++i)
-        if (!approx(map[i], T(Healpix_undef)))
+      for (int64_t i=pixset.ivbegin(j); i<pixset.ivend(j); ++i)
+        if (!approx<double>(map[i], Healpix_undef))
           list[cnt++] = map[i];
     out[m] = (cnt>0) ? mymedian(list.begin(),list.begin()+cnt)
                      : T(Healpix_undef);
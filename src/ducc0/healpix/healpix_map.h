@@ -33,40 +33,147 @@
 #define HEALPIX_MAP_H
 
 #include <vector>
+#include <array>
 #include <algorithm>
-#include "ducc0/error_handling.h"
-#include "ducc0/threading.h"
-#include "Healpix_cxx/healpix_base.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/math/math_utils.h"
+#include "ducc0/healpix/healpix_base.h"
 
 namespace ducc0 {
 
-namespace healpix {
+namespace detail_healpix {
 
 //! Healpix value representing "undefined"
-const double Healpix_undef=-1.6375e30;
+constexpr double Healpix_undef=-1.6375e30;
+
+/*! Stores the map \a in, whose ordering scheme and resolution are described
+    by \a base, in \a out, using the other ordering scheme.
+    \a base must describe a hierarchical map, and \a in and \a out must not
+    overlap. The maps are processed in blocks of NESTED sub-faces, so that
+    both of them are accessed in short contiguous pieces. */
+template<typename T> void reorder_map (const Healpix_Base2 &base,
+  const mav<T,1> &in, mav<T,1> &out, size_t nthreads)
+  {
+  int order = base.Order();
+  MR_assert(order>=0, "need hierarchical map");
+  MR_assert((in.shape(0)==size_t(base.Npix()))
+          &&(out.shape(0)==size_t(base.Npix())), "bad map size");
+  Healpix_Base2 bring(order, RING), bnest(order, NEST);
+  bool to_nest = base.Scheme()==RING;
+  // A sub-face of 64x64 pixels occupies a contiguous range of NESTED indices.
+  // Its diagonals x+y=const lie on a single ring each and have consecutive
+  // RING indices, so both maps are accessed in short contiguous runs.
+  int lbs = std::min(order, 6);
+  int bs = 1<<lbs;
+  Healpix_Base2 bblock(order-lbs, NEST);
+  // NESTED index offsets of the pixels within a sub-face
+  std::vector<int64_t> loc(bs*bs);
+  for (int y=0; y<bs; ++y)
+    for (int x=0; x<bs; ++x)
+      loc[y*bs+x] = bnest.xyf2pix(x,y,0);
+  execDynamic(bblock.Npix(), nthreads, 1, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext())
+      for (auto b=rng.lo; b<rng.hi; ++b)
+        {
+        int x0, y0, f;
+        bblock.pix2xyf(b, x0, y0, f);
+        x0<<=lbs; y0<<=lbs;
+        int64_t nbase = bnest.xyf2pix(x0,y0,f);
+        for (int d=0; d<2*bs-1; ++d)
+          {
+          int xlo=std::max(0,d-bs+1), xhi=std::min(d,bs-1);
+          int64_t rlo = bring.xyf2pix(x0+xlo,y0+d-xlo,f),
+                  rhi = bring.xyf2pix(x0+xhi,y0+d-xhi,f);
+          // the run may wrap around phi=0
+          bool contiguous = (rhi-rlo==xhi-xlo);
+          for (int x=xlo; x<=xhi; ++x)
+            {
+            int64_t pnest = nbase + loc[(d-x)*bs+x];
+            int64_t pring = contiguous ? rlo+(x-xlo)
+                                       : bring.xyf2pix(x0+x,y0+d-x,f);
+            if (to_nest)
+              out.v(pnest) = in(pring);
+            else
+              out.v(pring) = in(pnest);
+            }
+          }
+        }
+    });
+  }
+
+/*! Stores the map \a in (described by \a base_in) in \a out (described by
+    \a base_out), which has a higher resolution. Every pixel of \a out gets
+    the value of the pixel of \a in containing it.
+    \a base_out.Nside() must be an integer multiple of \a base_in.Nside(). */
+template<typename T> void upgrade_map (const Healpix_Base2 &base_in,
+  const mav<T,1> &in, const Healpix_Base2 &base_out, mav<T,1> &out,
+  size_t nthreads)
+  {
+  MR_assert(base_out.Nside()>base_in.Nside(), "this is no upgrade");
+  int fact = base_out.Nside()/base_in.Nside();
+  MR_assert (base_out.Nside()==base_in.Nside()*fact,
+    "the larger Nside must be a multiple of the smaller one");
+  MR_assert((in.shape(0)==size_t(base_in.Npix()))
+          &&(out.shape(0)==size_t(base_out.Npix())), "bad map size");
+
+  execStatic(base_in.Npix(), nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext())
+      for (auto m=rng.lo; m<rng.hi; ++m)
+        {
+        int x,y,f;
+        base_in.pix2xyf(m,x,y,f);
+        T val = in(m);
+        for (int j=fact*y; j<fact*(y+1); ++j)
+          for (int i=fact*x; i<fact*(x+1); ++i)
+            out.v(base_out.xyf2pix(i,j,f)) = val;
+        }
+    });
+  }
+
+/*! Stores the map \a in (described by \a base_in) in \a out (described by
+    \a base_out), which has a lower resolution. Every pixel of \a out gets
+    the average of the defined pixels of \a in which it contains.
+    \a base_in.Nside() must be an integer multiple of \a base_out.Nside().
+    \a pessimistic determines whether or not pixels are set to
+    \a Healpix_undef when not all of the corresponding high-resolution
+    pixels are defined.
+
+    This function is instantiated for \a float and \a double only. */
+template<typename T> void degrade_map (const Healpix_Base2 &base_in,
+  const mav<T,1> &in, const Healpix_Base2 &base_out, mav<T,1> &out,
+  bool pessimistic, size_t nthreads);
 
 /*! A HEALPix map of a given datatype */
-template<typename T> class Healpix_Map: public Healpix_Base
+template<typename T> class Healpix_Map: public Healpix_Base2
   {
   private:
     std::vector<T> map;
 
+    mav<T,1> view() const
+      { return mav<T,1>(map.data(), {map.size()}); }
+    mav<T,1> view()
+      { return mav<T,1>(map.data(), {map.size()}, true); }
+
   public:
     /*! Constructs an unallocated map. */
     Healpix_Map () {}
     /*! Constructs a map with a given \a order and the ordering
         scheme \a scheme. */
     Healpix_Map (int order, Ordering_Scheme scheme)
-      : Healpix_Base (order, scheme), map(npix_) {}
+      : Healpix_Base2 (order, scheme), map(npix_) {}
     /*! Constructs a map with a given \a nside and the ordering
         scheme \a scheme. */
-    Healpix_Map (int nside, Ordering_Scheme scheme, const nside_dummy)
-      : Healpix_Base (nside, scheme, SET_NSIDE), map(npix_) {}
+    Healpix_Map (int64_t nside, Ordering_Scheme scheme, const nside_dummy)
+      : Healpix_Base2 (nside, scheme, SET_NSIDE), map(npix_) {}
     /*! Constructs a map from the contents of \a data and sets the ordering
         scheme to \a Scheme. The size of \a data must be a valid HEALPix
         map size. */
     Healpix_Map (const std::vector<T> &data, Ordering_Scheme scheme)
-      : Healpix_Base (npix2nside(data.size()), scheme, SET_NSIDE), map(data) {}
+      : Healpix_Base2 (npix2nside(data.size()), scheme, SET_NSIDE), map(data) {}
 
     /*! Deletes the old map, creates a map from the contents of \a data and
         sets the ordering scheme to \a scheme. The size of \a data must be a
@@ -74,23 +181,24 @@ template<typename T> class Healpix_Map: public Healpix_Base
         \note On exit, \a data is zero-sized! */
     void Set (std::vector<T> &data, Ordering_Scheme scheme)
       {
-      Healpix_Base::SetNside(npix2nside (data.size()), scheme);
-      map.transfer(data);
+      Healpix_Base2::SetNside(npix2nside (data.size()), scheme);
+      map.clear();
+      map.swap(data);
       }
 
     /*! Deletes the old map and creates a new map  with a given \a order
         and the ordering scheme \a scheme. */
     void Set (int order, Ordering_Scheme scheme)
       {
-      Healpix_Base::Set(order, scheme);
-      map.alloc(npix_);
+      Healpix_Base2::Set(order, scheme);
+      map.assign(npix_, T(0));
       }
     /*! Deletes the old map and creates a new map  with a given \a nside
         and the ordering scheme \a scheme. */
-    void SetNside (int nside, Ordering_Scheme scheme)
+    void SetNside (int64_t nside, Ordering_Scheme scheme)
       {
-      Healpix_Base::SetNside(nside, scheme);
-      map.alloc(npix_);
+      Healpix_Base2::SetNside(nside, scheme);
+      map.assign(npix_, T(0));
       }
 
     /*! Fills the map with \a val. */
@@ -100,18 +208,16 @@ template<typename T> class Healpix_Map: public Healpix_Base
     /*! Imports the map \a orig into the current map, adjusting the
         ordering scheme. \a orig must have the same resolution as the
         current map. */
-    void Import_nograde (const Healpix_Map<T> &orig)
+    void Import_nograde (const Healpix_Map<T> &orig, size_t nthreads=1)
       {
       MR_assert (nside_==orig.nside_,
         "Import_nograde: maps have different nside");
       if (orig.scheme_ == scheme_)
-        for (int m=0; m<npix_; ++m) map[m] = orig.map[m];
+        map = orig.map;
       else
         {
-        swapfunc swapper = (scheme_ == NEST) ?
-          &Healpix_Base::ring2nest : &Healpix_Base::nest2ring;
-#pragma omp parallel for schedule (dynamic,5000)
-        for (int m=0; m<npix_; ++m) map[(this->*swapper)(m)] = orig.map[m];
+        auto out = view();
+        reorder_map(orig, orig.view(), out, nthreads);
         }
       }
 
@@ -119,25 +225,10 @@ template<typename T> class Healpix_Map: public Healpix_Base
         ordering scheme and the map resolution. \a orig must have lower
         resolution than the current map, and \a this->Nside() must be an
         integer multiple of \a orig.Nside(). */
-    void Import_upgrade (const Healpix_Map<T> &orig)
+    void Import_upgrade (const Healpix_Map<T> &orig, size_t nthreads=1)
       {
-      MR_assert(nside_>orig.nside_,"Import_upgrade: this is no upgrade");
-      int fact = nside_/orig.nside_;
-      MR_assert (nside_==orig.nside_*fact,
-        "the larger Nside must be a multiple of the smaller one");
-
-#pragma omp parallel for schedule (dynamic,5000)
-      for (int m=0; m<orig.npix_; ++m)
-        {
-        int x,y,f;
-        orig.pix2xyf(m,x,y,f);
-        for (int j=fact*y; j<fact*(y+1); ++j)
-          for (int i=fact*x; i<fact*(x+1); ++i)
-            {
-            int mypix = xyf2pix(i,j,f);
-            map[mypix] = orig.map[m];
-            }
-        }
+      auto out = view();
+      upgrade_map(orig, orig.view(), *this, out, nthreads);
       }
 
     /*! Imports the map \a orig into the current map, adjusting the
@@ -146,62 +237,47 @@ template<typename T> class Healpix_Map: public Healpix_Base
         integer multiple of \a this->Nside().
         \a pessimistic determines whether or not
         pixels are set to \a Healpix_undef when not all of the corresponding
-        high-resolution pixels are defined.
-
-        This method is instantiated for \a float and \a double only. */
-    void Import_degrade (const Healpix_Map<T> &orig, bool pessimistic=false);
+        high-resolution pixels are defined. */
+    void Import_degrade (const Healpix_Map<T> &orig, bool pessimistic=false,
+      size_t nthreads=1)
+      {
+      auto out = view();
+      degrade_map(orig, orig.view(), *this, out, pessimistic, nthreads);
+      }
 
     /*! Imports the map \a orig into the current map, adjusting the
         ordering scheme and the map resolution if necessary.
         When downgrading, \a pessimistic determines whether or not
         pixels are set to \a Healpix_undef when not all of the corresponding
-        high-resolution pixels are defined.
-
-        This method is instantiated for \a float and \a double only. */
-    void Import (const Healpix_Map<T> &orig, bool pessimistic=false)
+        high-resolution pixels are defined. */
+    void Import (const Healpix_Map<T> &orig, bool pessimistic=false,
+      size_t nthreads=1)
       {
       if (orig.nside_ == nside_) // no up/degrading
-        Import_nograde(orig);
+        Import_nograde(orig, nthreads);
       else if (orig.nside_ < nside_) // upgrading
-        Import_upgrade(orig);
+        Import_upgrade(orig, nthreads);
       else
-        Import_degrade(orig,pessimistic);
+        Import_degrade(orig, pessimistic, nthreads);
       }
 
     /*! Returns a constant reference to the pixel with the number \a pix. */
-    const T &operator[] (int pix) const { return map[pix]; }
+    const T &operator[] (int64_t pix) const { return map[pix]; }
     /*! Returns a reference to the pixel with the number \a pix. */
-    T &operator[] (int pix) { return map[pix]; }
+    T &operator[] (int64_t pix) { return map[pix]; }
 
     /*! Swaps the map ordering from RING to NEST and vice versa.
-        This is done in-place (i.e. with negligible space overhead). */
-    void swap_scheme()
+        This needs a temporary copy of the map. */
+    void swap_scheme(size_t nthreads=1)
       {
-      swapfunc swapper = (scheme_ == NEST) ?
-        &Healpix_Base::ring2nest : &Healpix_Base::nest2ring;
-
-      std::vector<int> cycle=swap_cycles();
-
-#pragma omp parallel for schedule(dynamic,1)
-      for (size_t m=0; m<cycle.size(); ++m)
-        {
-        int istart = cycle[m];
-
-        T pixbuf = map[istart];
-        int iold = istart, inew = (this->*swapper)(istart);
-        while (inew != istart)
-          {
-          map[iold] = map[inew];
-          iold = inew;
-          inew = (this->*swapper)(inew);
-          }
-        map[iold] = pixbuf;
-        }
+      std::vector<T> tmp(map);
+      auto out = view();
+      reorder_map(*this, mav<T,1>(tmp.data(), {tmp.size()}), out, nthreads);
       scheme_ = (scheme_==RING) ? NEST : RING;
       }
 
     /*! performs the actual interpolation using \a pix and \a wgt. */
-    T interpolation (const std::array<int,4> &pix,
+    T interpolation (const std::array<int64_t,4> &pix,
       const std::array<double,4> &wgt) const
       {
       double wtot=0;
@@ -217,7 +293,7 @@ template<typename T> class Healpix_Map: public Healpix_Base
     /*! Returns the interpolated map value at \a ptg */
     T interpolated_value (const pointing &ptg) const
       {
-      std::array<int,4> pix;
+      std::array<int64_t,4> pix;
       std::array<double,4> wgt;
       get_interpol (ptg, pix, wgt);
       return interpolation (pix, wgt);
@@ -235,7 +311,7 @@ template<typename T> class Healpix_Map: public Healpix_Base
     /*! Swaps the contents of two Healpix_Map objects. */
     void swap (Healpix_Map &other)
       {
-      Healpix_Base::swap(other);
+      Healpix_Base2::swap(other);
       map.swap(other.map);
       }
 
@@ -243,8 +319,8 @@ template<typename T> class Healpix_Map: public Healpix_Base
     double average() const
       {
       tree_adder<double> adder;
-      int pix=0;
-      for (int m=0; m<npix_; ++m)
+      int64_t pix=0;
+      for (int64_t m=0; m<npix_; ++m)
         if (!approx<double>(map[m],Healpix_undef))
           { ++pix; adder.add(map[m]); }
       return (pix>0) ? adder.result()/pix : Healpix_undef;
@@ -253,7 +329,7 @@ template<typename T> class Healpix_Map: public Healpix_Base
     /*! Adds \a val to all defined map pixels. */
     void Add (T val)
       {
-      for (int m=0; m<npix_; ++m)
+      for (int64_t m=0; m<npix_; ++m)
         if (!approx<double>(map[m],Healpix_undef))
           { map[m]+=val; }
       }
@@ -261,7 +337,7 @@ template<typename T> class Healpix_Map: public Healpix_Base
     /*! Multiplies all defined map pixels by \a val. */
     void Scale (T val)
       {
-      for (int m=0; m<npix_; ++m)
+      for (int64_t m=0; m<npix_; ++m)
         if (!approx<double>(map[m],Healpix_undef))
           { map[m]*=val; }
       }
@@ -270,32 +346,28 @@ template<typename T> class Healpix_Map: public Healpix_Base
         pixels. */
     double rms() const
       {
-      using namespace std;
-
       double result=0;
-      int pix=0;
-      for (int m=0; m<npix_; ++m)
+      int64_t pix=0;
+      for (int64_t m=0; m<npix_; ++m)
         if (!approx<double>(map[m],Healpix_undef))
           { ++pix; result+=map[m]*map[m]; }
-      return (pix>0) ? sqrt(result/pix) : Healpix_undef;
+      return (pix>0) ? std::sqrt(result/pix) : Healpix_undef;
       }
     /*! Returns the maximum absolute value in the map, ignoring undefined
         pixels. */
     T absmax() const
       {
-      using namespace std;
-
       T result=0;
-      for (int m=0; m<npix_; ++m)
+      for (int64_t m=0; m<npix_; ++m)
         if (!approx<double>(map[m],Healpix_undef))
-          { result = max(result,abs(map[m])); }
+          { result = std::max(result,std::abs(map[m])); }
       return result;
       }
     /*! Returns \a true, if no pixel has the value \a Healpix_undef,
         else \a false. */
     bool fullyDefined() const
       {
-      for (int m=0; m<npix_; ++m)
+      for (int64_t m=0; m<npix_; ++m)
         if (approx<double>(map[m],Healpix_undef))
           return false;
       return true;
@@ -305,17 +377,27 @@ template<typename T> class Healpix_Map: public Healpix_Base
     size_t replaceUndefWith0()
       {
       size_t res=0;
-      for (int m=0; m<npix_; ++m)
+      for (int64_t m=0; m<npix_; ++m)
         if (approx<double>(map[m],Healpix_undef))
           { map[m]=0.; ++res; }
       return res;
       }
 
     /*! Returns a map that contains at each pixel the median value of all
-        pixels within the radius \a rad (in radians) around the pixel center. */
+        pixels within the radius \a rad (in radians) around the pixel center.
+
+        This method is instantiated for \a float and \a double only. */
     Healpix_Map median(double rad) const;
   };
 
-}}
+}
+
+using detail_healpix::Healpix_undef;
+using detail_healpix::reorder_map;
+using detail_healpix::upgrade_map;
+using detail_healpix::degrade_map;
+using detail_healpix::Healpix_Map;
+
+}
 
 #endif
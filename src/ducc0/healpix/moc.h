@@ -32,13 +32,20 @@
 #ifndef HEALPIX_MOC_H
 #define HEALPIX_MOC_H
 
-#include "Healpix_cxx/healpix_base.h"
-#include "ducc0/compress_utils.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "ducc0/math/math_utils.h"
+#include "ducc0/math/rangeset.h"
+#include "ducc0/healpix/healpix_base.h"
 
 namespace ducc0 {
 
-namespace healpix {
+namespace detail_healpix {
 
+/*! A multi-order coverage map (MOC) of the sphere.
+    Internally, the covered area is stored as a set of NESTED pixel ranges
+    at order \a maxorder; a cell of any lower order occupies a single range. */
 template<typename I> class Moc
   {
   public:
@@ -55,13 +62,56 @@ template<typename I> class Moc
       }
 
   public:
-    const rangeset<I> &Rs() { return rs; }
+    /*! Returns a Moc covering the pixels in \a pixset, which contains NESTED
+        pixel indices at order \a order. */
+    static Moc fromRangeset(int order, const rangeset<I> &pixset)
+      {
+      MR_assert((order>=0)&&(order<=maxorder), "bad order");
+      int shift=2*(maxorder-order);
+      Moc res;
+      res.rs.reserve(pixset.nranges());
+      for (size_t i=0; i<pixset.nranges(); ++i)
+        res.rs.append(pixset.ivbegin(i)<<shift, pixset.ivend(i)<<shift);
+      return res;
+      }
+
+    /*! Returns a Moc covering all pixels of order \a order whose centers
+        lie within \a radius of \a ptg (\a fact==0), or which overlap with
+        this disc (\a fact>0; see T_Healpix_Base::query_disc_inclusive()).
+        The query is carried out in the NEST scheme, so all cells of lower
+        order that lie completely inside the disc are obtained as single
+        ranges and never expanded into individual pixels. */
+    static Moc queryDisc(int order, pointing ptg, double radius, int fact=0)
+      {
+      T_Healpix_Base<I> base(order, NEST);
+      rangeset<I> pixset;
+      (fact==0) ? base.query_disc(ptg, radius, pixset)
+                : base.query_disc_inclusive(ptg, radius, pixset, fact);
+      return fromRangeset(order, pixset);
+      }
+    /*! Returns a Moc covering all pixels of order \a order whose centers
+        lie within the convex polygon defined by \a vertex (\a fact==0), or
+        which overlap with the polygon (\a fact>0; see
+        T_Healpix_Base::query_polygon_inclusive()).
+        Like queryDisc(), this never expands lower-order cells. */
+    static Moc queryPolygon(int order, const std::vector<pointing> &vertex,
+      int fact=0)
+      {
+      T_Healpix_Base<I> base(order, NEST);
+      rangeset<I> pixset;
+      (fact==0) ? base.query_polygon(vertex, pixset)
+                : base.query_polygon_inclusive(vertex, pixset, fact);
+      return fromRangeset(order, pixset);
+      }
+
+    const rangeset<I> &Rs() const { return rs; }
     size_t maxOrder() const
       {
       I combo=0;
       for (size_t i=0; i<rs.nranges(); ++i)
         combo|=rs.ivbegin(i)|rs.ivend(i);
-      return maxorder-(trailingZeros(combo)>>1);
+      // an empty Moc or one consisting of whole base cells has order 0
+      return maxorder-std::min<int>(maxorder,trailingZeros(combo)>>1);
       }
     Moc degradedToOrder (int order, bool keepPartialCells) const
       {
@@ -84,6 +134,17 @@ template<typename I> class Moc
       int shift=2*(maxorder-order);
       rs.add(p1<<shift,p2<<shift);
       }
+    /*! Adds all pixel ranges \a [first;second[ of order \a order in
+        \a ranges to the Moc. The ranges may be given in any order; they are
+        sorted and merged with the Moc in a single pass
+        (see rangeset::add()). */
+    void addPixelRanges (int order, std::vector<std::pair<I,I>> ranges)
+      {
+      int shift=2*(maxorder-order);
+      for (auto &rng: ranges)
+        { rng.first<<=shift; rng.second<<=shift; }
+      rs.add(std::move(ranges));
+      }
     void appendPixelRange (int order, I p1, I p2)
       {
       int shift=2*(maxorder-order);
@@ -91,6 +152,10 @@ template<typename I> class Moc
       }
     void appendPixel (int order, I p)
       { appendPixelRange(order,p,p+1); }
+    /* The set operations below merge the sorted range boundaries of both
+       operands in a single pass (rangeset::generalUnion()); if one operand
+       has far fewer ranges than the other, its boundaries are located by
+       binary search instead. */
     /*! Returns a new Moc that contains the union of this Moc and \a other. */
     Moc op_or (const Moc &other) const
       { return fromNewRangeSet(rs.op_or(other.rs)); }
@@ -104,6 +169,26 @@ template<typename I> class Moc
         contained in \a other. */
     Moc op_andnot (const Moc &other) const
       { return fromNewRangeSet(rs.op_andnot(other.rs)); }
+    /*! Returns a new Moc that contains the union of all Mocs in \a mocs.
+        The Mocs are merged pairwise in a balanced tree, so every range
+        takes part in only O(log(mocs.size())) merge passes. */
+    static Moc unionOf (const std::vector<Moc> &mocs)
+      {
+      if (mocs.empty()) return Moc();
+      std::vector<Moc> tmp;
+      const std::vector<Moc> *cur = &mocs;
+      while (cur->size()>1)
+        {
+        std::vector<Moc> next((cur->size()+1)>>1);
+        for (size_t i=0; i+1<cur->size(); i+=2)
+          next[i>>1] = (*cur)[i].op_or((*cur)[i+1]);
+        if (cur->size()&1)
+          next.back() = cur->back();
+        tmp.swap(next);
+        cur = &tmp;
+        }
+      return (*cur)[0];
+      }
     /*! Returns the complement of this Moc. */
     Moc complement() const
       {
@@ -217,21 +302,13 @@ template<typename I> class Moc
       sort(vu.begin()+start,vu.end());
       }
 
+    /*! Returns a compact binary representation of this Moc
+        (see rangeset::serialize()). */
     std::vector<uint8_t> toCompressed() const
-      {
-      obitstream obs;
-      interpol_encode(rs.data().begin(),rs.data().end(),obs);
-      return obs.state();
-      }
+      { return rs.serialize(); }
+    /*! Returns the Moc stored in \a data by toCompressed(). */
     static Moc fromCompressed(const std::vector<uint8_t> &data)
-      {
-      ibitstream ibs(data);
-      std::vector<I> v;
-      interpol_decode(v,ibs);
-      Moc out;
-      out.rs.setData(v);
-      return out;
-      }
+      { return fromNewRangeSet(rangeset<I>::deserialize(data)); }
 
     bool operator==(const Moc &other) const
       {
@@ -246,6 +323,10 @@ template<typename I> class Moc
       { return rs.nval(); }
   };
 
-}}
+}
+
+using detail_healpix::Moc;
+
+}
 
 #endif
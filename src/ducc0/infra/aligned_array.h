@@ -22,8 +22,14 @@
 #ifndef DUCC0_ALIGNED_ARRAY_H
 #define DUCC0_ALIGNED_ARRAY_H
 
+#include <atomic>
 #include <cstdlib>
 #include <memory>
+#include <vector>
+#include "ducc0/infra/threading.h"
+#if defined(__linux__) && (!defined(DUCC0_NO_HUGEPAGES))
+#include <sys/mman.h>
+#endif
 
 namespace ducc0 {
 
@@ -31,53 +37,219 @@ namespace detail_aligned_array {
 
 using namespace std;
 
+// FIXME: let's not use aligned_alloc on Apple for the moment,
+// it's only supported from 10.15 on...
+#if ((__cplusplus >= 201703L) && (!defined(__APPLE__)))
+/* Returns \a bytes bytes of memory aligned to \a align (a power of 2). */
+inline void *raw_alloc(size_t bytes, size_t align)
+  {
+  void *res = aligned_alloc(align, (bytes+align-1)&(~(align-1)));
+  if (!res) throw bad_alloc();
+  return res;
+  }
+inline void raw_dealloc(void *ptr)
+  { free(ptr); }
+#else // portable emulation
+inline void *raw_alloc(size_t bytes, size_t align)
+  {
+  void *ptr = malloc(bytes+align);
+  if (!ptr) throw bad_alloc();
+  void *res = reinterpret_cast<void *>
+    ((reinterpret_cast<size_t>(ptr) & ~(align-1)) + align);
+  (reinterpret_cast<void**>(res))[-1] = ptr;
+  return res;
+  }
+inline void raw_dealloc(void *ptr)
+  { if (ptr) free((reinterpret_cast<void**>(ptr))[-1]); }
+#endif
+
+/*! Per-thread cache of memory blocks for short-lived scratch arrays (see
+    scratch_array), which avoids calls to malloc()/free() and the page faults
+    of freshly mapped memory in frequently executed code.
+    Block sizes are rounded up to powers of 2. Released blocks are kept for
+    reuse as long as the cache of the releasing thread holds at most
+    max_per_class blocks of that size and get_max_cached() bytes in total
+    (64 MiB by default). So every thread that has used scratch arrays can
+    keep up to that much memory allocated after the arrays are gone, until
+    it exits; trim() returns the cached blocks of the calling thread to the
+    system, and set_max_cached() changes the limit for all threads.
+    On Linux, blocks of at least hugepage_size bytes are aligned to that size
+    and marked for backing by transparent huge pages, unless
+    DUCC0_NO_HUGEPAGES is defined. */
+class scratch_pool
+  {
+  private:
+    static constexpr size_t min_class = 6;  // 64 bytes
+    static constexpr size_t nclasses = 8*sizeof(size_t);
+    static constexpr size_t max_per_class = 4;
+    static constexpr size_t hugepage_size = size_t(2)<<20;
+
+    vector<void *> cache[nclasses];
+    size_t cached;
+
+    // 0: not yet constructed, 1: alive, 2: destroyed at thread exit
+    static inline thread_local int state = 0;
+    static inline atomic<size_t> max_cached{size_t(64)<<20};
+
+    scratch_pool() : cached(0)
+      {
+      for (auto &c: cache) c.reserve(max_per_class);
+      state = 1;
+      }
+    ~scratch_pool()
+      {
+      state = 2;
+      for (auto &c: cache)
+        for (auto ptr: c)
+          raw_dealloc(ptr);
+      }
+
+    // returns the pool of the calling thread, or nullptr during thread exit
+    static scratch_pool *get()
+      {
+      if (state==2) return nullptr;
+      static thread_local scratch_pool pool;
+      return &pool;
+      }
+
+    // releases cached blocks, largest first, until at most limit bytes
+    // are left
+    void shrink(size_t limit)
+      {
+      for (size_t cls=nclasses; (cls>min_class) && (cached>limit); --cls)
+        while ((!cache[cls-1].empty()) && (cached>limit))
+          {
+          raw_dealloc(cache[cls-1].back());
+          cache[cls-1].pop_back();
+          cached -= size_t(1)<<(cls-1);
+          }
+      }
+
+    static size_t size_class(size_t bytes)
+      {
+      size_t res = min_class;
+      while ((size_t(1)<<res)<bytes) ++res;
+      return res;
+      }
+
+    static void *alloc_block(size_t bytes)
+      {
+#if defined(__linux__) && (!defined(DUCC0_NO_HUGEPAGES))
+      if (bytes>=hugepage_size)
+        {
+        void *res = raw_alloc(bytes, hugepage_size);
+        // only a hint; failure is harmless
+        madvise(res, bytes, MADV_HUGEPAGE);
+        return res;
+        }
+#endif
+      return raw_alloc(bytes, 64);
+      }
+
+  public:
+    /*! Returns a block of at least \a bytes bytes, aligned to 64 bytes. */
+    static void *alloc(size_t bytes)
+      {
+      size_t cls = size_class(bytes);
+      auto pool = get();
+      if (pool && (!pool->cache[cls].empty()))
+        {
+        void *res = pool->cache[cls].back();
+        pool->cache[cls].pop_back();
+        pool->cached -= size_t(1)<<cls;
+        return res;
+        }
+      return alloc_block(size_t(1)<<cls);
+      }
+    /*! Releases \a ptr, which was obtained from alloc(\a bytes) (possibly
+        on another thread). */
+    static void dealloc(void *ptr, size_t bytes)
+      {
+      size_t cls = size_class(bytes);
+      auto pool = get();
+      size_t limit = max_cached.load(memory_order_relaxed);
+      // the limit may have been lowered by another thread
+      if (pool && (pool->cached>limit))
+        pool->shrink(limit);
+      if (pool && (pool->cache[cls].size()<max_per_class)
+        && (pool->cached+(size_t(1)<<cls)<=limit))
+        {
+        pool->cache[cls].push_back(ptr);
+        pool->cached += size_t(1)<<cls;
+        return;
+        }
+      raw_dealloc(ptr);
+      }
+
+    /*! Releases the blocks cached by the calling thread, keeping at most
+        \a keep bytes. */
+    static void trim(size_t keep=0)
+      {
+      auto pool = get();
+      if (pool) pool->shrink(keep);
+      }
+    /*! Returns the number of bytes cached by the calling thread. */
+    static size_t cached_bytes()
+      {
+      auto pool = get();
+      return pool ? pool->cached : 0;
+      }
+    /*! Sets the number of bytes every thread may cache; 0 disables the
+        caching. The cache of the calling thread is trimmed immediately,
+        those of other threads the next time they release a block. */
+    static void set_max_cached(size_t bytes)
+      {
+      max_cached = bytes;
+      trim(bytes);
+      }
+    static size_t get_max_cached()
+      { return max_cached; }
+  };
+
 /*! Simple array class guaranteeing 64-byte alignment of the data pointer.
-    Mostly useful for storing data accessed by SIMD instructions. */
-template<typename T> class aligned_array
+    Mostly useful for storing data accessed by SIMD instructions.
+    If \a pooled is true, the memory is obtained from the scratch_pool of
+    the calling thread. */
+template<typename T, bool pooled=false> class aligned_array
   {
   private:
     T *p;
     size_t sz;
 
-// FIXME: let's not use aligned_alloc on Apple for the moment,
-// it's only supported from 10.15 on...
-#if ((__cplusplus >= 201703L) && (!defined(__APPLE__)))
     static T *ralloc(size_t num)
       {
       if (num==0) return nullptr;
-      void *res = aligned_alloc(64,num*sizeof(T));
-      if (!res) throw bad_alloc();
-      return reinterpret_cast<T *>(res);
+      if constexpr (pooled)
+        return reinterpret_cast<T *>(scratch_pool::alloc(num*sizeof(T)));
+      else
+        return reinterpret_cast<T *>(raw_alloc(num*sizeof(T), 64));
       }
-    static void dealloc(T *ptr)
-      { free(ptr); }
-#else // portable emulation
-    static T *ralloc(size_t num)
+    static void dealloc(T *ptr, size_t num)
       {
-      if (num==0) return nullptr;
-      void *ptr = malloc(num*sizeof(T)+64);
-      if (!ptr) throw bad_alloc();
-      T *res = reinterpret_cast<T *>
-        ((reinterpret_cast<size_t>(ptr) & ~(size_t(63))) + 64);
-      (reinterpret_cast<void**>(res))[-1] = ptr;
-      return res;
+      if (!ptr) return;
+      if constexpr (pooled)
+        scratch_pool::dealloc(ptr, num*sizeof(T));
+      else
+        raw_dealloc(ptr);
       }
-    static void dealloc(T *ptr)
-      { if (ptr) free((reinterpret_cast<void**>(ptr))[-1]); }
-#endif
 
   public:
     aligned_array() : p(nullptr), sz(0) {}
     aligned_array(size_t n) : p(ralloc(n)), sz(n) {}
+    /*! Allocates \a n elements and value-initializes them with \a nthreads
+        threads, such that every thread touches the elements it would get
+        in execStatic(n, nthreads, 0, ...) (see first_touch_init()). */
+    aligned_array(size_t n, size_t nthreads) : p(ralloc(n)), sz(n)
+      { first_touch_init(p, n, 1, nthreads); }
     aligned_array(aligned_array &&other)
       : p(other.p), sz(other.sz)
       { other.p=nullptr; other.sz=0; }
-    ~aligned_array() { dealloc(p); }
+    ~aligned_array() { dealloc(p, sz); }
 
     void resize(size_t n)
       {
       if (n==sz) return;
-      dealloc(p);
+      dealloc(p, sz);
       p = ralloc(n);
       sz = n;
       }
@@ -91,9 +263,15 @@ template<typename T> class aligned_array
     size_t size() const { return sz; }
   };
 
+/*! Aligned array for short-lived scratch data, whose memory is recycled
+    through a per-thread pool. */
+template<typename T> using scratch_array = aligned_array<T, true>;
+
 }
 
 using detail_aligned_array::aligned_array;
+using detail_aligned_array::scratch_array;
+using detail_aligned_array::scratch_pool;
 
 }
 
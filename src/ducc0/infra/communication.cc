@@ -23,6 +23,8 @@
 #include <cstring>
 #include <numeric>
 #include <unordered_map>
+#include <deque>
+#include <mutex>
 #include "ducc0/infra/communication.h"
 #include "ducc0/infra/error_handling.h"
 
@@ -186,6 +188,71 @@ void Communicator::all2allvRawVoid (const void *in, const int *numin,
 void Communicator::bcastRawVoid (void *data, type_index type, size_t num, int root) const
   { MPI_Bcast (data,num,ndt2mpi(type),root,comm_); }
 
+Communicator::Request::Request()
+  : req_(MPI_REQUEST_NULL) {}
+Communicator::Request::Request(Request &&other) noexcept
+  : req_(other.req_)
+  { other.req_=MPI_REQUEST_NULL; }
+Communicator::Request &Communicator::Request::operator=(Request &&other)
+  {
+  if (&other!=this)
+    {
+    wait();
+    req_=other.req_;
+    other.req_=MPI_REQUEST_NULL;
+    }
+  return *this;
+  }
+Communicator::Request::~Request()
+  { wait(); }
+
+void Communicator::Request::wait()
+  { MPI_Wait(&req_, MPI_STATUS_IGNORE); }
+bool Communicator::Request::test()
+  {
+  int flag=0;
+  MPI_Test(&req_, &flag, MPI_STATUS_IGNORE);
+  return flag;
+  }
+
+Communicator::Request Communicator::isendRawVoid (const void *data,
+  type_index type, size_t num, size_t dest) const
+  {
+  Request res;
+  MPI_Isend (const_cast<void *>(data),num,ndt2mpi(type),dest,0,comm_,
+    &res.req_);
+  return res;
+  }
+Communicator::Request Communicator::irecvRawVoid (void *data, type_index type,
+  size_t num, size_t src) const
+  {
+  Request res;
+  MPI_Irecv (data,num,ndt2mpi(type),src,0,comm_,&res.req_);
+  return res;
+  }
+Communicator::Request Communicator::iallreduceRawVoid (const void *in,
+  void *out, type_index type, size_t num, redOp op) const
+  {
+  Request res;
+  void *in2 = (in==out) ? MPI_IN_PLACE : const_cast<void *>(in);
+  MPI_Iallreduce (in2,out,num,ndt2mpi(type),op2mop(op),comm_,&res.req_);
+  return res;
+  }
+Communicator::Request Communicator::iall2allvRawVoid (const void *in,
+  const int *numin, const int *disin, void *out, const int *numout,
+  const int *disout, type_index type) const
+  {
+  long commsz=disin[num_ranks_-1]+numin[num_ranks_-1]
+             +disout[num_ranks_-1]+numout[num_ranks_-1];
+  if (commsz>0) assert_unequal(in,out);
+  Request res;
+  MPI_Datatype tp = ndt2mpi(type);
+  MPI_Ialltoallv (const_cast<void *>(in), const_cast<int *>(numin),
+    const_cast<int *>(disin), tp, out, const_cast<int *>(numout),
+    const_cast<int *>(disout), tp, comm_, &res.req_);
+  return res;
+  }
+
 #else
 
 //static
@@ -262,6 +329,132 @@ void Communicator::all2allvRawVoid (const void *in, const int *numin,
 void Communicator::bcastRawVoid (void *, type_index, size_t, int) const
   {}
 
+/* Without MPI, the only peer of a point-to-point operation is the task
+   itself. Sends are buffered and complete immediately; a receive completes
+   as soon as a message is available (i.e. when it is posted, or when the
+   next send is posted). */
+class SelfMessages
+  {
+  private:
+    struct Posted
+      {
+      void *data;
+      type_index type;
+      size_t num;
+      shared_ptr<bool> done;
+      };
+    mutex mut;
+    deque<pair<type_index, vector<char>>> sent;
+    deque<Posted> posted;
+
+    static void deliver(const pair<type_index, vector<char>> &msg,
+      const Posted &recv)
+      {
+      MR_assert(msg.first==recv.type, "message type mismatch");
+      MR_assert(msg.second.size()<=recv.num*typesize(recv.type),
+        "message truncated");
+      memcpy(recv.data, msg.second.data(), msg.second.size());
+      *recv.done=true;
+      }
+
+  public:
+    void send(const void *data, type_index type, size_t num)
+      {
+      auto ptr = static_cast<const char *>(data);
+      pair<type_index, vector<char>> msg(type,
+        vector<char>(ptr, ptr+num*typesize(type)));
+      lock_guard<mutex> lock(mut);
+      if (posted.empty())
+        sent.push_back(move(msg));
+      else
+        {
+        deliver(msg, posted.front());
+        posted.pop_front();
+        }
+      }
+    void recv(void *data, type_index type, size_t num,
+      const shared_ptr<bool> &done)
+      {
+      Posted recv{data, type, num, done};
+      lock_guard<mutex> lock(mut);
+      if (sent.empty())
+        posted.push_back(recv);
+      else
+        {
+        deliver(sent.front(), recv);
+        sent.pop_front();
+        }
+      }
+    void cancel(const shared_ptr<bool> &done)
+      {
+      lock_guard<mutex> lock(mut);
+      for (auto it=posted.begin(); it!=posted.end(); ++it)
+        if (it->done==done)
+          { posted.erase(it); return; }
+      }
+  };
+
+SelfMessages &self_messages()
+  {
+  static SelfMessages res;
+  return res;
+  }
+
+Communicator::Request::Request()
+  : done_(make_shared<bool>(true)) {}
+Communicator::Request::Request(Request &&other) noexcept
+  : done_(move(other.done_))
+  { other.done_=make_shared<bool>(true); }
+Communicator::Request &Communicator::Request::operator=(Request &&other)
+  {
+  if (&other!=this)
+    {
+    wait();
+    swap(done_, other.done_);
+    }
+  return *this;
+  }
+Communicator::Request::~Request()
+  {
+  // an unmatched receive can never complete; forget about it
+  if (!*done_) self_messages().cancel(done_);
+  }
+
+void Communicator::Request::wait()
+  { MR_assert(*done_, "receive without matching send"); }
+bool Communicator::Request::test()
+  { return *done_; }
+
+Communicator::Request Communicator::isendRawVoid (const void *data,
+  type_index type, size_t num, size_t dest) const
+  {
+  MR_assert (dest==0, "inconsistent call");
+  self_messages().send(data, type, num);
+  return Request();
+  }
+Communicator::Request Communicator::irecvRawVoid (void *data, type_index type,
+  size_t num, size_t src) const
+  {
+  MR_assert (src==0, "inconsistent call");
+  Request res;
+  *res.done_=false;
+  self_messages().recv(data, type, num, res.done_);
+  return res;
+  }
+Communicator::Request Communicator::iallreduceRawVoid (const void *in,
+  void *out, type_index type, size_t num, redOp op) const
+  {
+  allreduceRawVoid(in, out, type, num, op);
+  return Request();
+  }
+Communicator::Request Communicator::iall2allvRawVoid (const void *in,
+  const int *numin, const int *disin, void *out, const int *numout,
+  const int *disout, type_index type) const
+  {
+  all2allvRawVoid(in, numin, disin, out, numout, disout, type);
+  return Request();
+  }
+
 #endif
 
 }}
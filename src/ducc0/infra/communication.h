@@ -27,6 +27,7 @@
 #define DUCC0_USE_MPI
 
 #include <vector>
+#include <memory>
 #ifdef DUCC0_USE_MPI
 #include <mpi.h>
 #endif
@@ -58,6 +59,36 @@ class Communicator
     using CommType = struct{};
 #endif
 
+    /*! Handle of a nonblocking communication operation.
+        The operation is complete once wait() has returned, or test() has
+        returned \c true. All buffers passed to the operation (including
+        count and displacement arrays) must stay valid and must not be
+        modified before that. A handle going out of scope waits for the
+        completion of its operation. */
+    class Request
+      {
+      private:
+        friend class Communicator;
+#ifdef DUCC0_USE_MPI
+        MPI_Request req_;
+#else
+        shared_ptr<bool> done_;
+#endif
+
+      public:
+        Request();
+        Request(Request &&other) noexcept;
+        Request &operator=(Request &&other);
+        Request(const Request &) = delete;
+        Request &operator=(const Request &) = delete;
+        ~Request();
+
+        /*! Blocks until the operation has completed. */
+        void wait();
+        /*! Returns \c true if the operation has completed, without blocking. */
+        bool test();
+      };
+
   private:
     CommType comm_;
     int rank_, num_ranks_;
@@ -80,6 +111,16 @@ class Communicator
       void *out, const int *numout, const int *disout, type_index type) const;
     void bcastRawVoid (void *data, type_index type, size_t num, int root) const;
 
+    Request isendRawVoid (const void *data, type_index type, size_t num,
+      size_t dest) const;
+    Request irecvRawVoid (void *data, type_index type, size_t num, size_t src)
+      const;
+    Request iallreduceRawVoid (const void *in, void *out, type_index type,
+      size_t num, redOp op) const;
+    Request iall2allvRawVoid (const void *in, const int *numin,
+      const int *disin, void *out, const int *numout, const int *disout,
+      type_index type) const;
+
   public:
     Communicator();
     ~Communicator();
@@ -147,6 +188,22 @@ class Communicator
 
     template<typename T> void bcastRaw (T *data, size_t num, int root=0) const
       { bcastRawVoid (data, tidx<T>(), num, root); }
+
+    /* Nonblocking operations: these start the communication and return
+       immediately; the results are only available after the returned
+       Request has completed. */
+    template<typename T> Request isendRaw (const T *data, size_t num,
+      size_t dest) const
+      { return isendRawVoid (data, tidx<T>(), num, dest); }
+    template<typename T> Request irecvRaw (T *data, size_t num, size_t src)
+      const
+      { return irecvRawVoid (data, tidx<T>(), num, src); }
+    template<typename T> Request iallreduceRaw (const T *in, T *out,
+      size_t num, redOp op) const
+      { return iallreduceRawVoid (in, out, tidx<T>(), num, op); }
+    template<typename T> Request iall2allvRaw (const T *in, const int *numin,
+      const int *disin, T *out, const int *numout, const int *disout) const
+      { return iall2allvRawVoid (in,numin,disin,out,numout,disout,tidx<T>()); }
   };
 
 }
@@ -27,7 +27,14 @@
 #include <vector>
 #include <memory>
 #include <numeric>
+#include <type_traits>
+#include <tuple>
+#include <utility>
+#include <algorithm>
 #include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/aligned_array.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/mmap_file.h"
 
 namespace ducc0 {
 
@@ -38,7 +45,8 @@ using namespace std;
 template<typename T> class membuf
   {
   protected:
-    using Tsp = shared_ptr<vector<T>>;
+    // owner of the memory (a vector<T> or an aligned_array<T>)
+    using Tsp = shared_ptr<void>;
     Tsp ptr;
     const T *d;
     bool rw;
@@ -56,7 +64,34 @@ template<typename T> class membuf
       : d(d_), rw(false) {}
     // allocate own memory
     membuf(size_t sz)
-      : ptr(make_shared<vector<T>>(sz)), d(ptr->data()), rw(true) {}
+      : rw(true)
+      {
+      auto tmp = make_shared<vector<T>>(sz);
+      d = tmp->data();
+      ptr = move(tmp);
+      }
+    // allocate own memory, consisting of nblocks blocks which are
+    // value-initialized by nthreads threads (see first_touch_init())
+    membuf(size_t nblocks, size_t blocksize, size_t nthreads)
+      : rw(true)
+      {
+      static_assert(is_trivially_destructible<T>::value,
+        "T must be trivially destructible");
+      auto tmp = make_shared<aligned_array<T>>(nblocks*blocksize);
+      first_touch_init(tmp->data(), nblocks, blocksize, nthreads);
+      d = tmp->data();
+      ptr = move(tmp);
+      }
+    // view a part of a memory-mapped file, starting at byte offset ofs
+    membuf(const shared_ptr<mmap_file> &file, size_t ofs, size_t sz)
+      : ptr(file), d(reinterpret_cast<const T *>(file->data()+ofs)),
+        rw(file->writable())
+      {
+      static_assert(is_trivially_copyable<T>::value,
+        "T must be trivially copyable");
+      MR_assert(ofs+sz*sizeof(T)<=file->size(), "file is too small");
+      MR_assert((ofs%alignof(T))==0, "misaligned offset");
+      }
     // share another memory buffer, but read-only
     membuf(const membuf &other)
       : ptr(other.ptr), d(other.d), rw(false) {}
@@ -305,7 +340,7 @@ template<typename T> class fmav: public fmav_info, public membuf<T>
         nofs+=i0[i]*str[i];
         if (extent[i]!=0)
           {
-          MR_assert(i0[i]+extent[i2]<=shp[i], "bad subset");
+          MR_assert(i0[i]+extent[i]<=shp[i], "bad subset");
           nshp[i2] = extent[i]; nstr[i2]=str[i];
           ++i2;
           }
@@ -326,6 +361,11 @@ template<typename T> class fmav: public fmav_info, public membuf<T>
       : tinfo(shp_), tbuf(d_,rw_) {}
     fmav(const shape_t &shp_)
       : tinfo(shp_), tbuf(size()) {}
+    /*! Views the contents of \a file, starting at byte \a ofs, as a
+        C-contiguous array of shape \a shp_. The array is writable if
+        \a file is. */
+    fmav(const shared_ptr<mmap_file> &file, const shape_t &shp_, size_t ofs=0)
+      : tinfo(shp_), tbuf(file, ofs, size()) {}
     fmav(const T* d_, const tinfo &info)
       : tinfo(info), tbuf(d_) {}
     fmav(T* d_, const tinfo &info, bool rw_=false)
@@ -401,19 +441,6 @@ template<typename T> class fmav: public fmav_info, public membuf<T>
       }
   };
 
-// template<typename Func, typename T0, typename Ts...> void fmav_pointwise_op(Func func, T0 & arg0, Ts&... args)
-//   {
-//   MR_assert(multiequal(arg0.shape()==args.shape()...), "fmav shape mismatch");
-//   if (multiequal(true, arg0.stride()==args.stride()...)) // equal strides, we can make simplifications
-//     {
-//     if (arg0.compact()) // even better, we can go through everything in a single loop
-//       {
-//       for (size_t i=0; i<arg0.size(); ++i)
-//         func(arg0.ptr[i], args.ptr[i]...);
-//       }
-//     else
-//   }
-
 template<typename T, size_t ndim> class mav: public mav_info<ndim>, public membuf<T>
   {
 //  static_assert((ndim>0) && (ndim<4), "only supports 1D, 2D, and 3D arrays");
@@ -486,7 +513,7 @@ template<typename T, size_t ndim> class mav: public mav_info<ndim>, public membu
         nofs+=i0[i]*str[i];
         if (extent[i]!=0)
           {
-          MR_assert(i0[i]+extent[i2]<=shp[i], "bad subset");
+          MR_assert(i0[i]+extent[i]<=shp[i], "bad subset");
           nshp[i2] = extent[i]; nstr[i2]=str[i];
           ++i2;
           }
@@ -508,6 +535,20 @@ template<typename T, size_t ndim> class mav: public mav_info<ndim>, public membu
       : tinfo(shp_), tbuf(d_, rw_) {}
     mav(const array<size_t,ndim> &shp_)
       : tinfo(shp_), tbuf(size()) {}
+    /*! Allocates an array of shape \a shp_ whose memory is value-initialized
+        by \a nthreads threads, such that every thread touches the slices
+        along the first axis which it would get in
+        execStatic(shp_[0], nthreads, 0, ...). On NUMA machines, these slices
+        then reside in memory local to that thread. */
+    mav(const array<size_t,ndim> &shp_, size_t nthreads)
+      : tinfo(shp_), tbuf(shp_[0], tinfo::size()/max<size_t>(1,shp_[0]),
+                          nthreads) {}
+    /*! Views the contents of \a file, starting at byte \a ofs, as a
+        C-contiguous array of shape \a shp_. The array is writable if
+        \a file is. */
+    mav(const shared_ptr<mmap_file> &file, const array<size_t,ndim> &shp_,
+      size_t ofs=0)
+      : tinfo(shp_), tbuf(file, ofs, tinfo::size()) {}
 #if defined(_MSC_VER)
     // MSVC is broken
     mav(const mav &other) : tinfo(other), tbuf(other) {}
@@ -561,9 +602,12 @@ template<typename T, size_t ndim> class mav: public mav_info<ndim>, public membu
       return mav<T,nd2> (nshp, nstr, tbuf::d+nofs, *this);
       }
 
-    static mav build_noncritical(const shape_t &shape)
+    /*! Returns an array of shape \a shape whose strides avoid critical
+        multiples of 4096 bytes. Its memory is value-initialized by
+        \a nthreads threads in the same way as in mav(shape, nthreads). */
+    static mav build_noncritical(const shape_t &shape, size_t nthreads=1)
       {
-      if (ndim==1) return mav(shape);
+      if (ndim==1) return mav(shape, nthreads);
       shape_t shape2(shape);
       size_t stride = sizeof(T);
       for (size_t i=0, xi=ndim-1; i+1<ndim; ++i, --xi)
@@ -573,11 +617,137 @@ template<typename T, size_t ndim> class mav: public mav_info<ndim>, public membu
           shape2[xi] += 3;
         stride *= shape2[xi];
         }
-      mav tmp(shape2);
+      mav tmp(shape2, nthreads);
       return tmp.subarray<ndim>(shape_t(), shape);
       }
   };
 
+/* Elementwise operations on several arrays of identical shape */
+
+// pointers to the data of the arrays passed to mav_apply(); only non-const
+// arrays are accessed writable
+template<typename T> T *apply_ptr(fmav<T> &arr) { return arr.vdata(); }
+template<typename T> const T *apply_ptr(const fmav<T> &arr)
+  { return arr.data(); }
+template<typename T, size_t ndim> T *apply_ptr(mav<T,ndim> &arr)
+  { return arr.vdata(); }
+template<typename T, size_t ndim> const T *apply_ptr(const mav<T,ndim> &arr)
+  { return arr.data(); }
+
+template<size_t nargs> class apply_plan
+  {
+  public:
+    using tstr = array<ptrdiff_t, nargs>;
+
+    fmav_info::shape_t shp;
+    vector<tstr> str; // str[axis][argument]
+
+    /* Axes of length 1 are dropped, the remaining ones are sorted by
+       descending stride of the first array, and adjacent axes are merged
+       wherever this is possible for all arrays. */
+    template<typename... Targs> apply_plan(const Targs &... arrs)
+      {
+      const auto &arr0 = get<0>(forward_as_tuple(arrs...));
+      size_t ndim = arr0.shape().size();
+      MR_assert(((arrs.shape().size()==ndim) && ...), "dimension mismatch");
+      for (size_t i=0; i<ndim; ++i)
+        {
+        MR_assert(((arrs.shape(i)==arr0.shape(i)) && ...), "shape mismatch");
+        if (arr0.shape(i)==1) continue;
+        shp.push_back(arr0.shape(i));
+        str.push_back(tstr{arrs.stride(i)...});
+        }
+      vector<size_t> idx(shp.size());
+      iota(idx.begin(), idx.end(), 0);
+      stable_sort(idx.begin(), idx.end(), [this](size_t i1, size_t i2)
+        { return abs(str[i1][0]) > abs(str[i2][0]); });
+      auto shp2(shp);
+      auto str2(str);
+      for (size_t i=0; i<idx.size(); ++i)
+        { shp[i]=shp2[idx[i]]; str[i]=str2[idx[i]]; }
+      for (size_t i=shp.size(); i-->1; )
+        {
+        bool mergeable = true;
+        for (size_t j=0; j<nargs; ++j)
+          mergeable &= str[i-1][j]==str[i][j]*ptrdiff_t(shp[i]);
+        if (!mergeable) continue;
+        shp[i-1] *= shp[i];
+        str[i-1] = str[i];
+        shp.erase(shp.begin()+i);
+        str.erase(str.begin()+i);
+        }
+      }
+  };
+
+template<typename Tptrs, size_t... Is> Tptrs apply_advance(const Tptrs &ptrs,
+  const array<ptrdiff_t, sizeof...(Is)> &str, ptrdiff_t n,
+  index_sequence<Is...>)
+  { return Tptrs((get<Is>(ptrs)+n*str[Is])...); }
+
+template<typename Func, typename Tptrs, size_t... Is> void apply_inner(
+  size_t n, const array<ptrdiff_t, sizeof...(Is)> &str, const Tptrs &ptrs,
+  Func &func, index_sequence<Is...>)
+  {
+  // with unit strides, the compiler can vectorize the loop
+  if (((str[Is]==1) && ...))
+    for (size_t i=0; i<n; ++i)
+      func(get<Is>(ptrs)[i]...);
+  else
+    for (size_t i=0; i<n; ++i)
+      func(get<Is>(ptrs)[ptrdiff_t(i)*str[Is]]...);
+  }
+
+template<typename Func, typename Tptrs, size_t nargs> void apply_rec(
+  size_t idim, const apply_plan<nargs> &plan, const Tptrs &ptrs, Func &func)
+  {
+  auto iseq = make_index_sequence<nargs>();
+  if (idim+1==plan.shp.size())
+    return apply_inner(plan.shp[idim], plan.str[idim], ptrs, func, iseq);
+  for (size_t i=0; i<plan.shp[idim]; ++i)
+    apply_rec(idim+1, plan, apply_advance(ptrs, plan.str[idim], i, iseq),
+      func);
+  }
+
+/*! Calls \a func(a0[i], a1[i], ...) for every multi-index \a i of the
+    arrays \a arrs (any mix of fmav and mav objects with identical shapes).
+    Elements of const arrays are passed as const references, those of
+    non-const arrays as writable references (these arrays must be writable,
+    so read-only views have to be passed as const objects).
+    Chains of elementwise operations can thus be done in a single pass over
+    memory, without temporary arrays.
+    The elements are visited in the order given by the memory layout of the
+    first array (fused into a single loop if the layouts allow it), by
+    \a nthreads threads. The order of the calls is unspecified. */
+template<typename Func, typename... Targs> void mav_apply(Func func,
+  size_t nthreads, Targs &&... arrs)
+  {
+  constexpr size_t nargs = sizeof...(Targs);
+  static_assert(nargs>0, "need at least one array");
+  apply_plan<nargs> plan(arrs...);
+  auto ptrs = make_tuple(apply_ptr(arrs)...);
+  if (plan.shp.empty()) // a single element
+    return apply_inner(1, array<ptrdiff_t, nargs>(), ptrs, func,
+      make_index_sequence<nargs>());
+  size_t sz = accumulate(plan.shp.begin(), plan.shp.end(), size_t(1),
+    multiplies<>());
+  if (sz==0) return;
+  // not worth the overhead of a parallel region
+  if (sz<(size_t(1)<<15)) nthreads=1;
+  execStatic(plan.shp[0], nthreads, 0, [&](Scheduler &sched)
+    {
+    auto iseq = make_index_sequence<nargs>();
+    while (auto rng=sched.getNext())
+      {
+      if (plan.shp.size()==1)
+        apply_inner(rng.hi-rng.lo, plan.str[0],
+          apply_advance(ptrs, plan.str[0], rng.lo, iseq), func, iseq);
+      else
+        for (auto i=rng.lo; i<rng.hi; ++i)
+          apply_rec(1, plan, apply_advance(ptrs, plan.str[0], i, iseq), func);
+      }
+    });
+  }
+
 template<typename T, size_t ndim> class MavIter
   {
   protected:
@@ -641,6 +811,7 @@ using detail_mav::fmav;
 using detail_mav::mav;
 using detail_mav::FmavIter;
 using detail_mav::MavIter;
+using detail_mav::mav_apply;
 
 }
 
@@ -0,0 +1,143 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#if __has_include(<sys/mman.h>)
+#define DUCC0_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "ducc0/infra/mmap_file.h"
+#include "ducc0/infra/error_handling.h"
+
+namespace ducc0 {
+
+namespace detail_mmap_file {
+
+using namespace std;
+
+#ifdef DUCC0_HAVE_MMAP
+
+namespace {
+
+/* Closes the file descriptor when going out of scope; the mapping stays
+   valid after closing. */
+class fd_guard
+  {
+  private:
+    int fd;
+  public:
+    fd_guard(int fd_) : fd(fd_) {}
+    ~fd_guard() { if (fd>=0) close(fd); }
+    operator int() const { return fd; }
+  };
+
+char *map_fd(int fd, size_t size, bool rw, const string &filename)
+  {
+  // mmap() does not accept empty mappings
+  if (size==0) return nullptr;
+  void *res = mmap(nullptr, size, rw ? (PROT_READ|PROT_WRITE) : PROT_READ,
+    MAP_SHARED, fd, 0);
+  MR_assert(res!=MAP_FAILED, "could not map file '", filename, "': ",
+    strerror(errno));
+  return static_cast<char *>(res);
+  }
+
+} // unnamed namespace
+
+mmap_file::mmap_file(const string &filename, open_mode mode, size_t size)
+  : data_(nullptr), size_(0), rw_(mode!=READ_ONLY)
+  {
+  int flags = (mode==READ_ONLY) ? O_RDONLY :
+             ((mode==READ_WRITE) ? O_RDWR : (O_RDWR|O_CREAT|O_TRUNC));
+  fd_guard fd(open(filename.c_str(), flags, 0666));
+  MR_assert(fd>=0, "could not open file '", filename, "': ", strerror(errno));
+  if (mode==CREATE)
+    {
+    MR_assert(ftruncate(fd, off_t(size))==0, "could not resize file '",
+      filename, "': ", strerror(errno));
+    size_ = size;
+    }
+  else
+    {
+    struct stat st;
+    MR_assert(fstat(fd, &st)==0, "could not stat file '", filename, "': ",
+      strerror(errno));
+    size_ = size_t(st.st_size);
+    }
+  data_ = map_fd(fd, size_, rw_, filename);
+  }
+
+mmap_file::~mmap_file()
+  { if (data_) munmap(data_, size_); }
+
+void mmap_file::advise(access_hint hint, size_t ofs, size_t len) const
+  {
+  if ((!data_) || (ofs>=size_)) return;
+  len = min(len, size_-ofs);
+  // madvise() needs a page-aligned start address
+  size_t pagesize = size_t(sysconf(_SC_PAGESIZE));
+  size_t shift = ofs%pagesize;
+  ofs -= shift;
+  len += shift;
+  int advice = MADV_NORMAL;
+  switch (hint)
+    {
+    case ACCESS_NORMAL: advice = MADV_NORMAL; break;
+    case ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+    case ACCESS_RANDOM: advice = MADV_RANDOM; break;
+    case ACCESS_WILLNEED: advice = MADV_WILLNEED; break;
+    case ACCESS_DONTNEED: advice = MADV_DONTNEED; break;
+    default: MR_fail("unsupported access hint");
+    }
+  // failure is harmless, since this is only a hint
+  madvise(data_+ofs, len, advice);
+  }
+
+void mmap_file::sync() const
+  {
+  if ((!data_) || (!rw_)) return;
+  MR_assert(msync(data_, size_, MS_SYNC)==0, "msync failed: ",
+    strerror(errno));
+  }
+
+#else
+
+mmap_file::mmap_file(const string &, open_mode, size_t)
+  : data_(nullptr), size_(0), rw_(false)
+  { MR_fail("memory-mapped files are not supported on this system"); }
+
+mmap_file::~mmap_file() {}
+
+void mmap_file::advise(access_hint, size_t, size_t) const {}
+
+void mmap_file::sync() const {}
+
+#endif
+
+}}
@@ -0,0 +1,101 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file mmap_file.h
+ *  Memory-mapped files (POSIX mmap).
+ *
+ *  An mmap_file can be passed to the fmav and mav constructors, which then
+ *  view (part of) the file contents directly; the pages are only read from
+ *  disk when they are accessed, so the file may be larger than the available
+ *  memory. The arrays share ownership of the mapping, which is removed when
+ *  the last of them is destroyed.
+ *  On systems without mmap, all constructors throw an exception.
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#ifndef DUCC0_MMAP_FILE_H
+#define DUCC0_MMAP_FILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace ducc0 {
+
+namespace detail_mmap_file {
+
+class mmap_file
+  {
+  public:
+    /*! How the file is opened. */
+    enum open_mode
+      {
+      READ_ONLY,  /*!< map an existing file read-only */
+      READ_WRITE, /*!< map an existing file; changes are written back */
+      CREATE      /*!< create the file (or truncate an existing one) with
+                       the given size, filled with zeros, and map it
+                       writable */
+      };
+    /*! Expected access pattern, passed to madvise(). */
+    enum access_hint
+      {
+      ACCESS_NORMAL,     /*!< no special treatment */
+      ACCESS_SEQUENTIAL, /*!< aggressive read-ahead, pages can be dropped
+                              soon after access */
+      ACCESS_RANDOM,     /*!< no read-ahead */
+      ACCESS_WILLNEED,   /*!< start reading the pages now */
+      ACCESS_DONTNEED    /*!< the pages will not be accessed soon */
+      };
+
+  private:
+    char *data_;
+    std::size_t size_;
+    bool rw_;
+
+  public:
+    /*! Maps the file \a filename according to \a mode. \a size is the
+        file size in bytes for \a mode==CREATE and ignored otherwise. */
+    mmap_file(const std::string &filename, open_mode mode=READ_ONLY,
+      std::size_t size=0);
+    ~mmap_file();
+
+    mmap_file(const mmap_file &) = delete;
+    mmap_file &operator=(const mmap_file &) = delete;
+
+    const char *data() const { return data_; }
+    char *vdata() { return data_; }
+    std::size_t size() const { return size_; }
+    bool writable() const { return rw_; }
+
+    /*! Announces the access pattern for the bytes [\a ofs; \a ofs+\a len)
+        (by default, the whole file). This is only a hint to the kernel. */
+    void advise(access_hint hint, std::size_t ofs=0,
+      std::size_t len=~std::size_t(0)) const;
+    /*! Writes all modified pages back to the file and waits for
+        completion. */
+    void sync() const;
+  };
+
+}
+
+using detail_mmap_file::mmap_file;
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "ducc0/infra/perf_counters.h"
+
+namespace ducc0 {
+
+namespace detail_perf_counters {
+
+using namespace std;
+
+namespace {
+
+bool env_enabled()
+  {
+  auto evar=getenv("DUCC0_PERF_COUNTERS");
+  return evar && (string(evar)!="") && (string(evar)!="0");
+  }
+
+atomic<bool> enabled(env_enabled());
+
+#if defined(__linux__)
+
+class counter_set
+  {
+  private:
+    struct thread_fds
+      {
+      array<int, PERF_NEVENTS> fd;
+      };
+
+    mutex mtx;
+    map<pid_t, thread_fds> threads;
+    array<bool, PERF_NEVENTS> avail;
+    bool probed;
+    uint64_t fp_config;
+    bool have_fp;
+
+    int open_counter(size_t ev, pid_t tid) const
+      {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      switch (ev)
+        {
+        case PERF_CYCLES:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_CPU_CYCLES;
+          break;
+        case PERF_INSTRUCTIONS:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+          break;
+        case PERF_LLC_MISSES:
+          attr.type = PERF_TYPE_HARDWARE;
+          attr.config = PERF_COUNT_HW_CACHE_MISSES;
+          break;
+        case PERF_FP_OPS:
+          if (!have_fp) return -1;
+          attr.type = PERF_TYPE_RAW;
+          attr.config = fp_config;
+          break;
+        default:
+          return -1;
+        }
+      return int(syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+      }
+
+    void add_thread(pid_t tid)
+      {
+      thread_fds fds;
+      for (size_t ev=0; ev<PERF_NEVENTS; ++ev)
+        {
+        fds.fd[ev] = (probed && !avail[ev]) ? -1 : open_counter(ev, tid);
+        if (!probed) avail[ev] = (fds.fd[ev]>=0);
+        }
+      probed = true;
+      threads[tid] = fds;
+      }
+
+    // opens counters for all threads of the process not yet known
+    void scan_threads()
+      {
+      DIR *dir = opendir("/proc/self/task");
+      if (!dir) return;
+      while (auto ent = readdir(dir))
+        {
+        if (ent->d_name[0]=='.') continue;
+        pid_t tid = pid_t(atol(ent->d_name));
+        if ((tid>0) && (threads.find(tid)==threads.end()))
+          add_thread(tid);
+        }
+      closedir(dir);
+      }
+
+  public:
+    counter_set()
+      : probed(false), fp_config(0), have_fp(false)
+      {
+      avail.fill(false);
+      auto evar=getenv("DUCC0_PERF_FP_EVENT");
+      if (evar && (string(evar)!=""))
+        {
+        fp_config = strtoull(evar, nullptr, 16);
+        have_fp = true;
+        }
+      }
+    ~counter_set()
+      {
+      for (const auto &thr: threads)
+        for (auto fd: thr.second.fd)
+          if (fd>=0) close(fd);
+      }
+
+    bool available(size_t ev)
+      {
+      lock_guard<mutex> lock(mtx);
+      if (!probed) add_thread(pid_t(syscall(SYS_gettid)));
+      return (ev<PERF_NEVENTS) && avail[ev];
+      }
+
+    PerfCounts read()
+      {
+      lock_guard<mutex> lock(mtx);
+      scan_threads();
+      PerfCounts res;
+      for (const auto &thr: threads)
+        for (size_t ev=0; ev<PERF_NEVENTS; ++ev)
+          {
+          if (thr.second.fd[ev]<0) continue;
+          uint64_t buf[3]; // value, time enabled, time running
+          if (::read(thr.second.fd[ev], buf, sizeof(buf))!=ssize_t(sizeof(buf)))
+            continue;
+          if (buf[2]>0)
+            res.val[ev] += double(buf[0])*(double(buf[1])/double(buf[2]));
+          }
+      return res;
+      }
+  };
+
+counter_set &counters()
+  {
+  static counter_set cs;
+  return cs;
+  }
+
+#endif
+
+} // unnamed namespace
+
+const char *perf_event_name(size_t ev)
+  {
+  static const char *names[] = {"cycles", "instructions", "LLC misses",
+    "FP ops"};
+  return (ev<PERF_NEVENTS) ? names[ev] : "";
+  }
+
+void set_perf_counters(bool on)
+  { enabled.store(on); }
+
+bool perf_counters_enabled()
+  { return enabled.load(memory_order_relaxed); }
+
+#if defined(__linux__)
+bool perf_event_available(size_t ev)
+  { return counters().available(ev); }
+
+PerfCounts read_perf_counters()
+  { return counters().read(); }
+#else
+bool perf_event_available(size_t /*ev*/)
+  { return false; }
+
+PerfCounts read_perf_counters()
+  { return PerfCounts(); }
+#endif
+
+}}
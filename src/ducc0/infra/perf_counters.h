@@ -0,0 +1,108 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file perf_counters.h
+ *  Process-wide hardware performance counters (Linux perf_event_open).
+ *
+ *  Counting is switched off by default. It can be switched on with
+ *  set_perf_counters() or by setting the environment variable
+ *  DUCC0_PERF_COUNTERS to a nonzero value. A raw PMU event counting
+ *  floating-point operations (e.g. FP_ARITH_INST_RETIRED on Intel CPUs) can
+ *  be supplied in DUCC0_PERF_FP_EVENT as a hexadecimal "config" value.
+ *  On other systems, or if the kernel does not permit counting (see
+ *  /proc/sys/kernel/perf_event_paranoid), no events are available and all
+ *  counts are zero.
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#ifndef DUCC0_PERF_COUNTERS_H
+#define DUCC0_PERF_COUNTERS_H
+
+#include <array>
+#include <cstddef>
+
+namespace ducc0 {
+
+namespace detail_perf_counters {
+
+/*! The counted events. */
+enum PerfEvent
+  {
+  PERF_CYCLES,       /*!< CPU cycles */
+  PERF_INSTRUCTIONS, /*!< retired instructions */
+  PERF_LLC_MISSES,   /*!< last level cache misses */
+  PERF_FP_OPS,       /*!< the raw event given in DUCC0_PERF_FP_EVENT */
+  PERF_NEVENTS
+  };
+
+/*! Counter values of all events, summed over all threads of the process.
+    Values are scaled if the kernel had to multiplex the counters. */
+struct PerfCounts
+  {
+  std::array<double, PERF_NEVENTS> val;
+
+  PerfCounts() { val.fill(0.); }
+  double operator[](size_t i) const { return val[i]; }
+  PerfCounts &operator+=(const PerfCounts &other)
+    {
+    for (size_t i=0; i<PERF_NEVENTS; ++i) val[i]+=other.val[i];
+    return *this;
+    }
+  PerfCounts operator-(const PerfCounts &other) const
+    {
+    PerfCounts res(*this);
+    for (size_t i=0; i<PERF_NEVENTS; ++i) res.val[i]-=other.val[i];
+    return res;
+    }
+  };
+
+/*! Returns a short name of event \a ev. */
+const char *perf_event_name(size_t ev);
+
+/*! Switches counting on or off. */
+void set_perf_counters(bool on);
+/*! Returns \a true if counting is switched on. */
+bool perf_counters_enabled();
+/*! Returns \a true if event \a ev can be counted on this system. */
+bool perf_event_available(size_t ev);
+
+/*! Returns the current counter values, summed over all threads of the
+    process. Threads which were not yet known are added to the counting
+    with their future events. */
+PerfCounts read_perf_counters();
+
+}
+
+using detail_perf_counters::PerfEvent;
+using detail_perf_counters::PERF_CYCLES;
+using detail_perf_counters::PERF_INSTRUCTIONS;
+using detail_perf_counters::PERF_LLC_MISSES;
+using detail_perf_counters::PERF_FP_OPS;
+using detail_perf_counters::PERF_NEVENTS;
+using detail_perf_counters::PerfCounts;
+using detail_perf_counters::perf_event_name;
+using detail_perf_counters::set_perf_counters;
+using detail_perf_counters::perf_counters_enabled;
+using detail_perf_counters::perf_event_available;
+using detail_perf_counters::read_perf_counters;
+
+}
+
+#endif
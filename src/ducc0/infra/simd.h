@@ -45,9 +45,17 @@
 #include <cstdlib>
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include <type_traits>
 #ifndef DUCC0_NO_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
 #include <x86intrin.h>
 #endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DUCC0_SIMD_NEON
+#endif
+#endif
 
 namespace ducc0 {
 
@@ -128,6 +136,9 @@ template<typename T, size_t len> class vtp
       }
     inline vtp sqrt() const
       { return hlp::sqrt(v); }
+    /* rounds to the nearest integer (ties to even) */
+    vtp round() const
+      { return hlp::round(v); }
     vtp max(const vtp &other) const
       { return hlp::max(v, other.v); }
     Tm operator>(const vtp &other) const
@@ -166,6 +177,8 @@ template<typename T, size_t len> class vtp
       public:
         where_expr (Tm m_, vtp &v_)
           : v(v_), m(m_) {}
+        where_expr &operator= (const vtp &other)
+          { v=hlp::blend(m, other.v, v.v); return *this; }
         where_expr &operator*= (const vtp &other)
           { v=hlp::blend(m, v.v*other.v, v.v); return *this; }
         where_expr &operator+= (const vtp &other)
@@ -223,6 +236,7 @@ template<typename T> class pseudoscalar
 
     pseudoscalar abs() const { return std::abs(v); }
     inline pseudoscalar sqrt() const { return std::sqrt(v); }
+    pseudoscalar round() const { return std::nearbyint(v); }
     pseudoscalar max(const pseudoscalar &other) const
       { return std::max(v, other.v); }
 
@@ -246,13 +260,14 @@ template<typename T> class helper_<T,1>
     using Tm = bool;
 
     static Tv loadu(const T *ptr) { return *ptr; }
-    static void storeu(T *ptr, Tv v) { *ptr = v.v; }
+    static void storeu(T *ptr, Tv v) { *ptr = v[0]; }
 
     static Tv from_scalar(T v) { return v; }
     static Tv abs(Tv v) { return v.abs(); }
     static Tv max(Tv v1, Tv v2) { return v1.max(v2); }
     static Tv blend(Tm m, Tv v1, Tv v2) { return m ? v1 : v2; }
     static Tv sqrt(Tv v) { return v.sqrt(); }
+    static Tv round(Tv v) { return v.round(); }
     static Tm gt (Tv v1, Tv v2) { return v1>v2; }
     static Tm ge (Tv v1, Tv v2) { return v1>=v2; }
     static Tm lt (Tv v1, Tv v2) { return v1<v2; }
@@ -281,6 +296,7 @@ template<> class helper_<double,8>
     static Tv max(Tv v1, Tv v2) { return _mm512_max_pd(v1, v2); }
     static Tv blend(Tm m, Tv v1, Tv v2) { return _mm512_mask_blend_pd(m, v2, v1); }
     static Tv sqrt(Tv v) { return _mm512_sqrt_pd(v); }
+    static Tv round(Tv v) { return _mm512_roundscale_pd(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC); }
     static Tm gt (Tv v1, Tv v2) { return _mm512_cmp_pd_mask(v1,v2,_CMP_GT_OQ); }
     static Tm ge (Tv v1, Tv v2) { return _mm512_cmp_pd_mask(v1,v2,_CMP_GE_OQ); }
     static Tm lt (Tv v1, Tv v2) { return _mm512_cmp_pd_mask(v1,v2,_CMP_LT_OQ); }
@@ -305,6 +321,7 @@ template<> class helper_<float,16>
     static Tv max(Tv v1, Tv v2) { return _mm512_max_ps(v1, v2); }
     static Tv blend(Tm m, Tv v1, Tv v2) { return _mm512_mask_blend_ps(m, v2, v1); }
     static Tv sqrt(Tv v) { return _mm512_sqrt_ps(v); }
+    static Tv round(Tv v) { return _mm512_roundscale_ps(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC); }
     static Tm gt (Tv v1, Tv v2) { return _mm512_cmp_ps_mask(v1,v2,_CMP_GT_OQ); }
     static Tm ge (Tv v1, Tv v2) { return _mm512_cmp_ps_mask(v1,v2,_CMP_GE_OQ); }
     static Tm lt (Tv v1, Tv v2) { return _mm512_cmp_ps_mask(v1,v2,_CMP_LT_OQ); }
@@ -332,6 +349,7 @@ template<> class helper_<double,4>
     static Tv max(Tv v1, Tv v2) { return _mm256_max_pd(v1, v2); }
     static Tv blend(Tm m, Tv v1, Tv v2) { return _mm256_blendv_pd(v2, v1, m); }
     static Tv sqrt(Tv v) { return _mm256_sqrt_pd(v); }
+    static Tv round(Tv v) { return _mm256_round_pd(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC); }
     static Tm gt (Tv v1, Tv v2) { return _mm256_cmp_pd(v1,v2,_CMP_GT_OQ); }
     static Tm ge (Tv v1, Tv v2) { return _mm256_cmp_pd(v1,v2,_CMP_GE_OQ); }
     static Tm lt (Tv v1, Tv v2) { return _mm256_cmp_pd(v1,v2,_CMP_LT_OQ); }
@@ -356,6 +374,7 @@ template<> class helper_<float,8>
     static Tv max(Tv v1, Tv v2) { return _mm256_max_ps(v1, v2); }
     static Tv blend(Tm m, Tv v1, Tv v2) { return _mm256_blendv_ps(v2, v1, m); }
     static Tv sqrt(Tv v) { return _mm256_sqrt_ps(v); }
+    static Tv round(Tv v) { return _mm256_round_ps(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC); }
     static Tm gt (Tv v1, Tv v2) { return _mm256_cmp_ps(v1,v2,_CMP_GT_OQ); }
     static Tm ge (Tv v1, Tv v2) { return _mm256_cmp_ps(v1,v2,_CMP_GE_OQ); }
     static Tm lt (Tv v1, Tv v2) { return _mm256_cmp_ps(v1,v2,_CMP_LT_OQ); }
@@ -390,6 +409,14 @@ template<> class helper_<double,2>
 #endif
       }
     static Tv sqrt(Tv v) { return _mm_sqrt_pd(v); }
+    static Tv round(Tv v)
+      {
+#if defined(__SSE4_1__)
+      return _mm_round_pd(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+#else
+      return _mm_cvtepi32_pd(_mm_cvtpd_epi32(v));  // only for |v|<2^31
+#endif
+      }
     static Tm gt (Tv v1, Tv v2) { return _mm_cmpgt_pd(v1,v2); }
     static Tm ge (Tv v1, Tv v2) { return _mm_cmpge_pd(v1,v2); }
     static Tm lt (Tv v1, Tv v2) { return _mm_cmplt_pd(v1,v2); }
@@ -421,6 +448,14 @@ template<> class helper_<float,4>
 #endif
       }
     static Tv sqrt(Tv v) { return _mm_sqrt_ps(v); }
+    static Tv round(Tv v)
+      {
+#if defined(__SSE4_1__)
+      return _mm_round_ps(v, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+#else
+      return _mm_cvtepi32_ps(_mm_cvtps_epi32(v));  // only for |v|<2^31
+#endif
+      }
     static Tm gt (Tv v1, Tv v2) { return _mm_cmpgt_ps(v1,v2); }
     static Tm ge (Tv v1, Tv v2) { return _mm_cmpge_ps(v1,v2); }
     static Tm lt (Tv v1, Tv v2) { return _mm_cmplt_ps(v1,v2); }
@@ -429,6 +464,68 @@ template<> class helper_<float,4>
     static size_t maskbits(Tm v) { return size_t(_mm_movemask_ps(v)); }
   };
 
+template<typename T> using native_simd = vtp<T,vlen<T,16>>;
+#elif defined(DUCC0_SIMD_NEON)
+template<> class helper_<double,2>
+  {
+  private:
+    using T = double;
+    static constexpr size_t len = 2;
+  public:
+    using Tv = float64x2_t;
+    using Tm = uint64x2_t;
+
+    static Tv loadu(const T *ptr) { return vld1q_f64(ptr); }
+    static void storeu(T *ptr, Tv v) { vst1q_f64(ptr, v); }
+
+    static Tv from_scalar(T v) { return vdupq_n_f64(v); }
+    static Tv abs(Tv v) { return vabsq_f64(v); }
+    static Tv max(Tv v1, Tv v2) { return vmaxq_f64(v1, v2); }
+    static Tv blend(Tm m, Tv v1, Tv v2) { return vbslq_f64(m, v1, v2); }
+    static Tv sqrt(Tv v) { return vsqrtq_f64(v); }
+    static Tv round(Tv v) { return vrndnq_f64(v); }
+    static Tm gt (Tv v1, Tv v2) { return vcgtq_f64(v1,v2); }
+    static Tm ge (Tv v1, Tv v2) { return vcgeq_f64(v1,v2); }
+    static Tm lt (Tv v1, Tv v2) { return vcltq_f64(v1,v2); }
+    static Tm ne (Tv v1, Tv v2)
+      { return vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(vceqq_f64(v1,v2)))); }
+    static Tm mask_and (Tm v1, Tm v2) { return vandq_u64(v1,v2); }
+    static size_t maskbits(Tm v)
+      {
+      const uint64x2_t bits = {1, 2};
+      return size_t(vaddvq_u64(vandq_u64(v, bits)));
+      }
+  };
+template<> class helper_<float,4>
+  {
+  private:
+    using T = float;
+    static constexpr size_t len = 4;
+  public:
+    using Tv = float32x4_t;
+    using Tm = uint32x4_t;
+
+    static Tv loadu(const T *ptr) { return vld1q_f32(ptr); }
+    static void storeu(T *ptr, Tv v) { vst1q_f32(ptr, v); }
+
+    static Tv from_scalar(T v) { return vdupq_n_f32(v); }
+    static Tv abs(Tv v) { return vabsq_f32(v); }
+    static Tv max(Tv v1, Tv v2) { return vmaxq_f32(v1, v2); }
+    static Tv blend(Tm m, Tv v1, Tv v2) { return vbslq_f32(m, v1, v2); }
+    static Tv sqrt(Tv v) { return vsqrtq_f32(v); }
+    static Tv round(Tv v) { return vrndnq_f32(v); }
+    static Tm gt (Tv v1, Tv v2) { return vcgtq_f32(v1,v2); }
+    static Tm ge (Tv v1, Tv v2) { return vcgeq_f32(v1,v2); }
+    static Tm lt (Tv v1, Tv v2) { return vcltq_f32(v1,v2); }
+    static Tm ne (Tv v1, Tv v2) { return vmvnq_u32(vceqq_f32(v1,v2)); }
+    static Tm mask_and (Tm v1, Tm v2) { return vandq_u32(v1,v2); }
+    static size_t maskbits(Tm v)
+      {
+      const uint32x4_t bits = {1, 2, 4, 8};
+      return size_t(vaddvq_u32(vandq_u32(v, bits)));
+      }
+  };
+
 template<typename T> using native_simd = vtp<T,vlen<T,16>>;
 #else
 template<typename T> using native_simd = vtp<T,1>;
@@ -436,6 +533,327 @@ template<typename T> using native_simd = vtp<T,1>;
 #else
 template<typename T> using native_simd = vtp<T,1>;
 #endif
+
+/* Vectorized elementary functions.
+
+   sincos(), sin(), cos(), exp(), log() and atan2() work on all vtp<float,N>
+   and vtp<double,N>. They use polynomial approximations after range
+   reduction (with coefficients from Cephes and fdlibm) and only need
+   arithmetic, comparisons and blends, so every backend supports them.
+   Maximum errors in units of the last place, measured over 10^7 random
+   arguments per case with GCC 12 on x86_64, with and without -ffast-math:
+
+                 sin/cos           exp    log    atan2
+       double    1.6 (2.5 large)   1.7    1.7    1.6
+       float     1.6 (2.4 large)   1.2    0.9    3.7
+
+   "large" refers to |x|>100. Further details:
+   - sin/cos: arguments with |x|>1e6 (double) or |x|>8192 (float) are
+     passed to the standard library functions lane by lane.
+   - exp: returns inf above and 0 below the representable range; subnormal
+     results are flushed to zero if the FPU is configured that way
+     (which -ffast-math does on x86).
+   - log: returns -inf for zero, NaN for negative and inf for infinite
+     arguments.
+   - atan2: the sign of a zero y is ignored, so the result lies in [0;pi]
+     for y==0.
+   For single-lane vectors, the functions of the standard library are
+   called directly. */
+
+/* Hides the value of v from the optimizer. Without this, -ffast-math would
+   allow the compiler to reassociate the argument reductions below, which
+   only work in the order they are written. */
+template<typename T, size_t len> inline vtp<T, len> opaque(vtp<T, len> v)
+  {
+  typename vtp<T, len>::Tv tv = v;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __asm__("" : "+x"(tv));
+#elif defined(__GNUC__) && defined(__aarch64__)
+  __asm__("" : "+w"(tv));
+#elif defined(__GNUC__)
+  __asm__("" : "+m"(tv));
+#endif
+  return tv;
+  }
+
+template<typename T, size_t len, size_t N>
+  inline vtp<T, len> poly_eval(vtp<T, len> x, const T (&c)[N])
+  {
+  vtp<T, len> res(c[0]);
+  for (size_t i=1; i<N; ++i)
+    res = res*x + c[i];
+  return res;
+  }
+
+/* Access to the bit representation of the vector entries. This relies on
+   Tv being a GNU vector type, which is true for all multi-lane backends. */
+template<typename T, size_t len> struct vbits
+  {
+  using V = vtp<T, len>;
+  using Tv = typename V::Tv;
+  // comparing GNU vectors yields a signed integer vector of the same layout
+  using Ti = decltype(Tv()<Tv());
+  using Te = std::remove_cv_t<std::remove_reference_t<decltype(Ti()[0])>>;
+  static constexpr bool dbl = std::is_same<T,double>::value;
+  static constexpr int mbits = dbl ? 52 : 23;
+  static constexpr Te bias = dbl ? 1023 : 127;
+  // for integer k with |k|<2^(mbits-1), the bits of magic+k are magicbits+k
+  static constexpr T magic = T(3)*T(uint64_t(1)<<(mbits-1));
+  static constexpr Te magicbits = dbl ? Te(0x4338000000000000ull) : Te(0x4b400000);
+
+  static Ti bits(V v) { return (Ti)Tv(v); }
+  static V from_bits(Ti v) { return V((Tv)v); }
+  // 2^n for integer-valued n with |n|<bias
+  static V pow2i(V n)
+    { return from_bits((bits(n+magic)-(magicbits-bias))<<mbits); }
+  // splits positive normalized x into m*2^e with m in [1;2)
+  static V frexp(V x, V &e)
+    {
+    Ti k = bits(x);
+    e = from_bits((k>>mbits)-bias+magicbits) - magic;
+    return from_bits((k&((Te(1)<<mbits)-1)) | (bias<<mbits));
+    }
+  };
+
+template<typename T, size_t len> inline void sincos(vtp<T, len> x,
+  vtp<T, len> &s, vtp<T, len> &c)
+  {
+  using V = vtp<T, len>;
+  if constexpr (len==1)
+    { s = std::sin(x[0]); c = std::cos(x[0]); }
+  else
+    {
+    constexpr bool dbl = std::is_same<T,double>::value;
+    constexpr T limit = dbl ? T(1e6) : T(8192);
+    // Cody-Waite reduction to r in [-pi/4; pi/4], x = n*pi/2 + r
+    V n = (x*T(0.63661977236758134308)).round();
+    V r;
+    if constexpr (dbl)
+      {
+      r = opaque(x - n*T(1.57079632673412561417e+00));
+      r = opaque(r - n*T(6.07710050630396597660e-11));
+      r = r - n*T(2.02226624879595063154e-21);
+      }
+    else
+      {
+      r = opaque(x - n*T(1.5703125f));
+      r = opaque(r - n*T(4.8375129699707031e-4f));
+      r = opaque(r - n*T(7.5495336204767227e-8f));
+      r = r - n*T(2.5633441515945189e-12f);
+      }
+    V z = r*r;
+    V ps, pc;
+    if constexpr (dbl)
+      {
+      static constexpr T cs[] = { 1.58969099521155010221e-10,
+        -2.50507602534068634195e-08, 2.75573137070700676789e-06,
+        -1.98412698298579493134e-04, 8.33333333332248946124e-03,
+        -1.66666666666666324348e-01 };
+      static constexpr T cc[] = { -1.13596475577881948265e-11,
+        2.08757232129817482790e-09, -2.75573143513906633035e-07,
+        2.48015872894767294178e-05, -1.38888888888741095749e-03,
+        4.16666666666666019037e-02 };
+      ps = r + r*z*poly_eval(z, cs);
+      pc = (T(1)-T(0.5)*z) + z*z*poly_eval(z, cc);
+      }
+    else
+      {
+      static constexpr T cs[] = { -1.9515295891e-4f, 8.3321608736e-3f,
+        -1.6666654611e-1f };
+      static constexpr T cc[] = { 2.443315711809948e-5f,
+        -1.388731625493765e-3f, 4.166664568298827e-2f };
+      ps = r + r*z*poly_eval(z, cs);
+      pc = (T(1)-T(0.5)*z) + z*z*poly_eval(z, cc);
+      }
+    // quadrant q = n mod 4
+    V q = n - T(4)*(n*T(0.25)-T(0.375)).round();
+    V hq = q*T(0.5);
+    auto odd = hq != hq.round();
+    s = ps; c = pc;
+    where(odd, s) = pc;
+    where(odd, c) = ps;
+    where(q>V(T(1.5)), s) = -s;
+    where((q>V(T(0.5)))&(q<V(T(2.5))), c) = -c;
+    if (any_of(abs(x)>V(limit)))
+      for (size_t i=0; i<len; ++i)
+        if (std::abs(x[i])>limit)
+          { s[i] = std::sin(x[i]); c[i] = std::cos(x[i]); }
+    }
+  }
+template<typename T, size_t len> inline vtp<T, len> sin(vtp<T, len> x)
+  {
+  vtp<T, len> s, c;
+  sincos(x, s, c);
+  return s;
+  }
+template<typename T, size_t len> inline vtp<T, len> cos(vtp<T, len> x)
+  {
+  vtp<T, len> s, c;
+  sincos(x, s, c);
+  return c;
+  }
+
+template<typename T, size_t len> inline vtp<T, len> exp(vtp<T, len> x)
+  {
+  using V = vtp<T, len>;
+  if constexpr (len==1)
+    return std::exp(x[0]);
+  else
+    {
+    using B = vbits<T, len>;
+    constexpr bool dbl = std::is_same<T,double>::value;
+    // beyond these limits, the result is inf or 0
+    constexpr T hi = dbl ? T(709.782712893383973096) : T(88.72283905206835),
+                lo = dbl ? T(-745.13321910194110842) : T(-103.97208),
+                ln2_hi = dbl ? T(6.93145751953125e-1) : T(0.693359375),
+                ln2_lo = dbl ? T(1.42860682030941723212e-6) : T(-2.12194440e-4);
+    V xc = x;
+    where(x>V(hi), xc) = V(hi);
+    where(x<V(lo), xc) = V(lo);
+    // x = n*ln(2) + r, |r|<=ln(2)/2
+    V n = (xc*T(1.44269504088896340736)).round();
+    V r = opaque(xc - n*ln2_hi) - n*ln2_lo;
+    V er;
+    if constexpr (dbl)
+      {
+      // Pade approximation
+      static constexpr T cp[] = { 1.26177193074810590878e-4,
+        3.02994407707441961300e-2, 9.99999999999999999910e-1 };
+      static constexpr T cq[] = { 3.00198505138664455042e-6,
+        2.52448340349684104192e-3, 2.27265548208155028766e-1,
+        2.00000000000000000009e0 };
+      V rr = r*r;
+      V px = r*poly_eval(rr, cp);
+      er = T(1) + T(2)*(px/(poly_eval(rr, cq)-px));
+      }
+    else
+      {
+      static constexpr T cp[] = { 1.9875691500e-4f, 1.3981999507e-3f,
+        8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f,
+        5.0000001201e-1f };
+      er = poly_eval(r, cp)*r*r + r + T(1);
+      }
+    // 2^n is applied in two steps, to cover subnormal and near-overflow
+    // results
+    V n1 = (n*T(0.5)).round();
+    V res = opaque(er*B::pow2i(n1))*B::pow2i(n-n1);
+    where(x>V(hi), res) = V(std::numeric_limits<T>::infinity());
+    where(x<V(lo), res) = V(T(0));
+    return res;
+    }
+  }
+
+template<typename T, size_t len> inline vtp<T, len> log(vtp<T, len> x)
+  {
+  using V = vtp<T, len>;
+  if constexpr (len==1)
+    return std::log(x[0]);
+  else
+    {
+    using B = vbits<T, len>;
+    constexpr bool dbl = std::is_same<T,double>::value;
+    // scale subnormal arguments into the normalized range
+    constexpr T sscale = T(uint64_t(1)<<(dbl ? 54 : 25));
+    V xs = x, eofs(T(0));
+    auto tiny = x<V(std::numeric_limits<T>::min());
+    where(tiny, xs) *= V(sscale);
+    where(tiny, eofs) = V(T(dbl ? 54 : 25));
+    // x = m*2^e with m in [sqrt(0.5); sqrt(2)]
+    V e;
+    V m = B::frexp(xs, e);
+    e -= eofs;
+    auto mbig = m>V(T(1.41421356237309504880));
+    where(mbig, m) *= V(T(0.5));
+    where(mbig, e) += V(T(1));
+    V f = m-T(1);
+    V res;
+    if constexpr (dbl)
+      {
+      static constexpr T cl[] = { 1.479819860511658591e-01,
+        1.531383769920937332e-01, 1.818357216161805012e-01,
+        2.222219843214978396e-01, 2.857142874366239149e-01,
+        3.999999999940941908e-01, 6.666666666666735130e-01 };
+      V s = f/(T(2)+f);
+      V z = s*s;
+      V R = z*poly_eval(z, cl);
+      V hfsq = T(0.5)*f*f;
+      V tail = opaque(s*(hfsq+R) + e*T(1.90821492927058770002e-10));
+      res = e*T(6.93147180369123816490e-01) + opaque(f - (hfsq - tail));
+      }
+    else
+      {
+      static constexpr T cl[] = { 7.0376836292e-2f, -1.1514610310e-1f,
+        1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+        -1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f,
+        3.3333331174e-1f };
+      V z = f*f;
+      res = f*z*poly_eval(f, cl) + e*T(-2.12194440e-4) - T(0.5)*z;
+      res = opaque(f + res) + e*T(0.693359375);
+      }
+    where(x>V(std::numeric_limits<T>::max()), res) = x;
+    where(V(T(0))>=x, res) = V(-std::numeric_limits<T>::infinity());
+    where(x<V(T(0)), res) = V(std::numeric_limits<T>::quiet_NaN());
+    return res;
+    }
+  }
+
+template<typename T, size_t len> inline vtp<T, len> atan2(vtp<T, len> y,
+  vtp<T, len> x)
+  {
+  using V = vtp<T, len>;
+  if constexpr (len==1)
+    return std::atan2(y[0], x[0]);
+  else
+    {
+    constexpr bool dbl = std::is_same<T,double>::value;
+    // reduce to atan(num/den) with num=min(|x|,|y|), den=max(|x|,|y|)
+    V ax = abs(x), ay = abs(y);
+    auto swap = ay>ax;
+    V num = ay, den = ax;
+    where(swap, num) = ax;
+    where(swap, den) = ay;
+    where(V(T(0))>=den, den) = V(T(1));
+    // for num/den>tan(pi/8) (float) or >0.66 (double), use
+    // atan(num/den) = pi/4 + atan((num-den)/(num+den))
+    auto red = num>den*(dbl ? T(0.66) : T(0.41421356237309504880));
+    V tn = num, td = den;
+    where(red, tn) = num-den;
+    where(red, td) = num+den;
+    V t = tn/td;
+    V z = t*t;
+    V res;
+    if constexpr (dbl)
+      {
+      static constexpr T cp[] = { -8.750608600031904122785e-1,
+        -1.615753718733365076637e1, -7.500855792314704667340e1,
+        -1.228866684490136173410e2, -6.485021904942025371773e1 };
+      static constexpr T cq[] = { 1., 2.485846490142306297962e1,
+        1.650270098316988542046e2, 4.328810604912902668951e2,
+        4.853903996359136964868e2, 1.945506571482613964425e2 };
+      res = t + t*z*(poly_eval(z, cp)/poly_eval(z, cq));
+      }
+    else
+      {
+      static constexpr T cp[] = { 8.05374449538e-2f, -1.38776856032e-1f,
+        1.99777106478e-1f, -3.33329491539e-1f };
+      res = t + t*z*poly_eval(z, cp);
+      }
+    // pi/4, pi/2 and pi, split into a leading and a correction term
+    constexpr double pio4 = 7.85398163397448309616e-01;
+    constexpr T pio4_hi = T(pio4),
+                pio4_lo = dbl ? T(3.06161699786838301793e-17) : T(pio4-pio4_hi),
+                pio2_hi = T(2*pio4),
+                pio2_lo = T(2)*pio4_lo,
+                pi_hi = T(4*pio4),
+                pi_lo = T(4)*pio4_lo;
+    where(red, res) = V(pio4_hi) + opaque(res + V(pio4_lo));
+    where(swap, res) = V(pio2_hi) - opaque(res - V(pio2_lo));
+    where(x<V(T(0)), res) = V(pi_hi) - opaque(res - V(pi_lo));
+    where(y<V(T(0)), res) = -res;
+    return res;
+    }
+  }
+
 }
 
 using detail_simd::native_simd;
@@ -446,6 +864,12 @@ using detail_simd::sqrt;
 using detail_simd::any_of;
 using detail_simd::none_of;
 using detail_simd::all_of;
+using detail_simd::sincos;
+using detail_simd::sin;
+using detail_simd::cos;
+using detail_simd::exp;
+using detail_simd::log;
+using detail_simd::atan2;
 
 // since we are explicitly introducing a few names that are also available in
 // std::, we need to import them from std::as well, otherwise name resolution
@@ -454,6 +878,11 @@ using detail_simd::all_of;
 using std::abs;
 using std::sqrt;
 using std::max;
+using std::sin;
+using std::cos;
+using std::exp;
+using std::log;
+using std::atan2;
 
 }
 
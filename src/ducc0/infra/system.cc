@@ -21,6 +21,9 @@
 
 #include <regex>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 
@@ -71,4 +74,38 @@ size_t usable_memory()
   return MemTotal-Committed;
   }
 
+bool cpu_supports_isa(const string &name)
+  {
+  if (name=="default") return true;
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+  __builtin_cpu_init();
+  if (name=="avx512f") return __builtin_cpu_supports("avx512f");
+  // the "avx2" variants are compiled with -mavx2 -mfma
+  if (name=="avx2")
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (name=="fma4") return __builtin_cpu_supports("fma4");
+  if (name=="fma") return __builtin_cpu_supports("fma");
+  if (name=="avx") return __builtin_cpu_supports("avx");
+#endif
+  return false;
+  }
+
+string select_isa_variant(const vector<string> &variants)
+  {
+  const char *env = getenv("DUCC0_ARCH");
+  if (env && (*env!='\0'))
+    {
+    string res(env);
+    MR_assert((res=="default")
+      || (std::find(variants.begin(), variants.end(), res)!=variants.end()),
+      "DUCC0_ARCH: instruction set variant '", res, "' is not available");
+    MR_assert(cpu_supports_isa(res), "DUCC0_ARCH: instruction set variant '",
+      res, "' is not supported by this CPU");
+    return res;
+    }
+  for (const auto &v: variants)
+    if (cpu_supports_isa(v)) return v;
+  return "default";
+  }
+
 }}
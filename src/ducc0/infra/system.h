@@ -23,6 +23,7 @@
 #define DUCC0_SYSTEM_H
 
 #include <string>
+#include <vector>
 #include <cstdlib>
 
 namespace ducc0 {
@@ -33,11 +34,25 @@ std::size_t getProcessInfo(const std::string &quantity);
 std::size_t getMemInfo(const std::string &quantity);
 std::size_t usable_memory();
 
+/*! Returns true if the CPU can execute code compiled for the instruction
+    set variant \a name ("default", "avx", "fma", "fma4", "avx2" (which
+    includes FMA) or "avx512f"). Only "default" is supported on non-x86
+    platforms. */
+bool cpu_supports_isa(const std::string &name);
+/*! Returns the first entry of \a variants (ordered by preference) which is
+    supported by the CPU, or "default" if there is none.
+    If the environment variable DUCC0_ARCH is set, its value is returned
+    instead; it must be "default" or one of \a variants, and supported by
+    the CPU. */
+std::string select_isa_variant(const std::vector<std::string> &variants);
+
 }
 
 using detail_system::getProcessInfo;
 using detail_system::getMemInfo;
 using detail_system::usable_memory;
+using detail_system::cpu_supports_isa;
+using detail_system::select_isa_variant;
 
 }
 
@@ -20,25 +20,76 @@
    Authors: Peter Bell, Martin Reinecke */
 
 #include "ducc0/infra/threading.h"
+#include <atomic>
+#include <algorithm>
 
 #ifndef DUCC0_NO_THREADING
 #include <cstdlib>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
-#include <queue>
-#include <atomic>
 #include <vector>
 #include <exception>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include "ducc0/infra/error_handling.h"
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #if __has_include(<pthread.h>)
 #include <pthread.h>
 #endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
 #endif
 
 namespace ducc0 {
 
 namespace detail_threading {
 
+/* Limits the number of threads working concurrently in parallel regions. */
+class thread_budget
+  {
+  private:
+    std::atomic<size_t> limit_, used_;
+
+  public:
+    explicit thread_budget(size_t limit)
+      : limit_(std::max<size_t>(1, limit)), used_(0) {}
+
+    size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    void set_limit(size_t limit)
+      { limit_.store(std::max<size_t>(1, limit), std::memory_order_relaxed); }
+
+    /* Occupies \a n slots, even if this exceeds the limit. */
+    void add(size_t n)
+      { used_.fetch_add(n, std::memory_order_relaxed); }
+    /* Occupies up to \a n free slots and returns their number. */
+    size_t acquire(size_t n)
+      {
+      auto cur = used_.load(std::memory_order_relaxed);
+      size_t res;
+      do
+        {
+        auto lim = limit();
+        res = (cur>=lim) ? 0 : std::min(n, lim-cur);
+        if (res==0) return 0;
+        }
+      while (!used_.compare_exchange_weak(cur, cur+res,
+        std::memory_order_relaxed));
+      return res;
+      }
+    void release(size_t n)
+      { used_.fetch_sub(n, std::memory_order_relaxed); }
+  };
+
+ThreadGroup::ThreadGroup(size_t nthreads)
+  : budget_(std::make_shared<thread_budget>(nthreads)) {}
+size_t ThreadGroup::nthreads() const
+  { return budget_->limit(); }
+
 #ifndef DUCC0_NO_THREADING
 
 static const size_t max_threads_ = std::max<size_t>(1, std::thread::hardware_concurrency());
@@ -53,121 +104,442 @@ void set_default_nthreads(size_t new_default_nthreads)
 
 size_t max_threads() { return max_threads_; }
 
+thread_budget &global_budget()
+  {
+  static thread_budget budget(max_threads_);
+  return budget;
+  }
+
+void set_thread_budget(size_t nthreads)
+  { global_budget().set_limit(nthreads); }
+size_t get_thread_budget()
+  { return global_budget().limit(); }
+
+// A reasonable guess, probably close enough for most hardware
+constexpr size_t cache_line_size = 64;
+
+/* Idle threads search for work this many times before going to sleep; the
+   first spin_pause searches are separated by a CPU pause instruction, the
+   remaining ones by a yield of the time slice. */
+constexpr size_t spin_limit = 256;
+constexpr size_t spin_pause = 32;
+
+inline void spin_wait(size_t iter)
+  {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+  if (iter<spin_pause) { _mm_pause(); return; }
+#else
+  (void)iter;
+#endif
+  std::this_thread::yield();
+  }
+
+class task
+  {
+  public:
+    virtual ~task() {}
+    virtual void run() = 0;
+  };
+
+/* Fixed-capacity work-stealing deque (Chase & Lev 2005, with the memory
+   orderings of Le et al. 2013). Only the owning worker may call push() and
+   pop(), which operate at the bottom end; other threads steal() from the
+   top. */
+class work_deque
+  {
+  private:
+    static constexpr ptrdiff_t capacity = 256;
+    alignas(cache_line_size) std::atomic<ptrdiff_t> top_;
+    alignas(cache_line_size) std::atomic<ptrdiff_t> bottom_;
+    std::atomic<task *> buf_[capacity];
+
+  public:
+    work_deque(): top_(0), bottom_(0)
+      {
+      for (auto &v: buf_)
+        v.store(nullptr, std::memory_order_relaxed);
+      }
+
+    /* Returns false if the deque is full. */
+    bool push(task *t)
+      {
+      auto b = bottom_.load(std::memory_order_relaxed);
+      if (b-top_.load(std::memory_order_acquire)>=capacity) return false;
+      buf_[b&(capacity-1)].store(t, std::memory_order_relaxed);
+      bottom_.store(b+1, std::memory_order_release);
+      return true;
+      }
+
+    task *pop()
+      {
+      auto b = bottom_.load(std::memory_order_relaxed)-1;
+      bottom_.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto t = top_.load(std::memory_order_relaxed);
+      if (t>b)  // empty
+        {
+        bottom_.store(b+1, std::memory_order_relaxed);
+        return nullptr;
+        }
+      task *res = buf_[b&(capacity-1)].load(std::memory_order_relaxed);
+      if (t==b)  // last entry; a thief may be taking it at the same time
+        {
+        if (!top_.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+          std::memory_order_relaxed))
+          res = nullptr;
+        bottom_.store(b+1, std::memory_order_relaxed);
+        }
+      return res;
+      }
+
+    /* Returns nullptr only if the deque is empty. */
+    task *steal()
+      {
+      while (true)
+        {
+        auto t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom_.load(std::memory_order_acquire);
+        if (t>=b) return nullptr;
+        task *res = buf_[t&(capacity-1)].load(std::memory_order_relaxed);
+        if (top_.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+          std::memory_order_relaxed))
+          return res;
+        }
+      }
+  };
+
+/* Bounded multi-producer multi-consumer FIFO queue (after D. Vyukov),
+   through which threads outside the pool hand work to a worker. */
+class injection_queue
+  {
+  private:
+    static constexpr size_t capacity = 256;
+    struct cell
+      {
+      std::atomic<size_t> seq;
+      task *data;
+      };
+    cell buf_[capacity];
+    alignas(cache_line_size) std::atomic<size_t> enq_;
+    alignas(cache_line_size) std::atomic<size_t> deq_;
+
+  public:
+    injection_queue(): enq_(0), deq_(0)
+      {
+      for (size_t i=0; i<capacity; ++i)
+        {
+        buf_[i].seq.store(i, std::memory_order_relaxed);
+        buf_[i].data = nullptr;
+        }
+      }
+
+    /* Returns false if the queue is full. */
+    bool push(task *t)
+      {
+      auto pos = enq_.load(std::memory_order_relaxed);
+      while (true)
+        {
+        auto &c = buf_[pos&(capacity-1)];
+        auto diff = ptrdiff_t(c.seq.load(std::memory_order_acquire))
+                  - ptrdiff_t(pos);
+        if (diff<0) return false;
+        if (diff>0)
+          pos = enq_.load(std::memory_order_relaxed);
+        else if (enq_.compare_exchange_weak(pos, pos+1,
+          std::memory_order_relaxed))
+          {
+          c.data = t;
+          c.seq.store(pos+1, std::memory_order_release);
+          return true;
+          }
+        }
+      }
+
+    task *pop()
+      {
+      auto pos = deq_.load(std::memory_order_relaxed);
+      while (true)
+        {
+        auto &c = buf_[pos&(capacity-1)];
+        auto diff = ptrdiff_t(c.seq.load(std::memory_order_acquire))
+                  - ptrdiff_t(pos+1);
+        if (diff<0) return nullptr;
+        if (diff>0)
+          pos = deq_.load(std::memory_order_relaxed);
+        else if (deq_.compare_exchange_weak(pos, pos+1,
+          std::memory_order_relaxed))
+          {
+          task *res = c.data;
+          c.seq.store(pos+capacity, std::memory_order_release);
+          return res;
+          }
+        }
+      }
+  };
+
+/* Counts down the tasks of a parallel region. count_down() is a single
+   atomic operation unless the waiting thread has gone to sleep. */
 class latch
   {
-    std::atomic<size_t> num_left_;
-    std::mutex mut_;
-    std::condition_variable completed_;
+  private:
+    static constexpr size_t sleeping = size_t(1)<<(8*sizeof(size_t)-1);
+    // number of outstanding tasks, plus the "sleeping" bit
+    std::atomic<size_t> state_;
+    // shared by all latches, so that count_down() never touches a latch
+    // which its owner may already have destroyed
+    static inline std::mutex mut_;
+    static inline std::condition_variable completed_;
     using lock_t = std::unique_lock<std::mutex>;
 
   public:
-    latch(size_t n): num_left_(n) {}
+    latch(size_t n): state_(n) {}
 
     void count_down()
       {
-      lock_t lock(mut_);
-      if (--num_left_)
+      if (state_.fetch_sub(1, std::memory_order_acq_rel)!=(sleeping|1))
         return;
+      lock_t lock(mut_);
       completed_.notify_all();
       }
 
     void wait()
       {
       lock_t lock(mut_);
+      state_.fetch_or(sleeping, std::memory_order_acq_rel);
       completed_.wait(lock, [this]{ return is_ready(); });
       }
-    bool is_ready() { return num_left_ == 0; }
+    bool is_ready() const
+      { return (state_.load(std::memory_order_acquire)&~sleeping)==0; }
+  };
+
+static constexpr size_t not_a_worker = ~size_t(0);
+static thread_local size_t worker_id = not_a_worker;
+// number of parallel regions the current thread is working in
+static thread_local size_t region_depth = 0;
+// the ThreadGroup of regions opened by the current thread, if any
+static thread_local thread_budget *cur_group = nullptr;
+
+ThreadGroupScope::ThreadGroupScope(const ThreadGroup &group)
+  : budget_(group.budget_), old_(cur_group)
+  { cur_group = budget_.get(); }
+ThreadGroupScope::~ThreadGroupScope()
+  { cur_group = old_; }
+
+/* Marks the current thread as working in a region of \a group. */
+class region_scope
+  {
+  private:
+    thread_budget *old_;
+
+  public:
+    explicit region_scope(thread_budget *group): old_(cur_group)
+      { ++region_depth; cur_group = group; }
+    ~region_scope()
+      { --region_depth; cur_group = old_; }
   };
 
-template <typename T> class concurrent_queue
+/* Reserves the threads of a parallel region which asks for \a nextra
+   threads in addition to the calling one. A caller which is not yet working
+   in another region occupies a slot of its own (even if the budget is
+   exhausted); otherwise it works in the slot of its outer region. */
+class slot_reservation
   {
-    std::queue<T> q_;
-    std::mutex mut_;
-    std::atomic<size_t> size_;
-    using lock_t = std::lock_guard<std::mutex>;
+  private:
+    thread_budget *group_;
+    size_t nown_, nextra_;
 
   public:
-    void push(T val)
+    explicit slot_reservation(size_t nextra)
+      : group_(cur_group), nown_((region_depth==0) ? 1 : 0)
       {
-      ++size_;
-      lock_t lock(mut_);
-      q_.push(std::move(val));
+      auto &glob(global_budget());
+      glob.add(nown_);
+      if (group_) group_->add(nown_);
+      size_t n = group_ ? group_->acquire(nextra) : nextra;
+      nextra_ = glob.acquire(n);
+      if (group_) group_->release(n-nextra_);
       }
-
-    bool try_pop(T &val)
+    ~slot_reservation()
       {
-      if (size_==0) return false;
-      lock_t lock(mut_);
-      // Queue might have been emptied while we acquired the lock
-      if (q_.empty()) return false;
-
-      --size_;
-      val = std::move(q_.front());
-      q_.pop();
-      return true;
+      global_budget().release(nown_+nextra_);
+      if (group_) group_->release(nown_+nextra_);
       }
 
+    size_t nextra() const { return nextra_; }
+    thread_budget *group() const { return group_; }
+  };
+
+#if defined(__linux__)
 
-    // bool try_pop(T &val)
-    //   {
-    //   while (size_ > 0)
-    //     {
-    //     lock_t lock(mut_);
-    //     // Item might not have been added yet
-    //     if (q_.empty()) continue;
+// parses a list in the format of the Linux sysfs, e.g. "0-3,8,10-11"
+std::vector<size_t> read_idxlist(const std::string &fname)
+  {
+  std::vector<size_t> res;
+  std::ifstream inp(fname);
+  std::string line;
+  if (!std::getline(inp, line)) return res;
+  std::istringstream iss(line);
+  std::string tok;
+  while (std::getline(iss, tok, ','))
+    {
+    auto pos = tok.find('-');
+    size_t lo = std::stoul(tok.substr(0, pos)),
+           hi = (pos==std::string::npos) ? lo : std::stoul(tok.substr(pos+1));
+    for (size_t i=lo; i<=hi; ++i)
+      res.push_back(i);
+    }
+  return res;
+  }
 
-    //     --size_;
-    //     val = std::move(q_.front());
-    //     q_.pop();
-    //     return true;
-    //     }
-    //   return false;
-    //   }
-  };
+/* Returns the CPUs in \a allowed, ordered according to \a policy. */
+std::vector<size_t> cpu_order(AffinityPolicy policy, const cpu_set_t &allowed)
+  {
+  auto is_allowed = [&](size_t cpu)
+    { return (cpu<CPU_SETSIZE) && CPU_ISSET(cpu, &allowed); };
+  std::vector<std::vector<size_t>> nodes;
+  const std::string sysdir("/sys/devices/system/node/");
+  for (auto node: read_idxlist(sysdir+"online"))
+    {
+    std::vector<size_t> cpus;
+    for (auto cpu: read_idxlist(sysdir+"node"+std::to_string(node)+"/cpulist"))
+      if (is_allowed(cpu)) cpus.push_back(cpu);
+    if (!cpus.empty()) nodes.push_back(cpus);
+    }
+  if (nodes.empty())  // no NUMA information available
+    {
+    nodes.emplace_back();
+    for (size_t cpu=0; cpu<CPU_SETSIZE; ++cpu)
+      if (is_allowed(cpu)) nodes[0].push_back(cpu);
+    }
+  std::vector<size_t> res;
+  if (policy==AFFINITY_COMPACT)
+    for (const auto &node: nodes)
+      res.insert(res.end(), node.begin(), node.end());
+  else
+    for (size_t i=0, nleft=1; nleft>0; ++i)
+      {
+      nleft=0;
+      for (const auto &node: nodes)
+        if (i<node.size())
+          { res.push_back(node[i]); ++nleft; }
+      }
+  return res;
+  }
+
+#endif
+
+AffinityPolicy affinity_from_env()
+  {
+  auto val = getenv("DUCC0_AFFINITY");
+  if (!val) return AFFINITY_NONE;
+  std::string policy(val);
+  if ((policy=="") || (policy=="none")) return AFFINITY_NONE;
+  if (policy=="compact") return AFFINITY_COMPACT;
+  if (policy=="scatter") return AFFINITY_SCATTER;
+  MR_fail("DUCC0_AFFINITY must be 'none', 'compact' or 'scatter'");
+  }
 
+/* Every worker owns a work_deque and an inbox (an injection_queue).
+   Tasks submitted by a worker go to its own deque; task i of a parallel
+   region opened by another thread goes to the inbox of worker i-1 (modulo
+   the pool size), so that the mapping of tasks to workers (and, with
+   thread affinity, to CPUs) is reproducible.
+   Threads looking for work first pop from their own deque and inbox, then
+   steal from the deques of the other workers. Idle workers only take tasks
+   from other inboxes after spinning for a while, which gives the addressed
+   worker a chance to pick them up itself. */
 class thread_pool
   {
   private:
-    // A reasonable guess, probably close enough for most hardware
-    static constexpr size_t cache_line_size = 64;
     struct alignas(cache_line_size) worker
       {
       std::thread thread;
-      std::condition_variable work_ready;
+      work_deque deque;
+      injection_queue inbox;
+      // a sleeping worker waits for "wakeup"
       std::mutex mut;
-      std::atomic_flag busy_flag = ATOMIC_FLAG_INIT;
-      std::function<void()> work;
+      std::condition_variable wakeup;
+      std::atomic<bool> parked;
+      bool notified;  // protected by mut
+      };
 
-      void worker_main(std::atomic<bool> & shutdown_flag,
-        concurrent_queue<std::function<void()>> &overflow_work)
+    std::vector<worker> workers_;
+    // tasks submitted by execAsync()
+    injection_queue detached_;
+    std::mutex mut_;
+    std::atomic<bool> shutdown_;
+    AffinityPolicy affinity_;
+#if defined(__linux__)
+    cpu_set_t allowed_cpus_;
+#endif
+    using lock_t = std::lock_guard<std::mutex>;
+
+    void worker_main(size_t id)
+      {
+      worker_id = id;
+      auto &me(workers_[id]);
+      while (true)
         {
-        using lock_t = std::unique_lock<std::mutex>;
-        while (!shutdown_flag)
+        task *t = nullptr;
+        for (size_t i=0; (!t) && (i<spin_limit); ++i)
           {
-          std::function<void()> local_work;
+          if (shutdown_) return;
+          if ((!(t=find_work(2*i>=spin_limit))) && (!(t=detached_.pop())))
+            spin_wait(i);
+          }
+        if (!t)
           {
-          lock_t lock(mut);
-          // Wait to be woken by the thread pool with a piece of work
-          work_ready.wait(lock, [&]{ return (work || shutdown_flag); });
-          local_work.swap(work);
+          std::unique_lock<std::mutex> lock(me.mut);
+          me.parked.store(true, std::memory_order_seq_cst);
+          // pairs with the fence in wake(): either we see the new work
+          // here, or the submitter sees that we are parked
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          t = find_work(true);
+          if (!t) t = detached_.pop();
+          if (!t)
+            me.wakeup.wait(lock, [&]{ return me.notified || shutdown_; });
+          me.notified = false;
+          me.parked.store(false, std::memory_order_relaxed);
           }
+        if (t) t->run();
+        }
+      }
 
-          if (local_work) local_work();
-
-          // Execute any work which queued up while we were busy
-          while (overflow_work.try_pop(local_work)) local_work();
+    /* Wakes \a w if it is sleeping and no wakeup is pending; returns
+       whether it did so. */
+    bool wake_worker(worker &w)
+      {
+      if (!w.parked.load(std::memory_order_relaxed)) return false;
+      lock_t lock(w.mut);
+      if ((!w.parked.load(std::memory_order_relaxed)) || w.notified)
+        return false;
+      w.notified = true;
+      w.wakeup.notify_one();
+      return true;
+      }
 
-          // Mark ourself as available before going back to sleep
-          busy_flag.clear();
+    void apply_affinity_locked()
+      {
+#if defined(__linux__)
+      std::vector<size_t> order;
+      if (affinity_!=AFFINITY_NONE)
+        order = cpu_order(affinity_, allowed_cpus_);
+      for (size_t i=0; i<workers_.size(); ++i)
+        {
+        if (!workers_[i].thread.joinable()) continue;
+        cpu_set_t cpus = allowed_cpus_;
+        if (!order.empty())
+          {
+          CPU_ZERO(&cpus);
+          CPU_SET(order[(i+1)%order.size()], &cpus);
           }
+        // failure is not critical, the thread just stays unpinned
+        pthread_setaffinity_np(workers_[i].thread.native_handle(),
+          sizeof(cpu_set_t), &cpus);
         }
-      };
-
-    concurrent_queue<std::function<void()>> overflow_work_;
-    std::mutex mut_;
-    std::vector<worker> workers_;
-    std::atomic<bool> shutdown_;
-    using lock_t = std::lock_guard<std::mutex>;
+#endif
+      }
 
     void create_threads()
       {
@@ -177,11 +549,10 @@ class thread_pool
         {
         try
           {
-          auto *worker = &workers_[i];
-          worker->busy_flag.clear();
-          worker->work = nullptr;
-          worker->thread = std::thread(
-            [worker, this]{ worker->worker_main(shutdown_, overflow_work_); });
+          auto &w(workers_[i]);
+          w.parked = false;
+          w.notified = false;
+          w.thread = std::thread([this, i]{ worker_main(i); });
           }
         catch (...)
           {
@@ -189,13 +560,17 @@ class thread_pool
           throw;
           }
         }
+      apply_affinity_locked();
       }
 
     void shutdown_locked()
       {
       shutdown_ = true;
       for (auto &worker : workers_)
-        worker.work_ready.notify_all();
+        {
+        lock_t lock(worker.mut);
+        worker.wakeup.notify_all();
+        }
 
       for (auto &worker : workers_)
         if (worker.thread.joinable())
@@ -204,45 +579,101 @@ class thread_pool
 
   public:
     explicit thread_pool(size_t nthreads):
-      workers_(nthreads)
-      { create_threads(); }
+      workers_(nthreads), shutdown_(false), affinity_(affinity_from_env())
+      {
+#if defined(__linux__)
+      if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed_cpus_)!=0)
+        {
+        CPU_ZERO(&allowed_cpus_);
+        for (size_t i=0; i<std::min<size_t>(max_threads_, CPU_SETSIZE); ++i)
+          CPU_SET(i, &allowed_cpus_);
+        }
+#endif
+      create_threads();
+      }
 
     thread_pool(): thread_pool(max_threads_) {}
 
     ~thread_pool() { shutdown(); }
 
-    void submit(std::function<void()> work)
+    /* Queues task number \a itask (>0) of a parallel region; returns false
+       if this is not possible (queue full or pool shut down), in which case
+       the caller should run the task itself. Sleeping workers are only
+       woken by wake(). */
+    bool submit(task *t, size_t itask)
       {
-      lock_t lock(mut_);
-      if (shutdown_)
-        throw std::runtime_error("Work item submitted after shutdown");
+      if (shutdown_) return false;
+      size_t nw = workers_.size();
+      return (worker_id<nw) ? workers_[worker_id].deque.push(t)
+                            : workers_[(itask-1)%nw].inbox.push(t);
+      }
 
-      auto submit_to_idle = [&](std::function<void()> &work) -> bool
-        {
-        for (auto &worker : workers_)
-          if (!worker.busy_flag.test_and_set())
-            {
-            {
-            lock_t lock(worker.mut);
-            worker.work = std::move(work);
-            }
-            worker.work_ready.notify_one();
-            return true;
-            }
-        return false;
-        };
+    /* Wakes sleeping workers after tasks 1 to \a ntasks of a region have
+       been submitted. */
+    void wake(size_t ntasks)
+      {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      size_t nw = workers_.size(), nextra = 0;
+      if (worker_id<nw)  // any worker can steal the tasks from our deque
+        nextra = ntasks;
+      else
+        for (size_t i=0; i<ntasks; ++i)
+          // if the addressed worker is awake, it may be busy for a while,
+          // so alert another one
+          if ((i>=nw) || (!wake_worker(workers_[i]))) ++nextra;
+      for (size_t i=0; (i<nw) && (nextra>0); ++i)
+        if (wake_worker(workers_[i])) --nextra;
+      }
+
+    /* Queues a task which does not belong to a parallel region and wakes
+       a worker for it; returns false if this is not possible. */
+    bool submit_detached(task *t)
+      {
+      if (shutdown_ || (!detached_.push(t))) return false;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (auto &w: workers_)
+        if (wake_worker(w)) break;
+      return true;
+      }
 
-      // First check for any idle workers and wake those
-      if (submit_to_idle(work)) return;
-      // If no workers were idle, push onto the overflow queue for later
-      overflow_work_.push(std::move(work));
+    /* Returns a queued task, or nullptr if none was found. Tasks in the
+       inboxes of other workers are only considered if \a all_inboxes is
+       true. */
+    task *find_work(bool all_inboxes)
+      {
+      size_t nw = workers_.size(), me = worker_id;
+      if (me<nw)
+        {
+        if (auto t=workers_[me].deque.pop()) return t;
+        if (auto t=workers_[me].inbox.pop()) return t;
+        }
+      size_t start = (me<nw) ? me+1 : 0;
+      for (size_t i=0; i<nw; ++i)
+        {
+        size_t victim = (start+i)%nw;
+        if (victim==me) continue;
+        if (auto t=workers_[victim].deque.steal()) return t;
+        }
+      if (all_inboxes)
+        for (size_t i=0; i<nw; ++i)
+          {
+          size_t victim = (start+i)%nw;
+          if (victim==me) continue;
+          if (auto t=workers_[victim].inbox.pop()) return t;
+          }
+      return nullptr;
+      }
 
-      // Possible race: All workers might have gone idle between the first
-      // submit attempt and pushing the work item into the queue. So, there
-      // could be no active workers to check the queue.
-      // Resolve with another check for idle workers.
-      std::function<void()> dummy_work = []{};
-      submit_to_idle(dummy_work);
+    void set_affinity(AffinityPolicy policy)
+      {
+      lock_t lock(mut_);
+      affinity_ = policy;
+      apply_affinity_locked();
+      }
+    AffinityPolicy affinity()
+      {
+      lock_t lock(mut_);
+      return affinity_;
       }
 
     void shutdown()
@@ -276,13 +707,17 @@ inline thread_pool &get_pool()
   return pool;
   }
 
+void set_thread_affinity(AffinityPolicy policy)
+  { get_pool().set_affinity(policy); }
+AffinityPolicy get_thread_affinity()
+  { return get_pool().affinity(); }
+
 class Distribution
   {
   private:
     size_t nthreads_;
-    std::mutex mut_;
     size_t nwork_;
-    size_t cur_;
+    std::atomic<size_t> cur_;
     size_t chunksize_;
     double fact_max_;
     std::vector<size_t> nextstart;
@@ -358,15 +793,24 @@ class Distribution
           }
         case DYNAMIC:
           {
-          std::unique_lock<std::mutex> lck(mut_);
-          if (cur_>=nwork_) return Range();
-          auto rem = nwork_-cur_;
-          size_t tmp = size_t((fact_max_*double(rem))/double(nthreads_));
-          auto sz = std::min(rem, std::max(chunksize_, tmp));
-          size_t lo=cur_;
-          cur_+=sz;
-          size_t hi=cur_;
-          return Range(lo, hi);
+          if (fact_max_==0.)  // fixed chunk size
+            {
+            auto lo = cur_.fetch_add(chunksize_, std::memory_order_relaxed);
+            if (lo>=nwork_) return Range();
+            return Range(lo, std::min(lo+chunksize_, nwork_));
+            }
+          auto lo = cur_.load(std::memory_order_relaxed);
+          size_t sz;
+          do
+            {
+            if (lo>=nwork_) return Range();
+            auto rem = nwork_-lo;
+            size_t tmp = size_t((fact_max_*double(rem))/double(nthreads_));
+            sz = std::min(rem, std::max(chunksize_, tmp));
+            }
+          while (!cur_.compare_exchange_weak(lo, lo+sz,
+            std::memory_order_relaxed));
+          return Range(lo, lo+sz);
           }
         }
       return Range();
@@ -387,6 +831,64 @@ class MyScheduler: public Scheduler
     virtual Range getNext() { return dist_.getNext(ithread_); }
   };
 
+/* The state of a parallel region whose logical threads are shared among
+   the calling thread and a number of helpers. */
+class region
+  {
+  private:
+    Distribution &dist_;
+    std::function<void(Scheduler &)> &f_;
+    thread_budget *group_;
+    std::atomic<size_t> next_;
+    std::mutex ex_mut_;
+
+  public:
+    latch counter;
+    std::exception_ptr ex;
+
+    region(Distribution &dist, std::function<void(Scheduler &)> &f,
+      thread_budget *group, size_t nhelpers)
+      : dist_(dist), f_(f), group_(group), next_(nhelpers+1),
+        counter(nhelpers) {}
+
+    /* Executes logical thread \a first, then further ones which have not
+       been claimed yet. */
+    void work(size_t first)
+      {
+      region_scope scope(group_);
+      for (size_t i=first; i<dist_.nthreads();
+           i=next_.fetch_add(1, std::memory_order_relaxed))
+        try
+          {
+          MyScheduler sched(dist_, i);
+          f_(sched);
+          }
+        catch (...)
+          {
+          std::lock_guard<std::mutex> lock(ex_mut_);
+          ex = std::current_exception();
+          }
+      }
+  };
+
+/* Helper number \a ihelper (>0) of a parallel region; it starts with the
+   logical thread of the same number. */
+class region_task: public task
+  {
+  private:
+    region *reg_;
+    size_t ihelper_;
+
+  public:
+    region_task(region &reg, size_t ihelper): reg_(&reg), ihelper_(ihelper) {}
+
+    virtual void run()
+      {
+      reg_->work(ihelper_);
+      reg_->counter.count_down();
+      }
+  };
+
 void Distribution::thread_map(std::function<void(Scheduler &)> f)
   {
   if (nthreads_ == 1)
@@ -396,30 +898,45 @@ void Distribution::thread_map(std::function<void(Scheduler &)> f)
     return;
     }
 
+  slot_reservation slots(nthreads_-1);
+  size_t nhelpers = std::min(slots.nextra(), nthreads_-1);
+  if (nhelpers==0)  // run all logical threads here
+    {
+    region_scope scope(slots.group());
+    for (size_t i=0; i<nthreads_; ++i)
+      {
+      MyScheduler sched(*this, i);
+      f(sched);
+      }
+    return;
+    }
+
   auto & pool = get_pool();
-  latch counter(nthreads_);
-  std::exception_ptr ex;
-  std::mutex ex_mut;
-  for (size_t i=0; i<nthreads_; ++i)
+  region reg(*this, f, slots.group(), nhelpers);
+  std::vector<region_task> tasks;
+  tasks.reserve(nhelpers);
+  for (size_t i=1; i<=nhelpers; ++i)
+    tasks.emplace_back(reg, i);
+  for (size_t i=1; i<=nhelpers; ++i)
+    if (!pool.submit(&tasks[i-1], i))
+      tasks[i-1].run();
+  pool.wake(nhelpers);
+  // the calling thread takes part in the work ...
+  reg.work(0);
+  // ... and executes queued tasks (of this or any other region) until
+  // all helpers are finished; if it finds nothing to do for a while, it goes
+  // to sleep.
+  for (size_t i=0; !reg.counter.is_ready(); )
     {
-    pool.submit(
-      [this, &f, i, &counter, &ex, &ex_mut] {
-      try
-        {
-        MyScheduler sched(*this, i);
-        f(sched);
-        }
-      catch (...)
-        {
-        std::lock_guard<std::mutex> lock(ex_mut);
-        ex = std::current_exception();
-        }
-      counter.count_down();
-      });
+    if (auto t=pool.find_work(true))
+      { t->run(); i=0; }
+    else if (i<spin_limit)
+      spin_wait(i++);
+    else
+      reg.counter.wait();
     }
-  counter.wait();
-  if (ex)
-    std::rethrow_exception(ex);
+  if (reg.ex)
+    std::rethrow_exception(reg.ex);
   }
 
 void execSingle(size_t nwork, std::function<void(Scheduler &)> func)
@@ -451,11 +968,40 @@ void execParallel(size_t nthreads, std::function<void(Scheduler &)> func)
   dist.execParallel(nthreads, move(func));
   }
 
+/* A task of execAsync(), which deletes itself when done. */
+class detached_task: public task
+  {
+  private:
+    std::function<void()> func_;
+
+  public:
+    explicit detached_task(std::function<void()> func): func_(move(func)) {}
+    virtual void run()
+      {
+      func_();
+      delete this;
+      }
+  };
+
+void execAsync(std::function<void()> func)
+  {
+  auto t = new detached_task(move(func));
+  if (!get_pool().submit_detached(t))
+    t->run();
+  }
+
 #else
 
 size_t get_default_nthreads() { return 1; }
 void set_default_nthreads(size_t /* new_default_nthreads */) {}
 size_t max_threads() { return 1; }
+void set_thread_budget(size_t /* nthreads */) {}
+size_t get_thread_budget() { return 1; }
+ThreadGroupScope::ThreadGroupScope(const ThreadGroup &group)
+  : budget_(group.budget_), old_(nullptr) {}
+ThreadGroupScope::~ThreadGroupScope() {}
+void set_thread_affinity(AffinityPolicy /* policy */) {}
+AffinityPolicy get_thread_affinity() { return AFFINITY_NONE; }
 
 class MyScheduler: public Scheduler
   {
@@ -502,6 +1048,8 @@ void execParallel(size_t, std::function<void(Scheduler &)> func)
   MyScheduler sched(1);
   func(sched);
   }
+void execAsync(std::function<void()> func)
+  { func(); }
 
 #endif
 
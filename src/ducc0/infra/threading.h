@@ -23,6 +23,8 @@
 #define DUCC0_THREADING_H
 
 #include <functional>
+#include <new>
+#include <memory>
 
 namespace ducc0 {
 
@@ -51,6 +53,76 @@ size_t max_threads();
 void set_default_nthreads(size_t new_default_nthreads);
 size_t get_default_nthreads();
 
+/*! Policies for pinning the worker threads of the thread pool to CPUs. */
+enum AffinityPolicy
+  {
+  AFFINITY_NONE,    /*!< threads may run on any CPU */
+  AFFINITY_COMPACT, /*!< fill the CPUs of one NUMA node before the next */
+  AFFINITY_SCATTER  /*!< assign consecutive threads round-robin to the NUMA
+                         nodes */
+  };
+
+/*! Pins the worker threads according to \a policy (only supported on
+    Linux; a no-op elsewhere). Only CPUs which the process is allowed to use
+    at startup are considered. Thread \a i of a parallel region (\a i>0)
+    runs preferably on worker \a i-1, which is pinned to the \a i-th CPU of
+    the policy's ordering; the first CPU is left to the thread opening the
+    regions, which is never pinned.
+    The initial policy is taken from the environment variable
+    DUCC0_AFFINITY ("none", "compact" or "scatter"); the default is
+    AFFINITY_NONE. */
+void set_thread_affinity(AffinityPolicy policy);
+AffinityPolicy get_thread_affinity();
+
+/*! Sets the maximum number of threads working concurrently in the parallel
+    regions of the whole process (default: max_threads()).
+    A region asking for \a nthreads threads obtains as many helper threads as
+    the budget allows; its \a nthreads logical threads (as reported by
+    Scheduler::num_threads() and Scheduler::thread_num()) are then shared
+    among the helpers and the calling thread, so that the results do not
+    depend on the budget. A thread opening a region counts against the budget
+    only if it is not already working in another region, i.e. nested regions
+    reuse the slot of their caller, and run serially if the budget is
+    exhausted. */
+void set_thread_budget(size_t nthreads);
+size_t get_thread_budget();
+
+class thread_budget;
+
+/*! A bound on the number of threads working concurrently in the parallel
+    regions of several callers. Regions opened by a thread while it is inside
+    a ThreadGroupScope of the group (including regions nested in them, on any
+    thread) draw their helper threads from the group, in addition to the
+    process-wide budget. ThreadGroup objects may be copied; the copies share
+    the same bound. */
+class ThreadGroup
+  {
+  private:
+    std::shared_ptr<thread_budget> budget_;
+
+    friend class ThreadGroupScope;
+
+  public:
+    explicit ThreadGroup(size_t nthreads);
+    size_t nthreads() const;
+  };
+
+/*! While an object of this class exists, parallel regions opened by the
+    current thread belong to the given ThreadGroup. Scopes on the same thread
+    must be destroyed in reverse order of their construction. */
+class ThreadGroupScope
+  {
+  private:
+    std::shared_ptr<thread_budget> budget_;
+    thread_budget *old_;
+
+  public:
+    explicit ThreadGroupScope(const ThreadGroup &group);
+    ~ThreadGroupScope();
+    ThreadGroupScope(const ThreadGroupScope &) = delete;
+    ThreadGroupScope &operator=(const ThreadGroupScope &) = delete;
+  };
+
 void execSingle(size_t nwork,
   std::function<void(Scheduler &)> func);
 void execStatic(size_t nwork, size_t nthreads, size_t chunksize,
@@ -61,17 +133,55 @@ void execGuided(size_t nwork, size_t nthreads, size_t chunksize_min,
   double fact_max, std::function<void(Scheduler &)> func);
 void execParallel(size_t nthreads, std::function<void(Scheduler &)> func);
 
+/*! Runs \a func on a worker thread of the thread pool and returns without
+    waiting for it. Such tasks are started in the order of submission,
+    whenever a worker has no work of parallel regions to do; parallel regions
+    opened by \a func are subject to the thread budget like any others.
+    \a func must not throw. If the pool cannot accept the task, \a func is
+    executed immediately by the calling thread. */
+void execAsync(std::function<void()> func);
+
+/*! Value-initializes the \a nblocks*blocksize objects of type \a T in the
+    freshly allocated memory at \a ptr. The blocks are distributed over the
+    threads like the work items of execStatic(nblocks, nthreads, 0, ...).
+    Since the operating system places every memory page on the NUMA node of
+    the thread touching it first, later execStatic() loops of the same shape
+    will then mostly access node-local memory (see also
+    set_thread_affinity()). */
+template<typename T> void first_touch_init(T *ptr, size_t nblocks,
+  size_t blocksize, size_t nthreads)
+  {
+  execStatic(nblocks, nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext())
+      for (size_t i=rng.lo*blocksize; i<rng.hi*blocksize; ++i)
+        new(ptr+i) T();
+    });
+  }
+
 } // end of namespace detail_threading
 
 using detail_threading::max_threads;
 using detail_threading::get_default_nthreads;
 using detail_threading::set_default_nthreads;
+using detail_threading::AffinityPolicy;
+using detail_threading::AFFINITY_NONE;
+using detail_threading::AFFINITY_COMPACT;
+using detail_threading::AFFINITY_SCATTER;
+using detail_threading::set_thread_affinity;
+using detail_threading::get_thread_affinity;
+using detail_threading::set_thread_budget;
+using detail_threading::get_thread_budget;
+using detail_threading::ThreadGroup;
+using detail_threading::ThreadGroupScope;
+using detail_threading::first_touch_init;
 using detail_threading::Scheduler;
 using detail_threading::execSingle;
 using detail_threading::execStatic;
 using detail_threading::execDynamic;
 using detail_threading::execGuided;
 using detail_threading::execParallel;
+using detail_threading::execAsync;
 
 } // end of namespace ducc0
 
@@ -28,8 +28,16 @@
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 #include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/perf_counters.h"
 
 namespace ducc0 {
 
@@ -52,6 +60,201 @@ class SimpleTimer
       { return chrono::duration<double>(clock::now() - starttime).count(); }
   };
 
+/*! Process-wide recorder of timed regions, which can be written in the
+    Chrome trace-event format (to be viewed with chrome://tracing or
+    Perfetto). Every thread records into its own buffer.
+    Recording is switched off by default; while it is off, a TraceScope
+    costs a single relaxed atomic load. */
+class TraceRecorder
+  {
+  private:
+    using clock = chrono::steady_clock;
+
+    struct event
+      {
+      string name;
+      double t0, t1; // microseconds since the creation of the recorder
+      bool has_counts;
+      PerfCounts counts;
+      };
+    struct thread_buffer
+      {
+      size_t tid;
+      mutex mtx;
+      vector<event> events;
+      };
+
+    atomic<bool> enabled_;
+    clock::time_point epoch;
+    mutable mutex mtx;
+    vector<unique_ptr<thread_buffer>> buffers;
+
+    thread_buffer &local_buffer()
+      {
+      static thread_local thread_buffer *buf = nullptr;
+      if (!buf)
+        {
+        lock_guard<mutex> lock(mtx);
+        buffers.push_back(make_unique<thread_buffer>());
+        buf = buffers.back().get();
+        buf->tid = buffers.size()-1;
+        }
+      return *buf;
+      }
+
+    static void write_escaped(const string &str, ostream &os)
+      {
+      for (auto c: str)
+        {
+        if ((c=='"') || (c=='\\')) os << '\\' << c;
+        else if (static_cast<unsigned char>(c)<0x20) os << ' ';
+        else os << c;
+        }
+      }
+
+  public:
+    TraceRecorder()
+      : enabled_(false), epoch(clock::now()) {}
+
+    bool enabled() const
+      { return enabled_.load(memory_order_relaxed); }
+    void set_enabled(bool on)
+      { enabled_.store(on, memory_order_relaxed); }
+
+    /*! Returns the microseconds elapsed since the creation of the recorder. */
+    double now() const
+      { return chrono::duration<double, micro>(clock::now()-epoch).count(); }
+
+    /*! Records a region named \a name, which was active on the calling
+        thread from \a t0 to \a t1 (as returned by now()). If \a counts is
+        not null, it is stored with the event as the hardware counter values
+        of the region. */
+    void record(const string &name, double t0, double t1,
+      const PerfCounts *counts=nullptr)
+      {
+      auto &buf = local_buffer();
+      lock_guard<mutex> lock(buf.mtx);
+      buf.events.push_back({name, t0, t1, counts!=nullptr,
+        counts ? *counts : PerfCounts()});
+      }
+
+    /*! Discards all recorded events. */
+    void clear()
+      {
+      lock_guard<mutex> lock(mtx);
+      for (auto &buf: buffers)
+        {
+        lock_guard<mutex> lock2(buf->mtx);
+        buf->events.clear();
+        }
+      }
+
+    /*! Writes all recorded events as a JSON object in the Chrome trace-event
+        format ("complete" events, one thread ID per recording thread). */
+    void write_json(ostream &os) const
+      {
+      ostringstream oss;
+      oss << "{\"traceEvents\":[";
+      bool first=true;
+      lock_guard<mutex> lock(mtx);
+      for (const auto &buf: buffers)
+        {
+        lock_guard<mutex> lock2(buf->mtx);
+        for (const auto &ev: buf->events)
+          {
+          oss << (first ? "\n" : ",\n") << "{\"name\":\"";
+          write_escaped(ev.name, oss);
+          oss << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buf->tid
+              << fixed << setprecision(3) << ",\"ts\":" << ev.t0
+              << ",\"dur\":" << ev.t1-ev.t0;
+          if (ev.has_counts)
+            {
+            oss << ",\"args\":{";
+            bool firstarg=true;
+            for (size_t i=0; i<PERF_NEVENTS; ++i)
+              if (perf_event_available(i))
+                {
+                oss << (firstarg ? "" : ",") << "\"" << perf_event_name(i)
+                    << "\":" << setprecision(0) << ev.counts[i];
+                firstarg=false;
+                }
+            oss << "}";
+            }
+          oss << "}";
+          first=false;
+          }
+        }
+      oss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+      os << oss.str();
+      }
+    string json() const
+      { ostringstream oss; write_json(oss); return oss.str(); }
+  };
+
+/*! Returns the process-wide TraceRecorder. */
+inline TraceRecorder &trace_recorder()
+  {
+  static TraceRecorder rec;
+  return rec;
+  }
+
+/*! Records the lifetime of the object as a region named \a name, if the
+    TraceRecorder is enabled at construction time. If hardware performance
+    counters are switched on as well (see perf_counters.h), the counts of
+    the whole process during the region are stored with the event.
+    \note \a name must outlive the object. */
+class TraceScope
+  {
+  private:
+    const char *name;
+    double t0;
+    bool counting;
+    PerfCounts c0;
+
+  public:
+    TraceScope(const char *name_)
+      : name(nullptr), t0(0.), counting(false)
+      {
+      auto &rec = trace_recorder();
+      if (rec.enabled())
+        {
+        name=name_;
+        counting = perf_counters_enabled();
+        if (counting) c0=read_perf_counters();
+        t0=rec.now();
+        }
+      }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+    ~TraceScope()
+      {
+      if (name)
+        {
+        auto &rec = trace_recorder();
+        double t1 = rec.now();
+        if (counting)
+          {
+          auto cnt = read_perf_counters()-c0;
+          rec.record(name, t0, t1, &cnt);
+          }
+        else
+          rec.record(name, t0, t1);
+        }
+      }
+  };
+
+/*! Hierarchical accumulation of wall clock times.
+    Every thread calling push() and pop() has its own timer stack; the
+    stacks are merged by get_timings() and report(). Only the thread which
+    created the object accounts the time outside of all pushed timers (to
+    the root), and get_timings() and report() must not be called while
+    other threads are still using the object.
+    If the TraceRecorder is enabled, every timer interval is recorded
+    there as well.
+    If hardware performance counters are switched on (see perf_counters.h),
+    the counts of the whole process are accounted to the timers of the
+    creating thread in the same way as the wall clock time, and reported
+    alongside. */
 class TimerHierarchy
   {
   private:
@@ -67,6 +270,8 @@ class TimerHierarchy
         tstack_node *parent;
         string name;
         double accTime;
+        PerfCounts accCounts;
+        double traceStart; // start time for the TraceRecorder, or <0
         maptype child;
 
       private:
@@ -77,6 +282,13 @@ class TimerHierarchy
             t_own += nd.second.full_acc();
           return t_own;
           }
+        PerfCounts full_counts() const
+          {
+          PerfCounts c_own = accCounts;
+          for (const auto &nd: child)
+            c_own += nd.second.full_counts();
+          return c_own;
+          }
 
         size_t max_namelen() const
           {
@@ -92,17 +304,37 @@ class TimerHierarchy
           os << setw(pre) << int(val) << "." << setw(post) << setfill('0')
              << int((val-int(val))*fct+0.5) << setfill(' ');
           }
+        static void printcounts(const PerfCounts &cnt, ostream &os)
+          {
+          auto prec = os.precision();
+          os << fixed << setprecision(2);
+          if (perf_event_available(PERF_CYCLES))
+            os << "  " << setw(8) << 1e-9*cnt[PERF_CYCLES] << " Gcyc";
+          if (perf_event_available(PERF_INSTRUCTIONS)
+           && perf_event_available(PERF_CYCLES))
+            os << "  IPC " << setw(5)
+               << ((cnt[PERF_CYCLES]>0) ? cnt[PERF_INSTRUCTIONS]/cnt[PERF_CYCLES] : 0.);
+          if (perf_event_available(PERF_LLC_MISSES))
+            os << "  LLC misses " << setw(9) << 1e-6*cnt[PERF_LLC_MISSES] << "M";
+          if (perf_event_available(PERF_FP_OPS))
+            os << "  FP " << setw(8) << 1e-9*cnt[PERF_FP_OPS] << "G";
+          os.unsetf(ios_base::floatfield);
+          os.precision(prec);
+          }
         static void printline(const string &indent, int twidth, int slen,
           const string &name, double val, double total,
-          ostream &os)
+          const PerfCounts *cnt, ostream &os)
           {
           os << indent << "+- " << name << setw(slen+1-name.length()) << ":";
           floatformat(100*val/total, 3, 2, os);
           os << "% (";
           floatformat(val, twidth-5, 4, os);
-          os << "s)\n";
+          os << "s)";
+          if (cnt) printcounts(*cnt, os);
+          os << "\n";
           }
-        void report(const string &indent, int twidth, int slen, ostream &os) const
+        void report(const string &indent, int twidth, int slen,
+          bool counts, ostream &os) const
           {
           double total=full_acc();
           vector<Tipair> tmp;
@@ -114,21 +346,28 @@ class TimerHierarchy
             sort(tmp.begin(),tmp.end(),
               [](const Tipair &a, const Tipair &b){ return a.second>b.second; });
             double tsum=0;
+            PerfCounts csum;
             os << indent << "|\n";
             for (unsigned i=0; i<tmp.size(); ++i)
               {
-              printline(indent, twidth, slen, tmp[i].first->first, tmp[i].second, total, os);
-              (tmp[i].first->second).report(indent+"|  ",twidth,slen,os);
+              const auto &nd(tmp[i].first->second);
+              PerfCounts cnt = counts ? nd.full_counts() : PerfCounts();
+              printline(indent, twidth, slen, tmp[i].first->first, tmp[i].second,
+                total, counts ? &cnt : nullptr, os);
+              nd.report(indent+"|  ",twidth,slen,counts,os);
               tsum+=tmp[i].second;
+              csum+=cnt;
               }
-            printline(indent, twidth, slen, "<unaccounted>", total-tsum, total, os);
+            PerfCounts crest = counts ? full_counts()-csum : PerfCounts();
+            printline(indent, twidth, slen, "<unaccounted>", total-tsum, total,
+              counts ? &crest : nullptr, os);
             if (indent!="") os << indent << "\n";
             }
           }
 
       public:
         tstack_node(const string &name_, tstack_node *parent_=nullptr)
-          : parent(parent_), name(name_), accTime(0.) {}
+          : parent(parent_), name(name_), accTime(0.), traceStart(-1.) {}
 
         void report(ostream &os) const
           {
@@ -139,13 +378,36 @@ class TimerHierarchy
           os << "\nTotal wall clock time for " << name << ": " << setprecision(4) << total << "s\n";
 //          printf("\nTotal wall clock time for '%s': %1.4fs\n",name.c_str(),total);
 
+          bool counts = full_counts()[PERF_CYCLES]>0;
+          if (counts)
+            {
+            os << "Hardware counters (whole process):";
+            printcounts(full_counts(), os);
+            os << "\n";
+            }
+
           int logtime=max(1,int(log10(total)+1));
-          report("",logtime+5,slen, os);
+          report("",logtime+5,slen,counts,os);
           }
 
         void addTime(double dt)
           { accTime += dt; }
 
+        /* Adds the times of \a other and its descendants to this node and
+           its descendants. */
+        void merge(const tstack_node &other)
+          {
+          accTime += other.accTime;
+          accCounts += other.accCounts;
+          for (const auto &ch: other.child)
+            {
+            auto it=child.find(ch.first);
+            if (it==child.end())
+              it = child.insert(make_pair(ch.first,tstack_node(ch.first, this))).first;
+            it->second.merge(ch.second);
+            }
+          }
+
         double add_timings(const string &prefix,
           map<string, double> &res) const
           {
@@ -155,64 +417,146 @@ class TimerHierarchy
           res[prefix] = t_own;
           return t_own;
           }
+        PerfCounts add_counts(const string &prefix,
+          map<string, PerfCounts> &res) const
+          {
+          PerfCounts c_own = accCounts;
+          for (const auto &nd: child)
+            c_own += nd.second.add_counts(prefix+":"+nd.first, res);
+          res[prefix] = c_own;
+          return c_own;
+          }
+      };
+
+    struct tstack
+      {
+      clock::time_point last_time;
+      tstack_node root;
+      tstack_node *curnode;
+      bool owner;
+      bool counting; // last_counts is valid
+      PerfCounts last_counts;
+
+      tstack(const string &name, bool owner_)
+        : last_time(clock::now()), root(name, nullptr), curnode(&root),
+          owner(owner_), counting(false) {}
       };
 
-    clock::time_point last_time;
-    tstack_node root;
-    tstack_node *curnode;
+    string name;
+    mutable mutex mtx;
+    map<thread::id, unique_ptr<tstack>> stacks;
 
-    void adjust_time()
+    tstack &local_stack()
+      {
+      lock_guard<mutex> lock(mtx);
+      auto &res = stacks[this_thread::get_id()];
+      if (!res) res = make_unique<tstack>(name, false);
+      return *res;
+      }
+
+    static void adjust_time(tstack &st)
       {
       auto tnow = clock::now();
-      curnode->addTime(chrono::duration<double>(tnow - last_time).count());
-      last_time = tnow;
+      if (st.owner || (st.curnode!=&st.root))
+        st.curnode->addTime(chrono::duration<double>(tnow - st.last_time).count());
+      st.last_time = tnow;
+      if (st.owner)
+        {
+        bool on = perf_counters_enabled();
+        if (on)
+          {
+          auto cnt = read_perf_counters();
+          if (st.counting)
+            st.curnode->accCounts += cnt-st.last_counts;
+          st.last_counts = cnt;
+          }
+        st.counting = on;
+        }
       }
 
-    void push_internal(const string &name)
+    static void push_internal(tstack &st, const string &name)
       {
-      auto it=curnode->child.find(name);
-      if (it==curnode->child.end())
+      auto it=st.curnode->child.find(name);
+      if (it==st.curnode->child.end())
         {
         MR_assert(name.find(':') == string::npos, "reserved character");
-        it = curnode->child.insert(make_pair(name,tstack_node(name, curnode))).first;
+        it = st.curnode->child.insert(make_pair(name,tstack_node(name, st.curnode))).first;
+        }
+      st.curnode=&(it->second);
+      auto &rec = trace_recorder();
+      st.curnode->traceStart = rec.enabled() ? rec.now() : -1.;
+      }
+    static void pop_internal(tstack &st)
+      {
+      auto node = st.curnode;
+      MR_assert(node->parent!=nullptr, "tried to pop from empty timer stack");
+      if (node->traceStart>=0.)
+        {
+        auto &rec = trace_recorder();
+        rec.record(node->name, node->traceStart, rec.now());
         }
-      curnode=&(it->second);
+      st.curnode = node->parent;
+      }
+
+    tstack_node merged() const
+      {
+      tstack_node res(name);
+      lock_guard<mutex> lock(mtx);
+      for (const auto &st: stacks)
+        res.merge(st.second->root);
+      return res;
       }
 
   public:
-    TimerHierarchy(const string &name="<root>")
-      : last_time(clock::now()), root(name, nullptr), curnode(&root) {}
+    TimerHierarchy(const string &name_="<root>")
+      : name(name_)
+      { stacks[this_thread::get_id()] = make_unique<tstack>(name, true); }
     void push(const string &name)
       {
-      adjust_time();
-      push_internal(name);
+      auto &st = local_stack();
+      adjust_time(st);
+      push_internal(st, name);
       }
     void pop()
       {
-      adjust_time();
-      curnode = curnode->parent;
-      MR_assert(curnode!=nullptr, "tried to pop from empty timer stack");
+      auto &st = local_stack();
+      adjust_time(st);
+      pop_internal(st);
       }
     void poppush(const string &name)
       {
-      pop();
-      push_internal(name);
+      auto &st = local_stack();
+      adjust_time(st);
+      pop_internal(st);
+      push_internal(st, name);
       }
     map<string, double> get_timings()
       {
-      adjust_time();
+      adjust_time(local_stack());
       map<string, double> res;
-      root.add_timings("root", res);
+      merged().add_timings("root", res);
+      return res;
+      }
+    /*! Returns the hardware counter values accounted to every timer (see
+        perf_counters.h), with the same keys as get_timings(). */
+    map<string, PerfCounts> get_counts()
+      {
+      adjust_time(local_stack());
+      map<string, PerfCounts> res;
+      merged().add_counts("root", res);
       return res;
       }
     void report(ostream &os) const
-      { ostringstream oss; root.report(oss); os<<oss.str(); }
+      { ostringstream oss; merged().report(oss); os<<oss.str(); }
   };
 
 }
 
 using detail_timers::SimpleTimer;
 using detail_timers::TimerHierarchy;
+using detail_timers::TraceRecorder;
+using detail_timers::trace_recorder;
+using detail_timers::TraceScope;
 
 }
 
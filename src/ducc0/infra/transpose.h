@@ -29,8 +29,11 @@
 #define DUCC_TRANSPOSE_H
 
 #include <algorithm>
+#include <type_traits>
 #include "ducc0/infra/error_handling.h"
 #include "ducc0/infra/mav.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/threading.h"
 
 namespace ducc0 {
 
@@ -89,10 +92,126 @@ template<typename T, typename Func> void sthelper1(const T *in, T *out,
     func(*in, *out);
   }
 
+/*! Function object performing a plain copy; passing it to transpose()
+    enables the in-register tile transposes below. */
+struct copy_op
+  {
+  template<typename T> void operator()(const T &in, T &out) const
+    { out=in; }
+  };
+
+/* In-register transposes of square tiles, selected by element size.
+   \a vl is the tile edge length; \a trans() reads \a vl rows of \a vl
+   contiguous elements starting at \a in (row distance \a sti elements)
+   and writes them transposed to \a out (row distance \a sto elements).
+   A \a vl of 1 means that no SIMD kernel is available (16-byte elements
+   are moved as a whole anyway). */
+template<size_t sz> struct tile_kernel
+  { static constexpr size_t vl=1; };
+
+/* 128-bit tiles are used even if AVX is available: with 256-bit stores,
+   which cross cache lines for most row lengths, the transposes turned out
+   to be slower than the scalar code. */
+#if (!defined(DUCC0_NO_SIMD)) && defined(__SSE2__)
+template<> struct tile_kernel<4>
+  {
+  static constexpr size_t vl=4;
+  static void trans(const void *in_, ptrdiff_t sti, void *out_, ptrdiff_t sto)
+    {
+    auto in = reinterpret_cast<const float *>(in_);
+    auto out = reinterpret_cast<float *>(out_);
+    __m128 r0 = _mm_loadu_ps(in),
+           r1 = _mm_loadu_ps(in+sti),
+           r2 = _mm_loadu_ps(in+2*sti),
+           r3 = _mm_loadu_ps(in+3*sti);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(out      , r0);
+    _mm_storeu_ps(out+  sto, r1);
+    _mm_storeu_ps(out+2*sto, r2);
+    _mm_storeu_ps(out+3*sto, r3);
+    }
+  };
+template<> struct tile_kernel<8>
+  {
+  static constexpr size_t vl=2;
+  static void trans(const void *in_, ptrdiff_t sti, void *out_, ptrdiff_t sto)
+    {
+    auto in = reinterpret_cast<const double *>(in_);
+    auto out = reinterpret_cast<double *>(out_);
+    __m128d r0 = _mm_loadu_pd(in),
+            r1 = _mm_loadu_pd(in+sti);
+    _mm_storeu_pd(out    , _mm_unpacklo_pd(r0, r1));
+    _mm_storeu_pd(out+sto, _mm_unpackhi_pd(r0, r1));
+    }
+  };
+#endif
+
+template<typename T, typename Func> constexpr bool use_tile_kernel
+  = is_same<Func, copy_op>::value && (tile_kernel<sizeof(T)>::vl>1)
+    && is_trivially_copyable<T>::value;
+
 bool critical(ptrdiff_t s)
   {
   s = (s>=0) ? s : -s;
-  return (s>4096) && ((s&(s-1))==0);
+  return (s>=1024) && ((s&(s-1))==0);
+  }
+
+/* Transposes a block which is contiguous along axis 1 on input and along
+   axis 0 on output (sti1==sto0==1) with the tile kernel. */
+template<typename T, typename Kernel> void tile_block(const T *in, T *out,
+  size_t s0, size_t s1, ptrdiff_t sti0, ptrdiff_t sto1)
+  {
+  constexpr size_t vl = Kernel::vl;
+  size_t s0v = s0-s0%vl, s1v = s1-s1%vl;
+  for (size_t i0=0; i0<s0v; i0+=vl)
+    for (size_t i1=0; i1<s1v; i1+=vl)
+      Kernel::trans(in+i0*sti0+i1, sti0, out+i1*sto1+i0, sto1);
+  for (size_t i0=0; i0<s0; ++i0)
+    for (size_t i1=(i0<s0v) ? s1v : 0; i1<s1; ++i1)
+      out[i1*sto1+i0] = in[i0*sti0+i1];
+  }
+
+/* Recursive (cache-oblivious) blocking: the longer of the two axes is
+   halved until both fit into a leaf of edge length \a leaf. The inner loop
+   of a leaf runs over axis 1. */
+template<typename T, typename Func> void sthelper2_rec(const T *in, T *out,
+  size_t s0, size_t s1, ptrdiff_t sti0, ptrdiff_t sti1, ptrdiff_t sto0,
+  ptrdiff_t sto1, size_t leaf, Func func)
+  {
+  if ((s0<=leaf) && (s1<=leaf))
+    {
+    if constexpr (use_tile_kernel<T, Func>)
+      if ((sti1==1) && (sto0==1))
+        return tile_block<T, tile_kernel<sizeof(T)>>(in, out, s0, s1, sti0, sto1);
+    constexpr size_t bs=8;
+    for (size_t ii0=0; ii0<s0; ii0+=bs)
+      {
+      size_t ii0e = min(s0, ii0+bs);
+      for (size_t ii1=0; ii1<s1; ii1+=bs)
+        {
+        size_t ii1e = min(s1, ii1+bs);
+        for (size_t i0=ii0; i0<ii0e; ++i0)
+          for (size_t i1=ii1; i1<ii1e; ++i1)
+            func(in[i0*sti0+i1*sti1], out[i0*sto0+i1*sto1]);
+        }
+      }
+    return;
+    }
+  // split at a multiple of the leaf size, so that all tiles stay complete
+  if (s0>=s1)
+    {
+    size_t h = max(leaf, (s0/(2*leaf))*leaf);
+    sthelper2_rec(in, out, h, s1, sti0, sti1, sto0, sto1, leaf, func);
+    sthelper2_rec(in+h*sti0, out+h*sto0, s0-h, s1, sti0, sti1, sto0, sto1,
+      leaf, func);
+    }
+  else
+    {
+    size_t h = max(leaf, (s1/(2*leaf))*leaf);
+    sthelper2_rec(in, out, s0, h, sti0, sti1, sto0, sto1, leaf, func);
+    sthelper2_rec(in+h*sti1, out+h*sto1, s0, s1-h, sti0, sti1, sto0, sto1,
+      leaf, func);
+    }
   }
 
 template<typename T, typename Func> void sthelper2(const T * DUCC0_RESTRICT in,
@@ -122,58 +241,88 @@ template<typename T, typename Func> void sthelper2(const T * DUCC0_RESTRICT in,
     return;
     }
   // OK, we have to do a real transpose
-  // select blockig sizes depending on critical strides
-  bool crit0 = critical(sizeof(T)*sti0) || critical(sizeof(T)*sto0);
-  bool crit1 = critical(sizeof(T)*sti1) || critical(sizeof(T)*sto1);
-  size_t bs0 = crit0 ? 8 : 8;
-  size_t bs1 = crit1 ? 8 : 8;
-  // make sure that the smallest absolute stride goes in the innermost loop
-  if (min(abs(sti0),abs(sto0))<min(abs(sti1),abs(sto1)))
+  // make sure that the smallest absolute stride goes in the innermost loop;
+  // the tile kernel expects the input to be contiguous along axis 1
+  if ((min(abs(sti0),abs(sto0))<min(abs(sti1),abs(sto1)))
+    || (use_tile_kernel<T, Func> && (sti0==1) && (sto1==1)))
     {
     swap(s0,s1);
     swap(sti0,sti1);
     swap(sto0,sto1);
-    swap(bs0, bs1);
-    }
-  for (size_t ii0=0; ii0<s0; ii0+=bs0)
-    {
-    size_t ii0e = min(s0, ii0+bs0);
-    for (size_t ii1=0; ii1<s1; ii1+=bs1)
-      {
-      size_t ii1e = min(s1, ii1+bs1);
-      for (size_t i0=ii0; i0<ii0e; ++i0)
-        for (size_t i1=ii1; i1<ii1e; ++i1)
-          func(in[i0*sti0+i1*sti1], out[i0*sto0+i1*sto1]);
-      }
     }
-  }
-
-template<typename T, typename Func> void iter(const fmav<T> &in,
-  fmav<T> &out, size_t dim, ptrdiff_t idxin, ptrdiff_t idxout, Func func)
-  {
-  size_t ndim = in.ndim();
-  if (dim+2==ndim)
-    sthelper2(in.data()+idxin, out.vdata()+idxout, in.shape(ndim-2), in.shape(ndim-1),
-      in.stride(ndim-2), in.stride(ndim-1), out.stride(ndim-2),
-      out.stride(ndim-1), func);
-  else
-    for (size_t i=0; i<in.shape(dim); ++i)
-      iter(in, out, dim+1, idxin+i*in.stride(dim), idxout+i*out.stride(dim), func);
+  // smaller leaves for strides which map all rows to few cache sets
+  size_t leaf = (critical(sizeof(T)*sti0) || critical(sizeof(T)*sto1)) ? 16 : 32;
+  sthelper2_rec(in, out, s0, s1, sti0, sti1, sto0, sto1, leaf, func);
   }
 
 template<typename T, typename Func> void transpose(const fmav<T> &in,
-  fmav<T> &out, Func func)
+  fmav<T> &out, Func func, size_t nthreads=1)
   {
   auto [shp, si, so] = prep(in, out);
-  fmav<T> in2(in, shp, si), out2(out, shp, so);
-  if (in2.ndim()==1)  // 1D, just iterate
+  size_t ndim = shp.size();
+  if (ndim==0)  // single element
+    {
+    func(*in.data(), *out.vdata());
+    return;
+    }
+  // not worth the overhead of a parallel region
+  if (in.size()<(size_t(1)<<15)) nthreads=1;
+  const T *pin = in.data();
+  T *pout = out.vdata();
+  if (ndim==1)  // 1D, just iterate
     {
-    sthelper1(in2.data(), out2.vdata(), in2.shape(0), in2.stride(0), out2.stride(0), func);
+    execStatic(shp[0], nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext())
+        sthelper1(pin+rng.lo*si[0], pout+rng.lo*so[0], rng.hi-rng.lo,
+          si[0], so[0], func);
+      });
     return;
     }
-  iter(in2, out2, 0, 0, 0, func);
+  // The work items are the 2D slices spanned by the two last axes. If there
+  // are too few of them to keep all threads busy, the slices are
+  // additionally split along their longer axis.
+  size_t nouter=1;
+  for (size_t i=0; i+2<ndim; ++i)
+    nouter*=shp[i];
+  size_t s0=shp[ndim-2], s1=shp[ndim-1];
+  size_t isplit = (s0>=s1) ? ndim-2 : ndim-1;
+  size_t nsplit = 1;
+  if ((nthreads!=1) && (nouter<4*max_threads()))
+    nsplit = min((4*max_threads()+nouter-1)/nouter,
+                 max<size_t>(1, shp[isplit]/32));
+  execStatic(nouter*nsplit, nthreads, 0, [&](Scheduler &sched)
+    {
+    auto shp2(shp);
+    while (auto rng=sched.getNext())
+      for (auto item=rng.lo; item<rng.hi; ++item)
+        {
+        size_t iouter = item/nsplit, ipart = item%nsplit;
+        ptrdiff_t idxin=0, idxout=0;
+        for (size_t i=ndim-2; i-->0; )
+          {
+          size_t pos = iouter%shp[i];
+          iouter /= shp[i];
+          idxin += ptrdiff_t(pos)*si[i];
+          idxout += ptrdiff_t(pos)*so[i];
+          }
+        size_t lo = (ipart*shp[isplit])/nsplit,
+               hi = ((ipart+1)*shp[isplit])/nsplit;
+        idxin += ptrdiff_t(lo)*si[isplit];
+        idxout += ptrdiff_t(lo)*so[isplit];
+        shp2[isplit] = hi-lo;
+        sthelper2(pin+idxin, pout+idxout, shp2[ndim-2], shp2[ndim-1],
+          si[ndim-2], si[ndim-1], so[ndim-2], so[ndim-1], func);
+        }
+    });
   }
 
+/*! Copies \a in to \a out (which must have the same shape), using \a nthreads
+    threads. */
+template<typename T> void transpose(const fmav<T> &in, fmav<T> &out,
+  size_t nthreads=1)
+  { transpose(in, out, copy_op(), nthreads); }
+
 }
 
 using detail_transpose::transpose;
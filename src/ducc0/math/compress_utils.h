@@ -25,6 +25,10 @@
 /*! \file compress_utils.h
  *  Support for compression of integer arrays.
  *
+ *  Strictly increasing sequences (like the boundaries of a rangeset) are
+ *  stored via binary interpolative coding, which needs only a few bits per
+ *  entry if the gaps between neighbouring entries are small.
+ *
  *  Copyright (C) 2013-2020 Max-Planck-Society
  *  \author Martin Reinecke
  */
@@ -32,85 +36,82 @@
 #ifndef DUCC0_COMPRESS_UTILS_H
 #define DUCC0_COMPRESS_UTILS_H
 
+#include <cstdint>
+#include <cstddef>
 #include <limits>
 #include <vector>
 #include <iterator>
+#include <algorithm>
 
-#include "ducc0/error_handling.h"
-#include "ducc0/math_utils.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/math/math_utils.h"
 
 namespace ducc0 {
 
+/*! Class for writing a stream of unsigned integers with arbitrary bit
+    lengths (most significant bit first). */
 class obitstream
   {
   private:
     std::vector<uint8_t> data;
     size_t bitpos;
 
-    template<typename T> void put_internal (const T &val, uint8_t bits)
-      {
-      int bitsleft = 8-(bitpos&7);
-      if (bitsleft==8) data.push_back(0);
-      if (bits<=bitsleft) // wbits==bits
-        {
-        data.back() |= ((val&((T(1)<<bits)-1))<<(bitsleft-bits));
-        bitpos+=bits;
-        }
-      else // wbits==bitsleft
-        {
-        data.back() |= ((val>>(bits-bitsleft))&((1<<bitsleft)-1));
-        bitpos+=bitsleft;
-        put_internal(val,bits-bitsleft);
-        }
-      }
-
   public:
     obitstream() : bitpos(0) {}
 
+    /*! Appends the lowest \a bits bits of \a val to the stream. */
     template<typename T> void put (const T &val, uint8_t bits)
       {
       if (bits==0) return;
       MR_assert(bits<=(sizeof(T)<<3),"too many bits for this data type");
-//      MR_assert(val-(val&((T(1)<<bits)-1))==0,"value has too many bits");
-      put_internal(val,bits);
+      uint64_t v = uint64_t(val);
+      // fill the partially written byte, then copy whole bytes
+      while (bits>0)
+        {
+        size_t bitsleft = 8-(bitpos&7);
+        if (bitsleft==8) data.push_back(0);
+        size_t nb = std::min<size_t>(bits, bitsleft);
+        data.back() |= uint8_t(((v>>(bits-nb))&((1u<<nb)-1))<<(bitsleft-nb));
+        bitpos+=nb;
+        bits=uint8_t(bits-nb);
+        }
       }
 
+    /*! Returns the bytes written so far; unused bits of the last byte
+        are zero. */
     const std::vector<uint8_t> &state() const
       { return data; }
   };
 
+/*! Class for reading a stream written by an obitstream.
+    \note The stream refers to the bytes passed to the constructor, which
+    must stay alive and unchanged while it is used. */
 class ibitstream
   {
   private:
-    const std::vector<uint8_t> data;
-    size_t bitpos;
+    const uint8_t *data;
+    size_t size, bitpos;
 
-    template<typename T> void get_internal (T &val, int bits)
-      {
-      int bitsleft = 8-(bitpos&7);
-      if (bits<=bitsleft)
-        {
-        val |= ((data[bitpos>>3]>>(bitsleft-bits))&((1<<bits)-1));
-        bitpos+=bits;
-        }
-      else
-        {
-        val |= T((data[bitpos>>3])&((1<<bitsleft)-1))<<(bits-bitsleft);
-        bitpos+=bitsleft;
-        get_internal(val,bits-bitsleft);
-        }
-      }
   public:
-    ibitstream(const std::vector<uint8_t> &indata) : data(indata), bitpos(0) {}
+    ibitstream(const std::vector<uint8_t> &indata)
+      : data(indata.data()), size(indata.size()), bitpos(0) {}
 
+    /*! Reads the next \a bits bits from the stream. */
     template<typename T> T get (uint8_t bits)
       {
       if (bits==0) return T(0);
       MR_assert(bits<=(sizeof(T)<<3),"too many bits for this data type");
-      MR_assert((bitpos+bits)<=8*data.size(),"reading past end of stream");
-      T res=T(0);
-      get_internal(res,bits);
-      return res;
+      MR_assert((bitpos+bits)<=8*size,"reading past end of stream");
+      uint64_t res=0;
+      while (bits>0)
+        {
+        size_t bitsleft = 8-(bitpos&7);
+        size_t nb = std::min<size_t>(bits, bitsleft);
+        res = (res<<nb) | ((data[bitpos>>3]>>(bitsleft-nb))&((1u<<nb)-1));
+        bitpos+=nb;
+        bits=uint8_t(bits-nb);
+        }
+      return T(res);
       }
     void rewind (uint8_t bits) {bitpos-=bits;}
   };
@@ -155,6 +156,8 @@ template<typename Iter> void interpol_encode2 (Iter l, Iter r, obitstream &obs,
   interpol_encode2(m,r,obs,shift);
   }
 
+/*! Writes the strictly increasing, nonnegative sequence [\a l;\a r[ to
+    \a obs, using binary interpolative coding. */
 template<typename Iter> void interpol_encode (Iter l, Iter r, obitstream &obs)
   {
   typedef std::iterator_traits<Iter> traits;
@@ -217,6 +220,8 @@ template<typename Iter> void interpol_decode2 (Iter l, Iter r, ibitstream &ibs,
   interpol_decode2(m,r,ibs,shift);
   }
 
+/*! Reads a sequence written by interpol_encode() from \a ibs and stores it
+    in \a v. */
 template<typename T> void interpol_decode (std::vector<T> &v, ibitstream &ibs)
   {
   uint8_t maxbits=ibs.get<uint8_t>(8);
@@ -36,8 +36,9 @@
 #include <vector>
 #include <utility>
 #include <iostream>
-#include "ducc0/error_handling.h"
-#include "ducc0/math_utils.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/math/math_utils.h"
+#include "ducc0/math/rangeset.h"
 
 namespace ducc0 {
 
@@ -163,7 +164,7 @@ template<typename T> class crangeset
         T b,e;
 
       public:
-        IvIter(const crangeset &ref_) : rsi(ref_)
+        IvIter(const crangeset &ref_) : rsi(ref_), b(0), e(0)
           {
           if (rsi.atEnd()) return;
           b=*rsi;
@@ -375,6 +376,29 @@ template<typename T> class crangeset
                            : generalAllOrNothing2(b,a,flip_b,flip_a));
       }
   public:
+    crangeset() {}
+    /*! Creates a crangeset containing the same values as \a rs. */
+    explicit crangeset(const rangeset<T> &rs)
+      {
+      r.reserve(2*rs.nranges());
+      for (size_t i=0; i<rs.nranges(); ++i)
+        append(rs.ivbegin(i),rs.ivend(i));
+      r.shrink_to_fit();
+      }
+    /*! Returns a rangeset containing the same values as the crangeset. */
+    rangeset<T> toRangeset() const
+      {
+      rangeset<T> res;
+      res.reserve(r.size());
+      typename crangeset<T>::IvIter iter(*this);
+      while (!iter.atEnd())
+        {
+        res.append(iter.ivbegin(),iter.ivend());
+        ++iter;
+        }
+      return res;
+      }
+
     /*! Removes all rangeset entries. */
     void clear() { r.clear(); }
     bool empty() const { return r.empty(); }
@@ -48,10 +48,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <complex>
 #include <algorithm>
+#include <typeindex>
 #include "ducc0/infra/threading.h"
 #include "ducc0/infra/misc_utils.h"
 #include "ducc0/infra/simd.h"
 #include "ducc0/infra/mav.h"
+#include "ducc0/infra/timers.h"
 #ifndef DUCC0_NO_THREADING
 #include <mutex>
 #endif
@@ -122,8 +124,177 @@ struct util // hack to avoid duplicate symbols
     return std::max(size_t(1), std::min(parallel, max_threads));
     }
 #endif
+
+  /* Minimum length of a 1D transform for which the multithreaded
+     "four-step" algorithm is considered. */
+  static constexpr size_t fourstep_minlen = 32768;
+
+#ifdef DUCC0_NO_THREADING
+  static size_t fourstep_factor (size_t /*nthreads*/, const fmav_info &/*info*/,
+    size_t /*axis*/, size_t /*len*/)
+    { return 0; }
+#else
+  /* Returns a factor n1 of len (with 16<=n1<=len/n1) if the transforms along
+     axis should be done by decomposing every line into a 2D problem of shape
+     (n1, len/n1); this is the case if there are too few lines to keep all
+     threads busy. Otherwise returns 0. */
+  static size_t fourstep_factor (size_t nthreads, const fmav_info &info,
+    size_t axis, size_t len)
+    {
+    size_t max_threads = (nthreads==0) ? ducc0::get_default_nthreads() : nthreads;
+    if ((max_threads==1) || (len<fourstep_minlen)) return 0;
+    if (info.size()/info.shape(axis) >= max_threads) return 0;
+    size_t res=0;
+    for (size_t f=16; f*f<=len; ++f)
+      if (len%f==0) res=f;
+    return res;
+    }
+#endif
   };
 
+//
+// plan cache
+//
+
+/*! Process-wide, bounded LRU cache for 1D transform plans.
+    Entries are keyed by plan type (which includes the precision) and length;
+    plans are handed out as shared pointers, so evicting an entry never
+    invalidates a plan that is still in use. Evicted plans which are still
+    referenced elsewhere are remembered and handed out again on request.
+    Only plans of identical type and length are shared; every plan still
+    holds its own twiddle factors, which are not shared across lengths. */
+class plan_cache
+  {
+  private:
+    struct entry
+      {
+      std::type_index type;
+      size_t length;
+      std::shared_ptr<void> plan;
+      size_t last_access;
+      };
+    struct weak_entry
+      {
+      std::type_index type;
+      size_t length;
+      std::weak_ptr<void> plan;
+      };
+
+    std::vector<entry> cache;
+    std::vector<weak_entry> evicted;
+    size_t max_size=16;
+    size_t access_counter=0;
+    size_t nhits=0, nmisses=0;
+#ifndef DUCC0_NO_THREADING
+    std::mutex mut;
+    using lock_t = std::lock_guard<std::mutex>;
+#else
+    struct lock_t { lock_t(int) {} };
+    int mut=0;
+#endif
+
+    // marks e as the most recently used entry
+    void touch(entry &e)
+      { e.last_access = ++access_counter; }
+
+    void shrink_to(size_t sz)
+      {
+      while (cache.size()>sz)
+        {
+        size_t lru=0;
+        for (size_t i=1; i<cache.size(); ++i)
+          if (cache[i].last_access<cache[lru].last_access)
+            lru=i;
+        auto &e(cache[lru]);
+        if (e.plan.use_count()>1) // still in use somewhere else
+          evicted.push_back({e.type, e.length, e.plan});
+        cache.erase(cache.begin()+ptrdiff_t(lru));
+        }
+      }
+
+    void insert(std::type_index type, size_t length, std::shared_ptr<void> plan)
+      {
+      if (max_size==0) return;
+      shrink_to(max_size-1);
+      cache.push_back({type, length, plan, 0});
+      touch(cache.back());
+      }
+
+    std::shared_ptr<void> find(std::type_index type, size_t length)
+      {
+      for (auto &e: cache)
+        if ((e.length==length) && (e.type==type))
+          { touch(e); return e.plan; }
+      for (size_t i=0; i<evicted.size(); )
+        {
+        auto p = evicted[i].plan.lock();
+        if (!p)
+          { evicted.erase(evicted.begin()+ptrdiff_t(i)); continue; }
+        if ((evicted[i].length==length) && (evicted[i].type==type))
+          {
+          evicted.erase(evicted.begin()+ptrdiff_t(i));
+          insert(type, length, p);
+          return p;
+          }
+        ++i;
+        }
+      return nullptr;
+      }
+
+  public:
+    template<typename Tplan> std::shared_ptr<Tplan> get(size_t length)
+      {
+      std::type_index type(typeid(Tplan));
+      {
+      lock_t lock(mut);
+      auto p = find(type, length);
+      if (p) { ++nhits; return std::static_pointer_cast<Tplan>(p); }
+      ++nmisses;
+      }
+      // construct the plan outside the lock, it may take a while
+      auto plan = std::make_shared<Tplan>(length);
+      {
+      lock_t lock(mut);
+      // another thread may have been faster
+      auto p = find(type, length);
+      if (p) return std::static_pointer_cast<Tplan>(p);
+      insert(type, length, plan);
+      }
+      return plan;
+      }
+
+    void clear()
+      {
+      lock_t lock(mut);
+      cache.clear();
+      evicted.clear();
+      nhits=nmisses=0;
+      }
+    void set_max_size(size_t sz)
+      {
+      lock_t lock(mut);
+      max_size=sz;
+      shrink_to(max_size);
+      }
+    size_t get_max_size()
+      { lock_t lock(mut); return max_size; }
+    size_t size()
+      { lock_t lock(mut); return cache.size(); }
+    size_t hits()
+      { lock_t lock(mut); return nhits; }
+    size_t misses()
+      { lock_t lock(mut); return nmisses; }
+  };
+
+inline plan_cache &get_plan_cache()
+  {
+  static plan_cache cache;
+  return cache;
+  }
+
+template<typename Tplan> std::shared_ptr<Tplan> get_plan(size_t length)
+  { return get_plan_cache().get<Tplan>(length); }
+
 
 //
 // sine/cosine transforms
@@ -145,7 +316,7 @@ template<typename T0> class T_dct1
       size_t N=fftplan.length(), n=N/2+1;
       if (ortho)
         { c[0]*=sqrt2; c[n-1]*=sqrt2; }
-      aligned_array<T> tmp(N);
+      scratch_array<T> tmp(N);
       tmp[0] = c[0];
       for (size_t i=1; i<n; ++i)
         tmp[i] = tmp[N-i] = c[i];
@@ -173,7 +344,7 @@ template<typename T0> class T_dst1
       bool /*ortho*/, int /*type*/, bool /*cosine*/) const
       {
       size_t N=fftplan.length(), n=N/2-1;
-      aligned_array<T> tmp(N);
+      scratch_array<T> tmp(N);
       tmp[0] = tmp[n+1] = c[0]*0;
       for (size_t i=0; i<n; ++i)
         { tmp[i+1]=c[i]; tmp[N-1-i]=-c[i]; }
@@ -291,7 +462,7 @@ template<typename T0> class T_dcst4
         // and is released under the 3-clause BSD license with friendly
         // permission of Matteo Frigo and Steven G. Johnson.
 
-        aligned_array<T> y(N);
+        scratch_array<T> y(N);
         {
         size_t i=0, m=n2;
         for (; m<N; ++i, m+=4)
@@ -334,7 +505,7 @@ template<typename T0> class T_dcst4
         {
         // even length algorithm from
         // https://www.appletonaudio.com/blog/2013/derivation-of-fast-dct-4-algorithm-based-on-dft/
-        aligned_array<Cmplx<T>> y(n2);
+        scratch_array<Cmplx<T>> y(n2);
         for(size_t i=0; i<n2; ++i)
           {
           y[i].Set(c[2*i],c[N-1-2*i]);
@@ -551,13 +722,13 @@ class rev_iter
     size_t remaining() const { return rem; }
   };
 
-template<typename T, typename T0> DUCC0_NOINLINE aligned_array<T> alloc_tmp
+template<typename T, typename T0> DUCC0_NOINLINE scratch_array<T> alloc_tmp
   (const fmav_info &info, size_t axsize)
   {
   auto othersize = info.size()/axsize;
   constexpr auto vlen = native_simd<T0>::size();
   auto tmpsize = axsize*((othersize>=vlen) ? vlen : 1);
-  return aligned_array<T>(tmpsize);
+  return scratch_array<T>(tmpsize);
   }
 
 template <typename T, size_t vlen> DUCC0_NOINLINE void copy_input(const multi_iter<vlen> &it,
@@ -733,17 +904,19 @@ DUCC0_NOINLINE void general_nd(const fmav<T> &in, fmav<T> &out,
   const shape_t &axes, T0 fct, size_t nthreads, const Exec & exec,
   const bool allow_inplace=true)
   {
-  std::unique_ptr<Tplan> plan;
+  TraceScope trace("general_nd");
+  std::shared_ptr<Tplan> plan;
 
   for (size_t iax=0; iax<axes.size(); ++iax)
     {
     size_t len=in.shape(axes[iax]);
     if ((!plan) || (len!=plan->length()))
-      plan = std::make_unique<Tplan>(len);
+      plan = get_plan<Tplan>(len);
 
     execParallel(
       util::thread_count(nthreads, in, axes[iax], native_simd<T0>::size()),
       [&](Scheduler &sched) {
+        TraceScope trace_thread("general_nd pass");
         constexpr auto vlen = native_simd<T0>::size();
         auto storage = alloc_tmp<T,T0>(in, len);
         const auto &tin(iax==0? in : out);
@@ -902,7 +1075,7 @@ template<typename T> DUCC0_NOINLINE void general_r2c(
   const fmav<T> &in, fmav<Cmplx<T>> &out, size_t axis, bool forward, T fct,
   size_t nthreads)
   {
-  auto plan = std::make_unique<pocketfft_r<T>>(in.shape(axis));
+  auto plan = get_plan<pocketfft_r<T>>(in.shape(axis));
   size_t len=in.shape(axis);
   execParallel(
     util::thread_count(nthreads, in, axis, native_simd<T>::size()),
@@ -959,7 +1132,7 @@ template<typename T> DUCC0_NOINLINE void general_c2r(
   const fmav<Cmplx<T>> &in, fmav<T> &out, size_t axis, bool forward, T fct,
   size_t nthreads)
   {
-  auto plan = std::make_unique<pocketfft_r<T>>(out.shape(axis));
+  auto plan = get_plan<pocketfft_r<T>>(out.shape(axis));
   size_t len=out.shape(axis);
   execParallel(
     util::thread_count(nthreads, in, axis, native_simd<T>::size()),
@@ -1047,6 +1220,137 @@ struct ExecR2R
     }
   };
 
+//
+// parallel transforms of long 1D arrays ("four-step" algorithm)
+//
+
+/* Computes a single 1D c2c transform of length n1*n2, using all threads.
+   The input is regarded as an (n1, n2) matrix A with A(a,b)=in[a*n2+b];
+   after transforming its columns, multiplying by the twiddle factors
+   W_len^{b*c} and transforming its rows, element (c,d) of the result is
+   out[c+n1*d], so the final transposition is done by writing to a transposed
+   view of the output. in and out may be identical. */
+template<typename T> DUCC0_NOINLINE void c2c_fourstep(const fmav<Cmplx<T>> &in,
+  fmav<Cmplx<T>> &out, size_t n1, bool forward, T fct, size_t nthreads)
+  {
+  size_t len=in.shape(0), n2=len/n1;
+  MR_assert(n1*n2==len, "bad factorization");
+  ptrdiff_t si=in.stride(0), so=out.stride(0);
+  fmav<Cmplx<T>> in2(in.data(), {n1,n2}, {ptrdiff_t(n2)*si, si});
+  fmav<Cmplx<T>> tmp({n1,n2});
+  general_nd<pocketfft_c<T>>(in2, tmp, {0}, fct, nthreads, ExecC2C{forward});
+  UnityRoots<T,Cmplx<T>> roots(len);
+  execStatic(n1, nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext()) for(auto c=rng.lo; c<rng.hi; ++c)
+      {
+      auto row = tmp.vdata()+c*n2;
+      for (size_t b=1, idx=c; b<n2; ++b, idx+=c)
+        {
+        if (idx>=len) idx-=len;
+        row[b] = forward ? row[b].template special_mul<true>(roots[idx])
+                         : row[b].template special_mul<false>(roots[idx]);
+        }
+      }
+    });
+  fmav<Cmplx<T>> out2(out.vdata(), {n1,n2}, {so, ptrdiff_t(n1)*so}, true);
+  general_nd<pocketfft_c<T>>(tmp, out2, {1}, T(1), nthreads, ExecC2C{forward});
+  }
+
+template<typename T> DUCC0_NOINLINE void general_c2c_fourstep(
+  const fmav<Cmplx<T>> &in, fmav<Cmplx<T>> &out, size_t axis, size_t n1,
+  bool forward, T fct, size_t nthreads)
+  {
+  size_t len=in.shape(axis);
+  multi_iter<1> it(in, out, axis, 1, 0);
+  while (it.remaining()>0)
+    {
+    it.advance(1);
+    fmav<Cmplx<T>> lin(in.data()+it.iofs(0), {len}, {it.stride_in()});
+    fmav<Cmplx<T>> lout(out.vdata()+it.oofs(0), {len}, {it.stride_out()}, true);
+    c2c_fourstep(lin, lout, n1, forward, fct, nthreads);
+    }
+  }
+
+/* r2c transforms of even length 2*m are computed via a complex transform
+   of length m, using the standard split into even and odd samples. */
+template<typename T> DUCC0_NOINLINE void general_r2c_fourstep(
+  const fmav<T> &in, fmav<Cmplx<T>> &out, size_t axis, size_t n1,
+  bool forward, T fct, size_t nthreads)
+  {
+  size_t len=in.shape(axis), m=len/2;
+  fmav<Cmplx<T>> z({m});
+  UnityRoots<T,Cmplx<T>> roots(len);
+  multi_iter<1> it(in, out, axis, 1, 0);
+  while (it.remaining()>0)
+    {
+    it.advance(1);
+    auto pin = in.data()+it.iofs(0);
+    auto pout = out.vdata()+it.oofs(0);
+    ptrdiff_t si=it.stride_in(), so=it.stride_out();
+    auto pz = z.vdata();
+    execStatic(m, nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+        pz[i].Set(pin[ptrdiff_t(2*i)*si], pin[ptrdiff_t(2*i+1)*si]);
+      });
+    c2c_fourstep(z, z, n1, true, fct, nthreads);
+    execStatic(m+1, nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext()) for(auto k=rng.lo; k<rng.hi; ++k)
+        {
+        auto z1 = pz[(k==m) ? 0 : k], z2 = pz[(k==0) ? 0 : m-k];
+        // even and odd parts: e=(z1+conj(z2))/2, o=(z1-conj(z2))/(2i)
+        Cmplx<T> e(T(0.5)*(z1.r+z2.r), T(0.5)*(z1.i-z2.i)),
+                 o(T(0.5)*(z1.i+z2.i), T(0.5)*(z2.r-z1.r));
+        auto res = e + o.template special_mul<true>(roots[k]);
+        pout[ptrdiff_t(k)*so].Set(res.r, forward ? res.i : -res.i);
+        }
+      });
+    }
+  }
+
+/* c2r transforms of even length 2*m are computed via a complex transform
+   of length m, inverting the steps of general_r2c_fourstep. */
+template<typename T> DUCC0_NOINLINE void general_c2r_fourstep(
+  const fmav<Cmplx<T>> &in, fmav<T> &out, size_t axis, size_t n1,
+  bool forward, T fct, size_t nthreads)
+  {
+  size_t len=out.shape(axis), m=len/2;
+  fmav<Cmplx<T>> z({m});
+  UnityRoots<T,Cmplx<T>> roots(len);
+  multi_iter<1> it(in, out, axis, 1, 0);
+  while (it.remaining()>0)
+    {
+    it.advance(1);
+    auto pin = in.data()+it.iofs(0);
+    auto pout = out.vdata()+it.oofs(0);
+    ptrdiff_t si=it.stride_in(), so=it.stride_out();
+    auto pz = z.vdata();
+    execStatic(m, nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext()) for(auto k=rng.lo; k<rng.hi; ++k)
+        {
+        // a=X[k], b=conj(X[m-k]); imaginary parts of X[0] and X[m] are ignored
+        auto a = pin[ptrdiff_t(k)*si], b = pin[ptrdiff_t(m-k)*si];
+        if (k==0) { a.i=T(0); b.i=T(0); }
+        if (forward) a.i=-a.i; else b.i=-b.i;
+        Cmplx<T> e = a+b, o = (a-b).template special_mul<false>(roots[k]);
+        pz[k].Set(e.r-o.i, e.i+o.r);
+        }
+      });
+    c2c_fourstep(z, z, n1, false, fct, nthreads);
+    execStatic(m, nthreads, 0, [&](Scheduler &sched)
+      {
+      while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+        {
+        pout[ptrdiff_t(2*i)*so] = pz[i].r;
+        pout[ptrdiff_t(2*i+1)*so] = pz[i].i;
+        }
+      });
+    }
+  }
+
 template<typename T> DUCC0_NOINLINE void c2c(const fmav<std::complex<T>> &in,
   fmav<std::complex<T>> &out, const shape_t &axes, bool forward,
   T fct, size_t nthreads=1)
@@ -1055,6 +1359,9 @@ template<typename T> DUCC0_NOINLINE void c2c(const fmav<std::complex<T>> &in,
   if (in.size()==0) return;
   fmav<Cmplx<T>> in2(reinterpret_cast<const Cmplx<T> *>(in.data()), in);
   fmav<Cmplx<T>> out2(reinterpret_cast<Cmplx<T> *>(out.vdata()), out, out.writable());
+  if (axes.size()==1)
+    if (auto n1=util::fourstep_factor(nthreads, in, axes[0], in.shape(axes[0])))
+      return general_c2c_fourstep(in2, out2, axes[0], n1, forward, fct, nthreads);
   general_nd<pocketfft_c<T>>(in2, out2, axes, fct, nthreads, ExecC2C{forward});
   }
 
@@ -1094,6 +1401,10 @@ template<typename T> DUCC0_NOINLINE void r2c(const fmav<T> &in,
   util::sanity_check_cr(out, in, axis);
   if (in.size()==0) return;
   fmav<Cmplx<T>> out2(reinterpret_cast<Cmplx<T> *>(out.vdata()), out, out.writable());
+  size_t len=in.shape(axis);
+  if ((len&1)==0)
+    if (auto n1=util::fourstep_factor(nthreads, in, axis, len/2))
+      return general_r2c_fourstep(in, out2, axis, n1, forward, fct, nthreads);
   general_r2c(in, out2, axis, forward, fct, nthreads);
   }
 
@@ -1116,6 +1427,10 @@ template<typename T> DUCC0_NOINLINE void c2r(const fmav<std::complex<T>> &in,
   util::sanity_check_cr(in, out, axis);
   if (in.size()==0) return;
   fmav<Cmplx<T>> in2(reinterpret_cast<const Cmplx<T> *>(in.data()), in);
+  size_t len=out.shape(axis);
+  if ((len&1)==0)
+    if (auto n1=util::fourstep_factor(nthreads, out, axis, len/2))
+      return general_c2r_fourstep(in2, out, axis, n1, forward, fct, nthreads);
   general_c2r(in2, out, axis, forward, fct, nthreads);
   }
 
@@ -1133,6 +1448,74 @@ template<typename T> DUCC0_NOINLINE void c2r(const fmav<std::complex<T>> &in,
   c2r(atmp, out, axes.back(), forward, fct, nthreads);
   }
 
+/* In-place real transforms use the FFTW layout: along the padded axis the
+   real array holds 2*(n/2+1) values, of which the first n are the real data;
+   the same memory, reinterpreted as n/2+1 complex values, holds the
+   half-complex spectrum. This requires unit stride along the padded axis and
+   even strides along all other axes. */
+template<typename T> fmav<std::complex<T>> inplace_complex_view(fmav<T> &data,
+  size_t axis)
+  {
+  if (axis>=data.ndim()) throw std::invalid_argument("bad axis number");
+  MR_assert((data.shape(axis)&1)==0, "padded axis length must be even");
+  MR_assert(data.stride(axis)==1, "padded axis must have unit stride");
+  auto shp = data.shape();
+  auto str = data.stride();
+  shp[axis] >>= 1;
+  for (size_t i=0; i<data.ndim(); ++i)
+    if (i!=axis)
+      {
+      MR_assert((str[i]&1)==0, "strides of the padded array must be even");
+      str[i] /= 2;
+      }
+  return fmav<std::complex<T>>(reinterpret_cast<std::complex<T> *>(data.vdata()),
+    shp, str, true);
+  }
+template<typename T> fmav<T> inplace_real_view(fmav<T> &data, size_t axis,
+  size_t lastsize)
+  {
+  if (axis>=data.ndim()) throw std::invalid_argument("bad axis number");
+  MR_assert(data.shape(axis)==2*(lastsize/2+1), "bad padded axis length");
+  shape_t ext(data.shape());
+  ext[axis] = lastsize;
+  return data.subarray(shape_t(data.ndim(),0), ext);
+  }
+
+/*! In-place r2c transform: \a data is padded as described above along
+    \a axes.back(), \a lastsize is the number of real input values along
+    this axis. On exit \a data contains the complex result, which can be
+    accessed via inplace_complex_view(). */
+template<typename T> DUCC0_NOINLINE void r2c_inplace(fmav<T> &data,
+  const shape_t &axes, size_t lastsize, bool forward, T fct,
+  size_t nthreads=1)
+  {
+  util::sanity_check_axes(data.ndim(), axes);
+  auto rdata = inplace_real_view(data, axes.back(), lastsize);
+  auto cdata = inplace_complex_view(data, axes.back());
+  // every 1D line is completely read before its result is written, so the
+  // regular r2c code is safe to use on overlapping input and output
+  r2c(rdata, cdata, axes, forward, fct, nthreads);
+  }
+
+/*! In-place c2r transform: the complex input is stored in \a data as
+    described above; on exit the first \a lastsize entries along
+    \a axes.back() contain the real result. */
+template<typename T> DUCC0_NOINLINE void c2r_inplace(fmav<T> &data,
+  const shape_t &axes, size_t lastsize, bool forward, T fct,
+  size_t nthreads=1)
+  {
+  util::sanity_check_axes(data.ndim(), axes);
+  auto rdata = inplace_real_view(data, axes.back(), lastsize);
+  auto cdata = inplace_complex_view(data, axes.back());
+  if (cdata.size()==0) return;
+  if (axes.size()>1)
+    {
+    auto newaxes = shape_t{axes.begin(), --axes.end()};
+    c2c(cdata, cdata, newaxes, forward, T(1), nthreads);
+    }
+  c2r(cdata, rdata, axes.back(), forward, fct, nthreads);
+  }
+
 template<typename T> DUCC0_NOINLINE void r2r_fftpack(const fmav<T> &in,
   fmav<T> &out, const shape_t &axes, bool real2hermitian, bool forward,
   T fct, size_t nthreads=1)
@@ -1152,6 +1535,89 @@ template<typename T> DUCC0_NOINLINE void r2r_separable_hartley(const fmav<T> &in
     false);
   }
 
+/* Pruned multi-D transforms: along every transformed axis of length n,
+   an extent e<=n selects the index range [0; e-e/2[ together with
+   [n-e/2; n[, i.e. a region centered on index 0 in FFT order.
+   \a in_extent describes where the input can be nonzero (it must be zero
+   everywhere else), \a out_extent describes which part of the output is
+   needed; all other output values are unspecified.
+   The axes are processed in the given order, and only the line transforms
+   intersecting the nonzero input region (in the axes not yet transformed)
+   and the wanted output region (in the axes already transformed) are
+   carried out. */
+template<typename T, typename Func> void general_pruned(fmav<T> &arr,
+  const shape_t &axes, const shape_t &in_extent, const shape_t &out_extent,
+  Func &&func)
+  {
+  util::sanity_check_axes(arr.ndim(), axes);
+  MR_assert((in_extent.size()==axes.size())&&(out_extent.size()==axes.size()),
+    "number of extents must match number of axes");
+  if (arr.size()==0) return;
+  size_t ndim = arr.ndim();
+  std::vector<size_t> axpos(ndim, ~size_t(0));
+  for (size_t i=0; i<axes.size(); ++i)
+    {
+    MR_assert(in_extent[i]<=arr.shape(axes[i]), "input extent too large");
+    MR_assert(out_extent[i]<=arr.shape(axes[i]), "output extent too large");
+    axpos[axes[i]] = i;
+    }
+  for (size_t iax=0; iax<axes.size(); ++iax)
+    {
+    // index ranges to be covered along every dimension
+    std::vector<std::vector<std::pair<size_t,size_t>>> rng(ndim);
+    for (size_t d=0; d<ndim; ++d)
+      {
+      size_t n=arr.shape(d), e=n;
+      if ((d!=axes[iax]) && (axpos[d]<axes.size()))
+        e = (axpos[d]<iax) ? out_extent[axpos[d]] : in_extent[axpos[d]];
+      if (e==n)
+        rng[d].emplace_back(0, n);
+      else
+        {
+        if (e-e/2>0) rng[d].emplace_back(0, e-e/2);
+        if (e/2>0) rng[d].emplace_back(n-e/2, e/2);
+        }
+      }
+    // loop over all combinations of ranges
+    shape_t pos(ndim,0), i0(ndim), ext(ndim);
+    bool done=false;
+    for (size_t d=0; d<ndim; ++d)
+      if (rng[d].empty()) done=true;
+    while (!done)
+      {
+      for (size_t d=0; d<ndim; ++d)
+        {
+        i0[d] = rng[d][pos[d]].first;
+        ext[d] = rng[d][pos[d]].second;
+        }
+      auto sub = arr.subarray(i0, ext);
+      func(sub, axes[iax], iax==0);
+      done=true;
+      for (size_t d=0; d<ndim; ++d)
+        if (++pos[d]<rng[d].size()) { done=false; break; }
+        else pos[d]=0;
+      }
+    }
+  }
+
+template<typename T> DUCC0_NOINLINE void c2c_pruned(
+  fmav<std::complex<T>> &arr, const shape_t &axes, const shape_t &in_extent,
+  const shape_t &out_extent, bool forward, T fct, size_t nthreads=1)
+  {
+  general_pruned(arr, axes, in_extent, out_extent,
+    [&](fmav<std::complex<T>> &sub, size_t axis, bool first)
+      { c2c(sub, sub, {axis}, forward, first ? fct : T(1), nthreads); });
+  }
+
+template<typename T> DUCC0_NOINLINE void r2r_separable_hartley_pruned(
+  fmav<T> &arr, const shape_t &axes, const shape_t &in_extent,
+  const shape_t &out_extent, T fct, size_t nthreads=1)
+  {
+  general_pruned(arr, axes, in_extent, out_extent,
+    [&](fmav<T> &sub, size_t axis, bool first)
+      { r2r_separable_hartley(sub, sub, {axis}, first ? fct : T(1), nthreads); });
+  }
+
 template<typename T> void r2r_genuine_hartley(const fmav<T> &in,
   fmav<T> &out, const shape_t &axes, T fct, size_t nthreads=1)
   {
@@ -1175,6 +1641,176 @@ template<typename T> void r2r_genuine_hartley(const fmav<T> &in,
     }
   }
 
+template<typename T, typename T0> scratch_array<T> alloc_tmp_conv
+  (const fmav_info &info, size_t axis, size_t len)
+  {
+  auto othersize = info.size()/info.shape(axis);
+  constexpr auto vlen = native_simd<T0>::size();
+  auto tmpsize = len*((othersize>=vlen) ? vlen : 1);
+  return scratch_array<T>(tmpsize);
+  }
+
+template<typename Tplan, typename T, typename T0, typename Exec>
+DUCC0_NOINLINE void general_convolve_axis(const fmav<T> &in, fmav<T> &out,
+  const size_t axis, const std::vector<T0> &kernel, size_t nthreads,
+  const Exec &exec)
+  {
+  TraceScope trace("general_convolve_axis");
+  size_t l_in=in.shape(axis), l_out=out.shape(axis);
+  auto plan1 = get_plan<Tplan>(l_in);
+  auto plan2 = get_plan<Tplan>(l_out);
+
+  execParallel(
+    util::thread_count(nthreads, in, axis, native_simd<T0>::size()),
+    [&](Scheduler &sched) {
+      constexpr auto vlen = native_simd<T0>::size();
+      // room for the transformed input and the output, one after another
+      auto storage = alloc_tmp_conv<T,T0>(in, axis, l_in+l_out);
+      multi_iter<vlen> it(in, out, axis, sched.num_threads(), sched.thread_num());
+#ifndef DUCC0_NO_SIMD
+      if (vlen>1)
+        while (it.remaining()>=vlen)
+          {
+          it.advance(vlen);
+          auto tdatav = reinterpret_cast<add_vec_t<T> *>(storage.data());
+          exec(it, in, out, tdatav, *plan1, *plan2, kernel);
+          }
+#endif
+      while (it.remaining()>0)
+        {
+        it.advance(1);
+        auto buf = reinterpret_cast<T *>(storage.data());
+        exec(it, in, out, buf, *plan1, *plan2, kernel);
+        }
+    });  // end of parallel region
+  }
+
+struct ExecConv1R
+  {
+  template <typename T0, typename T, size_t vlen> void operator() (
+    const multi_iter<vlen> &it, const fmav<T0> &in, fmav<T0> &out,
+    T * buf, const pocketfft_r<T0> &plan1, const pocketfft_r<T0> &plan2,
+    const std::vector<T0> &kernel) const
+    {
+    size_t l_in = plan1.length(),
+           l_out = plan2.length(),
+           l_min = std::min(l_in, l_out);
+    copy_input(it, in, buf);
+    plan1.exec(buf, T0(1), true);
+    for (size_t i=0; i<l_min; ++i) buf[i]*=kernel[(i+1)/2];
+    // Nyquist frequency of the shorter length (see ExecConv1C)
+    if (l_min<l_out)
+      buf[l_min-1] *= T0(0.5);
+    else if (l_min<l_in)
+      buf[l_min-1] *= T0(2);
+    for (size_t i=l_in; i<l_out; ++i) buf[i] = T(0);
+    plan2.exec(buf, T0(1), false);
+    copy_output(it, buf, out);
+    }
+  };
+
+struct ExecConv1C
+  {
+  template <typename T0, typename T, size_t vlen> void operator() (
+    const multi_iter<vlen> &it, const fmav<Cmplx<T0>> &in,
+    fmav<Cmplx<T0>> &out, T *buf, const pocketfft_c<T0> &plan1,
+    const pocketfft_c<T0> &plan2, const std::vector<Cmplx<T0>> &kernel) const
+    {
+    size_t l_in = plan1.length(),
+           l_out = plan2.length(),
+           l_min = std::min(l_in, l_out);
+    copy_input(it, in, buf);
+    plan1.exec(buf, T0(1), true);
+    auto res = buf+l_in;
+    res[0] = buf[0]*kernel[0];
+    size_t i;
+    for (i=1; 2*i<l_min; ++i)
+      {
+      res[i] = buf[i]*kernel[i];
+      res[l_out-i] = buf[l_in-i]*kernel[l_min-i];
+      }
+    if (2*i==l_min) // Nyquist frequency of the shorter length
+      {
+      if (l_min<l_out) // padding: split it evenly between +/- frequency
+        res[l_out-i] = res[i] = buf[i]*kernel[i]*T0(0.5);
+      else if (l_min<l_in) // truncation: fold both frequencies onto it
+        res[i] = (buf[i]+buf[l_in-i])*kernel[i];
+      else
+        res[i] = buf[i]*kernel[i];
+      ++i;
+      }
+    for (; i<=l_out-i; ++i)
+      {
+      res[i].Set(T0(0), T0(0));
+      res[l_out-i] = res[i];
+      }
+    plan2.exec(res, T0(1), false);
+    copy_output(it, res, out);
+    }
+  };
+
+/*! Convolution of real data along \a axis, with optional resampling:
+    every 1D line of \a in along \a axis is Fourier transformed, multiplied
+    with \a kernel, zero-padded or truncated in Fourier space to the length
+    of \a out along this axis and transformed back.
+    \a kernel holds the (real) Fourier coefficients of the convolution kernel
+    for the frequencies 0 to l_min/2, where l_min is the smaller of the input
+    and output lengths, which must both be even. The Nyquist coefficient is
+    treated as in the complex variant below, so that both give the same
+    results for real data. No normalization is applied;
+    \a kernel should contain the factor 1/(input length) for a plain
+    resampling.
+    All other axes of \a in and \a out must have identical lengths. \a in
+    and \a out may be identical arrays, if their strides agree. */
+template<typename T> void convolve_axis(const fmav<T> &in, fmav<T> &out,
+  size_t axis, const std::vector<T> &kernel, size_t nthreads=1)
+  {
+  MR_assert(axis<in.ndim(), "bad axis number");
+  MR_assert(in.ndim()==out.ndim(), "dimensionality mismatch");
+  if (in.data()==out.data())
+    MR_assert(in.stride()==out.stride(), "strides mismatch");
+  for (size_t i=0; i<in.ndim(); ++i)
+    if (i!=axis)
+      MR_assert(in.shape(i)==out.shape(i), "shape mismatch");
+  MR_assert(!((in.shape(axis)&1) || (out.shape(axis)&1)),
+    "input and output axis lengths must be even");
+  MR_assert(kernel.size()==std::min(in.shape(axis), out.shape(axis))/2+1,
+    "bad kernel size");
+  if (in.size()==0) return;
+  general_convolve_axis<pocketfft_r<T>>(in, out, axis, kernel, nthreads,
+    ExecConv1R());
+  }
+
+/*! Complex counterpart of the real-valued convolve_axis(). Here the axis
+    lengths are arbitrary, and \a kernel holds l_min complex Fourier
+    coefficients in the usual FFT order (frequencies 0, 1, ..., followed by
+    the negative frequencies). If l_min is even, its Nyquist coefficient is
+    split evenly between the two corresponding output frequencies when
+    zero-padding, and the two input frequencies are summed when
+    truncating. */
+template<typename T> void convolve_axis(const fmav<std::complex<T>> &in,
+  fmav<std::complex<T>> &out, size_t axis,
+  const std::vector<std::complex<T>> &kernel, size_t nthreads=1)
+  {
+  MR_assert(axis<in.ndim(), "bad axis number");
+  MR_assert(in.ndim()==out.ndim(), "dimensionality mismatch");
+  if (in.data()==out.data())
+    MR_assert(in.stride()==out.stride(), "strides mismatch");
+  for (size_t i=0; i<in.ndim(); ++i)
+    if (i!=axis)
+      MR_assert(in.shape(i)==out.shape(i), "shape mismatch");
+  MR_assert(kernel.size()==std::min(in.shape(axis), out.shape(axis)),
+    "bad kernel size");
+  if (in.size()==0) return;
+  fmav<Cmplx<T>> in2(reinterpret_cast<const Cmplx<T> *>(in.data()), in);
+  fmav<Cmplx<T>> out2(reinterpret_cast<Cmplx<T> *>(out.vdata()), out, out.writable());
+  std::vector<Cmplx<T>> kernel2(kernel.size());
+  for (size_t i=0; i<kernel.size(); ++i)
+    kernel2[i].Set(kernel[i].real(), kernel[i].imag());
+  general_convolve_axis<pocketfft_c<T>>(in2, out2, axis, kernel2, nthreads,
+    ExecConv1C());
+  }
+
 } // namespace detail_fft
 
 using detail_fft::FORWARD;
@@ -1182,11 +1818,19 @@ using detail_fft::BACKWARD;
 using detail_fft::c2c;
 using detail_fft::c2r;
 using detail_fft::r2c;
+using detail_fft::r2c_inplace;
+using detail_fft::c2r_inplace;
+using detail_fft::inplace_complex_view;
 using detail_fft::r2r_fftpack;
 using detail_fft::r2r_separable_hartley;
+using detail_fft::c2c_pruned;
+using detail_fft::r2r_separable_hartley_pruned;
 using detail_fft::r2r_genuine_hartley;
 using detail_fft::dct;
 using detail_fft::dst;
+using detail_fft::convolve_axis;
+using detail_fft::get_plan;
+using detail_fft::get_plan_cache;
 
 } // namespace ducc0
 
@@ -36,6 +36,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DUCC0_FFT1D_H
 
 #include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <algorithm>
 #include "ducc0/infra/useful_macros.h"
 #include "ducc0/math/cmplx.h"
 #include "ducc0/infra/aligned_array.h"
@@ -86,9 +90,36 @@ struct util1d // hack to avoid duplicate symbols
     return res;
     }
 
-  DUCC0_NOINLINE static double cost_guess (size_t n)
+  /* estimated cost per array element of a pass with the prime factor p,
+     done either with the generic O(p) algorithm or (if rader is true and it
+     is cheaper) with Rader's algorithm, i.e. two FFTs of length p-1. */
+  DUCC0_NOINLINE static double cost_prime (size_t p, bool rader)
     {
     constexpr double lfp=1.1; // penalty for non-hardcoded larger factors
+    if (p<=5) return double(p);
+    double res=lfp*double(p); // penalize larger prime factors
+    if (rader && (p>11))
+      res = std::min(res, rader_cost(p));
+    return res;
+    }
+
+  /* estimated cost per array element of a Rader pass for the prime p.
+     The FFTs of length p-1 do not use Rader passes themselves, since nested
+     permutations are very cache-unfriendly; Bluestein's algorithm is usually
+     the better choice in such cases. */
+  DUCC0_NOINLINE static double rader_cost (size_t p)
+    {
+    constexpr double rfp=2.; // penalty for permutation and pointwise product
+    return rfp*(2*cost_guess(p-1, false)/double(p) + 2.);
+    }
+
+  /* returns true if a pass with the prime factor p should use Rader's
+     algorithm instead of the generic one. */
+  static bool use_rader (size_t p)
+    { return (p>11) && (rader_cost(p)<cost_prime(p, false)); }
+
+  DUCC0_NOINLINE static double cost_guess (size_t n, bool rader=true)
+    {
     size_t ni=n;
     double result=0.;
     while ((n&1)==0)
@@ -96,13 +127,43 @@ struct util1d // hack to avoid duplicate symbols
     for (size_t x=3; x*x<=n; x+=2)
       while ((n%x)==0)
         {
-        result+= (x<=5) ? double(x) : lfp*double(x); // penalize larger prime factors
+        result+=cost_prime(x, rader);
         n/=x;
         }
-    if (n>1) result+=(n<=5) ? double(n) : lfp*double(n);
+    if (n>1) result+=cost_prime(n, rader);
     return result*double(ni);
     }
 
+  /* returns a generator of the multiplicative group of integers modulo the
+     prime p */
+  DUCC0_NOINLINE static size_t primitive_root (size_t p)
+    {
+    std::vector<size_t> fact;
+    size_t n=p-1;
+    for (size_t x=2; x*x<=n; ++x)
+      if ((n%x)==0)
+        {
+        fact.push_back(x);
+        while ((n%x)==0) n/=x;
+        }
+    if (n>1) fact.push_back(n);
+    auto powmod = [p](size_t b, size_t e)
+      {
+      size_t res=1;
+      for (; e>0; e>>=1, b=(b*b)%p)
+        if (e&1) res=(res*b)%p;
+      return res;
+      };
+    for (size_t g=2; g<p; ++g)
+      {
+      bool ok=true;
+      for (auto f: fact)
+        if (powmod(g, (p-1)/f)==1) { ok=false; break; }
+      if (ok) return g;
+      }
+    throw std::runtime_error("no primitive root found");
+    }
+
   /* returns the smallest composite of 2, 3, 5, 7 and 11 which is >= n */
   DUCC0_NOINLINE static size_t good_size_cmplx(size_t n)
     {
@@ -167,10 +228,42 @@ struct util1d // hack to avoid duplicate symbols
 template<typename T0> class cfftp
   {
   private:
+    /* Data for a pass with a prime factor p using Rader's algorithm:
+       plan of length p-1, the index permutations g^q and g^(-q) mod p
+       (g being a primitive root of p), and the normalized Fourier
+       transforms of the convolution kernel for both directions. */
+    struct raderdata
+      {
+      std::unique_ptr<cfftp> plan;
+      std::vector<size_t> perm, iperm;
+      aligned_array<Cmplx<T0>> kfwd, kbwd;
+
+      DUCC0_NOINLINE raderdata(size_t p)
+        : plan(new cfftp(p-1, false)), perm(p-1), iperm(p-1), kfwd(p-1), kbwd(p-1)
+        {
+        size_t g=util1d::primitive_root(p);
+        perm[0] = iperm[0] = 1;
+        for (size_t q=1; q<p-1; ++q)
+          perm[q] = (perm[q-1]*g)%p;
+        for (size_t q=1; q<p-1; ++q)
+          iperm[q] = perm[p-1-q];
+        UnityRoots<T0,Cmplx<T0>> roots(p);
+        T0 fct = T0(1)/T0(p-1);
+        for (size_t q=0; q<p-1; ++q)
+          {
+          kfwd[q] = conj(roots[iperm[q]])*fct;
+          kbwd[q] = roots[iperm[q]]*fct;
+          }
+        plan->exec(kfwd.data(), T0(1), true);
+        plan->exec(kbwd.data(), T0(1), true);
+        }
+      };
+
     struct fctdata
       {
       size_t fct;
       Cmplx<T0> *tw, *tws;
+      std::unique_ptr<raderdata> rad;
       };
 
     size_t length;
@@ -178,7 +271,7 @@ template<typename T0> class cfftp
     std::vector<fctdata> fact;
 
     void add_factor(size_t factor)
-      { fact.push_back({factor, nullptr, nullptr}); }
+      { fact.push_back({factor, nullptr, nullptr, nullptr}); }
 
 template<bool fwd, typename T> void pass2 (size_t ido, size_t l1,
   const T * DUCC0_RESTRICT cc, T * DUCC0_RESTRICT ch,
@@ -563,6 +656,96 @@ template<bool fwd, typename T> void pass8 (size_t ido, size_t l1,
    }
 
 
+/* radix-16 pass, computed as a 4x4 decomposition of the factor: four
+   radix-4 butterflies, internal twiddles (multiples of pi/8), and another
+   four radix-4 butterflies */
+#define POCKETFFT_DFT4(a0,a1,a2,a3,b0,b1,b2,b3) \
+        { \
+        T t1_, t2_, t3_, t4_; \
+        PM(t2_,t1_,a0,a2); \
+        PM(t3_,t4_,a1,a3); \
+        ROTX90<fwd>(t4_); \
+        PM(b0,b2,t2_,t3_); \
+        PM(b1,b3,t1_,t4_); \
+        }
+#define POCKETFFT_PREP16(idx) \
+        T y0, y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15; \
+        POCKETFFT_DFT4(CC(idx,0,k),CC(idx,4,k),CC(idx, 8,k),CC(idx,12,k),y0,y1,y2,y3) \
+        POCKETFFT_DFT4(CC(idx,1,k),CC(idx,5,k),CC(idx, 9,k),CC(idx,13,k),y4,y5,y6,y7) \
+        POCKETFFT_DFT4(CC(idx,2,k),CC(idx,6,k),CC(idx,10,k),CC(idx,14,k),y8,y9,y10,y11) \
+        POCKETFFT_DFT4(CC(idx,3,k),CC(idx,7,k),CC(idx,11,k),CC(idx,15,k),y12,y13,y14,y15) \
+        ROTX16<fwd,1>(y5); \
+        ROTX45<fwd>(y6); \
+        ROTX16<fwd,3>(y7); \
+        ROTX45<fwd>(y9); \
+        ROTX90<fwd>(y10); \
+        ROTX135<fwd>(y11); \
+        ROTX16<fwd,3>(y13); \
+        ROTX135<fwd>(y14); \
+        ROTX16<fwd,9>(y15);
+
+/* multiplies a by exp(+-2*pi*i*m/16) for m=1, 3, 9 */
+template <bool fwd, size_t m, typename T> void ROTX16(T &a) const
+  {
+  constexpr T0 c1=T0(0.923879532511286756128183189396788933L),
+               s1=T0(0.382683432365089771728459984030398866L);
+  constexpr T0 wr = (m==1) ? c1 : ((m==3) ? s1 : -c1),
+               wi = ((m==1) ? s1 : ((m==3) ? c1 : -s1)) * (fwd ? -1 : 1);
+  auto tmp_=a.r;
+  a.r = wr*a.r - wi*a.i;
+  a.i = wr*a.i + wi*tmp_;
+  }
+
+template<bool fwd, typename T> void pass16 (size_t ido, size_t l1,
+  const T * DUCC0_RESTRICT cc, T * DUCC0_RESTRICT ch,
+  const Cmplx<T0> * DUCC0_RESTRICT wa) const
+  {
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido](size_t a, size_t b, size_t c) -> const T&
+    { return cc[a+ido*(b+16*c)]; };
+  auto WA = [wa, ido](size_t x, size_t i)
+    { return wa[i-1+x*(ido-1)]; };
+
+  for (size_t k=0; k<l1; ++k)
+    {
+    {
+    POCKETFFT_PREP16(0)
+    POCKETFFT_DFT4(y0,y4,y8,y12,CH(0,k,0),CH(0,k,4),CH(0,k,8),CH(0,k,12))
+    POCKETFFT_DFT4(y1,y5,y9,y13,CH(0,k,1),CH(0,k,5),CH(0,k,9),CH(0,k,13))
+    POCKETFFT_DFT4(y2,y6,y10,y14,CH(0,k,2),CH(0,k,6),CH(0,k,10),CH(0,k,14))
+    POCKETFFT_DFT4(y3,y7,y11,y15,CH(0,k,3),CH(0,k,7),CH(0,k,11),CH(0,k,15))
+    }
+    for (size_t i=1; i<ido; ++i)
+      {
+      POCKETFFT_PREP16(i)
+      T x0, x1, x2, x3;
+      POCKETFFT_DFT4(y0,y4,y8,y12,CH(i,k,0),x1,x2,x3)
+      special_mul<fwd>(x1,WA(3,i),CH(i,k,4));
+      special_mul<fwd>(x2,WA(7,i),CH(i,k,8));
+      special_mul<fwd>(x3,WA(11,i),CH(i,k,12));
+      POCKETFFT_DFT4(y1,y5,y9,y13,x0,x1,x2,x3)
+      special_mul<fwd>(x0,WA(0,i),CH(i,k,1));
+      special_mul<fwd>(x1,WA(4,i),CH(i,k,5));
+      special_mul<fwd>(x2,WA(8,i),CH(i,k,9));
+      special_mul<fwd>(x3,WA(12,i),CH(i,k,13));
+      POCKETFFT_DFT4(y2,y6,y10,y14,x0,x1,x2,x3)
+      special_mul<fwd>(x0,WA(1,i),CH(i,k,2));
+      special_mul<fwd>(x1,WA(5,i),CH(i,k,6));
+      special_mul<fwd>(x2,WA(9,i),CH(i,k,10));
+      special_mul<fwd>(x3,WA(13,i),CH(i,k,14));
+      POCKETFFT_DFT4(y3,y7,y11,y15,x0,x1,x2,x3)
+      special_mul<fwd>(x0,WA(2,i),CH(i,k,3));
+      special_mul<fwd>(x1,WA(6,i),CH(i,k,7));
+      special_mul<fwd>(x2,WA(10,i),CH(i,k,11));
+      special_mul<fwd>(x3,WA(14,i),CH(i,k,15));
+      }
+    }
+  }
+
+#undef POCKETFFT_PREP16
+#undef POCKETFFT_DFT4
+
 #define POCKETFFT_PREP11(idx) \
         T t1 = CC(idx,0,k), t2, t3, t4, t5, t6, t7, t8, t9, t10, t11; \
         PM (t2,t11,CC(idx,1,k),CC(idx,10,k)); \
@@ -760,12 +943,62 @@ template<bool fwd, typename T> void passg (size_t ido, size_t ip,
     }
   }
 
+/* Pass for a prime factor ip using Rader's algorithm: the DFT of length ip
+   is reduced to a cyclic convolution of length ip-1, which is carried out
+   with two FFTs of that length. */
+template<bool fwd, typename T> void passr (size_t ido, size_t ip,
+  size_t l1, const T * DUCC0_RESTRICT cc, T * DUCC0_RESTRICT ch,
+  const Cmplx<T0> * DUCC0_RESTRICT wa, const raderdata &rad) const
+  {
+  const size_t cdim=ip;
+
+  auto CH = [ch,ido,l1](size_t a, size_t b, size_t c) -> T&
+    { return ch[a+ido*(b+l1*c)]; };
+  auto CC = [cc,ido,cdim](size_t a, size_t b, size_t c) -> const T&
+    { return cc[a+ido*(b+cdim*c)]; };
+  auto WA = [wa, ido](size_t x, size_t i)
+    { return wa[i-1+x*(ido-1)]; };
+
+  const auto &kern(fwd ? rad.kfwd : rad.kbwd);
+  scratch_array<T> buf(2*(ip-1));
+  T *conv=buf.data(), *scratch=buf.data()+ip-1;
+  for (size_t k=0; k<l1; ++k)
+    for (size_t i=0; i<ido; ++i)
+      {
+      T x0 = CC(i,0,k), sum = x0;
+      for (size_t q=0; q<ip-1; ++q)
+        {
+        conv[q] = CC(i,rad.perm[q],k);
+        sum += conv[q];
+        }
+      rad.plan->template pass_all<true>(conv, T0(1), scratch);
+      for (size_t q=0; q<ip-1; ++q)
+        special_mul<false>(conv[q], kern[q], conv[q]);
+      rad.plan->template pass_all<false>(conv, T0(1), scratch);
+      CH(i,k,0) = sum;
+      if (i==0)
+        for (size_t q=0; q<ip-1; ++q)
+          CH(0,k,rad.iperm[q]) = x0+conv[q];
+      else
+        for (size_t q=0; q<ip-1; ++q)
+          special_mul<fwd>(x0+conv[q], WA(rad.iperm[q]-1,i), CH(i,k,rad.iperm[q]));
+      }
+  }
+
 template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
+  {
+  if (length==1) { c[0]*=fct; return; }
+  scratch_array<T> ch(length);
+  pass_all<fwd>(c, fct, ch.data());
+  }
+
+/* same as above, but uses the caller-provided scratch space ch, which must
+   hold length elements */
+template<bool fwd, typename T> void pass_all(T c[], T0 fct, T *ch) const
   {
   if (length==1) { c[0]*=fct; return; }
   size_t l1=1;
-  aligned_array<T> ch(length);
-  T *p1=c, *p2=ch.data();
+  T *p1=c, *p2=ch;
 
   for(size_t k1=0; k1<fact.size(); k1++)
     {
@@ -774,6 +1007,8 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
     size_t ido = length/l2;
     if     (ip==4)
       pass4<fwd> (ido, l1, p1, p2, fact[k1].tw);
+    else if(ip==16)
+      pass16<fwd>(ido, l1, p1, p2, fact[k1].tw);
     else if(ip==8)
       pass8<fwd>(ido, l1, p1, p2, fact[k1].tw);
     else if(ip==2)
@@ -786,6 +1021,8 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
       pass7<fwd> (ido, l1, p1, p2, fact[k1].tw);
     else if(ip==11)
       pass11<fwd> (ido, l1, p1, p2, fact[k1].tw);
+    else if(fact[k1].rad)
+      passr<fwd>(ido, ip, l1, p1, p2, fact[k1].tw, *fact[k1].rad);
     else
       {
       passg<fwd>(ido, ip, l1, p1, p2, fact[k1].tw, fact[k1].tws);
@@ -813,19 +1050,37 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
       { fwd ? pass_all<true>(c, fct) : pass_all<false>(c, fct); }
 
   private:
-    DUCC0_NOINLINE void factorize()
+    DUCC0_NOINLINE void factorize(bool allow_rader, bool radix16)
       {
       size_t len=length;
-      while ((len&7)==0)
-        { add_factor(8); len>>=3; }
-      while ((len&3)==0)
-        { add_factor(4); len>>=2; }
-      if ((len&1)==0)
+      if (radix16)
         {
-        len>>=1;
-        // factor 2 should be at the front of the factor list
-        add_factor(2);
-        std::swap(fact[0].fct, fact.back().fct);
+        size_t n16=0;
+        while ((len&15)==0)
+          { ++n16; len>>=4; }
+        // remaining power of 2 goes to the front of the factor list
+        if ((len&7)==0)
+          { add_factor(8); len>>=3; }
+        else if ((len&3)==0)
+          { add_factor(4); len>>=2; }
+        else if ((len&1)==0)
+          { add_factor(2); len>>=1; }
+        for (size_t i=0; i<n16; ++i)
+          add_factor(16);
+        }
+      else
+        {
+        while ((len&7)==0)
+          { add_factor(8); len>>=3; }
+        while ((len&3)==0)
+          { add_factor(4); len>>=2; }
+        if ((len&1)==0)
+          {
+          len>>=1;
+          // factor 2 should be at the front of the factor list
+          add_factor(2);
+          std::swap(fact[0].fct, fact.back().fct);
+          }
         }
       for (size_t divisor=3; divisor*divisor<=len; divisor+=2)
         while ((len%divisor)==0)
@@ -834,8 +1089,16 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
           len/=divisor;
           }
       if (len>1) add_factor(len);
+      if (allow_rader)
+        for (auto &f: fact)
+          if ((f.fct!=16) && util1d::use_rader(f.fct))
+            f.rad.reset(new raderdata(f.fct));
       }
 
+    // returns true if the factor is handled by passg
+    static bool generic_factor(const fctdata &f)
+      { return (f.fct>11) && (f.fct!=16) && (!f.rad); }
+
     size_t twsize() const
       {
       size_t twsize=0, l1=1;
@@ -843,7 +1106,7 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
         {
         size_t ip=fact[k].fct, ido= length/(l1*ip);
         twsize+=(ip-1)*(ido-1);
-        if (ip>11)
+        if (generic_factor(fact[k]))
           twsize+=ip;
         l1*=ip;
         }
@@ -863,7 +1126,7 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
         for (size_t j=1; j<ip; ++j)
           for (size_t i=1; i<ido; ++i)
             fact[k].tw[(j-1)*(ido-1)+i-1] = twiddle[j*l1*i];
-        if (ip>11)
+        if (generic_factor(fact[k]))
           {
           fact[k].tws=mem.data()+memofs;
           memofs+=ip;
@@ -875,12 +1138,17 @@ template<bool fwd, typename T> void pass_all(T c[], T0 fct) const
       }
 
   public:
-    DUCC0_NOINLINE cfftp(size_t length_)
+    /* If radix16 is true, power-of-2 factors are mostly handled by radix-16
+       passes. This reduces the number of passes over the data, but also
+       increases register pressure, so it only pays off when transforming
+       several lines at once using SIMD types. */
+    DUCC0_NOINLINE cfftp(size_t length_, bool allow_rader=true,
+      bool radix16=false)
       : length(length_)
       {
       if (length==0) throw std::runtime_error("zero-length FFT requested");
       if (length==1) return;
-      factorize();
+      factorize(allow_rader, radix16);
       mem.resize(twsize());
       comp_twiddle();
       }
@@ -1569,7 +1837,7 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
       {
       if (length==1) { c[0]*=fct; return; }
       size_t n=length, nf=fact.size();
-      aligned_array<T> ch(n);
+      scratch_array<T> ch(n);
       T *p1=c, *p2=ch.data();
 
       if (r2hc)
@@ -1695,6 +1963,37 @@ template<typename T> void radbg(size_t ido, size_t ip, size_t l1,
       }
 };
 
+/* Performs a real-valued transform of length n (in FFTPACK storage order)
+   via a complex transform of the same length; func(tmp, fwd) must carry out
+   the (scaled) complex transform on the array tmp in place. */
+template<typename T0, typename T, typename Func> void exec_r_via_c(T c[],
+  size_t n, bool fwd, Func func)
+  {
+  scratch_array<Cmplx<T>> tmp(n);
+  if (fwd)
+    {
+    auto zero = T0(0)*c[0];
+    for (size_t m=0; m<n; ++m)
+      tmp[m].Set(c[m], zero);
+    func(tmp.data(), true);
+    c[0] = tmp[0].r;
+    memcpy (reinterpret_cast<void *>(c+1),
+            reinterpret_cast<void *>(tmp.data()+1), (n-1)*sizeof(T));
+    }
+  else
+    {
+    tmp[0].Set(c[0],c[0]*0);
+    memcpy (reinterpret_cast<void *>(tmp.data()+1),
+            reinterpret_cast<void *>(c+1), (n-1)*sizeof(T));
+    if ((n&1)==0) tmp[n/2].i=T0(0)*c[0];
+    for (size_t m=1; 2*m<n; ++m)
+      tmp[n-m].Set(tmp[m].r, -tmp[m].i);
+    func(tmp.data(), false);
+    for (size_t m=0; m<n; ++m)
+      c[m] = tmp[m].r;
+    }
+  }
+
 //
 // complex Bluestein transforms
 //
@@ -1709,7 +2008,7 @@ template<typename T0> class fftblue
 
     template<bool fwd, typename T> void fft(Cmplx<T> c[], T0 fct) const
       {
-      aligned_array<Cmplx<T>> akf(n2);
+      scratch_array<Cmplx<T>> akf(n2);
 
       /* initialize a_k and FFT it */
       for (size_t m=0; m<n; ++m)
@@ -1773,29 +2072,8 @@ template<typename T0> class fftblue
 
     template<typename T> void exec_r(T c[], T0 fct, bool fwd)
       {
-      aligned_array<Cmplx<T>> tmp(n);
-      if (fwd)
-        {
-        auto zero = T0(0)*c[0];
-        for (size_t m=0; m<n; ++m)
-          tmp[m].Set(c[m], zero);
-        fft<true>(tmp.data(),fct);
-        c[0] = tmp[0].r;
-        memcpy (reinterpret_cast<void *>(c+1),
-                reinterpret_cast<void *>(tmp.data()+1), (n-1)*sizeof(T));
-        }
-      else
-        {
-        tmp[0].Set(c[0],c[0]*0);
-        memcpy (reinterpret_cast<void *>(tmp.data()+1),
-                reinterpret_cast<void *>(c+1), (n-1)*sizeof(T));
-        if ((n&1)==0) tmp[n/2].i=T0(0)*c[0];
-        for (size_t m=1; 2*m<n; ++m)
-          tmp[n-m].Set(tmp[m].r, -tmp[m].i);
-        fft<false>(tmp.data(),fct);
-        for (size_t m=0; m<n; ++m)
-          c[m] = tmp[m].r;
-        }
+      exec_r_via_c<T0>(c, n, fwd, [this,fct](Cmplx<T> *tmp, bool fwd_)
+        { fwd_ ? fft<true>(tmp,fct) : fft<false>(tmp,fct); });
       }
   };
 
@@ -1807,9 +2085,24 @@ template<typename T0> class pocketfft_c
   {
   private:
     std::unique_ptr<cfftp<T0>> packplan;
+    std::unique_ptr<cfftp<T0>> vpackplan; // radix-16 variant for SIMD types
     std::unique_ptr<fftblue<T0>> blueplan;
     size_t len;
 
+    /* Radix-16 passes reduce the number of sweeps over the data, but their
+       many concurrent memory streams are harmful for long scalar transforms.
+       Measurements suggest using them for scalar transforms of moderate
+       length and for SIMD types (i.e. several lines at once) of large length,
+       so for the latter a separate plan may be created. */
+    void make_packplan(size_t length)
+      {
+      bool r16 = (length&255)==0; // at least two radix-16 passes
+      packplan=std::unique_ptr<cfftp<T0>>
+        (new cfftp<T0>(length, true, r16 && (length<=2048)));
+      if (r16 && (length>=8192))
+        vpackplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length, true, true));
+      }
+
   public:
     DUCC0_NOINLINE pocketfft_c(size_t length)
       : len(length)
@@ -1818,7 +2111,7 @@ template<typename T0> class pocketfft_c
       size_t tmp = (length<50) ? 0 : util1d::largest_prime_factor(length);
       if (tmp*tmp <= length)
         {
-        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
+        make_packplan(length);
         return;
         }
       double comp1 = util1d::cost_guess(length);
@@ -1827,11 +2120,15 @@ template<typename T0> class pocketfft_c
       if (comp2<comp1) // use Bluestein
         blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(length));
       else
-        packplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
+        make_packplan(length);
       }
 
     template<typename T> DUCC0_NOINLINE void exec(Cmplx<T> c[], T0 fct, bool fwd) const
-      { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec(c,fct,fwd); }
+      {
+      if (vpackplan && (sizeof(T)>sizeof(T0)))
+        return vpackplan->exec(c,fct,fwd);
+      packplan ? packplan->exec(c,fct,fwd) : blueplan->exec(c,fct,fwd);
+      }
 
     size_t length() const { return len; }
   };
@@ -1845,6 +2142,7 @@ template<typename T0> class pocketfft_r
   private:
     std::unique_ptr<rfftp<T0>> packplan;
     std::unique_ptr<fftblue<T0>> blueplan;
+    std::unique_ptr<cfftp<T0>> cplan; // complex plan using Rader passes
     size_t len;
 
   public:
@@ -1858,17 +2156,28 @@ template<typename T0> class pocketfft_r
         packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
         return;
         }
-      double comp1 = 0.5*util1d::cost_guess(length);
+      double comp1 = 0.5*util1d::cost_guess(length, false);
       double comp2 = 2*util1d::cost_guess(util1d::good_size_cmplx(2*length-1));
       comp2*=1.5; /* fudge factor that appears to give good overall performance */
-      if (comp2<comp1) // use Bluestein
+      /* Complex transform using Rader passes, applied to real data; for
+         large prime factors the real-valued passes are not much faster than
+         complex ones, hence the comparatively small penalty. */
+      double comp3 = 0.6*util1d::cost_guess(length);
+      if ((comp3<comp1) && (comp3<comp2)) // use complex transform with Rader
+        cplan=std::unique_ptr<cfftp<T0>>(new cfftp<T0>(length));
+      else if (comp2<comp1) // use Bluestein
         blueplan=std::unique_ptr<fftblue<T0>>(new fftblue<T0>(length));
       else
         packplan=std::unique_ptr<rfftp<T0>>(new rfftp<T0>(length));
       }
 
     template<typename T> DUCC0_NOINLINE void exec(T c[], T0 fct, bool fwd) const
-      { packplan ? packplan->exec(c,fct,fwd) : blueplan->exec_r(c,fct,fwd); }
+      {
+      if (packplan) return packplan->exec(c,fct,fwd);
+      if (blueplan) return blueplan->exec_r(c,fct,fwd);
+      exec_r_via_c<T0>(c, len, fwd, [this,fct](Cmplx<T> *tmp, bool fwd_)
+        { cplan->exec(tmp,fct,fwd_); });
+      }
 
     size_t length() const { return len; }
   };
@@ -23,6 +23,13 @@
 #define DUCC0_GL_INTEGRATOR_H
 
 #include <cmath>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#ifndef DUCC0_NO_THREADING
+#include <mutex>
+#endif
 #include "ducc0/math/constants.h"
 #include "ducc0/infra/error_handling.h"
 #include "ducc0/infra/threading.h"
@@ -33,70 +40,269 @@ namespace detail_gl_integrator {
 
 using namespace std;
 
-class GL_Integrator
+/*! Positive Gauss-Legendre nodes (in ascending order, starting with 0 for
+    odd n) and their weights. */
+struct GL_rule
   {
-  private:
-    size_t n_;
-    vector<double> x, w;
+  vector<double> x, w;
+  };
 
-    static inline double one_minus_x2 (double x)
-      { return (std::abs(x)>0.1) ? (1.+x)*(1.-x) : 1.-x*x; }
+inline double one_minus_x2 (double x)
+  { return (std::abs(x)>0.1) ? (1.+x)*(1.-x) : 1.-x*x; }
 
-  public:
-    GL_Integrator(size_t n, size_t nthreads=1)
-      : n_(n)
-      {
-      MR_assert(n>=1, "number of points must be at least 1");
-      constexpr double eps = 3e-14;
-      size_t m = (n+1)>>1;
-      x.resize(m);
-      w.resize(m);
+/* Newton iteration on the Legendre recursion; O(n^2) operations. */
+inline void gl_newton(size_t n, size_t nthreads, GL_rule &rule)
+  {
+  constexpr double eps = 3e-14;
+  size_t m = (n+1)>>1;
+  auto &x(rule.x), &w(rule.w);
 
-      double dn=double(n);
-      const double t0 = 1 - (1-1./dn) / (8.*dn*dn);
-      const double t1 = 1./(4.*dn+2.);
+  double dn=double(n);
+  const double t0 = 1 - (1-1./dn) / (8.*dn*dn);
+  const double t1 = 1./(4.*dn+2.);
 
-      execDynamic(m, nthreads, 1, [&](Scheduler &sched)
+  execDynamic(m, nthreads, 1, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext()) for(auto i=rng.lo+1; i<rng.hi+1; ++i)
+      {
+      double x0 = cos(pi * double((i<<2)-1) * t1) * t0;
+
+      bool dobreak=false;
+      size_t j=0;
+      double dpdx;
+      while(1)
         {
-        while (auto rng=sched.getNext()) for(auto i=rng.lo+1; i<rng.hi+1; ++i)
+        double P_1 = 1.0;
+        double P0 = x0;
+        double dx, x1;
+
+        for (size_t k=2; k<=n; k++)
           {
-          double x0 = cos(pi * double((i<<2)-1) * t1) * t0;
-
-          bool dobreak=false;
-          size_t j=0;
-          double dpdx;
-          while(1)
-            {
-            double P_1 = 1.0;
-            double P0 = x0;
-            double dx, x1;
-
-            for (size_t k=2; k<=n; k++)
-              {
-              double P_2 = P_1;
-              P_1 = P0;
-//              P0 = ((2*k-1)*x0*P_1-(k-1)*P_2)/k;
-              P0 = x0*P_1 + (k-1.)/k * (x0*P_1-P_2);
-              }
-
-            dpdx = (P_1 - x0*P0) * n / one_minus_x2(x0);
-
-            /* Newton step */
-            x1 = x0 - P0/dpdx;
-            dx = x0-x1;
-            x0 = x1;
-            if (dobreak) break;
-
-            if (std::abs(dx)<=eps) dobreak=1;
-            MR_assert(++j<100, "convergence problem");
-            }
-
-          x[m-i] = x0;
-          w[m-i] = 2. / (one_minus_x2(x0) * dpdx * dpdx);
+          double P_2 = P_1;
+          P_1 = P0;
+//          P0 = ((2*k-1)*x0*P_1-(k-1)*P_2)/k;
+          P0 = x0*P_1 + (k-1.)/k * (x0*P_1-P_2);
           }
-        });
-      if (n&1) x[0] = 0.; // set to exact zero
+
+        dpdx = (P_1 - x0*P0) * n / one_minus_x2(x0);
+
+        /* Newton step */
+        x1 = x0 - P0/dpdx;
+        dx = x0-x1;
+        x0 = x1;
+        if (dobreak) break;
+
+        if (std::abs(dx)<=eps) dobreak=1;
+        MR_assert(++j<100, "convergence problem");
+        }
+
+      x[m-i] = x0;
+      w[m-i] = 2. / (one_minus_x2(x0) * dpdx * dpdx);
+      }
+    });
+  }
+
+/* Asymptotic expansion of I. Bogaert, "Iteration-free computation of
+   Gauss-Legendre quadrature nodes and weights", SIAM J. Sci. Comput. 36,
+   A1008 (2014). Every node costs O(1) operations; the results are accurate
+   to double precision for n>100. */
+
+/* k-th zero of the Bessel function J_0 */
+inline double besselj0_zero(size_t k)
+  {
+  static const double jz[] = {
+    2.40482555769577276862163187933,  5.52007811028631064959660411281,
+    8.65372791291101221695419871266,  11.7915344390142816137430449119,
+    14.9309177084877859477625939974,  18.0710639679109225431478829756,
+    21.2116366298792589590783933505,  24.3524715307493027370579447632,
+    27.4934791320402547958772882346,  30.6346064684319751175495789269,
+    33.7758202135735686842385463467,  36.9170983536640439797694930633,
+    40.0584257646282392947993073740,  43.1997917131767303575240727287,
+    46.3411883716618140186857888791,  49.4826098973978171736027615332,
+    52.6240518411149960292512853804,  55.7655107550199793116834927735,
+    58.9069839260809421328344066346,  62.0484691902271698828525002646 };
+  if (k<=20) return jz[k-1];
+  // McMahon's expansion
+  double z = pi*(double(k)-0.25);
+  double r = 1./z, r2 = r*r;
+  return z + r*(0.125+r2*(-0.807291666666666666666666666667e-1
+    +r2*(0.246028645833333333333333333333+r2*(-1.82443876720610119047619047619
+    +r2*(25.3364147973439050099206349206+r2*(-567.644412135183381139802038240
+    +r2*(18690.4765282320653831636345064+r2*(-8.49353580299148769921876983660e5
+    +5.09225462402226769498681286758e7*r2))))))));
+  }
+
+/* J_1(j_{0,k})^2 */
+inline double besselj1_squared(size_t k)
+  {
+  static const double j1[] = {
+    0.269514123941916926139021992911,  0.115780138582203695807812836182,
+    0.0736863511364082151406476811985, 0.0540375731981162820417749182758,
+    0.0426614290172430912655106063495, 0.0352421034909961013587473033648,
+    0.0300210701030546726750888157688, 0.0261473914953080885904584675399,
+    0.0231591218246913922652676382178, 0.0207838291222678576039808057297,
+    0.0188504506693176678161056800214, 0.0172461575696650082995240053542,
+    0.0158935181059235978027565238008, 0.0147376260964721895895742982592,
+    0.0137384651453871179182880484134, 0.0128661817376151328791406637228,
+    0.0120980515486267975471075438497, 0.0114164712244916085168627222986,
+    0.0108075927911802040115547286830, 0.0102603729262807628110423992790,
+    0.00976589713979105054059846736696 };
+  if (k<=21) return j1[k-1];
+  double x = 1./(double(k)-0.25), x2 = x*x;
+  return x*(0.202642367284675542887949351103+x2*x2*(-0.303380429711290253026202643516e-3
+    +x2*(0.198924364245969295201137972743e-3+x2*(-0.228969902772111653038747229723e-3
+    +x2*(0.433710719130746277915572905025e-3+x2*(-0.123632349727175414724737657367e-2
+    +x2*(0.496101423268883102872271417616e-2+x2*(-0.266837393702323757700998557826e-1
+    +0.185395398206345628711318848386*x2))))))));
+  }
+
+inline void gl_asymptotic(size_t n, size_t nthreads, GL_rule &rule)
+  {
+  size_t m = (n+1)>>1;
+  auto &x(rule.x), &w(rule.w);
+  const double vn = 1./(double(n)+0.5);
+
+  execStatic(m, nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext()) for(auto k=rng.lo+1; k<rng.hi+1; ++k)
+      {
+      double nu = besselj0_zero(k);
+      double theta = vn*nu;
+      double t2 = theta*theta;
+      double b = besselj1_squared(k);
+
+      // Chebyshev interpolants for the node ...
+      double sf1 = (((((-1.29052996274280508473467968379e-12*t2
+        +2.40724685864330121825976175184e-10)*t2
+        -3.13148654635992041468855740012e-08)*t2
+        +0.275573168962061235623801563453e-05)*t2
+        -0.148809523713909147898955880165e-03)*t2
+        +0.416666666665193394525296923981e-02)*t2
+        -0.416666666666662959639712457549e-01;
+      double sf2 = (((((+2.20639421781871003734786884322e-09*t2
+        -7.53036771373769326811030753538e-08)*t2
+        +0.161969259453836261731700382098e-05)*t2
+        -0.253300326008232025914059965302e-04)*t2
+        +0.282116886057560434805998583817e-03)*t2
+        -0.209022248387852902722635654229e-02)*t2
+        +0.815972221772932265640401128517e-02;
+      double sf3 = (((((-2.97058225375526229899781956673e-08*t2
+        +5.55845330223796209655886325712e-07)*t2
+        -0.567797841356833081642185432056e-05)*t2
+        +0.418498100329504574443885193835e-04)*t2
+        -0.251395293283965914823026348764e-03)*t2
+        +0.128654198542845137196151147483e-02)*t2
+        -0.416012165620204364833694266818e-02;
+      // ... and for the weight
+      double wsf1 = ((((((((-2.20902861044616638398573427475e-14*t2
+        +2.30365726860377376873232578871e-12)*t2
+        -1.75257700735423807659851042318e-10)*t2
+        +1.03756066927916795821098009353e-08)*t2
+        -4.63968647553221331251529631098e-07)*t2
+        +0.149644593625028648361395938176e-04)*t2
+        -0.326278659594412170300449074873e-03)*t2
+        +0.436507936507598105249726413120e-02)*t2
+        -0.305555555555553028279487898503e-01)*t2
+        +0.833333333333333302184063103900e-01;
+      double wsf2 = (((((((+3.63117412152654783455929483029e-12*t2
+        +7.67643545069893130779501844323e-11)*t2
+        -7.12912857233642220650643150625e-09)*t2
+        +2.11483880685947151466370130277e-07)*t2
+        -0.381817918680045468483009307090e-05)*t2
+        +0.465969530694968391417927388162e-04)*t2
+        -0.407297185611335764191683161117e-03)*t2
+        +0.268959435694729660779984493795e-02)*t2
+        -0.111111111111214923138249347172e-01;
+      double wsf3 = (((((((+2.01826791256703301806643264922e-09*t2
+        -4.38647122520206649251063212545e-08)*t2
+        +5.08898347288671653137451093208e-07)*t2
+        -0.397933316519135275712977531366e-05)*t2
+        +0.200559326396458326778521795392e-04)*t2
+        -0.422888059282921161626339411388e-04)*t2
+        -0.105646050254076140548678457002e-03)*t2
+        -0.947969308958577323145923317955e-04)*t2
+        +0.656966489926484797412985260842e-02;
+
+      double nuosin = nu/sin(theta);
+      double bnuosin = b*nuosin;
+      double winvsinc = vn*vn*nuosin;
+      double wis2 = winvsinc*winvsinc;
+
+      theta = vn*(nu + theta*winvsinc*(sf1 + wis2*(sf2 + wis2*sf3)));
+      double deno = bnuosin + bnuosin*wis2*(wsf1 + wis2*(wsf2 + wis2*wsf3));
+      x[m-k] = cos(theta);
+      w[m-k] = (2.*vn)/deno;
       }
+    });
+  }
+
+inline shared_ptr<const GL_rule> make_gl_rule(size_t n, size_t nthreads)
+  {
+  auto res = make_shared<GL_rule>();
+  size_t m = (n+1)>>1;
+  res->x.resize(m);
+  res->w.resize(m);
+  if (n<=100)
+    gl_newton(n, nthreads, *res);
+  else
+    gl_asymptotic(n, nthreads, *res);
+  if (n&1) res->x[0] = 0.; // set to exact zero
+  return res;
+  }
+
+/*! Returns the Gauss-Legendre rule with \a n nodes.
+    The most recently used rules are cached, so that repeated construction
+    of the same geometry does not recompute them. */
+inline shared_ptr<const GL_rule> get_gl_rule(size_t n, size_t nthreads=1)
+  {
+  MR_assert(n>=1, "number of points must be at least 1");
+  constexpr size_t max_size=16;
+  static vector<pair<size_t, shared_ptr<const GL_rule>>> cache;
+#ifndef DUCC0_NO_THREADING
+  static mutex mut;
+  using lock_t = lock_guard<mutex>;
+#else
+  struct lock_t { lock_t(int) {} };
+  static int mut=0;
+#endif
+  auto lookup = [&]() -> shared_ptr<const GL_rule>
+    {
+    for (size_t i=0; i<cache.size(); ++i)
+      if (cache[i].first==n)
+        {
+        // move to the front, the least recently used rule is at the back
+        rotate(cache.begin(), cache.begin()+ptrdiff_t(i),
+               cache.begin()+ptrdiff_t(i)+1);
+        return cache[0].second;
+        }
+    return nullptr;
+    };
+  {
+  lock_t lock(mut);
+  auto p = lookup();
+  if (p) return p;
+  }
+  // compute the rule outside the lock, it may take a while
+  auto rule = make_gl_rule(n, nthreads);
+  lock_t lock(mut);
+  // another thread may have been faster
+  auto p = lookup();
+  if (p) return p;
+  if (cache.size()==max_size) cache.pop_back();
+  cache.insert(cache.begin(), {n, rule});
+  return rule;
+  }
+
+class GL_Integrator
+  {
+  private:
+    size_t n_;
+    shared_ptr<const GL_rule> rule;
+    const vector<double> &x, &w;
+
+  public:
+    GL_Integrator(size_t n, size_t nthreads=1)
+      : n_(n), rule(get_gl_rule(n, nthreads)), x(rule->x), w(rule->w) {}
 
     template<typename Func> auto integrate(Func f) -> decltype(f(0.))
       {
@@ -154,6 +360,8 @@ class GL_Integrator
 
 }
 
+using detail_gl_integrator::GL_rule;
+using detail_gl_integrator::get_gl_rule;
 using detail_gl_integrator::GL_Integrator;
 
 }
@@ -104,6 +104,13 @@ template<typename T> class GriddingKernel
         ((W+vlen-1)/vlen) objects of type native_simd<T>!
         */
     virtual void eval(T x, native_simd<T> *res) const = 0;
+    /*! Does the same as eval() for vlen different values of x at once
+        (one per SIMD lane), storing the values in transposed order:
+        res[i] holds the i-th kernel value for every lane of x.
+        NOTE: res must point to memory large enough to hold
+        W objects of type native_simd<T>!
+        */
+    virtual void eval_batch(native_simd<T> x, native_simd<T> *res) const = 0;
     /*! Returns the function approximation at location x.
         x must lie in [-1; 1].  */
     virtual T eval_single(T x) const = 0;
@@ -293,6 +300,18 @@ template<typename T> class HornerKernel: public GriddingKernel<T>
     virtual void eval(T x, native_simd<T> *res) const
       { (this->*evalfunc)(x, res); }
 
+    virtual void eval_batch(native_simd<T> x, native_simd<T> *res) const
+      {
+      x = (x+1)*T(W)-1;
+      for (size_t i=0; i<W; ++i)
+        {
+        Tsimd tval = scoeff[i];
+        for (size_t j=1; j<=D; ++j)
+          tval = tval*x + scoeff[j*sstride+i];
+        res[i] = tval;
+        }
+      }
+
     virtual T eval_single(T x) const
       { return (this->*evalsinglefunc)(x); }
 
@@ -320,16 +339,40 @@ template<size_t W, typename T> class TemplateKernel
     static constexpr auto sstride = nvec*vlen;
 
   public:
-    TemplateKernel(const HornerKernel<T> &krn)
+    /*! True if evaluating the kernel for vlen coordinates at once with the
+        *_batch() methods wastes fewer arithmetic operations than the
+        per-coordinate methods, which leave at least half of the SIMD lanes
+        unused in this case. */
+    static constexpr bool prefer_batch = (nvec*vlen>=2*W);
+
+    /*! \a krn may have a different precision than the template kernel
+        (e.g. for evaluating a double precision kernel with float SIMD). */
+    template<typename T2> TemplateKernel(const HornerKernel<T2> &krn)
       : scoeff(reinterpret_cast<T *>(&coeff[0]))
       {
       MR_assert(W==krn.support(), "support mismatch");
       MR_assert(D==krn.degree(), "degree mismatch");
-      for (size_t i=0; i<coeff.size(); ++i) coeff[i] = krn.Coeff()[i];
+      constexpr auto vlen2 = native_simd<T2>::size();
+      constexpr auto sstride2 = ((W+vlen2-1)/vlen2)*vlen2;
+      auto src = reinterpret_cast<const T2 *>(krn.Coeff().data());
+      auto dst = reinterpret_cast<T *>(&coeff[0]);
+      for (size_t j=0; j<=D; ++j)
+        for (size_t i=0; i<sstride; ++i)
+          dst[j*sstride+i] = (i<W) ? T(src[j*sstride2+i]) : T(0);
       }
 
     constexpr size_t support() const { return W; }
 
+    [[gnu::always_inline]] void eval1(T x, native_simd<T> * DUCC0_RESTRICT res) const
+      {
+      for (size_t i=0; i<nvec; ++i)
+        {
+        auto tval = coeff[i];
+        for (size_t j=1; j<=D; ++j)
+          tval = tval*x + coeff[j*nvec+i];
+        res[i] = tval;
+        }
+      }
     [[gnu::always_inline]] void eval2s(T x, T y, T z, native_simd<T> * DUCC0_RESTRICT res) const
       {
       z += W*T(0.5); // now in [0; W[
@@ -399,6 +442,56 @@ template<size_t W, typename T> class TemplateKernel
           }
         }
       }
+
+    /*! The *_batch() methods evaluate the kernel for vlen coordinates at once,
+        one per SIMD lane, with the same arguments as the corresponding
+        per-coordinate methods. The results are stored in transposed order:
+        res[i] holds the i-th kernel value of every coordinate, i.e. res
+        must hold W (eval1_batch()) or 2*W (eval2_batch(), eval2s_batch())
+        SIMD vectors. */
+    [[gnu::always_inline]] void eval1_batch(Tsimd x, Tsimd * DUCC0_RESTRICT res) const
+      {
+      for (size_t i=0; i<W; ++i)
+        {
+        Tsimd tval = scoeff[i];
+        for (size_t j=1; j<=D; ++j)
+          tval = tval*x + scoeff[j*sstride+i];
+        res[i] = tval;
+        }
+      }
+    [[gnu::always_inline]] void eval2s_batch(Tsimd x, Tsimd y, Tsimd z, Tsimd * DUCC0_RESTRICT res) const
+      {
+      Tsimd tvalz;
+      for (size_t k=0; k<vlen; ++k)
+        {
+        T zk = z[k] + W*T(0.5); // now in [0; W[
+        auto nth = min(W-1, size_t(max(T(0), zk)));
+        zk = (zk-nth)*2-1;
+        auto ptrz = scoeff+nth;
+        auto tval = *ptrz;
+        for (size_t j=1; j<=D; ++j)
+          tval = tval*zk + ptrz[j*sstride];
+        tvalz[k] = tval;
+        }
+      eval2_batch(x, y, res);
+      for (size_t i=0; i<W; ++i)
+        res[i] *= tvalz;
+      }
+    [[gnu::always_inline]] void eval2_batch(Tsimd x, Tsimd y, Tsimd * DUCC0_RESTRICT res) const
+      {
+      for (size_t i=0; i<W; ++i)
+        {
+        Tsimd tvalx = scoeff[i];
+        Tsimd tvaly = scoeff[i];
+        for (size_t j=1; j<=D; ++j)
+          {
+          tvalx = tvalx*x + scoeff[j*sstride+i];
+          tvaly = tvaly*y + scoeff[j*sstride+i];
+          }
+        res[i] = tvalx;
+        res[i+W] = tvaly;
+        }
+      }
   };
 
 struct KernelParams
@@ -661,9 +754,9 @@ template<typename T> auto selectKernel(size_t idx)
   return make_shared<HornerKernel<T>>(supp, supp+3, lam, GLFullCorrection(supp, lam));
   }
 
-/*! Returns the best matching 2-parameter ES kernel for the given oversampling
-    factor and error. */
-template<typename T> auto selectKernel(double ofactor, double epsilon)
+/*! Returns the index of the best matching 2-parameter ES kernel for the
+    given oversampling factor and error (KernelDB.size() if there is none). */
+template<typename T> size_t findKernel(double ofactor, double epsilon)
   {
   size_t Wmin = is_same<T, float>::value ? 8 : 1000;
   size_t idx = KernelDB.size();
@@ -673,8 +766,13 @@ template<typename T> auto selectKernel(double ofactor, double epsilon)
       idx = i;
       Wmin = KernelDB[i].W;
       }
-  return selectKernel<T>(idx);
+  return idx;
   }
+
+/*! Returns the best matching 2-parameter ES kernel for the given oversampling
+    factor and error. */
+template<typename T> auto selectKernel(double ofactor, double epsilon)
+  { return selectKernel<T>(findKernel<T>(ofactor, epsilon)); }
 template<typename T> auto selectKernel(double ofactor, double epsilon, size_t idx)
   {
   return (idx<KernelDB.size()) ?
@@ -706,6 +804,7 @@ template<typename T> auto getAvailableKernels(double epsilon)
 }
 
 using detail_gridding_kernel::GriddingKernel;
+using detail_gridding_kernel::findKernel;
 using detail_gridding_kernel::selectKernel;
 using detail_gridding_kernel::getAvailableKernels;
 using detail_gridding_kernel::HornerKernel;
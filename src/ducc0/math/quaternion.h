@@ -25,7 +25,10 @@
 #define DUCC0_QUATERNION_H
 
 #include <cmath>
+#include <tuple>
+#include <algorithm>
 #include "ducc0/math/vec3.h"
+#include "ducc0/math/constants.h"
 
 namespace ducc0 {
 
@@ -109,6 +112,21 @@ template<typename T> class quaternion_t
       T inorm = T(1)/norm;
       return make_tuple(vec3_t<T>(x*inorm,y*inorm,z*inorm), 2*atan2(norm, w));
       }
+
+    /*! Returns the angles (theta, phi, psi) of the rotation
+        R_z(phi)*R_y(theta)*R_z(psi) described by this quaternion,
+        with theta in [0; pi] and phi in [0; 2pi). The quaternion need not
+        be normalized. */
+    auto toEulerZYZ() const
+      {
+      T sum = atan2(z, w),   // (phi+psi)/2
+        dif = atan2(-x, y);  // (phi-psi)/2
+      T theta = 2*atan2(sqrt(x*x+y*y), sqrt(z*z+w*w));
+      T phi = sum+dif, psi = sum-dif;
+      if (phi<T(0)) phi += T(twopi);
+      if (phi>=T(twopi)) phi -= T(twopi);
+      return make_tuple(theta, phi, psi);
+      }
   };
 
 /*! \} */
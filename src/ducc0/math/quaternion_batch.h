@@ -0,0 +1,266 @@
+/*
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*! \file quaternion_batch.h
+ *  Vectorized and multithreaded operations on arrays of quaternions
+ *
+ *  Copyright (C) 2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#ifndef DUCC0_QUATERNION_BATCH_H
+#define DUCC0_QUATERNION_BATCH_H
+
+#include <cmath>
+#include <algorithm>
+#include "ducc0/math/quaternion.h"
+#include "ducc0/math/vec3.h"
+#include "ducc0/math/constants.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/error_handling.h"
+
+namespace ducc0 {
+
+namespace detail_quaternion_batch {
+
+using namespace std;
+
+/*! \defgroup quatbatchgroup Batched quaternion operations
+
+    These functions apply an operation to arrays of quaternions (shape
+    (n,4), components in the order x, y, z, w), 3-vectors (shape (n,3)) or
+    angles (shape (n)). Groups of native_simd<T>::size() elements are
+    converted to structure-of-arrays form, so that every arithmetic
+    instruction works on several elements at once, and the groups are
+    distributed over \a nthreads threads.
+    Where noted, an input array with only one row is broadcast. */
+/*! \{ */
+
+namespace quat_batch_detail {
+
+template<typename T> using Tv = native_simd<T>;
+
+/* Calls func(i0, nv) for all groups [i0; i0+nv) of a SIMD vector length. */
+template<typename T, typename Func> void loop(size_t n, size_t nthreads,
+  Func &&func)
+  {
+  constexpr size_t vl = Tv<T>::size();
+  execStatic((n+vl-1)/vl, nthreads, 0, [&](Scheduler &sched)
+    {
+    while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+      func(i*vl, std::min(vl, n-i*vl));
+    });
+  }
+
+/* Loads component k of the rows i0, ..., i0+nv-1 of arr into a SIMD
+   vector; arrays with a single row are broadcast, and lanes beyond nv
+   repeat the last valid row. */
+template<typename T, size_t ndim> inline Tv<T> load(const mav<T,ndim> &arr,
+  size_t i0, size_t nv, size_t k)
+  {
+  constexpr size_t vl = Tv<T>::size();
+  const T *p = arr.data() + ((ndim==1) ? 0 : k*arr.stride(ndim-1));
+  ptrdiff_t str = arr.stride(0);
+  if (arr.shape(0)==1) return Tv<T>(p[0]);
+  p += ptrdiff_t(i0)*str;
+  T buf[vl];
+  if (nv==vl)
+    for (size_t j=0; j<vl; ++j) buf[j] = p[ptrdiff_t(j)*str];
+  else
+    for (size_t j=0; j<vl; ++j) buf[j] = p[ptrdiff_t(std::min(j,nv-1))*str];
+  return Tv<T>::loadu(buf);
+  }
+template<typename T, size_t ndim> inline void store(const Tv<T> &v,
+  mav<T,ndim> &arr, size_t i0, size_t nv, size_t k)
+  {
+  T *p = arr.vdata() + ((ndim==1) ? 0 : k*arr.stride(ndim-1));
+  ptrdiff_t str = arr.stride(0);
+  p += ptrdiff_t(i0)*str;
+  T buf[Tv<T>::size()];
+  v.storeu(buf);
+  for (size_t j=0; j<nv; ++j) p[ptrdiff_t(j)*str] = buf[j];
+  }
+
+template<typename T> quaternion_t<Tv<T>> load_quat(const mav<T,2> &q,
+  size_t i0, size_t nv)
+  {
+  return quaternion_t<Tv<T>>(load(q,i0,nv,0), load(q,i0,nv,1),
+                             load(q,i0,nv,2), load(q,i0,nv,3));
+  }
+template<typename T> void store_quat(const quaternion_t<Tv<T>> &q,
+  mav<T,2> &out, size_t i0, size_t nv)
+  {
+  store(q.x,out,i0,nv,0); store(q.y,out,i0,nv,1);
+  store(q.z,out,i0,nv,2); store(q.w,out,i0,nv,3);
+  }
+template<typename T> vec3_t<Tv<T>> load_vec(const mav<T,2> &v, size_t i0,
+  size_t nv)
+  { return vec3_t<Tv<T>>(load(v,i0,nv,0), load(v,i0,nv,1), load(v,i0,nv,2)); }
+template<typename T> void store_vec(const vec3_t<Tv<T>> &v, mav<T,2> &out,
+  size_t i0, size_t nv)
+  { store(v.x,out,i0,nv,0); store(v.y,out,i0,nv,1); store(v.z,out,i0,nv,2); }
+
+/* Returns the common number of rows of a and b, either of which may
+   have a single row. */
+template<typename T1, size_t nd1, typename T2, size_t nd2>
+  size_t broadcast_rows(const mav<T1,nd1> &a, const mav<T2,nd2> &b)
+  {
+  size_t na=a.shape(0), nb=b.shape(0);
+  MR_assert((na==nb)||(na==1)||(nb==1), "array size mismatch");
+  return (na==1) ? nb : na;
+  }
+
+}
+
+/*! Computes out[i] = a[i]*b[i], where a[i] and/or b[i] are replaced by their
+    conjugates if \a conj_a or \a conj_b is set. \a a or \a b may
+    consist of a single quaternion, which is then used for all \a i.
+    \a out may be identical to \a a or \a b. */
+template<typename T> void quat_multiply(const mav<T,2> &a, const mav<T,2> &b,
+  mav<T,2> &out, bool conj_a=false, bool conj_b=false, size_t nthreads=1)
+  {
+  namespace qbd = quat_batch_detail;
+  MR_assert((a.shape(1)==4)&&(b.shape(1)==4)&&(out.shape(1)==4),
+    "need 4 entries in quaternion");
+  size_t n = qbd::broadcast_rows(a, b);
+  MR_assert(out.shape(0)==n, "output size mismatch");
+  qbd::loop<T>(n, nthreads, [&](size_t i0, size_t nv)
+    {
+    auto qa = qbd::load_quat(a, i0, nv), qb = qbd::load_quat(b, i0, nv);
+    if (conj_a) qa = qa.conj();
+    if (conj_b) qb = qb.conj();
+    qbd::store_quat(qa*qb, out, i0, nv);
+    });
+  }
+
+/*! Rotates the vectors \a v[i] by the rotations described by the
+    quaternions \a q[i] (i.e. computes q[i]*v[i]*q[i]^-1) and stores the
+    results in \a out. The quaternions need not be normalized. \a q or
+    \a v may consist of a single entry, which is then used for all \a i. */
+template<typename T> void quat_rotate_vectors(const mav<T,2> &q,
+  const mav<T,2> &v, mav<T,2> &out, size_t nthreads=1)
+  {
+  namespace qbd = quat_batch_detail;
+  using V = qbd::Tv<T>;
+  MR_assert(q.shape(1)==4, "need 4 entries in quaternion");
+  MR_assert((v.shape(1)==3)&&(out.shape(1)==3), "need 3 entries in vector");
+  size_t n = qbd::broadcast_rows(q, v);
+  MR_assert(out.shape(0)==n, "output size mismatch");
+  qbd::loop<T>(n, nthreads, [&](size_t i0, size_t nv)
+    {
+    auto qq = qbd::load_quat(q, i0, nv);
+    auto vv = qbd::load_vec(v, i0, nv);
+    // ((w^2-u.u)*v + 2*(u.v)*u + 2*w*(u x v)) / |q|^2
+    V uu = qq.x*qq.x + qq.y*qq.y + qq.z*qq.z,
+      uv = qq.x*vv.x + qq.y*vv.y + qq.z*vv.z;
+    V inorm = V(T(1))/(uu + qq.w*qq.w);
+    V f1 = (qq.w*qq.w-uu)*inorm, f2 = T(2)*uv*inorm, f3 = T(2)*qq.w*inorm;
+    vec3_t<V> res(f1*vv.x + f2*qq.x + f3*(qq.y*vv.z-qq.z*vv.y),
+                  f1*vv.y + f2*qq.y + f3*(qq.z*vv.x-qq.x*vv.z),
+                  f1*vv.z + f2*qq.z + f3*(qq.x*vv.y-qq.y*vv.x));
+    qbd::store_vec(res, out, i0, nv);
+    });
+  }
+
+/*! Converts the quaternions \a q into rotation axes (unit vectors, shape
+    (n,3)) and angles in [0; 2pi], like quaternion_t::toAxisAngle(). */
+template<typename T> void quat_to_axis_angle(const mav<T,2> &q,
+  mav<T,2> &axis, mav<T,1> &angle, size_t nthreads=1)
+  {
+  namespace qbd = quat_batch_detail;
+  using V = qbd::Tv<T>;
+  MR_assert(q.shape(1)==4, "need 4 entries in quaternion");
+  MR_assert(axis.shape(1)==3, "need 3 entries in vector");
+  size_t n = q.shape(0);
+  MR_assert((axis.shape(0)==n)&&(angle.shape(0)==n), "array size mismatch");
+  qbd::loop<T>(n, nthreads, [&](size_t i0, size_t nv)
+    {
+    auto qq = qbd::load_quat(q, i0, nv);
+    V norm = qq.x*qq.x + qq.y*qq.y + qq.z*qq.z;
+    auto zero = V(T(0))>=norm;
+    norm = sqrt(norm);
+    V inorm = V(T(1))/norm;
+    where(zero, inorm) = V(T(0));
+    vec3_t<V> ax(qq.x*inorm, qq.y*inorm, qq.z*inorm);
+    where(zero, ax.z) = V(T(1));
+    V ang = T(2)*atan2(norm, qq.w);
+    where(zero, ang) = V(T(0));
+    qbd::store_vec(ax, axis, i0, nv);
+    qbd::store(ang, angle, i0, nv, 0);
+    });
+  }
+
+/*! Computes the quaternions of the rotations by \a angle around the unit
+    vectors \a axis, like the corresponding quaternion_t constructor. */
+template<typename T> void quat_from_axis_angle(const mav<T,2> &axis,
+  const mav<T,1> &angle, mav<T,2> &q, size_t nthreads=1)
+  {
+  namespace qbd = quat_batch_detail;
+  using V = qbd::Tv<T>;
+  MR_assert(axis.shape(1)==3, "need 3 entries in vector");
+  MR_assert(q.shape(1)==4, "need 4 entries in quaternion");
+  size_t n = axis.shape(0);
+  MR_assert((angle.shape(0)==n)&&(q.shape(0)==n), "array size mismatch");
+  qbd::loop<T>(n, nthreads, [&](size_t i0, size_t nv)
+    {
+    auto ax = qbd::load_vec(axis, i0, nv);
+    V sa, ca;
+    sincos(qbd::load(angle,i0,nv,0)*T(0.5), sa, ca);
+    qbd::store_quat(quaternion_t<V>(sa*ax.x, sa*ax.y, sa*ax.z, ca), q, i0, nv);
+    });
+  }
+
+/*! Converts the quaternions \a q into the angles (theta, phi, psi) of
+    quaternion_t::toEulerZYZ() and stores them in \a out (shape (n,3)).
+    The quaternions need not be normalized. */
+template<typename T> void quat_to_euler_zyz(const mav<T,2> &q,
+  mav<T,2> &out, size_t nthreads=1)
+  {
+  namespace qbd = quat_batch_detail;
+  using V = qbd::Tv<T>;
+  MR_assert(q.shape(1)==4, "need 4 entries in quaternion");
+  MR_assert(out.shape(1)==3, "need 3 entries in pointing");
+  size_t n = q.shape(0);
+  MR_assert(out.shape(0)==n, "array size mismatch");
+  qbd::loop<T>(n, nthreads, [&](size_t i0, size_t nv)
+    {
+    auto qq = qbd::load_quat(q, i0, nv);
+    V sum = atan2(qq.z, qq.w),   // (phi+psi)/2
+      dif = atan2(-qq.x, qq.y);  // (phi-psi)/2
+    vec3_t<V> res(T(2)*atan2(sqrt(qq.x*qq.x+qq.y*qq.y),
+                             sqrt(qq.z*qq.z+qq.w*qq.w)),
+                  sum+dif, sum-dif);
+    where(res.y<V(T(0)), res.y) += V(T(twopi));
+    where(res.y>=V(T(twopi)), res.y) -= V(T(twopi));
+    qbd::store_vec(res, out, i0, nv);
+    });
+  }
+
+/*! \} */
+
+}
+
+using detail_quaternion_batch::quat_multiply;
+using detail_quaternion_batch::quat_rotate_vectors;
+using detail_quaternion_batch::quat_to_axis_angle;
+using detail_quaternion_batch::quat_from_axis_angle;
+using detail_quaternion_batch::quat_to_euler_zyz;
+
+}
+
+#endif
@@ -38,6 +38,7 @@
 #include <iostream>
 #include "ducc0/infra/error_handling.h"
 #include "ducc0/math/math_utils.h"
+#include "ducc0/math/compress_utils.h"
 
 namespace ducc0 {
 
@@ -242,6 +243,25 @@ template<typename T> class rangeset
       checkConsistency();
       }
 
+    /*! Returns a compact binary representation of the rangeset, obtained by
+        interpolative coding of the range boundaries. The rangeset must not
+        contain negative numbers. */
+    std::vector<uint8_t> serialize() const
+      {
+      obitstream obs;
+      interpol_encode(r.begin(),r.end(),obs);
+      return obs.state();
+      }
+    /*! Returns the rangeset stored in \a data by serialize(). */
+    static rangeset deserialize(const std::vector<uint8_t> &data)
+      {
+      ibitstream ibs(data);
+      rangeset res;
+      interpol_decode(res.r,ibs);
+      res.checkConsistency();
+      return res;
+      }
+
     /*! Returns the first value of range \a i. */
     const T &ivbegin (size_t i) const { return r[2*i]; }
     /*! Returns the one-past-last value of range \a i. */
@@ -280,12 +300,30 @@ template<typename T> class rangeset
     void add(const T &v1, const T &v2)
       {
       if (v2<=v1) return;
-      if (r.empty() || (v1>=r[r.size()-2])) append(v1,v2);
+      if (r.empty() || (v1>=r[r.size()-2])) { append(v1,v2); return; }
       addRemove(v1,v2,1);
       }
     /*! After this operation, the rangeset contains the union of itself
         with \a [v;v+1[. */
     void add(const T &v) { add(v,v+1); }
+    /*! After this operation, the rangeset contains the union of itself
+        with all ranges \a [first;second[ in \a ranges, which may be given
+        in any order and may overlap.
+        The new ranges are sorted and merged with the rangeset in a single
+        pass, so the cost is O(m*log(m)) for m new ranges, whereas adding
+        them one by one out of order needs O(n) per range. */
+    void add(std::vector<std::pair<T,T>> ranges)
+      {
+      std::sort(ranges.begin(), ranges.end());
+      rangeset tmp;
+      tmp.reserve(ranges.size());
+      for (const auto &rng: ranges)
+        tmp.append(rng.first, rng.second);
+      if (r.empty())
+        r.swap(tmp.r);
+      else
+        *this = op_or(tmp);
+      }
 
     /*! Removes all values within \a [v1;v2[ from the rangeset. */
     void remove(const T &v1, const T &v2)
@@ -31,10 +31,27 @@
 
 #include "ducc0/math/space_filling.h"
 
+#if (!defined(__BMI2__)) && defined(__x86_64__) && defined(__GNUC__)
+#define DUCC0_BMI2_DISPATCH
+#include <x86intrin.h>
+#endif
+
 namespace ducc0 {
 
+namespace {
+
+using arr2_32 = std::array<uint32_t,2>;
+using arr2_64 = std::array<uint64_t,2>;
+
+}
+
 #ifndef __BMI2__
 
+namespace {
+
+// table-based implementations, used if BMI2 is not available or slow
+namespace table {
+
 #if 1
 
 namespace {
@@ -281,8 +298,134 @@ std::array<uint64_t,3> morton2coord3D_64 (uint64_t v)
            compress3D_64(v>>2)};
   }
 
+} // namespace table
+
+#ifdef DUCC0_BMI2_DISPATCH
+
+namespace bmi2 {
+
+#define DUCC0_SF_BMI2 inline __attribute__((target("bmi2")))
+#include "ducc0/math/space_filling_bmi2_inc.h"
+
+#define DUCC0_SF_BATCH(name, Tin, Tout) \
+DUCC0_SF_BMI2 void name (const Tin *in, Tout *out, size_t n) \
+  { for (size_t i=0; i<n; ++i) out[i] = name(in[i]); }
+
+DUCC0_SF_BATCH(spread_bits_2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(spread_bits_2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(block2morton2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(coord2morton2D_32, arr2_32, uint32_t)
+DUCC0_SF_BATCH(morton2block2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(morton2coord2D_32, uint32_t, arr2_32)
+DUCC0_SF_BATCH(block2morton2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(coord2morton2D_64, arr2_64, uint64_t)
+DUCC0_SF_BATCH(morton2block2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(morton2coord2D_64, uint64_t, arr2_64)
+
+#undef DUCC0_SF_BATCH
+#undef DUCC0_SF_BMI2
+
+} // namespace bmi2
+
+/* pdep and pext are microcoded and much slower than the table lookups on
+   AMD CPUs before Zen3 (families 15h and 17h). */
+bool fast_bmi2()
+  {
+  static const bool res = []()
+    {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2")
+        && (!__builtin_cpu_is("amdfam15h"))
+        && (!__builtin_cpu_is("amdfam17h"));
+    }();
+  return res;
+  }
+
+#define DUCC0_SF_DISPATCH(call) if (fast_bmi2()) return bmi2::call;
+#else
+#define DUCC0_SF_DISPATCH(call)
+#endif
+
+}
+
+bool space_filling_bmi2()
+  {
+#ifdef DUCC0_BMI2_DISPATCH
+  return fast_bmi2();
+#else
+  return false;
+#endif
+  }
+
+uint32_t spread_bits_2D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(spread_bits_2D_32(v)) return table::spread_bits_2D_32(v); }
+uint64_t spread_bits_2D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(spread_bits_2D_64(v)) return table::spread_bits_2D_64(v); }
+uint32_t block2morton2D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(block2morton2D_32(v)) return table::block2morton2D_32(v); }
+uint32_t coord2morton2D_32 (std::array<uint32_t,2> xy)
+  { DUCC0_SF_DISPATCH(coord2morton2D_32(xy)) return table::coord2morton2D_32(xy); }
+uint32_t morton2block2D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(morton2block2D_32(v)) return table::morton2block2D_32(v); }
+std::array<uint32_t,2> morton2coord2D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(morton2coord2D_32(v)) return table::morton2coord2D_32(v); }
+uint64_t block2morton2D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(block2morton2D_64(v)) return table::block2morton2D_64(v); }
+uint64_t coord2morton2D_64 (std::array<uint64_t,2> xy)
+  { DUCC0_SF_DISPATCH(coord2morton2D_64(xy)) return table::coord2morton2D_64(xy); }
+uint64_t morton2block2D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(morton2block2D_64(v)) return table::morton2block2D_64(v); }
+std::array<uint64_t,2> morton2coord2D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(morton2coord2D_64(v)) return table::morton2coord2D_64(v); }
+
+uint32_t block2morton3D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(block2morton3D_32(v)) return table::block2morton3D_32(v); }
+uint32_t coord2morton3D_32 (std::array<uint32_t,3> xyz)
+  { DUCC0_SF_DISPATCH(coord2morton3D_32(xyz)) return table::coord2morton3D_32(xyz); }
+uint32_t morton2block3D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(morton2block3D_32(v)) return table::morton2block3D_32(v); }
+std::array<uint32_t,3> morton2coord3D_32 (uint32_t v)
+  { DUCC0_SF_DISPATCH(morton2coord3D_32(v)) return table::morton2coord3D_32(v); }
+uint64_t block2morton3D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(block2morton3D_64(v)) return table::block2morton3D_64(v); }
+uint64_t coord2morton3D_64 (std::array<uint64_t,3> xyz)
+  { DUCC0_SF_DISPATCH(coord2morton3D_64(xyz)) return table::coord2morton3D_64(xyz); }
+uint64_t morton2block3D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(morton2block3D_64(v)) return table::morton2block3D_64(v); }
+std::array<uint64_t,3> morton2coord3D_64 (uint64_t v)
+  { DUCC0_SF_DISPATCH(morton2coord3D_64(v)) return table::morton2coord3D_64(v); }
+
+#define DUCC0_SF_BATCH(name, Tin, Tout) \
+void name (const Tin *in, Tout *out, size_t n) \
+  { \
+  DUCC0_SF_DISPATCH(name(in, out, n)) \
+  for (size_t i=0; i<n; ++i) out[i] = table::name(in[i]); \
+  }
+
+#else
+
+bool space_filling_bmi2() { return true; }
+
+#define DUCC0_SF_BATCH(name, Tin, Tout) \
+void name (const Tin *in, Tout *out, size_t n) \
+  { for (size_t i=0; i<n; ++i) out[i] = name(in[i]); }
+
 #endif
 
+DUCC0_SF_BATCH(spread_bits_2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(spread_bits_2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(block2morton2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(coord2morton2D_32, arr2_32, uint32_t)
+DUCC0_SF_BATCH(morton2block2D_32, uint32_t, uint32_t)
+DUCC0_SF_BATCH(morton2coord2D_32, uint32_t, arr2_32)
+DUCC0_SF_BATCH(block2morton2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(coord2morton2D_64, arr2_64, uint64_t)
+DUCC0_SF_BATCH(morton2block2D_64, uint64_t, uint64_t)
+DUCC0_SF_BATCH(morton2coord2D_64, uint64_t, arr2_64)
+
+#undef DUCC0_SF_BATCH
+#undef DUCC0_SF_DISPATCH
+
 namespace {
 
 const uint8_t m2p3D[24][8]={
@@ -534,4 +677,17 @@ uint64_t peano2morton2D_64(uint64_t v, unsigned bits)
   return res;
   }
 
+void morton2peano2D_32(const uint32_t *in, uint32_t *out, size_t n,
+  unsigned bits)
+  { for (size_t i=0; i<n; ++i) out[i] = morton2peano2D_32(in[i], bits); }
+void peano2morton2D_32(const uint32_t *in, uint32_t *out, size_t n,
+  unsigned bits)
+  { for (size_t i=0; i<n; ++i) out[i] = peano2morton2D_32(in[i], bits); }
+void morton2peano2D_64(const uint64_t *in, uint64_t *out, size_t n,
+  unsigned bits)
+  { for (size_t i=0; i<n; ++i) out[i] = morton2peano2D_64(in[i], bits); }
+void peano2morton2D_64(const uint64_t *in, uint64_t *out, size_t n,
+  unsigned bits)
+  { for (size_t i=0; i<n; ++i) out[i] = peano2morton2D_64(in[i], bits); }
+
 }
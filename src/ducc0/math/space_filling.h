@@ -33,6 +33,7 @@
 #ifndef DUCC0_SPACE_FILLING_H
 #define DUCC0_SPACE_FILLING_H
 
+#include <cstddef>
 #include <cstdint>
 #include <array>
 
@@ -67,86 +68,10 @@ std::array<uint64_t,3> morton2coord3D_64 (uint64_t v);
 
 #else
 
-inline uint32_t spread_bits_2D_32 (uint32_t v)
-  { return _pdep_u32(v,0x55555555u); }
-inline uint64_t spread_bits_2D_64 (uint64_t v)
-  { return _pdep_u64(v,0x5555555555555555u); }
-
-inline uint32_t block2morton2D_32 (uint32_t v)
-  { return _pdep_u32(v,0x55555555u)|_pdep_u32(v>>16,0xaaaaaaaau); }
-inline uint32_t coord2morton2D_32 (std::array<uint32_t,2> xy)
-  { return _pdep_u32(xy[0],0x55555555u)|_pdep_u32(xy[1],0xaaaaaaaau); }
-inline uint32_t morton2block2D_32 (uint32_t v)
-  { return _pext_u32(v,0x55555555u)|(_pext_u32(v,0xaaaaaaaau)<<16); }
-inline std::array<uint32_t,2> morton2coord2D_32 (uint32_t v)
-  { return {_pext_u32(v,0x55555555u), _pext_u32(v,0xaaaaaaaau)}; }
-inline uint64_t block2morton2D_64 (uint64_t v)
-  {
-  return _pdep_u64(v,0x5555555555555555u)
-        |_pdep_u64(v>>32,0xaaaaaaaaaaaaaaaau);
-  }
-inline uint64_t coord2morton2D_64 (std::array<uint64_t,2> xy)
-  { return _pdep_u64(xy[0],0x5555555555555555u)|
-           _pdep_u64(xy[1],0xaaaaaaaaaaaaaaaau); }
-inline uint64_t morton2block2D_64 (uint64_t v)
-  {
-  return _pext_u64(v,0x5555555555555555u)
-       |(_pext_u64(v,0xaaaaaaaaaaaaaaaau)<<32);
-  }
-inline std::array<uint64_t,2> morton2coord2D_64 (uint64_t v)
-  {
-  return {_pext_u64(v,0x5555555555555555u),
-          _pext_u64(v,0xaaaaaaaaaaaaaaaau)};
-  }
-
-inline uint32_t block2morton3D_32 (uint32_t v)
-  {
-  return _pdep_u32(v    ,0x09249249u)
-        |_pdep_u32(v>>10,0x12492492u)
-        |_pdep_u32(v>>20,0x24924924u);
-  }
-inline uint32_t coord2morton3D_32 (std::array<uint32_t,3> xyz)
-  {
-  return _pdep_u32(xyz[0],0x09249249u)
-        |_pdep_u32(xyz[1],0x12492492u)
-        |_pdep_u32(xyz[2],0x24924924u);
-  }
-inline uint32_t morton2block3D_32 (uint32_t v)
-  {
-  return _pext_u32(v,0x9249249u)
-       |(_pext_u32(v,0x12492492u)<<10)
-       |(_pext_u32(v,0x24924924u)<<20);
-  }
-inline std::array<uint32_t,3> morton2coord3D_32 (uint32_t v)
-  {
-  return {_pext_u32(v,0x09249249u),
-          _pext_u32(v,0x12492492u),
-          _pext_u32(v,0x24924924u)};
-  }
-inline uint64_t block2morton3D_64 (uint64_t v)
-  {
-  return _pdep_u64(v    ,0x1249249249249249u)
-        |_pdep_u64(v>>21,0x2492492492492492u)
-        |_pdep_u64(v>>42,0x4924924924924924u);
-  }
-inline uint64_t coord2morton3D_64 (std::array<uint64_t,3> xyz)
-  {
-  return _pdep_u64(xyz[0],0x1249249249249249u)
-        |_pdep_u64(xyz[1],0x2492492492492492u)
-        |_pdep_u64(xyz[2],0x4924924924924924u);
-  }
-inline uint64_t morton2block3D_64 (uint64_t v)
-  {
-  return _pext_u64(v,0x1249249249249249u)
-       |(_pext_u64(v,0x2492492492492492u)<<21)
-       |(_pext_u64(v,0x4924924924924924u)<<42);
-  }
-inline std::array<uint64_t,3> morton2coord3D_64 (uint64_t v)
-  {
-  return {_pext_u64(v,0x1249249249249249u),
-          _pext_u64(v,0x2492492492492492u),
-          _pext_u64(v,0x4924924924924924u)};
-  }
+#define DUCC0_SF_BMI2 inline
+#include "ducc0/math/space_filling_bmi2_inc.h"
+#undef DUCC0_SF_BMI2
+
 #endif
 
 uint32_t morton2peano2D_32(uint32_t v, unsigned bits);
@@ -161,6 +86,39 @@ uint32_t peano2morton3D_32(uint32_t v, unsigned bits);
 uint64_t morton2peano3D_64(uint64_t v, unsigned bits);
 uint64_t peano2morton3D_64(uint64_t v, unsigned bits);
 
+/* Returns true if the Morton conversions use the BMI2 instructions pdep and
+   pext. Without compiler support for BMI2, this is decided at runtime; the
+   table-based code is kept on CPUs where pdep/pext are slow (AMD before
+   Zen3). */
+bool space_filling_bmi2();
+
+/* Array versions of the 2D conversions: out[i] = f(in[i]) for i<n.
+   These avoid the per-call dispatch overhead. */
+void spread_bits_2D_32 (const uint32_t *in, uint32_t *out, size_t n);
+void spread_bits_2D_64 (const uint64_t *in, uint64_t *out, size_t n);
+
+void block2morton2D_32 (const uint32_t *in, uint32_t *out, size_t n);
+void coord2morton2D_32 (const std::array<uint32_t,2> *in, uint32_t *out,
+  size_t n);
+void morton2block2D_32 (const uint32_t *in, uint32_t *out, size_t n);
+void morton2coord2D_32 (const uint32_t *in, std::array<uint32_t,2> *out,
+  size_t n);
+void block2morton2D_64 (const uint64_t *in, uint64_t *out, size_t n);
+void coord2morton2D_64 (const std::array<uint64_t,2> *in, uint64_t *out,
+  size_t n);
+void morton2block2D_64 (const uint64_t *in, uint64_t *out, size_t n);
+void morton2coord2D_64 (const uint64_t *in, std::array<uint64_t,2> *out,
+  size_t n);
+
+void morton2peano2D_32(const uint32_t *in, uint32_t *out, size_t n,
+  unsigned bits);
+void peano2morton2D_32(const uint32_t *in, uint32_t *out, size_t n,
+  unsigned bits);
+void morton2peano2D_64(const uint64_t *in, uint64_t *out, size_t n,
+  unsigned bits);
+void peano2morton2D_64(const uint64_t *in, uint64_t *out, size_t n,
+  unsigned bits);
+
 inline uint32_t coord2block2D_32(std::array<uint32_t,2> xy)
   { return (xy[0]&0xffff) | (xy[1]<<16); }
 inline std::array<uint32_t,2> block2coord2D_32(uint32_t v)
@@ -0,0 +1,108 @@
+/*
+ *  This file is part of libc_utils.
+ *
+ *  libc_utils is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libc_utils is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libc_utils; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ *  BMI2 (pdep/pext) implementations of the Morton index conversions.
+ *  This file is included by space_filling.h (if the compiler targets BMI2)
+ *  and by space_filling.cc (for runtime dispatch); DUCC0_SF_BMI2 must be
+ *  defined to the function specifiers before inclusion.
+ *
+ *  Copyright (C) 2015-2020 Max-Planck-Society
+ *  Author: Martin Reinecke
+ */
+
+DUCC0_SF_BMI2 uint32_t spread_bits_2D_32 (uint32_t v)
+  { return _pdep_u32(v,0x55555555u); }
+DUCC0_SF_BMI2 uint64_t spread_bits_2D_64 (uint64_t v)
+  { return _pdep_u64(v,0x5555555555555555u); }
+
+DUCC0_SF_BMI2 uint32_t block2morton2D_32 (uint32_t v)
+  { return _pdep_u32(v,0x55555555u)|_pdep_u32(v>>16,0xaaaaaaaau); }
+DUCC0_SF_BMI2 uint32_t coord2morton2D_32 (std::array<uint32_t,2> xy)
+  { return _pdep_u32(xy[0],0x55555555u)|_pdep_u32(xy[1],0xaaaaaaaau); }
+DUCC0_SF_BMI2 uint32_t morton2block2D_32 (uint32_t v)
+  { return _pext_u32(v,0x55555555u)|(_pext_u32(v,0xaaaaaaaau)<<16); }
+DUCC0_SF_BMI2 std::array<uint32_t,2> morton2coord2D_32 (uint32_t v)
+  { return {_pext_u32(v,0x55555555u), _pext_u32(v,0xaaaaaaaau)}; }
+DUCC0_SF_BMI2 uint64_t block2morton2D_64 (uint64_t v)
+  {
+  return _pdep_u64(v,0x5555555555555555u)
+        |_pdep_u64(v>>32,0xaaaaaaaaaaaaaaaau);
+  }
+DUCC0_SF_BMI2 uint64_t coord2morton2D_64 (std::array<uint64_t,2> xy)
+  { return _pdep_u64(xy[0],0x5555555555555555u)|
+           _pdep_u64(xy[1],0xaaaaaaaaaaaaaaaau); }
+DUCC0_SF_BMI2 uint64_t morton2block2D_64 (uint64_t v)
+  {
+  return _pext_u64(v,0x5555555555555555u)
+       |(_pext_u64(v,0xaaaaaaaaaaaaaaaau)<<32);
+  }
+DUCC0_SF_BMI2 std::array<uint64_t,2> morton2coord2D_64 (uint64_t v)
+  {
+  return {_pext_u64(v,0x5555555555555555u),
+          _pext_u64(v,0xaaaaaaaaaaaaaaaau)};
+  }
+
+DUCC0_SF_BMI2 uint32_t block2morton3D_32 (uint32_t v)
+  {
+  return _pdep_u32(v    ,0x09249249u)
+        |_pdep_u32(v>>10,0x12492492u)
+        |_pdep_u32(v>>20,0x24924924u);
+  }
+DUCC0_SF_BMI2 uint32_t coord2morton3D_32 (std::array<uint32_t,3> xyz)
+  {
+  return _pdep_u32(xyz[0],0x09249249u)
+        |_pdep_u32(xyz[1],0x12492492u)
+        |_pdep_u32(xyz[2],0x24924924u);
+  }
+DUCC0_SF_BMI2 uint32_t morton2block3D_32 (uint32_t v)
+  {
+  return _pext_u32(v,0x9249249u)
+       |(_pext_u32(v,0x12492492u)<<10)
+       |(_pext_u32(v,0x24924924u)<<20);
+  }
+DUCC0_SF_BMI2 std::array<uint32_t,3> morton2coord3D_32 (uint32_t v)
+  {
+  return {_pext_u32(v,0x09249249u),
+          _pext_u32(v,0x12492492u),
+          _pext_u32(v,0x24924924u)};
+  }
+DUCC0_SF_BMI2 uint64_t block2morton3D_64 (uint64_t v)
+  {
+  return _pdep_u64(v    ,0x1249249249249249u)
+        |_pdep_u64(v>>21,0x2492492492492492u)
+        |_pdep_u64(v>>42,0x4924924924924924u);
+  }
+DUCC0_SF_BMI2 uint64_t coord2morton3D_64 (std::array<uint64_t,3> xyz)
+  {
+  return _pdep_u64(xyz[0],0x1249249249249249u)
+        |_pdep_u64(xyz[1],0x2492492492492492u)
+        |_pdep_u64(xyz[2],0x4924924924924924u);
+  }
+DUCC0_SF_BMI2 uint64_t morton2block3D_64 (uint64_t v)
+  {
+  return _pext_u64(v,0x1249249249249249u)
+       |(_pext_u64(v,0x2492492492492492u)<<21)
+       |(_pext_u64(v,0x4924924924924924u)<<42);
+  }
+DUCC0_SF_BMI2 std::array<uint64_t,3> morton2coord3D_64 (uint64_t v)
+  {
+  return {_pext_u64(v,0x1249249249249249u),
+          _pext_u64(v,0x2492492492492492u),
+          _pext_u64(v,0x4924924924924924u)};
+  }
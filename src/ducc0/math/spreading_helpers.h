@@ -0,0 +1,408 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+/* Building blocks shared by the gridders (wgridder, nufft) which spread
+   non-uniform points onto a periodic oversampled grid with a gridding kernel
+   and interpolate from it: tile-local buffers, sorting of the points by tile,
+   and the kernel correction factors of the uniform modes. */
+
+#ifndef DUCC0_SPREADING_HELPERS_H
+#define DUCC0_SPREADING_HELPERS_H
+
+#include <cstdlib>
+#include <complex>
+#include <vector>
+#include <array>
+#include <mutex>
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/useful_macros.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/math/gridding_kernel.h"
+
+namespace ducc0 {
+
+namespace detail_spreading {
+
+using namespace std;
+
+/*! Number of tiles of side length (1<<log2tile) along a grid axis of length
+    \a n; see tile_index(). */
+template<int log2tile> constexpr size_t ntiles(size_t n)
+  { return ((n+1)>>log2tile)+1; }
+
+/*! Index of the tile along a grid axis for a point whose kernel starts at
+    grid index \a i0. \a i0 lies in [-nsafe; n+nsafe-supp], see getpix()
+    of the gridders. */
+template<int log2tile> inline size_t tile_index(int i0, int nsafe)
+  { return size_t(i0+nsafe)>>log2tile; }
+
+/*! Thread-local buffer covering one tile of a periodic grid of dimension
+    \a ndim plus a margin of nsafe=(supp+1)/2 cells on every side, so that the
+    kernels of all points in the tile lie completely inside it.
+    Real and imaginary parts are stored separately, and the last dimension
+    is padded to a multiple of the SIMD vector length. */
+template<typename T, size_t ndim, size_t supp, int log2tile> class TileBuffer
+  {
+  public:
+    static constexpr size_t vlen = native_simd<T>::size();
+    static constexpr int nsafe = (supp+1)/2;
+    static constexpr int su = 2*nsafe+(1<<log2tile);
+    static constexpr int suvec = ((su+vlen-1)/vlen)*vlen;
+
+    static constexpr int lineJump() { return suvec; }
+    static constexpr int planeJump() { return su*suvec; }
+
+  protected:
+    static constexpr size_t bufsize =
+      ((ndim==1) ? 1 : ((ndim==2) ? su : su*su))*suvec;
+
+    array<int,ndim> nn; // grid dimensions
+    array<int,ndim> i0; // start index of the current point
+    array<int,ndim> b0; // start index of the current buffer
+    vector<T> bufr, bufi;
+
+    TileBuffer(const array<size_t,ndim> &shape)
+      : bufr(bufsize+vlen, T(0)), bufi(bufsize+vlen, T(0))
+      {
+      for (size_t d=0; d<ndim; ++d) nn[d]=int(shape[d]);
+      reset();
+      }
+
+    void reset()
+      {
+      i0.fill(-1000000);
+      b0.fill(-1000000);
+      }
+    bool empty() const { return b0[0]<-nsafe; }
+
+    /* Sets the start index of the current point to \a i0new and returns
+       false if it is unchanged. */
+    [[gnu::always_inline]] bool setPoint(const array<int,ndim> &i0new)
+      {
+      if (i0new==i0) return false;
+      i0 = i0new;
+      return true;
+      }
+    [[gnu::always_inline]] bool outside() const
+      {
+      bool res=false;
+      for (size_t d=0; d<ndim; ++d)
+        if ((i0[d]<b0[d]) || (i0[d]+int(supp)>b0[d]+su)) res=true;
+      return res;
+      }
+    // moves the buffer to the tile containing the current point
+    [[gnu::always_inline]] void moveBuffer()
+      {
+      for (size_t d=0; d<ndim; ++d)
+        b0[d]=((((i0[d]+nsafe)>>log2tile)<<log2tile))-nsafe;
+      }
+    // offset of the current point within the buffer
+    [[gnu::always_inline]] ptrdiff_t offset() const
+      {
+      ptrdiff_t ofs=0;
+      for (size_t d=0; d+1<ndim; ++d)
+        ofs = ofs*su + (i0[d]-b0[d]);
+      return ofs*suvec + (i0[ndim-1]-b0[ndim-1]);
+      }
+
+    /* Calls func(buffer index, grid indices...) for all cells of the buffer,
+       sweeping along the first grid axis in the outermost loop. lock(i)
+       is called with the first grid index before processing the
+       corresponding slab of the buffer; its return value is kept alive
+       while doing so. */
+    template<typename Flock, typename Func> void forEachCell(Flock &&lock,
+      Func &&func) const
+      {
+      int idxu = (b0[0]+nn[0])%nn[0];
+      if constexpr (ndim==1)
+        {
+        auto lck = lock(0);
+        for (int iu=0; iu<su; ++iu)
+          {
+          func(iu, idxu);
+          if (++idxu>=nn[0]) idxu=0;
+          }
+        }
+      else if constexpr (ndim==2)
+        {
+        int idxv0 = (b0[1]+nn[1])%nn[1];
+        for (int iu=0; iu<su; ++iu)
+          {
+          int idxv = idxv0;
+          {
+          auto lck = lock(idxu);
+          for (int iv=0; iv<su; ++iv)
+            {
+            func(iu*suvec+iv, idxu, idxv);
+            if (++idxv>=nn[1]) idxv=0;
+            }
+          }
+          if (++idxu>=nn[0]) idxu=0;
+          }
+        }
+      else
+        {
+        int idxv0 = (b0[1]+nn[1])%nn[1];
+        int idxw0 = (b0[2]+nn[2])%nn[2];
+        for (int iu=0; iu<su; ++iu)
+          {
+          int idxv = idxv0;
+          {
+          auto lck = lock(idxu);
+          for (int iv=0; iv<su; ++iv)
+            {
+            int idxw = idxw0;
+            for (int iw=0; iw<su; ++iw)
+              {
+              func((iu*su+iv)*suvec+iw, idxu, idxv, idxw);
+              if (++idxw>=nn[2]) idxw=0;
+              }
+            if (++idxv>=nn[1]) idxv=0;
+            }
+          }
+          if (++idxu>=nn[0]) idxu=0;
+          }
+        }
+      }
+  };
+
+/*! Buffer for spreading points onto \a grid: prep() makes p0r and p0i
+    point to the buffer position corresponding to the kernel of the next
+    point, and the buffer contents are added to the grid whenever the buffer
+    has to be moved, as well as by flush() and on destruction.
+    If \a locks is given, the additions to the grid are protected by
+    locks[0] in 1D and by locks[i] for the slab with first index i
+    otherwise. */
+template<typename T, typename Tg, size_t ndim, size_t supp, int log2tile>
+  class SpreadingBuffer: public TileBuffer<T, ndim, supp, log2tile>
+  {
+  private:
+    using Base = TileBuffer<T, ndim, supp, log2tile>;
+    using Base::bufr;
+    using Base::bufi;
+
+    mav<complex<Tg>,ndim> &grid;
+    vector<mutex> *locks;
+
+    DUCC0_NOINLINE void dump()
+      {
+      if (this->empty()) return; // nothing written into buffer yet
+      auto lock = [this](int i)
+        { return locks ? unique_lock<mutex>((*locks)[size_t(i)])
+                       : unique_lock<mutex>(); };
+      this->forEachCell(lock, [this](size_t i, auto... idx)
+        {
+        grid.v(idx...) += complex<Tg>(bufr[i], bufi[i]);
+        bufr[i] = bufi[i] = 0;
+        });
+      }
+
+  public:
+    T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
+
+    SpreadingBuffer(mav<complex<Tg>,ndim> &grid_, vector<mutex> *locks_=nullptr)
+      : Base(grid_.shape()), grid(grid_), locks(locks_),
+        p0r(bufr.data()), p0i(bufi.data()) {}
+    ~SpreadingBuffer() { dump(); }
+
+    /*! Adds the buffer contents to the grid while holding \a lock and
+        resets the buffer. */
+    void flush(mutex &lock)
+      {
+      if (this->empty()) return;
+      {
+      lock_guard<mutex> lck(lock);
+      dump();
+      }
+      this->reset();
+      }
+
+    [[gnu::always_inline]] [[gnu::hot]] void prep(const array<int,ndim> &i0new)
+      {
+      if (!this->setPoint(i0new)) return;
+      if (this->outside())
+        {
+        dump();
+        this->moveBuffer();
+        }
+      auto ofs = this->offset();
+      p0r = bufr.data()+ofs;
+      p0i = bufi.data()+ofs;
+      }
+  };
+
+/*! Buffer for interpolating from \a grid: prep() makes p0r and p0i point
+    to the buffer position corresponding to the kernel of the next point,
+    reading the required part of the grid if the buffer has to be moved. */
+template<typename T, typename Tg, size_t ndim, size_t supp, int log2tile>
+  class InterpolationBuffer: public TileBuffer<T, ndim, supp, log2tile>
+  {
+  private:
+    using Base = TileBuffer<T, ndim, supp, log2tile>;
+    using Base::bufr;
+    using Base::bufi;
+
+    const mav<complex<Tg>,ndim> &grid;
+
+    DUCC0_NOINLINE void load()
+      {
+      this->forEachCell([](int) { return unique_lock<mutex>(); },
+        [this](size_t i, auto... idx)
+        {
+        bufr[i] = T(grid(idx...).real());
+        bufi[i] = T(grid(idx...).imag());
+        });
+      }
+
+  public:
+    const T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
+
+    InterpolationBuffer(const mav<complex<Tg>,ndim> &grid_)
+      : Base(grid_.shape()), grid(grid_), p0r(bufr.data()), p0i(bufi.data()) {}
+
+    [[gnu::always_inline]] [[gnu::hot]] void prep(const array<int,ndim> &i0new)
+      {
+      if (!this->setPoint(i0new)) return;
+      if (this->outside())
+        {
+        this->moveBuffer();
+        load();
+        }
+      auto ofs = this->offset();
+      p0r = bufr.data()+ofs;
+      p0i = bufi.data()+ofs;
+      }
+  };
+
+/*! Sorts items by an integer key in [0; nkeys), using \a nthreads threads.
+    The items are organized in \a ngroups groups (e.g. the rows of a
+    measurement set), group g containing nitems(g) items. key(g, j) returns
+    the key of item j of group g, or ~Tidx(0) if the item is to be skipped,
+    and entry(g, j) the value stored for it in the result. Items with equal
+    keys keep their order. */
+template<typename Tidx, typename Fnum, typename Fkey, typename Fentry>
+  vector<Tidx> bucket_sort(size_t ngroups, size_t nkeys, size_t nthreads,
+  Fnum nitems, Fkey key, Fentry entry)
+  {
+  // number of items before the groups processed by every thread
+  vector<size_t> tofs(nthreads+1, 0);
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid = sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, ngroups);
+    size_t cnt=0;
+    for (auto g=lo; g<hi; ++g)
+      cnt += nitems(g);
+    tofs[tid+1] = cnt;
+    });
+  for (size_t t=0; t<nthreads; ++t)
+    tofs[t+1] += tofs[t];
+  MR_assert(tofs[nthreads]<size_t(~Tidx(0)), "too many items");
+
+  mav<Tidx,2> acc({nthreads, (nkeys+16)}); // the 16 is safety distance to avoid false sharing
+  vector<Tidx> tmp(tofs[nthreads]);
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid = sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, ngroups);
+    for (size_t g=lo, idx=tofs[tid]; g<hi; ++g)
+      for (size_t j=0, n=nitems(g); j<n; ++j, ++idx)
+        {
+        tmp[idx] = key(g, j);
+        if (tmp[idx]!=(~Tidx(0)))
+          ++acc.v(tid, tmp[idx]);
+        }
+    });
+
+  Tidx offset=0;
+  for (size_t k=0; k<nkeys; ++k)
+    for (size_t tid=0; tid<nthreads; ++tid)
+      {
+      auto cnt = acc(tid, k);
+      acc.v(tid, k) = offset;
+      offset += cnt;
+      }
+
+  vector<Tidx> res(offset);
+  execParallel(nthreads, [&](Scheduler &sched)
+    {
+    auto tid = sched.thread_num();
+    auto [lo, hi] = calcShare(nthreads, tid, ngroups);
+    for (size_t g=lo, idx=tofs[tid]; g<hi; ++g)
+      for (size_t j=0, n=nitems(g); j<n; ++j, ++idx)
+        if (tmp[idx]!=(~Tidx(0)))
+          res[acc.v(tid, tmp[idx])++] = entry(g, j);
+    });
+  return res;
+  }
+
+/*! Signed mode number of index \a i along an axis of length \a n of a
+    uniform array. The zero mode is at index n/2, or at index 0 if
+    \a fft_order is true. */
+inline ptrdiff_t mode_index(size_t i, size_t n, bool fft_order)
+  {
+  return fft_order ? ((i+n/2<n) ? ptrdiff_t(i) : ptrdiff_t(i)-ptrdiff_t(n))
+                   : ptrdiff_t(i)-ptrdiff_t(n/2);
+  }
+
+/*! Returns, for every index along an axis of length \a n of a uniform array,
+    the corresponding index on the periodic oversampled axis of length
+    \a nover. */
+inline vector<size_t> grid_indices(size_t n, size_t nover, bool fft_order)
+  {
+  vector<size_t> res(n);
+  for (size_t i=0; i<n; ++i)
+    {
+    auto k = mode_index(i, n, fft_order);
+    res[i] = (k<0) ? size_t(ptrdiff_t(nover)+k) : size_t(k);
+    }
+  return res;
+  }
+
+/*! Returns the correction factors of \a krn for every index along an axis
+    of length \a n of a uniform array, which is oversampled to \a nover
+    grid points. */
+template<typename T> vector<double> correction_factors
+  (const GriddingKernel<T> &krn, size_t n, size_t nover, bool fft_order,
+  size_t nthreads)
+  {
+  auto cf = krn.corfunc(n/2+1, 1./nover, int(nthreads));
+  vector<double> res(n);
+  for (size_t i=0; i<n; ++i)
+    res[i] = cf[size_t(abs(mode_index(i, n, fft_order)))];
+  return res;
+  }
+
+}
+
+using detail_spreading::ntiles;
+using detail_spreading::tile_index;
+using detail_spreading::SpreadingBuffer;
+using detail_spreading::InterpolationBuffer;
+using detail_spreading::bucket_sort;
+using detail_spreading::grid_indices;
+using detail_spreading::correction_factors;
+
+}
+
+#endif
@@ -0,0 +1,848 @@
+/*
+ *  This file is part of the MR utility library.
+ *
+ *  This code is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This code is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this code; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Copyright (C) 2020 Max-Planck-Society
+   Author: Martin Reinecke */
+
+#ifndef DUCC0_NUFFT_H
+#define DUCC0_NUFFT_H
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/math/fft.h"
+#include "ducc0/infra/threading.h"
+#include "ducc0/infra/misc_utils.h"
+#include "ducc0/infra/useful_macros.h"
+#include "ducc0/infra/mav.h"
+#include "ducc0/infra/simd.h"
+#include "ducc0/infra/timers.h"
+#include "ducc0/math/constants.h"
+#include "ducc0/math/gridding_kernel.h"
+#include "ducc0/math/spreading_helpers.h"
+
+namespace ducc0 {
+
+namespace detail_nufft {
+
+using namespace std;
+
+using idx_t = uint32_t;
+
+inline double fmod1 (double v)
+  { return v-floor(v); }
+
+/*! Non-uniform FFT of types 1 and 2 in 1 to 3 dimensions (for type 3 see
+    Nufft3).
+
+    The non-uniform coordinates are given in radians and are periodic with
+    period 2*pi in every dimension. For a uniform array of shape
+    (N_0, ..., N_{ndim-1}) the mode indices along dimension d run from
+    -N_d/2 to N_d-1-N_d/2; by default the zero mode sits at index N_d/2,
+    if \a fft_order is true the modes are stored in the order used by the FFT
+    routines (zero mode first).
+
+    Type 1 ("nu2u"):  uniform[k] = sum_j points[j] * exp(-+i k.coord[j])
+    Type 2 ("u2nu"):  points[j] = sum_k uniform[k] * exp(-+i k.coord[j])
+    where the negative sign is used for forward transforms.
+
+    The spreading and interpolation machinery is shared with the wgridder
+    (see spreading_helpers.h): an ES kernel is selected from the kernel
+    database according to the requested accuracy, the size of the oversampled
+    grid is chosen via a simple cost model, and the points are processed in
+    tile order using thread-local buffers. */
+template<typename T, size_t ndim> class Nufft
+  {
+  private:
+    static_assert((ndim>=1) && (ndim<=3), "only 1D, 2D and 3D supported");
+    static constexpr int log2tile = (ndim==1) ? 9 : ((ndim==2) ? 4 : 3);
+
+    TimerHierarchy timers;
+    mav<double,2> coords;
+    size_t npoints;
+    array<size_t,ndim> nuni, nover;
+    size_t nthreads;
+    size_t verbosity;
+    size_t kidx, supp, nsafe;
+    shared_ptr<HornerKernel<T>> krn;
+    array<double,ndim> shift;
+    array<int,ndim> maxi0;
+    vector<idx_t> coord_idx;
+
+    // Nufft3 uses only the spreading step, onto a grid of its own choice
+    template<typename T2, size_t ndim2> friend class Nufft3;
+
+    [[gnu::always_inline]] void getpix(size_t ipt, array<double,ndim> &u,
+      array<int,ndim> &i0) const
+      {
+      for (size_t d=0; d<ndim; ++d)
+        {
+        u[d]=fmod1(coords(ipt,d)*inv_twopi)*nover[d];
+        i0[d]=min(int(u[d]+shift[d])-int(nover[d]), maxi0[d]);
+        }
+      }
+
+    void findParameters(double epsilon)
+      {
+      timers.push("parameter calculation");
+      auto idx = getAvailableKernels<T>(epsilon);
+      double mincost = 1e300;
+      constexpr double nref_fft=2048;
+      constexpr double costref_fft=0.0693;
+      kidx = KernelDB.size();
+      constexpr size_t vlen = native_simd<T>::size();
+      for (size_t i=0; i<idx.size(); ++i)
+        {
+        const auto &krn(KernelDB[idx[i]]);
+        auto lsupp = krn.W;
+        auto nvec = (lsupp+vlen-1)/vlen;
+        auto ofactor = krn.ofactor;
+        array<size_t,ndim> lnover;
+        double gridsize=1;
+        for (size_t d=0; d<ndim; ++d)
+          {
+          lnover[d] = max<size_t>(16,
+            2*good_size_complex(size_t(nuni[d]*ofactor*0.5)+1));
+          gridsize *= lnover[d];
+          }
+        double logterm = log(gridsize)/log(nref_fft*nref_fft);
+        double fftcost = gridsize/(nref_fft*nref_fft)*logterm*costref_fft;
+        double gridcost = 2.2e-10*npoints*(pow(lsupp,ndim-1)*nvec*vlen
+          + ((ndim*nvec+1)*(lsupp+3)*vlen));
+        double cost = fftcost+gridcost;
+        if (cost<mincost)
+          {
+          mincost=cost;
+          nover=lnover;
+          kidx = idx[i];
+          }
+        }
+      timers.pop();
+      }
+
+    void sortPoints()
+      {
+      timers.push("sorting points");
+      array<size_t,ndim> nt;
+      size_t nkeys=1;
+      for (size_t d=0; d<ndim; ++d)
+        {
+        nt[d] = ntiles<log2tile>(nover[d]);
+        nkeys *= nt[d];
+        }
+      coord_idx = bucket_sort<idx_t>(npoints, nkeys, nthreads,
+        [](size_t) { return size_t(1); },
+        [&](size_t i, size_t)
+          {
+          array<double,ndim> u;
+          array<int,ndim> i0;
+          getpix(i, u, i0);
+          size_t k=0;
+          for (size_t d=0; d<ndim; ++d)
+            k = k*nt[d] + tile_index<log2tile>(i0[d], int(nsafe));
+          return idx_t(k);
+          },
+        [](size_t i, size_t) { return idx_t(i); });
+      timers.pop();
+      }
+
+    /* Returns, for every index along dimension d of the uniform array, the
+       corresponding index on the oversampled grid and the correction
+       factor. */
+    void mode_tables(size_t d, bool fft_order, vector<size_t> &gidx,
+      vector<T> &fct) const
+      {
+      gidx = grid_indices(nuni[d], nover[d], fft_order);
+      auto cf = correction_factors(*krn, nuni[d], nover[d], fft_order,
+        nthreads);
+      fct.resize(nuni[d]);
+      for (size_t i=0; i<nuni[d]; ++i)
+        fct[i] = T(cf[i]);
+      }
+
+    /* FFT over the oversampled grid, skipping those parts which are known
+       to be zero (u2nu) or which are not needed (nu2u). */
+    void grid_fft(mav<complex<T>,ndim> &grid, bool forward, bool nu2u_order)
+      {
+      timers.push("FFT");
+      fmav<complex<T>> fgrid(grid);
+      // only the uniform part of the grid is nonzero before (u2nu) or needed
+      // after (nu2u) the transform
+      fmav_info::shape_t axes(ndim), eless(nuni.begin(), nuni.end()),
+        efull(nover.begin(), nover.end());
+      for (size_t i=0; i<ndim; ++i)
+        axes[i] = nu2u_order ? ndim-1-i : i;
+      if (nu2u_order)
+        {
+        reverse(eless.begin(), eless.end());
+        reverse(efull.begin(), efull.end());
+        c2c_pruned(fgrid, axes, efull, eless, forward, T(1), nthreads);
+        }
+      else
+        c2c_pruned(fgrid, axes, eless, efull, forward, T(1), nthreads);
+      timers.pop();
+      }
+
+    template<size_t SUPP> class HelperNu2u
+      {
+      public:
+        static constexpr size_t vlen = native_simd<T>::size();
+        static constexpr size_t nvec = (SUPP+vlen-1)/vlen;
+
+      private:
+        const Nufft &parent;
+        TemplateKernel<SUPP, T> tkrn;
+        SpreadingBuffer<T, T, ndim, SUPP, log2tile> tbuf;
+
+      public:
+        T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
+        union kbuf {
+          T scalar[ndim*nvec*vlen];
+          native_simd<T> simd[ndim*nvec];
+          };
+        kbuf buf;
+
+        HelperNu2u(const Nufft &parent_, mav<complex<T>,ndim> &grid_,
+          vector<mutex> &locks_)
+          : parent(parent_), tkrn(*parent.krn), tbuf(grid_, &locks_) {}
+
+        static constexpr int lineJump() { return decltype(tbuf)::lineJump(); }
+        static constexpr int planeJump() { return decltype(tbuf)::planeJump(); }
+
+        [[gnu::always_inline]] [[gnu::hot]] void prep(size_t ipt)
+          {
+          array<double,ndim> u;
+          array<int,ndim> i0;
+          parent.getpix(ipt, u, i0);
+          for (size_t d=0; d<ndim; ++d)
+            tkrn.eval1(T((i0[d]-u[d])*2+(SUPP-1)), &buf.simd[d*nvec]);
+          tbuf.prep(i0);
+          p0r = tbuf.p0r;
+          p0i = tbuf.p0i;
+          }
+      };
+
+    template<size_t SUPP> class HelperU2nu
+      {
+      public:
+        static constexpr size_t vlen = native_simd<T>::size();
+        static constexpr size_t nvec = (SUPP+vlen-1)/vlen;
+
+      private:
+        const Nufft &parent;
+        TemplateKernel<SUPP, T> tkrn;
+        InterpolationBuffer<T, T, ndim, SUPP, log2tile> tbuf;
+
+      public:
+        const T * DUCC0_RESTRICT p0r, * DUCC0_RESTRICT p0i;
+        union kbuf {
+          T scalar[ndim*nvec*vlen];
+          native_simd<T> simd[ndim*nvec];
+          };
+        kbuf buf;
+
+        HelperU2nu(const Nufft &parent_, const mav<complex<T>,ndim> &grid_)
+          : parent(parent_), tkrn(*parent.krn), tbuf(grid_) {}
+
+        static constexpr int lineJump() { return decltype(tbuf)::lineJump(); }
+        static constexpr int planeJump() { return decltype(tbuf)::planeJump(); }
+
+        [[gnu::always_inline]] [[gnu::hot]] void prep(size_t ipt)
+          {
+          array<double,ndim> u;
+          array<int,ndim> i0;
+          parent.getpix(ipt, u, i0);
+          for (size_t d=0; d<ndim; ++d)
+            tkrn.eval1(T((i0[d]-u[d])*2+(SUPP-1)), &buf.simd[d*nvec]);
+          tbuf.prep(i0);
+          p0r = tbuf.p0r;
+          p0i = tbuf.p0i;
+          }
+      };
+
+    template<size_t SUPP> [[gnu::hot]] void spreading_helper
+      (const mav<complex<T>,1> &points, mav<complex<T>,ndim> &grid)
+      {
+      using vtype = native_simd<T>;
+      constexpr size_t vlen=vtype::size();
+      constexpr size_t NVEC((SUPP+vlen-1)/vlen);
+
+      vector<mutex> locks((ndim==1) ? 1 : nover[0]);
+      execGuided(npoints, nthreads, 100, 0.2, [&](Scheduler &sched)
+        {
+        HelperNu2u<SUPP> hlp(*this, grid, locks);
+        constexpr int jump = hlp.lineJump();
+        constexpr int pjump = hlp.planeJump();
+        const T * DUCC0_RESTRICT ku = hlp.buf.scalar;
+        const T * DUCC0_RESTRICT kv = hlp.buf.scalar+NVEC*vlen;
+        const auto * DUCC0_RESTRICT kl = hlp.buf.simd+(ndim-1)*NVEC;
+
+        while (auto rng=sched.getNext()) for(auto ix=rng.lo; ix<rng.hi; ++ix)
+          {
+          auto ipt = coord_idx[ix];
+          hlp.prep(ipt);
+          auto * DUCC0_RESTRICT ptrr = hlp.p0r;
+          auto * DUCC0_RESTRICT ptri = hlp.p0i;
+          auto v(points(ipt));
+          vtype vr(v.real()), vi(v.imag());
+          if constexpr (ndim==1)
+            for (size_t cu=0; cu<NVEC; ++cu)
+              {
+              auto tr = vtype::loadu(ptrr+cu*vlen);
+              tr += vr*kl[cu];
+              tr.storeu(ptrr+cu*vlen);
+              auto ti = vtype::loadu(ptri+cu*vlen);
+              ti += vi*kl[cu];
+              ti.storeu(ptri+cu*vlen);
+              }
+          else if constexpr (ndim==2)
+            for (size_t cu=0; cu<SUPP; ++cu)
+              {
+              vtype tmpr=vr*ku[cu], tmpi=vi*ku[cu];
+              for (size_t cv=0; cv<NVEC; ++cv)
+                {
+                auto tr = vtype::loadu(ptrr+cv*vlen);
+                tr += tmpr*kl[cv];
+                tr.storeu(ptrr+cv*vlen);
+                auto ti = vtype::loadu(ptri+cv*vlen);
+                ti += tmpi*kl[cv];
+                ti.storeu(ptri+cv*vlen);
+                }
+              ptrr+=jump;
+              ptri+=jump;
+              }
+          else
+            for (size_t cu=0; cu<SUPP; ++cu)
+              {
+              auto * DUCC0_RESTRICT ptrr2 = ptrr;
+              auto * DUCC0_RESTRICT ptri2 = ptri;
+              for (size_t cv=0; cv<SUPP; ++cv)
+                {
+                vtype tmpr=vr*(ku[cu]*kv[cv]), tmpi=vi*(ku[cu]*kv[cv]);
+                for (size_t cw=0; cw<NVEC; ++cw)
+                  {
+                  auto tr = vtype::loadu(ptrr2+cw*vlen);
+                  tr += tmpr*kl[cw];
+                  tr.storeu(ptrr2+cw*vlen);
+                  auto ti = vtype::loadu(ptri2+cw*vlen);
+                  ti += tmpi*kl[cw];
+                  ti.storeu(ptri2+cw*vlen);
+                  }
+                ptrr2+=jump;
+                ptri2+=jump;
+                }
+              ptrr+=pjump;
+              ptri+=pjump;
+              }
+          }
+        });
+      }
+
+    template<size_t SUPP> [[gnu::hot]] void interpolation_helper
+      (const mav<complex<T>,ndim> &grid, mav<complex<T>,1> &points)
+      {
+      using vtype = native_simd<T>;
+      constexpr size_t vlen=vtype::size();
+      constexpr size_t NVEC((SUPP+vlen-1)/vlen);
+
+      execGuided(npoints, nthreads, 1000, 0.5, [&](Scheduler &sched)
+        {
+        HelperU2nu<SUPP> hlp(*this, grid);
+        constexpr int jump = hlp.lineJump();
+        constexpr int pjump = hlp.planeJump();
+        const T * DUCC0_RESTRICT ku = hlp.buf.scalar;
+        const T * DUCC0_RESTRICT kv = hlp.buf.scalar+NVEC*vlen;
+        const auto * DUCC0_RESTRICT kl = hlp.buf.simd+(ndim-1)*NVEC;
+
+        while (auto rng=sched.getNext()) for(auto ix=rng.lo; ix<rng.hi; ++ix)
+          {
+          auto ipt = coord_idx[ix];
+          hlp.prep(ipt);
+          vtype rr=0, ri=0;
+          const auto * DUCC0_RESTRICT ptrr = hlp.p0r;
+          const auto * DUCC0_RESTRICT ptri = hlp.p0i;
+          if constexpr (ndim==1)
+            for (size_t cu=0; cu<NVEC; ++cu)
+              {
+              rr += kl[cu]*vtype::loadu(ptrr+cu*vlen);
+              ri += kl[cu]*vtype::loadu(ptri+cu*vlen);
+              }
+          else if constexpr (ndim==2)
+            for (size_t cu=0; cu<SUPP; ++cu)
+              {
+              vtype tmpr(0), tmpi(0);
+              for (size_t cv=0; cv<NVEC; ++cv)
+                {
+                tmpr += kl[cv]*vtype::loadu(ptrr+cv*vlen);
+                tmpi += kl[cv]*vtype::loadu(ptri+cv*vlen);
+                }
+              rr += ku[cu]*tmpr;
+              ri += ku[cu]*tmpi;
+              ptrr += jump;
+              ptri += jump;
+              }
+          else
+            for (size_t cu=0; cu<SUPP; ++cu)
+              {
+              vtype tmpr2(0), tmpi2(0);
+              const auto * DUCC0_RESTRICT ptrr2 = ptrr;
+              const auto * DUCC0_RESTRICT ptri2 = ptri;
+              for (size_t cv=0; cv<SUPP; ++cv)
+                {
+                vtype tmpr(0), tmpi(0);
+                for (size_t cw=0; cw<NVEC; ++cw)
+                  {
+                  tmpr += kl[cw]*vtype::loadu(ptrr2+cw*vlen);
+                  tmpi += kl[cw]*vtype::loadu(ptri2+cw*vlen);
+                  }
+                tmpr2 += kv[cv]*tmpr;
+                tmpi2 += kv[cv]*tmpi;
+                ptrr2 += jump;
+                ptri2 += jump;
+                }
+              rr += ku[cu]*tmpr2;
+              ri += ku[cu]*tmpi2;
+              ptrr += pjump;
+              ptri += pjump;
+              }
+          points.v(ipt) = complex<T>(reduce(rr, std::plus<>()), reduce(ri, std::plus<>()));
+          }
+        });
+      }
+
+    void spreading(const mav<complex<T>,1> &points, mav<complex<T>,ndim> &grid)
+      {
+      timers.push("spreading");
+      if constexpr (is_same<T, float>::value)
+        switch(supp)
+          {
+          case  4: spreading_helper< 4>(points, grid); break;
+          case  5: spreading_helper< 5>(points, grid); break;
+          case  6: spreading_helper< 6>(points, grid); break;
+          case  7: spreading_helper< 7>(points, grid); break;
+          case  8: spreading_helper< 8>(points, grid); break;
+          default: MR_fail("must not happen");
+          }
+      else
+        switch(supp)
+          {
+          case  4: spreading_helper< 4>(points, grid); break;
+          case  5: spreading_helper< 5>(points, grid); break;
+          case  6: spreading_helper< 6>(points, grid); break;
+          case  7: spreading_helper< 7>(points, grid); break;
+          case  8: spreading_helper< 8>(points, grid); break;
+          case  9: spreading_helper< 9>(points, grid); break;
+          case 10: spreading_helper<10>(points, grid); break;
+          case 11: spreading_helper<11>(points, grid); break;
+          case 12: spreading_helper<12>(points, grid); break;
+          case 13: spreading_helper<13>(points, grid); break;
+          case 14: spreading_helper<14>(points, grid); break;
+          case 15: spreading_helper<15>(points, grid); break;
+          case 16: spreading_helper<16>(points, grid); break;
+          default: MR_fail("must not happen");
+          }
+      timers.pop();
+      }
+
+    void interpolation(const mav<complex<T>,ndim> &grid, mav<complex<T>,1> &points)
+      {
+      timers.push("interpolation");
+      if constexpr (is_same<T, float>::value)
+        switch(supp)
+          {
+          case  4: interpolation_helper< 4>(grid, points); break;
+          case  5: interpolation_helper< 5>(grid, points); break;
+          case  6: interpolation_helper< 6>(grid, points); break;
+          case  7: interpolation_helper< 7>(grid, points); break;
+          case  8: interpolation_helper< 8>(grid, points); break;
+          default: MR_fail("must not happen");
+          }
+      else
+        switch(supp)
+          {
+          case  4: interpolation_helper< 4>(grid, points); break;
+          case  5: interpolation_helper< 5>(grid, points); break;
+          case  6: interpolation_helper< 6>(grid, points); break;
+          case  7: interpolation_helper< 7>(grid, points); break;
+          case  8: interpolation_helper< 8>(grid, points); break;
+          case  9: interpolation_helper< 9>(grid, points); break;
+          case 10: interpolation_helper<10>(grid, points); break;
+          case 11: interpolation_helper<11>(grid, points); break;
+          case 12: interpolation_helper<12>(grid, points); break;
+          case 13: interpolation_helper<13>(grid, points); break;
+          case 14: interpolation_helper<14>(grid, points); break;
+          case 15: interpolation_helper<15>(grid, points); break;
+          case 16: interpolation_helper<16>(grid, points); break;
+          default: MR_fail("must not happen");
+          }
+      timers.pop();
+      }
+
+    /* Copies between the uniform array and the oversampled grid, applying
+       the kernel correction on the way. */
+    void uniform2grid(const mav<complex<T>,ndim> &uniform,
+      mav<complex<T>,ndim> &grid, bool fft_order)
+      {
+      timers.push("grid correction");
+      array<vector<size_t>,ndim> gidx;
+      array<vector<T>,ndim> fct;
+      for (size_t d=0; d<ndim; ++d)
+        mode_tables(d, fft_order, gidx[d], fct[d]);
+      execStatic(nuni[0], nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          auto i2 = gidx[0][i];
+          auto f0 = fct[0][i];
+          if constexpr (ndim==1)
+            grid.v(i2) = uniform(i)*f0;
+          else if constexpr (ndim==2)
+            for (size_t j=0; j<nuni[1]; ++j)
+              grid.v(i2,gidx[1][j]) = uniform(i,j)*(f0*fct[1][j]);
+          else
+            for (size_t j=0; j<nuni[1]; ++j)
+              {
+              auto j2 = gidx[1][j];
+              auto f1 = f0*fct[1][j];
+              for (size_t k=0; k<nuni[2]; ++k)
+                grid.v(i2,j2,gidx[2][k]) = uniform(i,j,k)*(f1*fct[2][k]);
+              }
+          }
+        });
+      timers.pop();
+      }
+    void grid2uniform(const mav<complex<T>,ndim> &grid,
+      mav<complex<T>,ndim> &uniform, bool fft_order)
+      {
+      timers.push("grid correction");
+      array<vector<size_t>,ndim> gidx;
+      array<vector<T>,ndim> fct;
+      for (size_t d=0; d<ndim; ++d)
+        mode_tables(d, fft_order, gidx[d], fct[d]);
+      execStatic(nuni[0], nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          auto i2 = gidx[0][i];
+          auto f0 = fct[0][i];
+          if constexpr (ndim==1)
+            uniform.v(i) = grid(i2)*f0;
+          else if constexpr (ndim==2)
+            for (size_t j=0; j<nuni[1]; ++j)
+              uniform.v(i,j) = grid(i2,gidx[1][j])*(f0*fct[1][j]);
+          else
+            for (size_t j=0; j<nuni[1]; ++j)
+              {
+              auto j2 = gidx[1][j];
+              auto f1 = f0*fct[1][j];
+              for (size_t k=0; k<nuni[2]; ++k)
+                uniform.v(i,j,k) = grid(i2,j2,gidx[2][k])*(f1*fct[2][k]);
+              }
+          }
+        });
+      timers.pop();
+      }
+
+    void init()
+      {
+      krn = selectKernel<T>(kidx);
+      supp = krn->support();
+      nsafe = (supp+1)/2;
+      for (size_t d=0; d<ndim; ++d)
+        {
+        MR_assert(nover[d]>=2*nsafe, "oversampled grid too small");
+        shift[d] = supp*(-0.5)+1+nover[d];
+        maxi0[d] = int(nover[d]+nsafe)-int(supp);
+        }
+      sortPoints();
+      }
+
+    /* Sets up spreading of the points onto an oversampled grid of shape
+       \a grid_shape with kernel \a kidx_ (used by Nufft3, which has no
+       uniform array). */
+    Nufft(const mav<double,2> &coords_, const array<size_t,ndim> &grid_shape,
+      size_t kidx_, size_t nthreads_)
+      : timers("nufft"), coords(coords_), npoints(coords.shape(0)),
+        nuni(grid_shape), nover(grid_shape), nthreads(nthreads_),
+        verbosity(0), kidx(kidx_)
+      {
+      MR_assert(coords.shape(1)==ndim, "dimensionality mismatch");
+      MR_assert(npoints<=(~idx_t(0)), "too many nonuniform points");
+      init();
+      }
+
+    void report()
+      {
+      if (verbosity==0) return;
+      cout << "NUFFT: " << npoints << " points, uniform grid";
+      for (auto n: nuni) cout << " " << n;
+      cout << ", oversampled grid";
+      for (auto n: nover) cout << " " << n;
+      cout << ", kernel support " << supp << endl;
+      timers.report(cout);
+      }
+
+  public:
+    /*! Sets up the transforms between the non-uniform points with
+        coordinates \a coords_ (shape (npoints, ndim)) and a uniform array
+        of shape \a uniform_shape. The requested \a epsilon is the relative
+        L2 accuracy of the result. */
+    Nufft(const mav<double,2> &coords_, const array<size_t,ndim> &uniform_shape,
+      double epsilon, size_t nthreads_, size_t verbosity_=0)
+      : timers("nufft"), coords(coords_), npoints(coords.shape(0)),
+        nuni(uniform_shape),
+        nthreads((nthreads_==0) ? get_default_nthreads() : nthreads_),
+        verbosity(verbosity_)
+      {
+      MR_assert(coords.shape(1)==ndim, "dimensionality mismatch");
+      MR_assert(npoints<=(~idx_t(0)), "too many nonuniform points");
+      MR_assert(epsilon>0, "epsilon must be positive");
+      for (auto n: nuni)
+        MR_assert(n>0, "uniform array must not be empty");
+      // adjust for increased error when gridding in more than 1 dimension
+      findParameters(epsilon/ndim);
+      init();
+      }
+
+    const array<size_t,ndim> &uniform_shape() const { return nuni; }
+    const array<size_t,ndim> &oversampled_shape() const { return nover; }
+    size_t support() const { return supp; }
+
+    /*! Type 1 transform: non-uniform points -> uniform array. */
+    void nu2u(bool forward, const mav<complex<T>,1> &points,
+      mav<complex<T>,ndim> &uniform, bool fft_order=false)
+      {
+      MR_assert(points.shape(0)==npoints, "number of points mismatch");
+      MR_assert(uniform.shape()==nuni, "uniform array shape mismatch");
+      timers.push("allocating grid");
+      mav<complex<T>,ndim> grid(nover);
+      timers.pop();
+      spreading(points, grid);
+      grid_fft(grid, forward, true);
+      grid2uniform(grid, uniform, fft_order);
+      report();
+      }
+
+    /*! Type 2 transform: uniform array -> non-uniform points. */
+    void u2nu(bool forward, const mav<complex<T>,ndim> &uniform,
+      mav<complex<T>,1> &points, bool fft_order=false)
+      {
+      MR_assert(points.shape(0)==npoints, "number of points mismatch");
+      MR_assert(uniform.shape()==nuni, "uniform array shape mismatch");
+      timers.push("allocating grid");
+      mav<complex<T>,ndim> grid(nover);
+      timers.pop();
+      uniform2grid(uniform, grid, fft_order);
+      grid_fft(grid, forward, false);
+      interpolation(grid, points);
+      report();
+      }
+  };
+
+/*! Non-uniform FFT of type 3 in 1 to 3 dimensions.
+
+    Type 3 ("nu2nu"):  out[k] = sum_j points[j] * exp(-+i freq[k].coord[j])
+    where the negative sign is used for forward transforms. Coordinates and
+    frequencies are arbitrary real numbers; there is no periodicity.
+
+    Both sets are first centered around zero, which only costs a phase factor
+    per point and per frequency. The points are then spread with an ES kernel
+    onto a grid whose spacing h is chosen such that all freq*h fall into the
+    band which the kernel's oversampling factor allows, and a type 2 transform
+    of that grid evaluates the sums at the rescaled frequencies freq*h. The
+    kernel correction is finally applied at the individual frequencies. */
+template<typename T, size_t ndim> class Nufft3
+  {
+  private:
+    size_t npoints, nfreq;
+    size_t nthreads;
+    size_t verbosity;
+    array<size_t,ndim> ngrid;
+    unique_ptr<Nufft<T,ndim>> spreader, interpolator;
+    // phase factors (for the positive sign) from shifting the coordinates
+    // and the frequencies
+    vector<complex<T>> prephase, postphase;
+    vector<T> corr;
+
+  public:
+    /*! Sets up the transform between the \a coords (shape (npoints, ndim))
+        and the frequencies \a freqs (shape (nfreq, ndim)). The requested
+        \a epsilon is the relative L2 accuracy of the result. */
+    Nufft3(const mav<double,2> &coords, const mav<double,2> &freqs,
+      double epsilon, size_t nthreads_, size_t verbosity_=0)
+      : npoints(coords.shape(0)), nfreq(freqs.shape(0)),
+        nthreads((nthreads_==0) ? get_default_nthreads() : nthreads_),
+        verbosity(verbosity_), prephase(npoints), postphase(nfreq),
+        corr(nfreq, T(1))
+      {
+      MR_assert((coords.shape(1)==ndim) && (freqs.shape(1)==ndim),
+        "dimensionality mismatch");
+      MR_assert(epsilon>0, "epsilon must be positive");
+      // half of the error budget each for the spreading and the type 2 step
+      auto kidx = findKernel<T>(2., 0.5*epsilon/ndim);
+      MR_assert(kidx<KernelDB.size(), "requested epsilon too small");
+      const auto &kp(KernelDB[kidx]);
+
+      array<double,ndim> xcen, scen, h;
+      for (size_t d=0; d<ndim; ++d)
+        {
+        double xmin=0, xmax=0, smin=0, smax=0;
+        if (npoints>0)
+          {
+          xmin=xmax=coords(0,d);
+          for (size_t i=1; i<npoints; ++i)
+            {
+            xmin = min(xmin, coords(i,d));
+            xmax = max(xmax, coords(i,d));
+            }
+          }
+        if (nfreq>0)
+          {
+          smin=smax=freqs(0,d);
+          for (size_t i=1; i<nfreq; ++i)
+            {
+            smin = min(smin, freqs(i,d));
+            smax = max(smax, freqs(i,d));
+            }
+          }
+        xcen[d] = 0.5*(xmin+xmax);
+        scen[d] = 0.5*(smin+smax);
+        double xhw = 0.5*(xmax-xmin), shw = 0.5*(smax-smin);
+        // the kernel handles |freq*h| up to pi/ofactor; for a single
+        // frequency any h works, so make the grid small
+        h[d] = (shw>0) ? pi/(kp.ofactor*shw) : max(xhw, 1.);
+        // leave room for the kernel support, so that no point is wrapped
+        // around
+        ngrid[d] = 2*good_size_complex(size_t(xhw/h[d]+0.5*kp.W)+2);
+        }
+
+      mav<double,2> gcoords({npoints,ndim}), fcoords({nfreq,ndim});
+      execStatic(npoints, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          double phase=0;
+          for (size_t d=0; d<ndim; ++d)
+            {
+            double x = coords(i,d)-xcen[d];
+            phase += scen[d]*x;
+            gcoords.v(i,d) = twopi*(x/h[d]+0.5*ngrid[d])/ngrid[d];
+            }
+          prephase[i] = complex<T>(polar(1., phase));
+          }
+        });
+      execStatic(nfreq, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          double phase=0;
+          for (size_t d=0; d<ndim; ++d)
+            {
+            phase += freqs(i,d)*xcen[d];
+            fcoords.v(i,d) = (freqs(i,d)-scen[d])*h[d];
+            }
+          postphase[i] = complex<T>(polar(1., phase));
+          }
+        });
+      spreader.reset(new Nufft<T,ndim>(gcoords, ngrid, kidx, nthreads));
+      interpolator = make_unique<Nufft<T,ndim>>(fcoords, ngrid, 0.5*epsilon,
+        nthreads, verbosity);
+      execStatic(nfreq, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          {
+          double fct=1;
+          for (size_t d=0; d<ndim; ++d)
+            fct *= spreader->krn->corfunc(abs(fcoords(i,d))*inv_twopi);
+          corr[i] = T(fct);
+          }
+        });
+      }
+
+    const array<size_t,ndim> &grid_shape() const { return ngrid; }
+
+    /*! Type 3 transform: non-uniform points -> non-uniform frequencies. */
+    void nu2nu(bool forward, const mav<complex<T>,1> &points,
+      mav<complex<T>,1> &out)
+      {
+      MR_assert(points.shape(0)==npoints, "number of points mismatch");
+      MR_assert(out.shape(0)==nfreq, "number of frequencies mismatch");
+      mav<complex<T>,1> points2({npoints});
+      execStatic(npoints, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          points2.v(i) = points(i)
+            *(forward ? conj(prephase[i]) : prephase[i]);
+        });
+      mav<complex<T>,ndim> grid(ngrid);
+      spreader->spreading(points2, grid);
+      interpolator->u2nu(forward, grid, out, false);
+      execStatic(nfreq, nthreads, 0, [&](Scheduler &sched)
+        {
+        while (auto rng=sched.getNext()) for(auto i=rng.lo; i<rng.hi; ++i)
+          out.v(i) *= corr[i]
+            *(forward ? conj(postphase[i]) : postphase[i]);
+        });
+      }
+  };
+
+template<typename T, size_t ndim> void nu2u(const mav<double,2> &coords,
+  const mav<complex<T>,1> &points, bool forward, double epsilon,
+  size_t nthreads, mav<complex<T>,ndim> &uniform, size_t verbosity=0,
+  bool fft_order=false)
+  {
+  Nufft<T,ndim> plan(coords, uniform.shape(), epsilon, nthreads, verbosity);
+  plan.nu2u(forward, points, uniform, fft_order);
+  }
+
+template<typename T, size_t ndim> void u2nu(const mav<double,2> &coords,
+  const mav<complex<T>,ndim> &uniform, bool forward, double epsilon,
+  size_t nthreads, mav<complex<T>,1> &points, size_t verbosity=0,
+  bool fft_order=false)
+  {
+  Nufft<T,ndim> plan(coords, uniform.shape(), epsilon, nthreads, verbosity);
+  plan.u2nu(forward, uniform, points, fft_order);
+  }
+
+template<typename T, size_t ndim> void nu2nu(const mav<double,2> &coords,
+  const mav<complex<T>,1> &points, const mav<double,2> &freqs, bool forward,
+  double epsilon, size_t nthreads, mav<complex<T>,1> &out, size_t verbosity=0)
+  {
+  Nufft3<T,ndim> plan(coords, freqs, epsilon, nthreads, verbosity);
+  plan.nu2nu(forward, points, out);
+  }
+
+}
+
+using detail_nufft::Nufft;
+using detail_nufft::Nufft3;
+using detail_nufft::nu2u;
+using detail_nufft::u2nu;
+using detail_nufft::nu2nu;
+
+}
+
+#endif
@@ -29,8 +29,14 @@
 #include <algorithm>
 #include <atomic>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 #include "ducc0/math/math_utils.h"
-#include "ducc0/math/fft1d.h"
+#include "ducc0/math/fft.h"
 #include "ducc0/sharp/sharp_internal.h"
 #include "ducc0/sharp/sharp_almhelpers.h"
 #include "ducc0/sharp/sharp_geomhelpers.h"
@@ -50,20 +56,60 @@ using fcmplx = complex<float>;
 
 static size_t chunksize_min=500, nchunks_max=10;
 
-static void get_chunk_info (size_t ndata, size_t nmult, size_t &nchunks, size_t &chunksize)
+static void get_chunk_info (size_t ndata, size_t nmult,
+  const sharp_chunking &par, size_t &nchunks, size_t &chunksize)
   {
-  chunksize = (ndata+nchunks_max-1)/nchunks_max;
-  if (chunksize>=chunksize_min) // use max number of chunks
+  if (ndata==0) { nchunks=0; chunksize=1; return; }
+  chunksize = (ndata+par.nchunks_max-1)/par.nchunks_max;
+  if (chunksize>=par.chunksize_min) // use max number of chunks
     chunksize = ((chunksize+nmult-1)/nmult)*nmult;
   else // need to adjust chunksize and nchunks
     {
-    nchunks = (ndata+chunksize_min-1)/chunksize_min;
+    nchunks = (ndata+par.chunksize_min-1)/par.chunksize_min;
     chunksize = (ndata+nchunks-1)/nchunks;
     if (nchunks>1)
       chunksize = ((chunksize+nmult-1)/nmult)*nmult;
     }
   nchunks = (ndata+chunksize-1)/chunksize;
   }
+void get_chunk_info (size_t ndata, size_t nmult, size_t &nchunks, size_t &chunksize)
+  { get_chunk_info(ndata, nmult, {chunksize_min, nchunks_max}, nchunks, chunksize); }
+
+/* Wisdom: tuned chunking parameters, keyed by a description of the geometry,
+   the a_lm set, the spin and the number of threads. */
+static mutex wisdom_mutex;
+static map<string, sharp_chunking> wisdom;
+static bool autotune=false;
+
+static string wisdom_key (const sharp_geom_info &ginfo,
+  const sharp_alm_info &ainfo, size_t spin, int nthreads)
+  {
+  // FNV-1a hash over the ring and m descriptions
+  uint64_t hash=0xcbf29ce484222325ull;
+  auto add = [&hash](uint64_t v)
+    {
+    for (size_t i=0; i<8; ++i, v>>=8)
+      hash = (hash^(v&0xff))*0x100000001b3ull;
+    };
+  for (size_t i=0; i<ginfo.nrings(); ++i)
+    {
+    double th=ginfo.theta(i);
+    uint64_t thbits;
+    memcpy(&thbits, &th, sizeof(thbits));
+    add(ginfo.nph(i));
+    add(thbits);
+    }
+  for (size_t mi=0; mi<ainfo.nm(); ++mi)
+    add(ainfo.mval(mi));
+  ostringstream res;
+  res << "s" << spin << "_l" << ainfo.lmax() << "_nm" << ainfo.nm()
+      << "_r" << ginfo.nrings() << "_p" << ginfo.nphmax() << "_t" << nthreads
+      << "_" << hex << hash;
+  return res.str();
+  }
+
+static sharp_chunking select_chunking (const sharp_geom_info &ginfo,
+  const sharp_alm_info &ainfo, size_t spin, int nthreads);
 
 DUCC0_NOINLINE size_t sharp_get_mlim (size_t lmax, size_t spin, double sth, double cth)
   {
@@ -79,16 +125,89 @@ DUCC0_NOINLINE size_t sharp_get_mlim (size_t lmax, size_t spin, double sth, doub
   return size_t(res+0.5);
   }
 
+size_t sharp_geom_info::mlim(size_t iring, size_t lmax, size_t spin) const
+  { return sharp_get_mlim(lmax, spin, sth(iring), cth(iring)); }
+
+class sharp_plan_impl
+  {
+  public:
+    struct chunk
+      {
+      size_t llim, ulim;
+      vector<bool> ispair;
+      vector<size_t> mlim;
+      vector<double> cth, sth;
+      };
+
+    const sharp_geom_info &ginfo;
+    const sharp_alm_info &ainfo;
+    size_t spin;
+    size_t chunksize;
+    vector<chunk> chunks;
+    sharp_Ylmgen gen; // prototype, copied by every worker thread
+    vector<double> norm, d1norm;
+    // one entry per ring; the plans come from the process-wide cache, so that
+    // rings of equal length (and other users of that length) share one plan
+    vector<shared_ptr<pocketfft_r<double>>> ringplan;
+
+    sharp_plan_impl(const sharp_geom_info &geom_info,
+      const sharp_alm_info &alm_info, size_t spin_,
+      const sharp_chunking &chunking)
+      : ginfo(geom_info), ainfo(alm_info), spin(spin_),
+        gen(ainfo.lmax(), ainfo.mmax(), spin),
+        norm(sharp_Ylmgen::get_norm(ainfo.lmax(), spin))
+      {
+      size_t lmax = ainfo.lmax();
+      if (spin==1) d1norm = sharp_Ylmgen::get_d1norm(lmax);
+
+      size_t nchunks;
+      get_chunk_info(ginfo.npairs(),sharp_veclen()*sharp_max_nvec(spin),
+                     chunking,nchunks,chunksize);
+      chunks.resize(nchunks);
+      for (size_t ic=0; ic<nchunks; ++ic)
+        {
+        auto &c(chunks[ic]);
+        c.llim=ic*chunksize;
+        c.ulim=min(c.llim+chunksize,ginfo.npairs());
+        size_t n=c.ulim-c.llim;
+        c.ispair.resize(n); c.mlim.resize(n); c.cth.resize(n); c.sth.resize(n);
+        for (size_t i=0; i<n; ++i)
+          {
+          c.ispair[i] = ginfo.pair(i+c.llim).r2!=~size_t(0);
+          c.cth[i] = ginfo.cth(ginfo.pair(i+c.llim).r1);
+          c.sth[i] = ginfo.sth(ginfo.pair(i+c.llim).r1);
+          c.mlim[i] = ginfo.mlim(ginfo.pair(i+c.llim).r1, lmax, spin);
+          }
+        }
+
+      ringplan.resize(ginfo.nrings());
+      map<size_t, shared_ptr<pocketfft_r<double>>> tmp;
+      for (size_t i=0; i<ginfo.nrings(); ++i)
+        {
+        auto &p(tmp[ginfo.nph(i)]);
+        if (!p) p = get_plan<pocketfft_r<double>>(ginfo.nph(i));
+        ringplan[i] = p;
+        }
+      }
+    /* uses tuned chunking parameters if available */
+    sharp_plan_impl(const sharp_geom_info &geom_info,
+      const sharp_alm_info &alm_info, size_t spin_, int nthreads)
+      : sharp_plan_impl(geom_info, alm_info, spin_,
+          select_chunking(geom_info, alm_info, spin_, nthreads)) {}
+  };
+
+/* Per-thread helper for the ring FFTs. The FFT plans are shared by all rings
+   of equal length (sharp_plan_impl::ringplan); the phase shifts exp(i*m*phi0)
+   are kept for the last phi0 encountered, which covers both rings of a pair
+   and synthesis as well as analysis (the latter uses the conjugate values). */
 struct ringhelper
   {
   double phi0_;
-  vector<dcmplx> shiftarr;
+  vector<dcmplx> shiftarr, shift_lo, shift_hi;
   size_t s_shift;
-  unique_ptr<pocketfft_r<double>> plan;
-  size_t length;
   bool norot;
-  ringhelper() : length(0) {}
-  void update(size_t nph, size_t mmax, double phi0)
+  ringhelper() : s_shift(0) {}
+  void update(size_t mmax, double phi0)
     {
     norot = (abs(phi0)<1e-14);
     if (!norot)
@@ -97,24 +216,27 @@ struct ringhelper
       shiftarr.resize(mmax+1);
       s_shift = mmax+1;
       phi0_ = phi0;
-// FIXME: improve this by using sincos2pibyn(nph) etc.
-      for (size_t m=0; m<=mmax; ++m)
-        shiftarr[m] = dcmplx(cos(m*phi0),sin(m*phi0));
-//      double *tmp=(double *) self->shiftarr;
-//      sincos_multi (mmax+1, phi0, &tmp[1], &tmp[0], 2);
-      }
-    if (nph!=length)
-      {
-      plan.reset(new pocketfft_r<double>(nph));
-      length=nph;
+      // exp(i*m*phi0) = exp(i*mhi*nlo*phi0) * exp(i*mlo*phi0) with
+      // m = mhi*nlo + mlo: O(sqrt(mmax)) trigonometric function calls instead
+      // of O(mmax), at the accuracy of a single complex multiplication
+      size_t nlo = size_t(sqrt(double(mmax+1)))+1, nhi = mmax/nlo+1;
+      shift_lo.resize(nlo);
+      shift_hi.resize(nhi);
+      for (size_t m=0; m<nlo; ++m)
+        shift_lo[m] = dcmplx(cos(m*phi0),sin(m*phi0));
+      for (size_t m=0; m<nhi; ++m)
+        shift_hi[m] = dcmplx(cos(double(m*nlo)*phi0),sin(double(m*nlo)*phi0));
+      for (size_t mh=0, m=0; mh<nhi; ++mh)
+        for (size_t ml=0; (ml<nlo)&&(m<=mmax); ++ml, ++m)
+          shiftarr[m] = shift_hi[mh]*shift_lo[ml];
       }
     }
-  DUCC0_NOINLINE void phase2ring (const sharp_geom_info &info, size_t iring,
+  DUCC0_NOINLINE void phase2ring (const sharp_plan_impl &plan, size_t iring,
     double *data, size_t mmax, const dcmplx *phase, size_t pstride)
     {
-    size_t nph = info.nph(iring);
+    size_t nph = plan.ginfo.nph(iring);
 
-    update (nph, mmax, info.phi0(iring));
+    update (mmax, plan.ginfo.phi0(iring));
 
     if (nph>=2*mmax+1)
       {
@@ -159,16 +281,16 @@ struct ringhelper
         }
       }
     data[1]=data[0];
-    plan->exec(&(data[1]), 1., false);
+    plan.ringplan[iring]->exec(&(data[1]), 1., false);
     }
-  DUCC0_NOINLINE void ring2phase (const sharp_geom_info &info, size_t iring,
+  DUCC0_NOINLINE void ring2phase (const sharp_plan_impl &plan, size_t iring,
     double *data, size_t mmax, dcmplx *phase, size_t pstride)
     {
-    size_t nph = info.nph(iring);
+    size_t nph = plan.ginfo.nph(iring);
 
-    update (nph, mmax, -info.phi0(iring));
+    update (mmax, plan.ginfo.phi0(iring));
 
-    plan->exec (&(data[1]), 1., true);
+    plan.ringplan[iring]->exec (&(data[1]), 1., true);
     data[0]=data[1];
     data[1]=data[nph+1]=0.;
 
@@ -180,7 +302,7 @@ struct ringhelper
       else
         for (size_t m=0; m<=mmax; ++m)
           phase[m*pstride] =
-            dcmplx(data[2*m], data[2*m+1]) * shiftarr[m];
+            dcmplx(data[2*m], data[2*m+1]) * conj(shiftarr[m]);
       }
     else
       {
@@ -193,7 +315,7 @@ struct ringhelper
         else
           val = dcmplx(data[2*(nph-idx)], -data[2*(nph-idx)+1]);
         if (!norot)
-          val *= shiftarr[m];
+          val *= conj(shiftarr[m]);
         phase[m*pstride]=val;
         }
       }
@@ -285,6 +407,16 @@ DUCC0_NOINLINE void sharp_job::ringtmp2ring (size_t iring,
 DUCC0_NOINLINE void sharp_job::ring2ringtmp (size_t iring,
   vector<double> &ringtmp, size_t rstride)
   {
+  if (ringbuf)
+    {
+    size_t nph=ginfo.nph(iring);
+    double wgt = (flags&SHARP_USE_WEIGHTS) ? ginfo.weight(iring) : 1.;
+    const double *src = ringbuf+ringofs[iring];
+    for (size_t i=0; i<nmaps(); ++i, src+=nph)
+      for (size_t j=0; j<nph; ++j)
+        ringtmp[i*rstride+1+j] = src[j]*wgt;
+    return;
+    }
   for (size_t i=0; i<nmaps(); ++i)
     ginfo.get_ring(flags&SHARP_USE_WEIGHTS, iring, map[i], &ringtmp[i*rstride+1]);
   }
@@ -293,6 +425,7 @@ DUCC0_NOINLINE void sharp_job::ring2ringtmp (size_t iring,
 DUCC0_NOINLINE void sharp_job::map2phase (size_t mmax, size_t llim, size_t ulim)
   {
   if (type != SHARP_MAP2ALM) return;
+  TraceScope trace("sharp map2phase");
   size_t pstride = s_m;
   ducc0::execDynamic(ulim-llim, nthreads, 1, [&](ducc0::Scheduler &sched)
     {
@@ -305,13 +438,13 @@ DUCC0_NOINLINE void sharp_job::map2phase (size_t mmax, size_t llim, size_t ulim)
       size_t dim2 = s_th*(ith-llim);
       ring2ringtmp(ginfo.pair(ith).r1,ringtmp,rstride);
       for (size_t i=0; i<nmaps(); ++i)
-        helper.ring2phase (ginfo, ginfo.pair(ith).r1,
+        helper.ring2phase (plan, ginfo.pair(ith).r1,
           &ringtmp[i*rstride],mmax,&phase[dim2+2*i],pstride);
       if (ginfo.pair(ith).r2!=~size_t(0))
         {
         ring2ringtmp(ginfo.pair(ith).r2,ringtmp,rstride);
         for (size_t i=0; i<nmaps(); ++i)
-          helper.ring2phase (ginfo, ginfo.pair(ith).r2,
+          helper.ring2phase (plan, ginfo.pair(ith).r2,
             &ringtmp[i*rstride],mmax,&phase[dim2+2*i+1],pstride);
         }
       }
@@ -321,6 +454,7 @@ DUCC0_NOINLINE void sharp_job::map2phase (size_t mmax, size_t llim, size_t ulim)
 DUCC0_NOINLINE void sharp_job::phase2map (size_t mmax, size_t llim, size_t ulim)
   {
   if (type == SHARP_MAP2ALM) return;
+  TraceScope trace("sharp phase2map");
   size_t pstride = s_m;
   ducc0::execDynamic(ulim-llim, nthreads, 1, [&](ducc0::Scheduler &sched)
     {
@@ -332,13 +466,13 @@ DUCC0_NOINLINE void sharp_job::phase2map (size_t mmax, size_t llim, size_t ulim)
       {
       size_t dim2 = s_th*(ith-llim);
       for (size_t i=0; i<nmaps(); ++i)
-        helper.phase2ring (ginfo, ginfo.pair(ith).r1,
+        helper.phase2ring (plan, ginfo.pair(ith).r1,
           &ringtmp[i*rstride],mmax,&phase[dim2+2*i],pstride);
       ringtmp2ring(ginfo.pair(ith).r1,ringtmp,rstride);
       if (ginfo.pair(ith).r2!=~size_t(0))
         {
         for (size_t i=0; i<nmaps(); ++i)
-          helper.phase2ring (ginfo, ginfo.pair(ith).r2,
+          helper.phase2ring (plan, ginfo.pair(ith).r2,
             &ringtmp[i*rstride],mmax,&phase[dim2+2*i+1],pstride);
         ringtmp2ring(ginfo.pair(ith).r2,ringtmp,rstride);
         }
@@ -346,90 +480,276 @@ DUCC0_NOINLINE void sharp_job::phase2map (size_t mmax, size_t llim, size_t ulim)
     }); /* end of parallel region */
   }
 
+/* Fused phase2map() of this (synthesis) job and map2phase() of the adjoint
+   job adj: every ring is transformed to pixel space, multiplied with the
+   weight map and transformed back, without leaving the thread's buffer. */
+DUCC0_NOINLINE void sharp_job::phase2map2phase (sharp_job &adj,
+  const any &weight, size_t mmax, size_t llim, size_t ulim)
+  {
+  TraceScope trace("sharp phase2map2phase");
+  ducc0::execDynamic(ulim-llim, nthreads, 1, [&](ducc0::Scheduler &sched)
+    {
+    ringhelper helper;
+    size_t rstride=ginfo.nphmax()+2;
+    vector<double> ringtmp(nmaps()*rstride), wgt(ginfo.nphmax());
+
+    while (auto rng=sched.getNext()) for(auto ith=rng.lo+llim; ith<rng.hi+llim; ++ith)
+      {
+      size_t dim2 = s_th*(ith-llim), adim2 = adj.s_th*(ith-llim);
+      for (size_t j=0; j<2; ++j)
+        {
+        size_t iring = (j==0) ? ginfo.pair(ith).r1 : ginfo.pair(ith).r2;
+        if (iring==~size_t(0)) continue;
+        size_t nph=ginfo.nph(iring);
+        ginfo.get_ring(false, iring, weight, wgt.data());
+        for (size_t i=0; i<nmaps(); ++i)
+          {
+          double *ring = &ringtmp[i*rstride];
+          helper.phase2ring (plan, iring, ring, mmax, &phase[dim2+2*i+j], s_m);
+          for (size_t k=0; k<nph; ++k)
+            ring[k+1] *= wgt[k];
+          helper.ring2phase (plan, iring, ring, mmax, &adj.phase[adim2+2*i+j],
+            adj.s_m);
+          }
+        }
+      }
+    }); /* end of parallel region */
+  }
+
+DUCC0_NOINLINE uint64_t sharp_job::legendre_pass (const vector<bool> &ispair,
+  const vector<double> &cth, const vector<double> &sth,
+  const vector<size_t> &mlim, size_t llim, size_t ulim)
+  {
+  TraceScope trace("sharp legendre_pass");
+  size_t lmax = ainfo.lmax();
+  std::atomic<uint64_t> a_opcnt(0);
+  ducc0::execDynamic(ainfo.nm(), nthreads, 1, [&](ducc0::Scheduler &sched)
+    {
+    sharp_job ljob = *this;
+    ljob.opcnt=0;
+    sharp_Ylmgen generator(plan.gen);
+    vector<dcmplx> almbuffer;
+    ljob.alloc_almtmp(lmax,almbuffer);
+    // The spin>0 kernels only handle a single transform; for batches they
+    // are called once per transform on a view with its own a_lm buffer.
+    bool split = (ntrans>1) && (spin>0);
+    sharp_job tjob = ljob;
+    vector<dcmplx> talmbuffer;
+    if (split)
+      {
+      tjob.ntrans=1;
+      tjob.alloc_almtmp(lmax,talmbuffer);
+      }
+    size_t nca=ncomp_alm(), nalm_=nalm();
+
+    while (auto rng=sched.getNext()) for(auto mi=rng.lo; mi<rng.hi; ++mi)
+      {
+/* alm->alm_tmp where necessary */
+      ljob.alm2almtmp(mi);
+
+      if (!split)
+        inner_loop (ljob, ispair, cth, sth, llim, ulim, generator, mi, mlim);
+      else
+        for (size_t k=0; k<ntrans; ++k)
+          {
+          for (size_t l=ainfo.mval(mi); l<lmax+2; ++l)
+            for (size_t c=0; c<nca; ++c)
+              tjob.almtmp[l*nca+c] = ljob.almtmp[l*nalm_+k*nca+c];
+          tjob.phase = ljob.phase + 2*ncomp_map()*k;
+          inner_loop (tjob, ispair, cth, sth, llim, ulim, generator, mi, mlim);
+          if (type==SHARP_MAP2ALM)
+            for (size_t l=ainfo.mval(mi); l<lmax+2; ++l)
+              for (size_t c=0; c<nca; ++c)
+                ljob.almtmp[l*nalm_+k*nca+c] = tjob.almtmp[l*nca+c];
+          }
+
+/* alm_tmp->alm where necessary */
+      ljob.almtmp2alm(mi);
+      }
+
+    a_opcnt+=ljob.opcnt+tjob.opcnt;
+    }); /* end of parallel region */
+  return a_opcnt;
+  }
+
 DUCC0_NOINLINE void sharp_job::execute()
   {
+  TraceScope trace("sharp_job::execute");
   ducc0::SimpleTimer timer;
   opcnt=0;
-  size_t lmax = ainfo.lmax(),
-         mmax = ainfo.mmax();
-
-  norm_l = (type==SHARP_ALM2MAP_DERIV1) ?
-     sharp_Ylmgen::get_d1norm (lmax) :
-     sharp_Ylmgen::get_norm (lmax, spin);
+  size_t mmax = ainfo.mmax();
+  MR_assert(ainfo.nm()==mmax+1, "not all m values are present");
 
 /* clear output arrays if requested */
   init_output();
 
-  size_t nchunks, chunksize;
-  get_chunk_info(ginfo.npairs(),sharp_veclen()*sharp_max_nvec(spin),
-                 nchunks,chunksize);
   vector<dcmplx> phasebuffer;
 //FIXME: needs to be changed to "nm"
-  alloc_phase(mmax+1,chunksize, phasebuffer);
-  std::atomic<uint64_t> a_opcnt(0);
+  alloc_phase(mmax+1,plan.chunksize, phasebuffer);
 
 /* chunk loop */
-  for (size_t chunk=0; chunk<nchunks; ++chunk)
+  for (const auto &chunk: plan.chunks)
     {
-    size_t llim=chunk*chunksize, ulim=min(llim+chunksize,ginfo.npairs());
-    vector<bool> ispair(ulim-llim);
-    vector<size_t> mlim(ulim-llim);
-    vector<double> cth(ulim-llim), sth(ulim-llim);
-    for (size_t i=0; i<ulim-llim; ++i)
-      {
-      ispair[i] = ginfo.pair(i+llim).r2!=~size_t(0);
-      cth[i] = ginfo.cth(ginfo.pair(i+llim).r1);
-      sth[i] = ginfo.sth(ginfo.pair(i+llim).r1);
-      mlim[i] = sharp_get_mlim(lmax, spin, sth[i], cth[i]);
-      }
+    size_t llim=chunk.llim, ulim=chunk.ulim;
 
 /* map->phase where necessary */
     map2phase(mmax, llim, ulim);
 
-    ducc0::execDynamic(ainfo.nm(), nthreads, 1, [&](ducc0::Scheduler &sched)
-      {
-      sharp_job ljob = *this;
-      ljob.opcnt=0;
-      sharp_Ylmgen generator(lmax,mmax,ljob.spin);
-      vector<dcmplx> almbuffer;
-      ljob.alloc_almtmp(lmax,almbuffer);
+    opcnt += legendre_pass(chunk.ispair, chunk.cth, chunk.sth, chunk.mlim,
+      llim, ulim);
 
-      while (auto rng=sched.getNext()) for(auto mi=rng.lo; mi<rng.hi; ++mi)
-        {
-/* alm->alm_tmp where necessary */
-        ljob.alm2almtmp(mi);
+/* phase->map where necessary */
+    phase2map (mmax, llim, ulim);
+    } /* end of chunk loop */
 
-        inner_loop (ljob, ispair, cth, sth, llim, ulim, generator, mi, mlim);
+  time=timer();
+  }
 
-/* alm_tmp->alm where necessary */
-        ljob.almtmp2alm(mi);
+DUCC0_NOINLINE void sharp_job::execute_streaming
+  (const sharp_ring_reader &reader)
+  {
+  MR_assert(type==SHARP_MAP2ALM, "streaming is only supported for map2alm-type transforms");
+  ducc0::SimpleTimer timer;
+  opcnt=0;
+  size_t mmax = ainfo.mmax();
+  MR_assert(ainfo.nm()==mmax+1, "not all m values are present");
+
+  init_output();
+
+  vector<dcmplx> phasebuffer;
+  alloc_phase(mmax+1,plan.chunksize, phasebuffer);
+
+  vector<size_t> ofs(ginfo.nrings());
+  vector<double> buf;
+  ringofs = ofs.data();
+
+/* chunk loop */
+  for (const auto &chunk: plan.chunks)
+    {
+    size_t llim=chunk.llim, ulim=chunk.ulim;
+
+/* read the rings of this chunk */
+    size_t nbuf=0;
+    for (size_t ith=llim; ith<ulim; ++ith)
+      {
+      auto pr=ginfo.pair(ith);
+      ofs[pr.r1]=nbuf;
+      nbuf+=nmaps()*ginfo.nph(pr.r1);
+      if (pr.r2!=~size_t(0))
+        {
+        ofs[pr.r2]=nbuf;
+        nbuf+=nmaps()*ginfo.nph(pr.r2);
         }
+      }
+    buf.resize(nbuf);
+    for (size_t ith=llim; ith<ulim; ++ith)
+      for (auto iring: {ginfo.pair(ith).r1, ginfo.pair(ith).r2})
+        if (iring!=~size_t(0))
+          for (size_t i=0; i<nmaps(); ++i)
+            reader(any_cast<size_t>(map[i]), iring,
+              buf.data()+ofs[iring]+i*ginfo.nph(iring));
+    ringbuf = buf.data();
 
-      a_opcnt+=ljob.opcnt;
-      }); /* end of parallel region */
+/* map->phase */
+    map2phase(mmax, llim, ulim);
 
-/* phase->map where necessary */
-    phase2map (mmax, llim, ulim);
+    opcnt += legendre_pass(chunk.ispair, chunk.cth, chunk.sth, chunk.mlim,
+      llim, ulim);
+    } /* end of chunk loop */
+
+  ringbuf=nullptr;
+  ringofs=nullptr;
+  time=timer();
+  }
+
+DUCC0_NOINLINE void sharp_job::execute_weighted
+  (const vector<any> &alm_out, const any &weight)
+  {
+  TraceScope trace("sharp_job::execute_weighted");
+  MR_assert(type==SHARP_ALM2MAP, "weighted projection needs a synthesis job");
+  ducc0::SimpleTimer timer;
+  opcnt=0;
+  size_t mmax = ainfo.mmax();
+  MR_assert(ainfo.nm()==mmax+1, "not all m values are present");
+
+  sharp_job adj(SHARP_Yt, spin, alm_out, map, plan, flags, nthreads);
+  adj.init_output();
+
+  vector<dcmplx> phasebuffer, adjphasebuffer;
+  alloc_phase(mmax+1,plan.chunksize, phasebuffer);
+  adj.alloc_phase(mmax+1,plan.chunksize, adjphasebuffer);
+
+/* chunk loop */
+  for (const auto &chunk: plan.chunks)
+    {
+    size_t llim=chunk.llim, ulim=chunk.ulim;
+
+/* a_lm->phase */
+    opcnt += legendre_pass(chunk.ispair, chunk.cth, chunk.sth, chunk.mlim,
+      llim, ulim);
+
+/* phase->map->weighted map->phase */
+    phase2map2phase(adj, weight, mmax, llim, ulim);
+
+/* phase->a_lm */
+    opcnt += adj.legendre_pass(chunk.ispair, chunk.cth, chunk.sth, chunk.mlim,
+      llim, ulim);
     } /* end of chunk loop */
 
-  opcnt = a_opcnt;
   time=timer();
   }
 
 sharp_job::sharp_job (sharp_jobtype type_,
   size_t spin_, const vector<any> &alm_, const vector<any> &map_,
-  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info, size_t flags_, int nthreads_)
-  : alm(alm_), map(map_), type(type_), spin(spin_), flags(flags_), ginfo(geom_info), ainfo(alm_info),
+  const sharp_plan_impl &plan_, size_t flags_, int nthreads_)
+  : alm(alm_), map(map_), type(type_), spin(spin_), ntrans(0),
+    deriv1((type_==SHARP_ALM2MAP_DERIV1)||(type_==SHARP_ALM2MAP_DERIV1_ADJOINT)),
+    flags(flags_), plan(plan_), ginfo(plan.ginfo), ainfo(plan.ainfo),
     nthreads(nthreads_), time(0.), opcnt(0)
   {
-  if (type==SHARP_ALM2MAP_DERIV1) spin_=1;
   if (type==SHARP_MAP2ALM) flags|=SHARP_USE_WEIGHTS;
   if (type==SHARP_Yt) type=SHARP_MAP2ALM;
   if (type==SHARP_WY) { type=SHARP_ALM2MAP; flags|=SHARP_USE_WEIGHTS; }
+  if (type==SHARP_ALM2MAP_DERIV1_ADJOINT) type=SHARP_MAP2ALM;
 
   MR_assert(spin<=ainfo.lmax(), "bad spin");
+  ntrans = map.size()/ncomp_map();
+  MR_assert(ntrans>0, "no maps provided");
   MR_assert(alm.size()==nalm(), "incorrect # of a_lm components");
-  MR_assert(map.size()==nmaps(), "incorrect # of a_lm components");
+  MR_assert(map.size()==nmaps(), "incorrect # of map components");
+  MR_assert(spin==plan.spin, "spin does not match the plan");
+  MR_assert((!deriv1)||(spin==1), "derivative transforms require spin 1");
+  norm_l = deriv1 ? plan.d1norm.data() : plan.norm.data();
+  }
+
+/* Runs the transforms in groups of at most sharp_ntrans_max. The a_lm and map
+   vectors hold the components of consecutive transforms one after another. */
+static void execute_batches (sharp_jobtype type, size_t spin,
+  const vector<any> &alm, const vector<any> &map, const sharp_plan_impl &plan,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt,
+  const function<void(sharp_job &)> &exec=[](sharp_job &job){ job.execute(); })
+  {
+  size_t ncm = 1+(spin>0),
+         nca = ((type==SHARP_ALM2MAP_DERIV1)
+             ||(type==SHARP_ALM2MAP_DERIV1_ADJOINT)) ? 1 : ncm;
+  MR_assert((map.size()>0) && (map.size()%ncm==0),
+    "incorrect # of map components");
+  size_t ntrans = map.size()/ncm;
+  MR_assert(alm.size()==ntrans*nca, "incorrect # of a_lm components");
+  double t=0;
+  uint64_t ops=0;
+  for (size_t lo=0; lo<ntrans; lo+=sharp_ntrans_max)
+    {
+    size_t hi=min(ntrans, lo+sharp_ntrans_max);
+    vector<any> alm_(alm.begin()+lo*nca, alm.begin()+hi*nca),
+                map_(map.begin()+lo*ncm, map.begin()+hi*ncm);
+    sharp_job job(type, spin, alm_, map_, plan, flags, nthreads);
+    exec(job);
+    t += job.time;
+    ops += job.opcnt;
+    }
+  if (time!=nullptr) *time = t;
+  if (opcnt!=nullptr) *opcnt = ops;
   }
 
 void sharp_execute (sharp_jobtype type, size_t spin, const vector<any> &alm,
@@ -437,11 +757,230 @@ void sharp_execute (sharp_jobtype type, size_t spin, const vector<any> &alm,
   const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
   size_t flags, int nthreads, double *time, uint64_t *opcnt)
   {
-  sharp_job job(type, spin, alm, map, geom_info, alm_info, flags, nthreads);
+  sharp_plan_impl plan(geom_info, alm_info, spin, nthreads);
+  execute_batches(type, spin, alm, map, plan, flags, nthreads, time, opcnt);
+  }
+
+/* The map vector of a streaming job holds the global component indices,
+   which are passed on to the reader. */
+static void execute_streaming_batches (sharp_jobtype type, size_t spin,
+  const vector<any> &alm, const sharp_ring_reader &reader,
+  const sharp_plan_impl &plan, size_t flags, int nthreads, double *time,
+  uint64_t *opcnt)
+  {
+  MR_assert((type==SHARP_MAP2ALM)||(type==SHARP_Yt)
+    ||(type==SHARP_ALM2MAP_DERIV1_ADJOINT),
+    "streaming is only supported for map2alm-type transforms");
+  size_t ncm = 1+(spin>0),
+         nca = (type==SHARP_ALM2MAP_DERIV1_ADJOINT) ? 1 : ncm;
+  MR_assert(alm.size()%nca==0, "incorrect # of a_lm components");
+  vector<any> map(alm.size()/nca*ncm);
+  for (size_t i=0; i<map.size(); ++i) map[i]=i;
+  execute_batches(type, spin, alm, map, plan, flags, nthreads, time, opcnt,
+    [&reader](sharp_job &job) { job.execute_streaming(reader); });
+  }
+
+void sharp_execute_streaming (sharp_jobtype type, size_t spin,
+  const vector<any> &alm, const sharp_ring_reader &reader,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt)
+  {
+  sharp_plan_impl plan(geom_info, alm_info, spin, nthreads);
+  execute_streaming_batches(type, spin, alm, reader, plan, flags, nthreads,
+    time, opcnt);
+  }
+
+static void weighted_projection_batches (size_t spin,
+  const vector<any> &alm_in, const vector<any> &alm_out, const any &weight,
+  const sharp_plan_impl &plan, size_t flags, int nthreads, double *time,
+  uint64_t *opcnt)
+  {
+  size_t nc = 1+(spin>0);
+  MR_assert((alm_in.size()>0) && (alm_in.size()%nc==0),
+    "incorrect # of a_lm components");
+  MR_assert(alm_out.size()==alm_in.size(),
+    "input and output a_lm must have the same # of components");
+  size_t ntrans = alm_in.size()/nc;
+  double t=0;
+  uint64_t ops=0;
+  for (size_t lo=0; lo<ntrans; lo+=sharp_ntrans_max)
+    {
+    size_t hi=min(ntrans, lo+sharp_ntrans_max);
+    vector<any> in_(alm_in.begin()+lo*nc, alm_in.begin()+hi*nc),
+                out_(alm_out.begin()+lo*nc, alm_out.begin()+hi*nc),
+                map_((hi-lo)*nc); // no maps are accessed
+    sharp_job job(SHARP_Y, spin, in_, map_, plan, flags, nthreads);
+    job.execute_weighted(out_, weight);
+    t += job.time;
+    ops += job.opcnt;
+    }
+  if (time!=nullptr) *time = t;
+  if (opcnt!=nullptr) *opcnt = ops;
+  }
 
-  job.execute();
-  if (time!=nullptr) *time = job.time;
-  if (opcnt!=nullptr) *opcnt = job.opcnt;
+void sharp_weighted_projection (size_t spin, const vector<any> &alm_in,
+  const vector<any> &alm_out, const any &weight,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt)
+  {
+  sharp_plan_impl plan(geom_info, alm_info, spin, nthreads);
+  weighted_projection_batches(spin, alm_in, alm_out, weight, plan, flags,
+    nthreads, time, opcnt);
+  }
+
+/* Presents the rings of another geometry as if they were stored one after
+   another with unit stride in double arrays; used for scratch maps. */
+class sharp_contiguous_geom_info: public sharp_geom_info
+  {
+  private:
+    const sharp_geom_info &g;
+    vector<size_t> ofs;
+    size_t npix_;
+
+    static const double *ptr(const any &map)
+      {
+      if (map.type()==typeid(double *)) return any_cast<double *>(map);
+      return any_cast<const double *>(map);
+      }
+
+  public:
+    sharp_contiguous_geom_info(const sharp_geom_info &g_)
+      : g(g_), ofs(g.nrings()), npix_(0)
+      {
+      for (size_t i=0; i<g.nrings(); ++i)
+        { ofs[i]=npix_; npix_+=g.nph(i); }
+      }
+    size_t npix() const { return npix_; }
+
+    virtual size_t nrings() const { return g.nrings(); }
+    virtual size_t npairs() const { return g.npairs(); }
+    virtual size_t nph(size_t iring) const { return g.nph(iring); }
+    virtual size_t nphmax() const { return g.nphmax(); }
+    virtual double theta(size_t iring) const { return g.theta(iring); }
+    virtual double cth(size_t iring) const { return g.cth(iring); }
+    virtual double sth(size_t iring) const { return g.sth(iring); }
+    virtual double phi0(size_t iring) const { return g.phi0(iring); }
+    virtual double weight(size_t iring) const { return g.weight(iring); }
+    virtual Tpair pair(size_t ipair) const { return g.pair(ipair); }
+
+    virtual void clear_map(const any &map) const
+      {
+      auto p = any_cast<double *>(map);
+      fill(p, p+npix_, 0.);
+      }
+    virtual void get_ring(bool weighted, size_t iring, const any &map,
+      double *ringtmp) const
+      {
+      const double *p = ptr(map)+ofs[iring];
+      double wgt = weighted ? g.weight(iring) : 1.;
+      for (size_t m=0; m<g.nph(iring); ++m)
+        ringtmp[m] = p[m]*wgt;
+      }
+    virtual void add_ring(bool weighted, size_t iring, const double *ringtmp,
+      const any &map) const
+      {
+      double *p = any_cast<double *>(map)+ofs[iring];
+      double wgt = weighted ? g.weight(iring) : 1.;
+      for (size_t m=0; m<g.nph(iring); ++m)
+        p[m] += ringtmp[m]*wgt;
+      }
+  };
+
+vector<double> sharp_map2alm_iter (size_t spin, const vector<any> &alm,
+  const vector<any> &map, const sharp_geom_info &geom_info,
+  const sharp_alm_info &alm_info, size_t niter, double epsilon, int nthreads)
+  {
+  sharp_contiguous_geom_info ginfo(geom_info);
+  size_t npix=ginfo.npix(), ncomp=map.size();
+
+  // contiguous copies of the input maps, and the residual maps
+  vector<vector<double>> map0(ncomp, vector<double>(npix)),
+                         res(ncomp, vector<double>(npix));
+  vector<any> vmap0, vres;
+  double norm0=0;
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    for (size_t r=0, ofs=0; r<ginfo.nrings(); ofs+=ginfo.nph(r), ++r)
+      geom_info.get_ring(false, r, map[i], map0[i].data()+ofs);
+    for (auto v: map0[i]) norm0+=v*v;
+    vmap0.push_back(static_cast<const double *>(map0[i].data()));
+    vres.push_back(res[i].data());
+    }
+  norm0=sqrt(norm0);
+
+  sharp_plan_impl plan(ginfo, alm_info, spin, nthreads);
+  execute_batches(SHARP_MAP2ALM, spin, alm, vmap0, plan, 0, nthreads,
+    nullptr, nullptr);
+  vector<double> resid;
+  for (size_t iter=0; ; ++iter)
+    {
+    execute_batches(SHARP_Y, spin, alm, vres, plan, 0, nthreads,
+      nullptr, nullptr);
+    double norm=0;
+    for (size_t i=0; i<ncomp; ++i)
+      for (size_t j=0; j<npix; ++j)
+        {
+        res[i][j] = map0[i][j]-res[i][j];
+        norm += res[i][j]*res[i][j];
+        }
+    resid.push_back((norm0>0) ? sqrt(norm)/norm0 : 0.);
+    if ((iter==niter) || (resid.back()<=epsilon)) break;
+    execute_batches(SHARP_MAP2ALM, spin, alm, vres, plan, SHARP_ADD,
+      nthreads, nullptr, nullptr);
+    }
+  return resid;
+  }
+
+void sharp_execute_jobs (sharp_jobtype type, size_t spin,
+  const vector<any> &alm, const vector<any> &map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt,
+  const function<void(sharp_job &)> &exec)
+  {
+  sharp_plan_impl plan(geom_info, alm_info, spin, nthreads);
+  execute_batches(type, spin, alm, map, plan, flags, nthreads, time, opcnt,
+    exec);
+  }
+
+sharp_plan::sharp_plan(const sharp_geom_info &geom_info,
+  const sharp_alm_info &alm_info, size_t spin, int nthreads)
+  : impl(make_unique<sharp_plan_impl>(geom_info, alm_info, spin, nthreads)) {}
+sharp_plan::sharp_plan(unique_ptr<sharp_geom_info> &&geom_info,
+  unique_ptr<sharp_alm_info> &&alm_info, size_t spin, int nthreads)
+  : ginfo_own(move(geom_info)), ainfo_own(move(alm_info)),
+    impl(make_unique<sharp_plan_impl>(*ginfo_own, *ainfo_own, spin,
+      nthreads)) {}
+sharp_plan::~sharp_plan() {}
+
+const sharp_geom_info &sharp_plan::geom_info() const
+  { return impl->ginfo; }
+const sharp_alm_info &sharp_plan::alm_info() const
+  { return impl->ainfo; }
+size_t sharp_plan::spin() const
+  { return impl->spin; }
+
+void sharp_plan::execute (sharp_jobtype type, const vector<any> &alm,
+  const vector<any> &map, size_t flags, int nthreads, double *time,
+  uint64_t *opcnt) const
+  {
+  execute_batches(type, impl->spin, alm, map, *impl, flags, nthreads, time,
+    opcnt);
+  }
+
+void sharp_plan::execute_streaming (sharp_jobtype type,
+  const vector<any> &alm, const sharp_ring_reader &reader, size_t flags,
+  int nthreads, double *time, uint64_t *opcnt) const
+  {
+  execute_streaming_batches(type, impl->spin, alm, reader, *impl, flags,
+    nthreads, time, opcnt);
+  }
+
+void sharp_plan::weighted_projection (const vector<any> &alm_in,
+  const vector<any> &alm_out, const any &weight, size_t flags, int nthreads,
+  double *time, uint64_t *opcnt) const
+  {
+  weighted_projection_batches(impl->spin, alm_in, alm_out, weight, *impl,
+    flags, nthreads, time, opcnt);
   }
 
 void sharp_set_chunksize_min(size_t new_chunksize_min)
@@ -449,4 +988,119 @@ void sharp_set_chunksize_min(size_t new_chunksize_min)
 void sharp_set_nchunks_max(size_t new_nchunks_max)
   { nchunks_max=new_nchunks_max; }
 
+sharp_chunking sharp_autotune_chunking (const sharp_geom_info &geom_info,
+  const sharp_alm_info &alm_info, size_t spin, int nthreads)
+  {
+  // copies with contiguous storage, so that scratch arrays can be allocated
+  size_t nrings=geom_info.nrings(), nm=alm_info.nm(), lmax=alm_info.lmax();
+  vector<size_t> nph(nrings);
+  vector<ptrdiff_t> ofs(nrings);
+  vector<double> phi0(nrings), theta(nrings);
+  size_t npix=0;
+  for (size_t i=0; i<nrings; ++i)
+    {
+    nph[i]=geom_info.nph(i); phi0[i]=geom_info.phi0(i);
+    theta[i]=geom_info.theta(i); ofs[i]=ptrdiff_t(npix);
+    npix+=nph[i];
+    }
+  sharp_standard_geom_info ginfo(nrings, nph.data(), ofs.data(), 1,
+    phi0.data(), theta.data(), nullptr);
+  vector<size_t> mval(nm);
+  vector<ptrdiff_t> mvstart(nm);
+  size_t nalm=0;
+  for (size_t mi=0; mi<nm; ++mi)
+    {
+    mval[mi]=alm_info.mval(mi);
+    mvstart[mi]=ptrdiff_t(nalm)-ptrdiff_t(mval[mi]);
+    nalm+=lmax+1-mval[mi];
+    }
+  sharp_standard_alm_info ainfo(lmax, nm, 1, mval.data(), mvstart.data());
+
+  size_t ncomp=1+(spin>0);
+  vector<vector<dcmplx>> alm(ncomp, vector<dcmplx>(nalm, 0.));
+  vector<vector<double>> map(ncomp, vector<double>(npix, 0.));
+  vector<any> valm, vmap;
+  for (size_t i=0; i<ncomp; ++i)
+    {
+    valm.push_back(alm[i].data());
+    vmap.push_back(map[i].data());
+    }
+
+  // the global settings, and chunk counts from 1 up to about one chunk per
+  // SIMD block of ring pairs
+  vector<sharp_chunking> cand { {chunksize_min, nchunks_max} };
+  size_t nmult=sharp_veclen()*sharp_max_nvec(spin);
+  size_t maxchunks=max<size_t>(1, ginfo.npairs()/nmult);
+  for (size_t n=1; n<=maxchunks; n*=2)
+    cand.push_back({1, n});
+
+  sharp_chunking best=cand[0];
+  double tbest=1e300;
+  for (const auto &c: cand)
+    {
+    sharp_plan_impl plan(ginfo, ainfo, spin, c);
+    double t=1e300;
+    for (size_t rep=0; rep<2; ++rep)
+      {
+      ducc0::SimpleTimer timer;
+      execute_batches(SHARP_Y, spin, valm, vmap, plan, 0, nthreads,
+        nullptr, nullptr);
+      execute_batches(SHARP_Yt, spin, valm, vmap, plan, 0, nthreads,
+        nullptr, nullptr);
+      t=min(t, timer());
+      }
+    if (t<tbest) { tbest=t; best=c; }
+    }
+
+  lock_guard<mutex> lock(wisdom_mutex);
+  wisdom[wisdom_key(geom_info, alm_info, spin, nthreads)] = best;
+  return best;
+  }
+
+static sharp_chunking select_chunking (const sharp_geom_info &ginfo,
+  const sharp_alm_info &ainfo, size_t spin, int nthreads)
+  {
+  {
+  lock_guard<mutex> lock(wisdom_mutex);
+  auto it=wisdom.find(wisdom_key(ginfo, ainfo, spin, nthreads));
+  if (it!=wisdom.end()) return it->second;
+  if (!autotune) return {chunksize_min, nchunks_max};
+  }
+  return sharp_autotune_chunking(ginfo, ainfo, spin, nthreads);
+  }
+
+void sharp_set_autotune(bool enable)
+  {
+  lock_guard<mutex> lock(wisdom_mutex);
+  autotune=enable;
+  }
+
+void sharp_load_wisdom(const string &filename)
+  {
+  ifstream inp(filename);
+  MR_assert(inp, "could not open wisdom file '", filename, "'");
+  map<string, sharp_chunking> tmp;
+  string key;
+  sharp_chunking c;
+  while (inp >> key >> c.chunksize_min >> c.nchunks_max)
+    {
+    MR_assert((c.chunksize_min>0)&&(c.nchunks_max>0), "bad wisdom entry");
+    tmp[key]=c;
+    }
+  MR_assert(inp.eof(), "error reading wisdom file '", filename, "'");
+  lock_guard<mutex> lock(wisdom_mutex);
+  for (const auto &[k, v]: tmp)
+    wisdom[k]=v;
+  }
+
+void sharp_save_wisdom(const string &filename)
+  {
+  ofstream out(filename);
+  MR_assert(out, "could not open wisdom file '", filename, "'");
+  lock_guard<mutex> lock(wisdom_mutex);
+  for (const auto &[k, v]: wisdom)
+    out << k << " " << v.chunksize_min << " " << v.nchunks_max << "\n";
+  MR_assert(out, "error writing wisdom file '", filename, "'");
+  }
+
 }}
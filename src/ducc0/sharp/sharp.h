@@ -33,6 +33,8 @@
 #include <vector>
 #include <memory>
 #include <any>
+#include <string>
+#include <functional>
 
 namespace ducc0 {
 
@@ -54,7 +56,14 @@ class sharp_geom_info
     virtual double cth(size_t iring) const = 0;
     virtual double sth(size_t iring) const = 0;
     virtual double phi0(size_t iring) const = 0;
+    /*! Quadrature weight applied to the pixels of ring \a iring by analysis
+        transforms (SHARP_MAP2ALM/SHARP_YtW and SHARP_WY). */
+    virtual double weight(size_t iring) const = 0;
     virtual Tpair pair(size_t ipair) const = 0;
+    /*! Highest m taken into account for ring \a iring in transforms with
+        band limit \a lmax and spin \a spin; the Y_lm with higher m are
+        negligible there. The default is sharp_get_mlim(). */
+    virtual size_t mlim(size_t iring, size_t lmax, size_t spin) const;
 
     virtual void clear_map(const std::any &map) const = 0;
     virtual void get_ring(bool weighted, size_t iring, const std::any &map, double *ringtmp) const = 0;
@@ -94,7 +103,9 @@ enum sharp_jobtype { SHARP_YtW=0,               /*!< analysis */
                SHARP_ALM2MAP=SHARP_Y,     /*!< synthesis */
                SHARP_Yt=2,                /*!< adjoint synthesis */
                SHARP_WY=3,                /*!< adjoint analysis */
-               SHARP_ALM2MAP_DERIV1=4     /*!< synthesis of first derivatives */
+               SHARP_ALM2MAP_DERIV1=4,    /*!< synthesis of first derivatives */
+               SHARP_ALM2MAP_DERIV1_ADJOINT=5
+               /*!< adjoint synthesis of first derivatives */
              };
 
 /*! Job flags */
@@ -110,6 +121,60 @@ void sharp_execute (sharp_jobtype type, size_t spin, const std::vector<std::any>
   const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
   size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr);
 
+/*! Iterative analysis: starting from \a alm = map2alm(\a map), the
+    residual map2alm(\a map - alm2map(\a alm)) is added to \a alm up to
+    \a niter times (Jacobi iteration). This is useful for geometries without
+    exact quadrature, like HEALPix.
+    The iteration stops early once the relative residual
+    |\a map - alm2map(\a alm)| / |\a map| (L2 norms over all components) is
+    not larger than \a epsilon.
+    \a alm and \a map hold the components of one or several transforms of
+    spin \a spin, as for sharp_execute(). The original maps are left
+    unchanged; one plan and two map-sized work arrays per component are used
+    for all steps.
+    \returns the relative residual after the initial map2alm and after every
+      iteration step. */
+std::vector<double> sharp_map2alm_iter (size_t spin,
+  const std::vector<std::any> &alm, const std::vector<std::any> &map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t niter, double epsilon=0., int nthreads=1);
+
+/*! Source of map data for streaming transforms. A call must store the
+    \a geom_info.nph(\a iring) unweighted pixel values of ring \a iring of map
+    component \a icomp in \a ring. Components are numbered like the map
+    vector of sharp_execute(), i.e. consecutively over all transforms. */
+using sharp_ring_reader =
+  std::function<void(size_t icomp, size_t iring, double *ring)>;
+
+/*! Variant of sharp_execute() for transforms of type SHARP_MAP2ALM,
+    SHARP_Yt and SHARP_ALM2MAP_DERIV1_ADJOINT, which obtains the map data from
+    \a reader instead of from arrays. The rings are requested one chunk of
+    ring pairs at a time (in the order of the geometry's pair list) and only
+    the current chunk is kept in memory, so the full maps never need to be
+    resident. \a reader is only called from the calling thread.
+    For more than sharp_ntrans_max (8) transforms every ring is requested
+    once per group of 8 transforms. */
+void sharp_execute_streaming (sharp_jobtype type, size_t spin,
+  const std::vector<std::any> &alm, const sharp_ring_reader &reader,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr);
+
+/*! Fused weighted projection: \a alm_out = Y^T diag(\a weight) Y \a alm_in,
+    i.e. the synthesized maps are multiplied pixel by pixel with \a weight
+    and then transformed with the adjoint synthesis (SHARP_Yt). The maps only
+    exist ring by ring inside the working buffers, which saves the memory
+    and the memory traffic of separate SHARP_Y and SHARP_Yt calls.
+    \a alm_in and \a alm_out hold the components of one or several
+    transforms of spin \a spin, as for sharp_execute(); they must not
+    overlap. \a weight is a single map (double or float, like the map
+    arguments of sharp_execute()) applied to all components.
+    With SHARP_ADD in \a flags, the result is added to \a alm_out. */
+void sharp_weighted_projection (size_t spin,
+  const std::vector<std::any> &alm_in, const std::vector<std::any> &alm_out,
+  const std::any &weight,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr);
+
 template<typename T> void sharp_alm2map(const std::complex<T> *alm, T *map,
   const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
   size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
@@ -146,10 +211,151 @@ template<typename T> void sharp_map2alm_spin(size_t spin, std::complex<T> *alm1,
   {
   sharp_execute(SHARP_Yt, spin, {alm1, alm2}, {map1, map2}, geom_info, alm_info, flags, nthreads, time, opcnt);
   }
+/*! Computes the maps dT/dtheta and dT/dphi/sin(theta) of the field described
+    by \a alm in a single pass. */
+template<typename T> void sharp_alm2map_deriv1(const std::complex<T> *alm, T *map1, T *map2,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute(SHARP_ALM2MAP_DERIV1, 1, {alm}, {map1, map2}, geom_info, alm_info, flags, nthreads, time, opcnt);
+  }
+template<typename T> void sharp_alm2map_deriv1_adjoint(std::complex<T> *alm, const T *map1, const T *map2,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute(SHARP_ALM2MAP_DERIV1_ADJOINT, 1, {alm}, {map1, map2}, geom_info, alm_info, flags, nthreads, time, opcnt);
+  }
+
+class sharp_plan_impl;
+
+/*! Parameters controlling how the ring pairs are split into chunks. */
+struct sharp_chunking
+  {
+  size_t chunksize_min, nchunks_max;
+  };
+
+/*! Precomputed data for repeated SHTs with fixed geometry, a_lm layout and
+    spin: the Y_lm recurrence tables, the ring pair chunking and the ring FFT
+    plans. Transforms executed through a plan only do the actual work.
+    A plan is immutable after construction and can be used by several threads
+    at once.
+    If wisdom for the geometry, a_lm set, spin and \a nthreads is available
+    (see sharp_autotune_chunking()), its chunking is used; otherwise the
+    global chunking parameters apply.
+    \note Changes made by sharp_set_chunksize_min() and
+    sharp_set_nchunks_max() only affect plans created afterwards. */
+class sharp_plan
+  {
+  private:
+    std::unique_ptr<sharp_geom_info> ginfo_own;
+    std::unique_ptr<sharp_alm_info> ainfo_own;
+    std::unique_ptr<sharp_plan_impl> impl;
+
+  public:
+    /*! The plan only stores references to \a geom_info and \a alm_info,
+        which must outlive it. */
+    sharp_plan(const sharp_geom_info &geom_info,
+      const sharp_alm_info &alm_info, size_t spin, int nthreads=1);
+    /*! The plan takes ownership of \a geom_info and \a alm_info. */
+    sharp_plan(std::unique_ptr<sharp_geom_info> &&geom_info,
+      std::unique_ptr<sharp_alm_info> &&alm_info, size_t spin,
+      int nthreads=1);
+    ~sharp_plan();
+
+    const sharp_geom_info &geom_info() const;
+    const sharp_alm_info &alm_info() const;
+    size_t spin() const;
+
+    /*! \a alm and \a map may hold the components of several independent
+        transforms one after another; these are carried out together, and
+        for spin 0 they share the Y_lm recursion. */
+    void execute (sharp_jobtype type, const std::vector<std::any> &alm,
+      const std::vector<std::any> &map, size_t flags, int nthreads=1,
+      double *time=nullptr, uint64_t *opcnt=nullptr) const;
+    /*! See sharp_execute_streaming(). */
+    void execute_streaming (sharp_jobtype type,
+      const std::vector<std::any> &alm, const sharp_ring_reader &reader,
+      size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const;
+    /*! See sharp_weighted_projection(). */
+    void weighted_projection (const std::vector<std::any> &alm_in,
+      const std::vector<std::any> &alm_out, const std::any &weight,
+      size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const;
+
+    template<typename T> void alm2map(const std::complex<T> *alm, T *map,
+      size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const
+      { execute(SHARP_Y, {alm}, {map}, flags, nthreads, time, opcnt); }
+    template<typename T> void alm2map_adjoint(std::complex<T> *alm,
+      const T *map, size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const
+      { execute(SHARP_Yt, {alm}, {map}, flags, nthreads, time, opcnt); }
+    template<typename T> void alm2map_spin(const std::complex<T> *alm1,
+      const std::complex<T> *alm2, T *map1, T *map2, size_t flags,
+      int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_Y, {alm1, alm2}, {map1, map2}, flags, nthreads, time,
+        opcnt);
+      }
+    template<typename T> void alm2map_spin_adjoint(std::complex<T> *alm1,
+      std::complex<T> *alm2, const T *map1, const T *map2, size_t flags,
+      int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_Yt, {alm1, alm2}, {map1, map2}, flags, nthreads, time,
+        opcnt);
+      }
+    template<typename T> void map2alm(std::complex<T> *alm, const T *map,
+      size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_Yt, {alm}, {map}, flags, nthreads,
+        time, opcnt);
+      }
+    template<typename T> void map2alm_spin(std::complex<T> *alm1,
+      std::complex<T> *alm2, const T *map1, const T *map2, size_t flags,
+      int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_Yt, {alm1, alm2}, {map1, map2}, flags,
+        nthreads, time, opcnt);
+      }
+    /*! Requires a plan with spin 1. */
+    template<typename T> void alm2map_deriv1(const std::complex<T> *alm,
+      T *map1, T *map2, size_t flags, int nthreads=1, double *time=nullptr,
+      uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_ALM2MAP_DERIV1, {alm}, {map1, map2}, flags, nthreads,
+        time, opcnt);
+      }
+    /*! Requires a plan with spin 1. */
+    template<typename T> void alm2map_deriv1_adjoint(std::complex<T> *alm,
+      const T *map1, const T *map2, size_t flags, int nthreads=1,
+      double *time=nullptr, uint64_t *opcnt=nullptr) const
+      {
+      execute(SHARP_ALM2MAP_DERIV1_ADJOINT, {alm}, {map1, map2}, flags,
+        nthreads, time, opcnt);
+      }
+  };
 
 void sharp_set_chunksize_min(size_t new_chunksize_min);
 void sharp_set_nchunks_max(size_t new_nchunks_max);
 
+/*! Times forward and backward transforms with several chunking parameters
+    for the given geometry, a_lm set, spin and number of threads, stores the
+    fastest choice in the process-wide wisdom table and returns it.
+    Later plans and transforms with the same properties use this choice.
+    The arrays of \a geom_info and \a alm_info are not accessed. */
+sharp_chunking sharp_autotune_chunking (const sharp_geom_info &geom_info,
+  const sharp_alm_info &alm_info, size_t spin, int nthreads=1);
+/*! If \a enable is \c true, creating a plan for which no wisdom is available
+    runs sharp_autotune_chunking() first. Default is \c false. */
+void sharp_set_autotune(bool enable);
+/*! Adds the entries of the wisdom file \a filename to the wisdom table,
+    overwriting existing entries with the same key. */
+void sharp_load_wisdom(const std::string &filename);
+/*! Writes the wisdom table to \a filename (one entry per line). */
+void sharp_save_wisdom(const std::string &filename);
+
 /*! \} */
 
 size_t sharp_get_mlim (size_t lmax, size_t spin, double sth, double cth);
@@ -160,6 +366,17 @@ const char *sharp_architecture(void);
 
 using detail_sharp::sharp_geom_info;
 using detail_sharp::sharp_alm_info;
+using detail_sharp::sharp_plan;
+using detail_sharp::sharp_chunking;
+using detail_sharp::sharp_autotune_chunking;
+using detail_sharp::sharp_set_autotune;
+using detail_sharp::sharp_load_wisdom;
+using detail_sharp::sharp_save_wisdom;
+using detail_sharp::sharp_jobtype;
+using detail_sharp::sharp_ring_reader;
+using detail_sharp::sharp_execute_streaming;
+using detail_sharp::sharp_weighted_projection;
+using detail_sharp::sharp_map2alm_iter;
 using detail_sharp::SHARP_ADD;
 using detail_sharp::SHARP_USE_WEIGHTS;
 using detail_sharp::SHARP_YtW;
@@ -169,6 +386,7 @@ using detail_sharp::SHARP_ALM2MAP;
 using detail_sharp::SHARP_Yt;
 using detail_sharp::SHARP_WY;
 using detail_sharp::SHARP_ALM2MAP_DERIV1;
+using detail_sharp::SHARP_ALM2MAP_DERIV1_ADJOINT;
 using detail_sharp::sharp_architecture;
 using detail_sharp::sharp_veclen;
 using detail_sharp::sharp_get_mlim;
@@ -25,6 +25,7 @@
  *  \author Martin Reinecke
  */
 
+#include <algorithm>
 #include "ducc0/infra/error_handling.h"
 #include "ducc0/sharp/sharp_almhelpers.h"
 
@@ -98,21 +99,20 @@ void sharp_standard_alm_info::add_alm(size_t mi, const dcmplx *almtmp, const any
 
 ptrdiff_t sharp_standard_alm_info::index (size_t l, size_t mi)
   { return mvstart[mi]+stride*ptrdiff_t(l); }
-/* This currently requires all m values from 0 to nm-1 to be present.
-   It might be worthwhile to relax this criterion such that holes in the m
-   distribution are permissible. */
+/* The m values need not be contiguous (e.g. when every task of a distributed
+   transform only holds a subset), but they must be unique. */
 size_t sharp_standard_alm_info::mmax() const
   {
-  //FIXME: if gaps are allowed, we have to search the maximum m in the array
-  auto nm_=mval_.size();
-  vector<bool> mcheck(nm_,false);
+  size_t res=0;
+  for (auto m_cur : mval_)
+    res = max(res, m_cur);
+  vector<bool> mcheck(res+1,false);
   for (auto m_cur : mval_)
     {
-    MR_assert(m_cur<nm_, "not all m values are present");
     MR_assert(mcheck[m_cur]==false, "duplicate m value");
     mcheck[m_cur]=true;
     }
-  return nm_-1;
+  return res;
   }
 
 unique_ptr<sharp_standard_alm_info> sharp_make_triangular_alm_info (size_t lmax, size_t mmax, ptrdiff_t stride)
@@ -31,6 +31,9 @@
 #undef GENERIC_ARCH
 #undef ARCH
 
+#include <string>
+#include "ducc0/infra/system.h"
+
 namespace ducc0 {
 
 namespace detail_sharp {
@@ -49,23 +52,17 @@ static t_architecture architecture_ = nullptr;
 
 #ifdef MULTIARCH
 
-#if (defined(___AVX512F__) || defined(__FMA4__) || defined(__FMA__) || \
+#if (defined(__AVX512F__) || defined(__FMA4__) || defined(__FMA__) || \
      defined(__AVX2__) || defined(__AVX__))
 #error MULTIARCH specified but platform-specific flags detected
 #endif
 
+/* Every variant of sharp_core_inc.cc is compiled separately with the
+   corresponding -m flags; the first one supported by the CPU (or the one
+   requested via DUCC0_ARCH, see select_isa_variant()) is used.
+   The "avx2" variant is built with -mavx2 -mfma. Without a usable variant
+   the SSE2 baseline ("default") is taken. */
 #define DECL(arch) \
-static int XCONCATX2(have,arch)(void) \
-  { \
-  static int res=-1; \
-  if (res<0) \
-    { \
-    __builtin_cpu_init(); \
-    res = __builtin_cpu_supports(#arch); \
-    } \
-  return res; \
-  } \
-\
 void XCONCATX2(inner_loop,arch) (sharp_job &job, const vector<bool> &ispair, \
   const vector<double> &cth_, const vector<double> &sth_, size_t llim, size_t ulim, \
   sharp_Ylmgen &gen, size_t mi, const vector<size_t> &mlim); \
@@ -76,18 +73,24 @@ const char *XCONCATX2(sharp_architecture,arch) (void);
 #if (!defined(__APPLE__))
 DECL(avx512f)
 #endif
+DECL(avx2)
 DECL(fma4)
 DECL(fma)
-DECL(avx2)
 DECL(avx)
+#undef DECL
 
 #endif
 
 static void assign_funcs(void)
   {
 #ifdef MULTIARCH
+  string isa = select_isa_variant({
+#if (!defined(__APPLE__))
+    "avx512f",
+#endif
+    "avx2", "fma4", "fma", "avx"});
 #define DECL2(arch) \
-  if (XCONCATX2(have,arch)()) \
+  if (isa==#arch) \
     { \
     inner_loop_ = XCONCATX2(inner_loop,arch); \
     veclen_ = XCONCATX2(sharp_veclen,arch); \
@@ -98,10 +101,11 @@ static void assign_funcs(void)
 #if (!defined(__APPLE__))
 DECL2(avx512f)
 #endif
+DECL2(avx2)
 DECL2(fma4)
 DECL2(fma)
-DECL2(avx2)
 DECL2(avx)
+#undef DECL2
 #endif
   inner_loop_ = inner_loop_default;
   veclen_ = sharp_veclen_default;
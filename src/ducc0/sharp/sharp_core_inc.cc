@@ -476,6 +476,200 @@ DUCC0_NOINLINE static void calc_map2alm (sharp_job & DUCC0_RESTRICT job,
   map2alm_kernel(d, coef, alm, l, il, lmax, nv2);
   }
 
+/* Spin-0 kernels for several transforms at once (job.ntrans>1).
+   The recursion is evaluated for a block of nlblk steps and stored, and the
+   stored values are then applied to all transforms. The a_lm of transform k
+   are found at almtmp[l*ntrans+k]; the accumulators of transform k occupy
+   p[4*nv0*k ... 4*nv0*(k+1)) in the order p1r, p1i, p2r, p2i. */
+
+constexpr size_t nlblk = 8;
+
+/* Stores the next (at most nlblk) recursion values in ylm, each one for the
+   pair (l, l+1), and returns how many were stored. */
+DUCC0_NOINLINE static size_t ylm_block(const sharp_Ylmgen &gen,
+  s0data_v & DUCC0_RESTRICT d, Tbv0 * DUCC0_RESTRICT ylm, size_t &l,
+  size_t &il, size_t nv2, bool &full_ieee)
+  {
+  const auto &coef = gen.coef;
+  size_t nb=0;
+  for (; (nb<nlblk)&&(l<=gen.lmax); ++nb, ++il, l+=2)
+    {
+    Tv a=coef[il].a, b=coef[il].b;
+    if (full_ieee)
+      for (size_t i=0; i<nv2; ++i)
+        {
+        ylm[nb][i] = d.lam2[i];
+        Tv tmp = (a*d.csq[i] + b)*d.lam2[i] + d.lam1[i];
+        d.lam1[i] = d.lam2[i];
+        d.lam2[i] = tmp;
+        }
+    else
+      {
+      full_ieee=1;
+      for (size_t i=0; i<nv2; ++i)
+        {
+        ylm[nb][i] = d.lam2[i]*d.corfac[i];
+        Tv tmp = (a*d.csq[i] + b)*d.lam2[i] + d.lam1[i];
+        d.lam1[i] = d.lam2[i];
+        d.lam2[i] = tmp;
+        if (rescale(&d.lam1[i], &d.lam2[i], &d.scale[i], sharp_ftol))
+          getCorfac(d.scale[i], &d.corfac[i], gen.cf);
+        full_ieee &= all_of(d.scale[i]>=sharp_minscale);
+        }
+      if (full_ieee)
+        for (size_t i=0; i<nv2; ++i)
+          {
+          d.lam1[i] *= d.corfac[i];
+          d.lam2[i] *= d.corfac[i];
+          }
+      }
+    }
+  return nb;
+  }
+
+static bool init_corfac(const sharp_Ylmgen &gen, s0data_v & DUCC0_RESTRICT d,
+  size_t nv2)
+  {
+  bool full_ieee=true;
+  for (size_t i=0; i<nv2; ++i)
+    {
+    getCorfac(d.scale[i], &d.corfac[i], gen.cf);
+    full_ieee &= all_of(d.scale[i]>=sharp_minscale);
+    }
+  if (full_ieee)
+    for (size_t i=0; i<nv2; ++i)
+      {
+      d.lam1[i] *= d.corfac[i];
+      d.lam2[i] *= d.corfac[i];
+      }
+  return full_ieee;
+  }
+
+DUCC0_NOINLINE static void calc_alm2map_multi (sharp_job & DUCC0_RESTRICT job,
+  const sharp_Ylmgen &gen, s0data_v & DUCC0_RESTRICT d,
+  Tv * DUCC0_RESTRICT p, size_t nth)
+  {
+  size_t l,il=0,lmax=gen.lmax,nt=job.ntrans;
+  size_t nv2 = (nth+VLEN-1)/VLEN;
+  iter_to_ieee(gen, d, l, il, nv2);
+  job.opcnt += il * 4*nth;
+  if (l>lmax) return;
+  job.opcnt += (lmax+1-l) * (2+4*nt)*nth;
+
+  const dcmplx * DUCC0_RESTRICT alm=job.almtmp;
+  bool full_ieee=init_corfac(gen, d, nv2);
+  Tbv0 ylm[nlblk];
+  while (l<=lmax)
+    {
+    size_t l0=l;
+    size_t nb=ylm_block(gen, d, ylm, l, il, nv2, full_ieee);
+    for (size_t k=0; k<nt; ++k)
+      {
+      Tv * DUCC0_RESTRICT pk=p+4*nv0*k;
+      auto a=[&](size_t j, size_t ofs) { return alm[(l0+2*j+ofs)*nt+k]; };
+      size_t j=0;
+      // blocks of four steps, so that all coefficients fit into registers
+      for (; j+4<=nb; j+=4)
+        {
+        Tv ar1=a(j  ,0).real(), ai1=a(j  ,0).imag(),
+           ar2=a(j  ,1).real(), ai2=a(j  ,1).imag();
+        Tv ar3=a(j+1,0).real(), ai3=a(j+1,0).imag(),
+           ar4=a(j+1,1).real(), ai4=a(j+1,1).imag();
+        Tv ar5=a(j+2,0).real(), ai5=a(j+2,0).imag(),
+           ar6=a(j+2,1).real(), ai6=a(j+2,1).imag();
+        Tv ar7=a(j+3,0).real(), ai7=a(j+3,0).imag(),
+           ar8=a(j+3,1).real(), ai8=a(j+3,1).imag();
+        for (size_t i=0; i<nv2; ++i)
+          {
+          Tv p1r=pk[i], p1i=pk[nv0+i], p2r=pk[2*nv0+i], p2i=pk[3*nv0+i];
+          Tv y1=ylm[j][i], y2=ylm[j+1][i], y3=ylm[j+2][i], y4=ylm[j+3][i];
+          p1r += y1*ar1; p1i += y1*ai1; p2r += y1*ar2; p2i += y1*ai2;
+          p1r += y2*ar3; p1i += y2*ai3; p2r += y2*ar4; p2i += y2*ai4;
+          p1r += y3*ar5; p1i += y3*ai5; p2r += y3*ar6; p2i += y3*ai6;
+          p1r += y4*ar7; p1i += y4*ai7; p2r += y4*ar8; p2i += y4*ai8;
+          pk[i]=p1r; pk[nv0+i]=p1i; pk[2*nv0+i]=p2r; pk[3*nv0+i]=p2i;
+          }
+        }
+      for (; j<nb; ++j)
+        {
+        Tv ar1=a(j,0).real(), ai1=a(j,0).imag(),
+           ar2=a(j,1).real(), ai2=a(j,1).imag();
+        for (size_t i=0; i<nv2; ++i)
+          {
+          Tv y=ylm[j][i];
+          pk[i] += y*ar1; pk[nv0+i] += y*ai1;
+          pk[2*nv0+i] += y*ar2; pk[3*nv0+i] += y*ai2;
+          }
+        }
+      }
+    }
+  }
+
+DUCC0_NOINLINE static void calc_map2alm_multi (sharp_job & DUCC0_RESTRICT job,
+  const sharp_Ylmgen &gen, s0data_v & DUCC0_RESTRICT d,
+  const Tv * DUCC0_RESTRICT p, size_t nth)
+  {
+  size_t l,il=0,lmax=gen.lmax,nt=job.ntrans;
+  size_t nv2 = (nth+VLEN-1)/VLEN;
+  iter_to_ieee(gen, d, l, il, nv2);
+  job.opcnt += il * 4*nth;
+  if (l>lmax) return;
+  job.opcnt += (lmax+1-l) * (2+4*nt)*nth;
+
+  dcmplx * DUCC0_RESTRICT alm=job.almtmp;
+  bool full_ieee=init_corfac(gen, d, nv2);
+  Tbv0 ylm[nlblk];
+  while (l<=lmax)
+    {
+    size_t l0=l;
+    size_t nb=ylm_block(gen, d, ylm, l, il, nv2, full_ieee);
+    for (size_t k=0; k<nt; ++k)
+      {
+      const Tv * DUCC0_RESTRICT pk=p+4*nv0*k;
+      auto add=[&](size_t j, const Tv *atmp)
+        {
+        size_t lj=l0+2*j;
+        alm[lj*nt+k] += dcmplx(reduce(atmp[0],std::plus<>()),
+                               reduce(atmp[1],std::plus<>()));
+        alm[(lj+1)*nt+k] += dcmplx(reduce(atmp[2],std::plus<>()),
+                                   reduce(atmp[3],std::plus<>()));
+        };
+      size_t j=0;
+      for (; j+4<=nb; j+=4)
+        {
+        Tv atmp1[4] = {0,0,0,0}, atmp2[4] = {0,0,0,0},
+           atmp3[4] = {0,0,0,0}, atmp4[4] = {0,0,0,0};
+        for (size_t i=0; i<nv2; ++i)
+          {
+          Tv p1r=pk[i], p1i=pk[nv0+i], p2r=pk[2*nv0+i], p2i=pk[3*nv0+i];
+          Tv y1=ylm[j][i], y2=ylm[j+1][i], y3=ylm[j+2][i], y4=ylm[j+3][i];
+          atmp1[0] += y1*p1r; atmp1[1] += y1*p1i;
+          atmp1[2] += y1*p2r; atmp1[3] += y1*p2i;
+          atmp2[0] += y2*p1r; atmp2[1] += y2*p1i;
+          atmp2[2] += y2*p2r; atmp2[3] += y2*p2i;
+          atmp3[0] += y3*p1r; atmp3[1] += y3*p1i;
+          atmp3[2] += y3*p2r; atmp3[3] += y3*p2i;
+          atmp4[0] += y4*p1r; atmp4[1] += y4*p1i;
+          atmp4[2] += y4*p2r; atmp4[3] += y4*p2i;
+          }
+        add(j, atmp1); add(j+1, atmp2); add(j+2, atmp3); add(j+3, atmp4);
+        }
+      for (; j<nb; ++j)
+        {
+        Tv atmp[4] = {0,0,0,0};
+        for (size_t i=0; i<nv2; ++i)
+          {
+          atmp[0] += ylm[j][i]*pk[i];
+          atmp[1] += ylm[j][i]*pk[nv0+i];
+          atmp[2] += ylm[j][i]*pk[2*nv0+i];
+          atmp[3] += ylm[j][i]*pk[3*nv0+i];
+          }
+        add(j, atmp);
+        }
+      }
+    }
+  }
+
 DUCC0_NOINLINE static void iter_to_ieee_spin (const sharp_Ylmgen &gen,
   sxdata_v & DUCC0_RESTRICT d, size_t & DUCC0_RESTRICT l_, size_t nv2)
   {
@@ -939,8 +1133,266 @@ DUCC0_NOINLINE static void calc_alm2map_deriv1(sharp_job & DUCC0_RESTRICT job,
   }
 
 
+/* Adjoint of alm2map_deriv1_kernel: only the gradient part of the spin-1
+   adjoint is accumulated, into a single a_lm component. */
+DUCC0_NOINLINE static void map2alm_deriv1_kernel(sxdata_v & DUCC0_RESTRICT d,
+  const vector<sharp_Ylmgen::dbl2> &fx, dcmplx * DUCC0_RESTRICT alm,
+  size_t l, size_t lmax, size_t nv2)
+  {
+  size_t lsave=l;
+  while (l<=lmax)
+    {
+    Tv fx10=fx[l+1].a,fx11=fx[l+1].b;
+    Tv fx20=fx[l+2].a,fx21=fx[l+2].b;
+    Tv ar1=0, ai1=0, ar2=0, ai2=0;
+    for (size_t i=0; i<nv2; ++i)
+      {
+      d.l1p[i] = (d.cth[i]*fx10 - fx11)*d.l2p[i] - d.l1p[i];
+      ar1 += d.p2mi[i]*d.l2p[i];
+      ai1 -= d.p2mr[i]*d.l2p[i];
+      ar2 += d.p2pr[i]*d.l1p[i];
+      ai2 += d.p2pi[i]*d.l1p[i];
+      d.l2p[i] = (d.cth[i]*fx20 - fx21)*d.l1p[i] - d.l2p[i];
+      }
+    vhsum_cmplx_special (ar1,ai1,ar2,ai2,&alm[l]);
+    l+=2;
+    }
+  l=lsave;
+  while (l<=lmax)
+    {
+    Tv fx10=fx[l+1].a,fx11=fx[l+1].b;
+    Tv fx20=fx[l+2].a,fx21=fx[l+2].b;
+    Tv ar1=0, ai1=0, ar2=0, ai2=0;
+    for (size_t i=0; i<nv2; ++i)
+      {
+      d.l1m[i] = (d.cth[i]*fx10 + fx11)*d.l2m[i] - d.l1m[i];
+      ar1 += d.p1pr[i]*d.l2m[i];
+      ai1 += d.p1pi[i]*d.l2m[i];
+      ar2 -= d.p1mi[i]*d.l1m[i];
+      ai2 += d.p1mr[i]*d.l1m[i];
+      d.l2m[i] = (d.cth[i]*fx20 + fx21)*d.l1m[i] - d.l2m[i];
+      }
+    vhsum_cmplx_special (ar1,ai1,ar2,ai2,&alm[l]);
+    l+=2;
+    }
+  }
+
+DUCC0_NOINLINE static void calc_map2alm_deriv1(sharp_job & DUCC0_RESTRICT job,
+  const sharp_Ylmgen &gen, sxdata_v & DUCC0_RESTRICT d, size_t nth)
+  {
+  size_t l,lmax=gen.lmax;
+  size_t nv2 = (nth+VLEN-1)/VLEN;
+  iter_to_ieee_spin(gen, d, l, nv2);
+  job.opcnt += (l-gen.mhi) * 7*nth;
+  if (l>lmax) return;
+  job.opcnt += (lmax+1-l) * 15*nth;
+
+  const auto &fx = gen.coef;
+  dcmplx * DUCC0_RESTRICT alm=job.almtmp;
+  bool full_ieee=true;
+  for (size_t i=0; i<nv2; ++i)
+    {
+    getCorfac(d.scp[i], &d.cfp[i], gen.cf);
+    getCorfac(d.scm[i], &d.cfm[i], gen.cf);
+    full_ieee &= all_of(d.scp[i]>=sharp_minscale) &&
+                 all_of(d.scm[i]>=sharp_minscale);
+    }
+  for (size_t i=0; i<nv2; ++i)
+    {
+    Tv tmp;
+    tmp = d.p1pr[i]; d.p1pr[i] -= d.p2mi[i]; d.p2mi[i] += tmp;
+    tmp = d.p1pi[i]; d.p1pi[i] += d.p2mr[i]; d.p2mr[i] -= tmp;
+    tmp = d.p1mr[i]; d.p1mr[i] += d.p2pi[i]; d.p2pi[i] -= tmp;
+    tmp = d.p1mi[i]; d.p1mi[i] -= d.p2pr[i]; d.p2pr[i] += tmp;
+    }
+
+  while((!full_ieee) && (l<=lmax))
+    {
+    Tv fx10=fx[l+1].a,fx11=fx[l+1].b;
+    Tv fx20=fx[l+2].a,fx21=fx[l+2].b;
+    Tv ar1=0, ai1=0, ar2=0, ai2=0;
+    full_ieee=1;
+    for (size_t i=0; i<nv2; ++i)
+      {
+      d.l1p[i] = (d.cth[i]*fx10 - fx11)*d.l2p[i] - d.l1p[i];
+      d.l1m[i] = (d.cth[i]*fx10 + fx11)*d.l2m[i] - d.l1m[i];
+      Tv l2p = d.l2p[i]*d.cfp[i], l2m = d.l2m[i]*d.cfm[i];
+      Tv l1p = d.l1p[i]*d.cfp[i], l1m = d.l1m[i]*d.cfm[i];
+      ar1 += d.p1pr[i]*l2m + d.p2mi[i]*l2p;
+      ai1 += d.p1pi[i]*l2m - d.p2mr[i]*l2p;
+      ar2 += d.p2pr[i]*l1p - d.p1mi[i]*l1m;
+      ai2 += d.p2pi[i]*l1p + d.p1mr[i]*l1m;
+
+      d.l2p[i] = (d.cth[i]*fx20 - fx21)*d.l1p[i] - d.l2p[i];
+      d.l2m[i] = (d.cth[i]*fx20 + fx21)*d.l1m[i] - d.l2m[i];
+      if (rescale(&d.l1p[i], &d.l2p[i], &d.scp[i], sharp_ftol))
+        getCorfac(d.scp[i], &d.cfp[i], gen.cf);
+      full_ieee &= all_of(d.scp[i]>=sharp_minscale);
+      if (rescale(&d.l1m[i], &d.l2m[i], &d.scm[i], sharp_ftol))
+        getCorfac(d.scm[i], &d.cfm[i], gen.cf);
+      full_ieee &= all_of(d.scm[i]>=sharp_minscale);
+      }
+    vhsum_cmplx_special (ar1,ai1,ar2,ai2,&alm[l]);
+    l+=2;
+    }
+  if (l>lmax) return;
+
+  for (size_t i=0; i<nv2; ++i)
+    {
+    d.l1p[i] *= d.cfp[i];
+    d.l2p[i] *= d.cfp[i];
+    d.l1m[i] *= d.cfm[i];
+    d.l2m[i] *= d.cfm[i];
+    }
+  map2alm_deriv1_kernel(d, fx, alm, l, lmax, nv2);
+  }
+
+
 #define VZERO(var) do { memset(&(var),0,sizeof(var)); } while(0)
 
+/* Spin-0 synthesis of job.ntrans>1 transforms for a single m; gen must
+   already be prepared for this m. */
+DUCC0_NOINLINE static void inner_loop_a2m_multi(sharp_job &job,
+  const vector<bool> &ispair, const vector<double> &cth_,
+  const vector<double> &sth_, size_t llim, size_t ulim,
+  const sharp_Ylmgen &gen, size_t mi, const vector<size_t> &mlim)
+  {
+  const size_t m = gen.m, nt = job.ntrans;
+  //adjust the a_lm for the new algorithm
+  dcmplx * DUCC0_RESTRICT alm=job.almtmp;
+  for (size_t k=0; k<nt; ++k)
+    for (size_t il=0, l=gen.m; l<=gen.lmax; ++il,l+=2)
+      {
+      dcmplx al = alm[l*nt+k];
+      dcmplx al1 = (l+1>gen.lmax) ? 0. : alm[(l+1)*nt+k];
+      dcmplx al2 = (l+2>gen.lmax) ? 0. : alm[(l+2)*nt+k];
+      alm[l*nt+k] = gen.alpha[il]*(gen.eps[l+1]*al + gen.eps[l+2]*al2);
+      alm[(l+1)*nt+k] = gen.alpha[il]*al1;
+      }
+
+  const size_t nval=nv0*VLEN;
+  size_t ith=0;
+  size_t itgt[nval];
+  vector<Tv> pbuf(4*nv0*nt);
+  while (ith<ulim-llim)
+    {
+    s0data_u d;
+    fill(pbuf.begin(), pbuf.end(), Tv(0.));
+    size_t nth=0;
+    while ((nth<nval)&&(ith<ulim-llim))
+      {
+      if (mlim[ith]>=m)
+        {
+        itgt[nth] = ith;
+        d.s.csq[nth]=cth_[ith]*cth_[ith];
+        d.s.sth[nth]=sth_[ith];
+        ++nth;
+        }
+      else
+        {
+        auto phas_idx = ith*job.s_th + mi*job.s_m;
+        for (size_t k=0; k<nt; ++k)
+          job.phase[phas_idx+2*k] = job.phase[phas_idx+2*k+1] = 0;
+        }
+      ++ith;
+      }
+    if (nth>0)
+      {
+      size_t i2=((nth+VLEN-1)/VLEN)*VLEN;
+      for (auto i=nth; i<i2; ++i)
+        {
+        d.s.csq[i]=d.s.csq[nth-1];
+        d.s.sth[i]=d.s.sth[nth-1];
+        }
+      calc_alm2map_multi (job, gen, d.v, pbuf.data(), nth);
+      for (size_t k=0; k<nt; ++k)
+        {
+        const double *ps = reinterpret_cast<const double *>(&pbuf[4*nv0*k]);
+        for (size_t i=0; i<nth; ++i)
+          {
+          auto tgt=itgt[i];
+          //adjust for new algorithm
+          complex<double> r1(ps[i], ps[nval+i]),
+                          r2(ps[2*nval+i]*cth_[tgt], ps[3*nval+i]*cth_[tgt]);
+          auto phas_idx = tgt*job.s_th + mi*job.s_m + 2*k;
+          job.phase[phas_idx] = r1+r2;
+          if (ispair[tgt])
+            job.phase[phas_idx+1] = r1-r2;
+          }
+        }
+      }
+    }
+  }
+
+/* Spin-0 analysis of job.ntrans>1 transforms for a single m; gen must
+   already be prepared for this m. */
+DUCC0_NOINLINE static void inner_loop_m2a_multi(sharp_job &job,
+  const vector<bool> &ispair, const vector<double> &cth_,
+  const vector<double> &sth_, size_t llim, size_t ulim,
+  const sharp_Ylmgen &gen, size_t mi, const vector<size_t> &mlim)
+  {
+  const size_t m = gen.m, nt = job.ntrans;
+  const size_t nval=nv0*VLEN;
+  size_t ith=0;
+  vector<Tv> pbuf(4*nv0*nt);
+  while (ith<ulim-llim)
+    {
+    s0data_u d;
+    size_t nth=0;
+    while ((nth<nval)&&(ith<ulim-llim))
+      {
+      if (mlim[ith]>=m)
+        {
+        d.s.csq[nth]=cth_[ith]*cth_[ith]; d.s.sth[nth]=sth_[ith];
+        auto phas_idx = ith*job.s_th + mi*job.s_m;
+        for (size_t k=0; k<nt; ++k)
+          {
+          double *ps = reinterpret_cast<double *>(&pbuf[4*nv0*k]);
+          dcmplx ph1=job.phase[phas_idx+2*k];
+          dcmplx ph2=ispair[ith] ? job.phase[phas_idx+2*k+1] : 0.;
+          ps[nth]=(ph1+ph2).real(); ps[nval+nth]=(ph1+ph2).imag();
+          //adjust for new algorithm
+          ps[2*nval+nth]=(ph1-ph2).real()*cth_[ith];
+          ps[3*nval+nth]=(ph1-ph2).imag()*cth_[ith];
+          }
+        ++nth;
+        }
+      ++ith;
+      }
+    if (nth>0)
+      {
+      size_t i2=((nth+VLEN-1)/VLEN)*VLEN;
+      for (size_t i=nth; i<i2; ++i)
+        {
+        d.s.csq[i]=d.s.csq[nth-1];
+        d.s.sth[i]=d.s.sth[nth-1];
+        for (size_t k=0; k<nt; ++k)
+          {
+          double *ps = reinterpret_cast<double *>(&pbuf[4*nv0*k]);
+          ps[i]=ps[nval+i]=ps[2*nval+i]=ps[3*nval+i]=0.;
+          }
+        }
+      calc_map2alm_multi (job, gen, d.v, pbuf.data(), nth);
+      }
+    }
+  //adjust the a_lm for the new algorithm
+  dcmplx * DUCC0_RESTRICT alm=job.almtmp;
+  for (size_t k=0; k<nt; ++k)
+    {
+    dcmplx alm2 = 0.;
+    double alold=0;
+    for (size_t il=0, l=gen.m; l<=gen.lmax; ++il,l+=2)
+      {
+      dcmplx al = alm[l*nt+k];
+      dcmplx al1 = (l+1>gen.lmax) ? 0. : alm[(l+1)*nt+k];
+      alm[l*nt+k] = gen.alpha[il]*gen.eps[l+1]*al + alold*gen.eps[l]*alm2;
+      alm[(l+1)*nt+k] = gen.alpha[il]*al1;
+      alm2=al;
+      alold=gen.alpha[il];
+      }
+    }
+  }
+
 DUCC0_NOINLINE static void inner_loop_a2m(sharp_job &job, const vector<bool> & ispair,
   const vector<double> &cth_, const vector<double> &sth_, size_t llim, size_t ulim,
   sharp_Ylmgen &gen, size_t mi, const vector<size_t> &mlim)
@@ -953,7 +1405,10 @@ DUCC0_NOINLINE static void inner_loop_a2m(sharp_job &job, const vector<bool> & i
     case SHARP_ALM2MAP:
     case SHARP_ALM2MAP_DERIV1:
       {
-      if (job.spin==0)
+      if ((job.spin==0) && (job.ntrans>1))
+        inner_loop_a2m_multi(job, ispair, cth_, sth_, llim, ulim, gen, mi,
+          mlim);
+      else if (job.spin==0)
         {
         //adjust the a_lm for the new algorithm
         dcmplx * DUCC0_RESTRICT alm=job.almtmp;
@@ -1106,7 +1561,10 @@ DUCC0_NOINLINE static void inner_loop_m2a(sharp_job &job, const vector<bool> &is
     {
     case SHARP_MAP2ALM:
       {
-      if (job.spin==0)
+      if ((job.spin==0) && (job.ntrans>1))
+        inner_loop_m2a_multi(job, ispair, cth_, sth_, llim, ulim, gen, mi,
+          mlim);
+      else if (job.spin==0)
         {
         const size_t nval=nv0*VLEN;
         size_t ith=0;
@@ -1195,15 +1653,16 @@ DUCC0_NOINLINE static void inner_loop_m2a(sharp_job &job, const vector<bool> &is
               d.s.p1pr[i]=d.s.p1pi[i]=d.s.p2pr[i]=d.s.p2pi[i]=0.;
               d.s.p1mr[i]=d.s.p1mi[i]=d.s.p2mr[i]=d.s.p2mi[i]=0.;
               }
-            calc_map2alm_spin(job, gen, d.v, nth);
+            job.deriv1 ?
+              calc_map2alm_deriv1(job, gen, d.v, nth) :
+              calc_map2alm_spin  (job, gen, d.v, nth);
             }
           }
         //adjust the a_lm for the new algorithm
+        auto nalm = job.nalm();
         for (size_t l=gen.mhi; l<=gen.lmax; ++l)
-          {
-          job.almtmp[2*l  ]*=gen.alpha[l];
-          job.almtmp[2*l+1]*=gen.alpha[l];
-          }
+          for (size_t i=0; i<nalm; ++i)
+            job.almtmp[nalm*l+i]*=gen.alpha[l];
         }
       break;
       }
@@ -1235,7 +1694,14 @@ size_t XARCH(sharp_max_nvec)(size_t spin)
 #define XSTR(a) STR(a)
 #define STR(a) #a
 const char *XARCH(sharp_architecture)()
-  { return XSTR(ARCH); }
+  {
+// the ARM SIMD backends are only selected at compile time
+#if defined(GENERIC_ARCH) && defined(DUCC0_SIMD_NEON)
+  return "neon";
+#else
+  return XSTR(ARCH);
+#endif
+  }
 #undef STR
 #undef XSTR
 
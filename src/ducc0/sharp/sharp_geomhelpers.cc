@@ -33,6 +33,7 @@
 #include "ducc0/math/constants.h"
 #include "ducc0/math/fft1d.h"
 #include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/useful_macros.h"
 #include "ducc0/math/math_utils.h"
 
 namespace ducc0 {
@@ -142,6 +143,214 @@ void sharp_standard_geom_info::get_ring(bool weighted, size_t iring, const any &
   else MR_fail("bad map data type",map.type().name());
   }
 
+namespace {
+
+/* Colatitude of HEALPix ring \a ring (1 to 4*nside-1, counted from the north
+   pole). Both HEALPix geometries use this, since their rings must agree bit
+   for bit; it is kept out of line so that the compiler cannot evaluate it
+   differently at the call sites (e.g. with -ffast-math). */
+DUCC0_NOINLINE double healpix_ring_theta(size_t nside, size_t ring)
+  {
+  size_t northring = (ring>2*nside) ? 4*nside-ring : ring;
+  double res = (northring<nside) ? 2*asin(northring/(sqrt(6.)*nside))
+             : acos((2*nside-northring)*((8.*nside)/(12*nside*nside)));
+  return (northring==ring) ? res : pi-res;
+  }
+
+/* Common base of the geometries below, whose rings are stored with a
+   constant pixel stride; the derived classes provide the ring offsets and
+   all other ring properties on demand instead of keeping per-ring records. */
+class sharp_strided_geom_info: public sharp_geom_info
+  {
+  protected:
+    ptrdiff_t stride;
+
+    virtual ptrdiff_t ofs(size_t iring) const = 0;
+
+  private:
+    template<typename T> void tclear (T *map) const
+      {
+      for (size_t i=0; i<nrings(); ++i)
+        {
+        T *DUCC0_RESTRICT p1=&map[ofs(i)];
+        size_t n=nph(i);
+        if (stride==1)
+          memset(p1,0,n*sizeof(T));
+        else
+          for (size_t m=0; m<n; ++m)
+            p1[ptrdiff_t(m)*stride]=T(0);
+        }
+      }
+    template<typename T> void tget (bool weighted, size_t iring, const T *map, double *ringtmp) const
+      {
+      const T *DUCC0_RESTRICT p1=&map[ofs(iring)];
+      double wgt = weighted ? weight(iring) : 1.;
+      for (size_t m=0, n=nph(iring); m<n; ++m)
+        ringtmp[m] = p1[ptrdiff_t(m)*stride]*wgt;
+      }
+    template<typename T> void tadd (bool weighted, size_t iring, const double *ringtmp, T *map) const
+      {
+      T *DUCC0_RESTRICT p1=&map[ofs(iring)];
+      double wgt = weighted ? weight(iring) : 1.;
+      for (size_t m=0, n=nph(iring); m<n; ++m)
+        p1[ptrdiff_t(m)*stride] += T(ringtmp[m]*wgt);
+      }
+
+  public:
+    sharp_strided_geom_info(ptrdiff_t stride_) : stride(stride_) {}
+
+    virtual void clear_map(const any &map) const
+      {
+      if (map.type()==typeid(double *)) tclear(any_cast<double *>(map));
+      else if (map.type()==typeid(float *)) tclear(any_cast<float *>(map));
+      else MR_fail("bad map data type");
+      }
+    virtual void get_ring(bool weighted, size_t iring, const any &map, double *ringtmp) const
+      {
+      if (map.type()==typeid(const double *)) tget(weighted, iring, any_cast<const double *>(map), ringtmp);
+      else if (map.type()==typeid(double *)) tget(weighted, iring, any_cast<double *>(map), ringtmp);
+      else if (map.type()==typeid(const float *)) tget(weighted, iring, any_cast<const float *>(map), ringtmp);
+      else if (map.type()==typeid(float *)) tget(weighted, iring, any_cast<float *>(map), ringtmp);
+      else MR_fail("bad map data type",map.type().name());
+      }
+    virtual void add_ring(bool weighted, size_t iring, const double *ringtmp, const any &map) const
+      {
+      if (map.type()==typeid(double *)) tadd(weighted, iring, ringtmp, any_cast<double *>(map));
+      else if (map.type()==typeid(float *)) tadd(weighted, iring, ringtmp, any_cast<float *>(map));
+      else MR_fail("bad map data type");
+      }
+  };
+
+/* Full HEALPix map in RING order. All ring properties are computed from
+   Nside, so construction is O(1) (apart from copying the optional ring
+   weights). Ring i is the (i+1)-th ring counted from the north pole; the
+   pairs are ordered like in sharp_standard_geom_info. */
+class sharp_healpix_geom_info: public sharp_strided_geom_info
+  {
+  private:
+    size_t nside, npix, ncap;
+    vector<double> wgt; // relative ring weights, empty if all are 1
+
+    size_t northring(size_t iring) const
+      { return (iring<2*nside) ? iring+1 : 4*nside-1-iring; }
+
+  protected:
+    virtual ptrdiff_t ofs(size_t iring) const
+      {
+      size_t nr=northring(iring);
+      size_t res = (nr<nside) ? 2*nr*(nr-1) : ncap+(nr-nside)*4*nside;
+      if (nr!=iring+1) // southern hemisphere
+        res = npix-nph(iring)-res;
+      return ptrdiff_t(res)*stride;
+      }
+
+  public:
+    sharp_healpix_geom_info(size_t nside_, ptrdiff_t stride_,
+      const double *weight)
+      : sharp_strided_geom_info(stride_), nside(nside_), npix(12*nside*nside),
+        ncap(2*nside*(nside-1))
+      {
+      MR_assert(nside>0, "Nside must be positive");
+      if (weight!=nullptr) wgt.assign(weight, weight+2*nside);
+      }
+    virtual size_t nrings() const { return 4*nside-1; }
+    virtual size_t npairs() const { return 2*nside; }
+    virtual size_t nph(size_t iring) const
+      {
+      size_t nr=northring(iring);
+      return (nr<nside) ? 4*nr : 4*nside;
+      }
+    virtual size_t nphmax() const { return 4*nside; }
+    virtual double theta(size_t iring) const
+      { return healpix_ring_theta(nside, iring+1); }
+    virtual double cth(size_t iring) const { return cos(theta(iring)); }
+    virtual double sth(size_t iring) const { return sin(theta(iring)); }
+    virtual double phi0(size_t iring) const
+      {
+      size_t nr=northring(iring);
+      return ((nr>=nside) && ((nr-nside)&1)) ? 0. : pi/nph(iring);
+      }
+    virtual double weight(size_t iring) const
+      { return 4.*pi/npix*(wgt.empty() ? 1. : wgt[northring(iring)-1]); }
+    virtual Tpair pair(size_t ipair) const
+      {
+      // the polar rings with increasing nph come first, then the
+      // equatorial ones with phi0==0, and finally those with phi0>0
+      size_t nr;
+      if (ipair+1<nside)
+        nr = ipair+1;
+      else
+        {
+        size_t j=ipair+1-nside, nodd=(nside+1)/2;
+        nr = nside + ((j<nodd) ? 2*j+1 : 2*(j-nodd));
+        }
+      return (nr==2*nside) ? Tpair{nr-1, ~size_t(0)}
+                           : Tpair{nr-1, 4*nside-1-nr};
+      }
+  };
+
+/* Grids with \a nphi pixels and the same phi0 in every ring and ring
+   offsets which are multiples of \a stride_lat (Gauss-Legendre, Fejer,
+   Clenshaw-Curtis, Driscoll-Healy, McEwen-Wiaux). Only the colatitudes
+   and the weights are stored per ring. */
+class sharp_iso_geom_info: public sharp_strided_geom_info
+  {
+  private:
+    size_t nphi;
+    double phi0_;
+    ptrdiff_t stride_lat;
+    vector<double> theta_, weight_; // weight_ is empty if all weights are 1
+    vector<Tpair> pair_;
+
+  protected:
+    virtual ptrdiff_t ofs(size_t iring) const
+      { return ptrdiff_t(iring)*stride_lat; }
+
+  public:
+    /* \a theta must be in ascending order. */
+    sharp_iso_geom_info(size_t nphi_, double phi0__, ptrdiff_t stride_lon,
+      ptrdiff_t stride_lat_, vector<double> &&theta, vector<double> &&weight)
+      : sharp_strided_geom_info(stride_lon), nphi(nphi_), phi0_(phi0__),
+        stride_lat(stride_lat_), theta_(move(theta)), weight_(move(weight))
+      {
+      size_t nr=theta_.size();
+      MR_assert(nr>0, "need at least one ring");
+      MR_assert(weight_.empty() || (weight_.size()==nr),
+        "bad number of weights");
+      for (size_t i=1; i<nr; ++i)
+        MR_assert(theta_[i]>=theta_[i-1], "theta must be ascending");
+      // match rings on both hemispheres from the outside in; the northern
+      // ring of a pair is r1
+      for (size_t i=0, j=nr-1; i<=j; )
+        {
+        if (i==j)
+          { pair_.push_back({i, ~size_t(0)}); break; }
+        double c1=cth(i), c2=cth(j);
+        if (approx(c1,-c2,1e-12))
+          { pair_.push_back({i, j}); ++i; --j; }
+        else if (abs(c1)>abs(c2))
+          { pair_.push_back({i, ~size_t(0)}); ++i; }
+        else
+          { pair_.push_back({j, ~size_t(0)}); --j; }
+        }
+      sort(pair_.begin(), pair_.end(), [this] (const Tpair &a, const Tpair &b)
+        { return cth(a.r1)>cth(b.r1); });
+      }
+    virtual size_t nrings() const { return theta_.size(); }
+    virtual size_t npairs() const { return pair_.size(); }
+    virtual size_t nph(size_t /*iring*/) const { return nphi; }
+    virtual size_t nphmax() const { return nphi; }
+    virtual double theta(size_t iring) const { return theta_[iring]; }
+    virtual double cth(size_t iring) const { return cos(theta_[iring]); }
+    virtual double sth(size_t iring) const { return sin(theta_[iring]); }
+    virtual double phi0(size_t /*iring*/) const { return phi0_; }
+    virtual double weight(size_t iring) const
+      { return weight_.empty() ? 1. : weight_[iring]; }
+    virtual Tpair pair(size_t ipair) const { return pair_[ipair]; }
+  };
+
+} // unnamed namespace
+
 unique_ptr<sharp_geom_info> sharp_make_subset_healpix_geom_info (size_t nside, ptrdiff_t stride, size_t nrings,
   const size_t *rings, const double *weight)
   {
@@ -156,18 +365,15 @@ unique_ptr<sharp_geom_info> sharp_make_subset_healpix_geom_info (size_t nside, p
     {
     auto ring = (rings==nullptr)? (m+1) : rings[m];
     size_t northring = (ring>2*nside) ? 4*nside-ring : ring;
+    theta[m] = healpix_ring_theta(nside, ring);
     if (northring < nside)
       {
-      theta[m] = 2*asin(northring/(sqrt(6.)*nside));
       nph[m] = 4*northring;
       phi0[m] = pi/nph[m];
       checkofs = ptrdiff_t(2*northring*(northring-1))*stride;
       }
     else
       {
-      double fact1 = (8.*nside)/npix;
-      double costheta = (2*nside-northring)*fact1;
-      theta[m] = acos(costheta);
       nph[m] = 4*nside;
       if ((northring-nside) & 1)
         phi0[m] = 0;
@@ -178,7 +384,6 @@ unique_ptr<sharp_geom_info> sharp_make_subset_healpix_geom_info (size_t nside, p
       }
     if (northring != ring) /* southern hemisphere */
       {
-      theta[m] = pi-theta[m];
       checkofs = ptrdiff_t(npix - nph[m])*stride - checkofs;
       ofs[m] = curofs;
       }
@@ -195,36 +400,29 @@ unique_ptr<sharp_geom_info> sharp_make_subset_healpix_geom_info (size_t nside, p
 unique_ptr<sharp_geom_info> sharp_make_weighted_healpix_geom_info (size_t nside, ptrdiff_t stride,
   const double *weight)
   {
-  return sharp_make_subset_healpix_geom_info(nside, stride, 4*nside-1, nullptr, weight);
+  return make_unique<sharp_healpix_geom_info>(nside, stride, weight);
   }
 
 unique_ptr<sharp_geom_info> sharp_make_gauss_geom_info (size_t nrings, size_t nphi, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<size_t> nph(nrings, nphi);
-  vector<double> phi0_(nrings, phi0);
-  vector<ptrdiff_t> ofs(nrings);
-
   ducc0::GL_Integrator integ(nrings);
   auto theta = integ.coords();
   auto weight = integ.weights();
   for (size_t m=0; m<nrings; ++m)
     {
     theta[m] = acos(-theta[m]);
-    ofs[m]=ptrdiff_t(m)*stride_lat;
     weight[m]*=2*pi/nphi;
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), weight.data());
+  return make_unique<sharp_iso_geom_info>(nphi, phi0, stride_lon, stride_lat, move(theta), move(weight));
   }
 
 /* Weights from Waldvogel 2006: BIT Numerical Mathematics 46, p. 195 */
 unique_ptr<sharp_geom_info> sharp_make_fejer1_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<double> theta(nrings), weight(nrings), phi0_(nrings, phi0);
-  vector<size_t> nph(nrings, ppring);
-  vector<ptrdiff_t> ofs(nrings);
+  vector<double> theta(nrings), weight(nrings);
 
   weight[0]=2.;
   for (size_t k=1; k<=(nrings-1)/2; ++k)
@@ -242,21 +440,17 @@ unique_ptr<sharp_geom_info> sharp_make_fejer1_geom_info (size_t nrings, size_t p
     {
     theta[m]=pi*(m+0.5)/nrings;
     theta[nrings-1-m]=pi-theta[m];
-    ofs[m]=ptrdiff_t(m)*stride_lat;
-    ofs[nrings-1-m]=ptrdiff_t(nrings-1-m)*stride_lat;
-    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/(nrings*nph[m]);
+    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/(nrings*ppring);
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), weight.data());
+  return make_unique<sharp_iso_geom_info>(ppring, phi0, stride_lon, stride_lat, move(theta), move(weight));
   }
 
 /* Weights from Waldvogel 2006: BIT Numerical Mathematics 46, p. 195 */
 unique_ptr<sharp_geom_info> sharp_make_cc_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<double> theta(nrings), weight(nrings,0.), phi0_(nrings, phi0);
-  vector<size_t> nph(nrings, ppring);
-  vector<ptrdiff_t> ofs(nrings);
+  vector<double> theta(nrings), weight(nrings,0.);
 
   size_t n=nrings-1;
   double dw=-1./(n*n-1.+(n&1));
@@ -275,12 +469,10 @@ unique_ptr<sharp_geom_info> sharp_make_cc_geom_info (size_t nrings, size_t pprin
     theta[m]=pi*m/(nrings-1.);
     if (theta[m]<1e-15) theta[m]=1e-15;
     theta[nrings-1-m]=pi-theta[m];
-    ofs[m]=ptrdiff_t(m)*stride_lat;
-    ofs[nrings-1-m]=ptrdiff_t(nrings-1-m)*stride_lat;
-    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/(n*nph[m]);
+    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/(n*ppring);
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), weight.data());
+  return make_unique<sharp_iso_geom_info>(ppring, phi0, stride_lon, stride_lat, move(theta), move(weight));
   }
 
 static vector<double> get_dh_weights(size_t nrings)
@@ -302,57 +494,205 @@ static vector<double> get_dh_weights(size_t nrings)
 unique_ptr<sharp_geom_info> sharp_make_fejer2_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<double> theta(nrings), weight(get_dh_weights(nrings+1)), phi0_(nrings, phi0);
-  vector<size_t> nph(nrings, ppring);
-  vector<ptrdiff_t> ofs(nrings);
+  vector<double> theta(nrings), weight(get_dh_weights(nrings+1));
 
   for (size_t m=0; m<nrings; ++m)
     weight[m]=weight[m+1];
+  weight.resize(nrings);
 
   for (size_t m=0; m<(nrings+1)/2; ++m)
     {
     theta[m]=pi*(m+1)/(nrings+1.);
     theta[nrings-1-m]=pi-theta[m];
-    ofs[m]=ptrdiff_t(m)*stride_lat;
-    ofs[nrings-1-m]=ptrdiff_t(nrings-1-m)*stride_lat;
-    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/((nrings+1)*nph[m]);
+    weight[m]=weight[nrings-1-m]=weight[m]*2*pi/((nrings+1)*ppring);
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), weight.data());
+  return make_unique<sharp_iso_geom_info>(ppring, phi0, stride_lon, stride_lat, move(theta), move(weight));
   }
 
 unique_ptr<sharp_geom_info> sharp_make_dh_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<double> theta(nrings), weight(get_dh_weights(nrings)), phi0_(nrings, phi0);
-  vector<size_t> nph(nrings, ppring);
-  vector<ptrdiff_t> ofs(nrings);
+  vector<double> theta(nrings), weight(get_dh_weights(nrings));
 
   for (size_t m=0; m<nrings; ++m)
     {
     theta[m] = m*pi/nrings;
-    ofs[m] = ptrdiff_t(m)*stride_lat;
     weight[m]*=2*pi/(nrings*ppring);
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), weight.data());
+  return make_unique<sharp_iso_geom_info>(ppring, phi0, stride_lon, stride_lat, move(theta), move(weight));
   }
 
 unique_ptr<sharp_geom_info> sharp_make_mw_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat)
   {
-  vector<double> theta(nrings), phi0_(nrings, phi0);
-  vector<size_t> nph(nrings, ppring);
-  vector<ptrdiff_t> ofs(nrings);
+  vector<double> theta(nrings);
 
   for (size_t m=0; m<nrings; ++m)
     {
     theta[m]=pi*(2.*m+1.)/(2.*nrings-1.);
     if (theta[m]>pi-1e-15) theta[m]=pi-1e-15;
-    ofs[m]=ptrdiff_t(m)*stride_lat;
     }
 
-  return make_unique<sharp_standard_geom_info>(nrings, nph.data(), ofs.data(), stride_lon, phi0_.data(), theta.data(), nullptr);
+  return make_unique<sharp_iso_geom_info>(ppring, phi0, stride_lon, stride_lat, move(theta), vector<double>());
+  }
+
+
+namespace {
+
+/* Returns true if |lambda_lm(theta)| reaches exp(logthresh) for any l with
+   m<=l<=lmax. The values are obtained from the standard recursion in l,
+   starting at lambda_mm; their logarithmic scale is tracked separately to
+   avoid underflow. */
+bool ylm_reaches(size_t lmax, size_t m, double sth, double cth,
+  double logthresh)
+  {
+  constexpr double big=1e100;
+  const double logbig=log(big);
+  // log|lambda_mm| = log(sqrt((2m+1)/(4pi)*(2m-1)!!/(2m)!!)*sin^m(theta))
+  double logscale = 0.5*(log((2.*m+1.)/(4*pi)) + lgamma(2.*m+1.)
+    - m*log(4.) - 2*lgamma(m+1.)) + m*log(sth);
+  if (logscale>=logthresh) return true;
+  double thresh = exp(logthresh-logscale);
+  double lam=1., lam_prev=0.;
+  for (size_t l=m+1; l<=lmax; ++l)
+    {
+    double lnew;
+    if (l==m+1)
+      lnew = cth*sqrt(2.*m+3.)*lam;
+    else
+      {
+      double dl=double(l), dm=double(m);
+      double a = sqrt((4.*dl*dl-1.)/(dl*dl-dm*dm)),
+             b = sqrt(((dl-1.)*(dl-1.)-dm*dm)/(4.*(dl-1.)*(dl-1.)-1.));
+      lnew = a*(cth*lam - b*lam_prev);
+      }
+    lam_prev=lam; lam=lnew;
+    if (abs(lam)>=thresh) return true;
+    if (abs(lam)>big)
+      {
+      lam/=big; lam_prev/=big;
+      logscale+=logbig;
+      thresh = exp(logthresh-logscale);
+      }
+    }
+  return false;
+  }
+
+/* Counterpart of sharp_get_mlim() which determines the m limit of a ring
+   from the accuracy \a epsilon: for spin 0, it is the largest m for which
+   ylm_reaches() is true; the spin dependence is the same as in
+   sharp_get_mlim(). */
+size_t sharp_get_mlim_eps (size_t lmax, size_t spin, double sth, double cth,
+  double epsilon)
+  {
+  if (sth<=0.) return min(spin, lmax);
+  double logthresh = log(epsilon*sqrt((2.*lmax+1.)/(4*pi)));
+  // everything up to the turning point l*sin(theta)=m is kept
+  size_t lo = min(lmax, size_t(lmax*sth)), hi=lmax;
+  size_t mneed = lmax;
+  if (!ylm_reaches(lmax, hi, sth, cth, logthresh))
+    {
+    while (hi-lo>1)
+      {
+      size_t mid = lo+(hi-lo)/2;
+      if (ylm_reaches(lmax, mid, sth, cth, logthresh))
+        lo = mid;
+      else
+        hi = mid;
+      }
+    mneed = lo;
+    }
+  double t1 = mneed+1.;
+  double b = -2*double(spin)*abs(cth);
+  double c = double(spin)*spin-t1*t1;
+  double discr = b*b-4*c;
+  if (discr<=0) return lmax;
+  double res=(-b+sqrt(discr))/2.;
+  if (res>lmax) res=lmax;
+  return size_t(res+0.5);
+  }
+
+/* Selection of rings from another geometry; see
+   sharp_make_cutsky_geom_info(). */
+class sharp_cutsky_geom_info: public sharp_geom_info
+  {
+  private:
+    const sharp_geom_info &base;
+    vector<size_t> ring_; // index of every selected ring in base
+    vector<Tpair> pair_;
+    size_t nphmax_;
+    double epsilon;
+
+  public:
+    sharp_cutsky_geom_info(const sharp_geom_info &base_,
+      const vector<bool> &ring_mask, double epsilon_)
+      : base(base_), nphmax_(0), epsilon(epsilon_)
+      {
+      MR_assert(ring_mask.size()==base.nrings(), "bad size of ring mask");
+      MR_assert(epsilon>=0, "epsilon must not be negative");
+      constexpr size_t none=~size_t(0);
+      vector<size_t> idx(base.nrings(), none);
+      for (size_t i=0; i<base.nrings(); ++i)
+        if (ring_mask[i])
+          {
+          idx[i] = ring_.size();
+          ring_.push_back(i);
+          nphmax_ = max(nphmax_, base.nph(i));
+          }
+      // keep the pair order of base; pairs with one selected ring become
+      // single rings
+      for (size_t i=0; i<base.npairs(); ++i)
+        {
+        auto p = base.pair(i);
+        Tpair np{idx[p.r1], (p.r2==none) ? none : idx[p.r2]};
+        if (np.r1==none) swap(np.r1, np.r2);
+        if (np.r1!=none) pair_.push_back(np);
+        }
+      }
+    virtual size_t nrings() const { return ring_.size(); }
+    virtual size_t npairs() const { return pair_.size(); }
+    virtual size_t nph(size_t iring) const { return base.nph(ring_[iring]); }
+    virtual size_t nphmax() const { return nphmax_; }
+    virtual double theta(size_t iring) const { return base.theta(ring_[iring]); }
+    virtual double cth(size_t iring) const { return base.cth(ring_[iring]); }
+    virtual double sth(size_t iring) const { return base.sth(ring_[iring]); }
+    virtual double phi0(size_t iring) const { return base.phi0(ring_[iring]); }
+    virtual double weight(size_t iring) const { return base.weight(ring_[iring]); }
+    virtual Tpair pair(size_t ipair) const { return pair_[ipair]; }
+    virtual size_t mlim(size_t iring, size_t lmax, size_t spin) const
+      {
+      return (epsilon>0) ?
+        sharp_get_mlim_eps(lmax, spin, sth(iring), cth(iring), epsilon) :
+        base.mlim(ring_[iring], lmax, spin);
+      }
+    virtual void clear_map(const any &map) const
+      { base.clear_map(map); }
+    virtual void get_ring(bool weighted, size_t iring, const any &map, double *ringtmp) const
+      { base.get_ring(weighted, ring_[iring], map, ringtmp); }
+    virtual void add_ring(bool weighted, size_t iring, const double *ringtmp, const any &map) const
+      { base.add_ring(weighted, ring_[iring], ringtmp, map); }
+  };
+
+} // unnamed namespace
+
+unique_ptr<sharp_geom_info> sharp_make_cutsky_geom_info
+  (const sharp_geom_info &geom_info, const vector<bool> &ring_mask,
+  double epsilon)
+  { return make_unique<sharp_cutsky_geom_info>(geom_info, ring_mask, epsilon); }
+
+vector<bool> sharp_ring_mask (const sharp_geom_info &geom_info, const any &map)
+  {
+  vector<bool> res(geom_info.nrings());
+  vector<double> ringtmp(geom_info.nphmax());
+  for (size_t i=0; i<geom_info.nrings(); ++i)
+    {
+    geom_info.get_ring(false, i, map, ringtmp.data());
+    res[i] = any_of(ringtmp.begin(), ringtmp.begin()+geom_info.nph(i),
+      [](double v) { return v!=0.; });
+    }
+  return res;
   }
 
 }}
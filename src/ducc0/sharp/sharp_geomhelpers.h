@@ -75,6 +75,7 @@ class sharp_standard_geom_info: public sharp_geom_info
     virtual double cth(size_t iring) const { return ring[iring].cth; }
     virtual double sth(size_t iring) const { return ring[iring].sth; }
     virtual double phi0(size_t iring) const { return ring[iring].phi0; }
+    virtual double weight(size_t iring) const { return ring[iring].weight; }
     virtual Tpair pair(size_t ipair) const { return pair_[ipair]; }
     virtual void clear_map(const std::any &map) const;
     virtual void get_ring(bool weighted, size_t iring, const std::any &map, double *ringtmp) const;
@@ -193,6 +194,32 @@ std::unique_ptr<sharp_geom_info> sharp_make_dh_geom_info (size_t nrings, size_t
 std::unique_ptr<sharp_geom_info> sharp_make_mw_geom_info (size_t nrings, size_t ppring, double phi0,
   ptrdiff_t stride_lon, ptrdiff_t stride_lat);
 
+/*! Creates a geometry information for cut-sky transforms, which consists
+    of the rings \a iring of \a geom_info with \a ring_mask[iring]==true
+    (the mask has \a geom_info.nrings() entries, in the ring order of
+    \a geom_info). Transforms with it do no FFT or Legendre work for the
+    other rings: analysis transforms treat the other rings as zero,
+    synthesis transforms set them to zero (unless SHARP_ADD is given) and
+    leave them out otherwise.
+    If \a epsilon>0, the m range of every ring is truncated at the m above
+    which all |Y_lm| (l<=lmax) on this ring are smaller than \a epsilon
+    times sqrt((2*lmax+1)/(4*pi)), the largest |Y_lm| on the sphere, instead
+    of using sharp_get_mlim(). This is more aggressive near the poles for
+    moderate accuracies.
+    \note The returned object refers to \a geom_info, which must outlive
+      it.
+    \ingroup geominfogroup */
+std::unique_ptr<sharp_geom_info> sharp_make_cutsky_geom_info
+  (const sharp_geom_info &geom_info, const std::vector<bool> &ring_mask,
+  double epsilon=0.);
+
+/*! Returns a ring mask for sharp_make_cutsky_geom_info() which selects all
+    rings of \a geom_info containing at least one nonzero pixel of \a map,
+    which is passed like the maps of sharp_execute().
+    \ingroup geominfogroup */
+std::vector<bool> sharp_ring_mask (const sharp_geom_info &geom_info,
+  const std::any &map);
+
 }
 
 using detail_sharp::sharp_standard_geom_info;
@@ -205,6 +232,8 @@ using detail_sharp::sharp_make_fejer2_geom_info;
 using detail_sharp::sharp_make_cc_geom_info;
 using detail_sharp::sharp_make_dh_geom_info;
 using detail_sharp::sharp_make_mw_geom_info;
+using detail_sharp::sharp_make_cutsky_geom_info;
+using detail_sharp::sharp_ring_mask;
 
 }
 
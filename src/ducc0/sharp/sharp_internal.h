@@ -30,17 +30,23 @@
 
 #include <complex>
 #include <vector>
+#include <functional>
 #include "ducc0/sharp/sharp.h"
 #include "ducc0/infra/error_handling.h"
 
 namespace ducc0 {
 
+namespace detail_communication { class Communicator; }
+
 namespace detail_sharp {
 
 static constexpr int sharp_minscale=0, sharp_limscale=1, sharp_maxscale=1;
 static constexpr double sharp_fbig=0x1p+800,sharp_fsmall=0x1p-800;
 static constexpr double sharp_ftol=0x1p-60;
 static constexpr double sharp_fbighalf=0x1p+400;
+// maximum number of transforms handled by a single sharp_job; larger batches
+// are split to bound the size of the phase buffer
+static constexpr size_t sharp_ntrans_max=8;
 
 using std::complex;
 
@@ -104,34 +110,71 @@ class sharp_job
     void ringtmp2ring (size_t iring, const std::vector<double> &ringtmp, size_t rstride);
     void map2phase (size_t mmax, size_t llim, size_t ulim);
     void phase2map (size_t mmax, size_t llim, size_t ulim);
+    void phase2map2phase (sharp_job &adj, const std::any &weight,
+      size_t mmax, size_t llim, size_t ulim);
+    uint64_t legendre_pass (const std::vector<bool> &ispair,
+      const std::vector<double> &cth, const std::vector<double> &sth,
+      const std::vector<size_t> &mlim, size_t llim, size_t ulim);
 
   public:
     sharp_jobtype type;
     size_t spin;
+    size_t ntrans; // number of independent transforms processed together
+    bool deriv1; // first derivatives (or their adjoint) from a single a_lm
     size_t flags;
     size_t s_m, s_th; // strides in m and theta direction
     complex<double> *phase;
-    std::vector<double> norm_l;
+    const double *norm_l;
     complex<double> *almtmp;
+    const sharp_plan_impl &plan;
     const sharp_geom_info &ginfo;
     const sharp_alm_info &ainfo;
     int nthreads;
     double time;
     uint64_t opcnt;
+    // streaming transforms: ring data of the current chunk, and the offset
+    // of every ring's data in it; map[i] holds the component index
+    const double *ringbuf=nullptr;
+    const size_t *ringofs=nullptr;
 
     sharp_job(sharp_jobtype type,
       size_t spin, const std::vector<std::any> &alm_,
-      const std::vector<std::any> &map, const sharp_geom_info &geom_info,
-      const sharp_alm_info &alm_info, size_t flags, int nthreads_);
+      const std::vector<std::any> &map, const sharp_plan_impl &plan_,
+      size_t flags, int nthreads_);
 
     void alloc_phase (size_t nm, size_t ntheta, std::vector<complex<double>> &data);
     void alloc_almtmp (size_t lmax, std::vector<complex<double>> &data);
-    size_t nmaps() const { return 1+(spin>0); }
-    size_t nalm() const { return (type==SHARP_ALM2MAP_DERIV1) ? 1 : (1+(spin>0)); }
+    size_t ncomp_map() const { return 1+(spin>0); }
+    size_t ncomp_alm() const { return deriv1 ? 1 : (1+(spin>0)); }
+    size_t nmaps() const { return ntrans*ncomp_map(); }
+    size_t nalm() const { return ntrans*ncomp_alm(); }
 
     void execute();
+    /*! Variant of execute() for map2alm-type jobs which reads the rings of
+        every chunk via \a reader. */
+    void execute_streaming(const sharp_ring_reader &reader);
+    /*! Variant of execute() for synthesis jobs: multiplies the synthesized
+        maps with \a weight and adds the adjoint synthesis of the product to
+        \a alm_out, chunk by chunk, without storing any full maps. */
+    void execute_weighted(const std::vector<std::any> &alm_out,
+      const std::any &weight);
+    /*! Distributed variant of execute(): the job's geometry and a_lm
+        information describe the rings and m values owned by the calling
+        task. Defined in sharp_mpi.cc. */
+    void execute_mpi(const detail_communication::Communicator &comm);
   };
 
+void get_chunk_info (size_t ndata, size_t nmult, size_t &nchunks,
+  size_t &chunksize);
+
+/*! Builds a plan for \a geom_info and \a alm_info and calls \a exec on
+    every group of at most sharp_ntrans_max transforms. */
+void sharp_execute_jobs (sharp_jobtype type, size_t spin,
+  const std::vector<std::any> &alm, const std::vector<std::any> &map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt,
+  const std::function<void(sharp_job &)> &exec);
+
 void inner_loop (sharp_job &job, const std::vector<bool> &ispair,
   const std::vector<double> &cth, const std::vector<double> &sth, size_t llim,
   size_t ulim, sharp_Ylmgen &gen, size_t mi, const std::vector<size_t> &mlim);
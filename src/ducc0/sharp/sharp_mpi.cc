@@ -0,0 +1,275 @@
+/*
+ *  This file is part of libsharp2.
+ *
+ *  libsharp2 is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libsharp2 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libsharp2; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* libsharp2 is being developed at the Max-Planck-Institut fuer Astrophysik */
+
+/*! \file sharp_mpi.cc
+ *  Functionality only needed for MPI-parallel transforms
+ *
+ *  Copyright (C) 2012-2020 Max-Planck-Society
+ *  \author Martin Reinecke \author Dag Sverre Seljebotn
+ */
+
+#include <algorithm>
+#include "ducc0/sharp/sharp_mpi.h"
+#include "ducc0/sharp/sharp_internal.h"
+#include "ducc0/infra/communication.h"
+#include "ducc0/infra/error_handling.h"
+#include "ducc0/infra/timers.h"
+
+namespace ducc0 {
+
+namespace detail_sharp {
+
+using namespace std;
+
+using dcmplx = complex<double>;
+
+/* The Legendre transforms are done by the owners of the m values, the FFTs
+   by the owners of the rings. Every chunk of ring pairs consists of an equal
+   share of every task's pairs; between the two steps the phase data of the
+   chunk are transposed with a single all-to-all exchange. */
+DUCC0_NOINLINE void sharp_job::execute_mpi(const Communicator &comm)
+  {
+  ducc0::SimpleTimer timer;
+  opcnt=0;
+  size_t ntasks=comm.num_ranks(), rank=comm.rank();
+
+  size_t lmax = ainfo.lmax();
+  MR_assert((comm.allreduce(long(lmax), Communicator::Max)==long(lmax))
+         && (comm.allreduce(long(lmax), Communicator::Min)==long(lmax)),
+    "lmax must be identical on all tasks");
+
+/* gather the m values of all tasks */
+  size_t nm = ainfo.nm();
+  vector<int> nm_all = comm.allgatherVec(int(nm)), mdisp(ntasks,0);
+  for (size_t i=1; i<ntasks; ++i) mdisp[i]=mdisp[i-1]+nm_all[i-1];
+  vector<long> mval_loc(nm), mval_all(mdisp[ntasks-1]+nm_all[ntasks-1]);
+  for (size_t mi=0; mi<nm; ++mi) mval_loc[mi]=ainfo.mval(mi);
+  comm.allgathervRaw(mval_loc.data(), int(nm), mval_all.data(),
+    nm_all.data(), mdisp.data());
+  size_t mmax=0;
+  for (auto m: mval_all) mmax=max(mmax, size_t(m));
+  {
+  vector<bool> mcheck(mmax+1, false);
+  for (auto m: mval_all)
+    {
+    MR_assert(!mcheck[m], "m value owned by more than one task");
+    mcheck[m]=true;
+    }
+  }
+
+/* gather the ring pair properties of all tasks */
+  size_t npairs = ginfo.npairs();
+  vector<int> np_all = comm.allgatherVec(int(npairs)), pdisp(ntasks,0);
+  for (size_t i=1; i<ntasks; ++i) pdisp[i]=pdisp[i-1]+np_all[i-1];
+  size_t npairs_tot = pdisp[ntasks-1]+np_all[ntasks-1];
+  MR_assert(npairs_tot>0, "no rings provided");
+  vector<double> cth_loc(npairs), sth_loc(npairs),
+                 cth_all(npairs_tot), sth_all(npairs_tot);
+  vector<int> ispair_loc(npairs), ispair_all(npairs_tot);
+  for (size_t i=0; i<npairs; ++i)
+    {
+    cth_loc[i] = ginfo.cth(ginfo.pair(i).r1);
+    sth_loc[i] = ginfo.sth(ginfo.pair(i).r1);
+    ispair_loc[i] = ginfo.pair(i).r2!=~size_t(0);
+    }
+  comm.allgathervRaw(cth_loc.data(), int(npairs), cth_all.data(),
+    np_all.data(), pdisp.data());
+  comm.allgathervRaw(sth_loc.data(), int(npairs), sth_all.data(),
+    np_all.data(), pdisp.data());
+  comm.allgathervRaw(ispair_loc.data(), int(npairs), ispair_all.data(),
+    np_all.data(), pdisp.data());
+
+  size_t nchunks, chunksize;
+  get_chunk_info(npairs_tot, sharp_veclen()*sharp_max_nvec(spin), nchunks,
+    chunksize);
+  // task q contributes its pairs [np_all[q]*c/nchunks, np_all[q]*(c+1)/nchunks)
+  // to chunk c
+  auto plo = [&](size_t q, size_t c) { return np_all[q]*c/nchunks; };
+  size_t ncmax=0, nlocmax=0;
+  for (size_t c=0; c<nchunks; ++c)
+    {
+    size_t nc=0;
+    for (size_t q=0; q<ntasks; ++q)
+      nc += plo(q,c+1)-plo(q,c);
+    ncmax = max(ncmax, nc);
+    nlocmax = max(nlocmax, plo(rank,c+1)-plo(rank,c));
+    }
+
+/* clear output arrays if requested */
+  init_output();
+
+  // phase data of a chunk for the local m values (Legendre side) ...
+  vector<dcmplx> mphasebuf;
+  alloc_phase(nm, ncmax, mphasebuf);
+  dcmplx *mphase=phase;
+  size_t ms_m=s_m, ms_th=s_th;
+  // ... and for the local rings (FFT side)
+  vector<dcmplx> rphasebuf;
+  alloc_phase(mmax+1, nlocmax, rphasebuf);
+  dcmplx *rphase=phase;
+  size_t rs_m=s_m, rs_th=s_th;
+
+  size_t nblk=2*nmaps(); // complex values per ring pair and m
+  // everything needed to finish a chunk while the next one is in flight
+  struct chunk_data
+    {
+    size_t nc, llim, ulim;
+    vector<size_t> coff;
+    vector<bool> ispair;
+    vector<double> cth, sth;
+    vector<size_t> mlim;
+    vector<int> nsend, dsend, nrecv, drecv;
+    vector<dcmplx> sendbuf, recvbuf;
+    Communicator::Request req;
+    };
+  chunk_data cdata[2];
+
+  auto setup_chunk = [&](size_t c, chunk_data &cd)
+    {
+    cd.coff.resize(ntasks);
+    cd.nc=0;
+    for (size_t q=0; q<ntasks; ++q)
+      {
+      cd.coff[q]=cd.nc;
+      cd.nc += plo(q,c+1)-plo(q,c);
+      }
+    cd.ispair.resize(cd.nc); cd.cth.resize(cd.nc); cd.sth.resize(cd.nc);
+    cd.mlim.resize(cd.nc);
+    for (size_t q=0; q<ntasks; ++q)
+      for (size_t j=0, i=pdisp[q]+plo(q,c); j<plo(q,c+1)-plo(q,c); ++j, ++i)
+        {
+        cd.ispair[cd.coff[q]+j] = ispair_all[i]!=0;
+        cd.cth[cd.coff[q]+j] = cth_all[i];
+        cd.sth[cd.coff[q]+j] = sth_all[i];
+        cd.mlim[cd.coff[q]+j] = sharp_get_mlim(lmax, spin, sth_all[i],
+          cth_all[i]);
+        }
+    cd.llim=plo(rank,c); cd.ulim=plo(rank,c+1);
+    size_t nloc=cd.ulim-cd.llim;
+
+    // message sizes in doubles; the Legendre side sends in (mi, pair) order
+    cd.nsend.resize(ntasks); cd.dsend.resize(ntasks);
+    cd.nrecv.resize(ntasks); cd.drecv.resize(ntasks);
+    for (size_t q=0; q<ntasks; ++q)
+      {
+      size_t nq=plo(q,c+1)-plo(q,c);
+      size_t nm_side = (type==SHARP_MAP2ALM) ? nm_all[q]*nloc : nm*nq,
+             nr_side = (type==SHARP_MAP2ALM) ? nm*nq : nm_all[q]*nloc;
+      cd.nsend[q] = int(2*nblk*nm_side);
+      cd.nrecv[q] = int(2*nblk*nr_side);
+      cd.dsend[q] = (q==0) ? 0 : cd.dsend[q-1]+cd.nsend[q-1];
+      cd.drecv[q] = (q==0) ? 0 : cd.drecv[q-1]+cd.nrecv[q-1];
+      }
+    cd.sendbuf.resize((cd.dsend[ntasks-1]+cd.nsend[ntasks-1])/2);
+    cd.recvbuf.resize((cd.drecv[ntasks-1]+cd.nrecv[ntasks-1])/2);
+    };
+  auto start_exchange = [&](chunk_data &cd)
+    {
+    cd.req = comm.iall2allvRaw(reinterpret_cast<double *>(cd.sendbuf.data()),
+      cd.nsend.data(), cd.dsend.data(),
+      reinterpret_cast<double *>(cd.recvbuf.data()), cd.nrecv.data(),
+      cd.drecv.data());
+    };
+  auto legendre = [&](chunk_data &cd)
+    {
+    phase=mphase; s_m=ms_m; s_th=ms_th;
+    opcnt += legendre_pass(cd.ispair, cd.cth, cd.sth, cd.mlim, 0, cd.nc);
+    };
+
+/* chunk loop: the phase exchange of one chunk overlaps with the Legendre
+   transform (alm2map) or the FFTs (map2alm) of the next one */
+  for (size_t c=0; c<=nchunks; ++c)
+    {
+    if (c<nchunks)
+      {
+      auto &cd(cdata[c&1]);
+      setup_chunk(c, cd);
+      size_t nloc=cd.ulim-cd.llim;
+      if (type==SHARP_MAP2ALM)
+        {
+/* map->phase on the ring side */
+        phase=rphase; s_m=rs_m; s_th=rs_th;
+        map2phase(mmax, cd.llim, cd.ulim);
+        for (size_t q=0, idx=0; q<ntasks; ++q)
+          for (size_t mi=0; mi<size_t(nm_all[q]); ++mi)
+            {
+            size_t m=mval_all[mdisp[q]+mi];
+            for (size_t j=0; j<nloc; ++j, idx+=nblk)
+              copy_n(rphase+j*rs_th+m*rs_m, nblk, cd.sendbuf.data()+idx);
+            }
+        }
+      else
+        {
+/* Legendre transform on the m side */
+        legendre(cd);
+        for (size_t q=0, idx=0; q<ntasks; ++q)
+          for (size_t mi=0; mi<nm; ++mi)
+            for (size_t j=0; j<plo(q,c+1)-plo(q,c); ++j, idx+=nblk)
+              copy_n(mphase+(cd.coff[q]+j)*ms_th+mi*ms_m, nblk,
+                cd.sendbuf.data()+idx);
+        }
+      start_exchange(cd);
+      }
+    if (c>0)
+      {
+      auto &cd(cdata[(c-1)&1]);
+      cd.req.wait();
+      size_t nloc=cd.ulim-cd.llim;
+      if (type==SHARP_MAP2ALM)
+        {
+        for (size_t q=0, idx=0; q<ntasks; ++q)
+          for (size_t mi=0; mi<nm; ++mi)
+            for (size_t j=0; j<plo(q,c)-plo(q,c-1); ++j, idx+=nblk)
+              copy_n(cd.recvbuf.data()+idx, nblk,
+                mphase+(cd.coff[q]+j)*ms_th+mi*ms_m);
+/* Legendre transform on the m side */
+        legendre(cd);
+        }
+      else
+        {
+        // m values owned by no task must not contribute
+        fill(rphasebuf.begin(), rphasebuf.end(), dcmplx(0));
+        for (size_t q=0, idx=0; q<ntasks; ++q)
+          for (size_t mi=0; mi<size_t(nm_all[q]); ++mi)
+            {
+            size_t m=mval_all[mdisp[q]+mi];
+            for (size_t j=0; j<nloc; ++j, idx+=nblk)
+              copy_n(cd.recvbuf.data()+idx, nblk, rphase+j*rs_th+m*rs_m);
+            }
+/* phase->map on the ring side */
+        phase=rphase; s_m=rs_m; s_th=rs_th;
+        phase2map(mmax, cd.llim, cd.ulim);
+        }
+      }
+    } /* end of chunk loop */
+
+  time=timer();
+  }
+
+void sharp_execute_mpi (const Communicator &comm, sharp_jobtype type,
+  size_t spin, const vector<any> &alm, const vector<any> &map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads, double *time, uint64_t *opcnt)
+  {
+  sharp_execute_jobs(type, spin, alm, map, geom_info, alm_info, flags,
+    nthreads, time, opcnt, [&comm](sharp_job &job) { job.execute_mpi(comm); });
+  }
+
+}}
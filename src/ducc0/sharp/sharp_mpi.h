@@ -0,0 +1,99 @@
+/*
+ *  This file is part of libsharp2.
+ *
+ *  libsharp2 is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libsharp2 is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with libsharp2; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* libsharp2 is being developed at the Max-Planck-Institut fuer Astrophysik */
+
+/*! \file sharp_mpi.h
+ *  Interface for the spherical transform library with MPI support.
+ *
+ *  Copyright (C) 2011-2020 Max-Planck-Society
+ *  \author Martin Reinecke
+ */
+
+#ifndef SHARP2_MPI_H
+#define SHARP2_MPI_H
+
+#include "ducc0/sharp/sharp.h"
+#include "ducc0/infra/communication.h"
+
+namespace ducc0 {
+
+namespace detail_sharp {
+
+/*! Performs a distributed spherical transform.
+    Every task of \a comm passes the rings it owns in \a geom_info and the
+    m values it owns in \a alm_info; map and a_lm arrays only cover these
+    local parts. Rings and m values may be distributed arbitrarily, as long as
+    each ring and each m value is owned by exactly one task, and all tasks use
+    the same \a lmax and \a spin.
+    The phase arrays are redistributed between the ring and m decompositions
+    with one nonblocking all-to-all exchange per chunk of rings, which
+    overlaps with the computations for the next chunk.
+    All other parameters have the same meaning as for sharp_execute(). */
+void sharp_execute_mpi (const Communicator &comm, sharp_jobtype type,
+  size_t spin, const std::vector<std::any> &alm,
+  const std::vector<std::any> &map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr);
+
+template<typename T> void sharp_alm2map_mpi(const Communicator &comm,
+  const std::complex<T> *alm, T *map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute_mpi(comm, SHARP_Y, 0, {alm}, {map}, geom_info, alm_info,
+    flags, nthreads, time, opcnt);
+  }
+template<typename T> void sharp_alm2map_spin_mpi(const Communicator &comm,
+  size_t spin, const std::complex<T> *alm1, const std::complex<T> *alm2,
+  T *map1, T *map2,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute_mpi(comm, SHARP_Y, spin, {alm1, alm2}, {map1, map2},
+    geom_info, alm_info, flags, nthreads, time, opcnt);
+  }
+template<typename T> void sharp_map2alm_mpi(const Communicator &comm,
+  std::complex<T> *alm, const T *map,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute_mpi(comm, SHARP_Yt, 0, {alm}, {map}, geom_info, alm_info,
+    flags, nthreads, time, opcnt);
+  }
+template<typename T> void sharp_map2alm_spin_mpi(const Communicator &comm,
+  size_t spin, std::complex<T> *alm1, std::complex<T> *alm2,
+  const T *map1, const T *map2,
+  const sharp_geom_info &geom_info, const sharp_alm_info &alm_info,
+  size_t flags, int nthreads=1, double *time=nullptr, uint64_t *opcnt=nullptr)
+  {
+  sharp_execute_mpi(comm, SHARP_Yt, spin, {alm1, alm2}, {map1, map2},
+    geom_info, alm_info, flags, nthreads, time, opcnt);
+  }
+
+}
+
+using detail_sharp::sharp_execute_mpi;
+using detail_sharp::sharp_alm2map_mpi;
+using detail_sharp::sharp_alm2map_spin_mpi;
+using detail_sharp::sharp_map2alm_mpi;
+using detail_sharp::sharp_map2alm_spin_mpi;
+
+}
+
+#endif